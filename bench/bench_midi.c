@@ -0,0 +1,1107 @@
+/***********************************************************************
+ * @file bench_midi.c
+ * @brief Throughput and latency benchmark for the MIDI parser module
+ *
+ * @details Parses generated corpora (a dense piano performance,
+ *          controller sweeps under running status, a clock heavy
+ *          sequencer stream, SysEx dumps, a 16 channel firehose and
+ *          random garbage), and optionally raw MIDI files, with each
+ *          parser entry point, the UMP translator and a routing
+ *          chain. Reports bytes/s,
+ *          messages/s, ns/byte, cycles/byte and, where the kernel
+ *          exposes hardware counters, branch mispredictions per byte.
+ *
+ *          Usage: bench_midi [--json] [--latency] [--quick]
+ *                            [--corpus NAME] [--file PATH]...
+ *
+ *          --json     Print the results as JSON, for tracking regressions
+ *          --latency  Measure the time taken for each small chunk and
+ *                     report percentiles and a histogram instead
+ *          --quick    Use a small stream and a single repeat (smoke test)
+ *          --corpus   Only run the named corpus
+ *          --file     Add a corpus read from a raw MIDI byte file
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_route.h"
+#include "../midi/midi_voice.h"
+#include "../midi/midi_ump.h"
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC
+#endif
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Maximum size of a corpus in bytes
+ */
+#define BENCH_STREAM_SIZE (1u << 22)
+
+/**
+ * @brief Size of the generated corpora with --quick
+ */
+#define BENCH_QUICK_STREAM_SIZE (1u << 16)
+
+/**
+ * @brief Number of times the stream is parsed per measurement
+ */
+#define BENCH_REPEATS (8)
+
+/**
+ * @brief Chunk size used for the buffer parsers
+ */
+#define BENCH_CHUNK_SIZE (4096)
+
+/**
+ * @brief Chunk size used in latency mode
+ * @details The size of a typical USB-MIDI transfer or DMA half buffer
+ */
+#define BENCH_LATENCY_CHUNK_SIZE (64)
+
+/**
+ * @brief Number of buckets in the latency histogram
+ * @details Bucket n counts chunks that took [2^n, 2^(n+1)) ns
+ */
+#define BENCH_HISTOGRAM_BUCKETS (24)
+
+/**
+ * @brief Maximum number of corpora, including files
+ */
+#define BENCH_MAX_CORPORA (16)
+
+/*=====================================================================*
+    Private Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Benchmark corpus
+ */
+typedef struct bench_corpus_t {
+    /**
+     * @brief Name used in the output
+     */
+    const char *name;
+
+    /**
+     * @brief Generator, or NULL for a corpus read from a file
+     * @return The number of bytes generated
+     */
+    size_t (*generate)(void);
+
+    /**
+     * @brief Path of a corpus read from a file
+     */
+    const char *path;
+} bench_corpus_t;
+
+/**
+ * @brief Parser entry point under test
+ */
+typedef struct bench_entry_t {
+    /**
+     * @brief Name used in the output
+     */
+    const char *name;
+
+    /**
+     * @brief Parse stream[begin, end) with a parser set up by setup
+     * @return The number of messages parsed
+     */
+    size_t (*parse)(midi_parser_t *parser, size_t begin, size_t end);
+
+    /**
+     * @brief Configure a freshly initialized parser. May be NULL.
+     */
+    void (*setup)(midi_parser_t *parser);
+} bench_entry_t;
+
+/**
+ * @brief Results of one throughput measurement
+ */
+typedef struct bench_result_t {
+    double seconds;
+    double cycles;
+    long long branch_misses;
+    size_t messages;
+} bench_result_t;
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static uint8_t stream[BENCH_STREAM_SIZE];
+static size_t stream_size = BENCH_STREAM_SIZE;
+static size_t generate_size = BENCH_STREAM_SIZE;
+static midi_message_t messages[BENCH_CHUNK_SIZE];
+static midi_packed_t packed[BENCH_CHUNK_SIZE];
+static uint32_t ump_words[MIDI_UMP_MAX_WORDS * BENCH_CHUNK_SIZE];
+static midi_ump_encoder_t ump_encoder;
+static midi_ump_decoder_t ump_decoder;
+static midi_route_plan_t route_plan;
+static uint32_t route_storage[3 * BENCH_CHUNK_SIZE * 2];
+static midi_voice_allocator_t voice_allocator;
+static size_t voice_events;
+static double latencies[BENCH_STREAM_SIZE / BENCH_LATENCY_CHUNK_SIZE];
+static uint32_t random_state;
+static size_t realtime_events;
+static midi_dispatcher_t dispatcher;
+static int branch_counter = -1;
+static int cycle_counter = -1;
+
+/*=====================================================================*
+    Private Functions - Corpora
+ *=====================================================================*/
+
+/**
+ * @brief Deterministic pseudo random number generator (xorshift32)
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief Fill the rest of the stream with timing clock bytes
+ * @return The size of the stream
+ */
+static size_t pad_stream(size_t i)
+{
+    while (i < generate_size) { stream[i++] = MIDI_MESSAGE_TIMING_CLOCK; }
+    return generate_size;
+}
+
+/**
+ * @brief Generate a dense piano performance
+ * @details Chords of Note On messages under running status, released
+ *          with zero velocity Note On, with sustain pedal changes and
+ *          occasional Active Sensing
+ */
+static size_t generate_piano(void)
+{
+    size_t i = 0;
+    uint8_t held[4] = {0};
+    size_t held_count = 0;
+
+    stream[i++] = MIDI_MESSAGE_NOTE_ON;
+    while (i + 32 <= generate_size) {
+        uint32_t r = next_random();
+        switch (r & 0x1F) {
+        case 0:
+            /* Sustain pedal, then back to notes */
+            stream[i++] = MIDI_MESSAGE_CONTROL_CHANGE;
+            stream[i++] = MIDI_CC_SUSTAIN_PEDAL;
+            stream[i++] = (r & 0x100) ? 127 : 0;
+            stream[i++] = MIDI_MESSAGE_NOTE_ON;
+            break;
+        case 1:
+            stream[i++] = MIDI_MESSAGE_ACTIVE_SENSE;
+            break;
+        default:
+            /* Release the held notes, then play a new chord */
+            while (held_count > 0) {
+                stream[i++] = held[--held_count];
+                stream[i++] = 0;
+            }
+            for (uint32_t n = 0; n <= ((r >> 5) & 0x03); n++) {
+                uint8_t note = (uint8_t)(36 + ((r >> (8 + 4 * n)) % 60));
+                held[held_count++] = note;
+                stream[i++] = note;
+                stream[i++] = (uint8_t)(20 + ((r >> 20) % 100));
+            }
+            break;
+        }
+    }
+    return pad_stream(i);
+}
+
+/**
+ * @brief Generate dense controller sweeps under running status
+ * @details One Control Change status byte per 256 controller updates,
+ *          as produced by a fader or an MPE controller
+ */
+static size_t generate_controller_sweep(void)
+{
+    size_t i = 0;
+    uint8_t value = 0;
+
+    while (i + 3 <= generate_size) {
+        if ((i & 0x1FF) == 0) {
+            stream[i++] = MIDI_MESSAGE_CONTROL_CHANGE | 0x01;
+        }
+        stream[i++] = MIDI_CC_MOD_WHEEL;
+        stream[i++] = value++ & 0x7F;
+    }
+    return pad_stream(i);
+}
+
+/**
+ * @brief Generate a clock heavy sequencer stream
+ * @details Timing clock at 24 PPQN with a Song Position Pointer per bar
+ *          and a drum note on one clock in eight
+ */
+static size_t generate_clock_heavy(void)
+{
+    size_t i = 0;
+    uint32_t tick = 0;
+
+    stream[i++] = MIDI_MESSAGE_START;
+    while (i + 8 <= generate_size) {
+        uint32_t r = next_random();
+        stream[i++] = MIDI_MESSAGE_TIMING_CLOCK;
+        if (tick % 96 == 0) {
+            stream[i++] = MIDI_MESSAGE_SONG_POSITION_POINTER;
+            stream[i++] = (tick / 6) & 0x7F;
+            stream[i++] = (tick / 6 >> 7) & 0x7F;
+        }
+        if ((r & 0x07) == 0) {
+            stream[i++] = MIDI_MESSAGE_NOTE_ON | 0x09;
+            stream[i++] = (r >> 8) & 0x7F;
+            stream[i++] = (r >> 16) & 0x7F;
+        }
+        tick++;
+    }
+    return pad_stream(i);
+}
+
+/**
+ * @brief Generate SysEx dumps
+ * @details 4 KiB SysEx messages (as sent by a firmware or sample dump),
+ *          with a timing clock byte every 1000 bytes
+ */
+static size_t generate_sysex_dump(void)
+{
+    size_t i = 0;
+
+    while (i < generate_size) {
+        if (i % 1000 == 0) {
+            stream[i++] = MIDI_MESSAGE_TIMING_CLOCK;
+        } else if (i % 4096 == 0) {
+            stream[i++] = MIDI_MESSAGE_SYSTEM_EXCLUSIVE;
+        } else if (i % 4096 == 4095) {
+            stream[i++] = MIDI_MESSAGE_END_OF_EXCLUSIVE;
+        } else {
+            stream[i++] = next_random() & 0x7F;
+        }
+    }
+    return i;
+}
+
+/**
+ * @brief Generate a 16 channel firehose
+ * @details Runs of one to eight notes, controllers or pitch bends under
+ *          running status, on a random channel each
+ */
+static size_t generate_firehose(void)
+{
+    static const uint8_t types[] = {MIDI_MESSAGE_NOTE_ON,
+                                    MIDI_MESSAGE_NOTE_OFF,
+                                    MIDI_MESSAGE_CONTROL_CHANGE,
+                                    MIDI_MESSAGE_PITCH_BEND};
+    size_t i = 0;
+
+    while (i + 1 + 2 * 8 <= generate_size) {
+        uint32_t r = next_random();
+        stream[i++] = types[r & 0x03] | ((r >> 2) & 0x0F);
+        for (uint32_t n = 0; n <= ((r >> 6) & 0x07); n++) {
+            stream[i++] = (r >> 9) & 0x7F;
+            stream[i++] = (r >> (16 + n)) & 0x7F;
+        }
+    }
+    return pad_stream(i);
+}
+
+/**
+ * @brief Generate random garbage
+ * @details Uniformly random bytes, so half of them are status bytes
+ *          and most messages are interrupted
+ */
+static size_t generate_garbage(void)
+{
+    for (size_t i = 0; i < generate_size; i++) {
+        stream[i] = (uint8_t)next_random();
+    }
+    return generate_size;
+}
+
+/**
+ * @brief Read a corpus from a raw MIDI byte file
+ * @return The number of bytes read, or 0 on error
+ */
+static size_t load_file(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    size_t size;
+
+    if (file == NULL) {
+        fprintf(stderr, "bench_midi: cannot open %s\n", path);
+        return 0;
+    }
+    size = fread(stream, 1, BENCH_STREAM_SIZE, file);
+    fclose(file);
+    return size;
+}
+
+/*=====================================================================*
+    Private Functions - Handlers
+ *=====================================================================*/
+
+/**
+ * @brief Message handler that ignores the message
+ */
+static void ignore_message(void *context, const midi_message_t *message)
+{
+    (void)context;
+    (void)message;
+}
+
+/**
+ * @brief SysEx handler that ignores the span
+ */
+static void ignore_sysex_span(void *context, const midi_sysex_span_t *span)
+{
+    (void)context;
+    (void)span;
+}
+
+/**
+ * @brief Realtime handler that counts the events
+ */
+static void count_realtime(void *context, const midi_realtime_event_t *event)
+{
+    (void)context;
+    (void)event;
+    realtime_events++;
+}
+
+/**
+ * @brief Count the voice events
+ */
+static void count_voice_event(void *context, const midi_voice_event_t *event)
+{
+    (void)context;
+    (void)event;
+    voice_events++;
+}
+
+/*=====================================================================*
+    Private Functions - Entry Points
+ *=====================================================================*/
+
+/**
+ * @brief Parse the stream with midi_parse_byte
+ */
+static size_t parse_bytes(midi_parser_t *parser, size_t begin, size_t end)
+{
+    midi_message_t message;
+    size_t count = 0;
+
+    for (size_t i = begin; i < end; i++) {
+        if (midi_parse_byte(parser, stream[i], &message)
+            != MIDI_MESSAGE_NONE) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Parse the stream with midi_parse_buffer
+ */
+static size_t parse_buffer(midi_parser_t *parser, size_t begin, size_t end)
+{
+    size_t count = 0;
+
+    while (begin < end) {
+        size_t consumed;
+        size_t length = end - begin;
+        if (length > BENCH_CHUNK_SIZE) { length = BENCH_CHUNK_SIZE; }
+        count += midi_parse_buffer(parser,
+                                   &stream[begin],
+                                   length,
+                                   messages,
+                                   BENCH_CHUNK_SIZE,
+                                   &consumed);
+        begin += consumed;
+    }
+    return count;
+}
+
+/**
+ * @brief Parse the stream with midi_parse_buffer_packed
+ */
+static size_t
+parse_buffer_packed(midi_parser_t *parser, size_t begin, size_t end)
+{
+    size_t count = 0;
+
+    while (begin < end) {
+        size_t consumed;
+        size_t length = end - begin;
+        if (length > BENCH_CHUNK_SIZE) { length = BENCH_CHUNK_SIZE; }
+        count += midi_parse_buffer_packed(parser,
+                                          &stream[begin],
+                                          length,
+                                          packed,
+                                          BENCH_CHUNK_SIZE,
+                                          &consumed);
+        begin += consumed;
+    }
+    return count;
+}
+
+/**
+ * @brief Parse the stream with midi_parse_buffer_dispatch
+ * @details Handles Note On, Note Off and Control Change messages,
+ *          and ignores the rest
+ */
+static size_t
+parse_buffer_dispatch(midi_parser_t *parser, size_t begin, size_t end)
+{
+    size_t count = 0;
+
+    while (begin < end) {
+        size_t length = end - begin;
+        if (length > BENCH_CHUNK_SIZE) { length = BENCH_CHUNK_SIZE; }
+        count += midi_parse_buffer_dispatch(
+            parser, &dispatcher, &stream[begin], length);
+        begin += length;
+    }
+    return count;
+}
+
+/**
+ * @brief Parse the stream with midi_parse_buffer_packed and translate the
+ *        messages with midi_ump_from_packed
+ */
+static size_t
+translate_from_packed(midi_parser_t *parser, size_t begin, size_t end)
+{
+    size_t count = 0;
+
+    while (begin < end) {
+        size_t consumed;
+        size_t length = end - begin;
+        if (length > BENCH_CHUNK_SIZE) { length = BENCH_CHUNK_SIZE; }
+        const size_t parsed = midi_parse_buffer_packed(parser,
+                                                       &stream[begin],
+                                                       length,
+                                                       packed,
+                                                       BENCH_CHUNK_SIZE,
+                                                       &consumed);
+        size_t translated;
+        midi_ump_from_packed(&ump_encoder,
+                             packed,
+                             parsed,
+                             ump_words,
+                             MIDI_UMP_MAX_WORDS * BENCH_CHUNK_SIZE,
+                             &translated);
+        count += translated;
+        begin += consumed;
+    }
+    return count;
+}
+
+/**
+ * @brief Translate the stream into packets and back with
+ *        midi_ump_to_packed
+ * @return The number of messages translated back
+ */
+static size_t
+translate_round_trip(midi_parser_t *parser, size_t begin, size_t end)
+{
+    size_t count = 0;
+
+    while (begin < end) {
+        size_t consumed;
+        size_t length = end - begin;
+        if (length > BENCH_CHUNK_SIZE) { length = BENCH_CHUNK_SIZE; }
+        const size_t parsed = midi_parse_buffer_packed(parser,
+                                                       &stream[begin],
+                                                       length,
+                                                       packed,
+                                                       BENCH_CHUNK_SIZE,
+                                                       &consumed);
+        const size_t words = midi_ump_from_packed(
+            &ump_encoder, packed, parsed, ump_words,
+            MIDI_UMP_MAX_WORDS * BENCH_CHUNK_SIZE, NULL);
+        count += midi_ump_to_packed(&ump_decoder, ump_words, words, NULL,
+                                    packed, BENCH_CHUNK_SIZE, NULL);
+        begin += consumed;
+    }
+    return count;
+}
+
+/**
+ * @brief Parse the stream with midi_parse_buffer_packed and run the
+ *        messages through the routing plan
+ * @return The number of messages routed to the outputs
+ */
+static size_t route_packed(midi_parser_t *parser, size_t begin, size_t end)
+{
+    size_t count = 0;
+
+    while (begin < end) {
+        size_t consumed;
+        size_t length = end - begin;
+        if (length > BENCH_CHUNK_SIZE) { length = BENCH_CHUNK_SIZE; }
+        const size_t parsed = midi_parse_buffer_packed(parser,
+                                                       &stream[begin],
+                                                       length,
+                                                       packed,
+                                                       BENCH_CHUNK_SIZE,
+                                                       &consumed);
+        const midi_packed_t *routed;
+        midi_route_run(&route_plan, packed, parsed);
+        count += midi_route_output(&route_plan, 0, &routed, NULL);
+        count += midi_route_output(&route_plan, 1, &routed, NULL);
+        begin += consumed;
+    }
+    return count;
+}
+
+/**
+ * @brief Parse the stream with midi_parse_buffer_packed and assign the
+ *        notes to voices
+ * @return The number of messages parsed
+ */
+static size_t voice_packed(midi_parser_t *parser, size_t begin, size_t end)
+{
+    size_t count = 0;
+
+    while (begin < end) {
+        size_t consumed;
+        size_t length = end - begin;
+        if (length > BENCH_CHUNK_SIZE) { length = BENCH_CHUNK_SIZE; }
+        const size_t parsed = midi_parse_buffer_packed(parser,
+                                                       &stream[begin],
+                                                       length,
+                                                       packed,
+                                                       BENCH_CHUNK_SIZE,
+                                                       &consumed);
+        for (size_t i = 0; i < parsed; i++) {
+            midi_voice_update_packed(&voice_allocator, packed[i]);
+        }
+        count += parsed;
+        begin += consumed;
+    }
+    return count;
+}
+
+/**
+ * @brief Set a SysEx handler
+ */
+static void setup_sysex(midi_parser_t *parser)
+{
+    midi_parser_set_sysex_handler(parser, ignore_sysex_span, NULL);
+}
+
+/**
+ * @brief Set a realtime handler
+ */
+static void setup_realtime(midi_parser_t *parser)
+{
+    midi_parser_set_realtime_handler(parser, count_realtime, NULL, NULL);
+}
+
+/**
+ * @brief Only accept channels 1 to 3
+ */
+static void setup_filter(midi_parser_t *parser)
+{
+    midi_parser_set_channel_mask(parser, 0x0007);
+}
+
+/**
+ * @brief Translate into Message Type 2 packets
+ */
+static void setup_ump_midi1(midi_parser_t *parser)
+{
+    (void)parser;
+    midi_ump_encoder_init(&ump_encoder, 0, MIDI_UMP_PROTOCOL_MIDI1);
+    midi_ump_decoder_init(&ump_decoder);
+}
+
+/**
+ * @brief Translate into Message Type 4 packets
+ */
+static void setup_ump_midi2(midi_parser_t *parser)
+{
+    (void)parser;
+    midi_ump_encoder_init(&ump_encoder, 0, MIDI_UMP_PROTOCOL_MIDI2);
+    midi_ump_decoder_init(&ump_decoder);
+}
+
+/**
+ * @brief Compile a keyboard split chain: drop the clock, move channel 1
+ *        to channel 2, transpose, curve the velocity and split the keys
+ *        below middle C to a second output
+ */
+static void setup_route(midi_parser_t *parser)
+{
+    static midi_route_graph_t graph;
+    midi_route_match_t match;
+    uint8_t map[16];
+    uint8_t curve[128];
+
+    (void)parser;
+    for (size_t i = 0; i < 16; i++) { map[i] = (uint8_t)i; }
+    map[0] = 1;
+    for (size_t i = 0; i < 128; i++) {
+        curve[i] = (uint8_t)((i * i) / 127);
+    }
+
+    midi_route_graph_init(&graph);
+    midi_route_match_init(&match);
+    midi_route_match_set_type(&match, MIDI_MESSAGE_TIMING_CLOCK, 0);
+    midi_route_ref_t ref =
+        midi_route_add_filter(&graph, MIDI_ROUTE_SOURCE, &match);
+    ref = midi_route_add_remap(&graph, ref, map);
+    ref = midi_route_add_transpose(&graph, ref, MIDI_ROUTE_ALL_CHANNELS, -12);
+    ref = midi_route_add_curve(&graph, ref, MIDI_ROUTE_ALL_CHANNELS,
+                               MIDI_ROUTE_VELOCITY, curve);
+    midi_route_match_init(&match);
+    match.note_max = 59;
+    ref = midi_route_add_split(&graph, ref, &match);
+    midi_route_add_output(&graph, ref, 0);
+    midi_route_add_output(&graph, MIDI_ROUTE_ELSE(ref), 1);
+    midi_route_compile(&route_plan, &graph, BENCH_CHUNK_SIZE,
+                       (uint8_t *)route_storage, sizeof(route_storage));
+}
+
+/**
+ * @brief Allocate 32 voices
+ */
+static void setup_voice(midi_parser_t *parser)
+{
+    (void)parser;
+    midi_voice_init(&voice_allocator, 32, count_voice_event, NULL);
+}
+
+/**
+ * @brief Parser entry points, in output order
+ */
+static const bench_entry_t entries[] = {
+    {"midi_parse_byte", parse_bytes, NULL},
+    {"midi_parse_buffer", parse_buffer, NULL},
+    {"midi_parse_buffer_packed", parse_buffer_packed, NULL},
+    {"midi_parse_buffer_dispatch", parse_buffer_dispatch, NULL},
+    {"midi_parse_buffer+sysex", parse_buffer, setup_sysex},
+    {"midi_parse_buffer+realtime", parse_buffer, setup_realtime},
+    {"midi_parse_buffer+3ch", parse_buffer, setup_filter},
+    {"midi_ump_from_packed", translate_from_packed, setup_ump_midi1},
+    {"midi_ump_from_packed+mt4", translate_from_packed, setup_ump_midi2},
+    {"midi_ump_to_packed+mt4", translate_round_trip, setup_ump_midi2},
+    {"midi_route_run+5", route_packed, setup_route},
+    {"midi_voice_update+32", voice_packed, setup_voice},
+};
+
+/*=====================================================================*
+    Private Functions - Measurement
+ *=====================================================================*/
+
+/**
+ * @brief Monotonic time in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Open a hardware counter for this thread
+ * @param [in] config The perf hardware event to count
+ * @return A file descriptor, or -1 if hardware counters are unavailable
+ */
+static int open_counter(unsigned long long config)
+{
+#if defined(__linux__)
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    (void)config;
+    return -1;
+#endif
+}
+
+/**
+ * @brief Start a hardware counter
+ */
+static void counter_start(int fd)
+{
+#if defined(__linux__)
+    if (fd < 0) { return; }
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#else
+    (void)fd;
+#endif
+}
+
+/**
+ * @brief Stop a hardware counter and read its value
+ * @return The value, or -1 if the counter is unavailable
+ */
+static long long counter_stop(int fd)
+{
+#if defined(__linux__)
+    long long value = 0;
+    if (fd < 0) { return -1; }
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &value, sizeof(value)) != sizeof(value)) { return -1; }
+    return value;
+#else
+    (void)fd;
+    return -1;
+#endif
+}
+
+/**
+ * @brief Read the time stamp counter
+ * @return The counter value, or 0 if there is none
+ */
+static unsigned long long read_tsc(void)
+{
+#if defined(BENCH_HAVE_TSC)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Name of the source used for cycle counts
+ * @details Core cycles from perf when available, otherwise reference
+ *          cycles from the time stamp counter
+ */
+static const char *cycle_source(void)
+{
+    if (cycle_counter >= 0) { return "perf"; }
+#if defined(BENCH_HAVE_TSC)
+    return "tsc";
+#else
+    return "none";
+#endif
+}
+
+/**
+ * @brief Initialize a parser for an entry point
+ */
+static void setup_parser(const bench_entry_t *entry, midi_parser_t *parser)
+{
+    midi_parser_init(parser);
+    if (entry->setup != NULL) { entry->setup(parser); }
+    realtime_events = 0;
+}
+
+/**
+ * @brief Measure the throughput of one entry point on the stream
+ * @return The results of the fastest repeat
+ */
+static bench_result_t measure(const bench_entry_t *entry, int repeats)
+{
+    bench_result_t best = {1e30, -1.0, -1, 0};
+
+    for (int repeat = 0; repeat < repeats; repeat++) {
+        midi_parser_t parser;
+        setup_parser(entry, &parser);
+
+        counter_start(branch_counter);
+        counter_start(cycle_counter);
+        unsigned long long tsc = read_tsc();
+        double start = now();
+        size_t count = entry->parse(&parser, 0, stream_size);
+        double elapsed = now() - start;
+        tsc = read_tsc() - tsc;
+        long long cycles = counter_stop(cycle_counter);
+        long long misses = counter_stop(branch_counter);
+
+        if (elapsed < best.seconds) {
+            best.seconds = elapsed;
+            best.messages = count + realtime_events;
+            best.branch_misses = misses;
+            if (cycles >= 0) {
+                best.cycles = (double)cycles;
+            } else if (tsc > 0) {
+                best.cycles = (double)tsc;
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Print one throughput result as a table row or a JSON object
+ */
+static void print_result(const char *corpus,
+                         const bench_entry_t *entry,
+                         const bench_result_t *result,
+                         int json,
+                         int first)
+{
+    const double size = (double)stream_size;
+    const double ns_per_byte = result->seconds * 1e9 / size;
+    const double bytes_per_sec = size / result->seconds;
+    const double messages_per_sec = (double)result->messages / result->seconds;
+    const double cycles_per_byte =
+        (result->cycles >= 0) ? result->cycles / size : -1.0;
+
+    if (json) {
+        printf("%s\n    {\"corpus\": \"%s\", \"entry\": \"%s\", "
+               "\"bytes\": %zu, \"messages\": %zu, "
+               "\"ns_per_byte\": %.4f, \"bytes_per_sec\": %.0f, "
+               "\"messages_per_sec\": %.0f, ",
+               first ? "" : ",",
+               corpus,
+               entry->name,
+               stream_size,
+               result->messages,
+               ns_per_byte,
+               bytes_per_sec,
+               messages_per_sec);
+        if (cycles_per_byte >= 0) {
+            printf("\"cycles_per_byte\": %.4f, ", cycles_per_byte);
+        } else {
+            printf("\"cycles_per_byte\": null, ");
+        }
+        if (result->branch_misses >= 0) {
+            printf("\"branch_misses_per_byte\": %.5f}",
+                   (double)result->branch_misses / size);
+        } else {
+            printf("\"branch_misses_per_byte\": null}");
+        }
+        return;
+    }
+
+    printf("  %-28s %7.3f ns/B %7.3f cyc/B %8.1f MB/s %7.2f Mmsg/s",
+           entry->name,
+           ns_per_byte,
+           cycles_per_byte,
+           bytes_per_sec / 1e6,
+           messages_per_sec / 1e6);
+    if (result->branch_misses >= 0) {
+        printf(" %7.4f misses/B", (double)result->branch_misses / size);
+    } else {
+        printf("     n/a misses/B");
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Compare two doubles for qsort
+ */
+static int compare_doubles(const void *a, const void *b)
+{
+    const double x = *(const double *)a;
+    const double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Measure the time taken to parse each small chunk of the stream
+ * @details Prints the 50th, 90th, 99th and 99.9th percentiles, the
+ *          maximum and a log2 histogram of the chunk parse times
+ */
+static void measure_latency(const char *corpus,
+                            const bench_entry_t *entry,
+                            int json,
+                            int first)
+{
+    const size_t chunks = stream_size / BENCH_LATENCY_CHUNK_SIZE;
+    size_t histogram[BENCH_HISTOGRAM_BUCKETS] = {0};
+    midi_parser_t parser;
+
+    if (chunks == 0) { return; }
+
+    setup_parser(entry, &parser);
+    for (size_t c = 0; c < chunks; c++) {
+        const size_t begin = c * BENCH_LATENCY_CHUNK_SIZE;
+        double start = now();
+        entry->parse(&parser, begin, begin + BENCH_LATENCY_CHUNK_SIZE);
+        latencies[c] = (now() - start) * 1e9;
+
+        size_t bucket = 0;
+        while (bucket + 1 < BENCH_HISTOGRAM_BUCKETS
+               && latencies[c] >= (double)(2u << bucket)) {
+            bucket++;
+        }
+        histogram[bucket]++;
+    }
+    qsort(latencies, chunks, sizeof(latencies[0]), compare_doubles);
+
+    const double p50 = latencies[chunks / 2];
+    const double p90 = latencies[chunks * 9 / 10];
+    const double p99 = latencies[chunks * 99 / 100];
+    const double p999 = latencies[chunks * 999 / 1000];
+    const double max = latencies[chunks - 1];
+
+    if (json) {
+        printf("%s\n    {\"corpus\": \"%s\", \"entry\": \"%s\", "
+               "\"chunks\": %zu, \"p50_ns\": %.0f, \"p90_ns\": %.0f, "
+               "\"p99_ns\": %.0f, \"p999_ns\": %.0f, \"max_ns\": %.0f, "
+               "\"histogram\": [",
+               first ? "" : ",",
+               corpus,
+               entry->name,
+               chunks,
+               p50,
+               p90,
+               p99,
+               p999,
+               max);
+        for (size_t b = 0; b < BENCH_HISTOGRAM_BUCKETS; b++) {
+            printf("%s%zu", b ? ", " : "", histogram[b]);
+        }
+        printf("]}");
+        return;
+    }
+
+    printf("  %-28s p50 %6.0f ns  p90 %6.0f ns  p99 %6.0f ns  "
+           "p99.9 %6.0f ns  max %8.0f ns\n",
+           entry->name,
+           p50,
+           p90,
+           p99,
+           p999,
+           max);
+    for (size_t b = 0; b < BENCH_HISTOGRAM_BUCKETS; b++) {
+        if (histogram[b] == 0) { continue; }
+        printf("    %8u ns %8zu |", 1u << b, histogram[b]);
+        for (size_t bar = 0; bar < histogram[b] * 50 / chunks; bar++) {
+            printf("#");
+        }
+        printf("\n");
+    }
+}
+
+/*=====================================================================*
+    Main
+ *=====================================================================*/
+int main(int argc, char **argv)
+{
+    bench_corpus_t corpora[BENCH_MAX_CORPORA] = {
+        {"piano", generate_piano, NULL},
+        {"controller_sweep", generate_controller_sweep, NULL},
+        {"clock_heavy", generate_clock_heavy, NULL},
+        {"sysex_dump", generate_sysex_dump, NULL},
+        {"firehose", generate_firehose, NULL},
+        {"garbage", generate_garbage, NULL},
+    };
+    size_t corpus_count = 6;
+    const char *only = NULL;
+    int json = 0;
+    int latency = 0;
+    int repeats = BENCH_REPEATS;
+    int first = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else if (strcmp(argv[i], "--latency") == 0) {
+            latency = 1;
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            generate_size = BENCH_QUICK_STREAM_SIZE;
+            repeats = 1;
+        } else if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc
+                   && corpus_count < BENCH_MAX_CORPORA) {
+            corpora[corpus_count].name = argv[i + 1];
+            corpora[corpus_count].generate = NULL;
+            corpora[corpus_count].path = argv[i + 1];
+            corpus_count++;
+            i++;
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--json] [--latency] [--quick] "
+                    "[--corpus NAME] [--file PATH]...\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+#if defined(__linux__)
+    branch_counter = open_counter(PERF_COUNT_HW_BRANCH_MISSES);
+    cycle_counter = open_counter(PERF_COUNT_HW_CPU_CYCLES);
+#endif
+
+    midi_dispatcher_init(&dispatcher, NULL);
+    midi_dispatcher_set_handler(
+        &dispatcher, MIDI_MESSAGE_NOTE_ON, ignore_message);
+    midi_dispatcher_set_handler(
+        &dispatcher, MIDI_MESSAGE_NOTE_OFF, ignore_message);
+    midi_dispatcher_set_handler(
+        &dispatcher, MIDI_MESSAGE_CONTROL_CHANGE, ignore_message);
+
+    if (json) {
+        printf("{\n  \"mode\": \"%s\",\n  \"repeats\": %d,\n"
+               "  \"chunk_bytes\": %d,\n  \"cycle_source\": \"%s\",\n"
+               "  \"results\": [",
+               latency ? "latency" : "throughput",
+               repeats,
+               latency ? BENCH_LATENCY_CHUNK_SIZE : BENCH_CHUNK_SIZE,
+               cycle_source());
+    } else {
+        printf("%s with %d byte chunks, cycles from %s\n",
+               latency ? "Latency" : "Throughput",
+               latency ? BENCH_LATENCY_CHUNK_SIZE : BENCH_CHUNK_SIZE,
+               cycle_source());
+    }
+
+    for (size_t c = 0; c < corpus_count; c++) {
+        const bench_corpus_t *corpus = &corpora[c];
+        if (only != NULL && strcmp(only, corpus->name) != 0) { continue; }
+
+        random_state = 0x12345678;
+        stream_size = (corpus->generate != NULL) ? corpus->generate()
+                                                 : load_file(corpus->path);
+        if (stream_size == 0) { continue; }
+
+        if (!json) { printf("%s (%zu bytes)\n", corpus->name, stream_size); }
+        for (size_t e = 0; e < sizeof(entries) / sizeof(entries[0]); e++) {
+            if (latency) {
+                measure_latency(corpus->name, &entries[e], json, first);
+            } else {
+                bench_result_t result = measure(&entries[e], repeats);
+                print_result(corpus->name, &entries[e], &result, json, first);
+            }
+            first = 0;
+        }
+    }
+
+    if (json) { printf("\n  ]\n}\n"); }
+
+    return 0;
+}
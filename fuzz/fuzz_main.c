@@ -0,0 +1,190 @@
+/***********************************************************************
+ * @file fuzz_main.c
+ * @brief Standalone driver for the MIDI fuzz target
+ *
+ * @details Runs LLVMFuzzerTestOneInput without libFuzzer, for compilers
+ *          that do not have it, the ctest smoke test and AFL.
+ *
+ *          Usage: midi_fuzz [-runs=N] [-seed=N] [PATH]...
+ *
+ *          PATH      An input file, or a directory of input files (such
+ *                    as fuzz/corpus), to replay. With AFL, pass @@.
+ *          -runs=N   Also check N generated inputs (default 0)
+ *          -seed=N   Seed of the generated inputs (default 1)
+ *
+ *          The flags use the libFuzzer syntax, so the same command line
+ *          works with either build.
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include <dirent.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Maximum size of an input file
+ */
+#define DRIVER_MAX_INPUT (1u << 16)
+
+/**
+ * @brief Maximum size of a generated input
+ */
+#define DRIVER_MAX_GENERATED (1024)
+
+/**
+ * @brief Maximum length of the path of a corpus file
+ */
+#define DRIVER_MAX_PATH (4096)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static uint8_t input[DRIVER_MAX_INPUT];
+static uint32_t random_state;
+static size_t input_count;
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static int run_file(const char *path);
+
+static int run_path(const char *path);
+
+static uint32_t next_random(void);
+
+static size_t generate_input(uint8_t *bytes);
+
+/*=====================================================================*
+    Main
+ *=====================================================================*/
+
+int main(int argc, char **argv)
+{
+    unsigned long runs = 0;
+    unsigned long seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-runs=", 6) == 0) {
+            runs = strtoul(&argv[i][6], NULL, 10);
+        } else if (strncmp(argv[i], "-seed=", 6) == 0) {
+            seed = strtoul(&argv[i][6], NULL, 10);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr,
+                    "Usage: %s [-runs=N] [-seed=N] [PATH]...\n",
+                    argv[0]);
+            return 1;
+        } else if (!run_path(argv[i])) {
+            return 1;
+        }
+    }
+
+    /* Generated inputs, from a seed that can be given to replay them */
+    random_state = (uint32_t)seed ? (uint32_t)seed : 1;
+    for (unsigned long run = 0; run < runs; run++) {
+        const size_t size = generate_input(input);
+        LLVMFuzzerTestOneInput(input, size);
+        input_count++;
+    }
+
+    printf("midi_fuzz: %zu inputs passed\n", input_count);
+    return 0;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Check the input read from a file
+ * @return 1 if the file was read, 0 otherwise
+ */
+static int run_file(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL) {
+        fprintf(stderr, "midi_fuzz: cannot open %s\n", path);
+        return 0;
+    }
+
+    const size_t size = fread(input, 1, sizeof(input), file);
+    fclose(file);
+    LLVMFuzzerTestOneInput(input, size);
+    input_count++;
+    return 1;
+}
+
+/**
+ * @brief Check an input file, or every file of a directory
+ * @return 1 if every file was read, 0 otherwise
+ */
+static int run_path(const char *path)
+{
+    DIR *directory = opendir(path);
+    struct dirent *entry;
+
+    if (directory == NULL) { return run_file(path); }
+
+    while ((entry = readdir(directory)) != NULL) {
+        char file[DRIVER_MAX_PATH];
+
+        if (entry->d_name[0] == '.') { continue; }
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        if (!run_file(file)) {
+            closedir(directory);
+            return 0;
+        }
+    }
+
+    closedir(directory);
+    return 1;
+}
+
+/**
+ * @brief Next pseudo random number
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief Generate an input
+ * @details A random header, then a stream whose bytes are mostly data
+ *          bytes, with status bytes of every kind among them, so that
+ *          most of it parses into messages
+ * @return The size of the input
+ */
+static size_t generate_input(uint8_t *bytes)
+{
+    const size_t size = 10 + next_random() % DRIVER_MAX_GENERATED;
+    const uint32_t status_odds = 2 + next_random() % 14;
+
+    for (size_t i = 0; i < 10; i++) { bytes[i] = (uint8_t)next_random(); }
+
+    /* Small chunks and capacities are the interesting ones */
+    bytes[1] &= (next_random() & 1) ? 0x07 : 0xFF;
+    bytes[2] &= (next_random() & 1) ? 0x03 : 0xFF;
+
+    for (size_t i = 10; i < size; i++) {
+        const uint32_t r = next_random();
+        bytes[i] = (r % status_odds == 0) ? (uint8_t)(0x80 | (r >> 8))
+                                          : (uint8_t)((r >> 8) & 0x7F);
+    }
+    return size;
+}
@@ -0,0 +1,823 @@
+/***********************************************************************
+ * @file fuzz_midi.c
+ * @brief Differential fuzz target for the MIDI parser module
+ *
+ * @details Parses each input with the reference decoder of the test tree
+ *          and with every parser entry point: midi_parse_byte, the
+ *          buffer parsers into messages, packed words and timed arrays,
+ *          and the dispatcher. The messages, their arrival times, the
+ *          realtime lane, the SysEx spans and the final parser state must
+ *          all agree, and the process aborts on the first difference.
+ *
+ *          The first FUZZ_HEADER_SIZE bytes of an input configure the
+ *          run and the rest is the MIDI stream:
+ *
+ *          byte 0     FUZZ_FLAG_* options
+ *          byte 1     Chunk size of the buffer parsers (0: whole stream)
+ *          byte 2     Capacity of the output arrays (0: unlimited)
+ *          bytes 3-4  Channel mask, little endian
+ *          bytes 5-8  Message types to disable, a bit per entry of
+ *                     fuzz_types, little endian
+ *          byte 9     Controllers to disable: if bit 7 is set, every
+ *                     controller whose low three bits equal bits 0-2
+ *
+ *          Built with libFuzzer this file is the whole fuzz target.
+ *          Otherwise fuzz_main.c provides a driver that replays files
+ *          (and runs under AFL) and generates random inputs.
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../test/midi_reference.h"
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Maximum size of the MIDI stream of an input
+ * @details Longer inputs are truncated
+ */
+#define FUZZ_MAX_STREAM (16384)
+
+/**
+ * @brief Size of the configuration header of an input
+ */
+#define FUZZ_HEADER_SIZE (10)
+
+/**
+ * @brief Option: apply the channel, message type and controller filters
+ */
+#define FUZZ_FLAG_FILTERS (0x01)
+
+/**
+ * @brief Option: set a SysEx handler
+ */
+#define FUZZ_FLAG_SYSEX (0x02)
+
+/**
+ * @brief Option: set a realtime handler
+ */
+#define FUZZ_FLAG_REALTIME (0x04)
+
+/**
+ * @brief Option: set a timestamp source with the realtime handler
+ */
+#define FUZZ_FLAG_SOURCE (0x08)
+
+/**
+ * @brief Option: move the parser state to a fresh parser between calls
+ */
+#define FUZZ_FLAG_RESTORE (0x10)
+
+/**
+ * @brief Arrival time of the first byte of the stream
+ * @details Close to the wrap, so that the times wrap in longer inputs
+ */
+#define FUZZ_BASE (0xFFFFFF00u)
+
+/**
+ * @brief Time taken by each byte of the stream
+ */
+#define FUZZ_PERIOD (3u)
+
+/**
+ * @brief Time returned by the timestamp source
+ */
+#define FUZZ_SOURCE_TIME (0x5EEDu)
+
+/**
+ * @brief Check a condition and abort with a report if it does not hold
+ */
+#define FUZZ_CHECK(condition, path, what)                                    \
+    do {                                                                      \
+        if (!(condition)) { fail((path), (what)); }                           \
+    } while (0)
+
+/*=====================================================================*
+    Private Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Parser entry points checked against the reference
+ */
+typedef enum fuzz_path_t {
+    FUZZ_PATH_BUFFER,
+    FUZZ_PATH_PACKED,
+    FUZZ_PATH_TIMED,
+    FUZZ_PATH_PACKED_TIMED,
+    FUZZ_PATH_DISPATCH,
+    FUZZ_PATH_COUNT,
+} fuzz_path_t;
+
+/**
+ * @brief Configuration of a run, read from the input header
+ */
+typedef struct fuzz_config_t {
+    uint8_t flags;
+    size_t chunk;
+    size_t capacity;
+    uint16_t channel_mask;
+    uint32_t disabled_types;
+    uint8_t disabled_controllers;
+} fuzz_config_t;
+
+/**
+ * @brief Everything a parser produced for a stream
+ */
+typedef struct fuzz_output_t {
+    /**
+     * @brief The messages, packed, and the number of messages
+     */
+    midi_packed_t packed[FUZZ_MAX_STREAM];
+    size_t count;
+
+    /**
+     * @brief The arrival time of each message, if timed
+     */
+    uint32_t times[FUZZ_MAX_STREAM];
+    int timed;
+
+    /**
+     * @brief The messages of the realtime lane and their stream indices
+     */
+    uint8_t realtime[FUZZ_MAX_STREAM];
+    size_t realtime_index[FUZZ_MAX_STREAM];
+    size_t realtime_count;
+
+    /**
+     * @brief The SysEx payload of every accepted SysEx message
+     */
+    uint8_t payload[FUZZ_MAX_STREAM];
+    size_t payload_length;
+
+    /**
+     * @brief The MIDI_SYSEX_FLAG_ABORTED flag of each ended SysEx message
+     */
+    uint8_t ends[FUZZ_MAX_STREAM];
+    size_t end_count;
+
+    /**
+     * @brief Stream index of the buffer being parsed
+     */
+    size_t offset;
+
+    /**
+     * @brief The timestamp of untimed realtime events
+     */
+    uint32_t source_time;
+
+    /**
+     * @brief The parser state after the stream
+     */
+    midi_parser_state_t state;
+
+#if MIDI_CONFIG_STATS
+    /**
+     * @brief The parser statistics after the stream
+     */
+    midi_parser_stats_t stats;
+#endif
+} fuzz_output_t;
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+
+/**
+ * @brief Message types that byte 5-8 of the header can disable
+ */
+static const midi_message_type_t fuzz_types[] = {
+    MIDI_MESSAGE_NOTE_OFF,
+    MIDI_MESSAGE_NOTE_ON,
+    MIDI_MESSAGE_KEY_PRESSURE,
+    MIDI_MESSAGE_CONTROL_CHANGE,
+    MIDI_MESSAGE_PROGRAM_CHANGE,
+    MIDI_MESSAGE_CHANNEL_PRESSURE,
+    MIDI_MESSAGE_PITCH_BEND,
+    MIDI_MESSAGE_ALL_SOUND_OFF,
+    MIDI_MESSAGE_RESET_ALL_CONTROLLERS,
+    MIDI_MESSAGE_LOCAL_CONTROL,
+    MIDI_MESSAGE_ALL_NOTES_OFF,
+    MIDI_MESSAGE_OMNI_OFF,
+    MIDI_MESSAGE_OMNI_ON,
+    MIDI_MESSAGE_MONO_ON,
+    MIDI_MESSAGE_POLY_ON,
+    MIDI_MESSAGE_SYSTEM_EXCLUSIVE,
+    MIDI_MESSAGE_MTC_QUARTER_FRAME,
+    MIDI_MESSAGE_SONG_POSITION_POINTER,
+    MIDI_MESSAGE_SONG_SELECT,
+    MIDI_MESSAGE_TUNE_REQUEST,
+    MIDI_MESSAGE_END_OF_EXCLUSIVE,
+    MIDI_MESSAGE_TIMING_CLOCK,
+    MIDI_MESSAGE_START,
+    MIDI_MESSAGE_CONTINUE,
+    MIDI_MESSAGE_STOP,
+    MIDI_MESSAGE_ACTIVE_SENSE,
+    MIDI_MESSAGE_SYSTEM_RESET,
+};
+
+/**
+ * @brief Names of the entry points, for the failure report
+ */
+static const char *const path_names[FUZZ_PATH_COUNT] = {
+    "midi_parse_buffer",
+    "midi_parse_buffer_packed",
+    "midi_parse_buffer_timed",
+    "midi_parse_buffer_packed_timed",
+    "midi_parse_buffer_dispatch",
+};
+
+static fuzz_output_t expected_all;
+static fuzz_output_t expected_lane;
+static fuzz_output_t actual;
+static midi_message_t messages[FUZZ_MAX_STREAM];
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static void fail(const char *path, const char *what);
+
+static void read_config(fuzz_config_t *config, const uint8_t *header);
+
+static int is_accepted(const fuzz_config_t *config, midi_packed_t packed);
+
+static void
+configure_parser(midi_parser_t *parser, const fuzz_config_t *config);
+
+static void clear_output(fuzz_output_t *output, int timed);
+
+static void save_output_state(fuzz_output_t *output,
+                              const midi_parser_t *parser);
+
+static void run_reference(const fuzz_config_t *config,
+                          const uint8_t *stream,
+                          size_t length);
+
+static void run_parse_byte(const fuzz_config_t *config,
+                           const uint8_t *stream,
+                           size_t length);
+
+static void run_buffer_path(fuzz_path_t path,
+                            const fuzz_config_t *config,
+                            const uint8_t *stream,
+                            size_t length);
+
+static void compare_outputs(const fuzz_output_t *expected,
+                            const fuzz_output_t *output,
+                            const char *path,
+                            int sysex);
+
+static void compare_states(const midi_parser_state_t *expected,
+                           const midi_parser_state_t *state,
+                           const char *path,
+                           int sysex_flags);
+
+static void record_span(void *context, const midi_sysex_span_t *span);
+
+static void record_realtime(void *context,
+                            const midi_realtime_event_t *event);
+
+static uint32_t source_time(void *context);
+
+static void record_message(void *context, const midi_message_t *message);
+
+/*=====================================================================*
+    Fuzz Target
+ *=====================================================================*/
+
+/**
+ * @brief Check one input
+ * @param [in] data Pointer to the input
+ * @param [in] size The size of the input in bytes
+ * @return 0
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    fuzz_config_t config;
+
+    if (size < FUZZ_HEADER_SIZE) { return 0; }
+
+    const uint8_t *stream = &data[FUZZ_HEADER_SIZE];
+    size_t length = size - FUZZ_HEADER_SIZE;
+    if (length > FUZZ_MAX_STREAM) { length = FUZZ_MAX_STREAM; }
+
+    read_config(&config, data);
+    run_reference(&config, stream, length);
+
+    /* midi_parse_byte returns System Real-Time messages in line */
+    run_parse_byte(&config, stream, length);
+    compare_outputs(&expected_all, &actual, "midi_parse_byte", 0);
+    if (!(config.flags & FUZZ_FLAG_FILTERS)) {
+        compare_states(&expected_all.state, &actual.state,
+                       "midi_parse_byte", 0);
+    }
+
+    /* The buffer parsers must end in the state midi_parse_byte ends in */
+    expected_lane.state = actual.state;
+#if MIDI_CONFIG_STATS
+    expected_lane.stats = actual.stats;
+#endif
+
+    for (int path = 0; path < FUZZ_PATH_COUNT; path++) {
+        run_buffer_path((fuzz_path_t)path, &config, stream, length);
+        compare_outputs(&expected_lane, &actual, path_names[path],
+                        (config.flags & FUZZ_FLAG_SYSEX) != 0);
+
+        /* The span flags only move with the buffer parsers */
+        if (path == 0) {
+            expected_lane.state.sysex_flags = actual.state.sysex_flags;
+        }
+        compare_states(&expected_lane.state, &actual.state,
+                       path_names[path], 1);
+#if MIDI_CONFIG_STATS
+        if (!(config.flags & FUZZ_FLAG_RESTORE)) {
+            FUZZ_CHECK(memcmp(&expected_lane.stats,
+                              &actual.stats,
+                              sizeof(actual.stats))
+                           == 0,
+                       path_names[path],
+                       "statistics");
+        }
+#endif
+    }
+
+    return 0;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Report a difference and abort, so that the fuzzer keeps the input
+ */
+static void fail(const char *path, const char *what)
+{
+    fprintf(stderr, "midi_fuzz: %s differs from the reference: %s\n",
+            path, what);
+    abort();
+}
+
+/**
+ * @brief Read the configuration header of an input
+ */
+static void read_config(fuzz_config_t *config, const uint8_t *header)
+{
+    config->flags = header[0];
+    config->chunk = (header[1] != 0) ? header[1] : FUZZ_MAX_STREAM;
+    config->capacity = (header[2] != 0) ? header[2] : FUZZ_MAX_STREAM;
+    config->channel_mask = (uint16_t)(header[3] | header[4] << 8);
+    config->disabled_types = (uint32_t)header[5] | (uint32_t)header[6] << 8
+                             | (uint32_t)header[7] << 16
+                             | (uint32_t)header[8] << 24;
+    config->disabled_controllers = header[9];
+}
+
+/**
+ * @brief Check whether a message from the reference passes the filters
+ * @details Written from the documentation of the filter functions rather
+ *          than from the status byte filter of the parser
+ */
+static int is_accepted(const fuzz_config_t *config, midi_packed_t packed)
+{
+    const midi_message_type_t message_type = midi_packed_type(packed);
+    const midi_channel_t channel = midi_packed_channel(packed);
+
+    if (!(config->flags & FUZZ_FLAG_FILTERS)) { return 1; }
+
+    for (size_t i = 0; i < sizeof(fuzz_types) / sizeof(fuzz_types[0]); i++) {
+        if (fuzz_types[i] == message_type
+            && ((config->disabled_types >> i) & 1)) {
+            return 0;
+        }
+    }
+    if (channel != MIDI_CHANNEL_NONE
+        && !((config->channel_mask >> channel) & 1)) {
+        return 0;
+    }
+    if (message_type == MIDI_MESSAGE_CONTROL_CHANGE
+        && midi_packed_data1(packed) < MIDI_CC_ALL_SOUND_OFF
+        && (config->disabled_controllers & 0x80)
+        && (midi_packed_data1(packed) & 0x07)
+               == (config->disabled_controllers & 0x07)) {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Initialize a parser with the filters and handlers of a run
+ */
+static void
+configure_parser(midi_parser_t *parser, const fuzz_config_t *config)
+{
+    midi_parser_init(parser);
+
+    if (config->flags & FUZZ_FLAG_FILTERS) {
+        midi_parser_set_channel_mask(parser, config->channel_mask);
+        for (size_t i = 0; i < sizeof(fuzz_types) / sizeof(fuzz_types[0]);
+             i++) {
+            if ((config->disabled_types >> i) & 1) {
+                midi_parser_set_message_enabled(parser, fuzz_types[i], 0);
+            }
+        }
+        if (config->disabled_controllers & 0x80) {
+            for (uint8_t controller = 0; controller < MIDI_CC_ALL_SOUND_OFF;
+                 controller++) {
+                if ((controller & 0x07)
+                    == (config->disabled_controllers & 0x07)) {
+                    midi_parser_set_controller_enabled(
+                        parser, (midi_controller_t)controller, 0);
+                }
+            }
+        }
+    }
+
+    if (config->flags & FUZZ_FLAG_SYSEX) {
+        midi_parser_set_sysex_handler(parser, record_span, &actual);
+    }
+    if (config->flags & FUZZ_FLAG_REALTIME) {
+        midi_parser_set_realtime_handler(
+            parser,
+            record_realtime,
+            (config->flags & FUZZ_FLAG_SOURCE) ? source_time : NULL,
+            &actual);
+    }
+}
+
+/**
+ * @brief Empty an output
+ */
+static void clear_output(fuzz_output_t *output, int timed)
+{
+    output->count = 0;
+    output->timed = timed;
+    output->realtime_count = 0;
+    output->payload_length = 0;
+    output->end_count = 0;
+    output->offset = 0;
+    output->source_time = 0;
+}
+
+/**
+ * @brief Save the final parser state and statistics to an output
+ */
+static void save_output_state(fuzz_output_t *output,
+                              const midi_parser_t *parser)
+{
+    midi_parser_save_state(parser, &output->state);
+#if MIDI_CONFIG_STATS
+    midi_parser_get_stats(parser, &output->stats);
+#endif
+}
+
+/**
+ * @brief Decode a stream with the reference decoder and the filters
+ * @details Fills in expected_all with every message, for midi_parse_byte,
+ *          and expected_lane with System Real-Time messages moved to the
+ *          realtime lane if a realtime handler is set, for the buffer
+ *          parsers
+ */
+static void run_reference(const fuzz_config_t *config,
+                          const uint8_t *stream,
+                          size_t length)
+{
+    const int lane = (config->flags & FUZZ_FLAG_REALTIME) != 0;
+    midi_reference_t reference;
+    int sysex_accepted = 0;
+
+    midi_reference_init(&reference);
+    clear_output(&expected_all, 1);
+    clear_output(&expected_lane, 1);
+
+    for (size_t i = 0; i < length; i++) {
+        const midi_packed_t packed =
+            midi_reference_parse_byte(&reference, stream[i]);
+        const uint32_t time = FUZZ_BASE + FUZZ_PERIOD * (uint32_t)i;
+
+        /* The payload of a SysEx rejected by the filters is skipped */
+        if (sysex_accepted) {
+            if (reference.sysex == MIDI_REFERENCE_SYSEX_PAYLOAD) {
+                expected_lane.payload[expected_lane.payload_length++] =
+                    stream[i];
+            } else if (reference.sysex != MIDI_REFERENCE_SYSEX_NONE) {
+                expected_lane.ends[expected_lane.end_count++] =
+                    (reference.sysex == MIDI_REFERENCE_SYSEX_ABORTED)
+                        ? MIDI_SYSEX_FLAG_ABORTED
+                        : 0;
+                sysex_accepted = 0;
+            }
+        }
+
+        if (packed == 0 || !is_accepted(config, packed)) { continue; }
+        if (midi_packed_type(packed) == MIDI_MESSAGE_SYSTEM_EXCLUSIVE) {
+            sysex_accepted = 1;
+        }
+
+        expected_all.times[expected_all.count] = time;
+        expected_all.packed[expected_all.count++] = packed;
+        if (lane && midi_packed_type(packed) >= MIDI_MESSAGE_TIMING_CLOCK) {
+            expected_lane.realtime_index[expected_lane.realtime_count] = i;
+            expected_lane.realtime[expected_lane.realtime_count++] =
+                (uint8_t)midi_packed_type(packed);
+        } else {
+            expected_lane.times[expected_lane.count] = time;
+            expected_lane.packed[expected_lane.count++] = packed;
+        }
+    }
+
+    midi_reference_get_state(&reference, &expected_all.state);
+}
+
+/**
+ * @brief Parse a stream with midi_parse_byte into actual
+ */
+static void run_parse_byte(const fuzz_config_t *config,
+                           const uint8_t *stream,
+                           size_t length)
+{
+    midi_parser_t parser;
+    midi_message_t message;
+
+    configure_parser(&parser, config);
+    clear_output(&actual, 1);
+
+    for (size_t i = 0; i < length; i++) {
+        const midi_message_type_t message_type =
+            midi_parse_byte(&parser, stream[i], &message);
+        if (message_type == MIDI_MESSAGE_NONE) { continue; }
+
+        FUZZ_CHECK(message_type == message.message_type,
+                   "midi_parse_byte",
+                   "returned type");
+        actual.times[actual.count] = FUZZ_BASE + FUZZ_PERIOD * (uint32_t)i;
+        actual.packed[actual.count++] = midi_message_pack(&message);
+    }
+
+    save_output_state(&actual, &parser);
+}
+
+/**
+ * @brief Parse a stream with a buffer parser into actual
+ * @details The stream is passed in chunks, and each chunk in as many
+ *          calls as the capacity of the output requires
+ */
+static void run_buffer_path(fuzz_path_t path,
+                            const fuzz_config_t *config,
+                            const uint8_t *stream,
+                            size_t length)
+{
+    const char *name = path_names[path];
+    midi_parser_t parser;
+    midi_dispatcher_t dispatcher;
+
+    configure_parser(&parser, config);
+    clear_output(&actual,
+                 path == FUZZ_PATH_TIMED || path == FUZZ_PATH_PACKED_TIMED);
+    if (config->flags & FUZZ_FLAG_SOURCE) {
+        actual.source_time = FUZZ_SOURCE_TIME;
+    }
+
+    midi_dispatcher_init(&dispatcher, &actual);
+    for (int type = 0; type < 256; type++) {
+        midi_dispatcher_set_handler(
+            &dispatcher, (midi_message_type_t)type, record_message);
+    }
+    for (uint8_t controller = 0; controller < MIDI_CC_ALL_SOUND_OFF;
+         controller += 2) {
+        midi_dispatcher_set_controller_handler(
+            &dispatcher, (midi_controller_t)controller, record_message);
+    }
+
+    for (size_t start = 0; start < length; start += config->chunk) {
+        const size_t end =
+            (length - start > config->chunk) ? start + config->chunk : length;
+        size_t index = start;
+
+        while (index < end) {
+            const size_t size = end - index;
+            const uint32_t base = FUZZ_BASE + FUZZ_PERIOD * (uint32_t)index;
+            midi_packed_t *packed = &actual.packed[actual.count];
+            uint32_t *times = &actual.times[actual.count];
+            size_t consumed = 0;
+            size_t count = 0;
+
+            if (config->flags & FUZZ_FLAG_RESTORE) {
+                midi_parser_state_t state;
+                midi_parser_save_state(&parser, &state);
+                configure_parser(&parser, config);
+                midi_parser_restore_state(&parser, &state);
+            }
+
+            actual.offset = index;
+            switch (path) {
+            case FUZZ_PATH_BUFFER:
+                count = midi_parse_buffer(&parser, &stream[index], size,
+                                          messages, config->capacity,
+                                          &consumed);
+                for (size_t i = 0; i < count; i++) {
+                    packed[i] = midi_message_pack(&messages[i]);
+                }
+                break;
+
+            case FUZZ_PATH_PACKED:
+                count = midi_parse_buffer_packed(&parser, &stream[index],
+                                                 size, packed,
+                                                 config->capacity, &consumed);
+                break;
+
+            case FUZZ_PATH_TIMED:
+                count = midi_parse_buffer_timed(&parser, &stream[index], size,
+                                                base, FUZZ_PERIOD, messages,
+                                                times, config->capacity,
+                                                &consumed);
+                for (size_t i = 0; i < count; i++) {
+                    packed[i] = midi_message_pack(&messages[i]);
+                }
+                break;
+
+            case FUZZ_PATH_PACKED_TIMED:
+                count = midi_parse_buffer_packed_timed(
+                    &parser, &stream[index], size, base, FUZZ_PERIOD, packed,
+                    times, config->capacity, &consumed);
+                break;
+
+            case FUZZ_PATH_DISPATCH:
+            default:
+                /* The handlers append to actual themselves */
+                count = midi_parse_buffer_dispatch(
+                    &parser, &dispatcher, &stream[index], size);
+                FUZZ_CHECK(count == (size_t)(&actual.packed[actual.count]
+                                             - packed),
+                           name,
+                           "dispatched message count");
+                consumed = size;
+                count = 0;
+                break;
+            }
+
+            /* Parsing stops early only when the output is full */
+            FUZZ_CHECK(consumed > 0 && consumed <= size, name, "consumed");
+            FUZZ_CHECK(consumed == size || count == config->capacity,
+                       name,
+                       "stopped early");
+
+            actual.count += count;
+            index += consumed;
+        }
+    }
+
+    save_output_state(&actual, &parser);
+}
+
+/**
+ * @brief Compare an output against the expected output
+ * @param [in] sysex Non-zero to compare the SysEx spans
+ */
+static void compare_outputs(const fuzz_output_t *expected,
+                            const fuzz_output_t *output,
+                            const char *path,
+                            int sysex)
+{
+    FUZZ_CHECK(output->count == expected->count, path, "message count");
+    for (size_t i = 0; i < output->count; i++) {
+        FUZZ_CHECK(output->packed[i] == expected->packed[i], path, "message");
+        if (output->timed) {
+            FUZZ_CHECK(output->times[i] == expected->times[i],
+                       path,
+                       "message time");
+        }
+    }
+
+    FUZZ_CHECK(output->realtime_count == expected->realtime_count,
+               path,
+               "realtime count");
+    for (size_t i = 0; i < output->realtime_count; i++) {
+        FUZZ_CHECK(output->realtime[i] == expected->realtime[i],
+                   path,
+                   "realtime message");
+        FUZZ_CHECK(output->realtime_index[i] == expected->realtime_index[i],
+                   path,
+                   "realtime offset");
+    }
+
+    if (!sysex) { return; }
+    FUZZ_CHECK(output->payload_length == expected->payload_length
+                   && memcmp(output->payload,
+                             expected->payload,
+                             output->payload_length)
+                          == 0,
+               path,
+               "SysEx payload");
+    FUZZ_CHECK(output->end_count == expected->end_count
+                   && memcmp(output->ends, expected->ends, output->end_count)
+                          == 0,
+               path,
+               "SysEx ends");
+}
+
+/**
+ * @brief Compare a parser state against the expected state
+ * @param [in] sysex_flags Non-zero to compare the SysEx span flags
+ */
+static void compare_states(const midi_parser_state_t *expected,
+                           const midi_parser_state_t *state,
+                           const char *path,
+                           int sysex_flags)
+{
+    FUZZ_CHECK(state->message_type == expected->message_type,
+               path,
+               "state message type");
+    FUZZ_CHECK(state->channel == expected->channel, path, "state channel");
+    FUZZ_CHECK(state->byte_count == expected->byte_count,
+               path,
+               "state byte count");
+
+    /* Bytes past the byte count are stale and may differ */
+    for (size_t i = 0; i < state->byte_count && i < 2; i++) {
+        FUZZ_CHECK(state->buffer[i] == expected->buffer[i],
+                   path,
+                   "state data bytes");
+    }
+    if (sysex_flags) {
+        FUZZ_CHECK(state->sysex_flags == expected->sysex_flags,
+                   path,
+                   "state SysEx flags");
+    }
+}
+
+/**
+ * @brief SysEx handler that appends the span to actual
+ */
+static void record_span(void *context, const midi_sysex_span_t *span)
+{
+    fuzz_output_t *output = (fuzz_output_t *)context;
+    const int start = (span->flags & MIDI_SYSEX_FLAG_START) != 0;
+    const int resumed = (span->flags & MIDI_SYSEX_FLAG_CONTINUE) != 0;
+
+    FUZZ_CHECK(start != resumed, "SysEx handler", "span start flags");
+    FUZZ_CHECK(!(span->flags & MIDI_SYSEX_FLAG_ABORTED)
+                   || (span->flags & MIDI_SYSEX_FLAG_END),
+               "SysEx handler",
+               "span end flags");
+    FUZZ_CHECK(output->payload_length + span->length <= FUZZ_MAX_STREAM,
+               "SysEx handler",
+               "span length");
+
+    memcpy(&output->payload[output->payload_length], span->data,
+           span->length);
+    output->payload_length += span->length;
+    if (span->flags & MIDI_SYSEX_FLAG_END) {
+        output->ends[output->end_count++] =
+            span->flags & MIDI_SYSEX_FLAG_ABORTED;
+    }
+}
+
+/**
+ * @brief Realtime handler that appends the event to actual
+ */
+static void record_realtime(void *context, const midi_realtime_event_t *event)
+{
+    fuzz_output_t *output = (fuzz_output_t *)context;
+    const size_t index = output->offset + event->offset;
+    const uint32_t time = output->timed
+                              ? FUZZ_BASE + FUZZ_PERIOD * (uint32_t)index
+                              : output->source_time;
+
+    FUZZ_CHECK(event->timestamp == time, "realtime handler", "timestamp");
+
+    output->realtime_index[output->realtime_count] = index;
+    output->realtime[output->realtime_count++] =
+        (uint8_t)event->message_type;
+}
+
+/**
+ * @brief Timestamp source of the realtime handler
+ */
+static uint32_t source_time(void *context)
+{
+    (void)context;
+    return FUZZ_SOURCE_TIME;
+}
+
+/**
+ * @brief Dispatcher handler that appends the message to actual
+ */
+static void record_message(void *context, const midi_message_t *message)
+{
+    fuzz_output_t *output = (fuzz_output_t *)context;
+
+    output->packed[output->count++] = midi_message_pack(message);
+}
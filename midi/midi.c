@@ -1,412 +1,2002 @@
-/***********************************************************************
- * @file midi.c
- * @brief MIDI parser implementation
- *
- * @details MIDI parser implementation for parsing MIDI 1.0 messages
- *          byte-by-byte using a state machine approach. Supports channel
- *          voice messages, system messages, and running status.
- *
- * @see MIDI 1.0 Detailed Specification
- *      https://midi.org/midi-1-0-detailed-specification
- ***********************************************************************/
-
-/*=====================================================================*
-    Local Header Files
- *=====================================================================*/
-#include "midi.h"
-
-/*====================================================================*
- *    Interface Header Files
- *====================================================================*/
-/* None */
-
-/*====================================================================*
- *    System-wide Header Files
- *====================================================================*/
-#include <stddef.h>
-
-/*=====================================================================*
-    Private Defines
- *=====================================================================*/
-
-/**
- * @brief MIDI Most Significant Nibble Mask
- * @details The mask for the most significant nibble of a MIDI status byte
- */
-#define MIDI_MSN_MASK (0xF0)
-
-/**
- * @brief MIDI Least Significant Nibble Mask
- * @details The mask for the least significant nibble of a MIDI status byte
- */
-#define MIDI_LSN_MASK (0x0F)
-
-/**
- * @brief MIDI Channel Mask
- * @details The mask for the channel component of a MIDI channel message
- */
-#define MIDI_CHANNEL_MASK (0x0F)
-
-/**
- * @brief MIDI Most Significant Bit Mask
- * @details The mask for the most significant bit of a MIDI byte
- */
-#define MIDI_MSB_MASK (0x80)
-
-/**
- * @brief MIDI Parser Buffer Size
- * @details The maximum buffer size for midi_parser_t.buffer
- */
-#define MIDI_BUFFER_SIZE (2)
-
-/**
- * @brief MIDI Maximum Data Byte Value
- * @details The maximum valid data byte value
- */
-#define MIDI_MAX_DATA_BYTE (0x7F)
-
-/*=====================================================================*
-    Private Data Types
- *=====================================================================*/
-/* None */
-
-/*=====================================================================*
-    Private Function Prototypes
- *=====================================================================*/
-
-/* MIDI Parser Internal Functions */
-static midi_message_type_t parse_status_byte(midi_parser_t *parser,
-                                             const uint8_t byte,
-                                             midi_message_t *message);
-
-static midi_message_type_t parse_data_byte(midi_parser_t *parser,
-                                           const uint8_t byte,
-                                           midi_message_t *message);
-
-/*=====================================================================*
-    Private Data
- *=====================================================================*/
-/* None */
-
-/*=====================================================================*
-    Public Function Implementations
- *=====================================================================*/
-
-/**
- * @brief Initialize a MIDI parser
- * @param [in, out] parser Pointer to a midi_parser_t struct to initialize
- * @note This function must be called before using the parser
- */
-void midi_parser_init(midi_parser_t *parser)
-{
-    if (parser == NULL) { return; }
-
-    parser->message_type = MIDI_MESSAGE_NONE;
-    parser->channel = MIDI_CHANNEL_NONE;
-    parser->active_channel = MIDI_CHANNEL_NONE;
-    parser->buffer[0] = 0;
-    parser->buffer[1] = 0;
-    parser->byte_count = 0;
-}
-
-/**
- * @brief Reset a MIDI parser to its initial state
- * @param [in,out] parser Pointer to a midi_parser_t struct to reset
- * @note This clears any partial message state and running status
- */
-void midi_parser_reset(midi_parser_t *parser) { midi_parser_init(parser); }
-
-/**
- * @brief Parse a MIDI byte
- * @param [in,out] parser Pointer to a midi_parser_t struct
- * @param [in] byte The byte to parse
- * @param [out] message Pointer to a midi_message_t struct.
- *      This struct will be updated with the parsed message data,
- *      if a complete message has been parsed.
- * @return The MIDI message type. If a complete message has been
- *      parsed then the message type will be returned (and will be
- *      identical to the message_type field in the message struct).
- *      Otherwise the message type will be MIDI_MESSAGE_NONE
- * @retval MIDI_MESSAGE_NONE: No complete message has been parsed
- * @retval others: The message type of the parsed message
- */
-midi_message_type_t midi_parse_byte(midi_parser_t *parser,
-                                    const uint8_t byte,
-                                    midi_message_t *message)
-{
-    /* Check for NULL pointers */
-    if (parser == NULL || message == NULL) { return MIDI_MESSAGE_NONE; }
-
-    /* Check if we got a status byte */
-    if (byte & MIDI_MSB_MASK) {
-        return parse_status_byte(parser, byte, message);
-    } else {
-        /* It's a data byte */
-        return parse_data_byte(parser, byte, message);
-    }
-}
-
-/*=====================================================================*
-    Private Function Implementations
- *=====================================================================*/
-
-/**
- * @brief Parse a MIDI status byte
- * @param [in,out] parser Pointer to a midi_parser_t struct
- * @param [in] byte The byte to parse
- * @note This function assumes that the byte is a status byte
- * @param [out] message Pointer to a midi_message_t struct.
- *      This struct will be updated with the parsed message data,
- *      if a complete message has been parsed.
- * @return The MIDI message type. If a complete message has been
- *      parsed then the message type will be returned (and will be
- *      identical to the message_type field in the message struct).
- *      Otherwise the message type will be MIDI_MESSAGE_NONE
- * @retval MIDI_MESSAGE_NONE: No complete message has been parsed
- * @retval others: The message type of the parsed message
- */
-static midi_message_type_t parse_status_byte(midi_parser_t *parser,
-                                             const uint8_t byte,
-                                             midi_message_t *message)
-{
-    /* Check for NULL pointers */
-    if (parser == NULL || message == NULL) { return MIDI_MESSAGE_NONE; }
-
-    switch (byte & MIDI_MSN_MASK) {
-
-    /* CHANNEL VOICE MESSAGES */
-    case MIDI_MESSAGE_NOTE_OFF:
-    case MIDI_MESSAGE_NOTE_ON:
-    case MIDI_MESSAGE_KEY_PRESSURE:
-    case MIDI_MESSAGE_CONTROL_CHANGE:
-    case MIDI_MESSAGE_PROGRAM_CHANGE:
-    case MIDI_MESSAGE_CHANNEL_PRESSURE:
-    case MIDI_MESSAGE_PITCH_BEND:
-        parser->message_type = (midi_message_type_t)(byte & MIDI_MSN_MASK);
-        parser->channel = (midi_channel_t)(byte & MIDI_CHANNEL_MASK);
-        parser->byte_count = 0;
-        break;
-
-    /* SYSTEM MESSAGES */
-    case MIDI_MESSAGE_SYSTEM_EXCLUSIVE:
-        /*
-         * Because the previous switch was using the masked byte,
-         * all system messages are handled here,
-         * matching on the full byte value
-         */
-        switch (byte) {
-
-        case MIDI_MESSAGE_SYSTEM_EXCLUSIVE:
-            parser->message_type = MIDI_MESSAGE_SYSTEM_EXCLUSIVE;
-            parser->byte_count = 0;
-
-            message->message_type = MIDI_MESSAGE_SYSTEM_EXCLUSIVE;
-            message->channel = MIDI_CHANNEL_NONE;
-            return MIDI_MESSAGE_SYSTEM_EXCLUSIVE;
-
-        /* SYSTEM COMMON MESSAGES */
-        case MIDI_MESSAGE_MTC_QUARTER_FRAME:
-        case MIDI_MESSAGE_SONG_POSITION_POINTER:
-        case MIDI_MESSAGE_SONG_SELECT:
-            parser->message_type = (midi_message_type_t)byte;
-            parser->channel = MIDI_CHANNEL_NONE;
-            parser->byte_count = 0;
-            break;
-        case MIDI_MESSAGE_TUNE_REQUEST:
-        case MIDI_MESSAGE_END_OF_EXCLUSIVE:
-            parser->message_type = MIDI_MESSAGE_NONE;
-            parser->channel = MIDI_CHANNEL_NONE;
-            parser->byte_count = 0;
-            message->message_type = (midi_message_type_t)byte;
-            message->channel = MIDI_CHANNEL_NONE;
-            return message->message_type;
-
-        /* SYSTEM REALTIME MESSAGES */
-        case MIDI_MESSAGE_TIMING_CLOCK:
-        case MIDI_MESSAGE_START:
-        case MIDI_MESSAGE_CONTINUE:
-        case MIDI_MESSAGE_STOP:
-        case MIDI_MESSAGE_ACTIVE_SENSE:
-        case MIDI_MESSAGE_SYSTEM_RESET:
-            /* Do not clear running status */
-            message->message_type = (midi_message_type_t)byte;
-            message->channel = MIDI_CHANNEL_NONE;
-            return message->message_type;
-
-        default:
-            /* Undefined system message type */
-            /* Do not reset running status */
-            break;
-        }
-        break;
-
-    default:
-        /* Undefined message type */
-        /* Do not reset running status */
-        break;
-    }
-    return MIDI_MESSAGE_NONE;
-}
-
-/**
- * @brief Parse a MIDI data byte
- * @param [in,out] parser Pointer to a midi_parser_t struct
- * @param [in] byte The byte to parse
- * @note This function assumes that the byte is a data byte
- * @param [out] message Pointer to a midi_message_t struct.
- *      This struct will be updated with the parsed message data,
- *      if a complete message has been parsed.
- * @return The MIDI message type. If a complete message has been
- *      parsed then the message type will be returned (and will be
- *      identical to the message_type field in the message struct).
- *      Otherwise the message type will be MIDI_MESSAGE_NONE
- * @retval MIDI_MESSAGE_NONE: No complete message has been parsed
- * @retval others: The message type of the parsed message
- */
-static midi_message_type_t parse_data_byte(midi_parser_t *parser,
-                                           const uint8_t byte,
-                                           midi_message_t *message)
-{
-    /* Check for NULL pointers */
-    if (parser == NULL || message == NULL) { return MIDI_MESSAGE_NONE; }
-
-    /* Validate data byte range */
-    if (byte > MIDI_MAX_DATA_BYTE) {
-        /* Invalid data byte - ignore */
-        /* this should literally never happen */
-        return MIDI_MESSAGE_NONE;
-    }
-
-    /* Buffer overflow protection */
-    if (parser->byte_count >= MIDI_BUFFER_SIZE) {
-        /* this should never happen */
-        parser->byte_count = 0;
-        return MIDI_MESSAGE_NONE;
-    }
-
-    /*
-     * Figure out what to do with the data byte
-     * based on the current message type
-     */
-    switch (parser->message_type) {
-
-    case MIDI_MESSAGE_NOTE_OFF:
-        parser->buffer[parser->byte_count++] = byte;
-        if (parser->byte_count != 2) { break; }
-        message->message_type = MIDI_MESSAGE_NOTE_OFF;
-        message->channel = parser->channel;
-        message->note = parser->buffer[0];
-        message->velocity = parser->buffer[1];
-        parser->byte_count = 0;
-        return MIDI_MESSAGE_NOTE_OFF;
-
-    case MIDI_MESSAGE_NOTE_ON:
-        parser->buffer[parser->byte_count++] = byte;
-        if (parser->byte_count != 2) { break; }
-        message->channel = parser->channel;
-        message->note = parser->buffer[0];
-        message->velocity = parser->buffer[1];
-        if (message->velocity == 0) {
-            /* Note on with velocity 0 is equivalent to note off */
-            message->message_type = MIDI_MESSAGE_NOTE_OFF;
-        } else {
-            message->message_type = MIDI_MESSAGE_NOTE_ON;
-        }
-        parser->byte_count = 0;
-        return message->message_type;
-
-    case MIDI_MESSAGE_KEY_PRESSURE:
-        parser->buffer[parser->byte_count++] = byte;
-        if (parser->byte_count != 2) { break; }
-        message->message_type = MIDI_MESSAGE_KEY_PRESSURE;
-        message->channel = parser->channel;
-        message->key = parser->buffer[0];
-        message->key_pressure = parser->buffer[1];
-        parser->byte_count = 0;
-        return MIDI_MESSAGE_KEY_PRESSURE;
-
-    case MIDI_MESSAGE_CONTROL_CHANGE:
-        parser->buffer[parser->byte_count++] = byte;
-        if (parser->byte_count != 2) { break; }
-        message->message_type = MIDI_MESSAGE_CONTROL_CHANGE;
-        message->channel = parser->channel;
-        message->controller = (midi_controller_t)parser->buffer[0];
-        message->control_value = parser->buffer[1];
-        parser->byte_count = 0;
-        switch (message->controller) {
-        case MIDI_CC_ALL_SOUND_OFF:
-        case MIDI_CC_RESET_ALL_CONTROLLERS:
-        case MIDI_CC_LOCAL_CONTROL:
-        case MIDI_CC_ALL_NOTES_OFF:
-        case MIDI_CC_OMNI_OFF:
-        case MIDI_CC_OMNI_ON:
-        case MIDI_CC_MONO_ON:
-        case MIDI_CC_POLY_ON:
-            message->message_type = (midi_message_type_t)message->controller;
-            break;
-        default:
-            break;
-        }
-        return message->message_type;
-
-    case MIDI_MESSAGE_PROGRAM_CHANGE:
-        message->message_type = MIDI_MESSAGE_PROGRAM_CHANGE;
-        message->channel = parser->channel;
-        message->program = byte;
-        parser->byte_count = 0;
-        return MIDI_MESSAGE_PROGRAM_CHANGE;
-
-    case MIDI_MESSAGE_CHANNEL_PRESSURE:
-        message->message_type = MIDI_MESSAGE_CHANNEL_PRESSURE;
-        message->channel = parser->channel;
-        message->channel_pressure = byte;
-        parser->byte_count = 0;
-        return MIDI_MESSAGE_CHANNEL_PRESSURE;
-
-    case MIDI_MESSAGE_PITCH_BEND:
-        parser->buffer[parser->byte_count++] = byte;
-        if (parser->byte_count != 2) { break; }
-        message->message_type = MIDI_MESSAGE_PITCH_BEND;
-        message->channel = parser->channel;
-        message->pitch_bend = parser->buffer[1] << 7 | parser->buffer[0];
-        parser->byte_count = 0;
-        return MIDI_MESSAGE_PITCH_BEND;
-
-    case MIDI_MESSAGE_SYSTEM_EXCLUSIVE:
-        /* Just ignore the data byte */
-        return MIDI_MESSAGE_NONE;
-
-    case MIDI_MESSAGE_MTC_QUARTER_FRAME:
-        parser->message_type = MIDI_MESSAGE_NONE;
-        parser->byte_count = 0;
-        message->message_type = MIDI_MESSAGE_MTC_QUARTER_FRAME;
-        message->channel = MIDI_CHANNEL_NONE;
-        message->mtc_msg_type = byte >> 4;
-        message->mtc_values = byte & MIDI_LSN_MASK;
-        return MIDI_MESSAGE_MTC_QUARTER_FRAME;
-
-    case MIDI_MESSAGE_SONG_POSITION_POINTER:
-        parser->buffer[parser->byte_count++] = byte;
-        if (parser->byte_count != 2) { break; }
-        parser->message_type = MIDI_MESSAGE_NONE;
-        parser->byte_count = 0;
-        message->message_type = MIDI_MESSAGE_SONG_POSITION_POINTER;
-        message->channel = MIDI_CHANNEL_NONE;
-        message->song_position = parser->buffer[1] << 7 | parser->buffer[0];
-        return message->message_type;
-
-    case MIDI_MESSAGE_SONG_SELECT:
-        parser->message_type = MIDI_MESSAGE_NONE;
-        parser->byte_count = 0;
-        message->message_type = MIDI_MESSAGE_SONG_SELECT;
-        message->channel = MIDI_CHANNEL_NONE;
-        message->song_select = byte;
-        return MIDI_MESSAGE_SONG_SELECT;
-
-    default:
-        /* Unexpected data byte at this time */
-        break;
-    }
-
-    return MIDI_MESSAGE_NONE;
-}
+/***********************************************************************
+ * @file midi.c
+ * @brief MIDI parser implementation
+ *
+ * @details MIDI parser implementation for parsing MIDI 1.0 messages
+ *          byte-by-byte using a state machine approach. Supports channel
+ *          voice messages, system messages, and running status.
+ *
+ * @see MIDI 1.0 Detailed Specification
+ *      https://midi.org/midi-1-0-detailed-specification
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+/* None */
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIDI_SCAN_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)                                      \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIDI_SCAN_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MIDI_SCAN_NEON
+#endif
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief MIDI Most Significant Nibble Mask
+ * @details The mask for the most significant nibble of a MIDI status byte
+ */
+#define MIDI_MSN_MASK (0xF0)
+
+/**
+ * @brief MIDI Least Significant Nibble Mask
+ * @details The mask for the least significant nibble of a MIDI status byte
+ */
+#define MIDI_LSN_MASK (0x0F)
+
+/**
+ * @brief MIDI Channel Mask
+ * @details The mask for the channel component of a MIDI channel message
+ */
+#define MIDI_CHANNEL_MASK (0x0F)
+
+/**
+ * @brief MIDI Most Significant Bit Mask
+ * @details The mask for the most significant bit of a MIDI byte
+ */
+#define MIDI_MSB_MASK (0x80)
+
+/**
+ * @brief MIDI Most Significant Bit Mask (64-bit)
+ * @details The mask for the most significant bit of each byte of a word
+ */
+#define MIDI_MSB_MASK_64 (0x8080808080808080ull)
+
+/**
+ * @brief MIDI Parser Buffer Size
+ * @details The maximum buffer size for midi_parser_t.buffer
+ */
+#define MIDI_BUFFER_SIZE (2)
+
+/**
+ * @brief MIDI Maximum Data Byte Value
+ * @details The maximum valid data byte value
+ */
+#define MIDI_MAX_DATA_BYTE (0x7F)
+
+/**
+ * @brief Status Descriptor Index Mask
+ * @details The mask applied to a status byte to index status_descriptors
+ */
+#define STATUS_INDEX_MASK (0x7F)
+
+/**
+ * @brief Status Flag: Channel Message
+ * @details The low nibble of the status byte holds the channel number
+ */
+#define STATUS_FLAG_CHANNEL (0x01)
+
+/**
+ * @brief Status Flag: Set State
+ * @details The status byte becomes the current message type of the parser
+ */
+#define STATUS_FLAG_STATE (0x02)
+
+/**
+ * @brief Status Flag: Running Status
+ * @details The message type is kept after the message completes,
+ *          so further data bytes start a new message of the same type
+ */
+#define STATUS_FLAG_RUNNING (0x04)
+
+/**
+ * @brief Status Flag: Complete
+ * @details The message is complete as soon as the status byte is received
+ */
+#define STATUS_FLAG_COMPLETE (0x08)
+
+/**
+ * @brief Status Flag: Keep State
+ * @details The status byte does not affect the parser state
+ *          (System Real-Time and undefined status bytes)
+ */
+#define STATUS_FLAG_KEEP_STATE (0x10)
+
+/**
+ * @brief Channel Voice Status Descriptor
+ * @details Builds the descriptor for a channel voice status byte
+ */
+#define CHANNEL_STATUS(type, length)                                          \
+    {(type),                                                                  \
+     (length),                                                                \
+     STATUS_FLAG_CHANNEL | STATUS_FLAG_STATE | STATUS_FLAG_RUNNING}
+
+/**
+ * @brief Repeat a descriptor for all 16 channels of a channel voice message
+ */
+#define REPEAT_16(x) x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x
+
+/**
+ * @brief All Channels Mask
+ * @details Channel mask that accepts messages on every channel
+ */
+#define MIDI_ALL_CHANNELS_MASK (0xFFFF)
+
+/**
+ * @brief Add to a Statistics Counter
+ * @details Adds to a counter of midi_parser_stats_t. Compiles to nothing
+ *          when MIDI_CONFIG_STATS is 0, without evaluating its arguments
+ */
+#if MIDI_CONFIG_STATS
+#define STATS_ADD(parser, counter, amount)                                    \
+    ((parser)->stats.counter += (uint32_t)(amount))
+#else
+#define STATS_ADD(parser, counter, amount) ((void)0)
+#endif
+
+/**
+ * @brief Count a Message in the Statistics
+ */
+#define STATS_COUNT_MESSAGE(parser, message_type)                             \
+    STATS_ADD(parser, messages[midi_stats_type_index(message_type)], 1)
+
+/**
+ * @brief Always Inline
+ * @details Forces inlining of the shared buffer parsing loop so that
+ *          each public entry point gets a copy specialized for its
+ *          output format
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define MIDI_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define MIDI_ALWAYS_INLINE inline
+#endif
+
+/*=====================================================================*
+    Private Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Status Byte Descriptor
+ * @details Describes how the parser handles a status byte
+ *          and the data bytes that follow it
+ */
+typedef struct status_descriptor_t {
+    /**
+     * @brief The message type started or completed by the status byte
+     */
+    uint8_t message_type;
+
+    /**
+     * @brief The number of data bytes that complete the message
+     * @details Zero for messages without data bytes, and for
+     *          System Exclusive whose data bytes are not decoded
+     */
+    uint8_t data_length;
+
+    /**
+     * @brief Combination of STATUS_FLAG_* values
+     */
+    uint8_t flags;
+} status_descriptor_t;
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+/* MIDI Parser Internal Functions */
+static inline midi_message_type_t parse_byte(midi_parser_t *parser,
+                                             const uint8_t byte,
+                                             midi_message_t *message);
+
+static MIDI_ALWAYS_INLINE size_t
+parse_buffer(midi_parser_t *parser,
+             const uint8_t *buffer,
+             const size_t length,
+             midi_message_t *messages,
+             midi_packed_t *packed,
+             const midi_dispatcher_t *dispatcher,
+             uint32_t *timestamps,
+             const uint32_t base,
+             const uint32_t period,
+             const size_t capacity,
+             size_t *consumed);
+
+static inline midi_message_type_t parse_status_byte(midi_parser_t *parser,
+                                                    const uint8_t byte,
+                                                    midi_message_t *message);
+
+static inline midi_message_type_t parse_data_byte(midi_parser_t *parser,
+                                                  const uint8_t byte,
+                                                  midi_message_t *message);
+
+static inline midi_message_type_t
+decode_message(const midi_message_type_t message_type,
+               const midi_channel_t channel,
+               const uint8_t data0,
+               const uint8_t data1,
+               midi_message_t *message);
+
+static inline midi_message_type_t
+decode_channel_message(const midi_message_type_t message_type,
+                       const midi_channel_t channel,
+                       const uint8_t data0,
+                       const uint8_t data1,
+                       midi_message_t *message);
+
+static inline int
+is_two_byte_channel_message(const midi_message_type_t message_type);
+
+static inline int is_channel_message(const midi_message_type_t message_type);
+
+static inline uint32_t first_set_bit(const uint32_t mask);
+
+static inline size_t
+find_status_byte(const uint8_t *buffer, size_t index, const size_t length);
+
+static MIDI_ALWAYS_INLINE size_t
+decode_data_run(midi_parser_t *state,
+                const uint8_t *run,
+                const size_t run_length,
+                midi_message_t *messages,
+                midi_packed_t *packed,
+                const midi_dispatcher_t *dispatcher,
+                uint32_t *timestamps,
+                const uint32_t run_time,
+                const uint32_t period,
+                const size_t available,
+                size_t *count);
+
+static MIDI_ALWAYS_INLINE void
+emit_channel_message(midi_message_t *messages,
+                     midi_packed_t *packed,
+                     const midi_dispatcher_t *dispatcher,
+                     const size_t index,
+                     const midi_message_type_t message_type,
+                     const midi_channel_t channel,
+                     const uint8_t data0,
+                     const uint8_t data1);
+
+static inline void dispatch_message(const midi_dispatcher_t *dispatcher,
+                                    const midi_message_t *message);
+
+static inline midi_message_type_t
+channel_message_type(const midi_message_type_t message_type,
+                     const uint8_t data0,
+                     const uint8_t data1);
+
+static inline midi_packed_t
+pack_channel_message(const midi_message_type_t message_type,
+                     const midi_channel_t channel,
+                     const uint8_t data0,
+                     const uint8_t data1);
+
+static inline void deliver_sysex_span(midi_parser_t *state,
+                                      const uint8_t *buffer,
+                                      const size_t index,
+                                      const size_t end,
+                                      const size_t length);
+
+static inline void deliver_realtime_event(midi_parser_t *state,
+                                          const uint8_t byte,
+                                          const size_t offset,
+                                          const int timed,
+                                          const uint32_t timestamp);
+
+static inline void reset_state(midi_parser_t *parser);
+
+static void update_filters(midi_parser_t *parser);
+
+static inline int test_bit(const uint32_t *mask, const uint8_t index);
+
+static inline void
+assign_bit(uint32_t *mask, const uint8_t index, const int value);
+
+static inline int is_accepted(const midi_parser_t *parser,
+                              const midi_message_type_t message_type,
+                              const uint8_t data0,
+                              const uint8_t data1);
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+
+/**
+ * @brief Status Byte Descriptor Table
+ * @details Indexed by the status byte with the most significant bit
+ *          cleared (status & STATUS_INDEX_MASK)
+ */
+static const status_descriptor_t status_descriptors[128] = {
+    /* 0x80 - 0xEF: Channel Voice Messages */
+    REPEAT_16(CHANNEL_STATUS(MIDI_MESSAGE_NOTE_OFF, 2)),
+    REPEAT_16(CHANNEL_STATUS(MIDI_MESSAGE_NOTE_ON, 2)),
+    REPEAT_16(CHANNEL_STATUS(MIDI_MESSAGE_KEY_PRESSURE, 2)),
+    REPEAT_16(CHANNEL_STATUS(MIDI_MESSAGE_CONTROL_CHANGE, 2)),
+    REPEAT_16(CHANNEL_STATUS(MIDI_MESSAGE_PROGRAM_CHANGE, 1)),
+    REPEAT_16(CHANNEL_STATUS(MIDI_MESSAGE_CHANNEL_PRESSURE, 1)),
+    REPEAT_16(CHANNEL_STATUS(MIDI_MESSAGE_PITCH_BEND, 2)),
+
+    /*
+     * 0xF0 - 0xF7: System Exclusive and System Common Messages.
+     * Families that are compiled out keep their data length, so that
+     * midi_status_data_length still frames them, but start no message
+     */
+#if MIDI_CONFIG_SYSEX
+    {MIDI_MESSAGE_SYSTEM_EXCLUSIVE,
+     0,
+     STATUS_FLAG_STATE | STATUS_FLAG_RUNNING | STATUS_FLAG_COMPLETE},
+#else
+    {MIDI_MESSAGE_NONE, 0, 0},
+#endif
+#if MIDI_CONFIG_MTC
+    {MIDI_MESSAGE_MTC_QUARTER_FRAME, 1, STATUS_FLAG_STATE},
+#else
+    {MIDI_MESSAGE_NONE, 1, 0},
+#endif
+#if MIDI_CONFIG_SONG
+    {MIDI_MESSAGE_SONG_POSITION_POINTER, 2, STATUS_FLAG_STATE},
+    {MIDI_MESSAGE_SONG_SELECT, 1, STATUS_FLAG_STATE},
+#else
+    {MIDI_MESSAGE_NONE, 2, 0},
+    {MIDI_MESSAGE_NONE, 1, 0},
+#endif
+    {MIDI_MESSAGE_NONE, 0, STATUS_FLAG_KEEP_STATE}, /* 0xF4 Undefined */
+    {MIDI_MESSAGE_NONE, 0, STATUS_FLAG_KEEP_STATE}, /* 0xF5 Undefined */
+    {MIDI_MESSAGE_TUNE_REQUEST, 0, STATUS_FLAG_COMPLETE},
+#if MIDI_CONFIG_SYSEX
+    {MIDI_MESSAGE_END_OF_EXCLUSIVE, 0, STATUS_FLAG_COMPLETE},
+#else
+    {MIDI_MESSAGE_NONE, 0, 0},
+#endif
+
+    /* 0xF8 - 0xFF: System Real-Time Messages */
+    {MIDI_MESSAGE_TIMING_CLOCK,
+     0,
+     STATUS_FLAG_KEEP_STATE | STATUS_FLAG_COMPLETE},
+    {MIDI_MESSAGE_NONE, 0, STATUS_FLAG_KEEP_STATE}, /* 0xF9 Undefined */
+    {MIDI_MESSAGE_START, 0, STATUS_FLAG_KEEP_STATE | STATUS_FLAG_COMPLETE},
+    {MIDI_MESSAGE_CONTINUE, 0, STATUS_FLAG_KEEP_STATE | STATUS_FLAG_COMPLETE},
+    {MIDI_MESSAGE_STOP, 0, STATUS_FLAG_KEEP_STATE | STATUS_FLAG_COMPLETE},
+    {MIDI_MESSAGE_NONE, 0, STATUS_FLAG_KEEP_STATE}, /* 0xFD Undefined */
+    {MIDI_MESSAGE_ACTIVE_SENSE,
+     0,
+     STATUS_FLAG_KEEP_STATE | STATUS_FLAG_COMPLETE},
+    {MIDI_MESSAGE_SYSTEM_RESET,
+     0,
+     STATUS_FLAG_KEEP_STATE | STATUS_FLAG_COMPLETE},
+};
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a MIDI parser
+ * @param [in, out] parser Pointer to a midi_parser_t struct to initialize
+ * @note This function must be called before using the parser
+ */
+void midi_parser_init(midi_parser_t *parser)
+{
+    if (parser == NULL) { return; }
+
+    parser->active_channel = MIDI_CHANNEL_NONE;
+    parser->channel_mask = MIDI_ALL_CHANNELS_MASK;
+    for (size_t i = 0; i < 8; i++) { parser->type_mask[i] = UINT32_MAX; }
+    for (size_t i = 0; i < 4; i++) { parser->controller_mask[i] = UINT32_MAX; }
+    parser->sysex_handler = NULL;
+    parser->sysex_context = NULL;
+    parser->realtime_handler = NULL;
+    parser->timestamp_source = NULL;
+    parser->realtime_context = NULL;
+    midi_parser_reset_stats(parser);
+    update_filters(parser);
+    reset_state(parser);
+}
+
+/**
+ * @brief Reset a MIDI parser to its initial state
+ * @param [in,out] parser Pointer to a midi_parser_t struct to reset
+ * @note This clears any partial message state and running status.
+ *       The filters, the SysEx handler and the realtime handler are kept.
+ */
+void midi_parser_reset(midi_parser_t *parser)
+{
+    if (parser == NULL) { return; }
+
+    reset_state(parser);
+}
+
+/**
+ * @brief Get a snapshot of the statistics of a MIDI parser
+ * @param [in] parser Pointer to a midi_parser_t struct
+ * @param [out] stats Pointer to a midi_parser_stats_t struct that
+ *      receives the counters
+ */
+void midi_parser_get_stats(const midi_parser_t *parser,
+                           midi_parser_stats_t *stats)
+{
+    if (parser == NULL || stats == NULL) { return; }
+
+#if MIDI_CONFIG_STATS
+    *stats = parser->stats;
+#else
+    memset(stats, 0, sizeof(*stats));
+#endif
+}
+
+/**
+ * @brief Clear the statistics of a MIDI parser
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ */
+void midi_parser_reset_stats(midi_parser_t *parser)
+{
+    if (parser == NULL) { return; }
+
+#if MIDI_CONFIG_STATS
+    memset(&parser->stats, 0, sizeof(parser->stats));
+#endif
+}
+
+/**
+ * @brief Add the counters of a statistics snapshot to a total
+ * @param [in,out] total Pointer to the totals
+ * @param [in] stats Pointer to the snapshot to add
+ */
+void midi_parser_stats_merge(midi_parser_stats_t *total,
+                             const midi_parser_stats_t *stats)
+{
+    if (total == NULL || stats == NULL) { return; }
+
+    total->bytes += stats->bytes;
+    for (size_t i = 0; i < MIDI_STATS_MESSAGE_TYPES; i++) {
+        total->messages[i] += stats->messages[i];
+    }
+    total->orphaned_data_bytes += stats->orphaned_data_bytes;
+    total->interrupted_messages += stats->interrupted_messages;
+    total->undefined_status_bytes += stats->undefined_status_bytes;
+    total->sysex_bytes += stats->sysex_bytes;
+    total->buffer_overflows += stats->buffer_overflows;
+}
+
+/**
+ * @brief Save the state of a MIDI parser
+ * @param [in] parser Pointer to a midi_parser_t struct
+ * @param [out] state Pointer to a midi_parser_state_t struct
+ */
+void midi_parser_save_state(const midi_parser_t *parser,
+                            midi_parser_state_t *state)
+{
+    if (parser == NULL || state == NULL) { return; }
+
+    state->message_type = parser->message_type;
+    state->channel = parser->channel;
+    state->buffer[0] = parser->buffer[0];
+    state->buffer[1] = parser->buffer[1];
+    state->byte_count = parser->byte_count;
+    state->sysex_flags = parser->sysex_flags;
+}
+
+/**
+ * @brief Restore the state of a MIDI parser
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] state Pointer to a saved midi_parser_state_t struct
+ */
+void midi_parser_restore_state(midi_parser_t *parser,
+                               const midi_parser_state_t *state)
+{
+    if (parser == NULL || state == NULL) { return; }
+
+    /* Rebuild the status byte to apply this parser's status filter */
+    uint8_t status = (uint8_t)state->message_type;
+    if (is_channel_message(state->message_type)) {
+        status |= (uint8_t)(state->channel & MIDI_CHANNEL_MASK);
+    }
+
+    parser->message_type =
+        (state->message_type != MIDI_MESSAGE_NONE
+         && test_bit(parser->status_mask, status & STATUS_INDEX_MASK))
+            ? state->message_type
+            : MIDI_MESSAGE_NONE;
+    parser->channel = state->channel;
+    parser->buffer[0] = state->buffer[0];
+    parser->buffer[1] = state->buffer[1];
+    parser->byte_count =
+        (state->byte_count < MIDI_BUFFER_SIZE) ? state->byte_count : 0;
+    parser->sysex_flags = state->sysex_flags;
+}
+
+/**
+ * @brief Set the active channel for the MIDI parser
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] channel The MIDI channel to set as active,
+ *      or MIDI_CHANNEL_NONE to respond to all channels
+ */
+void midi_parser_set_active_channel(midi_parser_t *parser,
+                                    midi_channel_t channel)
+{
+    if (parser == NULL) { return; }
+
+    if (channel > MIDI_CHANNEL_16) {
+        midi_parser_set_channel_mask(parser, MIDI_ALL_CHANNELS_MASK);
+    } else {
+        midi_parser_set_channel_mask(parser, (uint16_t)(1u << channel));
+    }
+}
+
+/**
+ * @brief Get the active channel for the MIDI parser
+ * @param [in] parser Pointer to a midi_parser_t struct
+ * @return The active channel, or MIDI_CHANNEL_NONE
+ */
+midi_channel_t midi_parser_get_active_channel(midi_parser_t *parser)
+{
+    if (parser == NULL) { return MIDI_CHANNEL_NONE; }
+
+    return parser->active_channel;
+}
+
+/**
+ * @brief Set the channels the MIDI parser responds to
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] mask Bit n set to accept messages on channel n + 1
+ */
+void midi_parser_set_channel_mask(midi_parser_t *parser, uint16_t mask)
+{
+    if (parser == NULL) { return; }
+
+    parser->channel_mask = mask;
+
+    /* The active channel is only defined when a single channel is set */
+    parser->active_channel = MIDI_CHANNEL_NONE;
+    for (uint8_t channel = 0; channel < 16; channel++) {
+        if (mask == (1u << channel)) {
+            parser->active_channel = (midi_channel_t)channel;
+        }
+    }
+
+    update_filters(parser);
+}
+
+/**
+ * @brief Get the channels the MIDI parser responds to
+ * @param [in] parser Pointer to a midi_parser_t struct
+ * @return The channel mask
+ */
+uint16_t midi_parser_get_channel_mask(midi_parser_t *parser)
+{
+    if (parser == NULL) { return MIDI_ALL_CHANNELS_MASK; }
+
+    return parser->channel_mask;
+}
+
+/**
+ * @brief Enable or disable a message type
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] message_type The message type to enable or disable
+ * @param [in] enabled Non-zero to enable the message type
+ */
+void midi_parser_set_message_enabled(midi_parser_t *parser,
+                                     midi_message_type_t message_type,
+                                     int enabled)
+{
+    if (parser == NULL) { return; }
+
+    assign_bit(parser->type_mask, (uint8_t)message_type, enabled);
+    update_filters(parser);
+}
+
+/**
+ * @brief Enable or disable Control Change messages for a controller
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] controller The controller to enable or disable
+ * @param [in] enabled Non-zero to enable the controller
+ */
+void midi_parser_set_controller_enabled(midi_parser_t *parser,
+                                        midi_controller_t controller,
+                                        int enabled)
+{
+    if (parser == NULL) { return; }
+
+    assign_bit(parser->controller_mask,
+               (uint8_t)(controller & MIDI_MAX_DATA_BYTE),
+               enabled);
+    update_filters(parser);
+}
+
+/**
+ * @brief Set the SysEx handler for the MIDI parser
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] handler The function to call for each payload span,
+ *      or NULL to discard SysEx payload bytes
+ * @param [in] context Pointer passed back to the handler. May be NULL.
+ */
+void midi_parser_set_sysex_handler(midi_parser_t *parser,
+                                   midi_sysex_handler_t handler,
+                                   void *context)
+{
+    if (parser == NULL) { return; }
+
+    parser->sysex_handler = handler;
+    parser->sysex_context = context;
+}
+
+/**
+ * @brief Set the realtime handler for the MIDI parser
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] handler The function to call for each System Real-Time
+ *      message, or NULL to return them with the other messages
+ * @param [in] timestamp_source Optional function called to timestamp
+ *      each event. May be NULL.
+ * @param [in] context Pointer passed back to the handler and the
+ *      timestamp source. May be NULL.
+ */
+void midi_parser_set_realtime_handler(midi_parser_t *parser,
+                                      midi_realtime_handler_t handler,
+                                      midi_timestamp_source_t timestamp_source,
+                                      void *context)
+{
+    if (parser == NULL) { return; }
+
+    parser->realtime_handler = handler;
+    parser->timestamp_source = timestamp_source;
+    parser->realtime_context = context;
+}
+
+/**
+ * @brief Parse a MIDI byte
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] byte The byte to parse
+ * @param [out] message Pointer to a midi_message_t struct.
+ *      This struct will be updated with the parsed message data,
+ *      if a complete message has been parsed.
+ * @return The MIDI message type. If a complete message has been
+ *      parsed then the message type will be returned (and will be
+ *      identical to the message_type field in the message struct).
+ *      Otherwise the message type will be MIDI_MESSAGE_NONE
+ * @retval MIDI_MESSAGE_NONE: No complete message has been parsed
+ * @retval others: The message type of the parsed message
+ */
+midi_message_type_t midi_parse_byte(midi_parser_t *parser,
+                                    const uint8_t byte,
+                                    midi_message_t *message)
+{
+    /* Check for NULL pointers */
+    if (parser == NULL || message == NULL) { return MIDI_MESSAGE_NONE; }
+
+    STATS_ADD(parser, bytes, 1);
+    return parse_byte(parser, byte, message);
+}
+
+/**
+ * @brief Parse a buffer of MIDI bytes
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @param [out] messages Pointer to an array of midi_message_t structs.
+ *      Each complete message is written to the next free entry.
+ * @param [in] capacity The number of entries in the messages array
+ * @param [out] consumed Optional pointer that receives the number of
+ *      bytes that were parsed. May be NULL.
+ * @return The number of complete messages written to the messages array
+ */
+size_t midi_parse_buffer(midi_parser_t *parser,
+                         const uint8_t *buffer,
+                         size_t length,
+                         midi_message_t *messages,
+                         size_t capacity,
+                         size_t *consumed)
+{
+    /* Check for NULL pointers */
+    if (parser == NULL || buffer == NULL || messages == NULL) {
+        if (consumed != NULL) { *consumed = 0; }
+        return 0;
+    }
+
+    return parse_buffer(
+        parser, buffer, length, messages, NULL, NULL, NULL, 0, 0, capacity,
+        consumed);
+}
+
+/**
+ * @brief Parse a buffer of MIDI bytes into packed messages
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @param [out] packed Pointer to an array of midi_packed_t words.
+ *      Each complete message is written to the next free entry.
+ * @param [in] capacity The number of entries in the packed array
+ * @param [out] consumed Optional pointer that receives the number of
+ *      bytes that were parsed. May be NULL.
+ * @return The number of complete messages written to the packed array
+ */
+size_t midi_parse_buffer_packed(midi_parser_t *parser,
+                                const uint8_t *buffer,
+                                size_t length,
+                                midi_packed_t *packed,
+                                size_t capacity,
+                                size_t *consumed)
+{
+    /* Check for NULL pointers */
+    if (parser == NULL || buffer == NULL || packed == NULL) {
+        if (consumed != NULL) { *consumed = 0; }
+        return 0;
+    }
+
+    return parse_buffer(
+        parser, buffer, length, NULL, packed, NULL, NULL, 0, 0, capacity,
+        consumed);
+}
+
+/**
+ * @brief Parse a buffer of MIDI bytes and time each message
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @param [in] base The arrival time of the first byte of the buffer
+ * @param [in] period The time taken by each byte
+ * @param [out] messages Pointer to an array of midi_message_t structs
+ * @param [out] timestamps Pointer to an array that receives the arrival
+ *      time of each message
+ * @param [in] capacity The number of entries in the messages and
+ *      timestamps arrays
+ * @param [out] consumed Optional pointer that receives the number of
+ *      bytes that were parsed. May be NULL.
+ * @return The number of complete messages written to the messages array
+ */
+size_t midi_parse_buffer_timed(midi_parser_t *parser,
+                               const uint8_t *buffer,
+                               size_t length,
+                               uint32_t base,
+                               uint32_t period,
+                               midi_message_t *messages,
+                               uint32_t *timestamps,
+                               size_t capacity,
+                               size_t *consumed)
+{
+    /* Check for NULL pointers */
+    if (parser == NULL || buffer == NULL || messages == NULL
+        || timestamps == NULL) {
+        if (consumed != NULL) { *consumed = 0; }
+        return 0;
+    }
+
+    return parse_buffer(parser, buffer, length, messages, NULL, NULL,
+                        timestamps, base, period, capacity, consumed);
+}
+
+/**
+ * @brief Parse a buffer of MIDI bytes into packed messages and time each
+ *        message
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @param [in] base The arrival time of the first byte of the buffer
+ * @param [in] period The time taken by each byte
+ * @param [out] packed Pointer to an array of midi_packed_t words
+ * @param [out] timestamps Pointer to an array that receives the arrival
+ *      time of each message
+ * @param [in] capacity The number of entries in the packed and
+ *      timestamps arrays
+ * @param [out] consumed Optional pointer that receives the number of
+ *      bytes that were parsed. May be NULL.
+ * @return The number of complete messages written to the packed array
+ */
+size_t midi_parse_buffer_packed_timed(midi_parser_t *parser,
+                                      const uint8_t *buffer,
+                                      size_t length,
+                                      uint32_t base,
+                                      uint32_t period,
+                                      midi_packed_t *packed,
+                                      uint32_t *timestamps,
+                                      size_t capacity,
+                                      size_t *consumed)
+{
+    /* Check for NULL pointers */
+    if (parser == NULL || buffer == NULL || packed == NULL
+        || timestamps == NULL) {
+        if (consumed != NULL) { *consumed = 0; }
+        return 0;
+    }
+
+    return parse_buffer(parser, buffer, length, NULL, packed, NULL,
+                        timestamps, base, period, capacity, consumed);
+}
+
+/**
+ * @brief Initialize a MIDI message dispatcher with no handlers
+ * @param [out] dispatcher Pointer to a midi_dispatcher_t struct
+ * @param [in] context Pointer passed to every handler. May be NULL.
+ */
+void midi_dispatcher_init(midi_dispatcher_t *dispatcher, void *context)
+{
+    if (dispatcher == NULL) { return; }
+
+    for (size_t i = 0; i < 256; i++) { dispatcher->handlers[i] = NULL; }
+    for (size_t i = 0; i < 128; i++) {
+        dispatcher->controller_handlers[i] = NULL;
+    }
+    dispatcher->context = context;
+}
+
+/**
+ * @brief Set the handler for a message type
+ * @param [in,out] dispatcher Pointer to a midi_dispatcher_t struct
+ * @param [in] message_type The message type to handle
+ * @param [in] handler The handler, or NULL to ignore the message type
+ */
+void midi_dispatcher_set_handler(midi_dispatcher_t *dispatcher,
+                                 midi_message_type_t message_type,
+                                 midi_message_handler_t handler)
+{
+    if (dispatcher == NULL) { return; }
+
+    dispatcher->handlers[message_type & 0xFF] = handler;
+}
+
+/**
+ * @brief Set the handler for Control Change messages of one controller
+ * @param [in,out] dispatcher Pointer to a midi_dispatcher_t struct
+ * @param [in] controller The controller to handle (0-119)
+ * @param [in] handler The handler, or NULL to use the Control Change
+ *      message handler
+ */
+void midi_dispatcher_set_controller_handler(midi_dispatcher_t *dispatcher,
+                                            midi_controller_t controller,
+                                            midi_message_handler_t handler)
+{
+    if (dispatcher == NULL) { return; }
+
+    dispatcher->controller_handlers[controller & MIDI_MAX_DATA_BYTE] =
+        handler;
+}
+
+/**
+ * @brief Parse a buffer of MIDI bytes and dispatch the messages
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] dispatcher Pointer to a midi_dispatcher_t struct
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @return The number of complete messages parsed
+ */
+size_t midi_parse_buffer_dispatch(midi_parser_t *parser,
+                                  const midi_dispatcher_t *dispatcher,
+                                  const uint8_t *buffer,
+                                  size_t length)
+{
+    /* Check for NULL pointers */
+    if (parser == NULL || dispatcher == NULL || buffer == NULL) { return 0; }
+
+    return parse_buffer(parser, buffer, length, NULL, NULL, dispatcher, NULL,
+                        0, 0, SIZE_MAX, NULL);
+}
+
+/**
+ * @brief Get the number of data bytes that follow a status byte
+ * @param [in] status The status byte
+ * @return The number of data bytes, or 0 for status bytes without
+ *      data bytes (including System Exclusive) and for data bytes
+ */
+size_t midi_status_data_length(uint8_t status)
+{
+    if (!(status & MIDI_MSB_MASK)) { return 0; }
+
+    return status_descriptors[status & STATUS_INDEX_MASK].data_length;
+}
+
+/**
+ * @brief Decode a complete MIDI message from its status and data bytes
+ * @param [in] status The status byte
+ * @param [in] data1 The first data byte, if the message has one
+ * @param [in] data2 The second data byte, if the message has two
+ * @param [out] message Pointer to a midi_message_t struct
+ *      that will be updated with the decoded message data
+ * @return The decoded message type, or MIDI_MESSAGE_NONE if the status
+ *      byte is undefined or not a status byte
+ */
+midi_message_type_t midi_decode_message(uint8_t status,
+                                        uint8_t data1,
+                                        uint8_t data2,
+                                        midi_message_t *message)
+{
+    /* Check for NULL pointers */
+    if (message == NULL) { return MIDI_MESSAGE_NONE; }
+
+    if (!(status & MIDI_MSB_MASK)) {
+        message->message_type = MIDI_MESSAGE_NONE;
+        return MIDI_MESSAGE_NONE;
+    }
+
+    const status_descriptor_t descriptor =
+        status_descriptors[status & STATUS_INDEX_MASK];
+
+    /* Messages that are complete with their status byte */
+    if (descriptor.data_length == 0) {
+        message->message_type =
+            (descriptor.flags & STATUS_FLAG_COMPLETE)
+                ? (midi_message_type_t)descriptor.message_type
+                : MIDI_MESSAGE_NONE;
+        message->channel = MIDI_CHANNEL_NONE;
+        return message->message_type;
+    }
+
+    return decode_message((midi_message_type_t)descriptor.message_type,
+                          (descriptor.flags & STATUS_FLAG_CHANNEL)
+                              ? (midi_channel_t)(status & MIDI_CHANNEL_MASK)
+                              : MIDI_CHANNEL_NONE,
+                          data1 & MIDI_MAX_DATA_BYTE,
+                          data2 & MIDI_MAX_DATA_BYTE,
+                          message);
+}
+
+/**
+ * @brief Check a complete MIDI message against the filters of a parser
+ * @param [in] parser Pointer to a midi_parser_t struct
+ * @param [in] status The status byte
+ * @param [in] data1 The first data byte, if the message has one
+ * @param [in] data2 The second data byte, if the message has two
+ * @return Non-zero if the parser would return the message
+ */
+int midi_parser_accepts(const midi_parser_t *parser,
+                        uint8_t status,
+                        uint8_t data1,
+                        uint8_t data2)
+{
+    /* Check for NULL pointers */
+    if (parser == NULL) { return 0; }
+
+    if (!(status & MIDI_MSB_MASK)
+        || !test_bit(parser->status_mask, status & STATUS_INDEX_MASK)) {
+        return 0;
+    }
+
+    const status_descriptor_t descriptor =
+        status_descriptors[status & STATUS_INDEX_MASK];
+
+    /* Messages whose type depends on the data bytes */
+    return !parser->filter_decoded
+           || is_accepted(parser,
+                          (midi_message_type_t)descriptor.message_type,
+                          data1 & MIDI_MAX_DATA_BYTE,
+                          data2 & MIDI_MAX_DATA_BYTE);
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Parse a MIDI byte without validating the arguments
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] byte The byte to parse
+ * @param [out] message Pointer to a midi_message_t struct.
+ *      This struct will be updated with the parsed message data,
+ *      if a complete message has been parsed.
+ * @return The MIDI message type, or MIDI_MESSAGE_NONE if no complete
+ *      message has been parsed
+ * @note The caller is responsible for checking for NULL pointers
+ */
+static inline midi_message_type_t parse_byte(midi_parser_t *parser,
+                                             const uint8_t byte,
+                                             midi_message_t *message)
+{
+    midi_message_type_t message_type;
+
+    /* Check if we got a status byte */
+    if (byte & MIDI_MSB_MASK) {
+        message_type = parse_status_byte(parser, byte, message);
+    } else {
+        /* It's a data byte */
+        message_type = parse_data_byte(parser, byte, message);
+    }
+
+    if (MIDI_CONFIG_STATS && message_type != MIDI_MESSAGE_NONE) {
+        STATS_COUNT_MESSAGE(parser, message_type);
+    }
+    return message_type;
+}
+
+/**
+ * @brief Parse a buffer of MIDI bytes without validating the arguments
+ * @details Shared implementation of the buffer parsing functions.
+ *          Exactly one of messages, packed and dispatcher must be
+ *          non-NULL; since this function is always inlined into its
+ *          callers, the output format is resolved at compile time.
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @param [out] messages Pointer to an array of midi_message_t structs,
+ *      or NULL when parsing into another format
+ * @param [out] packed Pointer to an array of midi_packed_t words,
+ *      or NULL when parsing into another format
+ * @param [in] dispatcher Pointer to the dispatcher to pass each message
+ *      to, or NULL when parsing into an array
+ * @param [out] timestamps Pointer to an array that receives the arrival
+ *      time of each message, or NULL when the messages are not timed
+ * @param [in] base The arrival time of the first byte of the buffer
+ * @param [in] period The time taken by each byte
+ * @param [in] capacity The number of entries in the output array
+ * @param [out] consumed Optional pointer that receives the number of
+ *      bytes that were parsed. May be NULL.
+ * @return The number of complete messages written to the output array
+ */
+static MIDI_ALWAYS_INLINE size_t
+parse_buffer(midi_parser_t *parser,
+             const uint8_t *buffer,
+             const size_t length,
+             midi_message_t *messages,
+             midi_packed_t *packed,
+             const midi_dispatcher_t *dispatcher,
+             uint32_t *timestamps,
+             const uint32_t base,
+             const uint32_t period,
+             const size_t capacity,
+             size_t *consumed)
+{
+    size_t count = 0;
+    size_t index = 0;
+    midi_message_t message = {0};
+
+    /*
+     * Work on a local copy of the parser, written back at the end. Only
+     * the static functions of this file see its address, so the
+     * compiler knows that the writes to the output arrays and the
+     * handler calls leave it unchanged, and need not reload its fields
+     * after each of them as it must through the parser pointer
+     */
+    midi_parser_t state = *parser;
+
+    while (index < length && count < capacity) {
+        /*
+         * Data bytes are ignored while no message is being received,
+         * including after a status byte rejected by the filters. Like the
+         * scan below, it only starts on a data byte.
+         */
+        if (state.message_type == MIDI_MESSAGE_NONE
+            && !(buffer[index] & MIDI_MSB_MASK)) {
+            const size_t next = find_status_byte(buffer, index, length);
+            STATS_ADD(&state, orphaned_data_bytes, next - index);
+            index = next;
+            if (index >= length) { break; }
+        }
+
+        /*
+         * Fast path for running status: while the parser is at the start
+         * of a channel voice message, find the next status byte and decode
+         * the data bytes up to it without going through the state machine.
+         * A status byte goes straight to the state machine instead, so
+         * that status dense streams do not pay for a scan per byte.
+         */
+        if (state.byte_count == 0 && is_channel_message(state.message_type)
+            && !(buffer[index] & MIDI_MSB_MASK)) {
+            const size_t end = find_status_byte(buffer, index, length);
+            const size_t used = decode_data_run(&state,
+                                                &buffer[index],
+                                                end - index,
+                                                messages ? &messages[count]
+                                                         : NULL,
+                                                packed ? &packed[count] : NULL,
+                                                dispatcher,
+                                                timestamps ? &timestamps[count]
+                                                           : NULL,
+                                                base
+                                                    + period * (uint32_t)index,
+                                                period,
+                                                capacity - count,
+                                                &count);
+            index += used;
+            if (index >= length || count >= capacity) { break; }
+        }
+
+        /*
+         * SysEx payload: hand the data bytes up to the next status byte
+         * to the SysEx handler as a single span, or skip them if no
+         * handler is set
+         */
+#if MIDI_CONFIG_SYSEX
+        if (state.message_type == MIDI_MESSAGE_SYSTEM_EXCLUSIVE) {
+            const size_t end = find_status_byte(buffer, index, length);
+            if (state.sysex_handler != NULL) {
+                deliver_sysex_span(&state, buffer, index, end, length);
+            }
+            STATS_ADD(&state, sysex_bytes, end - index);
+            index = end;
+            if (index >= length) { break; }
+        }
+#endif
+
+        /* System Real-Time bytes go straight to the realtime lane */
+        if (buffer[index] >= MIDI_MESSAGE_TIMING_CLOCK
+            && state.realtime_handler != NULL) {
+            deliver_realtime_event(&state,
+                                   buffer[index],
+                                   index,
+                                   timestamps != NULL,
+                                   base + period * (uint32_t)index);
+            index++;
+            continue;
+        }
+
+        /* A message arrives with the byte that completes it */
+        if (timestamps != NULL) {
+            timestamps[count] = base + period * (uint32_t)index;
+        }
+
+        if (messages != NULL) {
+            if (parse_byte(&state, buffer[index++], &messages[count])
+                != MIDI_MESSAGE_NONE) {
+                count++;
+            }
+        } else if (packed != NULL) {
+            if (parse_byte(&state, buffer[index++], &message)
+                != MIDI_MESSAGE_NONE) {
+                packed[count++] = midi_message_pack(&message);
+            }
+        } else {
+            if (parse_byte(&state, buffer[index++], &message)
+                != MIDI_MESSAGE_NONE) {
+                dispatch_message(dispatcher, &message);
+                count++;
+            }
+        }
+    }
+
+    STATS_ADD(&state, bytes, index);
+    *parser = state;
+    if (consumed != NULL) { *consumed = index; }
+    return count;
+}
+
+/**
+ * @brief Parse a MIDI status byte
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] byte The byte to parse
+ * @note This function assumes that the byte is a status byte
+ *       and that the pointers have already been checked for NULL
+ * @param [out] message Pointer to a midi_message_t struct.
+ *      This struct will be updated with the parsed message data,
+ *      if a complete message has been parsed.
+ * @return The MIDI message type. If a complete message has been
+ *      parsed then the message type will be returned (and will be
+ *      identical to the message_type field in the message struct).
+ *      Otherwise the message type will be MIDI_MESSAGE_NONE
+ * @retval MIDI_MESSAGE_NONE: No complete message has been parsed
+ * @retval others: The message type of the parsed message
+ */
+static inline midi_message_type_t parse_status_byte(midi_parser_t *parser,
+                                                    const uint8_t byte,
+                                                    midi_message_t *message)
+{
+    const status_descriptor_t descriptor =
+        status_descriptors[byte & STATUS_INDEX_MASK];
+    const int accepted =
+        test_bit(parser->status_mask, byte & STATUS_INDEX_MASK);
+
+    /*
+     * System Real-Time and undefined status bytes do not affect
+     * running status or any partially received message
+     */
+    if (descriptor.flags & STATUS_FLAG_KEEP_STATE) {
+        if (MIDI_CONFIG_STATS && descriptor.message_type == MIDI_MESSAGE_NONE) {
+            STATS_ADD(parser, undefined_status_bytes, 1);
+        }
+    } else {
+        /* A partial message or a SysEx without End of Exclusive is cut */
+        if (MIDI_CONFIG_STATS
+            && (parser->byte_count != 0
+                || (parser->message_type == MIDI_MESSAGE_SYSTEM_EXCLUSIVE
+                    && byte != MIDI_MESSAGE_END_OF_EXCLUSIVE))) {
+            STATS_ADD(parser, interrupted_messages, 1);
+        }
+
+        /*
+         * A rejected status byte leaves no message type,
+         * so its data bytes are ignored
+         */
+        parser->message_type =
+            (accepted && (descriptor.flags & STATUS_FLAG_STATE))
+                ? (midi_message_type_t)descriptor.message_type
+                : MIDI_MESSAGE_NONE;
+        parser->channel = (descriptor.flags & STATUS_FLAG_CHANNEL)
+                              ? (midi_channel_t)(byte & MIDI_CHANNEL_MASK)
+                              : MIDI_CHANNEL_NONE;
+        parser->byte_count = 0;
+
+        /* The next SysEx span starts a new payload */
+        if (descriptor.message_type == MIDI_MESSAGE_SYSTEM_EXCLUSIVE) {
+            parser->sysex_flags = MIDI_SYSEX_FLAG_START;
+        }
+    }
+
+    if (accepted && (descriptor.flags & STATUS_FLAG_COMPLETE)) {
+        message->message_type = (midi_message_type_t)descriptor.message_type;
+        message->channel = MIDI_CHANNEL_NONE;
+        return message->message_type;
+    }
+
+    return MIDI_MESSAGE_NONE;
+}
+
+/**
+ * @brief Parse a MIDI data byte
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] byte The byte to parse
+ * @note This function assumes that the byte is a data byte
+ *       and that the pointers have already been checked for NULL
+ * @param [out] message Pointer to a midi_message_t struct.
+ *      This struct will be updated with the parsed message data,
+ *      if a complete message has been parsed.
+ * @return The MIDI message type. If a complete message has been
+ *      parsed then the message type will be returned (and will be
+ *      identical to the message_type field in the message struct).
+ *      Otherwise the message type will be MIDI_MESSAGE_NONE
+ * @retval MIDI_MESSAGE_NONE: No complete message has been parsed
+ * @retval others: The message type of the parsed message
+ */
+static inline midi_message_type_t parse_data_byte(midi_parser_t *parser,
+                                                  const uint8_t byte,
+                                                  midi_message_t *message)
+{
+    const midi_message_type_t message_type = parser->message_type;
+
+    /* Validate data byte range */
+    if (byte > MIDI_MAX_DATA_BYTE) {
+        /* Invalid data byte - ignore */
+        /* this should literally never happen */
+        return MIDI_MESSAGE_NONE;
+    }
+
+    /* Unexpected data byte at this time */
+    if (message_type == MIDI_MESSAGE_NONE) {
+        STATS_ADD(parser, orphaned_data_bytes, 1);
+        return MIDI_MESSAGE_NONE;
+    }
+
+    const status_descriptor_t descriptor =
+        status_descriptors[message_type & STATUS_INDEX_MASK];
+
+    /* System Exclusive data bytes are ignored */
+    if (descriptor.data_length == 0) {
+        STATS_ADD(parser, sysex_bytes, 1);
+        return MIDI_MESSAGE_NONE;
+    }
+
+    /* Buffer overflow protection */
+    if (parser->byte_count >= MIDI_BUFFER_SIZE) {
+        /* this should never happen */
+        STATS_ADD(parser, buffer_overflows, 1);
+        parser->byte_count = 0;
+        return MIDI_MESSAGE_NONE;
+    }
+
+    parser->buffer[parser->byte_count++] = byte;
+    if (parser->byte_count < descriptor.data_length) {
+        return MIDI_MESSAGE_NONE;
+    }
+    parser->byte_count = 0;
+
+    /* System Common messages clear running status once complete */
+    if (!(descriptor.flags & STATUS_FLAG_RUNNING)) {
+        parser->message_type = MIDI_MESSAGE_NONE;
+    }
+
+    /* Messages whose type depends on the data bytes */
+    if (parser->filter_decoded
+        && !is_accepted(
+            parser, message_type, parser->buffer[0], parser->buffer[1])) {
+        return MIDI_MESSAGE_NONE;
+    }
+
+    return decode_message(message_type,
+                          parser->channel,
+                          parser->buffer[0],
+                          parser->buffer[1],
+                          message);
+}
+
+/**
+ * @brief Decode a message from its data bytes
+ * @param [in] message_type The message type of the status byte
+ * @param [in] channel The channel the message was received on,
+ *      or MIDI_CHANNEL_NONE for System Common messages
+ * @param [in] data0 The first data byte
+ * @param [in] data1 The second data byte. Ignored for messages
+ *      with a single data byte
+ * @param [out] message Pointer to a midi_message_t struct
+ *      that will be updated with the decoded message data
+ * @return The decoded message type
+ */
+static inline midi_message_type_t
+decode_message(const midi_message_type_t message_type,
+               const midi_channel_t channel,
+               const uint8_t data0,
+               const uint8_t data1,
+               midi_message_t *message)
+{
+    if (is_two_byte_channel_message(message_type)) {
+        return decode_channel_message(
+            message_type, channel, data0, data1, message);
+    }
+
+    message->channel = channel;
+
+    switch (message_type) {
+
+    case MIDI_MESSAGE_PROGRAM_CHANGE:
+        message->message_type = MIDI_MESSAGE_PROGRAM_CHANGE;
+        message->program = data0;
+        break;
+
+    case MIDI_MESSAGE_CHANNEL_PRESSURE:
+        message->message_type = MIDI_MESSAGE_CHANNEL_PRESSURE;
+        message->channel_pressure = data0;
+        break;
+
+#if MIDI_CONFIG_MTC
+    case MIDI_MESSAGE_MTC_QUARTER_FRAME:
+        message->message_type = MIDI_MESSAGE_MTC_QUARTER_FRAME;
+        message->mtc_msg_type = data0 >> 4;
+        message->mtc_values = data0 & MIDI_LSN_MASK;
+        break;
+#endif
+
+#if MIDI_CONFIG_SONG
+    case MIDI_MESSAGE_SONG_POSITION_POINTER:
+        message->message_type = MIDI_MESSAGE_SONG_POSITION_POINTER;
+        message->song_position = data1 << 7 | data0;
+        break;
+
+    case MIDI_MESSAGE_SONG_SELECT:
+        message->message_type = MIDI_MESSAGE_SONG_SELECT;
+        message->song_select = data0;
+        break;
+#endif
+
+    default:
+        /* Not a message with data bytes */
+        message->message_type = MIDI_MESSAGE_NONE;
+        break;
+    }
+
+    return message->message_type;
+}
+
+/**
+ * @brief Decode a two data byte channel voice message
+ * @param [in] message_type The channel voice message type.
+ *      Must be one of Note Off, Note On, Key Pressure, Control Change
+ *      or Pitch Bend
+ * @param [in] channel The channel the message was received on
+ * @param [in] data0 The first data byte
+ * @param [in] data1 The second data byte
+ * @param [out] message Pointer to a midi_message_t struct
+ *      that will be updated with the decoded message data
+ * @return The decoded message type. Note On messages with a velocity
+ *      of zero are decoded as Note Off, and Control Change messages
+ *      for controllers 120-127 are decoded as Channel Mode messages
+ */
+static inline midi_message_type_t
+decode_channel_message(const midi_message_type_t message_type,
+                       const midi_channel_t channel,
+                       const uint8_t data0,
+                       const uint8_t data1,
+                       midi_message_t *message)
+{
+    message->channel = channel;
+
+    switch (message_type) {
+
+    case MIDI_MESSAGE_NOTE_OFF:
+        message->message_type = MIDI_MESSAGE_NOTE_OFF;
+        message->note = data0;
+        message->velocity = data1;
+        break;
+
+    case MIDI_MESSAGE_NOTE_ON:
+        /* Note on with velocity 0 is equivalent to note off */
+        message->message_type =
+            (data1 == 0) ? MIDI_MESSAGE_NOTE_OFF : MIDI_MESSAGE_NOTE_ON;
+        message->note = data0;
+        message->velocity = data1;
+        break;
+
+    case MIDI_MESSAGE_KEY_PRESSURE:
+        message->message_type = MIDI_MESSAGE_KEY_PRESSURE;
+        message->key = data0;
+        message->key_pressure = data1;
+        break;
+
+    case MIDI_MESSAGE_CONTROL_CHANGE:
+        /* Controllers 120-127 are Channel Mode messages */
+        message->message_type = (MIDI_CONFIG_CHANNEL_MODE
+                                  && data0 >= MIDI_CC_ALL_SOUND_OFF)
+                                    ? (midi_message_type_t)data0
+                                    : MIDI_MESSAGE_CONTROL_CHANGE;
+        message->controller = (midi_controller_t)data0;
+        message->control_value = data1;
+        break;
+
+    case MIDI_MESSAGE_PITCH_BEND:
+        message->message_type = MIDI_MESSAGE_PITCH_BEND;
+        message->pitch_bend = data1 << 7 | data0;
+        break;
+
+    default:
+        /* Not a two byte channel voice message */
+        message->message_type = MIDI_MESSAGE_NONE;
+        break;
+    }
+
+    return message->message_type;
+}
+
+/**
+ * @brief Check for a two data byte channel voice message type
+ * @param [in] message_type The message type to check
+ * @return Non-zero if the message type is Note Off, Note On,
+ *      Key Pressure, Control Change or Pitch Bend, otherwise zero
+ */
+static inline int
+is_two_byte_channel_message(const midi_message_type_t message_type)
+{
+    return (message_type >= MIDI_MESSAGE_NOTE_OFF
+            && message_type <= MIDI_MESSAGE_CONTROL_CHANGE)
+           || message_type == MIDI_MESSAGE_PITCH_BEND;
+}
+
+/**
+ * @brief Get the decoded type of a two data byte channel voice message
+ * @param [in] message_type The channel voice message type of the status
+ *      byte
+ * @param [in] data0 The first data byte
+ * @param [in] data1 The second data byte
+ * @return The message type, with Note On messages with a velocity of
+ *      zero as Note Off and controllers 120-127 as Channel Mode messages
+ */
+static inline midi_message_type_t
+channel_message_type(const midi_message_type_t message_type,
+                     const uint8_t data0,
+                     const uint8_t data1)
+{
+    /* Note on with velocity 0 is equivalent to note off */
+    if (message_type == MIDI_MESSAGE_NOTE_ON && data1 == 0) {
+        return MIDI_MESSAGE_NOTE_OFF;
+    }
+
+    /* Controllers 120-127 are Channel Mode messages */
+    if (message_type == MIDI_MESSAGE_CONTROL_CHANGE
+        && MIDI_CONFIG_CHANNEL_MODE && data0 >= MIDI_CC_ALL_SOUND_OFF) {
+        return (midi_message_type_t)data0;
+    }
+
+    return message_type;
+}
+
+/**
+ * @brief Pack a two data byte channel voice message
+ * @param [in] message_type The channel voice message type.
+ *      Must be one of Note Off, Note On, Key Pressure, Control Change
+ *      or Pitch Bend
+ * @param [in] channel The channel the message was received on
+ * @param [in] data0 The first data byte
+ * @param [in] data1 The second data byte
+ * @return The packed message, decoded in the same way as
+ *      decode_channel_message
+ */
+static inline midi_packed_t
+pack_channel_message(const midi_message_type_t message_type,
+                     const midi_channel_t channel,
+                     const uint8_t data0,
+                     const uint8_t data1)
+{
+    const midi_message_type_t decoded_type =
+        channel_message_type(message_type, data0, data1);
+
+    return midi_packed_make(decoded_type, channel, data0, data1);
+}
+
+/**
+ * @brief Check for a channel voice message type
+ * @param [in] message_type The message type to check
+ * @return Non-zero if the message type is a channel voice message,
+ *      otherwise zero
+ */
+static inline int is_channel_message(const midi_message_type_t message_type)
+{
+    return message_type >= MIDI_MESSAGE_NOTE_OFF
+           && message_type <= MIDI_MESSAGE_PITCH_BEND;
+}
+
+/**
+ * @brief Find the lowest set bit of a mask
+ * @param [in] mask The mask to search. Must not be zero
+ * @return The bit position of the lowest set bit
+ */
+static inline uint32_t first_set_bit(const uint32_t mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (uint32_t)__builtin_ctz(mask);
+#else
+    uint32_t position = 0;
+    while (!(mask & (1u << position))) { position++; }
+    return position;
+#endif
+}
+
+/**
+ * @brief Find the next status byte in a buffer
+ * @details Scans 32 (AVX2) or 16 (SSE2, NEON) bytes at a time using the
+ *          most significant bit of each byte, or 8 bytes at a time with
+ *          plain integer operations on other targets
+ * @param [in] buffer Pointer to the bytes to scan
+ * @param [in] index The index to start scanning from
+ * @param [in] length The number of bytes in the buffer
+ * @return The index of the next status byte, or length if the rest of
+ *      the buffer only holds data bytes
+ */
+static inline size_t
+find_status_byte(const uint8_t *buffer, size_t index, const size_t length)
+{
+#if defined(MIDI_SCAN_AVX2)
+    while (index + 32 <= length) {
+        const __m256i block =
+            _mm256_loadu_si256((const __m256i *)(const void *)&buffer[index]);
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(block);
+        if (mask != 0) { return index + first_set_bit(mask); }
+        index += 32;
+    }
+#endif
+#if defined(MIDI_SCAN_SSE2)
+    while (index + 16 <= length) {
+        const __m128i block =
+            _mm_loadu_si128((const __m128i *)(const void *)&buffer[index]);
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(block);
+        if (mask != 0) { return index + first_set_bit(mask); }
+        index += 16;
+    }
+#elif defined(MIDI_SCAN_NEON)
+    while (index + 16 <= length) {
+        const uint8x16_t block = vld1q_u8(&buffer[index]);
+        /* Narrow each byte's MSB test result to a nibble of a 64-bit mask */
+        const uint8x16_t status = vtstq_u8(block, vdupq_n_u8(MIDI_MSB_MASK));
+        const uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(status), 4);
+        const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+        if (mask != 0) {
+            for (size_t i = 0; i < 16; i++) {
+                if (buffer[index + i] & MIDI_MSB_MASK) { return index + i; }
+            }
+        }
+        index += 16;
+    }
+#else
+    while (index + 8 <= length) {
+        uint64_t word;
+        memcpy(&word, &buffer[index], sizeof(word));
+        if (word & MIDI_MSB_MASK_64) { break; }
+        index += 8;
+    }
+#endif
+    while (index < length && !(buffer[index] & MIDI_MSB_MASK)) { index++; }
+    return index;
+}
+
+/**
+ * @brief Decode a run of data bytes under running status
+ * @details Emits fixed stride messages (two bytes per message for
+ *          Note Off, Note On, Key Pressure, Control Change and Pitch Bend,
+ *          one byte per message for Program Change and Channel Pressure)
+ *          straight from the current message type of the parser.
+ *          When the message type filters depend on the data bytes
+ *          (Note On and Control Change), rejected messages are skipped.
+ *          A trailing odd data byte is left for the state machine.
+ * @param [in,out] state Pointer to the parser state. Must be at the
+ *      start of a channel voice message (byte_count of zero)
+ * @param [in] run Pointer to the data bytes. Must not hold status bytes
+ * @param [in] run_length The number of data bytes in the run
+ * @param [out] messages Pointer to the next free midi_message_t,
+ *      or NULL when decoding into another format
+ * @param [out] packed Pointer to the next free midi_packed_t,
+ *      or NULL when decoding into another format
+ * @param [in] dispatcher Pointer to the dispatcher to pass each message
+ *      to, or NULL when decoding into an array
+ * @param [out] timestamps Pointer to the next free arrival time, or NULL
+ *      when the messages are not timed
+ * @param [in] run_time The arrival time of the first byte of the run
+ * @param [in] period The time taken by each byte
+ * @param [in] available The number of free entries in the output array
+ * @param [in,out] count Incremented by the number of messages decoded
+ * @return The number of data bytes consumed from the run
+ */
+static MIDI_ALWAYS_INLINE size_t
+decode_data_run(midi_parser_t *state,
+                const uint8_t *run,
+                const size_t run_length,
+                midi_message_t *messages,
+                midi_packed_t *packed,
+                const midi_dispatcher_t *dispatcher,
+                uint32_t *timestamps,
+                const uint32_t run_time,
+                const uint32_t period,
+                const size_t available,
+                size_t *count)
+{
+    const midi_message_type_t message_type = state->message_type;
+    const midi_channel_t channel = state->channel;
+    midi_message_t message = {0};
+    size_t total;
+
+    if (is_two_byte_channel_message(message_type)) {
+        const size_t pairs = run_length / 2;
+        size_t pair = 0;
+        total = 0;
+        if (!state->filter_decoded) {
+            total = (pairs < available) ? pairs : available;
+            for (; pair < total; pair++) {
+                if (timestamps != NULL) {
+                    timestamps[pair] =
+                        run_time + period * (uint32_t)(2 * pair + 1);
+                }
+                emit_channel_message(messages,
+                                     packed,
+                                     dispatcher,
+                                     pair,
+                                     message_type,
+                                     channel,
+                                     run[2 * pair],
+                                     run[2 * pair + 1]);
+                STATS_COUNT_MESSAGE(
+                    state,
+                    channel_message_type(
+                        message_type, run[2 * pair], run[2 * pair + 1]));
+            }
+        } else {
+            for (; pair < pairs && total < available; pair++) {
+                const uint8_t data0 = run[2 * pair];
+                const uint8_t data1 = run[2 * pair + 1];
+                if (is_accepted(state, message_type, data0, data1)) {
+                    if (timestamps != NULL) {
+                        timestamps[total] =
+                            run_time + period * (uint32_t)(2 * pair + 1);
+                    }
+                    emit_channel_message(messages,
+                                         packed,
+                                         dispatcher,
+                                         total++,
+                                         message_type,
+                                         channel,
+                                         data0,
+                                         data1);
+                    STATS_COUNT_MESSAGE(
+                        state,
+                        channel_message_type(message_type, data0, data1));
+                }
+            }
+        }
+        if (pair > 0) {
+            /* Leave the buffer as the state machine would have */
+            state->buffer[0] = run[2 * pair - 2];
+            state->buffer[1] = run[2 * pair - 1];
+        }
+        *count += total;
+        return 2 * pair;
+    }
+
+    total = run_length;
+    if (total > available) { total = available; }
+    for (size_t i = 0; i < total; i++) {
+        if (timestamps != NULL) {
+            timestamps[i] = run_time + period * (uint32_t)i;
+        }
+        if (messages != NULL) {
+            decode_message(message_type, channel, run[i], 0, &messages[i]);
+        } else if (packed != NULL) {
+            packed[i] = midi_packed_make(message_type, channel, run[i], 0);
+        } else {
+            decode_message(message_type, channel, run[i], 0, &message);
+            dispatch_message(dispatcher, &message);
+        }
+    }
+    if (total > 0) {
+        /* Leave the buffer as the state machine would have */
+        state->buffer[0] = run[total - 1];
+    }
+    STATS_ADD(state, messages[midi_stats_type_index(message_type)], total);
+    *count += total;
+    return total;
+}
+
+/**
+ * @brief Deliver a span of SysEx payload bytes to the SysEx handler
+ * @details The span is flagged as the end of the payload when the status
+ *          byte that follows it ends the System Exclusive message, and
+ *          as aborted when that status byte is not End of Exclusive.
+ *          Empty spans are only delivered to mark the end of a payload.
+ * @param [in,out] state Pointer to the parser state. Must be receiving
+ *      a System Exclusive message and have a SysEx handler set
+ * @param [in] buffer Pointer to the bytes being parsed
+ * @param [in] index The index of the first payload byte of the span
+ * @param [in] end The index of the next status byte, or length
+ * @param [in] length The number of bytes in the buffer
+ */
+static inline void deliver_sysex_span(midi_parser_t *state,
+                                      const uint8_t *buffer,
+                                      const size_t index,
+                                      const size_t end,
+                                      const size_t length)
+{
+    midi_sysex_span_t span;
+
+    span.data = &buffer[index];
+    span.length = end - index;
+    span.flags = state->sysex_flags;
+
+    if (end < length) {
+        const status_descriptor_t descriptor =
+            status_descriptors[buffer[end] & STATUS_INDEX_MASK];
+        if (!(descriptor.flags & STATUS_FLAG_KEEP_STATE)) {
+            span.flags |= MIDI_SYSEX_FLAG_END;
+            if (buffer[end] != MIDI_MESSAGE_END_OF_EXCLUSIVE) {
+                span.flags |= MIDI_SYSEX_FLAG_ABORTED;
+            }
+        }
+    }
+
+    if (span.length > 0 || (span.flags & MIDI_SYSEX_FLAG_END)) {
+        if (!(span.flags & MIDI_SYSEX_FLAG_START)) {
+            span.flags |= MIDI_SYSEX_FLAG_CONTINUE;
+        }
+        state->sysex_handler(state->sysex_context, &span);
+        state->sysex_flags = 0;
+    }
+}
+
+/**
+ * @brief Write a two data byte channel voice message to the output
+ * @param [out] messages Pointer to the midi_message_t output array,
+ *      or NULL when decoding into another format
+ * @param [out] packed Pointer to the midi_packed_t output array,
+ *      or NULL when decoding into another format
+ * @param [in] dispatcher Pointer to the dispatcher to pass the message
+ *      to, or NULL when decoding into an array
+ * @param [in] index The index of the output array entry to write
+ * @param [in] message_type The channel voice message type
+ * @param [in] channel The channel the message was received on
+ * @param [in] data0 The first data byte
+ * @param [in] data1 The second data byte
+ */
+static MIDI_ALWAYS_INLINE void
+emit_channel_message(midi_message_t *messages,
+                     midi_packed_t *packed,
+                     const midi_dispatcher_t *dispatcher,
+                     const size_t index,
+                     const midi_message_type_t message_type,
+                     const midi_channel_t channel,
+                     const uint8_t data0,
+                     const uint8_t data1)
+{
+    if (messages != NULL) {
+        decode_channel_message(
+            message_type, channel, data0, data1, &messages[index]);
+    } else if (packed != NULL) {
+        packed[index] =
+            pack_channel_message(message_type, channel, data0, data1);
+    } else {
+        midi_message_t message = {0};
+        decode_channel_message(message_type, channel, data0, data1, &message);
+        dispatch_message(dispatcher, &message);
+    }
+}
+
+/**
+ * @brief Pass a message to its handler in a dispatcher
+ * @details Control Change messages go to the handler of their controller
+ *          if one is set, and to the Control Change handler otherwise.
+ *          Messages without a handler are ignored.
+ * @param [in] dispatcher Pointer to a midi_dispatcher_t struct
+ * @param [in] message Pointer to the message to dispatch
+ */
+static inline void dispatch_message(const midi_dispatcher_t *dispatcher,
+                                    const midi_message_t *message)
+{
+    midi_message_handler_t handler =
+        dispatcher->handlers[message->message_type];
+
+    if (message->message_type == MIDI_MESSAGE_CONTROL_CHANGE
+        && dispatcher->controller_handlers[message->controller] != NULL) {
+        handler = dispatcher->controller_handlers[message->controller];
+    }
+
+    if (handler != NULL) { handler(dispatcher->context, message); }
+}
+
+/**
+ * @brief Clear any partial message state and running status
+ * @param [out] parser Pointer to a midi_parser_t struct
+ */
+static inline void reset_state(midi_parser_t *parser)
+{
+    parser->message_type = MIDI_MESSAGE_NONE;
+    parser->channel = MIDI_CHANNEL_NONE;
+    parser->buffer[0] = 0;
+    parser->buffer[1] = 0;
+    parser->byte_count = 0;
+    parser->sysex_flags = 0;
+}
+
+/**
+ * @brief Rebuild the status byte filter from the channel, message type
+ *        and controller masks
+ * @details A status byte is accepted if any message it can start is
+ *          enabled. Note On and Control Change status bytes can also
+ *          start Note Off and Channel Mode messages, so when any of
+ *          those are disabled the decoded messages are filtered as well.
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ */
+static void update_filters(midi_parser_t *parser)
+{
+    const uint32_t *types = parser->type_mask;
+    int modes_enabled = 0;
+    int modes_disabled = 0;
+    int controllers_enabled = 1;
+
+    for (uint8_t mode = MIDI_MESSAGE_ALL_SOUND_OFF;
+         mode <= MIDI_MESSAGE_POLY_ON;
+         mode++) {
+        if (test_bit(types, mode)) {
+            modes_enabled = 1;
+        } else {
+            modes_disabled = 1;
+        }
+    }
+    for (size_t i = 0; i < 4; i++) {
+        if (parser->controller_mask[i] != UINT32_MAX) {
+            controllers_enabled = 0;
+        }
+    }
+
+    for (uint8_t index = 0; index <= STATUS_INDEX_MASK; index++) {
+        const status_descriptor_t descriptor = status_descriptors[index];
+        const uint8_t message_type = descriptor.message_type;
+        int accepted;
+
+        if (descriptor.flags & STATUS_FLAG_CHANNEL) {
+            const uint8_t channel = index & MIDI_CHANNEL_MASK;
+            accepted = test_bit(types, message_type);
+            if (message_type == MIDI_MESSAGE_NOTE_ON) {
+                accepted = accepted || test_bit(types, MIDI_MESSAGE_NOTE_OFF);
+            } else if (message_type == MIDI_MESSAGE_CONTROL_CHANGE) {
+                accepted = accepted || modes_enabled;
+            }
+            accepted = accepted && ((parser->channel_mask >> channel) & 1);
+        } else {
+            /* System messages are indexed by their status byte */
+            accepted = test_bit(types, index | MIDI_MSB_MASK);
+        }
+        assign_bit(parser->status_mask, index, accepted);
+    }
+
+    parser->filter_decoded =
+        !test_bit(types, MIDI_MESSAGE_NOTE_OFF)
+        || !test_bit(types, MIDI_MESSAGE_NOTE_ON)
+        || !test_bit(types, MIDI_MESSAGE_CONTROL_CHANGE) || modes_disabled
+        || !controllers_enabled;
+}
+
+/**
+ * @brief Test a bit of a multi-word mask
+ * @param [in] mask Pointer to the mask words
+ * @param [in] index The index of the bit to test
+ * @return Non-zero if the bit is set
+ */
+static inline int test_bit(const uint32_t *mask, const uint8_t index)
+{
+    return (mask[index >> 5] >> (index & 31)) & 1;
+}
+
+/**
+ * @brief Set or clear a bit of a multi-word mask
+ * @param [in,out] mask Pointer to the mask words
+ * @param [in] index The index of the bit to assign
+ * @param [in] value Non-zero to set the bit, zero to clear it
+ */
+static inline void
+assign_bit(uint32_t *mask, const uint8_t index, const int value)
+{
+    if (value) {
+        mask[index >> 5] |= 1u << (index & 31);
+    } else {
+        mask[index >> 5] &= ~(1u << (index & 31));
+    }
+}
+
+/**
+ * @brief Check a message against the message type and controller masks
+ * @details Used for Note On and Control Change status bytes, whose
+ *          message type depends on the data bytes
+ * @param [in] parser Pointer to a midi_parser_t struct
+ * @param [in] message_type The message type of the status byte
+ * @param [in] data0 The first data byte
+ * @param [in] data1 The second data byte
+ * @return Non-zero if the decoded message is accepted
+ */
+static inline int is_accepted(const midi_parser_t *parser,
+                              const midi_message_type_t message_type,
+                              const uint8_t data0,
+                              const uint8_t data1)
+{
+    uint8_t decoded_type = (uint8_t)message_type;
+
+    if (message_type == MIDI_MESSAGE_NOTE_ON && data1 == 0) {
+        decoded_type = MIDI_MESSAGE_NOTE_OFF;
+    } else if (message_type == MIDI_MESSAGE_CONTROL_CHANGE) {
+        if (MIDI_CONFIG_CHANNEL_MODE && data0 >= MIDI_CC_ALL_SOUND_OFF) {
+            decoded_type = data0;
+        } else if (!test_bit(parser->controller_mask, data0)) {
+            return 0;
+        }
+    }
+
+    return test_bit(parser->type_mask, decoded_type);
+}
+
+/**
+ * @brief Deliver a System Real-Time byte to the realtime handler
+ * @details Undefined status bytes and disabled message types are ignored
+ * @param [in] state Pointer to the parser state. Must have a realtime
+ *      handler set
+ * @param [in] byte The System Real-Time status byte
+ * @param [in] offset The index of the byte in the buffer being parsed
+ * @param [in] timed Non-zero to use the arrival time of the byte instead
+ *      of the timestamp source
+ * @param [in] timestamp The arrival time of the byte, when timed
+ */
+static inline void deliver_realtime_event(midi_parser_t *state,
+                                          const uint8_t byte,
+                                          const size_t offset,
+                                          const int timed,
+                                          const uint32_t timestamp)
+{
+    const status_descriptor_t descriptor =
+        status_descriptors[byte & STATUS_INDEX_MASK];
+    midi_realtime_event_t event;
+
+    if (!(descriptor.flags & STATUS_FLAG_COMPLETE)) {
+        STATS_ADD(state, undefined_status_bytes, 1);
+        return;
+    }
+    if (!test_bit(state->status_mask, byte & STATUS_INDEX_MASK)) { return; }
+    STATS_COUNT_MESSAGE(state, descriptor.message_type);
+
+    event.message_type = (midi_message_type_t)descriptor.message_type;
+    if (timed) {
+        event.timestamp = timestamp;
+    } else {
+        event.timestamp =
+            (state->timestamp_source != NULL)
+                ? state->timestamp_source(state->realtime_context)
+                : 0;
+    }
+    event.offset = offset;
+    state->realtime_handler(state->realtime_context, &event);
+}
@@ -1,542 +1,1467 @@
-/**********************************************************************
- * @file midi.h
- * @brief MIDI module
- *
- * @details This module provides a simple interface for sending and
- *          receiving MIDI messages.
- *
- * @see MIDI 1.0 Detailed Specification
- *      https://midi.org/midi-1-0-detailed-specification
- **********************************************************************/
-
-#ifndef MIDI_H
-#define MIDI_H
-
-/*=====================================================================*
-    Required Header Files
- *=====================================================================*/
-#include <stdint.h>
-
-/*=====================================================================*
-    Public Defines
- *=====================================================================*/
-/* None */
-
-/*=====================================================================*
-    Public Data Types
- *=====================================================================*/
-
-/**
- * @brief MIDI Channel
- *
- * @details This enum defines the MIDI channels
- *          The channels are numbered from 1 to 16
- */
-typedef enum midi_channel_t {
-    MIDI_CHANNEL_1 = 0x00,
-    MIDI_CHANNEL_2 = 0x01,
-    MIDI_CHANNEL_3 = 0x02,
-    MIDI_CHANNEL_4 = 0x03,
-    MIDI_CHANNEL_5 = 0x04,
-    MIDI_CHANNEL_6 = 0x05,
-    MIDI_CHANNEL_7 = 0x06,
-    MIDI_CHANNEL_8 = 0x07,
-    MIDI_CHANNEL_9 = 0x08,
-    MIDI_CHANNEL_10 = 0x09,
-    MIDI_CHANNEL_11 = 0x0A,
-    MIDI_CHANNEL_12 = 0x0B,
-    MIDI_CHANNEL_13 = 0x0C,
-    MIDI_CHANNEL_14 = 0x0D,
-    MIDI_CHANNEL_15 = 0x0E,
-    MIDI_CHANNEL_16 = 0x0F,
-    /**
-     * @brief MIDI Channel None
-     * @details This placeholder value is used to indicate
-     *          that no channel is selected or when a channel
-     *          number is not applicable for the message type
-     */
-    MIDI_CHANNEL_NONE = 0xFF,
-
-} midi_channel_t;
-
-/**
- * @brief MIDI Message Type
- *
- * @details This enum defines the MIDI message types
- */
-typedef enum midi_message_type_t {
-
-    /**
-     * @brief MIDI Message None
-     * @details This placeholder value is used to indicate
-     *          that no message is detected
-     */
-    MIDI_MESSAGE_NONE = 0x00,
-
-    /**
-     * @brief Note Off
-     * @param note The MIDI note number to turn off
-     * @param velocity The release velocity of the note if applicable
-     */
-    MIDI_MESSAGE_NOTE_OFF = 0x80,
-
-    /**
-     * @brief Note On
-     * @param note The MIDI note number to turn on
-     * @param velocity The note velocity
-     */
-    MIDI_MESSAGE_NOTE_ON = 0x90,
-
-    /**
-     * @brief Polyphonic Key Pressure
-     * @param key The MIDI note number to set the pressure of
-     * @param key_pressure The pressure of the note
-     */
-    MIDI_MESSAGE_KEY_PRESSURE = 0xA0,
-
-    /**
-     * @brief Control Change
-     * @param controller The controller number to change
-     * @param control_value The value to set on the controller
-     * @note Channel Mode messages are treated as their own
-     *       top-level entry in `midi_message_type_t`
-     */
-    MIDI_MESSAGE_CONTROL_CHANGE = 0xB0,
-
-    /**
-     * @brief All Sound Off
-     */
-    MIDI_MESSAGE_ALL_SOUND_OFF = 0x78, /* 120 */
-
-    /**
-     * @brief Reset All Controllers
-     */
-    MIDI_MESSAGE_RESET_ALL_CONTROLLERS = 0x79, /* 121 */
-
-    /**
-     * @brief Local Control On/Off
-     */
-    MIDI_MESSAGE_LOCAL_CONTROL = 0x7A, /* 122 */
-
-    /**
-     * @brief All Notes Off
-     * @note Also functions as All Notes Off (MIDI 1.0 Spec, Pg 20)
-     */
-    MIDI_MESSAGE_ALL_NOTES_OFF = 0x7B, /* 123 */
-
-    /**
-     * @brief Omni Mode Off
-     * @note Also functions as All Notes Off (MIDI 1.0 Spec, Pg 20)
-     */
-    MIDI_MESSAGE_OMNI_OFF = 0x7C, /* 124 */
-
-    /**
-     * @brief Omni Mode On
-     * @note Also functions as All Notes Off (MIDI 1.0 Spec, Pg 20)
-     */
-    MIDI_MESSAGE_OMNI_ON = 0x7D, /* 125 */
-
-    /**
-     * @brief Mono Mode On
-     * @note Also functions as All Notes Off (MIDI 1.0 Spec, Pg 20)
-     */
-    MIDI_MESSAGE_MONO_ON = 0x7E, /* 126 */
-
-    /**
-     * @brief Poly Mode On
-     * @note Also functions as All Notes Off (MIDI 1.0 Spec, Pg 20)
-     */
-    MIDI_MESSAGE_POLY_ON = 0x7F, /* 127 */
-
-    /**
-     * @brief Program Change
-     * @param program The program number to change to
-     */
-    MIDI_MESSAGE_PROGRAM_CHANGE = 0xC0,
-
-    /**
-     * @brief Channel Pressure
-     * @param channel_pressure The pressure to set on the channel
-     */
-    MIDI_MESSAGE_CHANNEL_PRESSURE = 0xD0,
-
-    /**
-     * @brief Pitch Bend
-     * @param pitch_bend The pitch bend value
-     */
-    MIDI_MESSAGE_PITCH_BEND = 0xE0,
-
-    /**
-     * @brief Start of System Exclusive
-     */
-    MIDI_MESSAGE_SYSTEM_EXCLUSIVE = 0xF0,
-
-    /**
-     * @brief MTC Quarter Frame
-     */
-    MIDI_MESSAGE_MTC_QUARTER_FRAME = 0xF1,
-
-    /**
-     * @brief Song Position Pointer
-     * @param song_position The position in the song
-     */
-    MIDI_MESSAGE_SONG_POSITION_POINTER = 0xF2,
-
-    /**
-     * @brief Song Select
-     * @param song_select The song number to select
-     */
-    MIDI_MESSAGE_SONG_SELECT = 0xF3,
-
-    /**
-     * @brief Tune Request
-     */
-    MIDI_MESSAGE_TUNE_REQUEST = 0xF6,
-
-    /**
-     * @brief End of System Exclusive
-     */
-    MIDI_MESSAGE_END_OF_EXCLUSIVE = 0xF7,
-
-    /**
-     * @brief Timing Clock
-     */
-    MIDI_MESSAGE_TIMING_CLOCK = 0xF8,
-
-    /**
-     * @brief Start
-     */
-    MIDI_MESSAGE_START = 0xFA,
-
-    /**
-     * @brief Continue
-     */
-    MIDI_MESSAGE_CONTINUE = 0xFB,
-
-    /**
-     * @brief Stop
-     */
-    MIDI_MESSAGE_STOP = 0xFC,
-
-    /**
-     * @brief Active Sense
-     */
-    MIDI_MESSAGE_ACTIVE_SENSE = 0xFE,
-
-    /**
-     * @brief System Reset
-     */
-    MIDI_MESSAGE_SYSTEM_RESET = 0xFF,
-
-} midi_message_type_t;
-
-/**
- * @brief MIDI Controller Names
- * @details This enum defines the MIDI controllers names
- */
-typedef enum midi_controller_t {
-    MIDI_CC_BANK_SELECT = 0x00,
-    MIDI_CC_MOD_WHEEL = 0x01,
-    MIDI_CC_BREATH_CONTROLLER = 0x02,
-    MIDI_CC_UNDEFINED_03 = 0x03,
-    MIDI_CC_FOOT_CONTROLLER = 0x04,
-    MIDI_CC_PORTAMENTO_TIME = 0x05,
-    MIDI_CC_DATA_ENTRY_MSB = 0x06,
-    MIDI_CC_CHANNEL_VOLUME = 0x07,
-    MIDI_CC_BALANCE = 0x08,
-    MIDI_CC_UNDEFINED_09 = 0x09,
-    MIDI_CC_PAN = 0x0A,
-    MIDI_CC_EXPRESSION_CONTROLLER = 0x0B,
-    MIDI_CC_EFFECT_CONTROL_1 = 0x0C,
-    MIDI_CC_EFFECT_CONTROL_2 = 0x0D,
-    MIDI_CC_UNDEFINED_0E = 0x0E,
-    MIDI_CC_UNDEFINED_0F = 0x0F,
-    MIDI_CC_GENERAL_PURPOSE_1 = 0x10,
-    MIDI_CC_GENERAL_PURPOSE_2 = 0x11,
-    MIDI_CC_GENERAL_PURPOSE_3 = 0x12,
-    MIDI_CC_GENERAL_PURPOSE_4 = 0x13,
-    MIDI_CC_UNDEFINED_14 = 0x14,
-    MIDI_CC_UNDEFINED_15 = 0x15,
-    MIDI_CC_UNDEFINED_16 = 0x16,
-    MIDI_CC_UNDEFINED_17 = 0x17,
-    MIDI_CC_UNDEFINED_18 = 0x18,
-    MIDI_CC_UNDEFINED_19 = 0x19,
-    MIDI_CC_UNDEFINED_1A = 0x1A,
-    MIDI_CC_UNDEFINED_1B = 0x1B,
-    MIDI_CC_UNDEFINED_1C = 0x1C,
-    MIDI_CC_UNDEFINED_1D = 0x1D,
-    MIDI_CC_UNDEFINED_1E = 0x1E,
-    MIDI_CC_UNDEFINED_1F = 0x1F,
-    MIDI_CC_BANK_SELECT_LSB = 0x20,
-    MIDI_CC_MOD_WHEEL_LSB = 0x21,
-    MIDI_CC_BREATH_CONTROLLER_LSB = 0x22,
-    MIDI_CC_UNDEFINED_23 = 0x23,
-    MIDI_CC_FOOT_CONTROLLER_LSB = 0x24,
-    MIDI_CC_PORTAMENTO_TIME_LSB = 0x25,
-    MIDI_CC_DATA_ENTRY_LSB = 0x26,
-    MIDI_CC_CHANNEL_VOLUME_LSB = 0x27,
-    MIDI_CC_BALANCE_LSB = 0x28,
-    MIDI_CC_UNDEFINED_29 = 0x29,
-    MIDI_CC_PAN_LSB = 0x2A,
-    MIDI_CC_EXPRESSION_CONTROLLER_LSB = 0x2B,
-    MIDI_CC_EFFECT_CONTROL_1_LSB = 0x2C,
-    MIDI_CC_EFFECT_CONTROL_2_LSB = 0x2D,
-    MIDI_CC_UNDEFINED_2E = 0x2E,
-    MIDI_CC_UNDEFINED_2F = 0x2F,
-    MIDI_CC_GENERAL_PURPOSE_1_LSB = 0x30,
-    MIDI_CC_GENERAL_PURPOSE_2_LSB = 0x31,
-    MIDI_CC_GENERAL_PURPOSE_3_LSB = 0x32,
-    MIDI_CC_GENERAL_PURPOSE_4_LSB = 0x33,
-    MIDI_CC_UNDEFINED_34 = 0x34,
-    MIDI_CC_UNDEFINED_35 = 0x35,
-    MIDI_CC_UNDEFINED_36 = 0x36,
-    MIDI_CC_UNDEFINED_37 = 0x37,
-    MIDI_CC_UNDEFINED_38 = 0x38,
-    MIDI_CC_UNDEFINED_39 = 0x39,
-    MIDI_CC_UNDEFINED_3A = 0x3A,
-    MIDI_CC_UNDEFINED_3B = 0x3B,
-    MIDI_CC_UNDEFINED_3C = 0x3C,
-    MIDI_CC_UNDEFINED_3D = 0x3D,
-    MIDI_CC_UNDEFINED_3E = 0x3E,
-    MIDI_CC_UNDEFINED_3F = 0x3F,
-    MIDI_CC_SUSTAIN_PEDAL = 0x40,
-    MIDI_CC_PORTAMENTO_ON_OFF = 0x41,
-    MIDI_CC_SOSTENUTO = 0x42,
-    MIDI_CC_SOFT_PEDAL = 0x43,
-    MIDI_CC_LEGATO_FOOTSWITCH = 0x44,
-    MIDI_CC_HOLD_2 = 0x45,
-    MIDI_CC_SOUND_CTRL_1_VARIATION = 0x46,
-    MIDI_CC_SOUND_CTRL_2_TIMBRE = 0x47,
-    MIDI_CC_SOUND_CTRL_3_RELEASE_TIME = 0x48,
-    MIDI_CC_SOUND_CTRL_4_ATTACK_TIME = 0x49,
-    MIDI_CC_SOUND_CTRL_5_BRIGHTNESS = 0x4A,
-    MIDI_CC_SOUND_CTRL_6 = 0x4B,
-    MIDI_CC_SOUND_CTRL_7 = 0x4C,
-    MIDI_CC_SOUND_CTRL_8 = 0x4D,
-    MIDI_CC_SOUND_CTRL_9 = 0x4E,
-    MIDI_CC_SOUND_CTRL_10 = 0x4F,
-    MIDI_CC_GENERAL_PURPOSE_5 = 0x50,
-    MIDI_CC_GENERAL_PURPOSE_6 = 0x51,
-    MIDI_CC_GENERAL_PURPOSE_7 = 0x52,
-    MIDI_CC_GENERAL_PURPOSE_8 = 0x53,
-    MIDI_CC_PORTAMENTO_CONTROL = 0x54,
-    MIDI_CC_UNDEFINED_55 = 0x55,
-    MIDI_CC_UNDEFINED_56 = 0x56,
-    MIDI_CC_UNDEFINED_57 = 0x57,
-    MIDI_CC_UNDEFINED_58 = 0x58,
-    MIDI_CC_UNDEFINED_59 = 0x59,
-    MIDI_CC_UNDEFINED_5A = 0x5A,
-    MIDI_CC_EFFECT_1_DEPTH = 0x5B,
-    MIDI_CC_EFFECT_2_DEPTH = 0x5C,
-    MIDI_CC_EFFECT_3_DEPTH = 0x5D,
-    MIDI_CC_EFFECT_4_DEPTH = 0x5E,
-    MIDI_CC_EFFECT_5_DEPTH = 0x5F,
-    MIDI_CC_DATA_INCREMENT = 0x60,
-    MIDI_CC_DATA_DECREMENT = 0x61,
-    MIDI_CC_NRPN_LSB = 0x62,
-    MIDI_CC_NRPN_MSB = 0x63,
-    MIDI_CC_RPN_LSB = 0x64,
-    MIDI_CC_RPN_MSB = 0x65,
-    MIDI_CC_UNDEFINED_66 = 0x66,
-    MIDI_CC_UNDEFINED_67 = 0x67,
-    MIDI_CC_UNDEFINED_68 = 0x68,
-    MIDI_CC_UNDEFINED_69 = 0x69,
-    MIDI_CC_UNDEFINED_6A = 0x6A,
-    MIDI_CC_UNDEFINED_6B = 0x6B,
-    MIDI_CC_UNDEFINED_6C = 0x6C,
-    MIDI_CC_UNDEFINED_6D = 0x6D,
-    MIDI_CC_UNDEFINED_6E = 0x6E,
-    MIDI_CC_UNDEFINED_6F = 0x6F,
-    MIDI_CC_UNDEFINED_70 = 0x70,
-    MIDI_CC_UNDEFINED_71 = 0x71,
-    MIDI_CC_UNDEFINED_72 = 0x72,
-    MIDI_CC_UNDEFINED_73 = 0x73,
-    MIDI_CC_UNDEFINED_74 = 0x74,
-    MIDI_CC_UNDEFINED_75 = 0x75,
-    MIDI_CC_UNDEFINED_76 = 0x76,
-    MIDI_CC_UNDEFINED_77 = 0x77,
-    MIDI_CC_ALL_SOUND_OFF = 0x78,
-    MIDI_CC_RESET_ALL_CONTROLLERS = 0x79,
-    MIDI_CC_LOCAL_CONTROL = 0x7A,
-    MIDI_CC_ALL_NOTES_OFF = 0x7B,
-    MIDI_CC_OMNI_OFF = 0x7C,
-    MIDI_CC_OMNI_ON = 0x7D,
-    MIDI_CC_MONO_ON = 0x7E,
-    MIDI_CC_POLY_ON = 0x7F,
-} midi_controller_t;
-
-/**
- * @brief MIDI Message
- * @details This struct defines a MIDI message
- *          and contains its associated data
- */
-typedef struct midi_message_t {
-    /**
-     * @brief MIDI Message Type
-     */
-    midi_message_type_t message_type;
-
-    /**
-     * @brief MIDI Channel Number
-     * @details The MIDI channel number associated with the message
-     *          If channels are not relevant to the specific message
-     *          type then this will be set to MIDI_CHANNEL_NONE
-     */
-    midi_channel_t channel;
-
-    /* Anonymous union to store the data associated with the message */
-    union {
-        /**
-         * @brief Note Off, Note On
-         */
-        struct {
-            /**
-             * @brief MIDI Note Number
-             */
-            uint8_t note;
-            /**
-             * @brief Note velocity
-             */
-            uint8_t velocity;
-        };
-
-        /**
-         * @brief Polyphonic Key Pressure
-         */
-        struct {
-            /**
-             * @brief MIDI Note Number
-             */
-            uint8_t key;
-            /**
-             * @brief Note pressure
-             */
-            uint8_t key_pressure;
-        };
-
-        /**
-         * @brief Control Change
-         */
-        struct {
-            /**
-             * @brief Controller
-             * @details The number of the controller to change
-             */
-            midi_controller_t controller;
-            /**
-             * @brief Control Value
-             * @details The value to set on the controller
-             */
-            uint8_t control_value;
-        };
-
-        /**
-         * @brief Program Change
-         * @details The program number to change to
-         */
-        uint8_t program;
-
-        /**
-         * @brief Channel Pressure
-         * @details The pressure to set on the channel
-         */
-        uint8_t channel_pressure;
-
-        /**
-         * @brief Pitch Bend
-         * @details The pitch bend value
-         */
-        uint16_t pitch_bend;
-
-        /**
-         * @brief Song Position Pointer
-         * @details The position in the song
-         */
-        uint16_t song_position;
-
-        /**
-         * @brief Song Select
-         * @details The song number to select
-         */
-        uint8_t song_select;
-
-        /**
-         * @brief MTC Quarter Frame
-         */
-        struct {
-            uint8_t mtc_msg_type;
-            uint8_t mtc_values;
-        };
-    };
-} midi_message_t;
-
-/**
- * @brief MIDI Parser
- * @details This struct contains the internal state of the MIDI parser
- * @note The fields of this struct should not be accessed directly.
- *       Use the `midi_parse_byte` function to parse MIDI bytes
- */
-typedef struct midi_parser_t {
-    midi_message_type_t message_type;
-    midi_channel_t channel;
-    midi_channel_t active_channel;
-    uint8_t buffer[2];
-    uint8_t byte_count;
-} midi_parser_t;
-
-/*=====================================================================*
-    Public Functions
- *=====================================================================*/
-
-/**
- * @brief Initialize a MIDI parser
- * @param [in, out] parser Pointer to a midi_parser_t struct to initialize
- * @note This function must be called before using the parser
- */
-void midi_parser_init(midi_parser_t *parser);
-
-/**
- * @brief Reset a MIDI parser to its initial state
- * @param [in,out] parser Pointer to a midi_parser_t struct to reset
- * @note This clears any partial message state and running status
- */
-void midi_parser_reset(midi_parser_t *parser);
-
-/**
- * @brief Set the active channel for the MIDI parser
- * @details Causes the parser to only return channel messages
- * @param [in,out] parser Pointer to a midi_parser_t struct
- * @param [in] channel The MIDI channel to set as active
- * @note Setting this value to MIDI_CHANNEL_NONE
- *       will disable the active channel
- *       and the parser will respond to all channels (omni mode)
- */
-void midi_parser_set_active_channel(midi_parser_t *parser,
-                                    midi_channel_t channel);
-
-/**
- * @brief Get the active channel for the MIDI parser
- * @param [in] parser Pointer to a midi_parser_t struct
- * @return The active channel
- */
-midi_channel_t midi_parser_get_active_channel(midi_parser_t *parser);
-
-/**
- * @brief Parse a MIDI byte
- * @param [in,out] parser Pointer to a midi_parser_t struct
- * @param [in] byte The byte to parse
- * @param [out] message Pointer to a midi_message_t struct.
- *      This struct will be updated with the parsed message data,
- *      if a complete message has been parsed.
- * @return The MIDI message type. If a complete message has been
- *      parsed then the message type will be returned (and will be
- *      identical to the message_type field in the message struct).
- *      Otherwise the message type will be MIDI_MESSAGE_NONE
- * @retval MIDI_MESSAGE_NONE: No complete message has been parsed
- * @retval others: The message type of the parsed message
- */
-midi_message_type_t midi_parse_byte(midi_parser_t *parser,
-                                    const uint8_t byte,
-                                    midi_message_t *message);
-
-#endif /* MIDI_H */
+/**********************************************************************
+ * @file midi.h
+ * @brief MIDI module
+ *
+ * @details This module provides a simple interface for sending and
+ *          receiving MIDI messages.
+ *
+ * @see MIDI 1.0 Detailed Specification
+ *      https://midi.org/midi-1-0-detailed-specification
+ **********************************************************************/
+
+#ifndef MIDI_H
+#define MIDI_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+/*=====================================================================*
+    Build Configuration
+
+    Each message family can be compiled out by defining its macro to 0,
+    for example with the MIDI_ENABLE_* CMake options. The status bytes
+    of a family that is compiled out are treated like status bytes that
+    the filters reject: they clear running status and their data bytes
+    are skipped.
+ *=====================================================================*/
+
+/**
+ * @brief Configuration: System Exclusive
+ * @details Set to 0 to compile out System Exclusive and End of Exclusive
+ *          messages and the delivery of SysEx payload spans
+ */
+#ifndef MIDI_CONFIG_SYSEX
+#define MIDI_CONFIG_SYSEX (1)
+#endif
+
+/**
+ * @brief Configuration: MIDI Time Code
+ * @details Set to 0 to compile out MTC Quarter Frame messages
+ */
+#ifndef MIDI_CONFIG_MTC
+#define MIDI_CONFIG_MTC (1)
+#endif
+
+/**
+ * @brief Configuration: Song Position Pointer and Song Select
+ * @details Set to 0 to compile out Song Position Pointer and Song Select
+ *          messages
+ */
+#ifndef MIDI_CONFIG_SONG
+#define MIDI_CONFIG_SONG (1)
+#endif
+
+/**
+ * @brief Configuration: Channel Mode Messages
+ * @details Set to 0 to decode controllers 120-127 as Control Change
+ *          messages instead of Channel Mode messages
+ */
+#ifndef MIDI_CONFIG_CHANNEL_MODE
+#define MIDI_CONFIG_CHANNEL_MODE (1)
+#endif
+
+/**
+ * @brief Configuration: Parser Statistics
+ * @details Set to 1 to count the bytes, messages and stream errors seen
+ *          by each parser (see midi_parser_stats_t). When 0, the counters
+ *          are not part of midi_parser_t and cost nothing.
+ */
+#ifndef MIDI_CONFIG_STATS
+#define MIDI_CONFIG_STATS (0)
+#endif
+
+/**
+ * @brief Configuration: Small Enums
+ * @details Set to 1 to store midi_channel_t, midi_message_type_t and
+ *          midi_controller_t in a single byte, which shrinks
+ *          midi_message_t to 4 bytes and the parser state accordingly.
+ *          Changes the ABI, so every translation unit that includes this
+ *          header must be built with the same setting.
+ * @note Only GCC and Clang support this. Other compilers ignore it.
+ */
+#ifndef MIDI_CONFIG_SMALL_ENUMS
+#define MIDI_CONFIG_SMALL_ENUMS (0)
+#endif
+
+/**
+ * @brief Storage attribute of the enums of this module
+ */
+#if MIDI_CONFIG_SMALL_ENUMS && (defined(__GNUC__) || defined(__clang__))
+#define MIDI_ENUM_STORAGE __attribute__((packed))
+#else
+#define MIDI_ENUM_STORAGE
+#endif
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Packed Message Type Shift
+ * @details Bit position of the message type in a midi_packed_t
+ */
+#define MIDI_PACKED_TYPE_SHIFT (24)
+
+/**
+ * @brief Packed Message Channel Shift
+ * @details Bit position of the channel in a midi_packed_t
+ */
+#define MIDI_PACKED_CHANNEL_SHIFT (16)
+
+/**
+ * @brief Packed Message First Data Byte Shift
+ * @details Bit position of the first data byte in a midi_packed_t
+ */
+#define MIDI_PACKED_DATA1_SHIFT (8)
+
+/**
+ * @brief Packed Message Second Data Byte Shift
+ * @details Bit position of the second data byte in a midi_packed_t
+ */
+#define MIDI_PACKED_DATA2_SHIFT (0)
+
+/**
+ * @brief SysEx Span Flag: Start
+ * @details The span holds the first payload bytes of a SysEx message
+ */
+#define MIDI_SYSEX_FLAG_START (0x01)
+
+/**
+ * @brief SysEx Span Flag: Continue
+ * @details The span continues the payload of the previous span
+ */
+#define MIDI_SYSEX_FLAG_CONTINUE (0x02)
+
+/**
+ * @brief SysEx Span Flag: End
+ * @details The span holds the last payload bytes of a SysEx message
+ */
+#define MIDI_SYSEX_FLAG_END (0x04)
+
+/**
+ * @brief SysEx Span Flag: Aborted
+ * @details The SysEx message was ended by a status byte other than
+ *          End of Exclusive. Always set together with MIDI_SYSEX_FLAG_END
+ */
+#define MIDI_SYSEX_FLAG_ABORTED (0x08)
+
+/**
+ * @brief Number of Message Type Counters
+ * @details The size of midi_parser_stats_t.messages: 7 Channel Voice,
+ *          8 Channel Mode and 16 System message types
+ */
+#define MIDI_STATS_MESSAGE_TYPES (31)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief MIDI Channel
+ *
+ * @details This enum defines the MIDI channels
+ *          The channels are numbered from 1 to 16
+ */
+typedef enum MIDI_ENUM_STORAGE midi_channel_t {
+    MIDI_CHANNEL_1 = 0x00,
+    MIDI_CHANNEL_2 = 0x01,
+    MIDI_CHANNEL_3 = 0x02,
+    MIDI_CHANNEL_4 = 0x03,
+    MIDI_CHANNEL_5 = 0x04,
+    MIDI_CHANNEL_6 = 0x05,
+    MIDI_CHANNEL_7 = 0x06,
+    MIDI_CHANNEL_8 = 0x07,
+    MIDI_CHANNEL_9 = 0x08,
+    MIDI_CHANNEL_10 = 0x09,
+    MIDI_CHANNEL_11 = 0x0A,
+    MIDI_CHANNEL_12 = 0x0B,
+    MIDI_CHANNEL_13 = 0x0C,
+    MIDI_CHANNEL_14 = 0x0D,
+    MIDI_CHANNEL_15 = 0x0E,
+    MIDI_CHANNEL_16 = 0x0F,
+    /**
+     * @brief MIDI Channel None
+     * @details This placeholder value is used to indicate
+     *          that no channel is selected or when a channel
+     *          number is not applicable for the message type
+     */
+    MIDI_CHANNEL_NONE = 0xFF,
+
+} midi_channel_t;
+
+/**
+ * @brief MIDI Message Type
+ *
+ * @details This enum defines the MIDI message types
+ */
+typedef enum MIDI_ENUM_STORAGE midi_message_type_t {
+
+    /**
+     * @brief MIDI Message None
+     * @details This placeholder value is used to indicate
+     *          that no message is detected
+     */
+    MIDI_MESSAGE_NONE = 0x00,
+
+    /**
+     * @brief Note Off
+     * @param note The MIDI note number to turn off
+     * @param velocity The release velocity of the note if applicable
+     */
+    MIDI_MESSAGE_NOTE_OFF = 0x80,
+
+    /**
+     * @brief Note On
+     * @param note The MIDI note number to turn on
+     * @param velocity The note velocity
+     */
+    MIDI_MESSAGE_NOTE_ON = 0x90,
+
+    /**
+     * @brief Polyphonic Key Pressure
+     * @param key The MIDI note number to set the pressure of
+     * @param key_pressure The pressure of the note
+     */
+    MIDI_MESSAGE_KEY_PRESSURE = 0xA0,
+
+    /**
+     * @brief Control Change
+     * @param controller The controller number to change
+     * @param control_value The value to set on the controller
+     * @note Channel Mode messages are treated as their own
+     *       top-level entry in `midi_message_type_t`
+     */
+    MIDI_MESSAGE_CONTROL_CHANGE = 0xB0,
+
+    /**
+     * @brief All Sound Off
+     */
+    MIDI_MESSAGE_ALL_SOUND_OFF = 0x78, /* 120 */
+
+    /**
+     * @brief Reset All Controllers
+     */
+    MIDI_MESSAGE_RESET_ALL_CONTROLLERS = 0x79, /* 121 */
+
+    /**
+     * @brief Local Control On/Off
+     */
+    MIDI_MESSAGE_LOCAL_CONTROL = 0x7A, /* 122 */
+
+    /**
+     * @brief All Notes Off
+     * @note Also functions as All Notes Off (MIDI 1.0 Spec, Pg 20)
+     */
+    MIDI_MESSAGE_ALL_NOTES_OFF = 0x7B, /* 123 */
+
+    /**
+     * @brief Omni Mode Off
+     * @note Also functions as All Notes Off (MIDI 1.0 Spec, Pg 20)
+     */
+    MIDI_MESSAGE_OMNI_OFF = 0x7C, /* 124 */
+
+    /**
+     * @brief Omni Mode On
+     * @note Also functions as All Notes Off (MIDI 1.0 Spec, Pg 20)
+     */
+    MIDI_MESSAGE_OMNI_ON = 0x7D, /* 125 */
+
+    /**
+     * @brief Mono Mode On
+     * @note Also functions as All Notes Off (MIDI 1.0 Spec, Pg 20)
+     */
+    MIDI_MESSAGE_MONO_ON = 0x7E, /* 126 */
+
+    /**
+     * @brief Poly Mode On
+     * @note Also functions as All Notes Off (MIDI 1.0 Spec, Pg 20)
+     */
+    MIDI_MESSAGE_POLY_ON = 0x7F, /* 127 */
+
+    /**
+     * @brief Program Change
+     * @param program The program number to change to
+     */
+    MIDI_MESSAGE_PROGRAM_CHANGE = 0xC0,
+
+    /**
+     * @brief Channel Pressure
+     * @param channel_pressure The pressure to set on the channel
+     */
+    MIDI_MESSAGE_CHANNEL_PRESSURE = 0xD0,
+
+    /**
+     * @brief Pitch Bend
+     * @param pitch_bend The pitch bend value
+     */
+    MIDI_MESSAGE_PITCH_BEND = 0xE0,
+
+    /**
+     * @brief Start of System Exclusive
+     */
+    MIDI_MESSAGE_SYSTEM_EXCLUSIVE = 0xF0,
+
+    /**
+     * @brief MTC Quarter Frame
+     */
+    MIDI_MESSAGE_MTC_QUARTER_FRAME = 0xF1,
+
+    /**
+     * @brief Song Position Pointer
+     * @param song_position The position in the song
+     */
+    MIDI_MESSAGE_SONG_POSITION_POINTER = 0xF2,
+
+    /**
+     * @brief Song Select
+     * @param song_select The song number to select
+     */
+    MIDI_MESSAGE_SONG_SELECT = 0xF3,
+
+    /**
+     * @brief Tune Request
+     */
+    MIDI_MESSAGE_TUNE_REQUEST = 0xF6,
+
+    /**
+     * @brief End of System Exclusive
+     */
+    MIDI_MESSAGE_END_OF_EXCLUSIVE = 0xF7,
+
+    /**
+     * @brief Timing Clock
+     */
+    MIDI_MESSAGE_TIMING_CLOCK = 0xF8,
+
+    /**
+     * @brief Start
+     */
+    MIDI_MESSAGE_START = 0xFA,
+
+    /**
+     * @brief Continue
+     */
+    MIDI_MESSAGE_CONTINUE = 0xFB,
+
+    /**
+     * @brief Stop
+     */
+    MIDI_MESSAGE_STOP = 0xFC,
+
+    /**
+     * @brief Active Sense
+     */
+    MIDI_MESSAGE_ACTIVE_SENSE = 0xFE,
+
+    /**
+     * @brief System Reset
+     */
+    MIDI_MESSAGE_SYSTEM_RESET = 0xFF,
+
+} midi_message_type_t;
+
+/**
+ * @brief MIDI Controller Names
+ * @details This enum defines the MIDI controllers names
+ */
+typedef enum MIDI_ENUM_STORAGE midi_controller_t {
+    MIDI_CC_BANK_SELECT = 0x00,
+    MIDI_CC_MOD_WHEEL = 0x01,
+    MIDI_CC_BREATH_CONTROLLER = 0x02,
+    MIDI_CC_UNDEFINED_03 = 0x03,
+    MIDI_CC_FOOT_CONTROLLER = 0x04,
+    MIDI_CC_PORTAMENTO_TIME = 0x05,
+    MIDI_CC_DATA_ENTRY_MSB = 0x06,
+    MIDI_CC_CHANNEL_VOLUME = 0x07,
+    MIDI_CC_BALANCE = 0x08,
+    MIDI_CC_UNDEFINED_09 = 0x09,
+    MIDI_CC_PAN = 0x0A,
+    MIDI_CC_EXPRESSION_CONTROLLER = 0x0B,
+    MIDI_CC_EFFECT_CONTROL_1 = 0x0C,
+    MIDI_CC_EFFECT_CONTROL_2 = 0x0D,
+    MIDI_CC_UNDEFINED_0E = 0x0E,
+    MIDI_CC_UNDEFINED_0F = 0x0F,
+    MIDI_CC_GENERAL_PURPOSE_1 = 0x10,
+    MIDI_CC_GENERAL_PURPOSE_2 = 0x11,
+    MIDI_CC_GENERAL_PURPOSE_3 = 0x12,
+    MIDI_CC_GENERAL_PURPOSE_4 = 0x13,
+    MIDI_CC_UNDEFINED_14 = 0x14,
+    MIDI_CC_UNDEFINED_15 = 0x15,
+    MIDI_CC_UNDEFINED_16 = 0x16,
+    MIDI_CC_UNDEFINED_17 = 0x17,
+    MIDI_CC_UNDEFINED_18 = 0x18,
+    MIDI_CC_UNDEFINED_19 = 0x19,
+    MIDI_CC_UNDEFINED_1A = 0x1A,
+    MIDI_CC_UNDEFINED_1B = 0x1B,
+    MIDI_CC_UNDEFINED_1C = 0x1C,
+    MIDI_CC_UNDEFINED_1D = 0x1D,
+    MIDI_CC_UNDEFINED_1E = 0x1E,
+    MIDI_CC_UNDEFINED_1F = 0x1F,
+    MIDI_CC_BANK_SELECT_LSB = 0x20,
+    MIDI_CC_MOD_WHEEL_LSB = 0x21,
+    MIDI_CC_BREATH_CONTROLLER_LSB = 0x22,
+    MIDI_CC_UNDEFINED_23 = 0x23,
+    MIDI_CC_FOOT_CONTROLLER_LSB = 0x24,
+    MIDI_CC_PORTAMENTO_TIME_LSB = 0x25,
+    MIDI_CC_DATA_ENTRY_LSB = 0x26,
+    MIDI_CC_CHANNEL_VOLUME_LSB = 0x27,
+    MIDI_CC_BALANCE_LSB = 0x28,
+    MIDI_CC_UNDEFINED_29 = 0x29,
+    MIDI_CC_PAN_LSB = 0x2A,
+    MIDI_CC_EXPRESSION_CONTROLLER_LSB = 0x2B,
+    MIDI_CC_EFFECT_CONTROL_1_LSB = 0x2C,
+    MIDI_CC_EFFECT_CONTROL_2_LSB = 0x2D,
+    MIDI_CC_UNDEFINED_2E = 0x2E,
+    MIDI_CC_UNDEFINED_2F = 0x2F,
+    MIDI_CC_GENERAL_PURPOSE_1_LSB = 0x30,
+    MIDI_CC_GENERAL_PURPOSE_2_LSB = 0x31,
+    MIDI_CC_GENERAL_PURPOSE_3_LSB = 0x32,
+    MIDI_CC_GENERAL_PURPOSE_4_LSB = 0x33,
+    MIDI_CC_UNDEFINED_34 = 0x34,
+    MIDI_CC_UNDEFINED_35 = 0x35,
+    MIDI_CC_UNDEFINED_36 = 0x36,
+    MIDI_CC_UNDEFINED_37 = 0x37,
+    MIDI_CC_UNDEFINED_38 = 0x38,
+    MIDI_CC_UNDEFINED_39 = 0x39,
+    MIDI_CC_UNDEFINED_3A = 0x3A,
+    MIDI_CC_UNDEFINED_3B = 0x3B,
+    MIDI_CC_UNDEFINED_3C = 0x3C,
+    MIDI_CC_UNDEFINED_3D = 0x3D,
+    MIDI_CC_UNDEFINED_3E = 0x3E,
+    MIDI_CC_UNDEFINED_3F = 0x3F,
+    MIDI_CC_SUSTAIN_PEDAL = 0x40,
+    MIDI_CC_PORTAMENTO_ON_OFF = 0x41,
+    MIDI_CC_SOSTENUTO = 0x42,
+    MIDI_CC_SOFT_PEDAL = 0x43,
+    MIDI_CC_LEGATO_FOOTSWITCH = 0x44,
+    MIDI_CC_HOLD_2 = 0x45,
+    MIDI_CC_SOUND_CTRL_1_VARIATION = 0x46,
+    MIDI_CC_SOUND_CTRL_2_TIMBRE = 0x47,
+    MIDI_CC_SOUND_CTRL_3_RELEASE_TIME = 0x48,
+    MIDI_CC_SOUND_CTRL_4_ATTACK_TIME = 0x49,
+    MIDI_CC_SOUND_CTRL_5_BRIGHTNESS = 0x4A,
+    MIDI_CC_SOUND_CTRL_6 = 0x4B,
+    MIDI_CC_SOUND_CTRL_7 = 0x4C,
+    MIDI_CC_SOUND_CTRL_8 = 0x4D,
+    MIDI_CC_SOUND_CTRL_9 = 0x4E,
+    MIDI_CC_SOUND_CTRL_10 = 0x4F,
+    MIDI_CC_GENERAL_PURPOSE_5 = 0x50,
+    MIDI_CC_GENERAL_PURPOSE_6 = 0x51,
+    MIDI_CC_GENERAL_PURPOSE_7 = 0x52,
+    MIDI_CC_GENERAL_PURPOSE_8 = 0x53,
+    MIDI_CC_PORTAMENTO_CONTROL = 0x54,
+    MIDI_CC_UNDEFINED_55 = 0x55,
+    MIDI_CC_UNDEFINED_56 = 0x56,
+    MIDI_CC_UNDEFINED_57 = 0x57,
+    MIDI_CC_UNDEFINED_58 = 0x58,
+    MIDI_CC_UNDEFINED_59 = 0x59,
+    MIDI_CC_UNDEFINED_5A = 0x5A,
+    MIDI_CC_EFFECT_1_DEPTH = 0x5B,
+    MIDI_CC_EFFECT_2_DEPTH = 0x5C,
+    MIDI_CC_EFFECT_3_DEPTH = 0x5D,
+    MIDI_CC_EFFECT_4_DEPTH = 0x5E,
+    MIDI_CC_EFFECT_5_DEPTH = 0x5F,
+    MIDI_CC_DATA_INCREMENT = 0x60,
+    MIDI_CC_DATA_DECREMENT = 0x61,
+    MIDI_CC_NRPN_LSB = 0x62,
+    MIDI_CC_NRPN_MSB = 0x63,
+    MIDI_CC_RPN_LSB = 0x64,
+    MIDI_CC_RPN_MSB = 0x65,
+    MIDI_CC_UNDEFINED_66 = 0x66,
+    MIDI_CC_UNDEFINED_67 = 0x67,
+    MIDI_CC_UNDEFINED_68 = 0x68,
+    MIDI_CC_UNDEFINED_69 = 0x69,
+    MIDI_CC_UNDEFINED_6A = 0x6A,
+    MIDI_CC_UNDEFINED_6B = 0x6B,
+    MIDI_CC_UNDEFINED_6C = 0x6C,
+    MIDI_CC_UNDEFINED_6D = 0x6D,
+    MIDI_CC_UNDEFINED_6E = 0x6E,
+    MIDI_CC_UNDEFINED_6F = 0x6F,
+    MIDI_CC_UNDEFINED_70 = 0x70,
+    MIDI_CC_UNDEFINED_71 = 0x71,
+    MIDI_CC_UNDEFINED_72 = 0x72,
+    MIDI_CC_UNDEFINED_73 = 0x73,
+    MIDI_CC_UNDEFINED_74 = 0x74,
+    MIDI_CC_UNDEFINED_75 = 0x75,
+    MIDI_CC_UNDEFINED_76 = 0x76,
+    MIDI_CC_UNDEFINED_77 = 0x77,
+    MIDI_CC_ALL_SOUND_OFF = 0x78,
+    MIDI_CC_RESET_ALL_CONTROLLERS = 0x79,
+    MIDI_CC_LOCAL_CONTROL = 0x7A,
+    MIDI_CC_ALL_NOTES_OFF = 0x7B,
+    MIDI_CC_OMNI_OFF = 0x7C,
+    MIDI_CC_OMNI_ON = 0x7D,
+    MIDI_CC_MONO_ON = 0x7E,
+    MIDI_CC_POLY_ON = 0x7F,
+} midi_controller_t;
+
+/**
+ * @brief MIDI Message
+ * @details This struct defines a MIDI message
+ *          and contains its associated data
+ */
+typedef struct midi_message_t {
+    /**
+     * @brief MIDI Message Type
+     */
+    midi_message_type_t message_type;
+
+    /**
+     * @brief MIDI Channel Number
+     * @details The MIDI channel number associated with the message
+     *          If channels are not relevant to the specific message
+     *          type then this will be set to MIDI_CHANNEL_NONE
+     */
+    midi_channel_t channel;
+
+    /* Anonymous union to store the data associated with the message */
+    union {
+        /**
+         * @brief Note Off, Note On
+         */
+        struct {
+            /**
+             * @brief MIDI Note Number
+             */
+            uint8_t note;
+            /**
+             * @brief Note velocity
+             */
+            uint8_t velocity;
+        };
+
+        /**
+         * @brief Polyphonic Key Pressure
+         */
+        struct {
+            /**
+             * @brief MIDI Note Number
+             */
+            uint8_t key;
+            /**
+             * @brief Note pressure
+             */
+            uint8_t key_pressure;
+        };
+
+        /**
+         * @brief Control Change
+         */
+        struct {
+            /**
+             * @brief Controller
+             * @details The number of the controller to change
+             */
+            midi_controller_t controller;
+            /**
+             * @brief Control Value
+             * @details The value to set on the controller
+             */
+            uint8_t control_value;
+        };
+
+        /**
+         * @brief Program Change
+         * @details The program number to change to
+         */
+        uint8_t program;
+
+        /**
+         * @brief Channel Pressure
+         * @details The pressure to set on the channel
+         */
+        uint8_t channel_pressure;
+
+        /**
+         * @brief Pitch Bend
+         * @details The pitch bend value
+         */
+        uint16_t pitch_bend;
+
+        /**
+         * @brief Song Position Pointer
+         * @details The position in the song
+         */
+        uint16_t song_position;
+
+        /**
+         * @brief Song Select
+         * @details The song number to select
+         */
+        uint8_t song_select;
+
+        /**
+         * @brief MTC Quarter Frame
+         */
+        struct {
+            uint8_t mtc_msg_type;
+            uint8_t mtc_values;
+        };
+    };
+} midi_message_t;
+
+/**
+ * @brief Packed MIDI Message
+ * @details A decoded MIDI message packed into a single 32-bit word,
+ *          the same size as a USB-MIDI event packet or a UMP word.
+ *
+ *          | Bits  | Field                                  |
+ *          |-------|----------------------------------------|
+ *          | 31-24 | Message type (midi_message_type_t)     |
+ *          | 23-16 | Channel (midi_channel_t)               |
+ *          | 15-8  | First data byte                        |
+ *          | 7-0   | Second data byte                       |
+ *
+ *          The data bytes are stored as they appear on the wire,
+ *          so 14-bit values (Pitch Bend, Song Position Pointer) hold
+ *          the LSB in the first data byte and the MSB in the second,
+ *          and an MTC Quarter Frame holds its whole data byte in the
+ *          first data byte. Unused data bytes are zero.
+ */
+typedef uint32_t midi_packed_t;
+
+/**
+ * @brief SysEx Payload Span
+ * @details A contiguous segment of System Exclusive payload bytes
+ *          (excluding the Start and End of Exclusive status bytes).
+ *          The data points into the buffer passed to the buffer parser
+ *          and is only valid for as long as that buffer is.
+ *          A payload is split into several spans when it is interrupted
+ *          by System Real-Time bytes or spread over several buffers.
+ */
+typedef struct midi_sysex_span_t {
+    /**
+     * @brief Pointer to the first payload byte of the span
+     */
+    const uint8_t *data;
+
+    /**
+     * @brief The number of payload bytes in the span
+     * @details May be zero for a span that only marks the end of a message
+     */
+    size_t length;
+
+    /**
+     * @brief Combination of MIDI_SYSEX_FLAG_* values
+     */
+    uint8_t flags;
+} midi_sysex_span_t;
+
+/**
+ * @brief SysEx Span Handler
+ * @param [in] context The context pointer given when the handler was set
+ * @param [in] span Pointer to the span. Only valid during the call
+ */
+typedef void (*midi_sysex_handler_t)(void *context,
+                                     const midi_sysex_span_t *span);
+
+/**
+ * @brief System Real-Time Event
+ * @details A System Real-Time message delivered through the realtime lane
+ */
+typedef struct midi_realtime_event_t {
+    /**
+     * @brief The System Real-Time message type
+     */
+    midi_message_type_t message_type;
+
+    /**
+     * @brief Timestamp from the timestamp source, or 0 if none is set
+     */
+    uint32_t timestamp;
+
+    /**
+     * @brief Index of the byte in the buffer being parsed
+     */
+    size_t offset;
+} midi_realtime_event_t;
+
+/**
+ * @brief System Real-Time Handler
+ * @param [in] context The context pointer given when the handler was set
+ * @param [in] event Pointer to the event. Only valid during the call
+ */
+typedef void (*midi_realtime_handler_t)(void *context,
+                                        const midi_realtime_event_t *event);
+
+/**
+ * @brief Timestamp Source
+ * @details Returns the current time, in any unit the application chooses
+ *          (e.g. timer ticks or microseconds)
+ * @param [in] context The context pointer given when the source was set
+ * @return The current time
+ */
+typedef uint32_t (*midi_timestamp_source_t)(void *context);
+
+/**
+ * @brief MIDI Message Handler
+ * @param [in] context The context pointer of the dispatcher
+ * @param [in] message Pointer to the message. Only valid during the call
+ */
+typedef void (*midi_message_handler_t)(void *context,
+                                       const midi_message_t *message);
+
+/**
+ * @brief MIDI Message Dispatcher
+ * @details Dense tables of message handlers, indexed by message type and,
+ *          for Control Change messages, by controller number.
+ *          A NULL entry means that messages of that type are ignored.
+ * @note Use the midi_dispatcher_* functions to set the handlers
+ */
+typedef struct midi_dispatcher_t {
+    /**
+     * @brief Handlers indexed by midi_message_type_t
+     */
+    midi_message_handler_t handlers[256];
+
+    /**
+     * @brief Control Change handlers indexed by midi_controller_t
+     * @details Take precedence over the Control Change entry of handlers
+     */
+    midi_message_handler_t controller_handlers[128];
+
+    /**
+     * @brief Context pointer passed to every handler
+     */
+    void *context;
+} midi_dispatcher_t;
+
+/**
+ * @brief MIDI Parser Statistics
+ * @details Counters of a parser, compiled in with MIDI_CONFIG_STATS.
+ *          Each counter wraps around modulo 2^32, so exporters should
+ *          report the difference between two snapshots.
+ */
+typedef struct midi_parser_stats_t {
+    /**
+     * @brief The number of bytes parsed
+     */
+    uint32_t bytes;
+
+    /**
+     * @brief The number of messages returned, indexed by
+     *        midi_stats_type_index
+     * @details Includes System Real-Time messages passed to the realtime
+     *          handler. Messages rejected by the filters are not counted.
+     */
+    uint32_t messages[MIDI_STATS_MESSAGE_TYPES];
+
+    /**
+     * @brief The number of data bytes received with no message to
+     *        complete
+     * @details Data bytes without running status, after a completed
+     *          System Common message, or after a status byte rejected by
+     *          the filters
+     */
+    uint32_t orphaned_data_bytes;
+
+    /**
+     * @brief The number of messages cut short by a status byte
+     * @details Partially received messages and System Exclusive
+     *          messages ended by a status byte other than End of
+     *          Exclusive
+     */
+    uint32_t interrupted_messages;
+
+    /**
+     * @brief The number of undefined status bytes (0xF4, 0xF5, 0xF9 and
+     *        0xFD)
+     */
+    uint32_t undefined_status_bytes;
+
+    /**
+     * @brief The number of System Exclusive payload bytes
+     */
+    uint32_t sysex_bytes;
+
+    /**
+     * @brief The number of times the data byte buffer was found full
+     * @details Should always be zero. Counts parser states corrupted by
+     *          the application, for example by a bad state restore.
+     */
+    uint32_t buffer_overflows;
+} midi_parser_stats_t;
+
+/**
+ * @brief MIDI Parser
+ * @details This struct contains the internal state of the MIDI parser
+ * @note The fields of this struct should not be accessed directly.
+ *       Use the `midi_parse_byte` function to parse MIDI bytes
+ */
+typedef struct midi_parser_t {
+    midi_message_type_t message_type;
+    midi_channel_t channel;
+    midi_channel_t active_channel;
+    uint8_t buffer[2];
+    uint8_t byte_count;
+    uint8_t sysex_flags;
+    uint8_t filter_decoded;
+    uint16_t channel_mask;
+    uint32_t status_mask[4];
+    uint32_t type_mask[8];
+    uint32_t controller_mask[4];
+    midi_sysex_handler_t sysex_handler;
+    void *sysex_context;
+    midi_realtime_handler_t realtime_handler;
+    midi_timestamp_source_t timestamp_source;
+    void *realtime_context;
+#if MIDI_CONFIG_STATS
+    midi_parser_stats_t stats;
+#endif
+} midi_parser_t;
+
+/**
+ * @brief MIDI Parser State
+ * @details The part of a parser that depends on the bytes parsed so far:
+ *          running status, a partially received message and the SysEx
+ *          span flags. Saving it between two bytes and restoring it into
+ *          a parser lets parsing resume exactly at that point.
+ */
+typedef struct midi_parser_state_t {
+    /**
+     * @brief Message type of the running status, or MIDI_MESSAGE_NONE
+     */
+    midi_message_type_t message_type;
+
+    /**
+     * @brief Channel of the running status, or MIDI_CHANNEL_NONE
+     */
+    midi_channel_t channel;
+
+    /**
+     * @brief Data bytes received so far of the current message
+     */
+    uint8_t buffer[2];
+
+    /**
+     * @brief The number of data bytes received so far
+     */
+    uint8_t byte_count;
+
+    /**
+     * @brief Flags of the next SysEx span (MIDI_SYSEX_FLAG_*)
+     */
+    uint8_t sysex_flags;
+} midi_parser_state_t;
+
+/*=====================================================================*
+    Public Inline Functions
+ *=====================================================================*/
+
+/**
+ * @brief Build a packed MIDI message from its fields
+ * @param [in] message_type The message type
+ * @param [in] channel The channel, or MIDI_CHANNEL_NONE
+ * @param [in] data1 The first data byte
+ * @param [in] data2 The second data byte
+ * @return The packed message
+ */
+static inline midi_packed_t midi_packed_make(midi_message_type_t message_type,
+                                             midi_channel_t channel,
+                                             uint8_t data1,
+                                             uint8_t data2)
+{
+    return ((uint32_t)(uint8_t)message_type << MIDI_PACKED_TYPE_SHIFT)
+           | ((uint32_t)(uint8_t)channel << MIDI_PACKED_CHANNEL_SHIFT)
+           | ((uint32_t)data1 << MIDI_PACKED_DATA1_SHIFT)
+           | ((uint32_t)data2 << MIDI_PACKED_DATA2_SHIFT);
+}
+
+/**
+ * @brief Get the message type of a packed MIDI message
+ * @param [in] packed The packed message
+ * @return The message type
+ */
+static inline midi_message_type_t midi_packed_type(midi_packed_t packed)
+{
+    return (midi_message_type_t)((packed >> MIDI_PACKED_TYPE_SHIFT) & 0xFF);
+}
+
+/**
+ * @brief Get the channel of a packed MIDI message
+ * @param [in] packed The packed message
+ * @return The channel, or MIDI_CHANNEL_NONE
+ */
+static inline midi_channel_t midi_packed_channel(midi_packed_t packed)
+{
+    return (midi_channel_t)((packed >> MIDI_PACKED_CHANNEL_SHIFT) & 0xFF);
+}
+
+/**
+ * @brief Get the first data byte of a packed MIDI message
+ * @param [in] packed The packed message
+ * @return The first data byte
+ */
+static inline uint8_t midi_packed_data1(midi_packed_t packed)
+{
+    return (uint8_t)((packed >> MIDI_PACKED_DATA1_SHIFT) & 0xFF);
+}
+
+/**
+ * @brief Get the second data byte of a packed MIDI message
+ * @param [in] packed The packed message
+ * @return The second data byte
+ */
+static inline uint8_t midi_packed_data2(midi_packed_t packed)
+{
+    return (uint8_t)((packed >> MIDI_PACKED_DATA2_SHIFT) & 0xFF);
+}
+
+/**
+ * @brief Pack a MIDI message into a single 32-bit word
+ * @param [in] message Pointer to the message to pack
+ * @return The packed message
+ */
+static inline midi_packed_t midi_message_pack(const midi_message_t *message)
+{
+    uint8_t data1 = 0;
+    uint8_t data2 = 0;
+
+    switch (message->message_type) {
+    case MIDI_MESSAGE_NOTE_OFF:
+    case MIDI_MESSAGE_NOTE_ON:
+        data1 = message->note;
+        data2 = message->velocity;
+        break;
+    case MIDI_MESSAGE_KEY_PRESSURE:
+        data1 = message->key;
+        data2 = message->key_pressure;
+        break;
+    case MIDI_MESSAGE_CONTROL_CHANGE:
+    case MIDI_MESSAGE_ALL_SOUND_OFF:
+    case MIDI_MESSAGE_RESET_ALL_CONTROLLERS:
+    case MIDI_MESSAGE_LOCAL_CONTROL:
+    case MIDI_MESSAGE_ALL_NOTES_OFF:
+    case MIDI_MESSAGE_OMNI_OFF:
+    case MIDI_MESSAGE_OMNI_ON:
+    case MIDI_MESSAGE_MONO_ON:
+    case MIDI_MESSAGE_POLY_ON:
+        data1 = (uint8_t)message->controller;
+        data2 = message->control_value;
+        break;
+    case MIDI_MESSAGE_PROGRAM_CHANGE:
+        data1 = message->program;
+        break;
+    case MIDI_MESSAGE_CHANNEL_PRESSURE:
+        data1 = message->channel_pressure;
+        break;
+    case MIDI_MESSAGE_PITCH_BEND:
+        data1 = message->pitch_bend & 0x7F;
+        data2 = (message->pitch_bend >> 7) & 0x7F;
+        break;
+    case MIDI_MESSAGE_SONG_POSITION_POINTER:
+        data1 = message->song_position & 0x7F;
+        data2 = (message->song_position >> 7) & 0x7F;
+        break;
+    case MIDI_MESSAGE_SONG_SELECT:
+        data1 = message->song_select;
+        break;
+    case MIDI_MESSAGE_MTC_QUARTER_FRAME:
+        data1 = (uint8_t)(message->mtc_msg_type << 4 | message->mtc_values);
+        break;
+    default:
+        /* No data bytes */
+        break;
+    }
+
+    return midi_packed_make(
+        message->message_type, message->channel, data1, data2);
+}
+
+/**
+ * @brief Unpack a packed MIDI message
+ * @param [in] packed The packed message
+ * @param [out] message Pointer to a midi_message_t struct
+ *      that will be updated with the unpacked message data
+ */
+static inline void midi_message_unpack(midi_packed_t packed,
+                                       midi_message_t *message)
+{
+    const uint8_t data1 = midi_packed_data1(packed);
+    const uint8_t data2 = midi_packed_data2(packed);
+
+    message->message_type = midi_packed_type(packed);
+    message->channel = midi_packed_channel(packed);
+
+    switch (message->message_type) {
+    case MIDI_MESSAGE_NOTE_OFF:
+    case MIDI_MESSAGE_NOTE_ON:
+        message->note = data1;
+        message->velocity = data2;
+        break;
+    case MIDI_MESSAGE_KEY_PRESSURE:
+        message->key = data1;
+        message->key_pressure = data2;
+        break;
+    case MIDI_MESSAGE_CONTROL_CHANGE:
+    case MIDI_MESSAGE_ALL_SOUND_OFF:
+    case MIDI_MESSAGE_RESET_ALL_CONTROLLERS:
+    case MIDI_MESSAGE_LOCAL_CONTROL:
+    case MIDI_MESSAGE_ALL_NOTES_OFF:
+    case MIDI_MESSAGE_OMNI_OFF:
+    case MIDI_MESSAGE_OMNI_ON:
+    case MIDI_MESSAGE_MONO_ON:
+    case MIDI_MESSAGE_POLY_ON:
+        message->controller = (midi_controller_t)data1;
+        message->control_value = data2;
+        break;
+    case MIDI_MESSAGE_PROGRAM_CHANGE:
+        message->program = data1;
+        break;
+    case MIDI_MESSAGE_CHANNEL_PRESSURE:
+        message->channel_pressure = data1;
+        break;
+    case MIDI_MESSAGE_PITCH_BEND:
+        message->pitch_bend = (uint16_t)(data2 << 7 | data1);
+        break;
+    case MIDI_MESSAGE_SONG_POSITION_POINTER:
+        message->song_position = (uint16_t)(data2 << 7 | data1);
+        break;
+    case MIDI_MESSAGE_SONG_SELECT:
+        message->song_select = data1;
+        break;
+    case MIDI_MESSAGE_MTC_QUARTER_FRAME:
+        message->mtc_msg_type = data1 >> 4;
+        message->mtc_values = data1 & 0x0F;
+        break;
+    default:
+        /* No data bytes */
+        break;
+    }
+}
+
+/**
+ * @brief Get the index of the message counter of a message type
+ * @param [in] message_type The message type. Must not be
+ *      MIDI_MESSAGE_NONE
+ * @return The index into midi_parser_stats_t.messages
+ */
+static inline size_t midi_stats_type_index(midi_message_type_t message_type)
+{
+    const uint8_t type = (uint8_t)message_type;
+
+    /* System messages after the Channel Voice and Channel Mode ones */
+    if (type >= MIDI_MESSAGE_SYSTEM_EXCLUSIVE) { return 15 + (type & 0x0F); }
+    if (type >= MIDI_MESSAGE_NOTE_OFF) { return (type >> 4) - 8; }
+    return 7 + (type & 0x07);
+}
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a MIDI parser
+ * @param [in, out] parser Pointer to a midi_parser_t struct to initialize
+ * @note This function must be called before using the parser
+ */
+void midi_parser_init(midi_parser_t *parser);
+
+/**
+ * @brief Reset a MIDI parser to its initial state
+ * @param [in,out] parser Pointer to a midi_parser_t struct to reset
+ * @note This clears any partial message state and running status.
+ *       The filters, the SysEx handler and the realtime handler are kept.
+ */
+void midi_parser_reset(midi_parser_t *parser);
+
+/**
+ * @brief Get a snapshot of the statistics of a MIDI parser
+ * @details Reads the counters without changing them. The counters of a
+ *          parser should be read by the thread that parses with it, or
+ *          while it is idle. Snapshots can then be combined on any thread
+ *          with midi_parser_stats_merge.
+ * @param [in] parser Pointer to a midi_parser_t struct
+ * @param [out] stats Pointer to a midi_parser_stats_t struct that
+ *      receives the counters. All zero when MIDI_CONFIG_STATS is 0.
+ */
+void midi_parser_get_stats(const midi_parser_t *parser,
+                           midi_parser_stats_t *stats);
+
+/**
+ * @brief Clear the statistics of a MIDI parser
+ * @details midi_parser_reset keeps the statistics
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ */
+void midi_parser_reset_stats(midi_parser_t *parser);
+
+/**
+ * @brief Add the counters of a statistics snapshot to a total
+ * @param [in,out] total Pointer to the totals, for example of every
+ *      port of an application
+ * @param [in] stats Pointer to the snapshot to add
+ */
+void midi_parser_stats_merge(midi_parser_stats_t *total,
+                             const midi_parser_stats_t *stats);
+
+/**
+ * @brief Save the state of a MIDI parser
+ * @param [in] parser Pointer to a midi_parser_t struct
+ * @param [out] state Pointer to a midi_parser_state_t struct that receives
+ *      the state
+ */
+void midi_parser_save_state(const midi_parser_t *parser,
+                            midi_parser_state_t *state);
+
+/**
+ * @brief Restore the state of a MIDI parser
+ * @details The filters and handlers of the parser are kept. Running
+ *          status for a status byte that the parser's filters reject is
+ *          dropped, as the parser would have done itself.
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] state Pointer to a state saved by midi_parser_save_state
+ */
+void midi_parser_restore_state(midi_parser_t *parser,
+                               const midi_parser_state_t *state);
+
+/**
+ * @brief Set the active channel for the MIDI parser
+ * @details Causes the parser to only return channel messages
+ *          received on the active channel. System messages are
+ *          not affected. Equivalent to a channel mask with only
+ *          the active channel set.
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] channel The MIDI channel to set as active
+ * @note Setting this value to MIDI_CHANNEL_NONE
+ *       will disable the active channel
+ *       and the parser will respond to all channels (omni mode)
+ */
+void midi_parser_set_active_channel(midi_parser_t *parser,
+                                    midi_channel_t channel);
+
+/**
+ * @brief Get the active channel for the MIDI parser
+ * @param [in] parser Pointer to a midi_parser_t struct
+ * @return The active channel, or MIDI_CHANNEL_NONE if the parser
+ *      responds to all channels or to more than one channel
+ */
+midi_channel_t midi_parser_get_active_channel(midi_parser_t *parser);
+
+/**
+ * @brief Set the channels the MIDI parser responds to
+ * @details Channel messages on channels that are not in the mask are
+ *          rejected as soon as their status byte is received, and their
+ *          data bytes are skipped without being decoded
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] mask Bit n set to accept messages on channel n + 1
+ *      (MIDI_CHANNEL_1 is bit 0). 0xFFFF accepts all channels.
+ */
+void midi_parser_set_channel_mask(midi_parser_t *parser, uint16_t mask);
+
+/**
+ * @brief Get the channels the MIDI parser responds to
+ * @param [in] parser Pointer to a midi_parser_t struct
+ * @return The channel mask. Bit n is set if channel n + 1 is accepted
+ */
+uint16_t midi_parser_get_channel_mask(midi_parser_t *parser);
+
+/**
+ * @brief Enable or disable a message type
+ * @details Disabled message types are not returned by the parser.
+ *          Where the message type is known from the status byte alone,
+ *          the message is rejected at the status byte and its data bytes
+ *          are skipped without being decoded. All message types are
+ *          enabled after midi_parser_init.
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] message_type The message type to enable or disable.
+ *      Note On messages with a velocity of zero are Note Off messages,
+ *      and Channel Mode messages have their own message types.
+ * @param [in] enabled Non-zero to enable the message type, zero to
+ *      disable it
+ */
+void midi_parser_set_message_enabled(midi_parser_t *parser,
+                                     midi_message_type_t message_type,
+                                     int enabled);
+
+/**
+ * @brief Enable or disable Control Change messages for a controller
+ * @details All controllers are enabled after midi_parser_init
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] controller The controller to enable or disable (0-119)
+ * @param [in] enabled Non-zero to enable the controller, zero to
+ *      disable it
+ */
+void midi_parser_set_controller_enabled(midi_parser_t *parser,
+                                        midi_controller_t controller,
+                                        int enabled);
+
+/**
+ * @brief Set the SysEx handler for the MIDI parser
+ * @details Enables SysEx payload delivery. While a System Exclusive
+ *          message is being received, the buffer parsers call the handler
+ *          with spans pointing straight into the buffer being parsed,
+ *          instead of discarding the payload bytes. The payload is never
+ *          copied or buffered by the parser.
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] handler The function to call for each payload span,
+ *      or NULL to discard SysEx payload bytes (the default)
+ * @param [in] context Pointer passed back to the handler. May be NULL.
+ * @note Only the buffer parsers deliver spans. Payload bytes passed to
+ *       midi_parse_byte are discarded as before.
+ * @note The System Exclusive and End of Exclusive messages are still
+ *       written to the output array of the buffer parsers.
+ * @note The handler is never called when MIDI_CONFIG_SYSEX is 0
+ */
+void midi_parser_set_sysex_handler(midi_parser_t *parser,
+                                   midi_sysex_handler_t handler,
+                                   void *context);
+
+/**
+ * @brief Set the realtime handler for the MIDI parser
+ * @details Routes System Real-Time messages (Timing Clock, Start,
+ *          Continue, Stop, Active Sensing and System Reset) to a separate
+ *          lane. The buffer parsers call the handler as soon as the byte is
+ *          reached, before any later byte is parsed, instead of writing
+ *          the message to the output array, so its latency does not depend
+ *          on the size of the buffer.
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] handler The function to call for each System Real-Time
+ *      message, or NULL to return them with the other messages
+ *      (the default)
+ * @param [in] timestamp_source Optional function called to timestamp
+ *      each event. May be NULL.
+ * @param [in] context Pointer passed back to the handler and the
+ *      timestamp source. May be NULL.
+ * @note midi_parse_byte still returns System Real-Time messages,
+ *       since it already returns each message as soon as it is parsed
+ * @note Disabled message types are not passed to the handler
+ */
+void midi_parser_set_realtime_handler(midi_parser_t *parser,
+                                      midi_realtime_handler_t handler,
+                                      midi_timestamp_source_t timestamp_source,
+                                      void *context);
+
+/**
+ * @brief Parse a MIDI byte
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] byte The byte to parse
+ * @param [out] message Pointer to a midi_message_t struct.
+ *      This struct will be updated with the parsed message data,
+ *      if a complete message has been parsed.
+ * @return The MIDI message type. If a complete message has been
+ *      parsed then the message type will be returned (and will be
+ *      identical to the message_type field in the message struct).
+ *      Otherwise the message type will be MIDI_MESSAGE_NONE
+ * @retval MIDI_MESSAGE_NONE: No complete message has been parsed
+ * @retval others: The message type of the parsed message
+ */
+midi_message_type_t midi_parse_byte(midi_parser_t *parser,
+                                    const uint8_t byte,
+                                    midi_message_t *message);
+
+/**
+ * @brief Parse a buffer of MIDI bytes
+ * @details Parses bytes from the buffer until either the buffer has been
+ *          consumed or the messages array is full. Each complete message
+ *          is written to the next free entry of the messages array.
+ *          The parser state is carried across calls, so a stream may be
+ *          split into chunks at any byte boundary.
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @param [out] messages Pointer to an array of midi_message_t structs.
+ *      Each complete message is written to the next free entry.
+ * @param [in] capacity The number of entries in the messages array
+ * @param [out] consumed Optional pointer that receives the number of
+ *      bytes that were parsed. May be NULL.
+ * @return The number of complete messages written to the messages array
+ * @note If the messages array fills up, parsing stops immediately after
+ *       the byte that completed the last message. The remaining bytes
+ *       (from buffer + *consumed) should be passed to the next call.
+ */
+size_t midi_parse_buffer(midi_parser_t *parser,
+                         const uint8_t *buffer,
+                         size_t length,
+                         midi_message_t *messages,
+                         size_t capacity,
+                         size_t *consumed);
+
+/**
+ * @brief Parse a buffer of MIDI bytes into packed messages
+ * @details Identical to midi_parse_buffer, except that each complete
+ *          message is written as a midi_packed_t word
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @param [out] packed Pointer to an array of midi_packed_t words.
+ *      Each complete message is written to the next free entry.
+ * @param [in] capacity The number of entries in the packed array
+ * @param [out] consumed Optional pointer that receives the number of
+ *      bytes that were parsed. May be NULL.
+ * @return The number of complete messages written to the packed array
+ */
+size_t midi_parse_buffer_packed(midi_parser_t *parser,
+                                const uint8_t *buffer,
+                                size_t length,
+                                midi_packed_t *packed,
+                                size_t capacity,
+                                size_t *consumed);
+
+/**
+ * @brief Parse a buffer of MIDI bytes and time each message
+ * @details Identical to midi_parse_buffer, except that the arrival time
+ *          of each message is written to the matching entry of a
+ *          separate timestamps array. A message arrives with the byte
+ *          that completes it, so byte n of the buffer arrives at
+ *          base + n * period, for example with a period of 320 us at
+ *          the 31.25 kbaud of a DIN-MIDI port. The time wraps around
+ *          modulo 2^32. Events of the realtime handler are timed the
+ *          same way instead of with the timestamp source.
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @param [in] base The arrival time of the first byte of the buffer
+ * @param [in] period The time taken by each byte, in the units of base
+ * @param [out] messages Pointer to an array of midi_message_t structs.
+ *      Each complete message is written to the next free entry.
+ * @param [out] timestamps Pointer to an array that receives the arrival
+ *      time of each message
+ * @param [in] capacity The number of entries in the messages and
+ *      timestamps arrays
+ * @param [out] consumed Optional pointer that receives the number of
+ *      bytes that were parsed. May be NULL.
+ * @return The number of complete messages written to the messages array
+ * @note The next chunk should be passed with a base of
+ *       base + *consumed * period, or the time its first byte arrived
+ */
+size_t midi_parse_buffer_timed(midi_parser_t *parser,
+                               const uint8_t *buffer,
+                               size_t length,
+                               uint32_t base,
+                               uint32_t period,
+                               midi_message_t *messages,
+                               uint32_t *timestamps,
+                               size_t capacity,
+                               size_t *consumed);
+
+/**
+ * @brief Parse a buffer of MIDI bytes into packed messages and time each
+ *        message
+ * @details Identical to midi_parse_buffer_timed, except that each
+ *          complete message is written as a midi_packed_t word
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @param [in] base The arrival time of the first byte of the buffer
+ * @param [in] period The time taken by each byte, in the units of base
+ * @param [out] packed Pointer to an array of midi_packed_t words.
+ *      Each complete message is written to the next free entry.
+ * @param [out] timestamps Pointer to an array that receives the arrival
+ *      time of each message
+ * @param [in] capacity The number of entries in the packed and
+ *      timestamps arrays
+ * @param [out] consumed Optional pointer that receives the number of
+ *      bytes that were parsed. May be NULL.
+ * @return The number of complete messages written to the packed array
+ */
+size_t midi_parse_buffer_packed_timed(midi_parser_t *parser,
+                                      const uint8_t *buffer,
+                                      size_t length,
+                                      uint32_t base,
+                                      uint32_t period,
+                                      midi_packed_t *packed,
+                                      uint32_t *timestamps,
+                                      size_t capacity,
+                                      size_t *consumed);
+
+/**
+ * @brief Initialize a MIDI message dispatcher with no handlers
+ * @param [out] dispatcher Pointer to a midi_dispatcher_t struct
+ * @param [in] context Pointer passed to every handler. May be NULL.
+ */
+void midi_dispatcher_init(midi_dispatcher_t *dispatcher, void *context);
+
+/**
+ * @brief Set the handler for a message type
+ * @param [in,out] dispatcher Pointer to a midi_dispatcher_t struct
+ * @param [in] message_type The message type to handle. Channel Mode
+ *      messages have their own message types (MIDI_MESSAGE_ALL_SOUND_OFF
+ *      to MIDI_MESSAGE_POLY_ON) and are not passed to Control Change
+ *      handlers.
+ * @param [in] handler The handler, or NULL to ignore the message type
+ */
+void midi_dispatcher_set_handler(midi_dispatcher_t *dispatcher,
+                                 midi_message_type_t message_type,
+                                 midi_message_handler_t handler);
+
+/**
+ * @brief Set the handler for Control Change messages of one controller
+ * @details Overrides the Control Change message handler for
+ *          that controller
+ * @param [in,out] dispatcher Pointer to a midi_dispatcher_t struct
+ * @param [in] controller The controller to handle (0-119)
+ * @param [in] handler The handler, or NULL to use the Control Change
+ *      message handler
+ */
+void midi_dispatcher_set_controller_handler(midi_dispatcher_t *dispatcher,
+                                            midi_controller_t controller,
+                                            midi_message_handler_t handler);
+
+/**
+ * @brief Parse a buffer of MIDI bytes and dispatch the messages
+ * @details Identical to midi_parse_buffer, except that each complete
+ *          message is passed straight to its handler in the dispatcher
+ *          instead of being written to an array, so the whole buffer is
+ *          always consumed
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] dispatcher Pointer to a midi_dispatcher_t struct
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @return The number of complete messages parsed, including messages
+ *      that had no handler
+ * @note Handlers must not use the parser that is dispatching to them
+ */
+size_t midi_parse_buffer_dispatch(midi_parser_t *parser,
+                                  const midi_dispatcher_t *dispatcher,
+                                  const uint8_t *buffer,
+                                  size_t length);
+
+/**
+ * @brief Get the number of data bytes that follow a status byte
+ * @param [in] status The status byte
+ * @return The number of data bytes, or 0 for status bytes without
+ *      data bytes (including System Exclusive) and for data bytes
+ */
+size_t midi_status_data_length(uint8_t status);
+
+/**
+ * @brief Decode a complete MIDI message from its status and data bytes
+ * @details Decodes a message the same way as the parser, without any
+ *          parser state or filters, for readers of formats that store
+ *          whole messages (such as Standard MIDI Files). Note On with a
+ *          velocity of zero is decoded as Note Off, and Control Change
+ *          for controllers 120-127 as Channel Mode messages.
+ * @param [in] status The status byte
+ * @param [in] data1 The first data byte, if the message has one
+ * @param [in] data2 The second data byte, if the message has two
+ * @param [out] message Pointer to a midi_message_t struct
+ *      that will be updated with the decoded message data
+ * @return The decoded message type, or MIDI_MESSAGE_NONE if the status
+ *      byte is undefined or not a status byte
+ */
+midi_message_type_t midi_decode_message(uint8_t status,
+                                        uint8_t data1,
+                                        uint8_t data2,
+                                        midi_message_t *message);
+
+/**
+ * @brief Check a complete MIDI message against the filters of a parser
+ * @details For readers of formats that frame whole messages (such as
+ *          USB-MIDI event packets), which decode them with
+ *          midi_decode_message instead of parsing them byte by byte.
+ *          The parser state is not used or changed.
+ * @param [in] parser Pointer to a midi_parser_t struct
+ * @param [in] status The status byte
+ * @param [in] data1 The first data byte, if the message has one
+ * @param [in] data2 The second data byte, if the message has two
+ * @return Non-zero if the parser would return the message
+ */
+int midi_parser_accepts(const midi_parser_t *parser,
+                        uint8_t status,
+                        uint8_t data1,
+                        uint8_t data2);
+
+#endif /* MIDI_H */
@@ -0,0 +1,359 @@
+/***********************************************************************
+ * @file midi_encoder.c
+ * @brief MIDI encoder implementation
+ *
+ * @details Serializes MIDI messages into MIDI 1.0 bytes. Repeated
+ *          channel status bytes are left out (running status), and
+ *          running status is never carried across System Exclusive or
+ *          System Common messages, matching the parser. System
+ *          Real-Time messages do not affect running status.
+ *
+ * @see MIDI 1.0 Detailed Specification
+ *      https://midi.org/midi-1-0-detailed-specification
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_encoder.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief MIDI Data Byte Mask
+ * @details The bits of a byte that may be set in a data byte
+ */
+#define MIDI_DATA_MASK (0x7F)
+
+/**
+ * @brief Largest MIDI channel number
+ */
+#define MIDI_MAX_CHANNEL (0x0F)
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static inline size_t encode_packed(const midi_encoder_t *encoder,
+                                   midi_packed_t packed,
+                                   uint8_t *bytes,
+                                   uint8_t *running_status);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a MIDI encoder
+ * @param [out] encoder Pointer to a midi_encoder_t struct to initialize
+ */
+void midi_encoder_init(midi_encoder_t *encoder)
+{
+    if (encoder == NULL) { return; }
+
+    encoder->running_status = 0;
+    encoder->running_status_enabled = 1;
+    encoder->note_off_as_note_on = 0;
+}
+
+/**
+ * @brief Reset a MIDI encoder
+ * @param [in,out] encoder Pointer to a midi_encoder_t struct
+ */
+void midi_encoder_reset(midi_encoder_t *encoder)
+{
+    if (encoder == NULL) { return; }
+
+    encoder->running_status = 0;
+}
+
+/**
+ * @brief Enable or disable running status
+ * @param [in,out] encoder Pointer to a midi_encoder_t struct
+ * @param [in] enabled Non-zero to leave out repeated status bytes
+ */
+void midi_encoder_set_running_status(midi_encoder_t *encoder, int enabled)
+{
+    if (encoder == NULL) { return; }
+
+    encoder->running_status_enabled = (enabled != 0);
+    encoder->running_status = 0;
+}
+
+/**
+ * @brief Enable or disable sending Note Off as Note On with velocity 0
+ * @param [in,out] encoder Pointer to a midi_encoder_t struct
+ * @param [in] enabled Non-zero to send Note Off messages as Note On
+ */
+void midi_encoder_set_note_off_as_note_on(midi_encoder_t *encoder,
+                                          int enabled)
+{
+    if (encoder == NULL) { return; }
+
+    encoder->note_off_as_note_on = (enabled != 0);
+}
+
+/**
+ * @brief Encode a MIDI message
+ * @param [in,out] encoder Pointer to a midi_encoder_t struct
+ * @param [in] message Pointer to the message to encode
+ * @param [out] buffer Pointer to the buffer that receives the bytes
+ * @param [in] capacity The number of bytes available in the buffer
+ * @return The number of bytes written, or 0 if the message does not fit
+ *      or cannot be encoded
+ */
+size_t midi_encode_message(midi_encoder_t *encoder,
+                           const midi_message_t *message,
+                           uint8_t *buffer,
+                           size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (encoder == NULL || message == NULL || buffer == NULL) { return 0; }
+
+    uint8_t bytes[MIDI_ENCODER_MAX_MESSAGE_SIZE];
+    uint8_t running_status = 0;
+    const size_t size = encode_packed(
+        encoder, midi_message_pack(message), bytes, &running_status);
+
+    if (size == 0 || size > capacity) { return 0; }
+
+    memcpy(buffer, bytes, size);
+    encoder->running_status = running_status;
+    return size;
+}
+
+/**
+ * @brief Encode an array of MIDI messages
+ * @param [in,out] encoder Pointer to a midi_encoder_t struct
+ * @param [in] messages Pointer to the messages to encode
+ * @param [in] count The number of messages
+ * @param [out] buffer Pointer to the buffer that receives the bytes
+ * @param [in] capacity The number of bytes available in the buffer
+ * @param [out] encoded Optional pointer that receives the number of
+ *      messages that were encoded or skipped. May be NULL.
+ * @return The number of bytes written to the buffer
+ */
+size_t midi_encode_messages(midi_encoder_t *encoder,
+                            const midi_message_t *messages,
+                            size_t count,
+                            uint8_t *buffer,
+                            size_t capacity,
+                            size_t *encoded)
+{
+    size_t written = 0;
+    size_t i = 0;
+
+    /* Check for NULL pointers */
+    if (encoder != NULL && messages != NULL && buffer != NULL) {
+        for (; i < count; i++) {
+            uint8_t bytes[MIDI_ENCODER_MAX_MESSAGE_SIZE];
+            uint8_t next_status = 0;
+            const size_t size = encode_packed(
+                encoder, midi_message_pack(&messages[i]), bytes, &next_status);
+
+            if (size > capacity - written) { break; }
+
+            /* Messages that cannot be encoded have a size of zero */
+            memcpy(&buffer[written], bytes, size);
+            written += size;
+            if (size != 0) { encoder->running_status = next_status; }
+        }
+    }
+
+    if (encoded != NULL) { *encoded = i; }
+    return written;
+}
+
+/**
+ * @brief Encode an array of packed MIDI messages
+ * @param [in,out] encoder Pointer to a midi_encoder_t struct
+ * @param [in] packed Pointer to the packed messages to encode
+ * @param [in] count The number of packed messages
+ * @param [out] buffer Pointer to the buffer that receives the bytes
+ * @param [in] capacity The number of bytes available in the buffer
+ * @param [out] encoded Optional pointer that receives the number of
+ *      messages that were encoded or skipped. May be NULL.
+ * @return The number of bytes written to the buffer
+ */
+size_t midi_encode_packed(midi_encoder_t *encoder,
+                          const midi_packed_t *packed,
+                          size_t count,
+                          uint8_t *buffer,
+                          size_t capacity,
+                          size_t *encoded)
+{
+    size_t written = 0;
+    size_t i = 0;
+
+    /* Check for NULL pointers */
+    if (encoder != NULL && packed != NULL && buffer != NULL) {
+        for (; i < count; i++) {
+            uint8_t bytes[MIDI_ENCODER_MAX_MESSAGE_SIZE];
+            uint8_t next_status = 0;
+            const size_t size =
+                encode_packed(encoder, packed[i], bytes, &next_status);
+
+            if (size > capacity - written) { break; }
+
+            memcpy(&buffer[written], bytes, size);
+            written += size;
+            if (size != 0) { encoder->running_status = next_status; }
+        }
+    }
+
+    if (encoded != NULL) { *encoded = i; }
+    return written;
+}
+
+/**
+ * @brief Encode a complete System Exclusive message
+ * @param [in,out] encoder Pointer to a midi_encoder_t struct
+ * @param [in] payload Pointer to the payload bytes. May be NULL if
+ *      length is 0.
+ * @param [in] length The number of payload bytes
+ * @param [out] buffer Pointer to the buffer that receives the bytes
+ * @param [in] capacity The number of bytes available in the buffer
+ * @return The number of bytes written, or 0 if the message does not fit
+ *      or the payload contains a status byte
+ */
+size_t midi_encode_sysex(midi_encoder_t *encoder,
+                         const uint8_t *payload,
+                         size_t length,
+                         uint8_t *buffer,
+                         size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (encoder == NULL || buffer == NULL || (payload == NULL && length > 0)) {
+        return 0;
+    }
+
+    if (capacity < 2 || length > capacity - 2) { return 0; }
+
+    for (size_t i = 0; i < length; i++) {
+        if (payload[i] > MIDI_DATA_MASK) { return 0; }
+    }
+
+    buffer[0] = MIDI_MESSAGE_SYSTEM_EXCLUSIVE;
+    if (length > 0) { memcpy(&buffer[1], payload, length); }
+    buffer[length + 1] = MIDI_MESSAGE_END_OF_EXCLUSIVE;
+
+    encoder->running_status = 0;
+    return length + 2;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Encode a packed MIDI message
+ * @param [in] encoder Pointer to a midi_encoder_t struct
+ * @param [in] packed The packed message to encode
+ * @param [out] bytes Pointer to MIDI_ENCODER_MAX_MESSAGE_SIZE bytes
+ *      that receive the encoded message
+ * @param [out] running_status Receives the running status after the
+ *      message has been sent
+ * @return The number of bytes encoded, or 0 if the message cannot
+ *      be encoded
+ */
+static inline size_t encode_packed(const midi_encoder_t *encoder,
+                                   midi_packed_t packed,
+                                   uint8_t *bytes,
+                                   uint8_t *running_status)
+{
+    midi_message_type_t message_type = midi_packed_type(packed);
+    const uint8_t channel = (uint8_t)midi_packed_channel(packed);
+    uint8_t data1 = midi_packed_data1(packed) & MIDI_DATA_MASK;
+    uint8_t data2 = midi_packed_data2(packed) & MIDI_DATA_MASK;
+    size_t data_length;
+
+    if (message_type == MIDI_MESSAGE_NOTE_OFF
+        && encoder->note_off_as_note_on) {
+        message_type = MIDI_MESSAGE_NOTE_ON;
+        data2 = 0;
+    }
+
+    /* Channel Mode messages are Control Change on the wire */
+    if (message_type >= MIDI_MESSAGE_ALL_SOUND_OFF
+        && message_type <= MIDI_MESSAGE_POLY_ON) {
+        data1 = (uint8_t)message_type;
+        message_type = MIDI_MESSAGE_CONTROL_CHANGE;
+    }
+
+    switch (message_type) {
+    case MIDI_MESSAGE_NOTE_OFF:
+    case MIDI_MESSAGE_NOTE_ON:
+    case MIDI_MESSAGE_KEY_PRESSURE:
+    case MIDI_MESSAGE_CONTROL_CHANGE:
+    case MIDI_MESSAGE_PITCH_BEND:
+        data_length = 2;
+        break;
+    case MIDI_MESSAGE_PROGRAM_CHANGE:
+    case MIDI_MESSAGE_CHANNEL_PRESSURE:
+        data_length = 1;
+        break;
+
+    case MIDI_MESSAGE_MTC_QUARTER_FRAME:
+    case MIDI_MESSAGE_SONG_SELECT:
+        /* System Common messages clear running status */
+        bytes[0] = (uint8_t)message_type;
+        bytes[1] = data1;
+        *running_status = 0;
+        return 2;
+    case MIDI_MESSAGE_SONG_POSITION_POINTER:
+        bytes[0] = (uint8_t)message_type;
+        bytes[1] = data1;
+        bytes[2] = data2;
+        *running_status = 0;
+        return 3;
+    case MIDI_MESSAGE_SYSTEM_EXCLUSIVE:
+    case MIDI_MESSAGE_TUNE_REQUEST:
+    case MIDI_MESSAGE_END_OF_EXCLUSIVE:
+        bytes[0] = (uint8_t)message_type;
+        *running_status = 0;
+        return 1;
+
+    case MIDI_MESSAGE_TIMING_CLOCK:
+    case MIDI_MESSAGE_START:
+    case MIDI_MESSAGE_CONTINUE:
+    case MIDI_MESSAGE_STOP:
+    case MIDI_MESSAGE_ACTIVE_SENSE:
+    case MIDI_MESSAGE_SYSTEM_RESET:
+        /* System Real-Time messages do not affect running status */
+        bytes[0] = (uint8_t)message_type;
+        *running_status = encoder->running_status;
+        return 1;
+
+    default:
+        /* Not a message that can be sent */
+        return 0;
+    }
+
+    if (channel > MIDI_MAX_CHANNEL) { return 0; }
+
+    const uint8_t status = (uint8_t)message_type | channel;
+    size_t size = 0;
+
+    if (!encoder->running_status_enabled
+        || encoder->running_status != status) {
+        bytes[size++] = status;
+    }
+    bytes[size++] = data1;
+    if (data_length == 2) { bytes[size++] = data2; }
+
+    *running_status = encoder->running_status_enabled ? status : 0;
+    return size;
+}
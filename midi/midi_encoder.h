@@ -0,0 +1,187 @@
+/**********************************************************************
+ * @file midi_encoder.h
+ * @brief MIDI encoder module
+ *
+ * @details This module provides the mirror of the MIDI parser: it
+ *          serializes MIDI messages into MIDI 1.0 bytes, applying
+ *          running status to save bandwidth on outbound streams.
+ *
+ * @see MIDI 1.0 Detailed Specification
+ *      https://midi.org/midi-1-0-detailed-specification
+ **********************************************************************/
+
+#ifndef MIDI_ENCODER_H
+#define MIDI_ENCODER_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Maximum Encoded Message Size
+ * @details The largest number of bytes a single message encodes to
+ *          (a status byte and two data bytes)
+ */
+#define MIDI_ENCODER_MAX_MESSAGE_SIZE (3)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief MIDI Encoder
+ * @details This struct holds the state of a MIDI encoder for one
+ *          outbound stream
+ */
+typedef struct midi_encoder_t {
+    /**
+     * @brief Running Status
+     * @details The last channel status byte sent, or 0 when the next
+     *          channel message must send its status byte
+     */
+    uint8_t running_status;
+
+    /**
+     * @brief Use running status
+     * @details Non-zero to leave out repeated channel status bytes
+     */
+    uint8_t running_status_enabled;
+
+    /**
+     * @brief Send Note Off as Note On
+     * @details Non-zero to send Note Off messages as Note On with
+     *          velocity 0, so that they can share running status with
+     *          the Note On messages around them
+     */
+    uint8_t note_off_as_note_on;
+} midi_encoder_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a MIDI encoder
+ * @details Running status is enabled and Note Off messages are sent
+ *          as Note Off
+ * @param [out] encoder Pointer to a midi_encoder_t struct to initialize
+ * @note This function must be called before using the encoder
+ */
+void midi_encoder_init(midi_encoder_t *encoder);
+
+/**
+ * @brief Reset a MIDI encoder
+ * @details Forgets the running status, so the next channel message
+ *          sends its status byte. Call this when the receiver may have
+ *          lost the running status, for example after a cable was
+ *          reconnected. The options are kept.
+ * @param [in,out] encoder Pointer to a midi_encoder_t struct
+ */
+void midi_encoder_reset(midi_encoder_t *encoder);
+
+/**
+ * @brief Enable or disable running status
+ * @param [in,out] encoder Pointer to a midi_encoder_t struct
+ * @param [in] enabled Non-zero to leave out repeated status bytes,
+ *      zero to send a status byte with every message
+ */
+void midi_encoder_set_running_status(midi_encoder_t *encoder, int enabled);
+
+/**
+ * @brief Enable or disable sending Note Off as Note On with velocity 0
+ * @param [in,out] encoder Pointer to a midi_encoder_t struct
+ * @param [in] enabled Non-zero to send Note Off messages as Note On
+ *      with velocity 0. The release velocity is not sent.
+ */
+void midi_encoder_set_note_off_as_note_on(midi_encoder_t *encoder,
+                                          int enabled);
+
+/**
+ * @brief Encode a MIDI message
+ * @param [in,out] encoder Pointer to a midi_encoder_t struct
+ * @param [in] message Pointer to the message to encode
+ * @param [out] buffer Pointer to the buffer that receives the bytes
+ * @param [in] capacity The number of bytes available in the buffer
+ * @return The number of bytes written, or 0 if the message does not fit
+ *      or cannot be encoded (MIDI_MESSAGE_NONE, or a channel message
+ *      without a valid channel). The encoder state is only updated
+ *      when the message is written.
+ * @note Data bytes are masked to 7 bits, so the output never contains
+ *       a stray status byte
+ */
+size_t midi_encode_message(midi_encoder_t *encoder,
+                           const midi_message_t *message,
+                           uint8_t *buffer,
+                           size_t capacity);
+
+/**
+ * @brief Encode an array of MIDI messages
+ * @details Encodes messages until they have all been encoded or the
+ *          next one does not fit. Messages that cannot be encoded are
+ *          skipped.
+ * @param [in,out] encoder Pointer to a midi_encoder_t struct
+ * @param [in] messages Pointer to the messages to encode
+ * @param [in] count The number of messages
+ * @param [out] buffer Pointer to the buffer that receives the bytes
+ * @param [in] capacity The number of bytes available in the buffer
+ * @param [out] encoded Optional pointer that receives the number of
+ *      messages that were encoded or skipped. May be NULL.
+ * @return The number of bytes written to the buffer
+ * @note The remaining messages (from messages + *encoded) should be
+ *       passed to the next call
+ */
+size_t midi_encode_messages(midi_encoder_t *encoder,
+                            const midi_message_t *messages,
+                            size_t count,
+                            uint8_t *buffer,
+                            size_t capacity,
+                            size_t *encoded);
+
+/**
+ * @brief Encode an array of packed MIDI messages
+ * @details Identical to midi_encode_messages, except that the messages
+ *          are midi_packed_t words
+ * @param [in,out] encoder Pointer to a midi_encoder_t struct
+ * @param [in] packed Pointer to the packed messages to encode
+ * @param [in] count The number of packed messages
+ * @param [out] buffer Pointer to the buffer that receives the bytes
+ * @param [in] capacity The number of bytes available in the buffer
+ * @param [out] encoded Optional pointer that receives the number of
+ *      messages that were encoded or skipped. May be NULL.
+ * @return The number of bytes written to the buffer
+ */
+size_t midi_encode_packed(midi_encoder_t *encoder,
+                          const midi_packed_t *packed,
+                          size_t count,
+                          uint8_t *buffer,
+                          size_t capacity,
+                          size_t *encoded);
+
+/**
+ * @brief Encode a complete System Exclusive message
+ * @details Writes Start of Exclusive, the payload and End of Exclusive,
+ *          and clears the running status
+ * @param [in,out] encoder Pointer to a midi_encoder_t struct
+ * @param [in] payload Pointer to the payload bytes, excluding the Start
+ *      and End of Exclusive status bytes. May be NULL if length is 0.
+ * @param [in] length The number of payload bytes
+ * @param [out] buffer Pointer to the buffer that receives the bytes
+ * @param [in] capacity The number of bytes available in the buffer
+ * @return The number of bytes written (length + 2), or 0 if the message
+ *      does not fit or the payload contains a status byte
+ */
+size_t midi_encode_sysex(midi_encoder_t *encoder,
+                         const uint8_t *payload,
+                         size_t length,
+                         uint8_t *buffer,
+                         size_t capacity);
+
+#endif /* MIDI_ENCODER_H */
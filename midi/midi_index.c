@@ -0,0 +1,537 @@
+/***********************************************************************
+ * @file midi_index.c
+ * @brief MIDI stream index implementation
+ *
+ * @details Builds checkpoints of the parser state over a MIDI 1.0 byte
+ *          stream, and seeks by restoring the nearest checkpoint and
+ *          replaying the bytes after it on a private parser, so that the
+ *          handlers of the caller's parser are never called for bytes
+ *          that are skipped.
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_index.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Magic bytes at the start of a serialized index
+ */
+#define INDEX_MAGIC "MIDX"
+#define INDEX_MAGIC_SIZE (4)
+
+/**
+ * @brief Number of data bytes a parser can hold of a partial message
+ */
+#define INDEX_MAX_BYTE_COUNT (2)
+
+/**
+ * @brief MIDI Maximum Data Byte Value
+ */
+#define INDEX_MAX_DATA_BYTE (0x7F)
+
+/**
+ * @brief Mask of the channel nibble of a Channel Voice status byte
+ */
+#define INDEX_CHANNEL_MASK (0x0F)
+
+/**
+ * @brief The SysEx span flags a parser state can hold
+ */
+#define INDEX_SYSEX_FLAGS                                                  \
+    (MIDI_SYSEX_FLAG_START | MIDI_SYSEX_FLAG_CONTINUE | MIDI_SYSEX_FLAG_END \
+     | MIDI_SYSEX_FLAG_ABORTED)
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static inline void add_checkpoint(midi_index_t *index,
+                                  uint32_t offset,
+                                  uint32_t tick,
+                                  uint32_t message,
+                                  const midi_parser_t *parser);
+
+static inline int is_due(const midi_index_t *index,
+                         uint32_t tick,
+                         uint32_t message);
+
+static inline void decimate(midi_index_t *index);
+
+static inline const midi_index_checkpoint_t *
+find_offset(const midi_index_t *index, size_t offset);
+
+static inline const midi_index_checkpoint_t *
+find_tick(const midi_index_t *index, uint32_t tick);
+
+static inline int is_valid_state_type(midi_message_type_t message_type);
+
+static inline int is_valid_checkpoint(const midi_index_checkpoint_t *checkpoint,
+                                      const midi_index_checkpoint_t *previous,
+                                      size_t length);
+
+static inline void write_le16(uint8_t *bytes, uint16_t value);
+
+static inline void write_le32(uint8_t *bytes, uint32_t value);
+
+static inline uint16_t read_le16(const uint8_t *bytes);
+
+static inline uint32_t read_le32(const uint8_t *bytes);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Build the index of a stream
+ * @param [out] index Pointer to a midi_index_t struct to initialize
+ * @param [in] stream Pointer to the stream
+ * @param [in] length The number of bytes in the stream
+ * @param [out] checkpoints Pointer to an array that receives the
+ *      checkpoints
+ * @param [in] capacity The number of checkpoints in the array
+ * @param [in] message_interval The number of messages between checkpoints
+ * @param [in] tick_interval The number of clock ticks between checkpoints
+ * @return The number of checkpoints, or 0 if an argument is invalid
+ */
+size_t midi_index_build(midi_index_t *index,
+                        const uint8_t *stream,
+                        size_t length,
+                        midi_index_checkpoint_t *checkpoints,
+                        size_t capacity,
+                        uint32_t message_interval,
+                        uint32_t tick_interval)
+{
+    /* Check for NULL pointers */
+    if (index == NULL || (stream == NULL && length > 0) || checkpoints == NULL
+        || capacity < 2 || (uint64_t)length > UINT32_MAX) {
+        return 0;
+    }
+
+    midi_parser_t parser;
+    midi_message_t message;
+    uint32_t tick = 0;
+    uint32_t messages = 0;
+
+    midi_parser_init(&parser);
+    index->stream = stream;
+    index->length = length;
+    index->checkpoints = checkpoints;
+    index->count = 0;
+    index->message_interval = message_interval;
+    index->tick_interval = tick_interval;
+    add_checkpoint(index, 0, 0, 0, &parser);
+
+    for (size_t i = 0; i < length; i++) {
+        const uint8_t byte = stream[i];
+
+        if (midi_parse_byte(&parser, byte, &message) != MIDI_MESSAGE_NONE) {
+            messages++;
+        }
+        if (byte == MIDI_MESSAGE_TIMING_CLOCK) { tick++; }
+
+        if (!is_due(index, tick, messages)) { continue; }
+
+        /* Thinning out the checkpoints may make this one unnecessary */
+        if (index->count == capacity) {
+            decimate(index);
+            if (!is_due(index, tick, messages)) { continue; }
+        }
+        add_checkpoint(index, (uint32_t)(i + 1), tick, messages, &parser);
+    }
+
+    return index->count;
+}
+
+/**
+ * @brief Seek to a byte offset
+ * @param [in] index Pointer to a midi_index_t struct
+ * @param [in] offset The offset to seek to
+ * @param [in,out] parser Pointer to the parser whose state is set
+ * @return The offset to continue parsing from
+ */
+size_t midi_index_seek_offset(const midi_index_t *index,
+                              size_t offset,
+                              midi_parser_t *parser)
+{
+    /* Check for NULL pointers */
+    if (index == NULL || parser == NULL || index->count == 0) { return 0; }
+
+    if (offset > index->length) { offset = index->length; }
+
+    const midi_index_checkpoint_t *checkpoint = find_offset(index, offset);
+    midi_parser_t replay;
+    midi_parser_state_t state;
+    midi_message_t message;
+
+    midi_parser_init(&replay);
+    midi_parser_restore_state(&replay, &checkpoint->state);
+    for (size_t i = checkpoint->offset; i < offset; i++) {
+        midi_parse_byte(&replay, index->stream[i], &message);
+    }
+
+    midi_parser_save_state(&replay, &state);
+    midi_parser_restore_state(parser, &state);
+    return offset;
+}
+
+/**
+ * @brief Seek to a clock tick
+ * @param [in] index Pointer to a midi_index_t struct
+ * @param [in] tick The tick to seek to
+ * @param [in,out] parser Pointer to the parser whose state is set
+ * @return The offset to continue parsing from
+ */
+size_t midi_index_seek_tick(const midi_index_t *index,
+                            uint32_t tick,
+                            midi_parser_t *parser)
+{
+    /* Check for NULL pointers */
+    if (index == NULL || parser == NULL || index->count == 0) { return 0; }
+
+    const midi_index_checkpoint_t *checkpoint = find_tick(index, tick);
+    midi_parser_t replay;
+    midi_parser_state_t state;
+    midi_message_t message;
+    uint32_t clocks = checkpoint->tick;
+    size_t offset = checkpoint->offset;
+
+    midi_parser_init(&replay);
+    midi_parser_restore_state(&replay, &checkpoint->state);
+    while (clocks < tick && offset < index->length) {
+        const uint8_t byte = index->stream[offset++];
+        midi_parse_byte(&replay, byte, &message);
+        if (byte == MIDI_MESSAGE_TIMING_CLOCK) { clocks++; }
+    }
+
+    midi_parser_save_state(&replay, &state);
+    midi_parser_restore_state(parser, &state);
+    return offset;
+}
+
+/**
+ * @brief Serialize an index
+ * @param [in] index Pointer to a midi_index_t struct
+ * @param [out] buffer Pointer to the buffer that receives the bytes
+ * @param [in] capacity The number of bytes available in the buffer
+ * @return The number of bytes written, or 0 if the index does not fit
+ */
+size_t midi_index_serialize(const midi_index_t *index,
+                            uint8_t *buffer,
+                            size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (index == NULL || buffer == NULL) { return 0; }
+
+    const size_t size = MIDI_INDEX_SERIALIZED_SIZE(index->count);
+    if (size > capacity || (uint64_t)index->count > UINT32_MAX) { return 0; }
+
+    memcpy(buffer, INDEX_MAGIC, INDEX_MAGIC_SIZE);
+    write_le16(&buffer[4], MIDI_INDEX_VERSION);
+    write_le16(&buffer[6], MIDI_INDEX_CHECKPOINT_SIZE);
+    write_le32(&buffer[8], (uint32_t)index->length);
+    write_le32(&buffer[12], index->message_interval);
+    write_le32(&buffer[16], index->tick_interval);
+    write_le32(&buffer[20], (uint32_t)index->count);
+
+    uint8_t *bytes = &buffer[MIDI_INDEX_HEADER_SIZE];
+    for (size_t i = 0; i < index->count; i++) {
+        const midi_index_checkpoint_t *checkpoint = &index->checkpoints[i];
+
+        write_le32(&bytes[0], checkpoint->offset);
+        write_le32(&bytes[4], checkpoint->tick);
+        write_le32(&bytes[8], checkpoint->message);
+        bytes[12] = (uint8_t)checkpoint->state.message_type;
+        bytes[13] = (uint8_t)checkpoint->state.channel;
+        bytes[14] = checkpoint->state.buffer[0];
+        bytes[15] = checkpoint->state.buffer[1];
+        bytes[16] = checkpoint->state.byte_count;
+        bytes[17] = checkpoint->state.sysex_flags;
+        bytes += MIDI_INDEX_CHECKPOINT_SIZE;
+    }
+
+    return size;
+}
+
+/**
+ * @brief Load a serialized index
+ * @param [out] index Pointer to a midi_index_t struct to initialize
+ * @param [in] stream Pointer to the stream the index was built from
+ * @param [in] length The number of bytes in the stream
+ * @param [in] data Pointer to the serialized index
+ * @param [in] size The number of bytes of serialized index
+ * @param [out] checkpoints Pointer to an array that receives the
+ *      checkpoints
+ * @param [in] capacity The number of checkpoints in the array
+ * @return The number of checkpoints, or 0 if the data is invalid
+ */
+size_t midi_index_deserialize(midi_index_t *index,
+                              const uint8_t *stream,
+                              size_t length,
+                              const uint8_t *data,
+                              size_t size,
+                              midi_index_checkpoint_t *checkpoints,
+                              size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (index == NULL || (stream == NULL && length > 0) || data == NULL
+        || checkpoints == NULL) {
+        return 0;
+    }
+
+    if (size < MIDI_INDEX_HEADER_SIZE
+        || memcmp(data, INDEX_MAGIC, INDEX_MAGIC_SIZE) != 0
+        || read_le16(&data[4]) != MIDI_INDEX_VERSION
+        || read_le16(&data[6]) != MIDI_INDEX_CHECKPOINT_SIZE
+        || read_le32(&data[8]) != length) {
+        return 0;
+    }
+
+    const size_t count = read_le32(&data[20]);
+    if (count == 0 || count > capacity
+        || size != MIDI_INDEX_SERIALIZED_SIZE(count)) {
+        return 0;
+    }
+
+    const uint8_t *bytes = &data[MIDI_INDEX_HEADER_SIZE];
+    for (size_t i = 0; i < count; i++) {
+        midi_index_checkpoint_t *checkpoint = &checkpoints[i];
+
+        checkpoint->offset = read_le32(&bytes[0]);
+        checkpoint->tick = read_le32(&bytes[4]);
+        checkpoint->message = read_le32(&bytes[8]);
+        checkpoint->state.message_type = (midi_message_type_t)bytes[12];
+        checkpoint->state.channel = (midi_channel_t)bytes[13];
+        checkpoint->state.buffer[0] = bytes[14];
+        checkpoint->state.buffer[1] = bytes[15];
+        checkpoint->state.byte_count = bytes[16];
+        checkpoint->state.sysex_flags = bytes[17];
+        bytes += MIDI_INDEX_CHECKPOINT_SIZE;
+
+        if (!is_valid_checkpoint(
+                checkpoint, (i > 0) ? &checkpoints[i - 1] : NULL, length)) {
+            return 0;
+        }
+    }
+
+    index->stream = stream;
+    index->length = length;
+    index->checkpoints = checkpoints;
+    index->count = count;
+    index->message_interval = read_le32(&data[12]);
+    index->tick_interval = read_le32(&data[16]);
+    return count;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Append a checkpoint of the parser state
+ * @note The caller makes sure that there is room for the checkpoint
+ */
+static inline void add_checkpoint(midi_index_t *index,
+                                  uint32_t offset,
+                                  uint32_t tick,
+                                  uint32_t message,
+                                  const midi_parser_t *parser)
+{
+    midi_index_checkpoint_t *checkpoint = &index->checkpoints[index->count++];
+
+    checkpoint->offset = offset;
+    checkpoint->tick = tick;
+    checkpoint->message = message;
+    midi_parser_save_state(parser, &checkpoint->state);
+}
+
+/**
+ * @brief Check whether an interval has passed since the last checkpoint
+ * @return Non-zero if a checkpoint should be added
+ */
+static inline int is_due(const midi_index_t *index,
+                         uint32_t tick,
+                         uint32_t message)
+{
+    const midi_index_checkpoint_t *last = &index->checkpoints[index->count - 1];
+
+    return (index->message_interval > 0
+            && message - last->message >= index->message_interval)
+           || (index->tick_interval > 0
+               && tick - last->tick >= index->tick_interval);
+}
+
+/**
+ * @brief Drop every other checkpoint and double the intervals
+ * @details Checkpoint 0, the start of the stream, is always kept
+ */
+static inline void decimate(midi_index_t *index)
+{
+    size_t kept = 0;
+
+    for (size_t i = 0; i < index->count; i += 2) {
+        index->checkpoints[kept++] = index->checkpoints[i];
+    }
+    index->count = kept;
+
+    if (index->message_interval <= UINT32_MAX / 2) {
+        index->message_interval *= 2;
+    }
+    if (index->tick_interval <= UINT32_MAX / 2) { index->tick_interval *= 2; }
+}
+
+/**
+ * @brief Find the last checkpoint at or before an offset
+ */
+static inline const midi_index_checkpoint_t *
+find_offset(const midi_index_t *index, size_t offset)
+{
+    /* The first checkpoint is at offset 0, so the answer is in [low, high) */
+    size_t low = 0;
+    size_t high = index->count;
+
+    while (high - low > 1) {
+        const size_t middle = low + (high - low) / 2;
+        if (index->checkpoints[middle].offset <= offset) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return &index->checkpoints[low];
+}
+
+/**
+ * @brief Find the last checkpoint before a tick
+ * @details A checkpoint at the tick may follow messages of the tick, so
+ *          only checkpoints at earlier ticks are used
+ */
+static inline const midi_index_checkpoint_t *
+find_tick(const midi_index_t *index, uint32_t tick)
+{
+    /* The first checkpoint is at tick 0, so the answer is in [low, high) */
+    size_t low = 0;
+    size_t high = index->count;
+
+    while (high - low > 1) {
+        const size_t middle = low + (high - low) / 2;
+        if (index->checkpoints[middle].tick < tick) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return &index->checkpoints[low];
+}
+
+/**
+ * @brief Check the message type of a loaded parser state
+ * @details A parser holds no message, the running status of a Channel
+ *          Voice message, or a SysEx or System Common message with data
+ *          bytes that this build decodes
+ * @param [in] message_type The message type
+ * @return Non-zero if a parser could be in that state
+ */
+static inline int is_valid_state_type(midi_message_type_t message_type)
+{
+    const uint8_t status = (uint8_t)message_type;
+
+    if (message_type == MIDI_MESSAGE_NONE) { return 1; }
+    if (status >= MIDI_MESSAGE_NOTE_OFF
+        && status < MIDI_MESSAGE_SYSTEM_EXCLUSIVE) {
+        return (status & INDEX_CHANNEL_MASK) == 0;
+    }
+    return (MIDI_CONFIG_SYSEX && status == MIDI_MESSAGE_SYSTEM_EXCLUSIVE)
+           || (MIDI_CONFIG_MTC && status == MIDI_MESSAGE_MTC_QUARTER_FRAME)
+           || (MIDI_CONFIG_SONG
+               && (status == MIDI_MESSAGE_SONG_POSITION_POINTER
+                   || status == MIDI_MESSAGE_SONG_SELECT));
+}
+
+/**
+ * @brief Check a loaded checkpoint
+ * @param [in] checkpoint Pointer to the checkpoint
+ * @param [in] previous Pointer to the checkpoint before it, or NULL for
+ *      the first one
+ * @param [in] length The number of bytes in the stream
+ * @return Non-zero if the checkpoint could have been built from a stream
+ *      of that length
+ */
+static inline int is_valid_checkpoint(const midi_index_checkpoint_t *checkpoint,
+                                      const midi_index_checkpoint_t *previous,
+                                      size_t length)
+{
+    const midi_parser_state_t *state = &checkpoint->state;
+
+    if (previous == NULL) {
+        if (checkpoint->offset != 0 || checkpoint->tick != 0
+            || checkpoint->message != 0) {
+            return 0;
+        }
+    } else if (checkpoint->offset < previous->offset
+               || checkpoint->tick < previous->tick
+               || checkpoint->message < previous->message) {
+        return 0;
+    }
+
+    return checkpoint->offset <= length
+           && is_valid_state_type(state->message_type)
+           && !(state->sysex_flags & ~INDEX_SYSEX_FLAGS)
+           && state->byte_count < INDEX_MAX_BYTE_COUNT
+           && state->buffer[0] <= INDEX_MAX_DATA_BYTE
+           && state->buffer[1] <= INDEX_MAX_DATA_BYTE
+           && (state->channel <= MIDI_CHANNEL_16
+               || state->channel == MIDI_CHANNEL_NONE);
+}
+
+/**
+ * @brief Write a little-endian 16-bit value
+ */
+static inline void write_le16(uint8_t *bytes, uint16_t value)
+{
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+}
+
+/**
+ * @brief Write a little-endian 32-bit value
+ */
+static inline void write_le32(uint8_t *bytes, uint32_t value)
+{
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+    bytes[2] = (uint8_t)(value >> 16);
+    bytes[3] = (uint8_t)(value >> 24);
+}
+
+/**
+ * @brief Read a little-endian 16-bit value
+ */
+static inline uint16_t read_le16(const uint8_t *bytes)
+{
+    return (uint16_t)(bytes[0] | bytes[1] << 8);
+}
+
+/**
+ * @brief Read a little-endian 32-bit value
+ */
+static inline uint32_t read_le32(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8
+           | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
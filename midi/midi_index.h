@@ -0,0 +1,229 @@
+/**********************************************************************
+ * @file midi_index.h
+ * @brief MIDI stream index module
+ *
+ * @details This module builds a seek index over a stream of MIDI 1.0
+ *          bytes, such as a recorded capture. Running status and
+ *          partially received messages make a position in a stream
+ *          meaningless without the bytes that came before it, so the
+ *          index stores checkpoints holding the parser state every few
+ *          messages or clock ticks. Seeking restores the last checkpoint
+ *          before the target in O(log n) and parses only the bytes from
+ *          there.
+ *
+ *          Time in a MIDI 1.0 stream is counted in Timing Clock messages
+ *          (24 per quarter note), so the ticks of the index are clocks.
+ *
+ *          The index can be serialized, so that it can be cached next to
+ *          the stream.
+ **********************************************************************/
+
+#ifndef MIDI_INDEX_H
+#define MIDI_INDEX_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Serialized index format version
+ */
+#define MIDI_INDEX_VERSION (1)
+
+/**
+ * @brief Size of the serialized index header, in bytes
+ */
+#define MIDI_INDEX_HEADER_SIZE (24)
+
+/**
+ * @brief Size of a serialized checkpoint, in bytes
+ */
+#define MIDI_INDEX_CHECKPOINT_SIZE (18)
+
+/**
+ * @brief Size of a serialized index
+ * @param count The number of checkpoints
+ */
+#define MIDI_INDEX_SERIALIZED_SIZE(count)                                  \
+    (MIDI_INDEX_HEADER_SIZE + (size_t)(count) * MIDI_INDEX_CHECKPOINT_SIZE)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Index Checkpoint
+ * @details The position and parser state between two bytes of the stream
+ */
+typedef struct midi_index_checkpoint_t {
+    /**
+     * @brief Offset of the next byte in the stream
+     */
+    uint32_t offset;
+
+    /**
+     * @brief The number of Timing Clock messages before the offset
+     */
+    uint32_t tick;
+
+    /**
+     * @brief The number of complete messages before the offset
+     */
+    uint32_t message;
+
+    /**
+     * @brief Parser state at the offset
+     */
+    midi_parser_state_t state;
+} midi_index_checkpoint_t;
+
+/**
+ * @brief MIDI Stream Index
+ */
+typedef struct midi_index_t {
+    /**
+     * @brief Pointer to the indexed stream
+     */
+    const uint8_t *stream;
+
+    /**
+     * @brief The number of bytes in the stream
+     */
+    size_t length;
+
+    /**
+     * @brief Pointer to the caller-provided checkpoints
+     */
+    midi_index_checkpoint_t *checkpoints;
+
+    /**
+     * @brief The number of checkpoints in use
+     */
+    size_t count;
+
+    /**
+     * @brief The number of messages between checkpoints, or 0
+     */
+    uint32_t message_interval;
+
+    /**
+     * @brief The number of clock ticks between checkpoints, or 0
+     */
+    uint32_t tick_interval;
+} midi_index_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Build the index of a stream
+ * @details Parses the stream once and saves a checkpoint at its start
+ *          and then whenever message_interval messages or tick_interval
+ *          clock ticks have passed since the last checkpoint. When the
+ *          array fills up, every other checkpoint is dropped and both
+ *          intervals are doubled, so that the checkpoints stay spread
+ *          over the whole stream.
+ * @param [out] index Pointer to a midi_index_t struct to initialize
+ * @param [in] stream Pointer to the stream. Must stay valid for as long
+ *      as the index is used.
+ * @param [in] length The number of bytes in the stream, at most
+ *      UINT32_MAX
+ * @param [out] checkpoints Pointer to an array that receives the
+ *      checkpoints
+ * @param [in] capacity The number of checkpoints in the array, at least 2
+ * @param [in] message_interval The number of messages between
+ *      checkpoints, or 0 to only count ticks
+ * @param [in] tick_interval The number of clock ticks between
+ *      checkpoints, or 0 to only count messages
+ * @return The number of checkpoints, or 0 if an argument is invalid
+ */
+size_t midi_index_build(midi_index_t *index,
+                        const uint8_t *stream,
+                        size_t length,
+                        midi_index_checkpoint_t *checkpoints,
+                        size_t capacity,
+                        uint32_t message_interval,
+                        uint32_t tick_interval);
+
+/**
+ * @brief Seek to a byte offset
+ * @details Restores the last checkpoint at or before the offset and
+ *          parses the bytes up to it. The parser is left in exactly the
+ *          state it would have after parsing the stream from its start.
+ * @param [in] index Pointer to a midi_index_t struct
+ * @param [in] offset The offset to seek to
+ * @param [in,out] parser Pointer to the parser whose state is set. Its
+ *      filters and handlers are kept, and its handlers are not called.
+ * @return The offset to continue parsing from, which is the requested
+ *      offset clamped to the length of the stream
+ */
+size_t midi_index_seek_offset(const midi_index_t *index,
+                              size_t offset,
+                              midi_parser_t *parser);
+
+/**
+ * @brief Seek to a clock tick
+ * @details Restores the last checkpoint before the tick and parses up to
+ *          and including the tick-th Timing Clock message, so that the
+ *          next byte parsed is the first one of the tick.
+ * @param [in] index Pointer to a midi_index_t struct
+ * @param [in] tick The tick to seek to. Tick 0 is the start of the stream.
+ * @param [in,out] parser Pointer to the parser whose state is set. Its
+ *      filters and handlers are kept, and its handlers are not called.
+ * @return The offset to continue parsing from, or the length of the
+ *      stream if it has fewer clocks
+ */
+size_t midi_index_seek_tick(const midi_index_t *index,
+                            uint32_t tick,
+                            midi_parser_t *parser);
+
+/**
+ * @brief Serialize an index
+ * @details Writes a little-endian header (magic "MIDX", version, stream
+ *          length, intervals and count) followed by the checkpoints
+ * @param [in] index Pointer to a midi_index_t struct
+ * @param [out] buffer Pointer to the buffer that receives the bytes
+ * @param [in] capacity The number of bytes available in the buffer
+ * @return The number of bytes written, MIDI_INDEX_SERIALIZED_SIZE of the
+ *      checkpoint count, or 0 if the index does not fit
+ */
+size_t midi_index_serialize(const midi_index_t *index,
+                            uint8_t *buffer,
+                            size_t capacity);
+
+/**
+ * @brief Load a serialized index
+ * @details Validates the header and every checkpoint, down to the
+ *          message type, data bytes and SysEx flags of its parser state,
+ *          so that a corrupt or stale cache file is rejected rather than
+ *          trusted
+ * @param [out] index Pointer to a midi_index_t struct to initialize
+ * @param [in] stream Pointer to the stream the index was built from
+ * @param [in] length The number of bytes in the stream. Must match the
+ *      length the index was built for.
+ * @param [in] data Pointer to the serialized index
+ * @param [in] size The number of bytes of serialized index
+ * @param [out] checkpoints Pointer to an array that receives the
+ *      checkpoints
+ * @param [in] capacity The number of checkpoints in the array
+ * @return The number of checkpoints, or 0 if the data is invalid, was
+ *      built for a stream of another length or does not fit
+ */
+size_t midi_index_deserialize(midi_index_t *index,
+                              const uint8_t *stream,
+                              size_t length,
+                              const uint8_t *data,
+                              size_t size,
+                              midi_index_checkpoint_t *checkpoints,
+                              size_t capacity);
+
+#endif /* MIDI_INDEX_H */
@@ -0,0 +1,683 @@
+/***********************************************************************
+ * @file midi_io.c
+ * @brief MIDI asynchronous input implementation for Linux
+ *
+ * @details The io_uring backend uses the system calls directly, with the
+ *          submission and completion queues mapped from the kernel. Every
+ *          port has one request in flight, a read or, when the read would
+ *          block, a poll for input, so the queues never fill. Requests
+ *          completed while a worker is busy are reaped without a system
+ *          call, and the requests queued meanwhile are submitted by the
+ *          same io_uring_enter call that waits for the next completions.
+ *
+ *          Each worker has an eventfd with a request in flight on it, so
+ *          that midi_io_stop can wake it. The kernel cancels the requests
+ *          of a thread when it exits, so canceled requests are submitted
+ *          again, by the next thread to run the worker.
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_io.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+#include "midi_ring.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Request data of the eventfd of a worker
+ */
+#define IO_EVENT_DATA (UINT64_MAX)
+
+/**
+ * @brief Request kinds, above the port index in the request data
+ */
+#define IO_REQUEST_READ (0)
+#define IO_REQUEST_POLL (1)
+#define IO_REQUEST_SHIFT (32)
+
+/**
+ * @brief Number of epoll events handled per wait
+ */
+#define IO_EPOLL_EVENTS (64)
+
+/**
+ * @brief File offset of a read at the current position
+ */
+#define IO_CURRENT_POSITION (UINT64_MAX)
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static int setup_uring(midi_io_t *io, midi_io_worker_t *worker);
+
+static void teardown_uring(midi_io_worker_t *worker);
+
+static int setup_epoll(midi_io_worker_t *worker);
+
+static void queue_request(midi_io_worker_t *worker,
+                          uint8_t opcode,
+                          int fd,
+                          void *buffer,
+                          size_t length,
+                          uint64_t data);
+
+static void queue_read(midi_io_t *io, size_t port);
+
+static size_t receive(midi_io_port_t *port, size_t length);
+
+static void close_port(midi_io_t *io,
+                       midi_io_worker_t *worker,
+                       midi_io_port_t *port,
+                       int error);
+
+static size_t
+complete(midi_io_t *io, midi_io_worker_t *worker, uint64_t data, int res);
+
+static size_t poll_uring(midi_io_t *io, midi_io_worker_t *worker, int wait);
+
+static size_t poll_epoll(midi_io_t *io, midi_io_worker_t *worker, int wait);
+
+static void *run_worker(void *argument);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize an asynchronous input
+ * @param [out] io Pointer to a midi_io_t struct
+ * @param [in] backend The backend to use
+ * @param [in] workers The number of workers
+ * @param [in] ports Pointer to an array of capacity midi_io_port_t structs
+ * @param [in] capacity The number of entries in the ports array
+ * @param [in] buffers Pointer to capacity * buffer_size bytes
+ * @param [in] buffer_size The size of the read buffer of each port
+ * @return 1 if the input was initialized, 0 otherwise
+ */
+int midi_io_init(midi_io_t *io,
+                 midi_io_backend_t backend,
+                 size_t workers,
+                 midi_io_port_t *ports,
+                 size_t capacity,
+                 uint8_t *buffers,
+                 size_t buffer_size)
+{
+    /* Check for NULL pointers */
+    if (io == NULL) { return 0; }
+
+    memset(io, 0, sizeof(*io));
+    for (size_t w = 0; w < MIDI_IO_MAX_WORKERS; w++) {
+        io->workers[w].fd = -1;
+        io->workers[w].event_fd = -1;
+        io->workers[w].io = io;
+        io->workers[w].index = w;
+    }
+    atomic_init(&io->stop, 0);
+
+    if (ports == NULL || buffers == NULL || workers == 0
+        || workers > MIDI_IO_MAX_WORKERS || capacity == 0
+        || capacity > workers * MIDI_IO_MAX_WORKER_PORTS
+        || buffer_size == 0 || buffer_size > UINT32_MAX) {
+        return 0;
+    }
+
+    io->worker_count = workers;
+    io->ports = ports;
+    io->capacity = capacity;
+    io->buffers = buffers;
+    io->buffer_size = buffer_size;
+
+    for (size_t w = 0; w < workers; w++) {
+        io->workers[w].event_fd = eventfd(0, EFD_CLOEXEC);
+        if (io->workers[w].event_fd < 0) { return 0; }
+    }
+
+    if (backend != MIDI_IO_BACKEND_EPOLL) {
+        int ready = 1;
+        for (size_t w = 0; w < workers && ready; w++) {
+            ready = setup_uring(io, &io->workers[w]);
+        }
+        if (ready) {
+            io->backend = MIDI_IO_BACKEND_IO_URING;
+            return 1;
+        }
+        for (size_t w = 0; w < workers; w++) {
+            teardown_uring(&io->workers[w]);
+        }
+        if (backend == MIDI_IO_BACKEND_IO_URING) { return 0; }
+    }
+
+    for (size_t w = 0; w < workers; w++) {
+        if (!setup_epoll(&io->workers[w])) { return 0; }
+    }
+    io->backend = MIDI_IO_BACKEND_EPOLL;
+    return 1;
+}
+
+/**
+ * @brief Release an asynchronous input
+ * @param [in,out] io Pointer to a midi_io_t struct
+ */
+void midi_io_deinit(midi_io_t *io)
+{
+    /* Check for NULL pointers */
+    if (io == NULL) { return; }
+
+    midi_io_stop(io);
+    for (size_t w = 0; w < MIDI_IO_MAX_WORKERS; w++) {
+        midi_io_worker_t *worker = &io->workers[w];
+        teardown_uring(worker);
+        if (worker->event_fd >= 0) { close(worker->event_fd); }
+        worker->event_fd = -1;
+    }
+    io->worker_count = 0;
+    io->count = 0;
+}
+
+/**
+ * @brief Get the backend of an asynchronous input
+ * @param [in] io Pointer to an initialized midi_io_t struct
+ * @return The backend in use
+ */
+midi_io_backend_t midi_io_get_backend(const midi_io_t *io)
+{
+    /* Check for NULL pointers */
+    if (io == NULL) { return MIDI_IO_BACKEND_AUTO; }
+
+    return io->backend;
+}
+
+/**
+ * @brief Add a port
+ * @param [in,out] io Pointer to a midi_io_t struct
+ * @param [in] fd The file descriptor to read
+ * @param [in] config Pointer to the parser of the port, or NULL
+ * @param [in] ring Pointer to the ring that receives the messages
+ * @return The index of the port, or MIDI_IO_INVALID_PORT
+ */
+size_t midi_io_add_port(midi_io_t *io,
+                        int fd,
+                        const midi_parser_t *config,
+                        midi_ring_t *ring)
+{
+    /* Check for NULL pointers */
+    if (io == NULL || ring == NULL || fd < 0 || io->worker_count == 0
+        || io->count >= io->capacity) {
+        return MIDI_IO_INVALID_PORT;
+    }
+
+    const size_t index = io->count;
+    midi_io_port_t *port = &io->ports[index];
+    midi_io_worker_t *worker = &io->workers[index % io->worker_count];
+
+    if (config != NULL) {
+        port->parser = *config;
+        midi_parser_reset(&port->parser);
+    } else {
+        midi_parser_init(&port->parser);
+    }
+    port->ring = ring;
+    port->buffer = &io->buffers[index * io->buffer_size];
+    port->fd = fd;
+    port->error = 0;
+    port->bytes = 0;
+    port->reads = 0;
+
+    if (io->backend == MIDI_IO_BACKEND_EPOLL) {
+        struct epoll_event event = {.events = EPOLLIN, .data.u64 = index};
+        if (epoll_ctl(worker->fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            return MIDI_IO_INVALID_PORT;
+        }
+    }
+
+    atomic_init(&port->open, 1);
+    io->count++;
+    if (io->backend == MIDI_IO_BACKEND_IO_URING) { queue_read(io, index); }
+    return index;
+}
+
+/**
+ * @brief Run a worker once
+ * @param [in,out] io Pointer to a midi_io_t struct
+ * @param [in] worker The index of the worker
+ * @param [in] wait Non-zero to wait until a read completes
+ * @return The number of messages pushed into the rings
+ */
+size_t midi_io_poll(midi_io_t *io, size_t worker, int wait)
+{
+    /* Check for NULL pointers */
+    if (io == NULL || worker >= io->worker_count) { return 0; }
+
+    if (io->backend == MIDI_IO_BACKEND_IO_URING) {
+        return poll_uring(io, &io->workers[worker], wait);
+    }
+    return poll_epoll(io, &io->workers[worker], wait);
+}
+
+/**
+ * @brief Run every worker on its own thread
+ * @param [in,out] io Pointer to a midi_io_t struct
+ * @return 1 if the threads were started, 0 otherwise
+ */
+int midi_io_start(midi_io_t *io)
+{
+    /* Check for NULL pointers */
+    if (io == NULL || io->worker_count == 0) { return 0; }
+
+    atomic_store(&io->stop, 0);
+    for (size_t w = 0; w < io->worker_count; w++) {
+        midi_io_worker_t *worker = &io->workers[w];
+        if (worker->started) { continue; }
+        if (pthread_create(&worker->thread, NULL, run_worker, worker) != 0) {
+            midi_io_stop(io);
+            return 0;
+        }
+        worker->started = 1;
+    }
+    return 1;
+}
+
+/**
+ * @brief Stop the threads started by midi_io_start
+ * @param [in,out] io Pointer to a midi_io_t struct
+ */
+void midi_io_stop(midi_io_t *io)
+{
+    /* Check for NULL pointers */
+    if (io == NULL) { return; }
+
+    atomic_store(&io->stop, 1);
+    for (size_t w = 0; w < io->worker_count; w++) {
+        midi_io_worker_t *worker = &io->workers[w];
+        if (!worker->started) { continue; }
+
+        const uint64_t one = 1;
+        ssize_t written;
+        do {
+            written = write(worker->event_fd, &one, sizeof(one));
+        } while (written < 0 && errno == EINTR);
+        pthread_join(worker->thread, NULL);
+        worker->started = 0;
+    }
+    atomic_store(&io->stop, 0);
+}
+
+/**
+ * @brief Check whether a port is still read
+ * @param [in] io Pointer to a midi_io_t struct
+ * @param [in] port The index of the port
+ * @return Non-zero if the port is open
+ */
+int midi_io_port_is_open(const midi_io_t *io, size_t port)
+{
+    /* Check for NULL pointers */
+    if (io == NULL || port >= io->count) { return 0; }
+
+    return atomic_load(&io->ports[port].open);
+}
+
+/**
+ * @brief Get the number of system calls of a worker
+ * @param [in] io Pointer to a midi_io_t struct
+ * @param [in] worker The index of the worker
+ * @return The number of system calls made by midi_io_poll
+ */
+size_t midi_io_get_syscall_count(const midi_io_t *io, size_t worker)
+{
+    /* Check for NULL pointers */
+    if (io == NULL || worker >= io->worker_count) { return 0; }
+
+    return io->workers[worker].syscalls;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Create and map the io_uring of a worker, register the buffers
+ *        and queue the read of its eventfd
+ * @return 1 on success, 0 if io_uring is not available
+ */
+static int setup_uring(midi_io_t *io, midi_io_worker_t *worker)
+{
+    /* One request per port of the worker, and one for the eventfd */
+    const size_t requests =
+        (io->capacity + io->worker_count - 1) / io->worker_count + 1;
+    uint32_t entries = 1;
+    while (entries < requests) { entries <<= 1; }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    const long fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) { return 0; }
+    worker->fd = (int)fd;
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) { return 0; }
+
+    worker->sq_map_size =
+        params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    worker->cq_map_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (worker->cq_map_size > worker->sq_map_size) {
+            worker->sq_map_size = worker->cq_map_size;
+        }
+        worker->cq_map_size = 0;
+    }
+
+    void *sq = mmap(NULL, worker->sq_map_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, worker->fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) { return 0; }
+    worker->sq_map = sq;
+
+    void *cq = sq;
+    if (worker->cq_map_size != 0) {
+        cq = mmap(NULL, worker->cq_map_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, worker->fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) { return 0; }
+        worker->cq_map = cq;
+    }
+
+    worker->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, worker->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, worker->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) { return 0; }
+    worker->sqes = sqes;
+
+    uint8_t *const sq_bytes = sq;
+    uint8_t *const cq_bytes = cq;
+    worker->sq_head = (uint32_t *)(void *)(sq_bytes + params.sq_off.head);
+    worker->sq_tail = (uint32_t *)(void *)(sq_bytes + params.sq_off.tail);
+    worker->sq_mask =
+        (uint32_t *)(void *)(sq_bytes + params.sq_off.ring_mask);
+    worker->sq_array = (uint32_t *)(void *)(sq_bytes + params.sq_off.array);
+    worker->cq_head = (uint32_t *)(void *)(cq_bytes + params.cq_off.head);
+    worker->cq_tail = (uint32_t *)(void *)(cq_bytes + params.cq_off.tail);
+    worker->cq_mask =
+        (uint32_t *)(void *)(cq_bytes + params.cq_off.ring_mask);
+    worker->cqes = cq_bytes + params.cq_off.cqes;
+
+    /* Registering the buffers saves mapping them on every read */
+    const struct iovec buffers = {
+        .iov_base = io->buffers,
+        .iov_len = io->capacity * io->buffer_size,
+    };
+    worker->fixed = syscall(__NR_io_uring_register, worker->fd,
+                            IORING_REGISTER_BUFFERS, &buffers, 1)
+                    == 0;
+
+    queue_request(worker, IORING_OP_READ, worker->event_fd,
+                  &worker->event_value, sizeof(worker->event_value),
+                  IO_EVENT_DATA);
+    return 1;
+}
+
+/**
+ * @brief Unmap the io_uring of a worker, if it has one, and close its
+ *        file descriptor
+ */
+static void teardown_uring(midi_io_worker_t *worker)
+{
+    if (worker->sqes != NULL) { munmap(worker->sqes, worker->sqes_size); }
+    if (worker->cq_map != NULL) {
+        munmap(worker->cq_map, worker->cq_map_size);
+    }
+    if (worker->sq_map != NULL) {
+        munmap(worker->sq_map, worker->sq_map_size);
+    }
+    worker->sqes = NULL;
+    worker->cq_map = NULL;
+    worker->sq_map = NULL;
+    worker->sq_head = NULL;
+    worker->fixed = 0;
+    if (worker->fd >= 0) { close(worker->fd); }
+    worker->fd = -1;
+}
+
+/**
+ * @brief Create the epoll instance of a worker and add its eventfd
+ * @return 1 on success, 0 otherwise
+ */
+static int setup_epoll(midi_io_worker_t *worker)
+{
+    worker->fd = epoll_create1(EPOLL_CLOEXEC);
+    if (worker->fd < 0) { return 0; }
+
+    struct epoll_event event = {.events = EPOLLIN, .data.u64 = IO_EVENT_DATA};
+    return epoll_ctl(worker->fd, EPOLL_CTL_ADD, worker->event_fd, &event)
+           == 0;
+}
+
+/**
+ * @brief Write a request at the tail of the submission queue
+ * @details Submitted by the next io_uring_enter call. For a poll, the
+ *          buffer is ignored and the length is the poll mask.
+ */
+static void queue_request(midi_io_worker_t *worker,
+                          uint8_t opcode,
+                          int fd,
+                          void *buffer,
+                          size_t length,
+                          uint64_t data)
+{
+    struct io_uring_sqe *sqes = worker->sqes;
+    const uint32_t tail = *worker->sq_tail;
+    const uint32_t index = tail & *worker->sq_mask;
+    struct io_uring_sqe *sqe = &sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = data;
+    if (opcode == IORING_OP_POLL_ADD) {
+        sqe->poll32_events = (uint32_t)length;
+    } else {
+        sqe->off = IO_CURRENT_POSITION;
+        sqe->addr = (uint64_t)(uintptr_t)buffer;
+        sqe->len = (uint32_t)length;
+    }
+    worker->sq_array[index] = index;
+
+    /* Publish the request after writing it */
+    atomic_store_explicit((_Atomic uint32_t *)worker->sq_tail, tail + 1,
+                          memory_order_release);
+}
+
+/**
+ * @brief Queue the read of a port
+ */
+static void queue_read(midi_io_t *io, size_t port)
+{
+    midi_io_worker_t *worker = &io->workers[port % io->worker_count];
+    midi_io_port_t *p = &io->ports[port];
+
+    queue_request(worker,
+                  worker->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ,
+                  p->fd, p->buffer, io->buffer_size,
+                  ((uint64_t)IO_REQUEST_READ << IO_REQUEST_SHIFT) | port);
+}
+
+/**
+ * @brief Parse the bytes read by a port into its ring
+ * @return The number of messages pushed
+ */
+static size_t receive(midi_io_port_t *port, size_t length)
+{
+    port->bytes += length;
+    port->reads++;
+    return midi_ring_parse(port->ring, &port->parser, port->buffer, length);
+}
+
+/**
+ * @brief Stop reading a port
+ */
+static void close_port(midi_io_t *io,
+                       midi_io_worker_t *worker,
+                       midi_io_port_t *port,
+                       int error)
+{
+    port->error = error;
+    atomic_store(&port->open, 0);
+    if (io->backend == MIDI_IO_BACKEND_EPOLL) {
+        epoll_ctl(worker->fd, EPOLL_CTL_DEL, port->fd, NULL);
+    }
+}
+
+/**
+ * @brief Handle a completed io_uring request and queue the next one
+ * @return The number of messages pushed
+ */
+static size_t
+complete(midi_io_t *io, midi_io_worker_t *worker, uint64_t data, int res)
+{
+    if (data == IO_EVENT_DATA) {
+        queue_request(worker, IORING_OP_READ, worker->event_fd,
+                      &worker->event_value, sizeof(worker->event_value),
+                      IO_EVENT_DATA);
+        return 0;
+    }
+
+    const size_t index = (size_t)(data & UINT32_MAX);
+    midi_io_port_t *port = &io->ports[index];
+    size_t pushed = 0;
+
+    if ((data >> IO_REQUEST_SHIFT) == IO_REQUEST_POLL) {
+        if (res < 0 && res != -EINTR && res != -ECANCELED) {
+            close_port(io, worker, port, -res);
+            return 0;
+        }
+    } else if (res > 0) {
+        pushed = receive(port, (size_t)res);
+    } else if (res == 0) {
+        close_port(io, worker, port, 0);
+        return 0;
+    } else if (res == -EAGAIN) {
+        /* Non-blocking file: wait for input before reading again */
+        queue_request(worker, IORING_OP_POLL_ADD, port->fd, NULL, POLLIN,
+                      ((uint64_t)IO_REQUEST_POLL << IO_REQUEST_SHIFT)
+                          | index);
+        return 0;
+    } else if (res != -EINTR && res != -ECANCELED) {
+        close_port(io, worker, port, -res);
+        return 0;
+    }
+
+    queue_read(io, index);
+    return pushed;
+}
+
+/**
+ * @brief Run an io_uring worker once
+ * @return The number of messages pushed
+ */
+static size_t poll_uring(midi_io_t *io, midi_io_worker_t *worker, int wait)
+{
+    const uint32_t queued =
+        *worker->sq_tail
+        - atomic_load_explicit((_Atomic uint32_t *)worker->sq_head,
+                               memory_order_acquire);
+
+    if (queued != 0 || wait) {
+        worker->syscalls++;
+        syscall(__NR_io_uring_enter, worker->fd, queued, wait ? 1 : 0,
+                wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    }
+
+    const struct io_uring_cqe *cqes = worker->cqes;
+    const uint32_t mask = *worker->cq_mask;
+    uint32_t head = *worker->cq_head;
+    const uint32_t tail = atomic_load_explicit(
+        (_Atomic uint32_t *)worker->cq_tail, memory_order_acquire);
+    size_t pushed = 0;
+
+    while (head != tail) {
+        const struct io_uring_cqe *cqe = &cqes[head & mask];
+        pushed += complete(io, worker, cqe->user_data, cqe->res);
+        head++;
+    }
+
+    /* Hand the entries back to the kernel once they are read */
+    atomic_store_explicit((_Atomic uint32_t *)worker->cq_head, head,
+                          memory_order_release);
+    return pushed;
+}
+
+/**
+ * @brief Run an epoll worker once
+ * @return The number of messages pushed
+ */
+static size_t poll_epoll(midi_io_t *io, midi_io_worker_t *worker, int wait)
+{
+    struct epoll_event events[IO_EPOLL_EVENTS];
+    size_t pushed = 0;
+
+    worker->syscalls++;
+    const int count =
+        epoll_wait(worker->fd, events, IO_EPOLL_EVENTS, wait ? -1 : 0);
+
+    for (int e = 0; e < count; e++) {
+        if (events[e].data.u64 == IO_EVENT_DATA) {
+            /* Clear the eventfd, which stays ready until it is read */
+            worker->syscalls++;
+            const ssize_t cleared = read(worker->event_fd,
+                                         &worker->event_value,
+                                         sizeof(worker->event_value));
+            (void)cleared;
+            continue;
+        }
+
+        midi_io_port_t *port = &io->ports[events[e].data.u64];
+        worker->syscalls++;
+        const ssize_t length = read(port->fd, port->buffer, io->buffer_size);
+        if (length > 0) {
+            pushed += receive(port, (size_t)length);
+        } else if (length == 0) {
+            close_port(io, worker, port, 0);
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK
+                   && errno != EINTR) {
+            close_port(io, worker, port, errno);
+        }
+    }
+
+    return pushed;
+}
+
+/**
+ * @brief Thread of a worker
+ */
+static void *run_worker(void *argument)
+{
+    midi_io_worker_t *worker = argument;
+
+    while (!atomic_load(&worker->io->stop)) {
+        midi_io_poll(worker->io, worker->index, 1);
+    }
+    return NULL;
+}
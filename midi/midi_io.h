@@ -0,0 +1,351 @@
+/**********************************************************************
+ * @file midi_io.h
+ * @brief MIDI asynchronous input module for Linux
+ *
+ * @details This module reads raw MIDI from many file descriptors, such
+ *          as ALSA rawmidi devices, serial ports and pipes, on a few
+ *          worker threads. Each read is parsed straight into the MIDI
+ *          message ring of its port with midi_ring_parse, by the parser
+ *          of the port, so the application only pops messages.
+ *
+ *          Each port has a read in flight at all times on an io_uring
+ *          instance of its worker, into its own part of the buffers
+ *          given at initialization, which are registered with the kernel
+ *          when it allows. A worker submits the reads it queued and
+ *          reaps every completed read with one system call, however
+ *          many ports there are. Where io_uring is not available, or on
+ *          request, an epoll instance per worker is used instead, with
+ *          one read per ready port.
+ *
+ *          The worker functions hold no threading code, so a worker can
+ *          be run on any thread with midi_io_poll. midi_io_start runs
+ *          every worker on its own POSIX thread. Nothing is allocated:
+ *          the ports and buffers come from the caller, and the io_uring
+ *          queues are mapped from the kernel at initialization.
+ *
+ *          The thread of a worker is the producer of the rings of its
+ *          ports, and runs the handlers of their parsers. Several ports
+ *          may share a ring if they belong to the same worker.
+ *
+ * @see io_uring(7), epoll(7)
+ **********************************************************************/
+
+#ifndef MIDI_IO_H
+#define MIDI_IO_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+#include "midi_ring.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Maximum number of workers
+ */
+#define MIDI_IO_MAX_WORKERS (16)
+
+/**
+ * @brief Maximum number of ports per worker
+ */
+#define MIDI_IO_MAX_WORKER_PORTS (16384)
+
+/**
+ * @brief Port index returned when a port cannot be added
+ */
+#define MIDI_IO_INVALID_PORT (SIZE_MAX)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief I/O Backend
+ */
+typedef enum midi_io_backend_t {
+    /**
+     * @brief io_uring if the kernel supports it, epoll otherwise
+     */
+    MIDI_IO_BACKEND_AUTO,
+
+    /**
+     * @brief io_uring, available from Linux 5.6
+     */
+    MIDI_IO_BACKEND_IO_URING,
+
+    /**
+     * @brief epoll
+     */
+    MIDI_IO_BACKEND_EPOLL,
+} midi_io_backend_t;
+
+/**
+ * @brief Input Port
+ * @note The fields of this struct should not be accessed directly while
+ *       the workers run. Use the `midi_io_*` functions.
+ */
+typedef struct midi_io_port_t {
+    /**
+     * @brief The parser of the port
+     */
+    midi_parser_t parser;
+
+    /**
+     * @brief The ring that receives the messages of the port
+     */
+    midi_ring_t *ring;
+
+    /**
+     * @brief The read buffer of the port
+     */
+    uint8_t *buffer;
+
+    /**
+     * @brief The file descriptor of the port
+     */
+    int fd;
+
+    /**
+     * @brief Non-zero until the end of the file, or a read error
+     */
+    atomic_int open;
+
+    /**
+     * @brief The error number of the read that closed the port, or 0
+     */
+    int error;
+
+    /**
+     * @brief The number of bytes and of reads received
+     */
+    size_t bytes;
+    size_t reads;
+} midi_io_port_t;
+
+/**
+ * @brief I/O Worker
+ * @note The fields of this struct should not be accessed directly.
+ */
+typedef struct midi_io_worker_t {
+    /**
+     * @brief The io_uring or epoll file descriptor
+     */
+    int fd;
+
+    /**
+     * @brief The eventfd that wakes the worker, and its read buffer
+     */
+    int event_fd;
+    uint64_t event_value;
+
+    /**
+     * @brief The io_uring queue indices, in the mapped rings
+     */
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+
+    /**
+     * @brief The io_uring submission and completion queue entries
+     */
+    void *sqes;
+    void *cqes;
+
+    /**
+     * @brief The io_uring mappings
+     */
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    size_t sqes_size;
+
+    /**
+     * @brief Non-zero if the buffers are registered with the io_uring
+     */
+    int fixed;
+
+    /**
+     * @brief The number of system calls made by midi_io_poll
+     */
+    size_t syscalls;
+
+    /**
+     * @brief The thread running the worker
+     */
+    pthread_t thread;
+    int started;
+
+    /**
+     * @brief The input the worker belongs to, for its thread
+     */
+    struct midi_io_t *io;
+    size_t index;
+} midi_io_worker_t;
+
+/**
+ * @brief MIDI Asynchronous Input
+ * @note The fields of this struct should not be accessed directly.
+ *       Use the `midi_io_*` functions.
+ */
+typedef struct midi_io_t {
+    /**
+     * @brief The workers
+     */
+    midi_io_worker_t workers[MIDI_IO_MAX_WORKERS];
+
+    /**
+     * @brief The number of workers
+     */
+    size_t worker_count;
+
+    /**
+     * @brief The backend in use
+     */
+    midi_io_backend_t backend;
+
+    /**
+     * @brief The ports, with room for capacity ports
+     */
+    midi_io_port_t *ports;
+    size_t capacity;
+    size_t count;
+
+    /**
+     * @brief The read buffers, buffer_size bytes per port
+     */
+    uint8_t *buffers;
+    size_t buffer_size;
+
+    /**
+     * @brief Set to stop the threads
+     */
+    atomic_int stop;
+} midi_io_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize an asynchronous input
+ * @details Creates the io_uring or epoll instance of each worker.
+ *          Ports are then added with midi_io_add_port.
+ * @param [out] io Pointer to a midi_io_t struct
+ * @param [in] backend The backend to use
+ * @param [in] workers The number of workers, from 1 to
+ *      MIDI_IO_MAX_WORKERS
+ * @param [in] ports Pointer to an array of capacity midi_io_port_t
+ *      structs. Must stay valid for as long as the input is used.
+ * @param [in] capacity The number of entries in the ports array, at most
+ *      MIDI_IO_MAX_WORKER_PORTS per worker
+ * @param [in] buffers Pointer to capacity * buffer_size bytes. Must stay
+ *      valid for as long as the input is used.
+ * @param [in] buffer_size The size of the read buffer of each port
+ * @return 1 if the input was initialized, 0 if an argument is invalid or
+ *      the backend is not available. Call midi_io_deinit either way.
+ */
+int midi_io_init(midi_io_t *io,
+                 midi_io_backend_t backend,
+                 size_t workers,
+                 midi_io_port_t *ports,
+                 size_t capacity,
+                 uint8_t *buffers,
+                 size_t buffer_size);
+
+/**
+ * @brief Release an asynchronous input
+ * @details Stops the threads and closes the io_uring or epoll instances.
+ *          The file descriptors of the ports are left open.
+ * @param [in,out] io Pointer to a midi_io_t struct
+ */
+void midi_io_deinit(midi_io_t *io);
+
+/**
+ * @brief Get the backend of an asynchronous input
+ * @param [in] io Pointer to an initialized midi_io_t struct
+ * @return MIDI_IO_BACKEND_IO_URING or MIDI_IO_BACKEND_EPOLL
+ */
+midi_io_backend_t midi_io_get_backend(const midi_io_t *io);
+
+/**
+ * @brief Add a port
+ * @details Port n is read by worker n modulo the number of workers. The
+ *          first read is submitted by the next poll of the worker.
+ * @param [in,out] io Pointer to a midi_io_t struct
+ * @param [in] fd The file descriptor to read. It must stay open until
+ *      the port is closed or the input is released.
+ * @param [in] config Pointer to the parser whose filters and handlers
+ *      the port uses, or NULL for the defaults of midi_parser_init. The
+ *      handlers run on the thread of the worker.
+ * @param [in] ring Pointer to the ring that receives the messages
+ * @return The index of the port, or MIDI_IO_INVALID_PORT if the ports
+ *      are full or an argument is invalid
+ * @note Must not be called while the threads run
+ */
+size_t midi_io_add_port(midi_io_t *io,
+                        int fd,
+                        const midi_parser_t *config,
+                        midi_ring_t *ring);
+
+/**
+ * @brief Run a worker once
+ * @details Submits the queued reads, waits for completions if asked,
+ *          and parses every completed read into the ring of its port.
+ *          Ports whose read reaches the end of the file or fails are
+ *          closed.
+ * @param [in,out] io Pointer to a midi_io_t struct
+ * @param [in] worker The index of the worker
+ * @param [in] wait Non-zero to wait until a read completes, or the
+ *      worker is woken by midi_io_stop
+ * @return The number of messages pushed into the rings
+ * @note Each worker must only be run by one thread at a time
+ */
+size_t midi_io_poll(midi_io_t *io, size_t worker, int wait);
+
+/**
+ * @brief Run every worker on its own thread
+ * @param [in,out] io Pointer to a midi_io_t struct
+ * @return 1 if the threads were started, 0 if a thread could not be
+ *      started, in which case none runs
+ */
+int midi_io_start(midi_io_t *io);
+
+/**
+ * @brief Stop the threads started by midi_io_start
+ * @details Wakes every worker and waits for its thread to return. The
+ *      reads in flight stay queued, so the threads may be started again.
+ * @param [in,out] io Pointer to a midi_io_t struct
+ */
+void midi_io_stop(midi_io_t *io);
+
+/**
+ * @brief Check whether a port is still read
+ * @param [in] io Pointer to a midi_io_t struct
+ * @param [in] port The index of the port
+ * @return Non-zero until the port reaches the end of its file or a read
+ *      fails, 0 for invalid ports
+ */
+int midi_io_port_is_open(const midi_io_t *io, size_t port);
+
+/**
+ * @brief Get the number of system calls of a worker
+ * @param [in] io Pointer to a midi_io_t struct
+ * @param [in] worker The index of the worker
+ * @return The number of system calls midi_io_poll made for the worker
+ */
+size_t midi_io_get_syscall_count(const midi_io_t *io, size_t worker);
+
+#endif /* MIDI_IO_H */
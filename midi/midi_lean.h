@@ -0,0 +1,136 @@
+/**********************************************************************
+ * @file midi_lean.h
+ * @brief Header-only lean MIDI parser
+ *
+ * @details A minimal parser for constrained targets that only need the
+ *          channel messages, for example notes and controllers read from
+ *          a UART interrupt. It is entirely static inline, so that it
+ *          compiles into the caller with no call overhead per byte, and
+ *          its state is three bytes.
+ *
+ *          The parser returns the same packed messages as midi_parse_byte
+ *          of a parser built without System Exclusive, MIDI Time Code and
+ *          song messages (MIDI_CONFIG_SYSEX, MIDI_CONFIG_MTC and
+ *          MIDI_CONFIG_SONG set to 0), with no filters. Channel Mode
+ *          messages follow MIDI_CONFIG_CHANNEL_MODE. Filtering is left to
+ *          the caller, which can compare the fields of the packed message
+ *          directly.
+ **********************************************************************/
+
+#ifndef MIDI_LEAN_H
+#define MIDI_LEAN_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stdint.h>
+
+#include "midi.h"
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Lean MIDI Parser
+ * @note The fields of this struct should not be accessed directly.
+ *       Use the `midi_lean_*` functions.
+ */
+typedef struct midi_lean_parser_t {
+    /**
+     * @brief The channel status byte of the running status, or 0
+     */
+    uint8_t status;
+
+    /**
+     * @brief The first data byte of a two data byte message
+     */
+    uint8_t data;
+
+    /**
+     * @brief Non-zero while the second data byte is awaited
+     */
+    uint8_t pending;
+} midi_lean_parser_t;
+
+/*=====================================================================*
+    Public Inline Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a lean MIDI parser
+ * @param [out] parser Pointer to a midi_lean_parser_t struct
+ */
+static inline void midi_lean_parser_init(midi_lean_parser_t *parser)
+{
+    parser->status = 0;
+    parser->data = 0;
+    parser->pending = 0;
+}
+
+/**
+ * @brief Parse a MIDI byte with a lean parser
+ * @details Channel Voice and Channel Mode messages, Tune Request and the
+ *          System Real-Time messages are returned. Other status bytes
+ *          clear running status and their data bytes are skipped, except
+ *          for the undefined status bytes 0xF4 and 0xF5, which are
+ *          ignored.
+ * @param [in,out] parser Pointer to a midi_lean_parser_t struct.
+ *      Not checked for NULL.
+ * @param [in] byte The byte to parse
+ * @return The packed message completed by the byte, or 0
+ *      (MIDI_MESSAGE_NONE) if the byte completes no message
+ */
+static inline midi_packed_t midi_lean_parse_byte(midi_lean_parser_t *parser,
+                                                 uint8_t byte)
+{
+    /* Data byte of the running status */
+    if (byte < 0x80) {
+        const uint8_t status = parser->status;
+        if (status == 0) { return 0; }
+
+        /* Program Change and Channel Pressure have one data byte */
+        if (!parser->pending && (status & 0xE0) != 0xC0) {
+            parser->data = byte;
+            parser->pending = 1;
+            return 0;
+        }
+
+        const uint8_t data0 = parser->pending ? parser->data : byte;
+        const uint8_t data1 = parser->pending ? byte : 0;
+        uint8_t type = status & 0xF0;
+
+        parser->pending = 0;
+        if (type == MIDI_MESSAGE_NOTE_ON && data1 == 0) {
+            type = MIDI_MESSAGE_NOTE_OFF;
+        } else if (MIDI_CONFIG_CHANNEL_MODE
+                   && type == MIDI_MESSAGE_CONTROL_CHANGE
+                   && data0 >= MIDI_CC_ALL_SOUND_OFF) {
+            type = data0;
+        }
+        return midi_packed_make((midi_message_type_t)type,
+                                (midi_channel_t)(status & 0x0F),
+                                data0,
+                                data1);
+    }
+
+    /* System Real-Time bytes do not affect running status */
+    if (byte >= MIDI_MESSAGE_TIMING_CLOCK) {
+        if (byte == 0xF9 || byte == 0xFD) { return 0; }
+        return midi_packed_make(
+            (midi_message_type_t)byte, MIDI_CHANNEL_NONE, 0, 0);
+    }
+
+    /* Undefined System Common bytes are ignored */
+    if (byte == 0xF4 || byte == 0xF5) { return 0; }
+
+    parser->status = (byte < MIDI_MESSAGE_SYSTEM_EXCLUSIVE) ? byte : 0;
+    parser->pending = 0;
+    if (byte == MIDI_MESSAGE_TUNE_REQUEST) {
+        return midi_packed_make(
+            MIDI_MESSAGE_TUNE_REQUEST, MIDI_CHANNEL_NONE, 0, 0);
+    }
+    return 0;
+}
+
+#endif /* MIDI_LEAN_H */
@@ -0,0 +1,573 @@
+/***********************************************************************
+ * @file midi_log.c
+ * @brief MIDI message log implementation
+ *
+ * @details Queries run in two passes over each chunk that may match:
+ *          the first computes a byte mask of the matching messages with
+ *          branch-free comparisons on the columns, which compilers turn
+ *          into vector code, and the second reduces the mask into a
+ *          count, a histogram or a list of messages.
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_log.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Number of messages parsed at a time by midi_log_parse_buffer
+ */
+#define LOG_STAGING_SIZE (64)
+
+/**
+ * @brief Bit of midi_log_chunk_t.channels for system messages
+ */
+#define LOG_SYSTEM_CHANNEL_BIT (16)
+
+/**
+ * @brief MIDI Maximum Data Byte Value
+ */
+#define LOG_MAX_DATA_BYTE (0x7F)
+
+/*=====================================================================*
+    Private Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Query Filter
+ * @details A query rewritten for the branch-free comparisons of
+ *          match_chunk: each range as its start and its width, so that
+ *          one unsigned comparison tests both ends
+ */
+typedef struct log_filter_t {
+    uint8_t message_type;
+    uint8_t any_type;
+    uint8_t channel;
+    uint8_t any_channel;
+    uint8_t data1_min;
+    uint8_t data1_span;
+    uint8_t data2_min;
+    uint8_t data2_span;
+    uint32_t time_from;
+    uint32_t time_span;
+} log_filter_t;
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static inline size_t chunk_count(const midi_log_t *log, size_t chunk);
+
+static inline void reset_chunk(midi_log_chunk_t *chunk);
+
+static inline uint32_t channel_bit(uint8_t channel);
+
+static inline midi_packed_t pack_entry(const midi_log_chunk_t *chunk,
+                                       size_t position);
+
+static int make_filter(log_filter_t *filter, const midi_log_query_t *query);
+
+static inline int may_match(const midi_log_chunk_t *chunk,
+                            const midi_log_query_t *query);
+
+static inline void match_chunk(const midi_log_chunk_t *chunk,
+                               size_t count,
+                               const log_filter_t *filter,
+                               uint8_t *matches);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a message log
+ * @param [out] log Pointer to a midi_log_t struct
+ * @param [in] storage Pointer to the storage of the chunks
+ * @param [in] size The number of bytes of storage
+ * @return 1 if the log was initialized, 0 otherwise
+ */
+int midi_log_init(midi_log_t *log, uint8_t *storage, size_t size)
+{
+    /* Check for NULL pointers */
+    if (log == NULL || storage == NULL) { return 0; }
+
+    const size_t padding =
+        (size_t)(-(uintptr_t)storage) & (size_t)(MIDI_LOG_ALIGN - 1);
+    if (size < padding + sizeof(midi_log_chunk_t)) { return 0; }
+
+    log->chunks = (midi_log_chunk_t *)(void *)(storage + padding);
+    log->capacity = (size - padding) / sizeof(midi_log_chunk_t);
+    log->count = 0;
+    return 1;
+}
+
+/**
+ * @brief Remove every message from a log
+ * @param [in,out] log Pointer to a midi_log_t struct
+ */
+void midi_log_clear(midi_log_t *log)
+{
+    /* Check for NULL pointers */
+    if (log == NULL) { return; }
+
+    log->count = 0;
+}
+
+/**
+ * @brief Get the number of messages in a log
+ * @param [in] log Pointer to a midi_log_t struct
+ * @return The number of messages
+ */
+size_t midi_log_size(const midi_log_t *log)
+{
+    return log != NULL ? log->count : 0;
+}
+
+/**
+ * @brief Get the number of messages a log can hold
+ * @param [in] log Pointer to a midi_log_t struct
+ * @return The number of messages
+ */
+size_t midi_log_capacity(const midi_log_t *log)
+{
+    return log != NULL ? log->capacity * MIDI_LOG_CHUNK_SIZE : 0;
+}
+
+/**
+ * @brief Append messages to a log
+ * @param [in,out] log Pointer to a midi_log_t struct
+ * @param [in] packed Pointer to the packed messages
+ * @param [in] times Pointer to the timestamps, or NULL
+ * @param [in] count The number of messages
+ * @return The number of messages appended
+ */
+size_t midi_log_append(midi_log_t *log,
+                       const midi_packed_t *packed,
+                       const uint32_t *times,
+                       size_t count)
+{
+    /* Check for NULL pointers */
+    if (log == NULL || packed == NULL) { return 0; }
+
+    const size_t space = midi_log_capacity(log) - log->count;
+    const size_t appended = count < space ? count : space;
+
+    for (size_t i = 0; i < appended; i++) {
+        const size_t position = log->count % MIDI_LOG_CHUNK_SIZE;
+        midi_log_chunk_t *chunk =
+            &log->chunks[log->count / MIDI_LOG_CHUNK_SIZE];
+        const uint8_t message_type = (uint8_t)midi_packed_type(packed[i]);
+        const uint8_t channel = (uint8_t)midi_packed_channel(packed[i]);
+        const uint8_t data1 = midi_packed_data1(packed[i]);
+        const uint8_t data2 = midi_packed_data2(packed[i]);
+        const uint32_t time = (times != NULL) ? times[i] : 0;
+
+        if (position == 0) { reset_chunk(chunk); }
+
+        chunk->time[position] = time;
+        chunk->message_type[position] = message_type;
+        chunk->channel[position] = channel;
+        chunk->data1[position] = data1;
+        chunk->data2[position] = data2;
+
+        chunk->types[message_type >> 5] |= 1u << (message_type & 31);
+        chunk->channels |= channel_bit(channel);
+        if (time < chunk->time_min) { chunk->time_min = time; }
+        if (time > chunk->time_max) { chunk->time_max = time; }
+        if (data1 < chunk->data1_min) { chunk->data1_min = data1; }
+        if (data1 > chunk->data1_max) { chunk->data1_max = data1; }
+        if (data2 < chunk->data2_min) { chunk->data2_min = data2; }
+        if (data2 > chunk->data2_max) { chunk->data2_max = data2; }
+
+        log->count++;
+    }
+
+    return appended;
+}
+
+/**
+ * @brief Parse a buffer of MIDI bytes into a log
+ * @param [in,out] log Pointer to a midi_log_t struct
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @param [in] base The arrival time of the first byte of the buffer
+ * @param [in] period The time taken by each byte
+ * @param [out] consumed Optional pointer that receives the number of
+ *      bytes that were parsed. May be NULL.
+ * @return The number of messages appended
+ */
+size_t midi_log_parse_buffer(midi_log_t *log,
+                             midi_parser_t *parser,
+                             const uint8_t *buffer,
+                             size_t length,
+                             uint32_t base,
+                             uint32_t period,
+                             size_t *consumed)
+{
+    size_t index = 0;
+    size_t appended = 0;
+
+    if (consumed != NULL) { *consumed = 0; }
+
+    /* Check for NULL pointers */
+    if (log == NULL || parser == NULL || buffer == NULL) { return 0; }
+
+    while (index < length && log->count < midi_log_capacity(log)) {
+        midi_packed_t packed[LOG_STAGING_SIZE];
+        uint32_t times[LOG_STAGING_SIZE];
+        const size_t space = midi_log_capacity(log) - log->count;
+        size_t used = 0;
+
+        const size_t count = midi_parse_buffer_packed_timed(
+            parser,
+            &buffer[index],
+            length - index,
+            base + period * (uint32_t)index,
+            period,
+            packed,
+            times,
+            space < LOG_STAGING_SIZE ? space : LOG_STAGING_SIZE,
+            &used);
+        appended += midi_log_append(log, packed, times, count);
+        index += used;
+    }
+
+    if (consumed != NULL) { *consumed = index; }
+    return appended;
+}
+
+/**
+ * @brief Get a message of a log
+ * @param [in] log Pointer to a midi_log_t struct
+ * @param [in] index The index of the message
+ * @param [out] packed Pointer that receives the packed message
+ * @param [out] time Optional pointer that receives the timestamp
+ * @return 1 if the message exists, 0 otherwise
+ */
+int midi_log_get(const midi_log_t *log,
+                 size_t index,
+                 midi_packed_t *packed,
+                 uint32_t *time)
+{
+    /* Check for NULL pointers */
+    if (log == NULL || packed == NULL || index >= log->count) { return 0; }
+
+    const midi_log_chunk_t *chunk = &log->chunks[index / MIDI_LOG_CHUNK_SIZE];
+    const size_t position = index % MIDI_LOG_CHUNK_SIZE;
+
+    *packed = pack_entry(chunk, position);
+    if (time != NULL) { *time = chunk->time[position]; }
+    return 1;
+}
+
+/**
+ * @brief Initialize a query that matches every message
+ * @param [out] query Pointer to a midi_log_query_t struct
+ */
+void midi_log_query_init(midi_log_query_t *query)
+{
+    /* Check for NULL pointers */
+    if (query == NULL) { return; }
+
+    query->message_type = MIDI_MESSAGE_NONE;
+    query->channel = MIDI_CHANNEL_NONE;
+    query->data1_min = 0;
+    query->data1_max = LOG_MAX_DATA_BYTE;
+    query->data2_min = 0;
+    query->data2_max = LOG_MAX_DATA_BYTE;
+    query->time_from = 0;
+    query->time_to = UINT32_MAX;
+}
+
+/**
+ * @brief Count the messages that match a query
+ * @param [in] log Pointer to a midi_log_t struct
+ * @param [in] query Pointer to a midi_log_query_t struct
+ * @return The number of matching messages
+ */
+size_t midi_log_count(const midi_log_t *log, const midi_log_query_t *query)
+{
+    log_filter_t filter;
+    uint8_t matches[MIDI_LOG_CHUNK_SIZE];
+    size_t total = 0;
+
+    /* Check for NULL pointers */
+    if (log == NULL || query == NULL || !make_filter(&filter, query)) {
+        return 0;
+    }
+
+    for (size_t c = 0; c * MIDI_LOG_CHUNK_SIZE < log->count; c++) {
+        const midi_log_chunk_t *chunk = &log->chunks[c];
+        const size_t count = chunk_count(log, c);
+        if (!may_match(chunk, query)) { continue; }
+
+        match_chunk(chunk, count, &filter, matches);
+        for (size_t i = 0; i < count; i++) { total += matches[i]; }
+    }
+
+    return total;
+}
+
+/**
+ * @brief Count the values of a data byte over the messages that match a
+ *        query
+ * @param [in] log Pointer to a midi_log_t struct
+ * @param [in] query Pointer to a midi_log_query_t struct
+ * @param [in] column The data byte to count
+ * @param [in,out] histogram Pointer to 128 counters
+ * @return The number of matching messages
+ */
+size_t midi_log_histogram(const midi_log_t *log,
+                          const midi_log_query_t *query,
+                          midi_log_column_t column,
+                          uint32_t *histogram)
+{
+    log_filter_t filter;
+    uint8_t matches[MIDI_LOG_CHUNK_SIZE];
+    size_t total = 0;
+
+    /* Check for NULL pointers */
+    if (log == NULL || query == NULL || histogram == NULL
+        || !make_filter(&filter, query)) {
+        return 0;
+    }
+
+    for (size_t c = 0; c * MIDI_LOG_CHUNK_SIZE < log->count; c++) {
+        const midi_log_chunk_t *chunk = &log->chunks[c];
+        const size_t count = chunk_count(log, c);
+        const uint8_t *values =
+            (column == MIDI_LOG_COLUMN_DATA2) ? chunk->data2 : chunk->data1;
+        if (!may_match(chunk, query)) { continue; }
+
+        match_chunk(chunk, count, &filter, matches);
+        for (size_t i = 0; i < count; i++) {
+            histogram[values[i] & LOG_MAX_DATA_BYTE] += matches[i];
+            total += matches[i];
+        }
+    }
+
+    return total;
+}
+
+/**
+ * @brief Copy out the messages that match a query
+ * @param [in] log Pointer to a midi_log_t struct
+ * @param [in] query Pointer to a midi_log_query_t struct
+ * @param [in] start The index of the message to start from
+ * @param [out] packed Pointer to an array that receives the messages
+ * @param [out] times Optional pointer to an array that receives their
+ *      timestamps
+ * @param [in] capacity The number of entries in the arrays
+ * @param [out] next Optional pointer that receives the index to start the
+ *      next call from
+ * @return The number of messages written
+ */
+size_t midi_log_select(const midi_log_t *log,
+                       const midi_log_query_t *query,
+                       size_t start,
+                       midi_packed_t *packed,
+                       uint32_t *times,
+                       size_t capacity,
+                       size_t *next)
+{
+    log_filter_t filter;
+    uint8_t matches[MIDI_LOG_CHUNK_SIZE];
+    size_t written = 0;
+    size_t index = start;
+
+    /* Check for NULL pointers */
+    if (log == NULL || query == NULL || packed == NULL) {
+        if (next != NULL) { *next = start; }
+        return 0;
+    }
+    if (!make_filter(&filter, query)) { index = log->count; }
+
+    while (index < log->count && written < capacity) {
+        const size_t c = index / MIDI_LOG_CHUNK_SIZE;
+        const midi_log_chunk_t *chunk = &log->chunks[c];
+        const size_t count = chunk_count(log, c);
+        size_t position = index % MIDI_LOG_CHUNK_SIZE;
+
+        if (!may_match(chunk, query)) {
+            index = (c + 1) * MIDI_LOG_CHUNK_SIZE;
+            continue;
+        }
+
+        match_chunk(chunk, count, &filter, matches);
+        for (; position < count && written < capacity; position++) {
+            if (!matches[position]) { continue; }
+            packed[written] = pack_entry(chunk, position);
+            if (times != NULL) { times[written] = chunk->time[position]; }
+            written++;
+        }
+        index = c * MIDI_LOG_CHUNK_SIZE + position;
+    }
+
+    if (index > log->count) { index = log->count; }
+    if (next != NULL) { *next = index; }
+    return written;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Get the number of messages in a chunk of a log
+ */
+static inline size_t chunk_count(const midi_log_t *log, size_t chunk)
+{
+    const size_t remaining = log->count - chunk * MIDI_LOG_CHUNK_SIZE;
+    return remaining < MIDI_LOG_CHUNK_SIZE ? remaining : MIDI_LOG_CHUNK_SIZE;
+}
+
+/**
+ * @brief Clear the summary of a chunk before its first message
+ */
+static inline void reset_chunk(midi_log_chunk_t *chunk)
+{
+    memset(chunk->types, 0, sizeof(chunk->types));
+    chunk->channels = 0;
+    chunk->time_min = UINT32_MAX;
+    chunk->time_max = 0;
+    chunk->data1_min = UINT8_MAX;
+    chunk->data1_max = 0;
+    chunk->data2_min = UINT8_MAX;
+    chunk->data2_max = 0;
+}
+
+/**
+ * @brief Get the bit of midi_log_chunk_t.channels for a channel
+ */
+static inline uint32_t channel_bit(uint8_t channel)
+{
+    return 1u << ((channel < 16) ? channel : LOG_SYSTEM_CHANNEL_BIT);
+}
+
+/**
+ * @brief Pack a message of a chunk
+ */
+static inline midi_packed_t pack_entry(const midi_log_chunk_t *chunk,
+                                       size_t position)
+{
+    return midi_packed_make((midi_message_type_t)chunk->message_type[position],
+                            (midi_channel_t)chunk->channel[position],
+                            chunk->data1[position],
+                            chunk->data2[position]);
+}
+
+/**
+ * @brief Rewrite a query for match_chunk
+ * @return 0 if the query can match no message, 1 otherwise
+ */
+static int make_filter(log_filter_t *filter, const midi_log_query_t *query)
+{
+    if (query->data1_min > query->data1_max
+        || query->data2_min > query->data2_max) {
+        return 0;
+    }
+
+    filter->message_type = (uint8_t)query->message_type;
+    filter->any_type = query->message_type == MIDI_MESSAGE_NONE;
+    filter->channel = (uint8_t)query->channel;
+    filter->any_channel = query->channel == MIDI_CHANNEL_NONE;
+    filter->data1_min = query->data1_min;
+    filter->data1_span = (uint8_t)(query->data1_max - query->data1_min);
+    filter->data2_min = query->data2_min;
+    filter->data2_span = (uint8_t)(query->data2_max - query->data2_min);
+    filter->time_from = query->time_from;
+    filter->time_span = query->time_to - query->time_from;
+    return 1;
+}
+
+/**
+ * @brief Check the summary of a chunk against a query
+ * @return 0 if no message of the chunk can match, 1 otherwise
+ */
+static inline int may_match(const midi_log_chunk_t *chunk,
+                            const midi_log_query_t *query)
+{
+    const uint8_t message_type = (uint8_t)query->message_type;
+
+    if (query->message_type != MIDI_MESSAGE_NONE
+        && !((chunk->types[message_type >> 5] >> (message_type & 31)) & 1)) {
+        return 0;
+    }
+    if (query->channel != MIDI_CHANNEL_NONE
+        && !(chunk->channels & channel_bit((uint8_t)query->channel))) {
+        return 0;
+    }
+    if (query->data1_max < chunk->data1_min
+        || query->data1_min > chunk->data1_max
+        || query->data2_max < chunk->data2_min
+        || query->data2_min > chunk->data2_max) {
+        return 0;
+    }
+
+    /* A range that wraps around is never used to skip */
+    if (query->time_from <= query->time_to
+        && (query->time_to < chunk->time_min
+            || query->time_from > chunk->time_max)) {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Compute the byte mask of the messages of a chunk that match
+ * @details Every comparison is evaluated for every message, without
+ *          branches, so that the loop vectorizes
+ * @param [in] chunk Pointer to the chunk
+ * @param [in] count The number of messages in the chunk
+ * @param [in] filter Pointer to the filter
+ * @param [out] matches Pointer to count bytes that receive 1 for the
+ *      matching messages and 0 for the others
+ */
+static inline void match_chunk(const midi_log_chunk_t *chunk,
+                               size_t count,
+                               const log_filter_t *filter,
+                               uint8_t *matches)
+{
+    const uint8_t message_type = filter->message_type;
+    const uint8_t any_type = filter->any_type;
+    const uint8_t channel = filter->channel;
+    const uint8_t any_channel = filter->any_channel;
+    const uint8_t data1_min = filter->data1_min;
+    const uint8_t data1_span = filter->data1_span;
+    const uint8_t data2_min = filter->data2_min;
+    const uint8_t data2_span = filter->data2_span;
+    const uint32_t time_from = filter->time_from;
+    const uint32_t time_span = filter->time_span;
+
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t type_ok =
+            (uint8_t)((chunk->message_type[i] == message_type) | any_type);
+        const uint8_t channel_ok =
+            (uint8_t)((chunk->channel[i] == channel) | any_channel);
+        const uint8_t data1_ok =
+            (uint8_t)((uint8_t)(chunk->data1[i] - data1_min) <= data1_span);
+        const uint8_t data2_ok =
+            (uint8_t)((uint8_t)(chunk->data2[i] - data2_min) <= data2_span);
+        const uint8_t time_ok =
+            (uint8_t)((uint32_t)(chunk->time[i] - time_from) <= time_span);
+
+        matches[i] = type_ok & channel_ok & data1_ok & data2_ok & time_ok;
+    }
+}
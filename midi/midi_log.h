@@ -0,0 +1,311 @@
+/**********************************************************************
+ * @file midi_log.h
+ * @brief MIDI message log module
+ *
+ * @details This module stores parsed messages for analysis, for example
+ *          of a captured session. The messages are appended to chunks of
+ *          MIDI_LOG_CHUNK_SIZE messages, carved out of storage provided
+ *          by the caller, and each chunk keeps its messages in columns:
+ *          one array each of message types, channels, first and second
+ *          data bytes and timestamps. A query that looks at the notes of
+ *          one channel then reads four bytes per message rather than a
+ *          whole midi_message_t, and the inner loops over the columns are
+ *          simple enough for the compiler to vectorize.
+ *
+ *          Each chunk also records which message types and channels it
+ *          holds, and the range of its data bytes and timestamps, so that
+ *          queries skip the chunks that cannot match without reading
+ *          their columns.
+ *
+ *          Messages are appended as packed words, or parsed straight into
+ *          the log from a byte buffer. A log is not thread-safe.
+ **********************************************************************/
+
+#ifndef MIDI_LOG_H
+#define MIDI_LOG_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Number of messages in a chunk
+ */
+#define MIDI_LOG_CHUNK_SIZE (256)
+
+/**
+ * @brief Alignment of the chunks in the storage, in bytes
+ */
+#define MIDI_LOG_ALIGN (64)
+
+/**
+ * @brief Size of the storage of a log
+ * @details Includes room to align the chunks, so any storage will do
+ * @param messages The number of messages the log must hold
+ */
+#define MIDI_LOG_STORAGE_SIZE(messages)                                    \
+    ((((size_t)(messages) + MIDI_LOG_CHUNK_SIZE - 1) / MIDI_LOG_CHUNK_SIZE) \
+         * sizeof(midi_log_chunk_t)                                        \
+     + MIDI_LOG_ALIGN)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Log Chunk
+ * @details The columns are indexed by the position of the message in the
+ *          chunk
+ * @note The fields of this struct should not be accessed directly
+ */
+typedef struct midi_log_chunk_t {
+    uint32_t time[MIDI_LOG_CHUNK_SIZE];
+    uint8_t message_type[MIDI_LOG_CHUNK_SIZE];
+    uint8_t channel[MIDI_LOG_CHUNK_SIZE];
+    uint8_t data1[MIDI_LOG_CHUNK_SIZE];
+    uint8_t data2[MIDI_LOG_CHUNK_SIZE];
+
+    /**
+     * @brief Bit n is set if the chunk holds a message of type n
+     */
+    uint32_t types[8];
+
+    /**
+     * @brief Bit n is set if the chunk holds a message on channel n + 1,
+     *        and bit 16 if it holds a system message
+     */
+    uint32_t channels;
+
+    /**
+     * @brief The smallest and largest values of the columns
+     */
+    uint32_t time_min;
+    uint32_t time_max;
+    uint8_t data1_min;
+    uint8_t data1_max;
+    uint8_t data2_min;
+    uint8_t data2_max;
+} midi_log_chunk_t;
+
+/**
+ * @brief MIDI Message Log
+ * @note The fields of this struct should not be accessed directly.
+ *       Use the `midi_log_*` functions.
+ */
+typedef struct midi_log_t {
+    /**
+     * @brief The chunks, in the caller's storage
+     */
+    midi_log_chunk_t *chunks;
+
+    /**
+     * @brief The number of chunks the storage holds
+     */
+    size_t capacity;
+
+    /**
+     * @brief The number of messages in the log
+     */
+    size_t count;
+} midi_log_t;
+
+/**
+ * @brief Log Query
+ * @details Selects the messages that match every field. Initialize with
+ *          midi_log_query_init, which matches every message, and narrow
+ *          down only the fields that matter.
+ */
+typedef struct midi_log_query_t {
+    /**
+     * @brief The message type, or MIDI_MESSAGE_NONE for any type
+     */
+    midi_message_type_t message_type;
+
+    /**
+     * @brief The channel, or MIDI_CHANNEL_NONE for any channel
+     */
+    midi_channel_t channel;
+
+    /**
+     * @brief The range of the first data byte, inclusive
+     */
+    uint8_t data1_min;
+    uint8_t data1_max;
+
+    /**
+     * @brief The range of the second data byte, inclusive
+     */
+    uint8_t data2_min;
+    uint8_t data2_max;
+
+    /**
+     * @brief The range of timestamps, inclusive
+     * @details Compared modulo 2^32, so the range may wrap around
+     */
+    uint32_t time_from;
+    uint32_t time_to;
+} midi_log_query_t;
+
+/**
+ * @brief Log Column
+ * @details The data byte column that a histogram counts
+ */
+typedef enum midi_log_column_t {
+    MIDI_LOG_COLUMN_DATA1,
+    MIDI_LOG_COLUMN_DATA2,
+} midi_log_column_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a message log
+ * @param [out] log Pointer to a midi_log_t struct
+ * @param [in] storage Pointer to the storage of the chunks, for example
+ *      MIDI_LOG_STORAGE_SIZE(messages) bytes. Must stay valid for as long
+ *      as the log is used.
+ * @param [in] size The number of bytes of storage
+ * @return 1 if the log was initialized, 0 if an argument is NULL or the
+ *      storage is too small for a single chunk
+ */
+int midi_log_init(midi_log_t *log, uint8_t *storage, size_t size);
+
+/**
+ * @brief Remove every message from a log
+ * @param [in,out] log Pointer to a midi_log_t struct
+ */
+void midi_log_clear(midi_log_t *log);
+
+/**
+ * @brief Get the number of messages in a log
+ * @param [in] log Pointer to a midi_log_t struct
+ * @return The number of messages
+ */
+size_t midi_log_size(const midi_log_t *log);
+
+/**
+ * @brief Get the number of messages a log can hold
+ * @param [in] log Pointer to a midi_log_t struct
+ * @return The number of messages
+ */
+size_t midi_log_capacity(const midi_log_t *log);
+
+/**
+ * @brief Append messages to a log
+ * @param [in,out] log Pointer to a midi_log_t struct
+ * @param [in] packed Pointer to the packed messages
+ * @param [in] times Pointer to the timestamp of each message, or NULL to
+ *      log a timestamp of 0
+ * @param [in] count The number of messages
+ * @return The number of messages appended, fewer than count if the log
+ *      is full
+ */
+size_t midi_log_append(midi_log_t *log,
+                       const midi_packed_t *packed,
+                       const uint32_t *times,
+                       size_t count);
+
+/**
+ * @brief Parse a buffer of MIDI bytes into a log
+ * @details Parses with midi_parse_buffer_packed_timed into a small array
+ *          on the stack and appends the messages, so that the whole
+ *          capture never has to be held as messages. Timestamps are the
+ *          arrival times of midi_parse_buffer_timed.
+ * @param [in,out] log Pointer to a midi_log_t struct
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @param [in] base The arrival time of the first byte of the buffer
+ * @param [in] period The time taken by each byte
+ * @param [out] consumed Optional pointer that receives the number of
+ *      bytes that were parsed. May be NULL.
+ * @return The number of messages appended
+ * @note If the log fills up, parsing stops after the byte that completed
+ *       the last message that fit
+ */
+size_t midi_log_parse_buffer(midi_log_t *log,
+                             midi_parser_t *parser,
+                             const uint8_t *buffer,
+                             size_t length,
+                             uint32_t base,
+                             uint32_t period,
+                             size_t *consumed);
+
+/**
+ * @brief Get a message of a log
+ * @param [in] log Pointer to a midi_log_t struct
+ * @param [in] index The index of the message, in append order
+ * @param [out] packed Pointer that receives the packed message
+ * @param [out] time Optional pointer that receives the timestamp.
+ *      May be NULL.
+ * @return 1 if the message exists, 0 otherwise
+ */
+int midi_log_get(const midi_log_t *log,
+                 size_t index,
+                 midi_packed_t *packed,
+                 uint32_t *time);
+
+/**
+ * @brief Initialize a query that matches every message
+ * @param [out] query Pointer to a midi_log_query_t struct
+ */
+void midi_log_query_init(midi_log_query_t *query);
+
+/**
+ * @brief Count the messages that match a query
+ * @param [in] log Pointer to a midi_log_t struct
+ * @param [in] query Pointer to a midi_log_query_t struct
+ * @return The number of matching messages
+ */
+size_t midi_log_count(const midi_log_t *log, const midi_log_query_t *query);
+
+/**
+ * @brief Count the values of a data byte over the messages that match a
+ *        query
+ * @details For example the velocities of the Note On messages of a
+ *          channel. The counts are added to the histogram, so that it can
+ *          be accumulated over several logs.
+ * @param [in] log Pointer to a midi_log_t struct
+ * @param [in] query Pointer to a midi_log_query_t struct
+ * @param [in] column The data byte to count
+ * @param [in,out] histogram Pointer to 128 counters, indexed by value
+ * @return The number of matching messages
+ */
+size_t midi_log_histogram(const midi_log_t *log,
+                          const midi_log_query_t *query,
+                          midi_log_column_t column,
+                          uint32_t *histogram);
+
+/**
+ * @brief Copy out the messages that match a query
+ * @details For example the values of one controller over time
+ * @param [in] log Pointer to a midi_log_t struct
+ * @param [in] query Pointer to a midi_log_query_t struct
+ * @param [in] start The index of the message to start from
+ * @param [out] packed Pointer to an array that receives the messages
+ * @param [out] times Optional pointer to an array that receives their
+ *      timestamps. May be NULL.
+ * @param [in] capacity The number of entries in the arrays
+ * @param [out] next Optional pointer that receives the index to start the
+ *      next call from, or the size of the log once every message has been
+ *      looked at. May be NULL.
+ * @return The number of messages written
+ */
+size_t midi_log_select(const midi_log_t *log,
+                       const midi_log_query_t *query,
+                       size_t start,
+                       midi_packed_t *packed,
+                       uint32_t *times,
+                       size_t capacity,
+                       size_t *next);
+
+#endif /* MIDI_LOG_H */
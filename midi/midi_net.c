@@ -0,0 +1,1128 @@
+/***********************************************************************
+ * @file midi_net.c
+ * @brief MIDI network transport implementation
+ *
+ * @details A packet is an RTP header, the RFC 6295 command section header
+ *          and command list, and, when the J flag is set, the journal:
+ *          the sequence number of the last packet of the checkpoint, the
+ *          length of the journal and the journal, each 16-bit field in
+ *          network byte order. The journal is the output of
+ *          midi_state_changes since the checkpoint, encoded with running
+ *          status. A packet without the J flag has changes that do not fit
+ *          in a journal, and its loss cannot be recovered.
+ *
+ *          The snapshot notes of the state the journal is read from are
+ *          set so that it lists a Note Off for every note that sounded
+ *          since the checkpoint and stopped, and a Note On for every
+ *          sounding note whose key was pressed or released since. Notes
+ *          that sound only through the sustain pedal are sent as a Note On
+ *          and a Note Off, which leaves them sustained on the receiver
+ *          whether its key was held or not.
+ *
+ *          The receiver parses the journal, keeps the messages that change
+ *          its state and encodes them again over the journal, which they
+ *          always fit: leaving messages out of a list sent with running
+ *          status never adds status bytes.
+ ***********************************************************************/
+
+/* sendmmsg and recvmmsg are GNU extensions */
+#define _GNU_SOURCE
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_net.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+#include "midi_encoder.h"
+#include "midi_pool.h"
+#include "midi_state.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief RTP header fields
+ */
+#define NET_RTP_HEADER_SIZE (12)
+#define NET_RTP_VERSION (0x80)
+#define NET_RTP_VERSION_MASK (0xC0)
+#define NET_RTP_PADDING (0x20)
+#define NET_RTP_EXTENSION (0x10)
+#define NET_RTP_CSRC_MASK (0x0F)
+#define NET_RTP_TYPE_MASK (0x7F)
+
+/**
+ * @brief Command section header flags
+ */
+#define NET_FLAG_B (0x80)
+#define NET_FLAG_J (0x40)
+#define NET_FLAG_Z (0x20)
+#define NET_LENGTH_MASK (0x0F)
+
+/**
+ * @brief Largest command lists of the short and long headers
+ */
+#define NET_SHORT_LENGTH_MAX (15)
+#define NET_LONG_LENGTH_MAX (4095)
+
+/**
+ * @brief Size of the long command section header
+ */
+#define NET_LONG_HEADER_SIZE (2)
+
+/**
+ * @brief Size of the journal header
+ */
+#define NET_JOURNAL_HEADER_SIZE (4)
+
+/**
+ * @brief Largest delta time, four 7-bit bytes
+ */
+#define NET_MAX_DELTA (0x0FFFFFFFu)
+
+/**
+ * @brief Smallest value of a switch controller that is on
+ */
+#define NET_SWITCH_ON (64)
+
+/**
+ * @brief Feedback packet signature and command
+ */
+#define NET_FEEDBACK_SIGNATURE (0xFF)
+#define NET_FEEDBACK_COMMAND_0 ('R')
+#define NET_FEEDBACK_COMMAND_1 ('S')
+
+/*=====================================================================*
+    Private Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Fields of a received packet
+ */
+typedef struct net_packet_t {
+    uint8_t *list;
+    size_t list_length;
+    uint8_t *journal;
+    size_t journal_length;
+    uint32_t timestamp;
+    uint32_t ssrc;
+    uint16_t sequence;
+    uint16_t checkpoint;
+    uint8_t delta_first;
+    uint8_t has_journal;
+} net_packet_t;
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static int16_t sequence_diff(uint16_t a, uint16_t b);
+
+static void write_u16(uint8_t *buffer, uint16_t value);
+
+static void write_u32(uint8_t *buffer, uint32_t value);
+
+static uint16_t read_u16(const uint8_t *buffer);
+
+static uint32_t read_u32(const uint8_t *buffer);
+
+static size_t delta_size(uint32_t delta);
+
+static void write_delta(uint8_t *buffer, uint32_t delta);
+
+static void take_checkpoint(midi_net_checkpoint_t *checkpoint);
+
+static void track(midi_net_checkpoint_t *checkpoint, midi_packed_t packed);
+
+static size_t build_journal(midi_net_sender_t *sender,
+                            size_t limit,
+                            int *complete);
+
+static size_t pack_packet(midi_net_sender_t *sender,
+                          const midi_packed_t *messages,
+                          const uint32_t *timestamps,
+                          size_t count,
+                          uint8_t *packet,
+                          size_t *length);
+
+static int parse_packet(uint8_t *packet, size_t length, net_packet_t *parsed);
+
+static int changes_state(const midi_state_t *state,
+                         midi_packed_t packed,
+                         midi_packed_t next);
+
+static size_t recover(midi_net_receiver_t *receiver,
+                      const net_packet_t *parsed,
+                      uint32_t port,
+                      midi_parser_pool_work_t *items,
+                      uint32_t *timestamps);
+
+static size_t command_size(midi_net_receiver_t *receiver,
+                           const uint8_t *command,
+                           size_t available);
+
+static size_t decode_list(midi_net_receiver_t *receiver,
+                          const net_packet_t *parsed,
+                          uint32_t port,
+                          midi_parser_pool_work_t *items,
+                          uint32_t *timestamps,
+                          size_t capacity);
+
+/*=====================================================================*
+    Public Function Implementations - Batches
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a packet batch
+ * @param [out] batch Pointer to a midi_net_batch_t struct
+ * @param [in] storage Pointer to capacity * packet_size bytes
+ * @param [in] capacity The number of packets
+ * @param [in] packet_size The size of each packet
+ * @return 1 if the batch was initialized, 0 otherwise
+ */
+int midi_net_batch_init(midi_net_batch_t *batch,
+                        uint8_t *storage,
+                        size_t capacity,
+                        size_t packet_size)
+{
+    /* Check for NULL pointers */
+    if (batch == NULL) { return 0; }
+
+    memset(batch, 0, sizeof(*batch));
+    if (storage == NULL || capacity == 0 || capacity > MIDI_NET_MAX_BATCH
+        || packet_size == 0 || packet_size > MIDI_NET_MAX_PACKET_SIZE) {
+        return 0;
+    }
+
+    batch->storage = storage;
+    batch->capacity = capacity;
+    batch->packet_size = packet_size;
+    return 1;
+}
+
+/**
+ * @brief Remove every packet from a batch
+ * @param [in,out] batch Pointer to a midi_net_batch_t struct
+ */
+void midi_net_batch_clear(midi_net_batch_t *batch)
+{
+    /* Check for NULL pointers */
+    if (batch == NULL) { return; }
+
+    batch->count = 0;
+}
+
+/**
+ * @brief Get a packet of a batch
+ * @param [in] batch Pointer to a midi_net_batch_t struct
+ * @param [in] index The index of the packet
+ * @param [out] length Pointer that receives the length of the packet
+ * @return Pointer to the packet, or NULL
+ */
+uint8_t *midi_net_batch_packet(midi_net_batch_t *batch,
+                               size_t index,
+                               size_t *length)
+{
+    /* Check for NULL pointers */
+    if (batch == NULL || index >= batch->count) { return NULL; }
+
+    if (length != NULL) { *length = batch->lengths[index]; }
+    return &batch->storage[index * batch->packet_size];
+}
+
+/**
+ * @brief Send the packets of a batch
+ * @param [in] fd The UDP socket
+ * @param [in,out] batch Pointer to a midi_net_batch_t struct
+ * @param [in] address The destination, or NULL
+ * @param [in] address_length The size of the destination
+ * @return The number of packets sent
+ */
+size_t midi_net_send(int fd,
+                     midi_net_batch_t *batch,
+                     const struct sockaddr *address,
+                     socklen_t address_length)
+{
+    /* Check for NULL pointers */
+    if (batch == NULL || batch->count == 0) { return 0; }
+
+    struct mmsghdr messages[MIDI_NET_MAX_BATCH];
+    struct iovec vectors[MIDI_NET_MAX_BATCH];
+
+    memset(messages, 0, batch->count * sizeof(messages[0]));
+    for (size_t i = 0; i < batch->count; i++) {
+        vectors[i].iov_base = &batch->storage[i * batch->packet_size];
+        vectors[i].iov_len = batch->lengths[i];
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_name = (void *)address;
+        messages[i].msg_hdr.msg_namelen = address != NULL ? address_length : 0;
+    }
+
+    size_t sent = 0;
+    while (sent < batch->count) {
+        const int result = sendmmsg(
+            fd, &messages[sent], (unsigned int)(batch->count - sent), 0);
+        if (result < 0 && errno == EINTR) { continue; }
+        if (result <= 0) { break; }
+        sent += (size_t)result;
+    }
+
+    /* Keep the packets that were not sent, for the next call */
+    const size_t remaining = batch->count - sent;
+    if (sent > 0 && remaining > 0) {
+        memmove(batch->storage,
+                &batch->storage[sent * batch->packet_size],
+                remaining * batch->packet_size);
+        memmove(batch->lengths,
+                &batch->lengths[sent],
+                remaining * sizeof(batch->lengths[0]));
+    }
+    batch->count = remaining;
+    return sent;
+}
+
+/**
+ * @brief Receive packets into a batch
+ * @param [in] fd The UDP socket
+ * @param [in,out] batch Pointer to a midi_net_batch_t struct
+ * @param [in] flags The flags of recvmmsg
+ * @return The number of packets received
+ */
+size_t midi_net_receive(int fd, midi_net_batch_t *batch, int flags)
+{
+    /* Check for NULL pointers */
+    if (batch == NULL || batch->storage == NULL) { return 0; }
+
+    struct mmsghdr messages[MIDI_NET_MAX_BATCH];
+    struct iovec vectors[MIDI_NET_MAX_BATCH];
+
+    batch->count = 0;
+    memset(messages, 0, batch->capacity * sizeof(messages[0]));
+    for (size_t i = 0; i < batch->capacity; i++) {
+        vectors[i].iov_base = &batch->storage[i * batch->packet_size];
+        vectors[i].iov_len = batch->packet_size;
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int result;
+    do {
+        result = recvmmsg(
+            fd, messages, (unsigned int)batch->capacity, flags, NULL);
+    } while (result < 0 && errno == EINTR);
+    if (result <= 0) { return 0; }
+
+    for (size_t i = 0; i < (size_t)result; i++) {
+        /* A truncated packet is left empty, so that it is ignored */
+        const int truncated = messages[i].msg_hdr.msg_flags & MSG_TRUNC;
+        batch->lengths[i] = truncated ? 0 : (uint16_t)messages[i].msg_len;
+    }
+    batch->count = (size_t)result;
+    return batch->count;
+}
+
+/*=====================================================================*
+    Public Function Implementations - Sender
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a sender
+ * @param [out] sender Pointer to a midi_net_sender_t struct
+ * @param [in] ssrc The synchronization source of the stream
+ * @param [in] sequence The sequence number of the first packet
+ * @param [in] packet_size The size of the packets
+ */
+void midi_net_sender_init(midi_net_sender_t *sender,
+                          uint32_t ssrc,
+                          uint16_t sequence,
+                          size_t packet_size)
+{
+    /* Check for NULL pointers */
+    if (sender == NULL) { return; }
+
+    memset(sender, 0, sizeof(*sender));
+    midi_state_init(&sender->journal_checkpoint.state);
+    take_checkpoint(&sender->journal_checkpoint);
+    midi_encoder_init(&sender->encoder);
+    midi_encoder_init(&sender->journal_encoder);
+
+    if (packet_size < MIDI_NET_MIN_PACKET_SIZE) {
+        packet_size = MIDI_NET_MIN_PACKET_SIZE;
+    }
+    if (packet_size > MIDI_NET_MAX_PACKET_SIZE) {
+        packet_size = MIDI_NET_MAX_PACKET_SIZE;
+    }
+
+    sender->ssrc = ssrc;
+    sender->packet_size = packet_size;
+    sender->sequence = sequence;
+    sender->checkpoint = (uint16_t)(sequence - 1);
+}
+
+/**
+ * @brief Pack messages into packets
+ * @param [in,out] sender Pointer to a midi_net_sender_t struct
+ * @param [in] messages Pointer to the messages
+ * @param [in] timestamps Pointer to the timestamp of each message, or NULL
+ * @param [in] count The number of messages
+ * @param [in,out] batch Pointer to the batch that receives the packets
+ * @return The number of messages packed or skipped
+ */
+size_t midi_net_sender_pack(midi_net_sender_t *sender,
+                            const midi_packed_t *messages,
+                            const uint32_t *timestamps,
+                            size_t count,
+                            midi_net_batch_t *batch)
+{
+    /* Check for NULL pointers */
+    if (sender == NULL || messages == NULL || batch == NULL
+        || batch->storage == NULL
+        || batch->packet_size < sender->packet_size) {
+        return 0;
+    }
+
+    size_t consumed = 0;
+    while (consumed < count && batch->count < batch->capacity) {
+        uint8_t *packet =
+            &batch->storage[batch->count * batch->packet_size];
+        size_t length = 0;
+
+        consumed += pack_packet(sender,
+                                &messages[consumed],
+                                timestamps != NULL ? &timestamps[consumed]
+                                                   : NULL,
+                                count - consumed,
+                                packet,
+                                &length);
+        if (length > 0) {
+            batch->lengths[batch->count++] = (uint16_t)length;
+        }
+    }
+    return consumed;
+}
+
+/**
+ * @brief Handle a feedback packet
+ * @param [in,out] sender Pointer to a midi_net_sender_t struct
+ * @param [in] packet Pointer to the packet
+ * @param [in] length The length of the packet
+ * @return 1 if the checkpoint moved, 0 otherwise
+ */
+int midi_net_sender_feedback(midi_net_sender_t *sender,
+                             const uint8_t *packet,
+                             size_t length)
+{
+    /* Check for NULL pointers */
+    if (sender == NULL || packet == NULL || length < MIDI_NET_FEEDBACK_SIZE) {
+        return 0;
+    }
+
+    if (packet[0] != NET_FEEDBACK_SIGNATURE
+        || packet[1] != NET_FEEDBACK_SIGNATURE
+        || packet[2] != NET_FEEDBACK_COMMAND_0
+        || packet[3] != NET_FEEDBACK_COMMAND_1
+        || read_u32(&packet[4]) != sender->ssrc) {
+        return 0;
+    }
+
+    /* The acknowledged packet must be sent, and end the next checkpoint */
+    const uint16_t acknowledged = read_u16(&packet[8]);
+    const uint16_t last = (uint16_t)(sender->sequence - 1);
+    if (!sender->pending
+        || sequence_diff(acknowledged, sender->pending_sequence) < 0
+        || sequence_diff(last, acknowledged) < 0) {
+        return 0;
+    }
+
+    sender->journal_checkpoint = sender->next_checkpoint;
+    sender->checkpoint = sender->pending_sequence;
+    sender->pending = 0;
+    return 1;
+}
+
+/*=====================================================================*
+    Public Function Implementations - Receiver
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a receiver
+ * @param [out] receiver Pointer to a midi_net_receiver_t struct
+ */
+void midi_net_receiver_init(midi_net_receiver_t *receiver)
+{
+    /* Check for NULL pointers */
+    if (receiver == NULL) { return; }
+
+    memset(receiver, 0, sizeof(*receiver));
+    midi_state_init(&receiver->state);
+    midi_parser_init(&receiver->parser);
+    midi_encoder_init(&receiver->encoder);
+}
+
+/**
+ * @brief Decode a packet into parser pool work items
+ * @param [in,out] receiver Pointer to a midi_net_receiver_t struct
+ * @param [in,out] packet Pointer to the packet
+ * @param [in] length The length of the packet
+ * @param [in] port The port of the items
+ * @param [out] items Pointer to an array that receives the items
+ * @param [out] timestamps Pointer to an array that receives the timestamp
+ *      of each item, or NULL
+ * @param [in] capacity The number of entries in the items and timestamps
+ *      arrays
+ * @return The number of items written
+ */
+size_t midi_net_receiver_decode(midi_net_receiver_t *receiver,
+                                uint8_t *packet,
+                                size_t length,
+                                uint32_t port,
+                                midi_parser_pool_work_t *items,
+                                uint32_t *timestamps,
+                                size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (receiver == NULL || packet == NULL || items == NULL) { return 0; }
+
+    net_packet_t parsed;
+    if (!parse_packet(packet, length, &parsed)
+        || (receiver->synced && parsed.ssrc != receiver->ssrc)) {
+        receiver->ignored++;
+        return 0;
+    }
+
+    int recovering = 0;
+    if (!receiver->synced) {
+        /* Joining a stream, whose journal holds the changes so far */
+        receiver->synced = 1;
+        receiver->ssrc = parsed.ssrc;
+        recovering = parsed.has_journal
+                     && parsed.checkpoint != (uint16_t)(parsed.sequence - 1);
+    } else {
+        const int16_t gap = sequence_diff(parsed.sequence, receiver->sequence);
+        if (gap < 0) {
+            receiver->ignored++;
+            return 0;
+        }
+        if (gap > 0) {
+            /* The checkpoint must be a packet the receiver has */
+            const uint16_t last = (uint16_t)(receiver->sequence - 1);
+            receiver->lost += (size_t)gap;
+            recovering = parsed.has_journal
+                         && sequence_diff(last, parsed.checkpoint) >= 0;
+            if (recovering) { receiver->recovered += (size_t)gap; }
+        }
+    }
+    receiver->sequence = (uint16_t)(parsed.sequence + 1);
+    receiver->packets++;
+
+    size_t count = 0;
+    if (recovering && capacity > 0) {
+        count = recover(receiver, &parsed, port, items, timestamps);
+    }
+    return count
+           + decode_list(receiver,
+                         &parsed,
+                         port,
+                         &items[count],
+                         timestamps != NULL ? &timestamps[count] : NULL,
+                         capacity - count);
+}
+
+/**
+ * @brief Write a feedback packet
+ * @param [in] receiver Pointer to a midi_net_receiver_t struct
+ * @param [out] buffer Pointer to the buffer that receives the packet
+ * @param [in] capacity The size of the buffer
+ * @return MIDI_NET_FEEDBACK_SIZE, or 0
+ */
+size_t midi_net_receiver_feedback(const midi_net_receiver_t *receiver,
+                                  uint8_t *buffer,
+                                  size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (receiver == NULL || buffer == NULL || !receiver->synced
+        || capacity < MIDI_NET_FEEDBACK_SIZE) {
+        return 0;
+    }
+
+    buffer[0] = NET_FEEDBACK_SIGNATURE;
+    buffer[1] = NET_FEEDBACK_SIGNATURE;
+    buffer[2] = NET_FEEDBACK_COMMAND_0;
+    buffer[3] = NET_FEEDBACK_COMMAND_1;
+    write_u32(&buffer[4], receiver->ssrc);
+    write_u16(&buffer[8], (uint16_t)(receiver->sequence - 1));
+    buffer[10] = 0;
+    buffer[11] = 0;
+    return MIDI_NET_FEEDBACK_SIZE;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Compare two sequence numbers
+ * @return The distance from b to a, negative if a comes first
+ */
+static int16_t sequence_diff(uint16_t a, uint16_t b)
+{
+    return (int16_t)(uint16_t)(a - b);
+}
+
+/**
+ * @brief Write a 16-bit field in network byte order
+ */
+static void write_u16(uint8_t *buffer, uint16_t value)
+{
+    buffer[0] = (uint8_t)(value >> 8);
+    buffer[1] = (uint8_t)value;
+}
+
+/**
+ * @brief Write a 32-bit field in network byte order
+ */
+static void write_u32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = (uint8_t)(value >> 24);
+    buffer[1] = (uint8_t)(value >> 16);
+    buffer[2] = (uint8_t)(value >> 8);
+    buffer[3] = (uint8_t)value;
+}
+
+/**
+ * @brief Read a 16-bit field in network byte order
+ */
+static uint16_t read_u16(const uint8_t *buffer)
+{
+    return (uint16_t)((buffer[0] << 8) | buffer[1]);
+}
+
+/**
+ * @brief Read a 32-bit field in network byte order
+ */
+static uint32_t read_u32(const uint8_t *buffer)
+{
+    return (uint32_t)buffer[0] << 24 | (uint32_t)buffer[1] << 16
+           | (uint32_t)buffer[2] << 8 | buffer[3];
+}
+
+/**
+ * @brief Get the number of bytes of a delta time
+ */
+static size_t delta_size(uint32_t delta)
+{
+    if (delta < 0x80u) { return 1; }
+    if (delta < 0x4000u) { return 2; }
+    if (delta < 0x200000u) { return 3; }
+    return 4;
+}
+
+/**
+ * @brief Write a delta time, 7 bits per byte with the most significant
+ *        first, and the top bit set on every byte but the last
+ */
+static void write_delta(uint8_t *buffer, uint32_t delta)
+{
+    const size_t size = delta_size(delta);
+
+    for (size_t i = 0; i < size; i++) {
+        const uint32_t shift = (uint32_t)(7 * (size - 1 - i));
+        const uint8_t more = i + 1 < size ? 0x80 : 0x00;
+        buffer[i] = (uint8_t)(((delta >> shift) & 0x7F) | more);
+    }
+}
+
+/**
+ * @brief Make the current state of a checkpoint its checkpoint
+ */
+static void take_checkpoint(midi_net_checkpoint_t *checkpoint)
+{
+    midi_state_t *state = &checkpoint->state;
+
+    midi_state_snapshot(state);
+    checkpoint->pedal = state->snapshot_sustain;
+    for (size_t channel = 0; channel < MIDI_STATE_CHANNELS; channel++) {
+        for (size_t word = 0; word < MIDI_STATE_SET_WORDS; word++) {
+            checkpoint->sounded[channel][word] =
+                state->held[channel][word] | state->sustained[channel][word];
+            checkpoint->touched[channel][word] = 0;
+        }
+    }
+}
+
+/**
+ * @brief Apply a sent message to a checkpoint
+ */
+static void track(midi_net_checkpoint_t *checkpoint, midi_packed_t packed)
+{
+    const midi_message_type_t type = midi_packed_type(packed);
+    const midi_channel_t channel = midi_packed_channel(packed);
+    const uint8_t note = midi_packed_data1(packed) & 0x7F;
+    const uint64_t bit = (uint64_t)1 << (note & 63);
+
+    midi_state_update_packed(&checkpoint->state, packed);
+    if (channel >= MIDI_STATE_CHANNELS) { return; }
+    if (checkpoint->state.controllers[channel][MIDI_CC_SUSTAIN_PEDAL]
+        >= NET_SWITCH_ON) {
+        checkpoint->pedal |= (uint16_t)(1u << channel);
+    }
+    if (type != MIDI_MESSAGE_NOTE_ON && type != MIDI_MESSAGE_NOTE_OFF) {
+        return;
+    }
+    checkpoint->touched[channel][note >> 6] |= bit;
+    if (type == MIDI_MESSAGE_NOTE_ON && midi_packed_data2(packed) != 0) {
+        checkpoint->sounded[channel][note >> 6] |= bit;
+    }
+}
+
+/**
+ * @brief Encode the changes since the checkpoint into the journal buffer
+ * @param [in,out] sender Pointer to a midi_net_sender_t struct
+ * @param [in] limit The largest journal
+ * @param [out] complete Set to 1 if every change fits, 0 otherwise
+ * @return The length of the journal
+ */
+static size_t build_journal(midi_net_sender_t *sender,
+                            size_t limit,
+                            int *complete)
+{
+    const midi_net_checkpoint_t *checkpoint = &sender->journal_checkpoint;
+    midi_state_t *scratch = &sender->scratch;
+
+    /*
+     * With these snapshot notes, the notes that sounded and stopped get a
+     * Note Off, and the sounding notes whose key was pressed or released
+     * get a Note On, even if they sounded at the checkpoint. The pedal is
+     * lifted before the Note Off messages if it was down at any time, as
+     * it may be down on the receiver.
+     */
+    *scratch = checkpoint->state;
+    scratch->snapshot_sustain = checkpoint->pedal;
+    for (size_t channel = 0; channel < MIDI_STATE_CHANNELS; channel++) {
+        for (size_t word = 0; word < MIDI_STATE_SET_WORDS; word++) {
+            const uint64_t current = scratch->held[channel][word]
+                                     | scratch->sustained[channel][word];
+            scratch->snapshot_notes[channel][word] =
+                (checkpoint->sounded[channel][word] & ~current)
+                | (current & ~checkpoint->touched[channel][word]);
+        }
+    }
+
+    const size_t count =
+        midi_state_changes(scratch, sender->changes, MIDI_NET_MAX_JOURNAL_SIZE);
+    *complete = 0;
+    if (count == MIDI_NET_MAX_JOURNAL_SIZE) { return 0; }
+
+    size_t length = 0;
+    midi_encoder_reset(&sender->journal_encoder);
+    for (size_t i = 0; i < count; i++) {
+        midi_message_t *message = &sender->changes[i];
+        size_t written = midi_encode_message(&sender->journal_encoder,
+                                             message,
+                                             &sender->journal[length],
+                                             limit - length);
+        if (written == 0) { return 0; }
+        length += written;
+
+        /* A note that only the pedal sustains is released again */
+        const uint64_t bit = (uint64_t)1 << (message->note & 63);
+        if (message->message_type == MIDI_MESSAGE_NOTE_ON
+            && !(scratch->held[message->channel][message->note >> 6] & bit)) {
+            message->message_type = MIDI_MESSAGE_NOTE_OFF;
+            message->velocity = MIDI_STATE_RELEASE_VELOCITY;
+            written = midi_encode_message(&sender->journal_encoder,
+                                          message,
+                                          &sender->journal[length],
+                                          limit - length);
+            if (written == 0) { return 0; }
+            length += written;
+        }
+    }
+
+    *complete = 1;
+    return length;
+}
+
+/**
+ * @brief Pack messages into one packet
+ * @param [in,out] sender Pointer to a midi_net_sender_t struct
+ * @param [in] messages Pointer to the messages
+ * @param [in] timestamps Pointer to their timestamps, or NULL
+ * @param [in] count The number of messages
+ * @param [out] packet Pointer to sender->packet_size bytes
+ * @param [out] length Receives the length of the packet, 0 if every
+ *      message consumed was skipped
+ * @return The number of messages consumed, at least 1
+ */
+static size_t pack_packet(midi_net_sender_t *sender,
+                          const midi_packed_t *messages,
+                          const uint32_t *timestamps,
+                          size_t count,
+                          uint8_t *packet,
+                          size_t *length)
+{
+    const size_t overhead = NET_RTP_HEADER_SIZE + NET_LONG_HEADER_SIZE;
+    size_t limit = (sender->packet_size - overhead - NET_JOURNAL_HEADER_SIZE)
+                   / 2;
+    if (limit > MIDI_NET_MAX_JOURNAL_SIZE) {
+        limit = MIDI_NET_MAX_JOURNAL_SIZE;
+    }
+
+    int complete = 0;
+    const size_t journal_length = build_journal(sender, limit, &complete);
+    size_t room = sender->packet_size - overhead;
+    if (complete) { room -= NET_JOURNAL_HEADER_SIZE + journal_length; }
+    if (room > NET_LONG_LENGTH_MAX) { room = NET_LONG_LENGTH_MAX; }
+
+    /* The list is written after a long header, and moved if it is short */
+    uint8_t *list = &packet[overhead];
+    size_t used = 0;
+    size_t consumed = 0;
+    uint32_t first = 0;
+    uint32_t last = 0;
+
+    midi_encoder_reset(&sender->encoder);
+    for (; consumed < count; consumed++) {
+        midi_encoder_t encoder = sender->encoder;
+        midi_message_t message;
+        uint8_t bytes[MIDI_ENCODER_MAX_MESSAGE_SIZE];
+
+        midi_message_unpack(messages[consumed], &message);
+        const size_t size =
+            midi_encode_message(&encoder, &message, bytes, sizeof(bytes));
+        if (size == 0) { continue; }
+
+        /* Messages earlier than the one before are sent at its time */
+        const uint32_t time = timestamps != NULL ? timestamps[consumed] : 0;
+        uint32_t delta = 0;
+        if (used == 0) {
+            first = time;
+            last = time;
+        } else if ((int32_t)(time - last) > 0) {
+            delta = time - last;
+        }
+        if (delta > NET_MAX_DELTA) { break; }
+
+        const size_t needed = (used != 0 ? delta_size(delta) : 0) + size;
+        if (used + needed > room) { break; }
+        if (used != 0) { write_delta(&list[used], delta); }
+        memcpy(&list[used + needed - size], bytes, size);
+        used += needed;
+        last += delta;
+
+        sender->encoder = encoder;
+        track(&sender->journal_checkpoint, messages[consumed]);
+        if (sender->pending) {
+            track(&sender->next_checkpoint, messages[consumed]);
+        }
+    }
+
+    *length = 0;
+    if (used == 0) { return consumed; }
+
+    packet[0] = NET_RTP_VERSION;
+    packet[1] = MIDI_NET_PAYLOAD_TYPE;
+    write_u16(&packet[2], sender->sequence);
+    write_u32(&packet[4], first);
+    write_u32(&packet[8], sender->ssrc);
+
+    const uint8_t flags = complete ? NET_FLAG_J : 0;
+    size_t offset = NET_RTP_HEADER_SIZE;
+    if (used <= NET_SHORT_LENGTH_MAX) {
+        packet[offset++] = (uint8_t)(flags | used);
+        memmove(&packet[offset], list, used);
+    } else {
+        packet[offset++] = (uint8_t)(NET_FLAG_B | flags | (used >> 8));
+        packet[offset++] = (uint8_t)used;
+    }
+    offset += used;
+
+    if (complete) {
+        write_u16(&packet[offset], sender->checkpoint);
+        write_u16(&packet[offset + 2], (uint16_t)journal_length);
+        memcpy(&packet[offset + NET_JOURNAL_HEADER_SIZE],
+               sender->journal,
+               journal_length);
+        offset += NET_JOURNAL_HEADER_SIZE + journal_length;
+    }
+    *length = offset;
+
+    /* The next checkpoint starts after this packet, until acknowledged */
+    if (!sender->pending) {
+        sender->next_checkpoint = sender->journal_checkpoint;
+        take_checkpoint(&sender->next_checkpoint);
+        sender->pending_sequence = sender->sequence;
+        sender->pending = 1;
+    }
+    sender->sequence++;
+    return consumed;
+}
+
+/**
+ * @brief Read the fields of a packet
+ * @return 1 if the packet is valid, 0 otherwise
+ */
+static int parse_packet(uint8_t *packet, size_t length, net_packet_t *parsed)
+{
+    if (length <= NET_RTP_HEADER_SIZE
+        || (packet[0] & NET_RTP_VERSION_MASK) != NET_RTP_VERSION
+        || (packet[1] & NET_RTP_TYPE_MASK) != MIDI_NET_PAYLOAD_TYPE) {
+        return 0;
+    }
+
+    if (packet[0] & NET_RTP_PADDING) {
+        const size_t padding = packet[length - 1];
+        if (padding == 0 || padding >= length - NET_RTP_HEADER_SIZE) {
+            return 0;
+        }
+        length -= padding;
+    }
+
+    size_t offset =
+        NET_RTP_HEADER_SIZE + 4 * (size_t)(packet[0] & NET_RTP_CSRC_MASK);
+    if (packet[0] & NET_RTP_EXTENSION) {
+        if (offset + 4 > length) { return 0; }
+        offset += 4 + 4 * (size_t)read_u16(&packet[offset + 2]);
+    }
+    if (offset >= length) { return 0; }
+
+    const uint8_t flags = packet[offset++];
+    size_t list_length = flags & NET_LENGTH_MASK;
+    if (flags & NET_FLAG_B) {
+        if (offset >= length) { return 0; }
+        list_length = list_length << 8 | packet[offset++];
+    }
+    if (list_length > length - offset) { return 0; }
+
+    parsed->list = &packet[offset];
+    parsed->list_length = list_length;
+    parsed->timestamp = read_u32(&packet[4]);
+    parsed->ssrc = read_u32(&packet[8]);
+    parsed->sequence = read_u16(&packet[2]);
+    parsed->delta_first = (flags & NET_FLAG_Z) != 0;
+    parsed->has_journal = 0;
+    parsed->journal = NULL;
+    parsed->journal_length = 0;
+    parsed->checkpoint = 0;
+    offset += list_length;
+
+    if (flags & NET_FLAG_J) {
+        if (length - offset < NET_JOURNAL_HEADER_SIZE) { return 0; }
+        const size_t journal_length = read_u16(&packet[offset + 2]);
+        parsed->checkpoint = read_u16(&packet[offset]);
+        offset += NET_JOURNAL_HEADER_SIZE;
+        if (journal_length > length - offset) { return 0; }
+        parsed->has_journal = 1;
+        parsed->journal = &packet[offset];
+        parsed->journal_length = journal_length;
+    }
+    return 1;
+}
+
+/**
+ * @brief Check whether a journal message changes the state of a receiver
+ * @param [in] state Pointer to the state of the receiver
+ * @param [in] packed The message
+ * @param [in] next The message after it in the journal, or 0
+ * @return Non-zero if the message changes the state
+ */
+static int changes_state(const midi_state_t *state,
+                         midi_packed_t packed,
+                         midi_packed_t next)
+{
+    const midi_channel_t channel = midi_packed_channel(packed);
+    const uint8_t data1 = midi_packed_data1(packed);
+    const uint8_t data2 = midi_packed_data2(packed);
+
+    if (channel >= MIDI_STATE_CHANNELS) { return 1; }
+
+    switch (midi_packed_type(packed)) {
+    case MIDI_MESSAGE_NOTE_ON:
+        if (data2 != 0) {
+            /* Followed by its Note Off, the note only needs to sound */
+            if (midi_packed_type(next) == MIDI_MESSAGE_NOTE_OFF
+                && midi_packed_channel(next) == channel
+                && midi_packed_data1(next) == data1) {
+                return !midi_state_is_note_on(state, channel, data1);
+            }
+            return !((state->held[channel][data1 >> 6] >> (data1 & 63)) & 1);
+        }
+        /* Note On with a velocity of 0 is a Note Off */
+        /* fall through */
+    case MIDI_MESSAGE_NOTE_OFF:
+        return (state->held[channel][data1 >> 6] >> (data1 & 63)) & 1;
+    case MIDI_MESSAGE_CONTROL_CHANGE:
+        return state->controllers[channel][data1] != data2;
+    case MIDI_MESSAGE_ALL_SOUND_OFF:
+        return midi_state_count_notes(state, channel) != 0;
+    case MIDI_MESSAGE_PROGRAM_CHANGE:
+        return state->program[channel] != data1;
+    case MIDI_MESSAGE_CHANNEL_PRESSURE:
+        return state->channel_pressure[channel] != data1;
+    case MIDI_MESSAGE_PITCH_BEND:
+        return state->pitch_bend[channel] != (uint16_t)(data1 | data2 << 7);
+    default:
+        return 1;
+    }
+}
+
+/**
+ * @brief Write the journal messages that change the state of the receiver
+ *        over the journal, as one item
+ * @return The number of items written, 0 or 1
+ */
+static size_t recover(midi_net_receiver_t *receiver,
+                      const net_packet_t *parsed,
+                      uint32_t port,
+                      midi_parser_pool_work_t *items,
+                      uint32_t *timestamps)
+{
+    midi_parser_t parser;
+    midi_parser_init(&parser);
+
+    const size_t count = midi_parse_buffer_packed(&parser,
+                                                  parsed->journal,
+                                                  parsed->journal_length,
+                                                  receiver->journal,
+                                                  MIDI_NET_MAX_JOURNAL_SIZE,
+                                                  NULL);
+
+    size_t length = 0;
+    midi_encoder_reset(&receiver->encoder);
+    for (size_t i = 0; i < count; i++) {
+        const midi_packed_t packed = receiver->journal[i];
+        const midi_packed_t next = i + 1 < count ? receiver->journal[i + 1] : 0;
+        if (!changes_state(&receiver->state, packed, next)) { continue; }
+
+        midi_message_t message;
+        midi_message_unpack(packed, &message);
+        const size_t written =
+            midi_encode_message(&receiver->encoder,
+                                &message,
+                                &parsed->journal[length],
+                                parsed->journal_length - length);
+        if (written == 0) { break; }
+        length += written;
+        midi_state_update_packed(&receiver->state, packed);
+    }
+    if (length == 0) { return 0; }
+
+    items[0].port = port;
+    items[0].data = parsed->journal;
+    items[0].length = length;
+    if (timestamps != NULL) { timestamps[0] = parsed->timestamp; }
+    return 1;
+}
+
+/**
+ * @brief Get the size of the command at the start of a list
+ * @return The size of the command, or 0 if it is not valid
+ */
+static size_t command_size(midi_net_receiver_t *receiver,
+                           const uint8_t *command,
+                           size_t available)
+{
+    const uint8_t status = command[0];
+    size_t size;
+    size_t start = 1;
+
+    if (status >= MIDI_MESSAGE_TIMING_CLOCK) { return 1; }
+
+    if (status == MIDI_MESSAGE_SYSTEM_EXCLUSIVE) {
+        /* A SysEx segment ends with 0xF7, or 0xF0 or 0xF4 (RFC 6295) */
+        receiver->running_status = 0;
+        for (size = 1; size < available; size++) {
+            if (command[size] == MIDI_MESSAGE_END_OF_EXCLUSIVE
+                || command[size] == MIDI_MESSAGE_SYSTEM_EXCLUSIVE
+                || command[size] == 0xF4) {
+                return size + 1;
+            }
+        }
+        return size;
+    }
+
+    if (status & 0x80) {
+        size = 1 + midi_status_data_length(status);
+        receiver->running_status = status < 0xF0 ? status : 0;
+    } else {
+        if (receiver->running_status == 0) { return 0; }
+        size = midi_status_data_length(receiver->running_status);
+        start = 0;
+    }
+
+    if (size > available) { return 0; }
+    for (size_t i = start; i < size; i++) {
+        if (command[i] & 0x80) { return 0; }
+    }
+    return size;
+}
+
+/**
+ * @brief Write an item for each command of the list of a packet
+ * @return The number of items written
+ */
+static size_t decode_list(midi_net_receiver_t *receiver,
+                          const net_packet_t *parsed,
+                          uint32_t port,
+                          midi_parser_pool_work_t *items,
+                          uint32_t *timestamps,
+                          size_t capacity)
+{
+    const uint8_t *list = parsed->list;
+    const size_t length = parsed->list_length;
+    uint32_t time = parsed->timestamp;
+    int delta = parsed->delta_first;
+    size_t offset = 0;
+    size_t count = 0;
+
+    while (offset < length && count < capacity) {
+        if (delta) {
+            uint32_t value = 0;
+            size_t size = 0;
+            do {
+                if (offset == length || size == 4) { return count; }
+                value = value << 7 | (list[offset] & 0x7F);
+                size++;
+            } while (list[offset++] & 0x80);
+            time += value;
+            if (offset == length) { break; }
+        }
+        delta = 1;
+
+        const size_t size =
+            command_size(receiver, &list[offset], length - offset);
+        if (size == 0) { break; }
+
+        items[count].port = port;
+        items[count].data = &list[offset];
+        items[count].length = size;
+        if (timestamps != NULL) { timestamps[count] = time; }
+        count++;
+
+        /* Follow the state the items lead to */
+        midi_packed_t packed[2];
+        const size_t parsed_count = midi_parse_buffer_packed(
+            &receiver->parser, &list[offset], size, packed, 2, NULL);
+        for (size_t i = 0; i < parsed_count; i++) {
+            midi_state_update_packed(&receiver->state, packed[i]);
+        }
+        offset += size;
+    }
+    return count;
+}
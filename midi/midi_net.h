@@ -0,0 +1,464 @@
+/**********************************************************************
+ * @file midi_net.h
+ * @brief MIDI network transport module
+ *
+ * @details This module carries MIDI over UDP as RTP packets whose payload
+ *          is an RTP-MIDI command section: a list of commands with delta
+ *          times, encoded with running status, so that a packet holds as
+ *          many messages as fit. Packets are built into batches, sent
+ *          with one sendmmsg call and received with one recvmmsg call.
+ *
+ *          The receiver does not copy the commands: each becomes a work
+ *          item of a midi_parser_pool_t that points into the received
+ *          packet, with its timestamp.
+ *
+ *          Every packet carries a recovery journal: the changes to the
+ *          channel state since a checkpoint, as a list of MIDI messages.
+ *          When packets are lost, the receiver plays the messages of the
+ *          journal that change the state it has (notes, controllers,
+ *          program, pitch bend and pressure), so that it is back in step
+ *          with the sender without a full resync. The checkpoint moves
+ *          forward when the sender is told, by a feedback packet from the
+ *          receiver, that a packet was received, which keeps the journal
+ *          short.
+ *
+ *          The command section follows RFC 6295. The journal has its own
+ *          format, so the packets only interoperate with receivers that
+ *          ignore the journal. System Exclusive messages are not sent.
+ *
+ * @see RFC 3550 RTP: A Transport Protocol for Real-Time Applications
+ * @see RFC 6295 RTP Payload Format for MIDI
+ **********************************************************************/
+
+#ifndef MIDI_NET_H
+#define MIDI_NET_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "midi.h"
+#include "midi_encoder.h"
+#include "midi_pool.h"
+#include "midi_state.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Largest packet, the UDP payload that fits an Ethernet frame
+ */
+#define MIDI_NET_MAX_PACKET_SIZE (1472)
+
+/**
+ * @brief Smallest packet size a sender can be given
+ */
+#define MIDI_NET_MIN_PACKET_SIZE (64)
+
+/**
+ * @brief Largest journal, half of the largest packet
+ */
+#define MIDI_NET_MAX_JOURNAL_SIZE (MIDI_NET_MAX_PACKET_SIZE / 2)
+
+/**
+ * @brief Maximum number of packets in a batch
+ */
+#define MIDI_NET_MAX_BATCH (64)
+
+/**
+ * @brief RTP payload type of the packets, from the dynamic range
+ */
+#define MIDI_NET_PAYLOAD_TYPE (97)
+
+/**
+ * @brief Size of a feedback packet
+ */
+#define MIDI_NET_FEEDBACK_SIZE (12)
+
+/**
+ * @brief Size of the storage of a batch
+ * @param packets The number of packets
+ * @param packet_size The size of each packet
+ */
+#define MIDI_NET_BATCH_STORAGE_SIZE(packets, packet_size)                  \
+    ((size_t)(packets) * (size_t)(packet_size))
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Packet Batch
+ * @details Packets to send with one sendmmsg call, or received with one
+ *          recvmmsg call, in caller-provided storage
+ */
+typedef struct midi_net_batch_t {
+    /**
+     * @brief The storage, packet_size bytes per packet
+     */
+    uint8_t *storage;
+
+    /**
+     * @brief The size of each packet in the storage
+     */
+    size_t packet_size;
+
+    /**
+     * @brief The number of packets the storage holds
+     */
+    size_t capacity;
+
+    /**
+     * @brief The number of packets in the batch
+     */
+    size_t count;
+
+    /**
+     * @brief The length of each packet
+     */
+    uint16_t lengths[MIDI_NET_MAX_BATCH];
+} midi_net_batch_t;
+
+/**
+ * @brief Network Checkpoint
+ * @details A channel state whose snapshot is a checkpoint, with the notes
+ *          that sounded since
+ * @note The fields of this struct should not be accessed directly.
+ */
+typedef struct midi_net_checkpoint_t {
+    /**
+     * @brief The channel state, whose snapshot is the checkpoint
+     */
+    midi_state_t state;
+
+    /**
+     * @brief Notes sounding at the checkpoint or started since
+     */
+    midi_state_set_t sounded[MIDI_STATE_CHANNELS];
+
+    /**
+     * @brief Notes whose key was pressed or released since the checkpoint
+     */
+    midi_state_set_t touched[MIDI_STATE_CHANNELS];
+
+    /**
+     * @brief Channels whose sustain pedal was down at the checkpoint or
+     *        since
+     */
+    uint16_t pedal;
+} midi_net_checkpoint_t;
+
+/**
+ * @brief Network Sender
+ * @note The fields of this struct should not be accessed directly.
+ *       Use the `midi_net_*` functions.
+ */
+typedef struct midi_net_sender_t {
+    /**
+     * @brief The checkpoint of the journal
+     */
+    midi_net_checkpoint_t journal_checkpoint;
+
+    /**
+     * @brief The next checkpoint, if pending
+     */
+    midi_net_checkpoint_t next_checkpoint;
+
+    /**
+     * @brief Copy of the journal checkpoint state that the journal is
+     *        read from
+     */
+    midi_state_t scratch;
+
+    /**
+     * @brief The messages and bytes of the journal
+     */
+    midi_message_t changes[MIDI_NET_MAX_JOURNAL_SIZE];
+    uint8_t journal[MIDI_NET_MAX_JOURNAL_SIZE];
+
+    /**
+     * @brief The encoders of the commands and of the journal
+     */
+    midi_encoder_t encoder;
+    midi_encoder_t journal_encoder;
+
+    /**
+     * @brief The synchronization source of the stream
+     */
+    uint32_t ssrc;
+
+    /**
+     * @brief The size of the packets
+     */
+    size_t packet_size;
+
+    /**
+     * @brief The sequence number of the next packet
+     */
+    uint16_t sequence;
+
+    /**
+     * @brief The last packet of the checkpoint
+     */
+    uint16_t checkpoint;
+
+    /**
+     * @brief The last packet of the next checkpoint, if pending
+     */
+    uint16_t pending_sequence;
+    uint8_t pending;
+} midi_net_sender_t;
+
+/**
+ * @brief Network Receiver
+ * @details The counters may be read directly
+ * @note The other fields of this struct should not be accessed directly.
+ *       Use the `midi_net_*` functions.
+ */
+typedef struct midi_net_receiver_t {
+    /**
+     * @brief The channel state the received messages lead to
+     */
+    midi_state_t state;
+
+    /**
+     * @brief The parser that tracks the state
+     */
+    midi_parser_t parser;
+
+    /**
+     * @brief The encoder of the recovered messages
+     */
+    midi_encoder_t encoder;
+
+    /**
+     * @brief The messages of a journal
+     */
+    midi_packed_t journal[MIDI_NET_MAX_JOURNAL_SIZE];
+
+    /**
+     * @brief The synchronization source of the stream
+     */
+    uint32_t ssrc;
+
+    /**
+     * @brief The sequence number of the next packet
+     */
+    uint16_t sequence;
+
+    /**
+     * @brief Running status of the command lists
+     */
+    uint8_t running_status;
+
+    /**
+     * @brief Non-zero once the first packet was received
+     */
+    uint8_t synced;
+
+    /**
+     * @brief The number of packets accepted
+     */
+    size_t packets;
+
+    /**
+     * @brief The number of packets lost
+     */
+    size_t lost;
+
+    /**
+     * @brief The number of lost packets whose changes were recovered
+     *        from a journal
+     */
+    size_t recovered;
+
+    /**
+     * @brief The number of packets ignored because they came late or
+     *        twice, or are not valid packets of the stream
+     */
+    size_t ignored;
+} midi_net_receiver_t;
+
+/*=====================================================================*
+    Public Functions - Batches
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a packet batch
+ * @param [out] batch Pointer to a midi_net_batch_t struct
+ * @param [in] storage Pointer to
+ *      MIDI_NET_BATCH_STORAGE_SIZE(capacity, packet_size) bytes. Must
+ *      stay valid for as long as the batch is used.
+ * @param [in] capacity The number of packets, at most MIDI_NET_MAX_BATCH
+ * @param [in] packet_size The size of each packet, at most
+ *      MIDI_NET_MAX_PACKET_SIZE
+ * @return 1 if the batch was initialized, 0 if an argument is invalid
+ */
+int midi_net_batch_init(midi_net_batch_t *batch,
+                        uint8_t *storage,
+                        size_t capacity,
+                        size_t packet_size);
+
+/**
+ * @brief Remove every packet from a batch
+ * @param [in,out] batch Pointer to a midi_net_batch_t struct
+ */
+void midi_net_batch_clear(midi_net_batch_t *batch);
+
+/**
+ * @brief Get a packet of a batch
+ * @param [in] batch Pointer to a midi_net_batch_t struct
+ * @param [in] index The index of the packet
+ * @param [out] length Pointer that receives the length of the packet
+ * @return Pointer to the packet, or NULL if there is no such packet
+ */
+uint8_t *midi_net_batch_packet(midi_net_batch_t *batch,
+                               size_t index,
+                               size_t *length);
+
+/**
+ * @brief Send the packets of a batch
+ * @details Sends with sendmmsg until every packet is sent or a call
+ *          fails. The packets sent are removed from the batch.
+ * @param [in] fd The UDP socket
+ * @param [in,out] batch Pointer to a midi_net_batch_t struct
+ * @param [in] address The destination, or NULL for a connected socket
+ * @param [in] address_length The size of the destination
+ * @return The number of packets sent
+ */
+size_t midi_net_send(int fd,
+                     midi_net_batch_t *batch,
+                     const struct sockaddr *address,
+                     socklen_t address_length);
+
+/**
+ * @brief Receive packets into a batch
+ * @details Replaces the packets of the batch with those received by one
+ *          recvmmsg call
+ * @param [in] fd The UDP socket
+ * @param [in,out] batch Pointer to a midi_net_batch_t struct
+ * @param [in] flags The flags of recvmmsg, such as MSG_DONTWAIT
+ * @return The number of packets received
+ */
+size_t midi_net_receive(int fd, midi_net_batch_t *batch, int flags);
+
+/*=====================================================================*
+    Public Functions - Sender
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a sender
+ * @details The checkpoint is the initial state of midi_state_init
+ * @param [out] sender Pointer to a midi_net_sender_t struct
+ * @param [in] ssrc The synchronization source of the stream, which
+ *      should be random
+ * @param [in] sequence The sequence number of the first packet, which
+ *      should be random
+ * @param [in] packet_size The size of the packets, clamped to
+ *      MIDI_NET_MIN_PACKET_SIZE and MIDI_NET_MAX_PACKET_SIZE
+ */
+void midi_net_sender_init(midi_net_sender_t *sender,
+                          uint32_t ssrc,
+                          uint16_t sequence,
+                          size_t packet_size);
+
+/**
+ * @brief Pack messages into packets
+ * @details Appends packets to the batch, each with as many messages as
+ *          fit after its journal, until every message is packed or the
+ *          batch is full. The RTP timestamp of a packet is the timestamp
+ *          of its first message, and the others are sent as delta times,
+ *          of up to 2^28 - 1. Messages that cannot be encoded are
+ *          skipped. The journal holds the changes since the checkpoint,
+ *          in up to half of the packet. A packet whose changes do not fit
+ *          is sent without a journal, so receivers should send feedback
+ *          often.
+ * @param [in,out] sender Pointer to a midi_net_sender_t struct
+ * @param [in] messages Pointer to the messages
+ * @param [in] timestamps Pointer to the timestamp of each message, in
+ *      the units of the RTP clock, or NULL to send every message at 0
+ * @param [in] count The number of messages
+ * @param [in,out] batch Pointer to the batch that receives the packets.
+ *      Its packets must be at least as large as the packets of the
+ *      sender.
+ * @return The number of messages packed or skipped
+ */
+size_t midi_net_sender_pack(midi_net_sender_t *sender,
+                            const midi_packed_t *messages,
+                            const uint32_t *timestamps,
+                            size_t count,
+                            midi_net_batch_t *batch);
+
+/**
+ * @brief Handle a feedback packet
+ * @details Moves the checkpoint forward if the receiver has every packet
+ *          of the next checkpoint
+ * @param [in,out] sender Pointer to a midi_net_sender_t struct
+ * @param [in] packet Pointer to the packet
+ * @param [in] length The length of the packet
+ * @return 1 if the checkpoint moved, 0 otherwise
+ */
+int midi_net_sender_feedback(midi_net_sender_t *sender,
+                             const uint8_t *packet,
+                             size_t length);
+
+/*=====================================================================*
+    Public Functions - Receiver
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a receiver
+ * @details The first packet received sets the stream the receiver
+ *          follows
+ * @param [out] receiver Pointer to a midi_net_receiver_t struct
+ */
+void midi_net_receiver_init(midi_net_receiver_t *receiver);
+
+/**
+ * @brief Decode a packet into parser pool work items
+ * @details Writes one item per command, pointing into the packet. When
+ *          packets were lost, the first item holds the messages of the
+ *          journal that change the state of the receiver, which are
+ *          written over the journal in the packet. Packets that are late,
+ *          repeated, of another stream or not valid are ignored.
+ * @param [in,out] receiver Pointer to a midi_net_receiver_t struct
+ * @param [in,out] packet Pointer to the packet
+ * @param [in] length The length of the packet
+ * @param [in] port The port of the items
+ * @param [out] items Pointer to an array that receives the items. They
+ *      are valid for as long as the packet is.
+ * @param [out] timestamps Pointer to an array that receives the
+ *      timestamp of each item, or NULL
+ * @param [in] capacity The number of entries in the items and timestamps
+ *      arrays. Commands that do not fit are dropped; length + 1 is
+ *      always enough.
+ * @return The number of items written
+ */
+size_t midi_net_receiver_decode(midi_net_receiver_t *receiver,
+                                uint8_t *packet,
+                                size_t length,
+                                uint32_t port,
+                                midi_parser_pool_work_t *items,
+                                uint32_t *timestamps,
+                                size_t capacity);
+
+/**
+ * @brief Write a feedback packet
+ * @details Tells the sender the last packet received, or recovered, so
+ *          that it can move its checkpoint forward. The format is the
+ *          Receiver Feedback command of the Apple MIDI session protocol.
+ * @param [in] receiver Pointer to a midi_net_receiver_t struct
+ * @param [out] buffer Pointer to the buffer that receives the packet
+ * @param [in] capacity The size of the buffer
+ * @return MIDI_NET_FEEDBACK_SIZE, or 0 if no packet was received yet or
+ *      the buffer is too small
+ */
+size_t midi_net_receiver_feedback(const midi_net_receiver_t *receiver,
+                                  uint8_t *buffer,
+                                  size_t capacity);
+
+#endif /* MIDI_NET_H */
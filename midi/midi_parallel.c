@@ -0,0 +1,394 @@
+/***********************************************************************
+ * @file midi_parallel.c
+ * @brief MIDI parallel decoder implementation
+ *
+ * @details Scans chunks from their sync points, links the parser states
+ *          across the chunk boundaries in order, and emits each chunk
+ *          from its exact start state. midi_parallel_decode runs the
+ *          scan and emit passes on POSIX threads, one chunk per thread.
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_parallel.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Number of messages parsed at a time when only counting
+ */
+#define PARALLEL_SCRATCH_SIZE (256)
+
+/**
+ * @brief Lowest status byte
+ */
+#define PARALLEL_STATUS_BIT (0x80)
+
+/**
+ * @brief First System Real-Time status byte
+ */
+#define PARALLEL_FIRST_REALTIME (0xF8)
+
+/**
+ * @brief Undefined System Common status bytes, which keep the state
+ */
+#define PARALLEL_UNDEFINED_F4 (0xF4)
+#define PARALLEL_UNDEFINED_F5 (0xF5)
+
+/*=====================================================================*
+    Private Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Parallel decoder passes run by a worker
+ */
+typedef enum parallel_pass_t {
+    PARALLEL_PASS_SCAN,
+    PARALLEL_PASS_EMIT,
+} parallel_pass_t;
+
+/**
+ * @brief Work of one thread of midi_parallel_decode
+ */
+typedef struct parallel_worker_t {
+    midi_parallel_chunk_t *chunk;
+    const midi_parser_t *config;
+    const midi_parser_state_t *start;
+    midi_packed_t *messages;
+    parallel_pass_t pass;
+} parallel_worker_t;
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static inline void make_parser(const midi_parser_t *config,
+                               midi_parser_t *parser);
+
+static inline int is_sync_byte(uint8_t byte);
+
+static size_t count_messages(midi_parser_t *parser,
+                             const uint8_t *data,
+                             size_t length);
+
+static void *run_worker(void *argument);
+
+static void run_pass(parallel_worker_t *workers, size_t count);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a chunk
+ * @param [out] chunk Pointer to a midi_parallel_chunk_t struct
+ * @param [in] data Pointer to the bytes of the chunk
+ * @param [in] length The number of bytes in the chunk
+ */
+void midi_parallel_chunk_init(midi_parallel_chunk_t *chunk,
+                              const uint8_t *data,
+                              size_t length)
+{
+    /* Check for NULL pointers */
+    if (chunk == NULL) { return; }
+
+    memset(chunk, 0, sizeof(*chunk));
+    chunk->data = data;
+    chunk->length = data != NULL ? length : 0;
+    chunk->sync = chunk->length;
+}
+
+/**
+ * @brief Scan a chunk
+ * @param [in,out] chunk Pointer to a midi_parallel_chunk_t struct
+ * @param [in] config Pointer to the parser whose filters are used
+ * @param [in] start Pointer to the state at the start of the chunk, or
+ *      NULL to scan from the sync point
+ */
+void midi_parallel_scan(midi_parallel_chunk_t *chunk,
+                        const midi_parser_t *config,
+                        const midi_parser_state_t *start)
+{
+    /* Check for NULL pointers */
+    if (chunk == NULL || config == NULL) { return; }
+
+    midi_parser_t parser;
+    make_parser(config, &parser);
+
+    if (start != NULL) {
+        midi_parser_restore_state(&parser, start);
+        chunk->sync = 0;
+    } else {
+        midi_parser_reset(&parser);
+        chunk->sync = 0;
+        while (chunk->sync < chunk->length
+               && !is_sync_byte(chunk->data[chunk->sync])) {
+            chunk->sync++;
+        }
+    }
+
+    chunk->count = count_messages(
+        &parser, &chunk->data[chunk->sync], chunk->length - chunk->sync);
+    midi_parser_save_state(&parser, &chunk->end);
+    chunk->sysex_started =
+        memchr(&chunk->data[chunk->sync], MIDI_MESSAGE_SYSTEM_EXCLUSIVE,
+               chunk->length - chunk->sync)
+        != NULL;
+}
+
+/**
+ * @brief Link scanned chunks
+ * @param [in,out] chunks Pointer to the chunks, in stream order
+ * @param [in] count The number of chunks
+ * @param [in] config Pointer to the parser whose filters are used
+ * @param [in] start Pointer to the state at the start of the first chunk
+ * @return The total number of messages
+ */
+size_t midi_parallel_link(midi_parallel_chunk_t *chunks,
+                          size_t count,
+                          const midi_parser_t *config,
+                          const midi_parser_state_t *start)
+{
+    /* Check for NULL pointers */
+    if (chunks == NULL || config == NULL || start == NULL) { return 0; }
+
+    midi_parser_state_t state = *start;
+    size_t total = 0;
+
+    for (size_t c = 0; c < count; c++) {
+        midi_parallel_chunk_t *chunk = &chunks[c];
+        midi_parser_t parser;
+
+        chunk->start = state;
+        chunk->offset = total;
+
+        /* Only data, realtime and undefined bytes come before the sync */
+        make_parser(config, &parser);
+        midi_parser_restore_state(&parser, &state);
+        const size_t prefix =
+            count_messages(&parser, chunk->data, chunk->sync);
+
+        if (chunk->sync == chunk->length) {
+            chunk->count = prefix;
+            midi_parser_save_state(&parser, &chunk->end);
+        } else {
+            /*
+             * The sync byte sets everything but the SysEx flags, which
+             * only a SysEx after it changes
+             */
+            chunk->count += prefix;
+            if (!chunk->sysex_started) {
+                chunk->end.sysex_flags = parser.sysex_flags;
+            }
+        }
+
+        state = chunk->end;
+        total += chunk->count;
+    }
+
+    return total;
+}
+
+/**
+ * @brief Emit the messages of a linked chunk
+ * @param [in] chunk Pointer to a linked midi_parallel_chunk_t struct
+ * @param [in] config Pointer to the parser whose filters are used
+ * @param [out] messages Pointer to the output array
+ * @return The number of messages written
+ */
+size_t midi_parallel_emit(const midi_parallel_chunk_t *chunk,
+                          const midi_parser_t *config,
+                          midi_packed_t *messages)
+{
+    /* Check for NULL pointers */
+    if (chunk == NULL || config == NULL || messages == NULL
+        || chunk->data == NULL) {
+        return 0;
+    }
+
+    midi_parser_t parser;
+    make_parser(config, &parser);
+    midi_parser_restore_state(&parser, &chunk->start);
+
+    return midi_parse_buffer_packed(&parser, chunk->data, chunk->length,
+                                    &messages[chunk->offset], chunk->count,
+                                    NULL);
+}
+
+/**
+ * @brief Decode a stream on several threads
+ * @param [in] config Pointer to the parser whose filters are used, or NULL
+ * @param [in] stream Pointer to the stream
+ * @param [in] length The number of bytes in the stream
+ * @param [out] messages Pointer to the output array
+ * @param [in] capacity The number of entries in the messages array
+ * @param [in] threads The number of threads
+ * @param [in,out] state Pointer to the parser state at the start of the
+ *      stream, which receives the state at its end, or NULL
+ * @return The number of messages written
+ */
+size_t midi_parallel_decode(const midi_parser_t *config,
+                            const uint8_t *stream,
+                            size_t length,
+                            midi_packed_t *messages,
+                            size_t capacity,
+                            size_t threads,
+                            midi_parser_state_t *state)
+{
+    /* Check for NULL pointers */
+    if (stream == NULL || messages == NULL || threads == 0
+        || threads > MIDI_PARALLEL_MAX_THREADS) {
+        return 0;
+    }
+
+    midi_parser_t defaults;
+    if (config == NULL) {
+        midi_parser_init(&defaults);
+        config = &defaults;
+    }
+
+    midi_parser_state_t start;
+    if (state != NULL) {
+        start = *state;
+    } else {
+        midi_parser_t parser;
+        make_parser(config, &parser);
+        midi_parser_reset(&parser);
+        midi_parser_save_state(&parser, &start);
+    }
+
+    /* Give each thread at least MIDI_PARALLEL_MIN_CHUNK bytes */
+    size_t count = length / MIDI_PARALLEL_MIN_CHUNK;
+    if (count > threads) { count = threads; }
+    if (count == 0) { count = 1; }
+
+    midi_parallel_chunk_t chunks[MIDI_PARALLEL_MAX_THREADS];
+    parallel_worker_t workers[MIDI_PARALLEL_MAX_THREADS];
+
+    for (size_t c = 0; c < count; c++) {
+        const size_t begin = length * c / count;
+        const size_t end = length * (c + 1) / count;
+
+        midi_parallel_chunk_init(&chunks[c], &stream[begin], end - begin);
+        workers[c].chunk = &chunks[c];
+        workers[c].config = config;
+        workers[c].start = c == 0 ? &start : NULL;
+        workers[c].messages = messages;
+        workers[c].pass = PARALLEL_PASS_SCAN;
+    }
+    run_pass(workers, count);
+
+    const size_t total = midi_parallel_link(chunks, count, config, &start);
+    if (total > capacity) { return 0; }
+
+    for (size_t c = 0; c < count; c++) {
+        workers[c].pass = PARALLEL_PASS_EMIT;
+    }
+    run_pass(workers, count);
+
+    if (state != NULL) { *state = chunks[count - 1].end; }
+    return total;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Copy the filters of a parser, without its handlers
+ */
+static inline void make_parser(const midi_parser_t *config,
+                               midi_parser_t *parser)
+{
+    *parser = *config;
+    parser->sysex_handler = NULL;
+    parser->sysex_context = NULL;
+    parser->realtime_handler = NULL;
+    parser->timestamp_source = NULL;
+    parser->realtime_context = NULL;
+}
+
+/**
+ * @brief Check whether a byte sets the whole message state of a parser
+ */
+static inline int is_sync_byte(uint8_t byte)
+{
+    return byte >= PARALLEL_STATUS_BIT && byte < PARALLEL_FIRST_REALTIME
+           && byte != PARALLEL_UNDEFINED_F4 && byte != PARALLEL_UNDEFINED_F5;
+}
+
+/**
+ * @brief Parse bytes, only counting the messages
+ */
+static size_t count_messages(midi_parser_t *parser,
+                             const uint8_t *data,
+                             size_t length)
+{
+    midi_packed_t scratch[PARALLEL_SCRATCH_SIZE];
+    size_t count = 0;
+    size_t index = 0;
+
+    while (index < length) {
+        size_t consumed = 0;
+        count += midi_parse_buffer_packed(parser, &data[index],
+                                          length - index, scratch,
+                                          PARALLEL_SCRATCH_SIZE, &consumed);
+        if (consumed == 0) { break; }
+        index += consumed;
+    }
+    return count;
+}
+
+/**
+ * @brief Run one pass on the chunk of a worker
+ */
+static void *run_worker(void *argument)
+{
+    parallel_worker_t *worker = (parallel_worker_t *)argument;
+
+    if (worker->pass == PARALLEL_PASS_SCAN) {
+        midi_parallel_scan(worker->chunk, worker->config, worker->start);
+    } else {
+        midi_parallel_emit(worker->chunk, worker->config, worker->messages);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Run a pass on every worker, the first one on the calling thread
+ * @details A worker whose thread cannot be started runs on the calling
+ *          thread instead
+ */
+static void run_pass(parallel_worker_t *workers, size_t count)
+{
+    pthread_t handles[MIDI_PARALLEL_MAX_THREADS];
+    int started[MIDI_PARALLEL_MAX_THREADS];
+
+    for (size_t w = 1; w < count; w++) {
+        started[w] =
+            pthread_create(&handles[w], NULL, run_worker, &workers[w]) == 0;
+    }
+    run_worker(&workers[0]);
+    for (size_t w = 1; w < count; w++) {
+        if (started[w]) {
+            pthread_join(handles[w], NULL);
+        } else {
+            run_worker(&workers[w]);
+        }
+    }
+}
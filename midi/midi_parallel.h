@@ -0,0 +1,196 @@
+/**********************************************************************
+ * @file midi_parallel.h
+ * @brief MIDI parallel decoder module
+ *
+ * @details This module decodes a large captured MIDI 1.0 byte stream on
+ *          several threads, with output identical to a sequential parse.
+ *
+ *          Running status makes the meaning of a byte depend on the bytes
+ *          before it, but every status byte other than System Real-Time
+ *          and the undefined 0xF4 and 0xF5 sets the whole message state.
+ *          The stream is split into chunks, and decoding runs in three
+ *          passes:
+ *          1. Scan, in parallel: each chunk is parsed from its first such
+ *             status byte, its sync point, counting the messages and
+ *             keeping the parser state at its end.
+ *          2. Link, in order: the few bytes before each sync point are
+ *             parsed from the end state of the previous chunk, which
+ *             gives the exact state at the start and end of every chunk
+ *             and the output offset of its messages.
+ *          3. Emit, in parallel: each chunk is parsed again from its exact
+ *             start state, straight into its place in the output.
+ *
+ *          The chunk functions hold no threading code, so any thread pool
+ *          can run them. midi_parallel_decode runs them on POSIX threads.
+ *
+ *          The parser handlers are not used: System Real-Time messages
+ *          are returned in the output and SysEx payloads are skipped, as
+ *          by a parser without handlers.
+ **********************************************************************/
+
+#ifndef MIDI_PARALLEL_H
+#define MIDI_PARALLEL_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Maximum number of threads of midi_parallel_decode
+ */
+#define MIDI_PARALLEL_MAX_THREADS (64)
+
+/**
+ * @brief Smallest chunk that midi_parallel_decode gives a thread, in bytes
+ * @details Shorter streams use fewer threads
+ */
+#define MIDI_PARALLEL_MIN_CHUNK (4096)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Parallel Decoder Chunk
+ */
+typedef struct midi_parallel_chunk_t {
+    /**
+     * @brief Pointer to the bytes of the chunk
+     */
+    const uint8_t *data;
+
+    /**
+     * @brief The number of bytes in the chunk
+     */
+    size_t length;
+
+    /**
+     * @brief Offset of the sync point in the chunk, or length if the
+     *        chunk has none
+     */
+    size_t sync;
+
+    /**
+     * @brief The number of messages of the chunk
+     * @details Counts the messages after the sync point once scanned, and
+     *          all of them once linked
+     */
+    size_t count;
+
+    /**
+     * @brief Offset of the first message of the chunk in the output,
+     *        once linked
+     */
+    size_t offset;
+
+    /**
+     * @brief Parser state at the start of the chunk, once linked
+     */
+    midi_parser_state_t start;
+
+    /**
+     * @brief Parser state at the end of the chunk
+     */
+    midi_parser_state_t end;
+
+    /**
+     * @brief Non-zero if a SysEx starts after the sync point
+     */
+    uint8_t sysex_started;
+} midi_parallel_chunk_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a chunk
+ * @param [out] chunk Pointer to a midi_parallel_chunk_t struct
+ * @param [in] data Pointer to the bytes of the chunk
+ * @param [in] length The number of bytes in the chunk
+ */
+void midi_parallel_chunk_init(midi_parallel_chunk_t *chunk,
+                              const uint8_t *data,
+                              size_t length);
+
+/**
+ * @brief Scan a chunk
+ * @details Safe to call for several chunks at once from different
+ *          threads
+ * @param [in,out] chunk Pointer to a midi_parallel_chunk_t struct
+ * @param [in] config Pointer to the parser whose filters are used
+ * @param [in] start Pointer to the state at the start of the chunk if it
+ *      is known, as for the first chunk, or NULL to scan from the sync
+ *      point
+ */
+void midi_parallel_scan(midi_parallel_chunk_t *chunk,
+                        const midi_parser_t *config,
+                        const midi_parser_state_t *start);
+
+/**
+ * @brief Link scanned chunks
+ * @details Must be called once, after every chunk is scanned. Parses the
+ *          bytes before each sync point in order.
+ * @param [in,out] chunks Pointer to the chunks, in stream order
+ * @param [in] count The number of chunks
+ * @param [in] config Pointer to the parser whose filters are used
+ * @param [in] start Pointer to the state at the start of the first chunk.
+ *      Must be the state it was scanned with.
+ * @return The total number of messages
+ */
+size_t midi_parallel_link(midi_parallel_chunk_t *chunks,
+                          size_t count,
+                          const midi_parser_t *config,
+                          const midi_parser_state_t *start);
+
+/**
+ * @brief Emit the messages of a linked chunk
+ * @details Safe to call for several chunks at once from different
+ *          threads
+ * @param [in] chunk Pointer to a linked midi_parallel_chunk_t struct
+ * @param [in] config Pointer to the parser whose filters are used
+ * @param [out] messages Pointer to the output array. The chunk writes
+ *      its count messages from its offset.
+ * @return The number of messages written
+ */
+size_t midi_parallel_emit(const midi_parallel_chunk_t *chunk,
+                          const midi_parser_t *config,
+                          midi_packed_t *messages);
+
+/**
+ * @brief Decode a stream on several threads
+ * @details Equivalent to midi_parse_buffer_packed on a parser with the
+ *          filters of config, no handlers and the given state
+ * @param [in] config Pointer to the parser whose filters are used, or
+ *      NULL for the defaults of midi_parser_init
+ * @param [in] stream Pointer to the stream
+ * @param [in] length The number of bytes in the stream
+ * @param [out] messages Pointer to the output array
+ * @param [in] capacity The number of entries in the messages array. A
+ *      stream of length bytes has at most length messages.
+ * @param [in] threads The number of threads, from 1 to
+ *      MIDI_PARALLEL_MAX_THREADS
+ * @param [in,out] state Pointer to the parser state at the start of the
+ *      stream, which receives the state at its end. NULL to start from a
+ *      reset parser.
+ * @return The number of messages written, or 0 if the arguments are
+ *      invalid or the messages do not fit. A chunk whose thread cannot
+ *      be started is decoded on the calling thread.
+ */
+size_t midi_parallel_decode(const midi_parser_t *config,
+                            const uint8_t *stream,
+                            size_t length,
+                            midi_packed_t *messages,
+                            size_t capacity,
+                            size_t threads,
+                            midi_parser_state_t *state);
+
+#endif /* MIDI_PARALLEL_H */
@@ -0,0 +1,432 @@
+/***********************************************************************
+ * @file midi_param.c
+ * @brief MIDI parameter decoder implementation
+ *
+ * @details Assembles 14-bit controllers and RPN/NRPN changes from the
+ *          Control Change messages of the parser. Each channel keeps its
+ *          MSB latches, its selected parameters and at most one MSB that
+ *          waits for its LSB.
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_param.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Number of channels
+ */
+#define PARAM_CHANNELS (16)
+
+/**
+ * @brief Value of midi_param_channel_t.pending when no MSB is pending
+ */
+#define PARAM_NO_PENDING (0xFF)
+
+/**
+ * @brief Values of midi_param_channel_t.selected
+ */
+#define PARAM_SELECTED_NONE (0)
+#define PARAM_SELECTED_RPN (1)
+#define PARAM_SELECTED_NRPN (2)
+
+/**
+ * @brief Mask of the 7-bit data values
+ */
+#define PARAM_DATA_MASK (0x7F)
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static midi_param_event_type_t data_parameter(
+    const midi_param_decoder_t *decoder,
+    size_t channel);
+
+static int is_composite(const midi_param_decoder_t *decoder,
+                        size_t channel,
+                        size_t controller);
+
+static void make_value_event(const midi_param_decoder_t *decoder,
+                             size_t channel,
+                             size_t controller,
+                             uint16_t value,
+                             uint32_t timestamp,
+                             midi_param_event_t *event);
+
+static void flush_channel(midi_param_decoder_t *decoder,
+                          size_t channel,
+                          midi_param_event_t *event);
+
+static void select_parameter(midi_param_decoder_t *decoder,
+                             size_t channel,
+                             size_t controller,
+                             uint8_t value);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a parameter decoder
+ * @param [out] decoder Pointer to a midi_param_decoder_t struct
+ * @param [in] flags The composite messages to assemble
+ * @param [in] order When 14-bit values are emitted
+ * @param [in] timeout The time after which a pending MSB is emitted alone
+ */
+void midi_param_init(midi_param_decoder_t *decoder,
+                     uint8_t flags,
+                     midi_param_order_t order,
+                     uint32_t timeout)
+{
+    /* Check for NULL pointers */
+    if (decoder == NULL) { return; }
+
+    decoder->flags = flags & MIDI_PARAM_FLAG_ALL;
+    decoder->order = order;
+    decoder->timeout = timeout;
+    midi_param_reset(decoder);
+}
+
+/**
+ * @brief Reset the decoder
+ * @param [in,out] decoder Pointer to a midi_param_decoder_t struct
+ */
+void midi_param_reset(midi_param_decoder_t *decoder)
+{
+    /* Check for NULL pointers */
+    if (decoder == NULL) { return; }
+
+    for (size_t channel = 0; channel < PARAM_CHANNELS; channel++) {
+        midi_param_channel_t *state = &decoder->channels[channel];
+
+        memset(state->msb, 0, sizeof(state->msb));
+        state->rpn = MIDI_PARAM_NULL;
+        state->nrpn = MIDI_PARAM_NULL;
+        state->selected = PARAM_SELECTED_NONE;
+        state->pending = PARAM_NO_PENDING;
+        state->pending_timestamp = 0;
+    }
+    decoder->pending_channels = 0;
+}
+
+/**
+ * @brief Decode a message
+ * @param [in,out] decoder Pointer to a midi_param_decoder_t struct
+ * @param [in] message Pointer to the message
+ * @param [in] timestamp The time the message was received
+ * @param [out] events Pointer to an array that receives the events
+ * @param [in] capacity The number of entries in the events array
+ * @return The number of events written
+ */
+size_t midi_param_process(midi_param_decoder_t *decoder,
+                          const midi_message_t *message,
+                          uint32_t timestamp,
+                          midi_param_event_t *events,
+                          size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (decoder == NULL || message == NULL || events == NULL
+        || capacity < MIDI_PARAM_MAX_EVENTS) {
+        return 0;
+    }
+
+    size_t count = 0;
+    const size_t channel = (size_t)message->channel;
+
+    if (channel < PARAM_CHANNELS) {
+        midi_param_channel_t *state = &decoder->channels[channel];
+        const size_t controller = (size_t)message->controller;
+        const uint8_t value = message->control_value & PARAM_DATA_MASK;
+        const int is_control =
+            message->message_type == MIDI_MESSAGE_CONTROL_CHANGE;
+
+        /* Emit a pending MSB unless this is its LSB, in time */
+        if (state->pending != PARAM_NO_PENDING) {
+            const int expired =
+                decoder->timeout != 0
+                && timestamp - state->pending_timestamp >= decoder->timeout;
+            const int completes =
+                is_control
+                && controller == (size_t)state->pending
+                                     + MIDI_PARAM_CONTROLLERS;
+
+            if (expired || !completes) {
+                flush_channel(decoder, channel, &events[count++]);
+            }
+        }
+
+        if (is_control && controller < MIDI_PARAM_CONTROLLERS
+            && is_composite(decoder, channel, controller)) {
+            state->msb[controller] = value;
+            if (decoder->order == MIDI_PARAM_ORDER_PAIRED) {
+                state->pending = (uint8_t)controller;
+                state->pending_timestamp = timestamp;
+                decoder->pending_channels |= (uint16_t)(1u << channel);
+                return count;
+            }
+            make_value_event(decoder, channel, controller,
+                             (uint16_t)(value << 7), timestamp,
+                             &events[count++]);
+            return count;
+        }
+
+        if (is_control && controller >= MIDI_PARAM_CONTROLLERS
+            && controller < 2 * MIDI_PARAM_CONTROLLERS
+            && is_composite(decoder, channel,
+                            controller - MIDI_PARAM_CONTROLLERS)) {
+            const size_t msb = controller - MIDI_PARAM_CONTROLLERS;
+
+            state->pending = PARAM_NO_PENDING;
+            decoder->pending_channels &= (uint16_t)~(1u << channel);
+            make_value_event(decoder, channel, msb,
+                             (uint16_t)((state->msb[msb] << 7) | value),
+                             timestamp, &events[count++]);
+            return count;
+        }
+
+        if (is_control
+            && (controller == MIDI_CC_DATA_INCREMENT
+                || controller == MIDI_CC_DATA_DECREMENT)
+            && data_parameter(decoder, channel) != MIDI_PARAM_EVENT_MESSAGE) {
+            midi_param_event_t *event = &events[count++];
+
+            event->type = data_parameter(decoder, channel);
+            event->op = controller == MIDI_CC_DATA_INCREMENT
+                            ? MIDI_PARAM_OP_INCREMENT
+                            : MIDI_PARAM_OP_DECREMENT;
+            event->channel = message->channel;
+            event->number = event->type == MIDI_PARAM_EVENT_RPN
+                                ? state->rpn
+                                : state->nrpn;
+            event->value = 0;
+            event->timestamp = timestamp;
+            event->message = 0;
+            return count;
+        }
+
+        if (is_control
+            && (((controller == MIDI_CC_RPN_LSB
+                  || controller == MIDI_CC_RPN_MSB)
+                 && (decoder->flags & MIDI_PARAM_FLAG_RPN))
+                || ((controller == MIDI_CC_NRPN_LSB
+                     || controller == MIDI_CC_NRPN_MSB)
+                    && (decoder->flags & MIDI_PARAM_FLAG_NRPN)))) {
+            select_parameter(decoder, channel, controller, value);
+            return count;
+        }
+
+        if (message->message_type == MIDI_MESSAGE_RESET_ALL_CONTROLLERS) {
+            state->rpn = MIDI_PARAM_NULL;
+            state->nrpn = MIDI_PARAM_NULL;
+            state->selected = PARAM_SELECTED_NONE;
+        }
+    } else if (message->message_type == MIDI_MESSAGE_SYSTEM_RESET) {
+        midi_param_reset(decoder);
+    }
+
+    /* Everything else passes through */
+    midi_param_event_t *event = &events[count++];
+    event->type = MIDI_PARAM_EVENT_MESSAGE;
+    event->op = MIDI_PARAM_OP_SET;
+    event->channel = message->channel;
+    event->number = 0;
+    event->value = 0;
+    event->timestamp = timestamp;
+    event->message = midi_message_pack(message);
+    return count;
+}
+
+/**
+ * @brief Emit the pending MSBs whose timeout expired
+ * @param [in,out] decoder Pointer to a midi_param_decoder_t struct
+ * @param [in] now The current time
+ * @param [out] events Pointer to an array that receives the events
+ * @param [in] capacity The number of entries in the events array
+ * @return The number of events written
+ */
+size_t midi_param_poll(midi_param_decoder_t *decoder,
+                       uint32_t now,
+                       midi_param_event_t *events,
+                       size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (decoder == NULL || events == NULL || decoder->timeout == 0) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (size_t channel = 0; channel < PARAM_CHANNELS && count < capacity;
+         channel++) {
+        const midi_param_channel_t *state = &decoder->channels[channel];
+
+        if ((decoder->pending_channels & (1u << channel))
+            && now - state->pending_timestamp >= decoder->timeout) {
+            flush_channel(decoder, channel, &events[count++]);
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Emit every pending MSB
+ * @param [in,out] decoder Pointer to a midi_param_decoder_t struct
+ * @param [out] events Pointer to an array that receives the events
+ * @param [in] capacity The number of entries in the events array
+ * @return The number of events written
+ */
+size_t midi_param_flush(midi_param_decoder_t *decoder,
+                        midi_param_event_t *events,
+                        size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (decoder == NULL || events == NULL) { return 0; }
+
+    size_t count = 0;
+    for (size_t channel = 0; channel < PARAM_CHANNELS && count < capacity;
+         channel++) {
+        if (decoder->pending_channels & (1u << channel)) {
+            flush_channel(decoder, channel, &events[count++]);
+        }
+    }
+    return count;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Get the kind of parameter that Data Entry changes on a channel
+ * @return MIDI_PARAM_EVENT_RPN or MIDI_PARAM_EVENT_NRPN, or
+ *         MIDI_PARAM_EVENT_MESSAGE if no enabled parameter is selected
+ */
+static midi_param_event_type_t data_parameter(
+    const midi_param_decoder_t *decoder,
+    size_t channel)
+{
+    const midi_param_channel_t *state = &decoder->channels[channel];
+
+    if (state->selected == PARAM_SELECTED_RPN
+        && state->rpn != MIDI_PARAM_NULL) {
+        return MIDI_PARAM_EVENT_RPN;
+    }
+    if (state->selected == PARAM_SELECTED_NRPN
+        && state->nrpn != MIDI_PARAM_NULL) {
+        return MIDI_PARAM_EVENT_NRPN;
+    }
+    return MIDI_PARAM_EVENT_MESSAGE;
+}
+
+/**
+ * @brief Check whether an MSB controller is assembled into events
+ */
+static int is_composite(const midi_param_decoder_t *decoder,
+                        size_t channel,
+                        size_t controller)
+{
+    if (controller == MIDI_CC_DATA_ENTRY_MSB
+        && data_parameter(decoder, channel) != MIDI_PARAM_EVENT_MESSAGE) {
+        return 1;
+    }
+    return (decoder->flags & MIDI_PARAM_FLAG_CONTROLLERS) != 0;
+}
+
+/**
+ * @brief Build the event of a 14-bit value
+ * @details Data Entry changes the selected parameter, if any
+ */
+static void make_value_event(const midi_param_decoder_t *decoder,
+                             size_t channel,
+                             size_t controller,
+                             uint16_t value,
+                             uint32_t timestamp,
+                             midi_param_event_t *event)
+{
+    const midi_param_channel_t *state = &decoder->channels[channel];
+    const midi_param_event_type_t parameter =
+        data_parameter(decoder, channel);
+
+    event->op = MIDI_PARAM_OP_SET;
+    event->channel = (midi_channel_t)channel;
+    event->value = value;
+    event->timestamp = timestamp;
+    event->message = 0;
+
+    if (controller == MIDI_CC_DATA_ENTRY_MSB
+        && parameter != MIDI_PARAM_EVENT_MESSAGE) {
+        event->type = parameter;
+        event->number = parameter == MIDI_PARAM_EVENT_RPN ? state->rpn
+                                                          : state->nrpn;
+    } else {
+        event->type = MIDI_PARAM_EVENT_CONTROLLER;
+        event->number = (uint16_t)controller;
+    }
+}
+
+/**
+ * @brief Emit the pending MSB of a channel alone
+ */
+static void flush_channel(midi_param_decoder_t *decoder,
+                          size_t channel,
+                          midi_param_event_t *event)
+{
+    midi_param_channel_t *state = &decoder->channels[channel];
+    const size_t controller = state->pending;
+
+    make_value_event(decoder, channel, controller,
+                     (uint16_t)(state->msb[controller] << 7),
+                     state->pending_timestamp, event);
+    state->pending = PARAM_NO_PENDING;
+    decoder->pending_channels &= (uint16_t)~(1u << channel);
+}
+
+/**
+ * @brief Update the parameter selection of a channel
+ * @details Selecting a parameter clears the Data Entry MSB latch, so that
+ *          an LSB alone does not combine with the value of another
+ *          parameter
+ */
+static void select_parameter(midi_param_decoder_t *decoder,
+                             size_t channel,
+                             size_t controller,
+                             uint8_t value)
+{
+    midi_param_channel_t *state = &decoder->channels[channel];
+
+    switch (controller) {
+    case MIDI_CC_RPN_MSB:
+        state->rpn = (uint16_t)((state->rpn & 0x7F) | (value << 7));
+        state->selected = PARAM_SELECTED_RPN;
+        break;
+    case MIDI_CC_RPN_LSB:
+        state->rpn = (uint16_t)((state->rpn & 0x3F80) | value);
+        state->selected = PARAM_SELECTED_RPN;
+        break;
+    case MIDI_CC_NRPN_MSB:
+        state->nrpn = (uint16_t)((state->nrpn & 0x7F) | (value << 7));
+        state->selected = PARAM_SELECTED_NRPN;
+        break;
+    case MIDI_CC_NRPN_LSB:
+    default:
+        state->nrpn = (uint16_t)((state->nrpn & 0x3F80) | value);
+        state->selected = PARAM_SELECTED_NRPN;
+        break;
+    }
+    state->msb[MIDI_CC_DATA_ENTRY_MSB] = 0;
+}
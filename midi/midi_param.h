@@ -0,0 +1,275 @@
+/**********************************************************************
+ * @file midi_param.h
+ * @brief MIDI parameter decoder module
+ *
+ * @details This module is an optional stage after the parser that
+ *          assembles multi-message parameter changes into single events:
+ *          - 14-bit controllers, from an MSB (controllers 0 to 31) and
+ *            its LSB (controllers 32 to 63)
+ *          - Registered and Non-Registered Parameter Numbers, from the
+ *            parameter selection (controllers 98 to 101) and the Data
+ *            Entry (controllers 6 and 38), Increment and Decrement
+ *            (controllers 96 and 97) controllers
+ *
+ *          The selected parameters and the MSB latches of each channel
+ *          are kept in a compact table. Every other message passes
+ *          through unchanged as an event of its own, in order.
+ *
+ * @see MIDI 1.0 Detailed Specification
+ *      https://midi.org/midi-1-0-detailed-specification
+ * @see RP-015 Response to Reset All Controllers
+ **********************************************************************/
+
+#ifndef MIDI_PARAM_H
+#define MIDI_PARAM_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Maximum number of events for one message
+ * @details A pending MSB that the message completes or flushes, and the
+ *          event of the message itself
+ */
+#define MIDI_PARAM_MAX_EVENTS (2)
+
+/**
+ * @brief Number of controllers with a 14-bit LSB partner
+ */
+#define MIDI_PARAM_CONTROLLERS (32)
+
+/**
+ * @brief Parameter number of the null RPN and NRPN, which selects none
+ */
+#define MIDI_PARAM_NULL (0x3FFF)
+
+/**
+ * @brief Decoder Flags
+ * @details Select the composite messages that are assembled. Controllers
+ *          of the others pass through as messages.
+ */
+#define MIDI_PARAM_FLAG_CONTROLLERS (0x01)
+#define MIDI_PARAM_FLAG_RPN (0x02)
+#define MIDI_PARAM_FLAG_NRPN (0x04)
+#define MIDI_PARAM_FLAG_ALL (0x07)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Pairing Order
+ * @details When the value of a 14-bit controller or of Data Entry is
+ *          emitted. A new MSB always resets the LSB to 0, and an LSB
+ *          alone combines with the latched MSB.
+ */
+typedef enum midi_param_order_t {
+    /**
+     * @brief Emit on the MSB and again on the LSB
+     * @details Lowest latency. Receivers see the coarse value first.
+     */
+    MIDI_PARAM_ORDER_IMMEDIATE = 0,
+
+    /**
+     * @brief Hold the MSB until its LSB arrives
+     * @details The MSB alone is emitted when another message of the
+     *          channel arrives or the timeout expires, so that a value
+     *          is never reordered after the messages that followed it
+     */
+    MIDI_PARAM_ORDER_PAIRED = 1,
+} midi_param_order_t;
+
+/**
+ * @brief Parameter Event Type
+ */
+typedef enum midi_param_event_type_t {
+    /**
+     * @brief A message that is not part of a parameter change
+     */
+    MIDI_PARAM_EVENT_MESSAGE = 0,
+
+    /**
+     * @brief A 14-bit controller value
+     */
+    MIDI_PARAM_EVENT_CONTROLLER = 1,
+
+    /**
+     * @brief A Registered Parameter Number change
+     */
+    MIDI_PARAM_EVENT_RPN = 2,
+
+    /**
+     * @brief A Non-Registered Parameter Number change
+     */
+    MIDI_PARAM_EVENT_NRPN = 3,
+} midi_param_event_type_t;
+
+/**
+ * @brief Parameter Change Operation
+ */
+typedef enum midi_param_op_t {
+    /**
+     * @brief Set the parameter to the value
+     */
+    MIDI_PARAM_OP_SET = 0,
+
+    /**
+     * @brief Increment the parameter, from Data Increment
+     */
+    MIDI_PARAM_OP_INCREMENT = 1,
+
+    /**
+     * @brief Decrement the parameter, from Data Decrement
+     */
+    MIDI_PARAM_OP_DECREMENT = 2,
+} midi_param_op_t;
+
+/**
+ * @brief Parameter Event
+ */
+typedef struct midi_param_event_t {
+    /**
+     * @brief The event type
+     */
+    midi_param_event_type_t type;
+
+    /**
+     * @brief The operation, for RPN and NRPN events
+     */
+    midi_param_op_t op;
+
+    /**
+     * @brief The channel, or MIDI_CHANNEL_NONE for system messages
+     */
+    midi_channel_t channel;
+
+    /**
+     * @brief The controller number (0 to 31) or the 14-bit parameter
+     *        number
+     */
+    uint16_t number;
+
+    /**
+     * @brief The 14-bit value, for set operations
+     */
+    uint16_t value;
+
+    /**
+     * @brief The timestamp of the last message of the event
+     */
+    uint32_t timestamp;
+
+    /**
+     * @brief The message, for MIDI_PARAM_EVENT_MESSAGE
+     */
+    midi_packed_t message;
+} midi_param_event_t;
+
+/**
+ * @brief Parameter Decoder Channel
+ * @note The fields of this struct should not be accessed directly
+ */
+typedef struct midi_param_channel_t {
+    uint8_t msb[MIDI_PARAM_CONTROLLERS];
+    uint16_t rpn;
+    uint16_t nrpn;
+    uint8_t selected;
+    uint8_t pending;
+    uint32_t pending_timestamp;
+} midi_param_channel_t;
+
+/**
+ * @brief MIDI Parameter Decoder
+ * @note The fields of this struct should not be accessed directly.
+ *       Use the `midi_param_*` functions.
+ */
+typedef struct midi_param_decoder_t {
+    midi_param_channel_t channels[16];
+    uint16_t pending_channels;
+    uint8_t flags;
+    midi_param_order_t order;
+    uint32_t timeout;
+} midi_param_decoder_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a parameter decoder
+ * @details No parameter is selected and every MSB latch is 0
+ * @param [out] decoder Pointer to a midi_param_decoder_t struct
+ * @param [in] flags The composite messages to assemble
+ *      (MIDI_PARAM_FLAG_*)
+ * @param [in] order When 14-bit values are emitted
+ * @param [in] timeout The time after which a pending MSB is emitted
+ *      alone, in the units of the timestamps, or 0 to wait for another
+ *      message of the channel. Only used by MIDI_PARAM_ORDER_PAIRED.
+ */
+void midi_param_init(midi_param_decoder_t *decoder,
+                     uint8_t flags,
+                     midi_param_order_t order,
+                     uint32_t timeout);
+
+/**
+ * @brief Reset the decoder
+ * @details Drops pending MSBs, clears the latches and deselects every
+ *          parameter, keeping the configuration
+ * @param [in,out] decoder Pointer to a midi_param_decoder_t struct
+ */
+void midi_param_reset(midi_param_decoder_t *decoder);
+
+/**
+ * @brief Decode a message
+ * @details Reset All Controllers deselects the parameters of its channel,
+ *          as RP-015 asks, and System Reset resets the decoder, dropping
+ *          the pending MSBs. Both pass through as messages.
+ * @param [in,out] decoder Pointer to a midi_param_decoder_t struct
+ * @param [in] message Pointer to the message
+ * @param [in] timestamp The time the message was received
+ * @param [out] events Pointer to an array that receives the events
+ * @param [in] capacity The number of entries in the events array, at
+ *      least MIDI_PARAM_MAX_EVENTS
+ * @return The number of events written, 0 when the message only updated
+ *      the decoder
+ */
+size_t midi_param_process(midi_param_decoder_t *decoder,
+                          const midi_message_t *message,
+                          uint32_t timestamp,
+                          midi_param_event_t *events,
+                          size_t capacity);
+
+/**
+ * @brief Emit the pending MSBs whose timeout expired
+ * @param [in,out] decoder Pointer to a midi_param_decoder_t struct
+ * @param [in] now The current time
+ * @param [out] events Pointer to an array that receives the events
+ * @param [in] capacity The number of entries in the events array
+ * @return The number of events written
+ */
+size_t midi_param_poll(midi_param_decoder_t *decoder,
+                       uint32_t now,
+                       midi_param_event_t *events,
+                       size_t capacity);
+
+/**
+ * @brief Emit every pending MSB, for example at the end of a stream
+ * @param [in,out] decoder Pointer to a midi_param_decoder_t struct
+ * @param [out] events Pointer to an array that receives the events
+ * @param [in] capacity The number of entries in the events array
+ * @return The number of events written
+ */
+size_t midi_param_flush(midi_param_decoder_t *decoder,
+                        midi_param_event_t *events,
+                        size_t capacity);
+
+#endif /* MIDI_PARAM_H */
@@ -0,0 +1,220 @@
+/***********************************************************************
+ * @file midi_pool.c
+ * @brief MIDI parser pool implementation
+ *
+ * @details Keeps the state of each port in six byte arrays inside the
+ *          caller's storage. A work item restores its port into the
+ *          shared parser, parses the chunk with midi_parse_buffer_packed
+ *          and saves the port back.
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_pool.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static inline void load_port(midi_parser_pool_t *pool, uint32_t port);
+
+static inline void store_port(midi_parser_pool_t *pool, uint32_t port);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a parser pool
+ * @param [out] pool Pointer to a midi_parser_pool_t struct
+ * @param [in] storage Pointer to MIDI_PARSER_POOL_STORAGE_SIZE(ports) bytes
+ * @param [in] ports The number of ports
+ * @param [in] config Pointer to a parser to copy the configuration of,
+ *      or NULL
+ */
+void midi_parser_pool_init(midi_parser_pool_t *pool,
+                           uint8_t *storage,
+                           uint32_t ports,
+                           const midi_parser_t *config)
+{
+    /* Check for NULL pointers */
+    if (pool == NULL || storage == NULL) { return; }
+
+    if (config != NULL) {
+        pool->parser = *config;
+    } else {
+        midi_parser_init(&pool->parser);
+    }
+    midi_parser_reset(&pool->parser);
+    midi_parser_save_state(&pool->parser, &pool->initial);
+
+    const size_t stride =
+        MIDI_PARSER_POOL_STORAGE_SIZE(ports) / MIDI_PARSER_POOL_ARRAYS;
+    pool->message_type = storage;
+    pool->channel = storage + stride;
+    pool->data1 = storage + 2 * stride;
+    pool->data2 = storage + 3 * stride;
+    pool->byte_count = storage + 4 * stride;
+    pool->sysex_flags = storage + 5 * stride;
+    pool->ports = ports;
+    pool->current_port = 0;
+
+    memset(pool->message_type, (uint8_t)pool->initial.message_type, stride);
+    memset(pool->channel, (uint8_t)pool->initial.channel, stride);
+    memset(pool->data1, pool->initial.buffer[0], stride);
+    memset(pool->data2, pool->initial.buffer[1], stride);
+    memset(pool->byte_count, pool->initial.byte_count, stride);
+    memset(pool->sysex_flags, pool->initial.sysex_flags, stride);
+}
+
+/**
+ * @brief Reset the state of a port
+ * @param [in,out] pool Pointer to a midi_parser_pool_t struct
+ * @param [in] port The port to reset
+ */
+void midi_parser_pool_reset_port(midi_parser_pool_t *pool, uint32_t port)
+{
+    /* Check for NULL pointers */
+    if (pool == NULL) { return; }
+
+    midi_parser_pool_set_state(pool, port, &pool->initial);
+}
+
+/**
+ * @brief Parse a batch of work items
+ * @param [in,out] pool Pointer to a midi_parser_pool_t struct
+ * @param [in,out] items Pointer to the work items
+ * @param [in] count The number of work items
+ * @param [out] ports Pointer to an array that receives the port of each
+ *      message
+ * @param [out] messages Pointer to an array that receives the messages
+ * @param [in] capacity The number of entries in the output arrays
+ * @return The number of messages written
+ */
+size_t midi_parser_pool_process(midi_parser_pool_t *pool,
+                                midi_parser_pool_work_t *items,
+                                size_t count,
+                                uint32_t *ports,
+                                midi_packed_t *messages,
+                                size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (pool == NULL || items == NULL || ports == NULL || messages == NULL) {
+        return 0;
+    }
+
+    size_t total = 0;
+
+    for (size_t i = 0; i < count && total < capacity; i++) {
+        midi_parser_pool_work_t *item = &items[i];
+
+        if (item->port >= pool->ports || item->data == NULL) {
+            item->length = 0;
+            continue;
+        }
+        if (item->length == 0) { continue; }
+
+        size_t consumed = 0;
+        load_port(pool, item->port);
+        pool->current_port = item->port;
+        const size_t parsed = midi_parse_buffer_packed(&pool->parser,
+                                                       item->data,
+                                                       item->length,
+                                                       &messages[total],
+                                                       capacity - total,
+                                                       &consumed);
+        store_port(pool, item->port);
+
+        for (size_t m = 0; m < parsed; m++) {
+            ports[total + m] = item->port;
+        }
+        total += parsed;
+        item->data += consumed;
+        item->length -= consumed;
+    }
+
+    return total;
+}
+
+/**
+ * @brief Read the state of a port
+ * @param [in] pool Pointer to a midi_parser_pool_t struct
+ * @param [in] port The port
+ * @param [out] state Pointer to a midi_parser_state_t struct
+ */
+void midi_parser_pool_get_state(const midi_parser_pool_t *pool,
+                                uint32_t port,
+                                midi_parser_state_t *state)
+{
+    /* Check for NULL pointers */
+    if (pool == NULL || state == NULL || port >= pool->ports) { return; }
+
+    state->message_type = (midi_message_type_t)pool->message_type[port];
+    state->channel = (midi_channel_t)pool->channel[port];
+    state->buffer[0] = pool->data1[port];
+    state->buffer[1] = pool->data2[port];
+    state->byte_count = pool->byte_count[port];
+    state->sysex_flags = pool->sysex_flags[port];
+}
+
+/**
+ * @brief Set the state of a port
+ * @details The state goes through the pool's parser, so that the filters
+ *          apply as for midi_parser_restore_state
+ * @param [in,out] pool Pointer to a midi_parser_pool_t struct
+ * @param [in] port The port
+ * @param [in] state Pointer to a saved state
+ */
+void midi_parser_pool_set_state(midi_parser_pool_t *pool,
+                                uint32_t port,
+                                const midi_parser_state_t *state)
+{
+    /* Check for NULL pointers */
+    if (pool == NULL || state == NULL || port >= pool->ports) { return; }
+
+    midi_parser_restore_state(&pool->parser, state);
+    store_port(pool, port);
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Restore the state of a port into the pool's parser
+ */
+static inline void load_port(midi_parser_pool_t *pool, uint32_t port)
+{
+    midi_parser_state_t state;
+
+    midi_parser_pool_get_state(pool, port, &state);
+    midi_parser_restore_state(&pool->parser, &state);
+}
+
+/**
+ * @brief Save the state of the pool's parser into a port
+ */
+static inline void store_port(midi_parser_pool_t *pool, uint32_t port)
+{
+    midi_parser_state_t state;
+
+    midi_parser_save_state(&pool->parser, &state);
+    pool->message_type[port] = (uint8_t)state.message_type;
+    pool->channel[port] = (uint8_t)state.channel;
+    pool->data1[port] = state.buffer[0];
+    pool->data2[port] = state.buffer[1];
+    pool->byte_count[port] = state.byte_count;
+    pool->sysex_flags[port] = state.sysex_flags;
+}
@@ -0,0 +1,197 @@
+/**********************************************************************
+ * @file midi_pool.h
+ * @brief MIDI parser pool module
+ *
+ * @details This module parses many independent MIDI 1.0 streams, or
+ *          ports, with one parser configuration. Only the state that
+ *          depends on the bytes parsed so far is kept per port, as six
+ *          bytes in structure-of-arrays layout: the state of 4096 ports
+ *          takes 24 KiB, and one cache line of each array covers 64
+ *          ports.
+ *
+ *          Work is given in batches of (port, chunk) items. Each item
+ *          loads the state of its port into the pool's parser, parses
+ *          the chunk and stores the state back.
+ *
+ *          A pool is not thread-safe. To shard ports across threads,
+ *          give each thread its own pool and storage, so that the
+ *          threads share no cache lines.
+ **********************************************************************/
+
+#ifndef MIDI_POOL_H
+#define MIDI_POOL_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Number of state arrays, and bytes of state per port
+ */
+#define MIDI_PARSER_POOL_ARRAYS (6)
+
+/**
+ * @brief Alignment of each state array in the storage, in bytes
+ */
+#define MIDI_PARSER_POOL_ALIGN (64)
+
+/**
+ * @brief Size of the storage of a pool
+ * @details Each state array is padded to a multiple of
+ *          MIDI_PARSER_POOL_ALIGN bytes, so the arrays stay cache-line
+ *          aligned when the storage is
+ * @param ports The number of ports
+ */
+#define MIDI_PARSER_POOL_STORAGE_SIZE(ports)                               \
+    (MIDI_PARSER_POOL_ARRAYS                                               \
+     * (((size_t)(ports) + MIDI_PARSER_POOL_ALIGN - 1)                     \
+        & ~(size_t)(MIDI_PARSER_POOL_ALIGN - 1)))
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Parser Pool Work Item
+ */
+typedef struct midi_parser_pool_work_t {
+    /**
+     * @brief The port the bytes were received on
+     */
+    uint32_t port;
+
+    /**
+     * @brief Pointer to the bytes to parse
+     * @details Advanced past the bytes that were parsed
+     */
+    const uint8_t *data;
+
+    /**
+     * @brief The number of bytes to parse
+     * @details Reduced by the number of bytes that were parsed
+     */
+    size_t length;
+} midi_parser_pool_work_t;
+
+/**
+ * @brief MIDI Parser Pool
+ * @note The fields of this struct should not be accessed directly,
+ *       except for current_port from a handler
+ */
+typedef struct midi_parser_pool_t {
+    /**
+     * @brief The parser that every port is parsed with
+     * @details Holds the filters and handlers shared by the ports
+     */
+    midi_parser_t parser;
+
+    /**
+     * @brief The state of a port that has parsed nothing
+     */
+    midi_parser_state_t initial;
+
+    /**
+     * @brief The per-port state arrays, in the caller's storage
+     */
+    uint8_t *message_type;
+    uint8_t *channel;
+    uint8_t *data1;
+    uint8_t *data2;
+    uint8_t *byte_count;
+    uint8_t *sysex_flags;
+
+    /**
+     * @brief The number of ports
+     */
+    uint32_t ports;
+
+    /**
+     * @brief The port of the item being parsed
+     * @details Lets the SysEx and realtime handlers tell the ports apart
+     */
+    uint32_t current_port;
+} midi_parser_pool_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a parser pool
+ * @details Every port starts in the state of a freshly reset parser
+ * @param [out] pool Pointer to a midi_parser_pool_t struct
+ * @param [in] storage Pointer to MIDI_PARSER_POOL_STORAGE_SIZE(ports)
+ *      bytes that hold the per-port state. Must stay valid for as long as
+ *      the pool is used.
+ * @param [in] ports The number of ports
+ * @param [in] config Pointer to a parser whose filters and handlers are
+ *      copied to the pool, or NULL for the defaults of midi_parser_init
+ */
+void midi_parser_pool_init(midi_parser_pool_t *pool,
+                           uint8_t *storage,
+                           uint32_t ports,
+                           const midi_parser_t *config);
+
+/**
+ * @brief Reset the state of a port
+ * @details Clears any partial message and the running status of the
+ *          port, for example when its connection is reopened
+ * @param [in,out] pool Pointer to a midi_parser_pool_t struct
+ * @param [in] port The port to reset
+ */
+void midi_parser_pool_reset_port(midi_parser_pool_t *pool, uint32_t port);
+
+/**
+ * @brief Parse a batch of work items
+ * @details Parses the items in order until every item is consumed or the
+ *          output arrays are full. Items for unknown ports are skipped.
+ *          Each item is advanced past the bytes that were parsed, so
+ *          after an early stop the same items can be passed again.
+ * @param [in,out] pool Pointer to a midi_parser_pool_t struct
+ * @param [in,out] items Pointer to the work items
+ * @param [in] count The number of work items
+ * @param [out] ports Pointer to an array that receives the port of each
+ *      message
+ * @param [out] messages Pointer to an array that receives the messages
+ * @param [in] capacity The number of entries in the ports and messages
+ *      arrays
+ * @return The number of messages written
+ */
+size_t midi_parser_pool_process(midi_parser_pool_t *pool,
+                                midi_parser_pool_work_t *items,
+                                size_t count,
+                                uint32_t *ports,
+                                midi_packed_t *messages,
+                                size_t capacity);
+
+/**
+ * @brief Read the state of a port
+ * @param [in] pool Pointer to a midi_parser_pool_t struct
+ * @param [in] port The port
+ * @param [out] state Pointer to a midi_parser_state_t struct that
+ *      receives the state, for example to move the port to a midi_parser_t
+ */
+void midi_parser_pool_get_state(const midi_parser_pool_t *pool,
+                                uint32_t port,
+                                midi_parser_state_t *state);
+
+/**
+ * @brief Set the state of a port
+ * @param [in,out] pool Pointer to a midi_parser_pool_t struct
+ * @param [in] port The port
+ * @param [in] state Pointer to a state saved by midi_parser_save_state
+ *      or midi_parser_pool_get_state
+ */
+void midi_parser_pool_set_state(midi_parser_pool_t *pool,
+                                uint32_t port,
+                                const midi_parser_state_t *state);
+
+#endif /* MIDI_POOL_H */
@@ -0,0 +1,285 @@
+/***********************************************************************
+ * @file midi_ring.c
+ * @brief MIDI message ring implementation
+ *
+ * @details Lock-free single-producer, single-consumer ring of packed
+ *          MIDI messages. The producer publishes new messages with a
+ *          release store of the head index, and the consumer frees slots
+ *          with a release store of the tail index; each side reads the
+ *          other's index with an acquire load.
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_ring.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Size of the scratch array for messages that do not fit
+ */
+#define MIDI_RING_SCRATCH_SIZE (16)
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static inline size_t
+producer_free(midi_ring_t *ring, const size_t head, const size_t wanted);
+
+static inline void add_overflow(midi_ring_t *ring, const size_t dropped);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize an empty MIDI message ring
+ * @param [out] ring Pointer to a midi_ring_t struct to initialize
+ * @param [in] storage Pointer to an array of capacity midi_packed_t words
+ * @param [in] capacity The number of entries in the storage array.
+ *      Must be a power of two.
+ * @return 1 if the ring was initialized, 0 otherwise
+ */
+int midi_ring_init(midi_ring_t *ring, midi_packed_t *storage, size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (ring == NULL || storage == NULL) { return 0; }
+
+    /* The indices are masked into the storage */
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) { return 0; }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->overflow_count, 0);
+    ring->cached_tail = 0;
+    ring->cached_head = 0;
+    ring->storage = storage;
+    ring->mask = capacity - 1;
+
+    return 1;
+}
+
+/**
+ * @brief Get the capacity of a MIDI message ring
+ * @param [in] ring Pointer to a midi_ring_t struct
+ * @return The number of messages the ring can hold
+ */
+size_t midi_ring_capacity(const midi_ring_t *ring)
+{
+    if (ring == NULL) { return 0; }
+
+    return ring->mask + 1;
+}
+
+/**
+ * @brief Get the number of messages in a MIDI message ring
+ * @param [in] ring Pointer to a midi_ring_t struct
+ * @return The number of messages waiting to be popped
+ */
+size_t midi_ring_size(midi_ring_t *ring)
+{
+    if (ring == NULL) { return 0; }
+
+    const size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    return head - tail;
+}
+
+/**
+ * @brief Get the number of messages dropped because the ring was full
+ * @param [in] ring Pointer to a midi_ring_t struct
+ * @return The number of messages dropped since the ring was initialized
+ */
+size_t midi_ring_get_overflow_count(midi_ring_t *ring)
+{
+    if (ring == NULL) { return 0; }
+
+    return atomic_load_explicit(&ring->overflow_count, memory_order_relaxed);
+}
+
+/**
+ * @brief Push messages into a MIDI message ring (producer side)
+ * @param [in,out] ring Pointer to a midi_ring_t struct
+ * @param [in] packed Pointer to the messages to push
+ * @param [in] count The number of messages to push
+ * @return The number of messages pushed
+ */
+size_t
+midi_ring_push(midi_ring_t *ring, const midi_packed_t *packed, size_t count)
+{
+    /* Check for NULL pointers */
+    if (ring == NULL || packed == NULL) { return 0; }
+
+    const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t pushed = producer_free(ring, head, count);
+    if (pushed > count) { pushed = count; }
+
+    /* Copy in up to two parts, around the end of the storage */
+    const size_t index = head & ring->mask;
+    size_t first = ring->mask + 1 - index;
+    if (first > pushed) { first = pushed; }
+    memcpy(&ring->storage[index], packed, first * sizeof(*packed));
+    memcpy(ring->storage, &packed[first], (pushed - first) * sizeof(*packed));
+
+    atomic_store_explicit(&ring->head, head + pushed, memory_order_release);
+    add_overflow(ring, count - pushed);
+
+    return pushed;
+}
+
+/**
+ * @brief Pop messages from a MIDI message ring (consumer side)
+ * @param [in,out] ring Pointer to a midi_ring_t struct
+ * @param [out] packed Pointer to an array that receives the messages
+ * @param [in] capacity The number of entries in the packed array
+ * @return The number of messages popped
+ */
+size_t midi_ring_pop(midi_ring_t *ring, midi_packed_t *packed, size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (ring == NULL || packed == NULL) { return 0; }
+
+    const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t popped = ring->cached_head - tail;
+
+    /* Only reload the head when the cached copy cannot fill the array */
+    if (popped < capacity) {
+        ring->cached_head =
+            atomic_load_explicit(&ring->head, memory_order_acquire);
+        popped = ring->cached_head - tail;
+    }
+    if (popped > capacity) { popped = capacity; }
+
+    /* Copy out in up to two parts, around the end of the storage */
+    const size_t index = tail & ring->mask;
+    size_t first = ring->mask + 1 - index;
+    if (first > popped) { first = popped; }
+    memcpy(packed, &ring->storage[index], first * sizeof(*packed));
+    memcpy(&packed[first], ring->storage, (popped - first) * sizeof(*packed));
+
+    atomic_store_explicit(&ring->tail, tail + popped, memory_order_release);
+
+    return popped;
+}
+
+/**
+ * @brief Parse a buffer of MIDI bytes into a MIDI message ring
+ *        (producer side)
+ * @param [in,out] ring Pointer to a midi_ring_t struct
+ * @param [in,out] parser Pointer to a midi_parser_t struct
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @return The number of messages pushed
+ */
+size_t midi_ring_parse(midi_ring_t *ring,
+                       midi_parser_t *parser,
+                       const uint8_t *buffer,
+                       size_t length)
+{
+    /* Check for NULL pointers */
+    if (ring == NULL || parser == NULL || buffer == NULL) { return 0; }
+
+    const size_t start =
+        atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t head = start;
+    size_t offset = 0;
+
+    while (offset < length) {
+        size_t consumed;
+        const size_t available = producer_free(ring, head, 1);
+
+        if (available == 0) {
+            /* Keep parsing so the parser stays in step, and count the
+             * messages that cannot be stored */
+            midi_packed_t scratch[MIDI_RING_SCRATCH_SIZE];
+            add_overflow(ring,
+                         midi_parse_buffer_packed(parser,
+                                                  &buffer[offset],
+                                                  length - offset,
+                                                  scratch,
+                                                  MIDI_RING_SCRATCH_SIZE,
+                                                  &consumed));
+            offset += consumed;
+            continue;
+        }
+
+        /* Parse straight into the contiguous free slots */
+        const size_t index = head & ring->mask;
+        size_t contiguous = ring->mask + 1 - index;
+        if (contiguous > available) { contiguous = available; }
+
+        head += midi_parse_buffer_packed(parser,
+                                         &buffer[offset],
+                                         length - offset,
+                                         &ring->storage[index],
+                                         contiguous,
+                                         &consumed);
+        offset += consumed;
+    }
+
+    /* Publish the whole chunk at once */
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+
+    return head - start;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Get the number of free slots, as seen by the producer
+ * @details Uses the cached tail index, and only reloads it when fewer
+ *          than the wanted number of slots look free
+ * @param [in,out] ring Pointer to a midi_ring_t struct
+ * @param [in] head The producer's head index
+ * @param [in] wanted The number of slots the producer wants to write
+ * @return The number of slots that can be written
+ */
+static inline size_t
+producer_free(midi_ring_t *ring, const size_t head, const size_t wanted)
+{
+    const size_t capacity = ring->mask + 1;
+    size_t available = capacity - (head - ring->cached_tail);
+
+    if (available < wanted) {
+        ring->cached_tail =
+            atomic_load_explicit(&ring->tail, memory_order_acquire);
+        available = capacity - (head - ring->cached_tail);
+    }
+    return available;
+}
+
+/**
+ * @brief Add dropped messages to the overflow count
+ * @details Only the producer writes the count, so a load and a store
+ *          are enough and no read-modify-write instruction is needed
+ * @param [in,out] ring Pointer to a midi_ring_t struct
+ * @param [in] dropped The number of messages dropped
+ */
+static inline void add_overflow(midi_ring_t *ring, const size_t dropped)
+{
+    if (dropped == 0) { return; }
+
+    const size_t count =
+        atomic_load_explicit(&ring->overflow_count, memory_order_relaxed);
+    atomic_store_explicit(
+        &ring->overflow_count, count + dropped, memory_order_relaxed);
+}
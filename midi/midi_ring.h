@@ -0,0 +1,177 @@
+/**********************************************************************
+ * @file midi_ring.h
+ * @brief MIDI message ring module
+ *
+ * @details This module provides a lock-free single-producer,
+ *          single-consumer ring of packed MIDI messages, for handing
+ *          messages parsed in an interrupt handler to the application
+ *          without locks or disabling interrupts.
+ *
+ *          The producer (for example a UART or DMA interrupt handler)
+ *          calls midi_ring_parse for each chunk of received bytes, or
+ *          midi_ring_push. The consumer calls midi_ring_pop. Each side
+ *          must only be used from one thread or interrupt context.
+ *
+ *          Only atomic loads and stores are used, so the ring also works
+ *          on cores without atomic read-modify-write instructions.
+ **********************************************************************/
+
+#ifndef MIDI_RING_H
+#define MIDI_RING_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Cache line size
+ * @details The producer and consumer indices are kept this far apart,
+ *          so that the two sides do not write to the same cache line.
+ *          May be defined by the build for cores with other line sizes.
+ */
+#ifndef MIDI_RING_CACHE_LINE_SIZE
+#define MIDI_RING_CACHE_LINE_SIZE (64)
+#endif
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief MIDI Message Ring
+ * @details The indices run freely and are masked into the storage,
+ *          so the capacity must be a power of two and every slot can
+ *          be used. Each side keeps a cached copy of the other side's
+ *          index and only reloads it when the ring looks full (or empty).
+ */
+typedef struct midi_ring_t {
+    /**
+     * @brief Index of the next slot to write. Written by the producer.
+     */
+    _Alignas(MIDI_RING_CACHE_LINE_SIZE) atomic_size_t head;
+
+    /**
+     * @brief The producer's copy of the consumer index
+     */
+    size_t cached_tail;
+
+    /**
+     * @brief The number of messages dropped because the ring was full.
+     *        Written by the producer.
+     */
+    atomic_size_t overflow_count;
+
+    /**
+     * @brief Index of the next slot to read. Written by the consumer.
+     */
+    _Alignas(MIDI_RING_CACHE_LINE_SIZE) atomic_size_t tail;
+
+    /**
+     * @brief The consumer's copy of the producer index
+     */
+    size_t cached_head;
+
+    /**
+     * @brief Pointer to the caller-provided storage
+     */
+    _Alignas(MIDI_RING_CACHE_LINE_SIZE) midi_packed_t *storage;
+
+    /**
+     * @brief The capacity of the storage minus one
+     */
+    size_t mask;
+} midi_ring_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize an empty MIDI message ring
+ * @param [out] ring Pointer to a midi_ring_t struct to initialize
+ * @param [in] storage Pointer to an array of capacity midi_packed_t
+ *      words. Must stay valid for as long as the ring is used.
+ * @param [in] capacity The number of entries in the storage array.
+ *      Must be a power of two.
+ * @return 1 if the ring was initialized, 0 if a pointer is NULL or the
+ *      capacity is not a power of two
+ * @note Must not be called while the producer or the consumer is
+ *       using the ring
+ */
+int midi_ring_init(midi_ring_t *ring, midi_packed_t *storage, size_t capacity);
+
+/**
+ * @brief Get the capacity of a MIDI message ring
+ * @param [in] ring Pointer to a midi_ring_t struct
+ * @return The number of messages the ring can hold
+ */
+size_t midi_ring_capacity(const midi_ring_t *ring);
+
+/**
+ * @brief Get the number of messages in a MIDI message ring
+ * @param [in] ring Pointer to a midi_ring_t struct
+ * @return The number of messages waiting to be popped. When called while
+ *      the other side is using the ring, the count may already be stale.
+ */
+size_t midi_ring_size(midi_ring_t *ring);
+
+/**
+ * @brief Get the number of messages dropped because the ring was full
+ * @param [in] ring Pointer to a midi_ring_t struct
+ * @return The number of messages dropped since the ring was initialized
+ */
+size_t midi_ring_get_overflow_count(midi_ring_t *ring);
+
+/**
+ * @brief Push messages into a MIDI message ring (producer side)
+ * @details Pushes as many messages as fit. Messages that do not fit are
+ *          dropped and added to the overflow count.
+ * @param [in,out] ring Pointer to a midi_ring_t struct
+ * @param [in] packed Pointer to the messages to push
+ * @param [in] count The number of messages to push
+ * @return The number of messages pushed
+ */
+size_t
+midi_ring_push(midi_ring_t *ring, const midi_packed_t *packed, size_t count);
+
+/**
+ * @brief Pop messages from a MIDI message ring (consumer side)
+ * @param [in,out] ring Pointer to a midi_ring_t struct
+ * @param [out] packed Pointer to an array that receives the messages,
+ *      oldest first
+ * @param [in] capacity The number of entries in the packed array
+ * @return The number of messages popped
+ */
+size_t midi_ring_pop(midi_ring_t *ring, midi_packed_t *packed, size_t capacity);
+
+/**
+ * @brief Parse a buffer of MIDI bytes into a MIDI message ring
+ *        (producer side)
+ * @details Parses the whole buffer with midi_parse_buffer_packed,
+ *          writing the messages straight into the ring storage, and
+ *          publishes them to the consumer once at the end. Messages that
+ *          do not fit are dropped and added to the overflow count, so the
+ *          parser state stays in step with the byte stream. Intended to
+ *          be called once per received chunk from an interrupt handler.
+ * @param [in,out] ring Pointer to a midi_ring_t struct
+ * @param [in,out] parser Pointer to a midi_parser_t struct. Must only
+ *      be used by the producer.
+ * @param [in] buffer Pointer to the bytes to parse
+ * @param [in] length The number of bytes in the buffer
+ * @return The number of messages pushed
+ */
+size_t midi_ring_parse(midi_ring_t *ring,
+                       midi_parser_t *parser,
+                       const uint8_t *buffer,
+                       size_t length);
+
+#endif /* MIDI_RING_H */
@@ -0,0 +1,915 @@
+/***********************************************************************
+ * @file midi_route.c
+ * @brief MIDI routing implementation
+ *
+ * @details Compiling walks the nodes in graph order, which is always a
+ *          valid order since a node can only use the references of the
+ *          nodes before it. A node whose input feeds nothing else works
+ *          in place on its input buffer, and is fused into the stage
+ *          that produced it when both are of the same kind. Otherwise
+ *          it gets a buffer of its own, sized for the most messages
+ *          that can reach it: a merge of two paths of the same batch
+ *          can hold it twice.
+ *
+ *          The stages compute every condition for every message without
+ *          branches, and write each message before deciding whether to
+ *          keep it, so that filtering in place is a store and an add.
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_route.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Index of MIDI_ROUTE_SOURCE in the per-reference arrays
+ */
+#define ROUTE_SOURCE_INDEX (2 * MIDI_ROUTE_MAX_NODES)
+
+/**
+ * @brief Stage of a reference that no stage produces
+ */
+#define ROUTE_NO_STAGE (0xFF)
+
+/**
+ * @brief MIDI Maximum Data Byte Value
+ */
+#define ROUTE_MAX_DATA_BYTE (0x7F)
+
+/**
+ * @brief Number of MIDI channels
+ */
+#define ROUTE_CHANNELS (16)
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static inline size_t ref_index(midi_route_ref_t ref);
+
+static inline size_t buffer_size(size_t entries);
+
+static int is_valid_ref(const midi_route_graph_t *graph, midi_route_ref_t ref);
+
+static midi_route_node_t *add_node(midi_route_graph_t *graph,
+                                   midi_route_kind_t kind,
+                                   midi_route_ref_t input);
+
+static void normalize_match(midi_route_match_t *match);
+
+static int fuse(midi_route_node_t *first, const midi_route_node_t *second);
+
+static inline uint32_t is_note(uint32_t message_type);
+
+static inline uint32_t match_event(const midi_route_match_t *match,
+                                   midi_packed_t event);
+
+static void run_filter(const midi_route_stage_t *stage,
+                       const midi_route_buffer_t *in,
+                       midi_route_buffer_t *out);
+
+static void run_channel_map(const midi_route_stage_t *stage,
+                            const midi_route_buffer_t *in,
+                            midi_route_buffer_t *out);
+
+static void run_note_map(const midi_route_stage_t *stage,
+                         const midi_route_buffer_t *in,
+                         midi_route_buffer_t *out);
+
+static void run_curve(const midi_route_stage_t *stage,
+                      const midi_route_buffer_t *in,
+                      midi_route_buffer_t *out);
+
+static void run_split(const midi_route_stage_t *stage,
+                      const midi_route_buffer_t *in,
+                      midi_route_buffer_t *out,
+                      midi_route_buffer_t *other);
+
+static void run_merge(const midi_route_buffer_t *first,
+                      const midi_route_buffer_t *second,
+                      midi_route_buffer_t *out);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a match that matches every message
+ * @param [out] match Pointer to a midi_route_match_t struct
+ */
+void midi_route_match_init(midi_route_match_t *match)
+{
+    /* Check for NULL pointers */
+    if (match == NULL) { return; }
+
+    memset(match->types, 0xFF, sizeof(match->types));
+    match->channels = MIDI_ROUTE_ALL_CHANNELS | MIDI_ROUTE_SYSTEM_CHANNEL;
+    match->note_min = 0;
+    match->note_max = ROUTE_MAX_DATA_BYTE;
+}
+
+/**
+ * @brief Enable or disable a message type in a match
+ * @param [in,out] match Pointer to a midi_route_match_t struct
+ * @param [in] message_type The message type, or MIDI_MESSAGE_NONE
+ * @param [in] enabled 1 to match the type, 0 not to
+ */
+void midi_route_match_set_type(midi_route_match_t *match,
+                               midi_message_type_t message_type,
+                               int enabled)
+{
+    /* Check for NULL pointers */
+    if (match == NULL) { return; }
+
+    if (message_type == MIDI_MESSAGE_NONE) {
+        memset(match->types, enabled ? 0xFF : 0, sizeof(match->types));
+        return;
+    }
+
+    const uint8_t type = (uint8_t)message_type;
+    const uint32_t bit = (uint32_t)1 << (type & 31);
+    if (enabled) {
+        match->types[type >> 5] |= bit;
+    } else {
+        match->types[type >> 5] &= ~bit;
+    }
+}
+
+/**
+ * @brief Initialize an empty graph
+ * @param [out] graph Pointer to a midi_route_graph_t struct
+ */
+void midi_route_graph_init(midi_route_graph_t *graph)
+{
+    /* Check for NULL pointers */
+    if (graph == NULL) { return; }
+
+    graph->count = 0;
+    graph->outputs = 0;
+}
+
+/**
+ * @brief Add a filter
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] input The messages to filter
+ * @param [in] match Pointer to the match of the messages to keep
+ * @return The messages that matched, or MIDI_ROUTE_INVALID
+ */
+midi_route_ref_t midi_route_add_filter(midi_route_graph_t *graph,
+                                       midi_route_ref_t input,
+                                       const midi_route_match_t *match)
+{
+    if (match == NULL) { return MIDI_ROUTE_INVALID; }
+
+    midi_route_node_t *node = add_node(graph, MIDI_ROUTE_FILTER, input);
+    if (node == NULL) { return MIDI_ROUTE_INVALID; }
+
+    node->match = *match;
+    normalize_match(&node->match);
+    return (midi_route_ref_t)(2 * (graph->count - 1));
+}
+
+/**
+ * @brief Add a channel remap
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] input The messages to remap
+ * @param [in] map Pointer to the new channel of each channel
+ * @return The remapped messages, or MIDI_ROUTE_INVALID
+ */
+midi_route_ref_t midi_route_add_remap(midi_route_graph_t *graph,
+                                      midi_route_ref_t input,
+                                      const uint8_t *map)
+{
+    if (map == NULL) { return MIDI_ROUTE_INVALID; }
+
+    midi_route_node_t *node = add_node(graph, MIDI_ROUTE_CHANNEL_MAP, input);
+    if (node == NULL) { return MIDI_ROUTE_INVALID; }
+
+    for (size_t channel = 0; channel < ROUTE_CHANNELS; channel++) {
+        node->table[channel] = (map[channel] < ROUTE_CHANNELS)
+                                   ? map[channel]
+                                   : MIDI_ROUTE_DROP;
+    }
+    return (midi_route_ref_t)(2 * (graph->count - 1));
+}
+
+/**
+ * @brief Add a key map
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] input The messages to map
+ * @param [in] channels The channels to map
+ * @param [in] map Pointer to the new note of each note
+ * @return The mapped messages, or MIDI_ROUTE_INVALID
+ */
+midi_route_ref_t midi_route_add_key_map(midi_route_graph_t *graph,
+                                        midi_route_ref_t input,
+                                        uint16_t channels,
+                                        const uint8_t *map)
+{
+    if (map == NULL) { return MIDI_ROUTE_INVALID; }
+
+    midi_route_node_t *node = add_node(graph, MIDI_ROUTE_NOTE_MAP, input);
+    if (node == NULL) { return MIDI_ROUTE_INVALID; }
+
+    node->channels = channels;
+    for (size_t note = 0; note <= ROUTE_MAX_DATA_BYTE; note++) {
+        node->table[note] =
+            (map[note] <= ROUTE_MAX_DATA_BYTE) ? map[note] : MIDI_ROUTE_DROP;
+    }
+    return (midi_route_ref_t)(2 * (graph->count - 1));
+}
+
+/**
+ * @brief Add a transpose
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] input The messages to transpose
+ * @param [in] channels The channels to transpose
+ * @param [in] semitones The number of semitones to add
+ * @return The transposed messages, or MIDI_ROUTE_INVALID
+ */
+midi_route_ref_t midi_route_add_transpose(midi_route_graph_t *graph,
+                                          midi_route_ref_t input,
+                                          uint16_t channels,
+                                          int semitones)
+{
+    uint8_t map[ROUTE_MAX_DATA_BYTE + 1];
+
+    for (int note = 0; note <= ROUTE_MAX_DATA_BYTE; note++) {
+        const int shifted = note + semitones;
+        map[note] = (shifted >= 0 && shifted <= ROUTE_MAX_DATA_BYTE)
+                        ? (uint8_t)shifted
+                        : MIDI_ROUTE_DROP;
+    }
+    return midi_route_add_key_map(graph, input, channels, map);
+}
+
+/**
+ * @brief Add a value curve
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] input The messages to change
+ * @param [in] channels The channels to change
+ * @param [in] controller The controller to change, or MIDI_ROUTE_VELOCITY
+ * @param [in] table Pointer to the new value of each value
+ * @return The changed messages, or MIDI_ROUTE_INVALID
+ */
+midi_route_ref_t midi_route_add_curve(midi_route_graph_t *graph,
+                                      midi_route_ref_t input,
+                                      uint16_t channels,
+                                      uint8_t controller,
+                                      const uint8_t *table)
+{
+    if (table == NULL
+        || (controller != MIDI_ROUTE_VELOCITY
+            && controller >= MIDI_CC_ALL_SOUND_OFF)) {
+        return MIDI_ROUTE_INVALID;
+    }
+
+    midi_route_node_t *node = add_node(graph, MIDI_ROUTE_CURVE, input);
+    if (node == NULL) { return MIDI_ROUTE_INVALID; }
+
+    node->channels = channels;
+    node->controller = controller;
+    for (size_t value = 0; value <= ROUTE_MAX_DATA_BYTE; value++) {
+        uint8_t mapped = table[value] & ROUTE_MAX_DATA_BYTE;
+        if (controller == MIDI_ROUTE_VELOCITY) {
+            mapped = (value == 0) ? 0 : (mapped == 0) ? 1 : mapped;
+        }
+        node->table[value] = mapped;
+    }
+    return (midi_route_ref_t)(2 * (graph->count - 1));
+}
+
+/**
+ * @brief Add a split
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] input The messages to split
+ * @param [in] match Pointer to the match of the first part
+ * @return The messages that matched, or MIDI_ROUTE_INVALID
+ */
+midi_route_ref_t midi_route_add_split(midi_route_graph_t *graph,
+                                      midi_route_ref_t input,
+                                      const midi_route_match_t *match)
+{
+    if (match == NULL) { return MIDI_ROUTE_INVALID; }
+
+    midi_route_node_t *node = add_node(graph, MIDI_ROUTE_SPLIT, input);
+    if (node == NULL) { return MIDI_ROUTE_INVALID; }
+
+    node->match = *match;
+    normalize_match(&node->match);
+    return (midi_route_ref_t)(2 * (graph->count - 1));
+}
+
+/**
+ * @brief Add a merge
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] first The first input
+ * @param [in] second The second input
+ * @return The merged messages, or MIDI_ROUTE_INVALID
+ */
+midi_route_ref_t midi_route_add_merge(midi_route_graph_t *graph,
+                                      midi_route_ref_t first,
+                                      midi_route_ref_t second)
+{
+    if (graph == NULL || !is_valid_ref(graph, second)) {
+        return MIDI_ROUTE_INVALID;
+    }
+
+    midi_route_node_t *node = add_node(graph, MIDI_ROUTE_MERGE, first);
+    if (node == NULL) { return MIDI_ROUTE_INVALID; }
+
+    node->inputs[1] = second;
+    return (midi_route_ref_t)(2 * (graph->count - 1));
+}
+
+/**
+ * @brief Send messages to an output
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] input The messages to send
+ * @param [in] output The number of the output
+ * @return 1 if the output was added, 0 otherwise
+ */
+int midi_route_add_output(midi_route_graph_t *graph,
+                          midi_route_ref_t input,
+                          uint8_t output)
+{
+    if (graph == NULL || output >= MIDI_ROUTE_MAX_OUTPUTS
+        || (graph->outputs & (1u << output))) {
+        return 0;
+    }
+
+    midi_route_node_t *node = add_node(graph, MIDI_ROUTE_OUTPUT, input);
+    if (node == NULL) { return 0; }
+
+    node->output = output;
+    graph->outputs |= 1u << output;
+    return 1;
+}
+
+/**
+ * @brief Compile a graph into a plan
+ * @param [out] plan Pointer to a midi_route_plan_t struct
+ * @param [in] graph Pointer to the graph
+ * @param [in] batch The largest number of messages of a run
+ * @param [in] storage Pointer to the storage of the buffers, or NULL
+ * @param [in] size The number of bytes of storage
+ * @return The number of bytes of storage needed, or 0
+ */
+size_t midi_route_compile(midi_route_plan_t *plan,
+                          const midi_route_graph_t *graph,
+                          size_t batch,
+                          uint8_t *storage,
+                          size_t size)
+{
+    uint8_t consumers[ROUTE_SOURCE_INDEX + 1] = {0};
+    uint8_t buffer_of[ROUTE_SOURCE_INDEX + 1];
+    uint8_t stage_of[ROUTE_SOURCE_INDEX + 1];
+
+    /* Check for NULL pointers */
+    if (plan == NULL || graph == NULL || batch == 0
+        || batch > MIDI_ROUTE_MAX_BATCH) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < graph->count; i++) {
+        const midi_route_node_t *node = &graph->nodes[i];
+        consumers[ref_index(node->inputs[0])]++;
+        if (node->kind == MIDI_ROUTE_MERGE) {
+            consumers[ref_index(node->inputs[1])]++;
+        }
+    }
+
+    plan->batch = 0;
+    plan->stage_count = 0;
+    plan->buffer_count = 1;
+    plan->buffers[0].batches = 1;
+    memset(plan->outputs, MIDI_ROUTE_DROP, sizeof(plan->outputs));
+    buffer_of[ROUTE_SOURCE_INDEX] = 0;
+    stage_of[ROUTE_SOURCE_INDEX] = ROUTE_NO_STAGE;
+
+    for (size_t i = 0; i < graph->count; i++) {
+        const midi_route_node_t *node = &graph->nodes[i];
+        const size_t input = ref_index(node->inputs[0]);
+        const uint8_t stage_in = stage_of[input];
+
+        if (node->kind == MIDI_ROUTE_OUTPUT) {
+            plan->outputs[node->output] = buffer_of[input];
+            continue;
+        }
+
+        /* Fuse with the stage before if nothing else sees its output */
+        if (consumers[input] == 1 && stage_in != ROUTE_NO_STAGE
+            && (input & 1) == 0
+            && fuse(&plan->stages[stage_in].node, node)) {
+            buffer_of[2 * i] = buffer_of[input];
+            stage_of[2 * i] = stage_in;
+            continue;
+        }
+
+        midi_route_stage_t *stage = &plan->stages[plan->stage_count];
+        const size_t batches = plan->buffers[buffer_of[input]].batches;
+
+        stage->node = *node;
+        stage->input = buffer_of[input];
+        stage->second = stage->input;
+        stage->other = stage->input;
+
+        if (node->kind == MIDI_ROUTE_MERGE) {
+            stage->second = buffer_of[ref_index(node->inputs[1])];
+            stage->output = (uint8_t)plan->buffer_count++;
+            plan->buffers[stage->output].batches =
+                batches + plan->buffers[stage->second].batches;
+        } else if (consumers[input] == 1) {
+            stage->output = stage->input;
+        } else {
+            stage->output = (uint8_t)plan->buffer_count++;
+            plan->buffers[stage->output].batches = batches;
+        }
+
+        if (node->kind == MIDI_ROUTE_SPLIT) {
+            stage->other = (uint8_t)plan->buffer_count++;
+            plan->buffers[stage->other].batches = batches;
+        }
+
+        buffer_of[2 * i] = stage->output;
+        buffer_of[2 * i + 1] = stage->other;
+        stage_of[2 * i] = (uint8_t)plan->stage_count;
+        stage_of[2 * i + 1] = (uint8_t)plan->stage_count;
+        plan->stage_count++;
+    }
+
+    /* Carve the buffers out of the storage */
+    size_t required = 0;
+    for (size_t b = 0; b < plan->buffer_count; b++) {
+        required += buffer_size(plan->buffers[b].batches * batch);
+    }
+    if (storage == NULL || required > size) { return required; }
+
+    size_t offset = 0;
+    for (size_t b = 0; b < plan->buffer_count; b++) {
+        midi_route_buffer_t *buffer = &plan->buffers[b];
+        const size_t entries = buffer->batches * batch;
+
+        buffer->events = (midi_packed_t *)(void *)(storage + offset);
+        buffer->sources = (uint16_t *)(void *)(buffer->events + entries);
+        buffer->count = 0;
+        offset += buffer_size(entries);
+    }
+    plan->batch = batch;
+    return required;
+}
+
+/**
+ * @brief Run a batch of messages through a plan
+ * @param [in,out] plan Pointer to a compiled midi_route_plan_t struct
+ * @param [in] events Pointer to the packed messages
+ * @param [in] count The number of messages
+ * @return The number of messages run
+ */
+size_t midi_route_run(midi_route_plan_t *plan,
+                      const midi_packed_t *events,
+                      size_t count)
+{
+    /* Check for NULL pointers */
+    if (plan == NULL || events == NULL || plan->batch == 0) { return 0; }
+
+    if (count > plan->batch) { count = plan->batch; }
+
+    midi_route_buffer_t *source = &plan->buffers[0];
+    memcpy(source->events, events, count * sizeof(midi_packed_t));
+    for (size_t i = 0; i < count; i++) { source->sources[i] = (uint16_t)i; }
+    source->count = count;
+
+    for (size_t s = 0; s < plan->stage_count; s++) {
+        const midi_route_stage_t *stage = &plan->stages[s];
+        const midi_route_buffer_t *in = &plan->buffers[stage->input];
+        midi_route_buffer_t *out = &plan->buffers[stage->output];
+
+        switch (stage->node.kind) {
+        case MIDI_ROUTE_FILTER:
+            run_filter(stage, in, out);
+            break;
+        case MIDI_ROUTE_CHANNEL_MAP:
+            run_channel_map(stage, in, out);
+            break;
+        case MIDI_ROUTE_NOTE_MAP:
+            run_note_map(stage, in, out);
+            break;
+        case MIDI_ROUTE_CURVE:
+            run_curve(stage, in, out);
+            break;
+        case MIDI_ROUTE_SPLIT:
+            run_split(stage, in, out, &plan->buffers[stage->other]);
+            break;
+        case MIDI_ROUTE_MERGE:
+            run_merge(in, &plan->buffers[stage->second], out);
+            break;
+        default:
+            break;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Get the messages of an output after midi_route_run
+ * @param [in] plan Pointer to a midi_route_plan_t struct
+ * @param [in] output The number of the output
+ * @param [out] events Pointer that receives a pointer to the messages
+ * @param [out] sources Optional pointer that receives a pointer to the
+ *      index in the batch of each message
+ * @return The number of messages
+ */
+size_t midi_route_output(const midi_route_plan_t *plan,
+                         size_t output,
+                         const midi_packed_t **events,
+                         const uint16_t **sources)
+{
+    /* Check for NULL pointers */
+    if (events == NULL) { return 0; }
+
+    *events = NULL;
+    if (sources != NULL) { *sources = NULL; }
+
+    if (plan == NULL || plan->batch == 0 || output >= MIDI_ROUTE_MAX_OUTPUTS
+        || plan->outputs[output] == MIDI_ROUTE_DROP) {
+        return 0;
+    }
+
+    const midi_route_buffer_t *buffer = &plan->buffers[plan->outputs[output]];
+    *events = buffer->events;
+    if (sources != NULL) { *sources = buffer->sources; }
+    return buffer->count;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Get the index of a reference in the per-reference arrays
+ */
+static inline size_t ref_index(midi_route_ref_t ref)
+{
+    return (ref == MIDI_ROUTE_SOURCE) ? ROUTE_SOURCE_INDEX : (size_t)ref;
+}
+
+/**
+ * @brief Get the bytes of a buffer, rounded up so the next one is aligned
+ */
+static inline size_t buffer_size(size_t entries)
+{
+    const size_t bytes = entries * (sizeof(midi_packed_t) + sizeof(uint16_t));
+    return (bytes + 3) & ~(size_t)3;
+}
+
+/**
+ * @brief Check that a reference names the source or an earlier node
+ * @details Only splits have a second reference
+ */
+static int is_valid_ref(const midi_route_graph_t *graph, midi_route_ref_t ref)
+{
+    if (ref == MIDI_ROUTE_SOURCE) { return 1; }
+    if (ref == MIDI_ROUTE_INVALID || (size_t)(ref >> 1) >= graph->count) {
+        return 0;
+    }
+
+    const midi_route_node_t *node = &graph->nodes[ref >> 1];
+    if (node->kind == MIDI_ROUTE_OUTPUT) { return 0; }
+    return (ref & 1) == 0 || node->kind == MIDI_ROUTE_SPLIT;
+}
+
+/**
+ * @brief Append a node to a graph
+ * @return Pointer to the node, or NULL if the graph is full or the input
+ *      is invalid
+ */
+static midi_route_node_t *add_node(midi_route_graph_t *graph,
+                                   midi_route_kind_t kind,
+                                   midi_route_ref_t input)
+{
+    if (graph == NULL || graph->count == MIDI_ROUTE_MAX_NODES
+        || !is_valid_ref(graph, input)) {
+        return NULL;
+    }
+
+    midi_route_node_t *node = &graph->nodes[graph->count++];
+    memset(node, 0, sizeof(*node));
+    node->kind = kind;
+    node->inputs[0] = input;
+    node->inputs[1] = MIDI_ROUTE_INVALID;
+    return node;
+}
+
+/**
+ * @brief Turn an empty note range into disabled note types
+ * @details So that match_event can test the range with one comparison
+ */
+static void normalize_match(midi_route_match_t *match)
+{
+    if (match->note_max > ROUTE_MAX_DATA_BYTE) {
+        match->note_max = ROUTE_MAX_DATA_BYTE;
+    }
+    if (match->note_min > match->note_max) {
+        midi_route_match_set_type(match, MIDI_MESSAGE_NOTE_OFF, 0);
+        midi_route_match_set_type(match, MIDI_MESSAGE_NOTE_ON, 0);
+        midi_route_match_set_type(match, MIDI_MESSAGE_KEY_PRESSURE, 0);
+        match->note_min = 0;
+        match->note_max = ROUTE_MAX_DATA_BYTE;
+    }
+}
+
+/**
+ * @brief Fold a node into the stage node before it
+ * @return 1 if the nodes were fused, 0 if they cannot be
+ */
+static int fuse(midi_route_node_t *first, const midi_route_node_t *second)
+{
+    if (first->kind != second->kind) { return 0; }
+
+    switch (first->kind) {
+    case MIDI_ROUTE_FILTER: {
+        midi_route_match_t *match = &first->match;
+        for (size_t word = 0; word < 8; word++) {
+            match->types[word] &= second->match.types[word];
+        }
+        match->channels &= second->match.channels;
+        if (second->match.note_min > match->note_min) {
+            match->note_min = second->match.note_min;
+        }
+        if (second->match.note_max < match->note_max) {
+            match->note_max = second->match.note_max;
+        }
+        normalize_match(match);
+        return 1;
+    }
+    case MIDI_ROUTE_CHANNEL_MAP:
+        for (size_t channel = 0; channel < ROUTE_CHANNELS; channel++) {
+            const uint8_t mapped = first->table[channel];
+            if (mapped != MIDI_ROUTE_DROP) {
+                first->table[channel] = second->table[mapped];
+            }
+        }
+        return 1;
+    case MIDI_ROUTE_NOTE_MAP:
+        if (first->channels != second->channels) { return 0; }
+        for (size_t note = 0; note <= ROUTE_MAX_DATA_BYTE; note++) {
+            const uint8_t mapped = first->table[note];
+            if (mapped != MIDI_ROUTE_DROP) {
+                first->table[note] = second->table[mapped];
+            }
+        }
+        return 1;
+    case MIDI_ROUTE_CURVE:
+        if (first->channels != second->channels
+            || first->controller != second->controller) {
+            return 0;
+        }
+        for (size_t value = 0; value <= ROUTE_MAX_DATA_BYTE; value++) {
+            first->table[value] = second->table[first->table[value]];
+        }
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Check whether a message type carries a note number
+ * @return 1 for Note Off, Note On and Polyphonic Key Pressure
+ */
+static inline uint32_t is_note(uint32_t message_type)
+{
+    return (uint8_t)(message_type - MIDI_MESSAGE_NOTE_OFF)
+           <= (MIDI_MESSAGE_KEY_PRESSURE - MIDI_MESSAGE_NOTE_OFF);
+}
+
+/**
+ * @brief Check a message against a match, without branches
+ * @return 1 if the message matches, 0 otherwise
+ */
+static inline uint32_t match_event(const midi_route_match_t *match,
+                                   midi_packed_t event)
+{
+    const uint32_t type = event >> 24;
+    const uint32_t channel = (event >> 16) & 0xFF;
+    const uint32_t note = (event >> 8) & 0xFF;
+    const uint32_t span = (uint32_t)(match->note_max - match->note_min);
+
+    const uint32_t type_ok = (match->types[type >> 5] >> (type & 31)) & 1;
+    const uint32_t channel_bit = (channel < ROUTE_CHANNELS) ? channel : 16;
+    const uint32_t channel_ok = (match->channels >> channel_bit) & 1;
+    const uint32_t note_ok =
+        (is_note(type) ^ 1)
+        | ((uint32_t)(uint8_t)(note - match->note_min) <= span);
+
+    return type_ok & channel_ok & note_ok;
+}
+
+/**
+ * @brief Keep the messages that match
+ */
+static void run_filter(const midi_route_stage_t *stage,
+                       const midi_route_buffer_t *in,
+                       midi_route_buffer_t *out)
+{
+    const midi_route_match_t match = stage->node.match;
+    const midi_packed_t *events = in->events;
+    const uint16_t *sources = in->sources;
+    midi_packed_t *out_events = out->events;
+    uint16_t *out_sources = out->sources;
+    const size_t count = in->count;
+    size_t kept = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const midi_packed_t event = events[i];
+        const uint16_t source = sources[i];
+        out_events[kept] = event;
+        out_sources[kept] = source;
+        kept += match_event(&match, event);
+    }
+    out->count = kept;
+}
+
+/**
+ * @brief Change the channel of the channel messages
+ */
+static void run_channel_map(const midi_route_stage_t *stage,
+                            const midi_route_buffer_t *in,
+                            midi_route_buffer_t *out)
+{
+    const uint8_t *map = stage->node.table;
+    const midi_packed_t *events = in->events;
+    const uint16_t *sources = in->sources;
+    midi_packed_t *out_events = out->events;
+    uint16_t *out_sources = out->sources;
+    const size_t count = in->count;
+    size_t kept = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const midi_packed_t event = events[i];
+        const uint16_t source = sources[i];
+        const uint32_t channel = (event >> 16) & 0xFF;
+        const uint32_t mapped = map[channel & 0x0F];
+        const uint32_t applies = channel < ROUTE_CHANNELS;
+
+        const uint32_t mask = (0u - applies) & 0x00FF0000u;
+
+        out_events[kept] = (event & ~mask) | ((mapped << 16) & mask);
+        out_sources[kept] = source;
+        kept += (applies ^ 1) | (mapped != MIDI_ROUTE_DROP);
+    }
+    out->count = kept;
+}
+
+/**
+ * @brief Change the note number of the note messages
+ */
+static void run_note_map(const midi_route_stage_t *stage,
+                         const midi_route_buffer_t *in,
+                         midi_route_buffer_t *out)
+{
+    const uint8_t *map = stage->node.table;
+    const uint32_t channels = stage->node.channels;
+    const midi_packed_t *events = in->events;
+    const uint16_t *sources = in->sources;
+    midi_packed_t *out_events = out->events;
+    uint16_t *out_sources = out->sources;
+    const size_t count = in->count;
+    size_t kept = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const midi_packed_t event = events[i];
+        const uint16_t source = sources[i];
+        const uint32_t channel = (event >> 16) & 0x0F;
+        const uint32_t mapped = map[(event >> 8) & ROUTE_MAX_DATA_BYTE];
+        const uint32_t applies =
+            is_note(event >> 24) & (channels >> channel) & 1;
+
+        const uint32_t mask = (0u - applies) & 0x0000FF00u;
+
+        out_events[kept] = (event & ~mask) | ((mapped << 8) & mask);
+        out_sources[kept] = source;
+        kept += (applies ^ 1) | (mapped != MIDI_ROUTE_DROP);
+    }
+    out->count = kept;
+}
+
+/**
+ * @brief Change the velocity or controller value through the table
+ */
+static void run_curve(const midi_route_stage_t *stage,
+                      const midi_route_buffer_t *in,
+                      midi_route_buffer_t *out)
+{
+    const uint8_t *table = stage->node.table;
+    const uint32_t channels = stage->node.channels;
+    const uint32_t velocity = stage->node.controller == MIDI_ROUTE_VELOCITY;
+    const uint32_t type = velocity ? MIDI_MESSAGE_NOTE_ON
+                                   : MIDI_MESSAGE_CONTROL_CHANGE;
+    const uint32_t controller = stage->node.controller;
+    const midi_packed_t *events = in->events;
+    midi_packed_t *out_events = out->events;
+    const size_t count = in->count;
+
+    /* Nothing is dropped, so the sources only move if not in place */
+    if (out->sources != in->sources) {
+        memcpy(out->sources, in->sources, count * sizeof(uint16_t));
+    }
+    for (size_t i = 0; i < count; i++) {
+        const midi_packed_t event = events[i];
+        const uint32_t applies =
+            ((event >> 24) == type)
+            & (velocity | (((event >> 8) & 0xFF) == controller))
+            & (channels >> ((event >> 16) & 0x0F)) & 1;
+
+        const uint32_t mask = (0u - applies) & 0x000000FFu;
+        const uint32_t value = table[event & ROUTE_MAX_DATA_BYTE];
+
+        out_events[i] = (event & ~mask) | (value & mask);
+    }
+    out->count = count;
+}
+
+/**
+ * @brief Send the messages that match to one buffer and the others to
+ *        another
+ */
+static void run_split(const midi_route_stage_t *stage,
+                      const midi_route_buffer_t *in,
+                      midi_route_buffer_t *out,
+                      midi_route_buffer_t *other)
+{
+    const midi_route_match_t match = stage->node.match;
+    const midi_packed_t *events = in->events;
+    const uint16_t *sources = in->sources;
+    midi_packed_t *out_events = out->events;
+    uint16_t *out_sources = out->sources;
+    midi_packed_t *other_events = other->events;
+    uint16_t *other_sources = other->sources;
+    const size_t count = in->count;
+    size_t kept = 0;
+    size_t rest = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const midi_packed_t event = events[i];
+        const uint16_t source = sources[i];
+        const uint32_t matched = match_event(&match, event);
+
+        other_events[rest] = event;
+        other_sources[rest] = source;
+        out_events[kept] = event;
+        out_sources[kept] = source;
+        kept += matched;
+        rest += matched ^ 1;
+    }
+    out->count = kept;
+    other->count = rest;
+}
+
+/**
+ * @brief Merge two buffers in the order of the batch
+ */
+static void run_merge(const midi_route_buffer_t *first,
+                      const midi_route_buffer_t *second,
+                      midi_route_buffer_t *out)
+{
+    size_t a = 0;
+    size_t b = 0;
+    size_t count = 0;
+
+    while (a < first->count && b < second->count) {
+        if (second->sources[b] < first->sources[a]) {
+            out->events[count] = second->events[b];
+            out->sources[count++] = second->sources[b++];
+        } else {
+            out->events[count] = first->events[a];
+            out->sources[count++] = first->sources[a++];
+        }
+    }
+    while (a < first->count) {
+        out->events[count] = first->events[a];
+        out->sources[count++] = first->sources[a++];
+    }
+    while (b < second->count) {
+        out->events[count] = second->events[b];
+        out->sources[count++] = second->sources[b++];
+    }
+    out->count = count;
+}
@@ -0,0 +1,475 @@
+/**********************************************************************
+ * @file midi_route.h
+ * @brief MIDI routing module
+ *
+ * @details This module runs packed messages through a static graph of
+ *          transforms: filters, channel remaps, key maps and transposes,
+ *          value curves, splits and merges, ending in numbered outputs.
+ *
+ *          The graph is built once with the `midi_route_add_*`
+ *          functions and compiled into a plan: a flat list of stages in
+ *          graph order, each working on a whole batch of messages at a
+ *          time in one tight loop, in place whenever its input feeds
+ *          nothing else. Consecutive stages of the same kind are fused
+ *          while compiling: filters into one filter, and remaps, key
+ *          maps and curves into one table each, so a chain of curves
+ *          costs one lookup per message. The buffers between the stages
+ *          live in storage provided by the caller, and nothing is
+ *          allocated after compiling.
+ *
+ *          Each message carries the index it had in the batch, so the
+ *          outputs tell where every message came from, for example to
+ *          find its timestamp, and merges keep the messages in the order
+ *          they arrived in.
+ *
+ *          A plan is not thread-safe, but several threads may each run
+ *          their own plan compiled from the same graph.
+ **********************************************************************/
+
+#ifndef MIDI_ROUTE_H
+#define MIDI_ROUTE_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Maximum number of nodes of a graph
+ */
+#define MIDI_ROUTE_MAX_NODES (32)
+
+/**
+ * @brief Number of outputs of a graph
+ */
+#define MIDI_ROUTE_MAX_OUTPUTS (8)
+
+/**
+ * @brief Maximum number of buffers of a plan
+ * @details The input batch, and at most two per node
+ */
+#define MIDI_ROUTE_MAX_BUFFERS (2 * MIDI_ROUTE_MAX_NODES + 1)
+
+/**
+ * @brief Maximum number of messages of a batch
+ */
+#define MIDI_ROUTE_MAX_BATCH (65536)
+
+/**
+ * @brief Reference to the messages given to midi_route_run
+ */
+#define MIDI_ROUTE_SOURCE ((midi_route_ref_t)0xFFFE)
+
+/**
+ * @brief Reference returned when a node could not be added
+ * @details Adding a node to an invalid reference fails too, so a chain
+ *          of calls only needs to be checked at the end
+ */
+#define MIDI_ROUTE_INVALID ((midi_route_ref_t)0xFFFF)
+
+/**
+ * @brief Reference to the messages a split did not match
+ * @param split The reference returned by midi_route_add_split
+ */
+#define MIDI_ROUTE_ELSE(split) ((midi_route_ref_t)((split) | 1))
+
+/**
+ * @brief Table entry that drops the message, in remaps and key maps
+ */
+#define MIDI_ROUTE_DROP (0xFF)
+
+/**
+ * @brief Curve target for the velocity of Note On messages
+ */
+#define MIDI_ROUTE_VELOCITY (0xFF)
+
+/**
+ * @brief Channel mask of every channel
+ */
+#define MIDI_ROUTE_ALL_CHANNELS (0xFFFF)
+
+/**
+ * @brief Bit of midi_route_match_t.channels for system messages
+ */
+#define MIDI_ROUTE_SYSTEM_CHANNEL (1ul << 16)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Reference to the messages a node produces
+ * @details Returned by the `midi_route_add_*` functions and given as the
+ *          input of the next nodes
+ */
+typedef uint16_t midi_route_ref_t;
+
+/**
+ * @brief Message Match
+ * @details The messages that filters keep and splits send to their first
+ *          reference. Initialize with midi_route_match_init, which
+ *          matches every message, and narrow down the fields that matter.
+ */
+typedef struct midi_route_match_t {
+    /**
+     * @brief Bit n of word n / 32 is set if message type n matches
+     * @details Set with midi_route_match_set_type
+     */
+    uint32_t types[8];
+
+    /**
+     * @brief Bit n is set if channel n matches, and
+     *        MIDI_ROUTE_SYSTEM_CHANNEL if system messages match
+     */
+    uint32_t channels;
+
+    /**
+     * @brief The range of note numbers that match, inclusive
+     * @details Applies to Note On, Note Off and Polyphonic Key Pressure.
+     *          Other messages match whatever their data bytes.
+     */
+    uint8_t note_min;
+    uint8_t note_max;
+} midi_route_match_t;
+
+/**
+ * @brief Node Kind
+ */
+typedef enum midi_route_kind_t {
+    MIDI_ROUTE_FILTER,
+    MIDI_ROUTE_CHANNEL_MAP,
+    MIDI_ROUTE_NOTE_MAP,
+    MIDI_ROUTE_CURVE,
+    MIDI_ROUTE_SPLIT,
+    MIDI_ROUTE_MERGE,
+    MIDI_ROUTE_OUTPUT,
+} midi_route_kind_t;
+
+/**
+ * @brief Graph Node
+ * @note The fields of this struct should not be accessed directly
+ */
+typedef struct midi_route_node_t {
+    midi_route_kind_t kind;
+
+    /**
+     * @brief The inputs, the second one for merges only
+     */
+    midi_route_ref_t inputs[2];
+
+    /**
+     * @brief The channels that key maps and curves apply to
+     */
+    uint16_t channels;
+
+    /**
+     * @brief The controller a curve applies to, or MIDI_ROUTE_VELOCITY
+     */
+    uint8_t controller;
+
+    /**
+     * @brief The number of an output node
+     */
+    uint8_t output;
+
+    /**
+     * @brief The match of a filter or split
+     */
+    midi_route_match_t match;
+
+    /**
+     * @brief The new channels of a remap, the new notes of a key map or
+     *        the new values of a curve, indexed by the old ones
+     */
+    uint8_t table[128];
+} midi_route_node_t;
+
+/**
+ * @brief Routing Graph
+ * @note The fields of this struct should not be accessed directly.
+ *       Use the `midi_route_add_*` functions.
+ */
+typedef struct midi_route_graph_t {
+    midi_route_node_t nodes[MIDI_ROUTE_MAX_NODES];
+    size_t count;
+
+    /**
+     * @brief Bit n is set if output n has a node
+     */
+    uint32_t outputs;
+} midi_route_graph_t;
+
+/**
+ * @brief Plan Stage
+ * @note The fields of this struct should not be accessed directly
+ */
+typedef struct midi_route_stage_t {
+    /**
+     * @brief The node, holding the fused tables
+     */
+    midi_route_node_t node;
+
+    /**
+     * @brief The buffers the stage reads, the second one for merges
+     */
+    uint8_t input;
+    uint8_t second;
+
+    /**
+     * @brief The buffers the stage writes, the second one for the
+     *        messages a split did not match
+     */
+    uint8_t output;
+    uint8_t other;
+} midi_route_stage_t;
+
+/**
+ * @brief Plan Buffer
+ * @note The fields of this struct should not be accessed directly
+ */
+typedef struct midi_route_buffer_t {
+    /**
+     * @brief The messages, in the caller's storage
+     */
+    midi_packed_t *events;
+
+    /**
+     * @brief The index in the batch of each message
+     */
+    uint16_t *sources;
+
+    /**
+     * @brief The number of messages
+     */
+    size_t count;
+
+    /**
+     * @brief The number of messages the buffer has room for, in batches
+     */
+    size_t batches;
+} midi_route_buffer_t;
+
+/**
+ * @brief Routing Plan
+ * @note The fields of this struct should not be accessed directly.
+ *       Use the `midi_route_*` functions.
+ */
+typedef struct midi_route_plan_t {
+    midi_route_stage_t stages[MIDI_ROUTE_MAX_NODES];
+    size_t stage_count;
+
+    midi_route_buffer_t buffers[MIDI_ROUTE_MAX_BUFFERS];
+    size_t buffer_count;
+
+    /**
+     * @brief The buffer of each output, or MIDI_ROUTE_DROP if the output
+     *        has no node
+     */
+    uint8_t outputs[MIDI_ROUTE_MAX_OUTPUTS];
+
+    /**
+     * @brief The number of messages of a batch, 0 until the plan is
+     *        compiled
+     */
+    size_t batch;
+} midi_route_plan_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a match that matches every message
+ * @param [out] match Pointer to a midi_route_match_t struct
+ */
+void midi_route_match_init(midi_route_match_t *match);
+
+/**
+ * @brief Enable or disable a message type in a match
+ * @param [in,out] match Pointer to a midi_route_match_t struct
+ * @param [in] message_type The message type, or MIDI_MESSAGE_NONE for
+ *      every type
+ * @param [in] enabled 1 to match the type, 0 not to
+ */
+void midi_route_match_set_type(midi_route_match_t *match,
+                               midi_message_type_t message_type,
+                               int enabled);
+
+/**
+ * @brief Initialize an empty graph
+ * @param [out] graph Pointer to a midi_route_graph_t struct
+ */
+void midi_route_graph_init(midi_route_graph_t *graph);
+
+/**
+ * @brief Add a filter
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] input The messages to filter
+ * @param [in] match Pointer to the match of the messages to keep
+ * @return The messages that matched, or MIDI_ROUTE_INVALID
+ */
+midi_route_ref_t midi_route_add_filter(midi_route_graph_t *graph,
+                                       midi_route_ref_t input,
+                                       const midi_route_match_t *match);
+
+/**
+ * @brief Add a channel remap
+ * @details System messages pass unchanged
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] input The messages to remap
+ * @param [in] map Pointer to 16 entries: the new channel of each channel,
+ *      or MIDI_ROUTE_DROP to drop its messages
+ * @return The remapped messages, or MIDI_ROUTE_INVALID
+ */
+midi_route_ref_t midi_route_add_remap(midi_route_graph_t *graph,
+                                      midi_route_ref_t input,
+                                      const uint8_t *map);
+
+/**
+ * @brief Add a key map
+ * @details Changes the note number of Note On, Note Off and Polyphonic
+ *          Key Pressure messages, for example to remap drum sounds.
+ *          Other messages pass unchanged.
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] input The messages to map
+ * @param [in] channels The channels to map, bit n for channel n
+ * @param [in] map Pointer to 128 entries: the new note of each note, or
+ *      MIDI_ROUTE_DROP to drop its messages
+ * @return The mapped messages, or MIDI_ROUTE_INVALID
+ */
+midi_route_ref_t midi_route_add_key_map(midi_route_graph_t *graph,
+                                        midi_route_ref_t input,
+                                        uint16_t channels,
+                                        const uint8_t *map);
+
+/**
+ * @brief Add a transpose
+ * @details A key map that shifts every note. Notes shifted out of the
+ *          range 0 to 127 are dropped.
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] input The messages to transpose
+ * @param [in] channels The channels to transpose, bit n for channel n
+ * @param [in] semitones The number of semitones to add, negative to
+ *      transpose down
+ * @return The transposed messages, or MIDI_ROUTE_INVALID
+ */
+midi_route_ref_t midi_route_add_transpose(midi_route_graph_t *graph,
+                                          midi_route_ref_t input,
+                                          uint16_t channels,
+                                          int semitones);
+
+/**
+ * @brief Add a value curve
+ * @details Replaces the velocity of Note On messages, or the value of
+ *          Control Change messages for one controller, through a table.
+ *          Velocities are never changed to or from 0, so that a Note On
+ *          stays a Note On.
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] input The messages to change
+ * @param [in] channels The channels to change, bit n for channel n
+ * @param [in] controller The controller to change, below 120, or
+ *      MIDI_ROUTE_VELOCITY
+ * @param [in] table Pointer to 128 entries: the new value of each value
+ * @return The changed messages, or MIDI_ROUTE_INVALID
+ */
+midi_route_ref_t midi_route_add_curve(midi_route_graph_t *graph,
+                                      midi_route_ref_t input,
+                                      uint16_t channels,
+                                      uint8_t controller,
+                                      const uint8_t *table);
+
+/**
+ * @brief Add a split
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] input The messages to split
+ * @param [in] match Pointer to the match of the first part
+ * @return The messages that matched, or MIDI_ROUTE_INVALID.
+ *      MIDI_ROUTE_ELSE of it refers to the others.
+ */
+midi_route_ref_t midi_route_add_split(midi_route_graph_t *graph,
+                                      midi_route_ref_t input,
+                                      const midi_route_match_t *match);
+
+/**
+ * @brief Add a merge
+ * @details The messages of both inputs, in the order of the batch. A
+ *          message that reaches both inputs is there twice, the one from
+ *          the first input first.
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] first The first input
+ * @param [in] second The second input
+ * @return The merged messages, or MIDI_ROUTE_INVALID
+ */
+midi_route_ref_t midi_route_add_merge(midi_route_graph_t *graph,
+                                      midi_route_ref_t first,
+                                      midi_route_ref_t second);
+
+/**
+ * @brief Send messages to an output
+ * @param [in,out] graph Pointer to a midi_route_graph_t struct
+ * @param [in] input The messages to send
+ * @param [in] output The number of the output, below
+ *      MIDI_ROUTE_MAX_OUTPUTS, that has no node yet
+ * @return 1 if the output was added, 0 otherwise
+ */
+int midi_route_add_output(midi_route_graph_t *graph,
+                          midi_route_ref_t input,
+                          uint8_t output);
+
+/**
+ * @brief Compile a graph into a plan
+ * @details Call with NULL storage to get the size of storage to provide.
+ * @param [out] plan Pointer to a midi_route_plan_t struct
+ * @param [in] graph Pointer to the graph. It can be changed or reused
+ *      once compiled.
+ * @param [in] batch The largest number of messages given to
+ *      midi_route_run at a time, at most MIDI_ROUTE_MAX_BATCH
+ * @param [in] storage Pointer to the storage of the buffers, aligned to 4
+ *      bytes. Must stay valid for as long as the plan is used.
+ * @param [in] size The number of bytes of storage
+ * @return The number of bytes of storage the plan needs, or 0 if an
+ *      argument is invalid. The plan is compiled only if storage was
+ *      given and the return value is at most size.
+ */
+size_t midi_route_compile(midi_route_plan_t *plan,
+                          const midi_route_graph_t *graph,
+                          size_t batch,
+                          uint8_t *storage,
+                          size_t size);
+
+/**
+ * @brief Run a batch of messages through a plan
+ * @details Replaces the messages of every output
+ * @param [in,out] plan Pointer to a compiled midi_route_plan_t struct
+ * @param [in] events Pointer to the packed messages
+ * @param [in] count The number of messages
+ * @return The number of messages run, at most the batch size of the plan.
+ *      Call again for the rest.
+ */
+size_t midi_route_run(midi_route_plan_t *plan,
+                      const midi_packed_t *events,
+                      size_t count);
+
+/**
+ * @brief Get the messages of an output after midi_route_run
+ * @param [in] plan Pointer to a midi_route_plan_t struct
+ * @param [in] output The number of the output
+ * @param [out] events Pointer that receives a pointer to the messages
+ * @param [out] sources Optional pointer that receives a pointer to the
+ *      index in the batch of each message. May be NULL.
+ * @return The number of messages. The pointers are valid until the next
+ *      run.
+ */
+size_t midi_route_output(const midi_route_plan_t *plan,
+                         size_t output,
+                         const midi_packed_t **events,
+                         const uint16_t **sources);
+
+#endif /* MIDI_ROUTE_H */
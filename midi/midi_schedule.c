@@ -0,0 +1,275 @@
+/***********************************************************************
+ * @file midi_schedule.c
+ * @brief MIDI output scheduler implementation
+ *
+ * @details Keeps the queued messages in a binary min-heap ordered by
+ *          deadline, then by the sequence number given when they were
+ *          pushed. Both are compared through their wrapped difference,
+ *          so that neither the clock nor the sequence number needs to be
+ *          reset when it wraps around.
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_schedule.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+#include "midi_encoder.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Sign bit of a wrapped difference
+ */
+#define SCHEDULE_SIGN_BIT (0x80000000u)
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static inline int is_before(uint32_t a, uint32_t b);
+
+static inline int is_earlier(const midi_scheduled_t *a,
+                             const midi_scheduled_t *b);
+
+static void sift_up(midi_scheduled_t *events, size_t index);
+
+static void sift_down(midi_scheduled_t *events, size_t count, size_t index);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a MIDI output scheduler
+ * @param [out] scheduler Pointer to a midi_scheduler_t struct
+ * @param [in] storage Pointer to the storage of the queue
+ * @param [in] capacity The number of messages the storage holds
+ * @param [in] config Pointer to an encoder whose settings are copied, or
+ *      NULL for the defaults
+ * @return 1 if the scheduler was initialized, 0 otherwise
+ */
+int midi_scheduler_init(midi_scheduler_t *scheduler,
+                        midi_scheduled_t *storage,
+                        size_t capacity,
+                        const midi_encoder_t *config)
+{
+    /* Check for NULL pointers */
+    if (scheduler == NULL || storage == NULL || capacity == 0) { return 0; }
+
+    scheduler->events = storage;
+    scheduler->capacity = capacity;
+    scheduler->count = 0;
+    scheduler->sequence = 0;
+    scheduler->overflow_count = 0;
+    if (config != NULL) {
+        scheduler->encoder = *config;
+    } else {
+        midi_encoder_init(&scheduler->encoder);
+    }
+    midi_encoder_reset(&scheduler->encoder);
+    return 1;
+}
+
+/**
+ * @brief Drop every queued message
+ * @param [in,out] scheduler Pointer to a midi_scheduler_t struct
+ */
+void midi_scheduler_clear(midi_scheduler_t *scheduler)
+{
+    /* Check for NULL pointers */
+    if (scheduler == NULL) { return; }
+
+    scheduler->count = 0;
+    midi_encoder_reset(&scheduler->encoder);
+}
+
+/**
+ * @brief Get the number of queued messages
+ * @param [in] scheduler Pointer to a midi_scheduler_t struct
+ * @return The number of queued messages
+ */
+size_t midi_scheduler_size(const midi_scheduler_t *scheduler)
+{
+    return scheduler != NULL ? scheduler->count : 0;
+}
+
+/**
+ * @brief Get the number of messages dropped because the queue was full
+ * @param [in] scheduler Pointer to a midi_scheduler_t struct
+ * @return The number of messages dropped
+ */
+size_t midi_scheduler_get_overflow_count(const midi_scheduler_t *scheduler)
+{
+    return scheduler != NULL ? scheduler->overflow_count : 0;
+}
+
+/**
+ * @brief Get the deadline of the earliest queued message
+ * @param [in] scheduler Pointer to a midi_scheduler_t struct
+ * @param [out] deadline Pointer that receives the deadline
+ * @return 1 if a message is queued, 0 otherwise
+ */
+int midi_scheduler_next_deadline(const midi_scheduler_t *scheduler,
+                                 uint32_t *deadline)
+{
+    /* Check for NULL pointers */
+    if (scheduler == NULL || deadline == NULL || scheduler->count == 0) {
+        return 0;
+    }
+
+    *deadline = scheduler->events[0].deadline;
+    return 1;
+}
+
+/**
+ * @brief Queue messages to send at their deadlines
+ * @param [in,out] scheduler Pointer to a midi_scheduler_t struct
+ * @param [in] packed Pointer to the packed messages to queue
+ * @param [in] deadlines Pointer to the deadline of each message
+ * @param [in] count The number of messages
+ * @param [in] offset The time added to every deadline
+ * @return The number of messages queued
+ */
+size_t midi_scheduler_push(midi_scheduler_t *scheduler,
+                           const midi_packed_t *packed,
+                           const uint32_t *deadlines,
+                           size_t count,
+                           uint32_t offset)
+{
+    /* Check for NULL pointers */
+    if (scheduler == NULL || packed == NULL || deadlines == NULL) {
+        return 0;
+    }
+
+    const size_t space = scheduler->capacity - scheduler->count;
+    const size_t pushed = count < space ? count : space;
+
+    for (size_t i = 0; i < pushed; i++) {
+        midi_scheduled_t *event = &scheduler->events[scheduler->count];
+
+        event->deadline = deadlines[i] + offset;
+        event->sequence = scheduler->sequence++;
+        event->message = packed[i];
+        sift_up(scheduler->events, scheduler->count++);
+    }
+
+    scheduler->overflow_count += count - pushed;
+    return pushed;
+}
+
+/**
+ * @brief Encode the messages that are due
+ * @param [in,out] scheduler Pointer to a midi_scheduler_t struct
+ * @param [in] now The current time
+ * @param [out] bytes Pointer to the buffer that receives the burst
+ * @param [in] capacity The size of the buffer in bytes
+ * @return The number of bytes written
+ */
+size_t midi_scheduler_poll(midi_scheduler_t *scheduler,
+                           uint32_t now,
+                           uint8_t *bytes,
+                           size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (scheduler == NULL || bytes == NULL) { return 0; }
+
+    midi_scheduled_t *events = scheduler->events;
+    size_t written = 0;
+
+    while (scheduler->count > 0 && !is_before(now, events[0].deadline)) {
+        /* Encode into a copy, so that a message that does not fit stays */
+        midi_encoder_t encoder = scheduler->encoder;
+        uint8_t encoded[MIDI_ENCODER_MAX_MESSAGE_SIZE];
+        const size_t length = midi_encode_packed(
+            &encoder, &events[0].message, 1, encoded, sizeof(encoded), NULL);
+        if (length > capacity - written) { break; }
+
+        memcpy(&bytes[written], encoded, length);
+        written += length;
+        scheduler->encoder = encoder;
+
+        /* Pop the earliest message */
+        events[0] = events[--scheduler->count];
+        sift_down(events, scheduler->count, 0);
+    }
+
+    return written;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Check whether a wrapped value comes before another
+ */
+static inline int is_before(uint32_t a, uint32_t b)
+{
+    return ((a - b) & SCHEDULE_SIGN_BIT) != 0;
+}
+
+/**
+ * @brief Check whether a scheduled message is sent before another
+ */
+static inline int is_earlier(const midi_scheduled_t *a,
+                             const midi_scheduled_t *b)
+{
+    if (a->deadline != b->deadline) {
+        return is_before(a->deadline, b->deadline);
+    }
+    return is_before(a->sequence, b->sequence);
+}
+
+/**
+ * @brief Move an entry up the heap to its place
+ */
+static void sift_up(midi_scheduled_t *events, size_t index)
+{
+    const midi_scheduled_t event = events[index];
+
+    while (index > 0) {
+        const size_t parent = (index - 1) / 2;
+        if (!is_earlier(&event, &events[parent])) { break; }
+        events[index] = events[parent];
+        index = parent;
+    }
+    events[index] = event;
+}
+
+/**
+ * @brief Move an entry down the heap to its place
+ */
+static void sift_down(midi_scheduled_t *events, size_t count, size_t index)
+{
+    if (count == 0) { return; }
+
+    const midi_scheduled_t event = events[index];
+
+    for (;;) {
+        const size_t left = 2 * index + 1;
+        if (left >= count) { break; }
+
+        const size_t right = left + 1;
+        const size_t child =
+            right < count && is_earlier(&events[right], &events[left])
+                ? right
+                : left;
+        if (!is_earlier(&events[child], &event)) { break; }
+        events[index] = events[child];
+        index = child;
+    }
+    events[index] = event;
+}
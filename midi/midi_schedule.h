@@ -0,0 +1,173 @@
+/**********************************************************************
+ * @file midi_schedule.h
+ * @brief MIDI output scheduler module
+ *
+ * @details This module queues outbound messages with the time they are
+ *          due, and encodes the messages that are due into byte bursts
+ *          for the output port. The queue is a binary min-heap over
+ *          storage provided by the caller, so that pushing and popping
+ *          take O(log n) time whatever the order of the deadlines.
+ *          Messages with the same deadline are sent in the order they
+ *          were pushed.
+ *
+ *          Deadlines are compared modulo 2^32, like the timestamps of
+ *          midi_parse_buffer_timed, so the clock may wrap around as long
+ *          as every queued deadline is within 2^31 ticks of the current
+ *          time. Messages timed by the parser can be pushed as they are,
+ *          with an offset that adds a fixed latency, to replay a capture
+ *          with its original timing.
+ **********************************************************************/
+
+#ifndef MIDI_SCHEDULE_H
+#define MIDI_SCHEDULE_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+#include "midi_encoder.h"
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Scheduled Message
+ * @note The fields of this struct should not be accessed directly
+ */
+typedef struct midi_scheduled_t {
+    uint32_t deadline;
+    uint32_t sequence;
+    midi_packed_t message;
+} midi_scheduled_t;
+
+/**
+ * @brief MIDI Output Scheduler
+ * @note The fields of this struct should not be accessed directly.
+ *       Use the `midi_scheduler_*` functions.
+ */
+typedef struct midi_scheduler_t {
+    /**
+     * @brief The heap of scheduled messages, earliest first
+     */
+    midi_scheduled_t *events;
+
+    /**
+     * @brief The number of entries of the events storage
+     */
+    size_t capacity;
+
+    /**
+     * @brief The number of queued messages
+     */
+    size_t count;
+
+    /**
+     * @brief The sequence number of the next pushed message
+     * @details Orders the messages that share a deadline
+     */
+    uint32_t sequence;
+
+    /**
+     * @brief The number of messages dropped because the queue was full
+     */
+    size_t overflow_count;
+
+    /**
+     * @brief Encodes the messages that are due
+     */
+    midi_encoder_t encoder;
+} midi_scheduler_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a MIDI output scheduler
+ * @param [out] scheduler Pointer to a midi_scheduler_t struct
+ * @param [in] storage Pointer to the storage of the queue
+ * @param [in] capacity The number of messages the storage holds
+ * @param [in] config Pointer to an encoder whose settings are copied to
+ *      the scheduler, or NULL for the defaults of midi_encoder_init
+ * @return 1 if the scheduler was initialized, 0 if a pointer is NULL or
+ *      the capacity is 0
+ */
+int midi_scheduler_init(midi_scheduler_t *scheduler,
+                        midi_scheduled_t *storage,
+                        size_t capacity,
+                        const midi_encoder_t *config);
+
+/**
+ * @brief Drop every queued message
+ * @details Also clears running status, so that the next burst starts
+ *          with a status byte
+ * @param [in,out] scheduler Pointer to a midi_scheduler_t struct
+ */
+void midi_scheduler_clear(midi_scheduler_t *scheduler);
+
+/**
+ * @brief Get the number of queued messages
+ * @param [in] scheduler Pointer to a midi_scheduler_t struct
+ * @return The number of queued messages
+ */
+size_t midi_scheduler_size(const midi_scheduler_t *scheduler);
+
+/**
+ * @brief Get the number of messages dropped because the queue was full
+ * @param [in] scheduler Pointer to a midi_scheduler_t struct
+ * @return The number of messages dropped since the scheduler was
+ *      initialized
+ */
+size_t midi_scheduler_get_overflow_count(const midi_scheduler_t *scheduler);
+
+/**
+ * @brief Get the deadline of the earliest queued message
+ * @details Lets the caller program its timer for the next burst
+ * @param [in] scheduler Pointer to a midi_scheduler_t struct
+ * @param [out] deadline Pointer that receives the deadline
+ * @return 1 if a message is queued, 0 if the queue is empty
+ */
+int midi_scheduler_next_deadline(const midi_scheduler_t *scheduler,
+                                 uint32_t *deadline);
+
+/**
+ * @brief Queue messages to send at their deadlines
+ * @details Messages that do not fit are dropped and counted as overflow
+ * @param [in,out] scheduler Pointer to a midi_scheduler_t struct
+ * @param [in] packed Pointer to the packed messages to queue
+ * @param [in] deadlines Pointer to the deadline of each message
+ * @param [in] count The number of messages
+ * @param [in] offset The time added to every deadline, for example the
+ *      latency of a replay
+ * @return The number of messages queued
+ */
+size_t midi_scheduler_push(midi_scheduler_t *scheduler,
+                           const midi_packed_t *packed,
+                           const uint32_t *deadlines,
+                           size_t count,
+                           uint32_t offset);
+
+/**
+ * @brief Encode the messages that are due
+ * @details Pops the messages whose deadline is not after now, earliest
+ *          first, and encodes them into one burst until every due
+ *          message is sent or the next one does not fit. Messages that
+ *          cannot be encoded (System Exclusive, MIDI_MESSAGE_NONE) are
+ *          dropped.
+ * @param [in,out] scheduler Pointer to a midi_scheduler_t struct
+ * @param [in] now The current time
+ * @param [out] bytes Pointer to the buffer that receives the burst
+ * @param [in] capacity The size of the buffer in bytes
+ * @return The number of bytes written
+ * @note Messages that did not fit stay queued for the next call
+ */
+size_t midi_scheduler_poll(midi_scheduler_t *scheduler,
+                           uint32_t now,
+                           uint8_t *bytes,
+                           size_t capacity);
+
+#endif /* MIDI_SCHEDULE_H */
@@ -0,0 +1,347 @@
+/***********************************************************************
+ * @file midi_smf.c
+ * @brief Standard MIDI File implementation
+ *
+ * @details Reads Standard MIDI Files from a file image in memory. The
+ *          chunks are indexed when the file is opened, and track events
+ *          are decoded one at a time by midi_smf_next_event, with the
+ *          channel messages decoded by midi_decode_message.
+ *
+ * @see Standard MIDI Files 1.0
+ *      https://midi.org/standard-midi-files-specification
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_smf.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Size of a chunk header (four byte type and four byte length)
+ */
+#define SMF_CHUNK_HEADER_SIZE (8)
+
+/**
+ * @brief Minimum length of the MThd chunk contents
+ */
+#define SMF_HEADER_LENGTH (6)
+
+/**
+ * @brief Maximum number of bytes in a variable-length quantity
+ */
+#define SMF_MAX_VLQ_SIZE (4)
+
+/**
+ * @brief Variable-length quantity bits
+ * @details Each byte holds seven bits of the value, most significant
+ *          first, and has its top bit set if more bytes follow
+ */
+#define SMF_VLQ_VALUE_MASK (0x7F)
+#define SMF_VLQ_CONTINUE (0x80)
+
+/**
+ * @brief MIDI Maximum Data Byte Value
+ */
+#define SMF_MAX_DATA_BYTE (0x7F)
+
+/**
+ * @brief Status byte of a meta event
+ */
+#define SMF_META_STATUS (0xFF)
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static inline uint32_t read_be32(const uint8_t *bytes);
+
+static inline uint16_t read_be16(const uint8_t *bytes);
+
+static inline midi_smf_status_t read_vlq(const uint8_t *data,
+                                         const size_t length,
+                                         size_t *offset,
+                                         uint32_t *value);
+
+static inline midi_smf_status_t read_span(const uint8_t *data,
+                                          const size_t length,
+                                          size_t *offset,
+                                          midi_smf_event_t *event);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Open a Standard MIDI File image
+ * @param [out] smf Pointer to a midi_smf_t struct to initialize
+ * @param [in] image Pointer to the file image
+ * @param [in] length The number of bytes in the image
+ * @param [out] tracks Pointer to an array that receives the track index
+ * @param [in] capacity The number of entries in the tracks array
+ * @return MIDI_SMF_OK, MIDI_SMF_ERROR_ARGUMENT, MIDI_SMF_ERROR_HEADER or
+ *      MIDI_SMF_ERROR_CAPACITY
+ */
+midi_smf_status_t midi_smf_open(midi_smf_t *smf,
+                                const uint8_t *image,
+                                size_t length,
+                                midi_smf_track_t *tracks,
+                                size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (smf == NULL || image == NULL || (tracks == NULL && capacity > 0)) {
+        return MIDI_SMF_ERROR_ARGUMENT;
+    }
+
+    smf->format = 0;
+    smf->division = 0;
+    smf->track_count = 0;
+    smf->tracks = tracks;
+
+    /* The file starts with the MThd chunk */
+    if (length < SMF_CHUNK_HEADER_SIZE + SMF_HEADER_LENGTH
+        || memcmp(image, "MThd", 4) != 0) {
+        return MIDI_SMF_ERROR_HEADER;
+    }
+
+    const uint32_t header_length = read_be32(&image[4]);
+    if (header_length < SMF_HEADER_LENGTH
+        || header_length > length - SMF_CHUNK_HEADER_SIZE) {
+        return MIDI_SMF_ERROR_HEADER;
+    }
+
+    smf->format = read_be16(&image[8]);
+    smf->division = read_be16(&image[12]);
+
+    /* Index the track chunks, skipping unknown chunk types */
+    size_t offset = SMF_CHUNK_HEADER_SIZE + header_length;
+    while (length - offset >= SMF_CHUNK_HEADER_SIZE) {
+        const uint8_t *chunk = &image[offset];
+        size_t chunk_length = read_be32(&chunk[4]);
+
+        offset += SMF_CHUNK_HEADER_SIZE;
+        if (chunk_length > length - offset) { chunk_length = length - offset; }
+
+        if (memcmp(chunk, "MTrk", 4) == 0) {
+            /* The tracks that fit stay indexed */
+            if (smf->track_count == capacity) {
+                return MIDI_SMF_ERROR_CAPACITY;
+            }
+            tracks[smf->track_count].data = &image[offset];
+            tracks[smf->track_count].length = chunk_length;
+            smf->track_count++;
+        }
+        offset += chunk_length;
+    }
+
+    return MIDI_SMF_OK;
+}
+
+/**
+ * @brief Start iterating over the events of a track
+ * @param [in] smf Pointer to an opened midi_smf_t struct
+ * @param [in] track The index of the track
+ * @param [out] iterator Pointer to a midi_smf_iterator_t struct
+ * @return MIDI_SMF_OK or MIDI_SMF_ERROR_ARGUMENT
+ */
+midi_smf_status_t midi_smf_track_begin(const midi_smf_t *smf,
+                                       size_t track,
+                                       midi_smf_iterator_t *iterator)
+{
+    /* Check for NULL pointers */
+    if (smf == NULL || iterator == NULL || track >= smf->track_count) {
+        return MIDI_SMF_ERROR_ARGUMENT;
+    }
+
+    iterator->data = smf->tracks[track].data;
+    iterator->length = smf->tracks[track].length;
+    iterator->offset = 0;
+    iterator->tick = 0;
+    iterator->running_status = 0;
+    iterator->ended = 0;
+
+    return MIDI_SMF_OK;
+}
+
+/**
+ * @brief Read the next event of a track
+ * @param [in,out] iterator Pointer to a midi_smf_iterator_t struct
+ * @param [out] event Pointer to a midi_smf_event_t struct that receives
+ *      the event
+ * @return MIDI_SMF_OK, MIDI_SMF_END_OF_TRACK or an error
+ */
+midi_smf_status_t midi_smf_next_event(midi_smf_iterator_t *iterator,
+                                      midi_smf_event_t *event)
+{
+    /* Check for NULL pointers */
+    if (iterator == NULL || event == NULL) { return MIDI_SMF_ERROR_ARGUMENT; }
+
+    const uint8_t *data = iterator->data;
+    const size_t length = iterator->length;
+    size_t offset = iterator->offset;
+    uint8_t running_status = iterator->running_status;
+    midi_smf_status_t status;
+
+    if (iterator->ended || offset >= length) {
+        iterator->ended = 1;
+        return MIDI_SMF_END_OF_TRACK;
+    }
+
+    status = read_vlq(data, length, &offset, &event->delta_time);
+    if (status != MIDI_SMF_OK) { return status; }
+    if (offset >= length) { return MIDI_SMF_ERROR_TRUNCATED; }
+
+    event->data = NULL;
+    event->length = 0;
+    event->meta_type = 0;
+
+    const uint8_t byte = data[offset];
+
+    if (byte == MIDI_MESSAGE_SYSTEM_EXCLUSIVE
+        || byte == MIDI_MESSAGE_END_OF_EXCLUSIVE) {
+        /* SysEx and escape events cancel running status */
+        offset++;
+        event->kind = (byte == MIDI_MESSAGE_SYSTEM_EXCLUSIVE)
+                          ? MIDI_SMF_EVENT_SYSEX
+                          : MIDI_SMF_EVENT_ESCAPE;
+        status = read_span(data, length, &offset, event);
+        running_status = 0;
+    } else if (byte == SMF_META_STATUS) {
+        /* Meta events cancel running status */
+        offset++;
+        if (offset >= length) { return MIDI_SMF_ERROR_TRUNCATED; }
+        event->kind = MIDI_SMF_EVENT_META;
+        event->meta_type = data[offset++];
+        status = read_span(data, length, &offset, event);
+        running_status = 0;
+    } else {
+        /* A data byte continues the running status */
+        if (byte >= MIDI_MESSAGE_NOTE_OFF) {
+            /* System messages other than SysEx are not allowed in files */
+            if (byte >= MIDI_MESSAGE_SYSTEM_EXCLUSIVE) {
+                return MIDI_SMF_ERROR_EVENT;
+            }
+            running_status = byte;
+            offset++;
+        } else if (running_status == 0) {
+            return MIDI_SMF_ERROR_EVENT;
+        }
+
+        const size_t data_length = midi_status_data_length(running_status);
+        if (data_length > length - offset) { return MIDI_SMF_ERROR_TRUNCATED; }
+
+        const uint8_t data1 = data[offset];
+        const uint8_t data2 = (data_length > 1) ? data[offset + 1] : 0;
+        if ((data1 | data2) > SMF_MAX_DATA_BYTE) {
+            return MIDI_SMF_ERROR_EVENT;
+        }
+        offset += data_length;
+
+        event->kind = MIDI_SMF_EVENT_MIDI;
+        midi_decode_message(running_status, data1, data2, &event->message);
+    }
+
+    if (status != MIDI_SMF_OK) { return status; }
+
+    if (event->kind == MIDI_SMF_EVENT_META
+        && event->meta_type == MIDI_SMF_META_END_OF_TRACK) {
+        iterator->ended = 1;
+    }
+
+    iterator->tick += event->delta_time;
+    iterator->offset = offset;
+    iterator->running_status = running_status;
+    event->tick = iterator->tick;
+
+    return MIDI_SMF_OK;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Read a big-endian 32-bit value
+ */
+static inline uint32_t read_be32(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16
+           | (uint32_t)bytes[2] << 8 | (uint32_t)bytes[3];
+}
+
+/**
+ * @brief Read a big-endian 16-bit value
+ */
+static inline uint16_t read_be16(const uint8_t *bytes)
+{
+    return (uint16_t)(bytes[0] << 8 | bytes[1]);
+}
+
+/**
+ * @brief Read a variable-length quantity
+ * @param [in] data Pointer to the track data
+ * @param [in] length The number of bytes in the track
+ * @param [in,out] offset The offset of the quantity, advanced past it
+ * @param [out] value Receives the value
+ * @return MIDI_SMF_OK, MIDI_SMF_ERROR_TRUNCATED or MIDI_SMF_ERROR_EVENT
+ */
+static inline midi_smf_status_t read_vlq(const uint8_t *data,
+                                         const size_t length,
+                                         size_t *offset,
+                                         uint32_t *value)
+{
+    uint32_t result = 0;
+
+    for (size_t i = 0; i < SMF_MAX_VLQ_SIZE; i++) {
+        if (*offset >= length) { return MIDI_SMF_ERROR_TRUNCATED; }
+
+        const uint8_t byte = data[(*offset)++];
+        result = result << 7 | (byte & SMF_VLQ_VALUE_MASK);
+        if (!(byte & SMF_VLQ_CONTINUE)) {
+            *value = result;
+            return MIDI_SMF_OK;
+        }
+    }
+    return MIDI_SMF_ERROR_EVENT;
+}
+
+/**
+ * @brief Read the length and contents of a meta or SysEx event
+ * @param [in] data Pointer to the track data
+ * @param [in] length The number of bytes in the track
+ * @param [in,out] offset The offset of the event length, advanced past
+ *      the contents
+ * @param [out] event Receives the span of the contents
+ * @return MIDI_SMF_OK, MIDI_SMF_ERROR_TRUNCATED or MIDI_SMF_ERROR_EVENT
+ */
+static inline midi_smf_status_t read_span(const uint8_t *data,
+                                          const size_t length,
+                                          size_t *offset,
+                                          midi_smf_event_t *event)
+{
+    uint32_t span_length;
+    const midi_smf_status_t status =
+        read_vlq(data, length, offset, &span_length);
+
+    if (status != MIDI_SMF_OK) { return status; }
+    if (span_length > length - *offset) { return MIDI_SMF_ERROR_TRUNCATED; }
+
+    event->data = &data[*offset];
+    event->length = span_length;
+    *offset += span_length;
+    return MIDI_SMF_OK;
+}
@@ -0,0 +1,303 @@
+/**********************************************************************
+ * @file midi_smf.h
+ * @brief Standard MIDI File module
+ *
+ * @details This module reads Standard MIDI Files (SMF) from a file
+ *          image in memory, such as a memory-mapped file. Opening a file
+ *          only indexes its chunks, and the events of each track are
+ *          decoded on demand by an iterator. Nothing is copied: meta and
+ *          SysEx events point into the file image, which must stay valid
+ *          for as long as the file is read.
+ *
+ * @see Standard MIDI Files 1.0
+ *      https://midi.org/standard-midi-files-specification
+ **********************************************************************/
+
+#ifndef MIDI_SMF_H
+#define MIDI_SMF_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Meta Event Types
+ * @details The type byte that follows 0xFF in a meta event
+ */
+#define MIDI_SMF_META_SEQUENCE_NUMBER (0x00)
+#define MIDI_SMF_META_TEXT (0x01)
+#define MIDI_SMF_META_COPYRIGHT (0x02)
+#define MIDI_SMF_META_TRACK_NAME (0x03)
+#define MIDI_SMF_META_INSTRUMENT_NAME (0x04)
+#define MIDI_SMF_META_LYRIC (0x05)
+#define MIDI_SMF_META_MARKER (0x06)
+#define MIDI_SMF_META_CUE_POINT (0x07)
+#define MIDI_SMF_META_CHANNEL_PREFIX (0x20)
+#define MIDI_SMF_META_END_OF_TRACK (0x2F)
+#define MIDI_SMF_META_SET_TEMPO (0x51)
+#define MIDI_SMF_META_SMPTE_OFFSET (0x54)
+#define MIDI_SMF_META_TIME_SIGNATURE (0x58)
+#define MIDI_SMF_META_KEY_SIGNATURE (0x59)
+#define MIDI_SMF_META_SEQUENCER_SPECIFIC (0x7F)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief SMF Status
+ * @details The result of opening a file or reading an event
+ */
+typedef enum midi_smf_status_t {
+    /**
+     * @brief Success
+     */
+    MIDI_SMF_OK = 0,
+
+    /**
+     * @brief The end of the track was reached
+     */
+    MIDI_SMF_END_OF_TRACK,
+
+    /**
+     * @brief A pointer argument was NULL or an index was out of range
+     */
+    MIDI_SMF_ERROR_ARGUMENT,
+
+    /**
+     * @brief The file does not start with a valid MThd chunk
+     */
+    MIDI_SMF_ERROR_HEADER,
+
+    /**
+     * @brief An event or variable-length quantity runs past the end
+     *        of its track
+     */
+    MIDI_SMF_ERROR_TRUNCATED,
+
+    /**
+     * @brief An event is malformed (a data byte without running status,
+     *        a status byte that is not allowed in a file, or a
+     *        variable-length quantity longer than four bytes)
+     */
+    MIDI_SMF_ERROR_EVENT,
+
+    /**
+     * @brief A caller-provided array is too small
+     */
+    MIDI_SMF_ERROR_CAPACITY,
+} midi_smf_status_t;
+
+/**
+ * @brief SMF Event Kind
+ */
+typedef enum midi_smf_event_kind_t {
+    /**
+     * @brief A MIDI channel message, decoded into the message field
+     */
+    MIDI_SMF_EVENT_MIDI,
+
+    /**
+     * @brief A SysEx event (0xF0). The data span holds the bytes after
+     *        the Start of Exclusive byte, usually ending with 0xF7.
+     */
+    MIDI_SMF_EVENT_SYSEX,
+
+    /**
+     * @brief An escape or SysEx continuation event (0xF7). The data span
+     *        holds bytes to be sent as they are.
+     */
+    MIDI_SMF_EVENT_ESCAPE,
+
+    /**
+     * @brief A meta event (0xFF). The meta_type field holds its type and
+     *        the data span its contents.
+     */
+    MIDI_SMF_EVENT_META,
+} midi_smf_event_kind_t;
+
+/**
+ * @brief SMF Track
+ * @details The contents of an MTrk chunk, pointing into the file image
+ */
+typedef struct midi_smf_track_t {
+    /**
+     * @brief Pointer to the first byte after the chunk header
+     */
+    const uint8_t *data;
+
+    /**
+     * @brief The number of bytes in the chunk
+     */
+    size_t length;
+} midi_smf_track_t;
+
+/**
+ * @brief Standard MIDI File
+ */
+typedef struct midi_smf_t {
+    /**
+     * @brief File format (0, 1 or 2)
+     */
+    uint16_t format;
+
+    /**
+     * @brief Time division from the header
+     * @details Ticks per quarter note when bit 15 is clear, otherwise
+     *          the negative SMPTE format in the upper byte and ticks per
+     *          frame in the lower byte
+     */
+    uint16_t division;
+
+    /**
+     * @brief The number of tracks indexed
+     */
+    size_t track_count;
+
+    /**
+     * @brief Pointer to the caller-provided track index
+     */
+    midi_smf_track_t *tracks;
+} midi_smf_t;
+
+/**
+ * @brief SMF Track Iterator
+ * @details Decodes the events of one track on demand
+ */
+typedef struct midi_smf_iterator_t {
+    /**
+     * @brief Pointer to the track data
+     */
+    const uint8_t *data;
+
+    /**
+     * @brief The number of bytes in the track
+     */
+    size_t length;
+
+    /**
+     * @brief Offset of the next event in the track
+     */
+    size_t offset;
+
+    /**
+     * @brief Absolute time of the last event, in ticks
+     */
+    uint32_t tick;
+
+    /**
+     * @brief Running status, or 0 if there is none
+     */
+    uint8_t running_status;
+
+    /**
+     * @brief Non-zero once the End of Track meta event has been read
+     */
+    uint8_t ended;
+} midi_smf_iterator_t;
+
+/**
+ * @brief SMF Event
+ */
+typedef struct midi_smf_event_t {
+    /**
+     * @brief Ticks since the previous event of the track
+     */
+    uint32_t delta_time;
+
+    /**
+     * @brief Ticks since the start of the track
+     */
+    uint32_t tick;
+
+    /**
+     * @brief The kind of event
+     */
+    midi_smf_event_kind_t kind;
+
+    /**
+     * @brief Meta event type (MIDI_SMF_META_*), for meta events
+     */
+    uint8_t meta_type;
+
+    /**
+     * @brief Decoded message, for MIDI events
+     */
+    midi_message_t message;
+
+    /**
+     * @brief Pointer to the contents of a meta or SysEx event, in the
+     *        file image. NULL for MIDI events.
+     */
+    const uint8_t *data;
+
+    /**
+     * @brief The number of bytes in the contents
+     */
+    uint32_t length;
+} midi_smf_event_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Open a Standard MIDI File image
+ * @details Reads the header and indexes the MTrk chunks, skipping
+ *          unknown chunks. Runs in time proportional to the number of
+ *          chunks, and does not read the track contents. The last
+ *          chunk is cut short to the end of the image if its length
+ *          runs past it, as written by some broken sequencers.
+ * @param [out] smf Pointer to a midi_smf_t struct to initialize
+ * @param [in] image Pointer to the file image. Must stay valid for as
+ *      long as the file is read.
+ * @param [in] length The number of bytes in the image
+ * @param [out] tracks Pointer to an array that receives the track index
+ * @param [in] capacity The number of entries in the tracks array
+ * @return MIDI_SMF_OK, MIDI_SMF_ERROR_ARGUMENT, MIDI_SMF_ERROR_HEADER, or
+ *      MIDI_SMF_ERROR_CAPACITY if the file has more tracks than fit. The
+ *      first capacity tracks are then indexed, and can still be read.
+ */
+midi_smf_status_t midi_smf_open(midi_smf_t *smf,
+                                const uint8_t *image,
+                                size_t length,
+                                midi_smf_track_t *tracks,
+                                size_t capacity);
+
+/**
+ * @brief Start iterating over the events of a track
+ * @param [in] smf Pointer to an opened midi_smf_t struct
+ * @param [in] track The index of the track
+ * @param [out] iterator Pointer to a midi_smf_iterator_t struct
+ * @return MIDI_SMF_OK, or MIDI_SMF_ERROR_ARGUMENT if the track index is
+ *      out of range
+ */
+midi_smf_status_t midi_smf_track_begin(const midi_smf_t *smf,
+                                       size_t track,
+                                       midi_smf_iterator_t *iterator);
+
+/**
+ * @brief Read the next event of a track
+ * @details Decodes the delta-time and the event. MIDI channel events are
+ *          decoded into a midi_message_t with running status, and meta
+ *          and SysEx events are returned as spans into the file image.
+ *          Meta and SysEx events cancel running status.
+ * @param [in,out] iterator Pointer to a midi_smf_iterator_t struct
+ * @param [out] event Pointer to a midi_smf_event_t struct that receives
+ *      the event
+ * @return MIDI_SMF_OK if an event was read, MIDI_SMF_END_OF_TRACK after the
+ *      End of Track meta event or the end of the chunk, or an error. After
+ *      an error the iterator stays at the malformed event.
+ */
+midi_smf_status_t midi_smf_next_event(midi_smf_iterator_t *iterator,
+                                      midi_smf_event_t *event);
+
+#endif /* MIDI_SMF_H */
@@ -0,0 +1,493 @@
+/***********************************************************************
+ * @file midi_smf_merge.c
+ * @brief Standard MIDI File merge implementation
+ *
+ * @details Merges the tracks of a Standard MIDI File in tick order. The
+ *          heap holds one key per track with a pending event: the tick
+ *          in the upper 32 bits and the track index in the lower 32
+ *          bits, so a single integer comparison orders events by tick
+ *          and then by track.
+ *
+ * @see Standard MIDI Files 1.0
+ *      https://midi.org/standard-midi-files-specification
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_smf_merge.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi_smf.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Length of the contents of a Set Tempo meta event
+ */
+#define SMF_TEMPO_LENGTH (3)
+
+/**
+ * @brief SMPTE time division bits
+ * @details When the top bit is set, the upper byte holds the negative
+ *          frame rate and the lower byte the ticks per frame
+ */
+#define SMF_DIVISION_SMPTE (0x8000)
+#define SMF_DIVISION_TICKS_MASK (0xFF)
+
+/**
+ * @brief The SMPTE frame rate of 29.97 frames per second (drop frame)
+ */
+#define SMF_SMPTE_DROP_FRAME_RATE (29)
+
+/**
+ * @brief Heap key of a track's pending event
+ */
+#define SMF_HEAP_KEY(tick, track) ((uint64_t)(tick) << 32 | (uint32_t)(track))
+#define SMF_HEAP_TRACK(key) ((size_t)((key) & 0xFFFFFFFF))
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static inline uint64_t ticks_to_microseconds(uint32_t ticks,
+                                             uint32_t tempo,
+                                             uint16_t division);
+
+static inline size_t find_tempo(const midi_smf_tempo_map_t *map,
+                                uint32_t tick);
+
+static inline void heap_sift_down(midi_smf_cursor_t *cursors,
+                                  size_t size,
+                                  size_t index);
+
+static midi_smf_status_t load_track(midi_smf_merge_t *merge,
+                                    size_t track,
+                                    uint32_t tick);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Build the tempo map of a file
+ * @param [out] map Pointer to a midi_smf_tempo_map_t struct to initialize
+ * @param [in] smf Pointer to an opened midi_smf_t struct
+ * @param [out] entries Pointer to an array that receives the entries
+ * @param [in] capacity The number of entries in the array, at least 1
+ * @return MIDI_SMF_OK, MIDI_SMF_ERROR_CAPACITY or an error
+ */
+midi_smf_status_t midi_smf_tempo_map_build(midi_smf_tempo_map_t *map,
+                                           const midi_smf_t *smf,
+                                           midi_smf_tempo_t *entries,
+                                           size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (map == NULL || smf == NULL || entries == NULL || capacity == 0) {
+        return MIDI_SMF_ERROR_ARGUMENT;
+    }
+
+    map->division = smf->division;
+    map->entries = entries;
+    map->count = 1;
+    entries[0].tick = 0;
+    entries[0].tempo = MIDI_SMF_DEFAULT_TEMPO;
+    entries[0].microseconds = 0;
+
+    for (size_t track = 0; track < smf->track_count; track++) {
+        midi_smf_iterator_t iterator;
+        midi_smf_event_t event;
+        midi_smf_status_t status;
+
+        midi_smf_track_begin(smf, track, &iterator);
+        while ((status = midi_smf_next_event(&iterator, &event))
+               == MIDI_SMF_OK) {
+            if (event.kind != MIDI_SMF_EVENT_META
+                || event.meta_type != MIDI_SMF_META_SET_TEMPO
+                || event.length != SMF_TEMPO_LENGTH) {
+                continue;
+            }
+
+            const uint32_t tempo = (uint32_t)event.data[0] << 16
+                                   | (uint32_t)event.data[1] << 8
+                                   | (uint32_t)event.data[2];
+
+            /* Tempo tracks are usually in order, so search from the end.
+             * The first entry is at tick 0, so position never reaches 0. */
+            size_t position = map->count;
+            while (entries[position - 1].tick > event.tick) { position--; }
+
+            if (entries[position - 1].tick == event.tick) {
+                entries[position - 1].tempo = tempo;
+                continue;
+            }
+            if (map->count == capacity) { return MIDI_SMF_ERROR_CAPACITY; }
+
+            memmove(&entries[position + 1], &entries[position],
+                    (map->count - position) * sizeof(entries[0]));
+            entries[position].tick = event.tick;
+            entries[position].tempo = tempo;
+            map->count++;
+        }
+        if (status != MIDI_SMF_END_OF_TRACK) { return status; }
+    }
+
+    /* Accumulate the time of each tempo change */
+    for (size_t i = 1; i < map->count; i++) {
+        entries[i].microseconds =
+            entries[i - 1].microseconds
+            + ticks_to_microseconds(entries[i].tick - entries[i - 1].tick,
+                                    entries[i - 1].tempo, map->division);
+    }
+
+    return MIDI_SMF_OK;
+}
+
+/**
+ * @brief Convert a tick to microseconds
+ * @param [in] map Pointer to a midi_smf_tempo_map_t struct
+ * @param [in] tick The tick to convert
+ * @return The time of the tick in microseconds
+ */
+uint64_t midi_smf_tempo_map_microseconds(const midi_smf_tempo_map_t *map,
+                                         uint32_t tick)
+{
+    /* Check for NULL pointers */
+    if (map == NULL || map->entries == NULL || map->count == 0) { return 0; }
+
+    const midi_smf_tempo_t *entry = &map->entries[find_tempo(map, tick)];
+    return entry->microseconds
+           + ticks_to_microseconds(tick - entry->tick, entry->tempo,
+                                   map->division);
+}
+
+/**
+ * @brief Initialize a merge iterator
+ * @param [out] merge Pointer to a midi_smf_merge_t struct to initialize
+ * @param [in] smf Pointer to an opened midi_smf_t struct
+ * @param [in] tempo_map Optional pointer to the tempo map of the file
+ * @param [out] cursors Pointer to an array of cursors
+ * @param [in] capacity The number of cursors in the array
+ * @return MIDI_SMF_OK or an error
+ */
+midi_smf_status_t midi_smf_merge_init(midi_smf_merge_t *merge,
+                                      const midi_smf_t *smf,
+                                      const midi_smf_tempo_map_t *tempo_map,
+                                      midi_smf_cursor_t *cursors,
+                                      size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (merge == NULL || smf == NULL || (cursors == NULL && capacity > 0)) {
+        return MIDI_SMF_ERROR_ARGUMENT;
+    }
+    if (smf->track_count > capacity) { return MIDI_SMF_ERROR_CAPACITY; }
+
+    merge->smf = smf;
+    merge->tempo_map = tempo_map;
+    merge->cursors = cursors;
+
+    for (size_t track = 0; track < smf->track_count; track++) {
+        cursors[track].checkpoints = NULL;
+        cursors[track].checkpoint_count = 0;
+    }
+
+    return midi_smf_merge_seek(merge, 0);
+}
+
+/**
+ * @brief Build the seek checkpoints of every track
+ * @param [in,out] merge Pointer to an initialized midi_smf_merge_t struct
+ * @param [out] checkpoints Pointer to an array that receives the
+ *      checkpoints
+ * @param [in] capacity The number of checkpoints in the array
+ * @param [in] interval The number of events between checkpoints
+ * @return MIDI_SMF_OK or an error
+ */
+midi_smf_status_t midi_smf_merge_index(midi_smf_merge_t *merge,
+                                       midi_smf_checkpoint_t *checkpoints,
+                                       size_t capacity,
+                                       size_t interval)
+{
+    /* Check for NULL pointers */
+    if (merge == NULL || (checkpoints == NULL && capacity > 0)
+        || interval == 0) {
+        return MIDI_SMF_ERROR_ARGUMENT;
+    }
+
+    midi_smf_status_t result = MIDI_SMF_OK;
+    size_t used = 0;
+
+    for (size_t track = 0; track < merge->smf->track_count; track++) {
+        midi_smf_cursor_t *cursor = &merge->cursors[track];
+        midi_smf_iterator_t *iterator = &cursor->iterator;
+        midi_smf_status_t status;
+        size_t events = 0;
+
+        cursor->checkpoints = &checkpoints[used];
+        cursor->checkpoint_count = 0;
+
+        midi_smf_track_begin(merge->smf, track, iterator);
+        while ((status = midi_smf_next_event(iterator, &cursor->event))
+               == MIDI_SMF_OK) {
+            events++;
+            if (iterator->ended || events % interval != 0
+                || used == capacity) {
+                continue;
+            }
+            checkpoints[used].offset = iterator->offset;
+            checkpoints[used].tick = iterator->tick;
+            checkpoints[used].running_status = iterator->running_status;
+            cursor->checkpoint_count++;
+            used++;
+        }
+        if (status != MIDI_SMF_END_OF_TRACK && result == MIDI_SMF_OK) {
+            result = status;
+        }
+        if (cursor->checkpoint_count == 0) { cursor->checkpoints = NULL; }
+    }
+
+    const midi_smf_status_t status = midi_smf_merge_seek(merge, 0);
+    return (result != MIDI_SMF_OK) ? result : status;
+}
+
+/**
+ * @brief Seek to a tick
+ * @param [in,out] merge Pointer to an initialized midi_smf_merge_t struct
+ * @param [in] tick The tick to seek to
+ * @return MIDI_SMF_OK or an error
+ */
+midi_smf_status_t midi_smf_merge_seek(midi_smf_merge_t *merge, uint32_t tick)
+{
+    /* Check for NULL pointers */
+    if (merge == NULL) { return MIDI_SMF_ERROR_ARGUMENT; }
+
+    midi_smf_status_t result = MIDI_SMF_OK;
+
+    merge->heap_size = 0;
+    merge->error = MIDI_SMF_OK;
+    merge->error_track = 0;
+
+    for (size_t track = 0; track < merge->smf->track_count; track++) {
+        const midi_smf_status_t status = load_track(merge, track, tick);
+        if (status != MIDI_SMF_OK && result == MIDI_SMF_OK) {
+            result = status;
+            merge->error_track = track;
+        }
+    }
+
+    /* Heapify the pending events */
+    for (size_t i = merge->heap_size / 2; i > 0; i--) {
+        heap_sift_down(merge->cursors, merge->heap_size, i - 1);
+    }
+
+    merge->tempo_index =
+        (merge->tempo_map != NULL && merge->tempo_map->count > 0)
+            ? find_tempo(merge->tempo_map, tick)
+            : 0;
+
+    return result;
+}
+
+/**
+ * @brief Read the next event of the merged stream
+ * @param [in,out] merge Pointer to an initialized midi_smf_merge_t struct
+ * @param [out] event Pointer to a midi_smf_merge_event_t struct that
+ *      receives the event
+ * @return MIDI_SMF_OK, MIDI_SMF_END_OF_TRACK or an error
+ */
+midi_smf_status_t midi_smf_merge_next(midi_smf_merge_t *merge,
+                                      midi_smf_merge_event_t *event)
+{
+    /* Check for NULL pointers */
+    if (merge == NULL || event == NULL) { return MIDI_SMF_ERROR_ARGUMENT; }
+
+    /* Report a track that failed while loading its next event */
+    if (merge->error != MIDI_SMF_OK) {
+        const midi_smf_status_t error = merge->error;
+        merge->error = MIDI_SMF_OK;
+        event->track = merge->error_track;
+        return error;
+    }
+
+    if (merge->heap_size == 0) { return MIDI_SMF_END_OF_TRACK; }
+
+    midi_smf_cursor_t *cursors = merge->cursors;
+    const size_t track = SMF_HEAP_TRACK(cursors[0].heap);
+    midi_smf_cursor_t *cursor = &cursors[track];
+
+    event->event = cursor->event;
+    event->track = track;
+    event->microseconds = 0;
+
+    /* Tempo changes are passed in order, so the entry only moves on */
+    const midi_smf_tempo_map_t *map = merge->tempo_map;
+    if (map != NULL && map->count > 0) {
+        const uint32_t tick = event->event.tick;
+        size_t index = merge->tempo_index;
+        while (index + 1 < map->count && map->entries[index + 1].tick <= tick) {
+            index++;
+        }
+        merge->tempo_index = index;
+
+        const midi_smf_tempo_t *entry = &map->entries[index];
+        event->microseconds =
+            entry->microseconds
+            + ticks_to_microseconds(tick - entry->tick, entry->tempo,
+                                    map->division);
+    }
+
+    /* Replace the track's key with its next event, or remove it */
+    const midi_smf_status_t status =
+        midi_smf_next_event(&cursor->iterator, &cursor->event);
+    if (status == MIDI_SMF_OK) {
+        cursors[0].heap = SMF_HEAP_KEY(cursor->event.tick, track);
+    } else {
+        cursors[0].heap = cursors[--merge->heap_size].heap;
+        if (status != MIDI_SMF_END_OF_TRACK) {
+            merge->error = status;
+            merge->error_track = track;
+        }
+    }
+    heap_sift_down(cursors, merge->heap_size, 0);
+
+    return MIDI_SMF_OK;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Convert a number of ticks at a tempo to microseconds
+ * @param [in] ticks The number of ticks
+ * @param [in] tempo Microseconds per quarter note
+ * @param [in] division Time division from the file header
+ * @return The length of the ticks in microseconds, or 0 if the division
+ *      is invalid
+ */
+static inline uint64_t ticks_to_microseconds(uint32_t ticks,
+                                             uint32_t tempo,
+                                             uint16_t division)
+{
+    if (!(division & SMF_DIVISION_SMPTE)) {
+        return (division == 0) ? 0 : (uint64_t)ticks * tempo / division;
+    }
+
+    /* SMPTE: frames per second times ticks per frame, in hundredths */
+    const int8_t frame_rate = (int8_t)(division >> 8);
+    const uint64_t ticks_per_frame = division & SMF_DIVISION_TICKS_MASK;
+    const uint64_t frames_per_100s = (frame_rate == -SMF_SMPTE_DROP_FRAME_RATE)
+                                         ? 2997
+                                         : (uint64_t)-frame_rate * 100;
+    const uint64_t ticks_per_100s = frames_per_100s * ticks_per_frame;
+
+    return (ticks_per_100s == 0) ? 0
+                                 : (uint64_t)ticks * 100000000 / ticks_per_100s;
+}
+
+/**
+ * @brief Find the tempo map entry in effect at a tick
+ * @return The index of the last entry at or before the tick
+ */
+static inline size_t find_tempo(const midi_smf_tempo_map_t *map,
+                                uint32_t tick)
+{
+    /* The first entry is at tick 0, so the answer is in [low, high) */
+    size_t low = 0;
+    size_t high = map->count;
+
+    while (high - low > 1) {
+        const size_t middle = low + (high - low) / 2;
+        if (map->entries[middle].tick <= tick) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Move a heap key down until both of its children are larger
+ * @param [in,out] cursors Pointer to the cursors holding the heap slots
+ * @param [in] size The number of keys in the heap
+ * @param [in] index The slot of the key to move
+ */
+static inline void heap_sift_down(midi_smf_cursor_t *cursors,
+                                  size_t size,
+                                  size_t index)
+{
+    const uint64_t key = cursors[index].heap;
+
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= size) { break; }
+        if (child + 1 < size && cursors[child + 1].heap < cursors[child].heap) {
+            child++;
+        }
+        if (cursors[child].heap >= key) { break; }
+        cursors[index].heap = cursors[child].heap;
+        index = child;
+    }
+    cursors[index].heap = key;
+}
+
+/**
+ * @brief Position a track at its first event at or after a tick
+ * @details Resumes from the last checkpoint before the tick, and appends
+ *          the track's key to the heap unless the track has ended
+ * @param [in,out] merge Pointer to a midi_smf_merge_t struct
+ * @param [in] track The index of the track
+ * @param [in] tick The tick to seek to
+ * @return MIDI_SMF_OK, or the error of a malformed track
+ */
+static midi_smf_status_t load_track(midi_smf_merge_t *merge,
+                                    size_t track,
+                                    uint32_t tick)
+{
+    midi_smf_cursor_t *cursor = &merge->cursors[track];
+    midi_smf_iterator_t *iterator = &cursor->iterator;
+    midi_smf_status_t status;
+
+    midi_smf_track_begin(merge->smf, track, iterator);
+
+    /* Find the last checkpoint strictly before the tick. A checkpoint at
+     * the tick may follow an event at the tick, which must be returned. */
+    size_t low = 0;
+    size_t high = cursor->checkpoint_count;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (cursor->checkpoints[middle].tick < tick) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low > 0) {
+        const midi_smf_checkpoint_t *checkpoint = &cursor->checkpoints[low - 1];
+        iterator->offset = checkpoint->offset;
+        iterator->tick = checkpoint->tick;
+        iterator->running_status = checkpoint->running_status;
+    }
+
+    while ((status = midi_smf_next_event(iterator, &cursor->event))
+           == MIDI_SMF_OK) {
+        if (cursor->event.tick >= tick) {
+            merge->cursors[merge->heap_size++].heap =
+                SMF_HEAP_KEY(cursor->event.tick, track);
+            return MIDI_SMF_OK;
+        }
+    }
+
+    return (status == MIDI_SMF_END_OF_TRACK) ? MIDI_SMF_OK : status;
+}
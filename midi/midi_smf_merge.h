@@ -0,0 +1,313 @@
+/**********************************************************************
+ * @file midi_smf_merge.h
+ * @brief Standard MIDI File merge module
+ *
+ * @details This module merges the tracks of a Standard MIDI File into a
+ *          single time-ordered stream of events, for playback or
+ *          rendering. The next event of each track is kept in a binary
+ *          min-heap keyed on its absolute tick, so each event costs
+ *          O(log tracks) rather than a scan over every track.
+ *
+ *          A tempo map converts ticks to microseconds, and optional
+ *          per-track checkpoints let the merge seek to any tick without
+ *          decoding the tracks from their start. All storage is provided
+ *          by the caller.
+ *
+ * @see Standard MIDI Files 1.0
+ *      https://midi.org/standard-midi-files-specification
+ **********************************************************************/
+
+#ifndef MIDI_SMF_MERGE_H
+#define MIDI_SMF_MERGE_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi_smf.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Default Tempo
+ * @details The tempo in microseconds per quarter note (120 BPM) until
+ *          the first Set Tempo meta event
+ */
+#define MIDI_SMF_DEFAULT_TEMPO (500000)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Tempo Map Entry
+ * @details A tempo that applies from a tick until the next entry
+ */
+typedef struct midi_smf_tempo_t {
+    /**
+     * @brief The tick of the tempo change
+     */
+    uint32_t tick;
+
+    /**
+     * @brief Microseconds per quarter note
+     */
+    uint32_t tempo;
+
+    /**
+     * @brief Time of the tempo change, in microseconds
+     */
+    uint64_t microseconds;
+} midi_smf_tempo_t;
+
+/**
+ * @brief Tempo Map
+ * @details The tempo changes of a file in tick order, for converting
+ *          ticks to microseconds. The first entry is always at tick 0.
+ */
+typedef struct midi_smf_tempo_map_t {
+    /**
+     * @brief Time division from the file header
+     */
+    uint16_t division;
+
+    /**
+     * @brief Pointer to the caller-provided entries
+     */
+    midi_smf_tempo_t *entries;
+
+    /**
+     * @brief The number of entries in use
+     */
+    size_t count;
+} midi_smf_tempo_map_t;
+
+/**
+ * @brief Track Checkpoint
+ * @details A snapshot of a track iterator between two events, from
+ *          which decoding can resume exactly
+ */
+typedef struct midi_smf_checkpoint_t {
+    /**
+     * @brief Offset of the next event in the track
+     */
+    size_t offset;
+
+    /**
+     * @brief Absolute time of the event before the checkpoint, in ticks
+     */
+    uint32_t tick;
+
+    /**
+     * @brief Running status at the checkpoint
+     */
+    uint8_t running_status;
+} midi_smf_checkpoint_t;
+
+/**
+ * @brief Merge Cursor
+ * @details The merge state of one track. The caller provides one cursor
+ *          per track, and should not change them while merging.
+ */
+typedef struct midi_smf_cursor_t {
+    /**
+     * @brief Iterator over the track
+     */
+    midi_smf_iterator_t iterator;
+
+    /**
+     * @brief The next event of the track, waiting in the heap
+     */
+    midi_smf_event_t event;
+
+    /**
+     * @brief Pointer to the checkpoints of the track, or NULL
+     */
+    const midi_smf_checkpoint_t *checkpoints;
+
+    /**
+     * @brief The number of checkpoints of the track
+     */
+    size_t checkpoint_count;
+
+    /**
+     * @brief A slot of the merge heap
+     * @details Private to the merge. The slot of the cursor at index i
+     *          holds the i-th heap entry, which may belong to another
+     *          track.
+     */
+    uint64_t heap;
+} midi_smf_cursor_t;
+
+/**
+ * @brief Merge Iterator
+ */
+typedef struct midi_smf_merge_t {
+    /**
+     * @brief Pointer to the file being merged
+     */
+    const midi_smf_t *smf;
+
+    /**
+     * @brief Pointer to the tempo map, or NULL
+     */
+    const midi_smf_tempo_map_t *tempo_map;
+
+    /**
+     * @brief Pointer to the caller-provided cursors, one per track
+     */
+    midi_smf_cursor_t *cursors;
+
+    /**
+     * @brief The number of tracks waiting in the heap
+     */
+    size_t heap_size;
+
+    /**
+     * @brief The tempo map entry in effect at the last event
+     */
+    size_t tempo_index;
+
+    /**
+     * @brief Error of a track that was left out of the heap, reported
+     *        by the next call to midi_smf_merge_next
+     */
+    midi_smf_status_t error;
+
+    /**
+     * @brief The index of the track that caused the error
+     */
+    size_t error_track;
+} midi_smf_merge_t;
+
+/**
+ * @brief Merged Event
+ */
+typedef struct midi_smf_merge_event_t {
+    /**
+     * @brief The event
+     */
+    midi_smf_event_t event;
+
+    /**
+     * @brief The index of the track the event belongs to
+     */
+    size_t track;
+
+    /**
+     * @brief Time of the event in microseconds, or 0 without a tempo map
+     */
+    uint64_t microseconds;
+} midi_smf_merge_event_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Build the tempo map of a file
+ * @details Collects the Set Tempo meta events of every track in tick
+ *          order. Before the first one the tempo is
+ *          MIDI_SMF_DEFAULT_TEMPO. When several tempo changes share a
+ *          tick, the one in the last track wins.
+ * @param [out] map Pointer to a midi_smf_tempo_map_t struct to initialize
+ * @param [in] smf Pointer to an opened midi_smf_t struct
+ * @param [out] entries Pointer to an array that receives the entries
+ * @param [in] capacity The number of entries in the array, at least 1
+ * @return MIDI_SMF_OK, MIDI_SMF_ERROR_CAPACITY if the file has more
+ *      tempo changes than fit, or the error of a malformed track
+ * @note Set Tempo events in a format 2 file apply to their own track
+ *       only, which a single tempo map cannot describe
+ */
+midi_smf_status_t midi_smf_tempo_map_build(midi_smf_tempo_map_t *map,
+                                           const midi_smf_t *smf,
+                                           midi_smf_tempo_t *entries,
+                                           size_t capacity);
+
+/**
+ * @brief Convert a tick to microseconds
+ * @details Binary-searches the tempo change before the tick. Files with
+ *          an SMPTE time division have a fixed tick length and ignore
+ *          the tempo.
+ * @param [in] map Pointer to a midi_smf_tempo_map_t struct
+ * @param [in] tick The tick to convert
+ * @return The time of the tick in microseconds, or 0 if map is NULL or
+ *      the division is invalid
+ */
+uint64_t midi_smf_tempo_map_microseconds(const midi_smf_tempo_map_t *map,
+                                         uint32_t tick);
+
+/**
+ * @brief Initialize a merge iterator
+ * @details Starts every track at tick 0
+ * @param [out] merge Pointer to a midi_smf_merge_t struct to initialize
+ * @param [in] smf Pointer to an opened midi_smf_t struct
+ * @param [in] tempo_map Optional pointer to the tempo map of the file,
+ *      for the microseconds of each event. May be NULL.
+ * @param [out] cursors Pointer to an array of cursors
+ * @param [in] capacity The number of cursors in the array, at least the
+ *      number of tracks
+ * @return MIDI_SMF_OK, MIDI_SMF_ERROR_ARGUMENT,
+ *      MIDI_SMF_ERROR_CAPACITY, or the error of the first malformed
+ *      track, which is left out of the merge
+ */
+midi_smf_status_t midi_smf_merge_init(midi_smf_merge_t *merge,
+                                      const midi_smf_t *smf,
+                                      const midi_smf_tempo_map_t *tempo_map,
+                                      midi_smf_cursor_t *cursors,
+                                      size_t capacity);
+
+/**
+ * @brief Build the seek checkpoints of every track
+ * @details Decodes every track once and saves a checkpoint before every
+ *          interval-th event. The checkpoints of each track are stored
+ *          one after the other in the array. If the array fills up, the
+ *          remaining tracks get fewer checkpoints and seek more slowly.
+ *          The merge is rewound to tick 0 afterwards.
+ * @param [in,out] merge Pointer to an initialized midi_smf_merge_t struct
+ * @param [out] checkpoints Pointer to an array that receives the
+ *      checkpoints. Must stay valid for as long as the merge is used.
+ * @param [in] capacity The number of checkpoints in the array
+ * @param [in] interval The number of events between checkpoints
+ * @return MIDI_SMF_OK, MIDI_SMF_ERROR_ARGUMENT, or the error of the
+ *      first malformed track
+ */
+midi_smf_status_t midi_smf_merge_index(midi_smf_merge_t *merge,
+                                       midi_smf_checkpoint_t *checkpoints,
+                                       size_t capacity,
+                                       size_t interval);
+
+/**
+ * @brief Seek to a tick
+ * @details Positions every track at its first event at or after the
+ *          tick, starting from the last checkpoint before the tick. The
+ *          events before the tick are skipped, not returned, so the
+ *          caller is responsible for chasing controller state.
+ * @param [in,out] merge Pointer to an initialized midi_smf_merge_t struct
+ * @param [in] tick The tick to seek to
+ * @return MIDI_SMF_OK, MIDI_SMF_ERROR_ARGUMENT, or the error of the
+ *      first malformed track, which is left out of the merge
+ */
+midi_smf_status_t midi_smf_merge_seek(midi_smf_merge_t *merge, uint32_t tick);
+
+/**
+ * @brief Read the next event of the merged stream
+ * @details Events are returned in tick order. Events with the same tick
+ *          are returned in track order, and in file order within a
+ *          track.
+ * @param [in,out] merge Pointer to an initialized midi_smf_merge_t struct
+ * @param [out] event Pointer to a midi_smf_merge_event_t struct that
+ *      receives the event
+ * @return MIDI_SMF_OK if an event was read, MIDI_SMF_END_OF_TRACK once
+ *      every track has ended, or an error. After an error, the track
+ *      field holds the malformed track, which is left out of the merge,
+ *      and the next call continues with the other tracks.
+ */
+midi_smf_status_t midi_smf_merge_next(midi_smf_merge_t *merge,
+                                      midi_smf_merge_event_t *event);
+
+#endif /* MIDI_SMF_MERGE_H */
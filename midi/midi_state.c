@@ -0,0 +1,785 @@
+/***********************************************************************
+ * @file midi_state.c
+ * @brief MIDI channel state implementation
+ *
+ * @details Tracks the state of the 16 channels of a MIDI stream in
+ *          structure-of-arrays tables. Notes and dirty controllers are
+ *          kept in 128-bit sets of two 64-bit words, which are iterated
+ *          by finding and clearing the lowest set bit.
+ *
+ * @see RP-015 Response to Reset All Controllers
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_state.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief First controller number of the Channel Mode messages
+ */
+#define STATE_FIRST_MODE_CONTROLLER (120)
+
+/**
+ * @brief Controller values from which a switch controller is on
+ */
+#define STATE_SWITCH_ON (64)
+
+/**
+ * @brief Value of the RPN and NRPN controllers that selects no parameter
+ */
+#define STATE_NULL_PARAMETER (127)
+
+/**
+ * @brief Mask of the 7-bit data values
+ */
+#define STATE_DATA_MASK (0x7F)
+
+/**
+ * @brief Mask of the 14-bit pitch bend value
+ */
+#define STATE_PITCH_BEND_MASK (0x3FFF)
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static inline uint32_t count_bits(uint64_t bits);
+
+static inline uint32_t first_set_bit(uint64_t bits);
+
+static inline int is_sustain_down(const midi_state_t *state, size_t channel);
+
+static inline void update_activity(midi_state_t *state, size_t channel);
+
+static inline uint8_t default_controller(size_t controller);
+
+static void set_controller(midi_state_t *state,
+                           size_t channel,
+                           size_t controller,
+                           uint8_t value);
+
+static inline void set_pitch_bend(midi_state_t *state,
+                                  size_t channel,
+                                  uint16_t value);
+
+static inline void set_channel_pressure(midi_state_t *state,
+                                        size_t channel,
+                                        uint8_t value);
+
+static inline void release_notes(midi_state_t *state, size_t channel);
+
+static inline void silence_notes(midi_state_t *state, size_t channel);
+
+static void reset_controllers(midi_state_t *state, size_t channel);
+
+static void reset_channel(midi_state_t *state, size_t channel);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a MIDI channel state
+ * @param [out] state Pointer to a midi_state_t struct to initialize
+ */
+void midi_state_init(midi_state_t *state)
+{
+    /* Check for NULL pointers */
+    if (state == NULL) { return; }
+
+    memset(state, 0, sizeof(*state));
+    for (size_t channel = 0; channel < MIDI_STATE_CHANNELS; channel++) {
+        reset_channel(state, channel);
+    }
+    midi_state_snapshot(state);
+}
+
+/**
+ * @brief Update the state with a message
+ * @param [in,out] state Pointer to a midi_state_t struct
+ * @param [in] message Pointer to the message
+ */
+void midi_state_update(midi_state_t *state, const midi_message_t *message)
+{
+    /* Check for NULL pointers */
+    if (state == NULL || message == NULL) { return; }
+
+    if (message->message_type == MIDI_MESSAGE_SYSTEM_RESET) {
+        for (size_t channel = 0; channel < MIDI_STATE_CHANNELS; channel++) {
+            reset_channel(state, channel);
+        }
+        return;
+    }
+
+    /* Everything else is a channel message */
+    const size_t channel = (size_t)message->channel;
+    if (channel >= MIDI_STATE_CHANNELS) { return; }
+
+    const uint16_t channel_bit = (uint16_t)(1u << channel);
+
+    switch (message->message_type) {
+    case MIDI_MESSAGE_NOTE_ON: {
+        const uint8_t note = message->note & STATE_DATA_MASK;
+        const uint64_t bit = (uint64_t)1 << (note & 63);
+
+        if (message->velocity == 0) {
+            /* Note On with a velocity of 0 from a non-parser source */
+            midi_message_t note_off = *message;
+            note_off.message_type = MIDI_MESSAGE_NOTE_OFF;
+            midi_state_update(state, &note_off);
+            break;
+        }
+        state->held[channel][note >> 6] |= bit;
+        state->sustained[channel][note >> 6] &= ~bit;
+        state->velocities[channel][note] = message->velocity & STATE_DATA_MASK;
+        state->active_channels |= channel_bit;
+        break;
+    }
+    case MIDI_MESSAGE_NOTE_OFF: {
+        const uint8_t note = message->note & STATE_DATA_MASK;
+        const uint64_t bit = (uint64_t)1 << (note & 63);
+
+        if (!(state->held[channel][note >> 6] & bit)) { break; }
+        state->held[channel][note >> 6] &= ~bit;
+        if (is_sustain_down(state, channel)) {
+            state->sustained[channel][note >> 6] |= bit;
+        }
+        update_activity(state, channel);
+        break;
+    }
+    case MIDI_MESSAGE_KEY_PRESSURE:
+        state->key_pressure[channel][message->key & STATE_DATA_MASK] =
+            message->key_pressure & STATE_DATA_MASK;
+        break;
+    case MIDI_MESSAGE_CONTROL_CHANGE:
+        if ((size_t)message->controller < STATE_FIRST_MODE_CONTROLLER) {
+            set_controller(state, channel, (size_t)message->controller,
+                           message->control_value & STATE_DATA_MASK);
+        }
+        break;
+    case MIDI_MESSAGE_ALL_SOUND_OFF:
+        silence_notes(state, channel);
+        break;
+    case MIDI_MESSAGE_RESET_ALL_CONTROLLERS:
+        reset_controllers(state, channel);
+        break;
+    case MIDI_MESSAGE_LOCAL_CONTROL:
+        if (message->control_value >= STATE_SWITCH_ON) {
+            state->local_control |= channel_bit;
+        } else {
+            state->local_control &= (uint16_t)~channel_bit;
+        }
+        break;
+    case MIDI_MESSAGE_ALL_NOTES_OFF:
+        release_notes(state, channel);
+        break;
+    case MIDI_MESSAGE_OMNI_OFF:
+        state->omni &= (uint16_t)~channel_bit;
+        release_notes(state, channel);
+        break;
+    case MIDI_MESSAGE_OMNI_ON:
+        state->omni |= channel_bit;
+        release_notes(state, channel);
+        break;
+    case MIDI_MESSAGE_MONO_ON:
+        state->mono |= channel_bit;
+        release_notes(state, channel);
+        break;
+    case MIDI_MESSAGE_POLY_ON:
+        state->mono &= (uint16_t)~channel_bit;
+        release_notes(state, channel);
+        break;
+    case MIDI_MESSAGE_PROGRAM_CHANGE: {
+        const uint8_t program = message->program & STATE_DATA_MASK;
+        if (state->program[channel] != program) {
+            state->program[channel] = program;
+            state->dirty_program |= channel_bit;
+        }
+        break;
+    }
+    case MIDI_MESSAGE_CHANNEL_PRESSURE:
+        set_channel_pressure(
+            state, channel, message->channel_pressure & STATE_DATA_MASK);
+        break;
+    case MIDI_MESSAGE_PITCH_BEND:
+        set_pitch_bend(
+            state, channel, message->pitch_bend & STATE_PITCH_BEND_MASK);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Update the state with a packed message
+ * @param [in,out] state Pointer to a midi_state_t struct
+ * @param [in] packed The packed message
+ */
+void midi_state_update_packed(midi_state_t *state, midi_packed_t packed)
+{
+    midi_message_t message;
+
+    midi_message_unpack(packed, &message);
+    midi_state_update(state, &message);
+}
+
+/**
+ * @brief Check whether a note is sounding
+ * @param [in] state Pointer to a midi_state_t struct
+ * @param [in] channel The channel of the note
+ * @param [in] note The note number
+ * @return Non-zero if the note is held or sustained
+ */
+int midi_state_is_note_on(const midi_state_t *state,
+                          midi_channel_t channel,
+                          uint8_t note)
+{
+    /* Check for NULL pointers */
+    if (state == NULL || (size_t)channel >= MIDI_STATE_CHANNELS
+        || note >= MIDI_STATE_KEYS) {
+        return 0;
+    }
+
+    const uint64_t sounding =
+        state->held[channel][note >> 6] | state->sustained[channel][note >> 6];
+    return (sounding >> (note & 63)) & 1;
+}
+
+/**
+ * @brief Count the sounding notes of a channel
+ * @param [in] state Pointer to a midi_state_t struct
+ * @param [in] channel The channel
+ * @return The number of held or sustained notes
+ */
+size_t midi_state_count_notes(const midi_state_t *state,
+                              midi_channel_t channel)
+{
+    /* Check for NULL pointers */
+    if (state == NULL || (size_t)channel >= MIDI_STATE_CHANNELS) { return 0; }
+
+    size_t count = 0;
+    for (size_t word = 0; word < MIDI_STATE_SET_WORDS; word++) {
+        count += count_bits(state->held[channel][word]
+                            | state->sustained[channel][word]);
+    }
+    return count;
+}
+
+/**
+ * @brief List the sounding notes of a channel
+ * @param [in] state Pointer to a midi_state_t struct
+ * @param [in] channel The channel
+ * @param [out] notes Pointer to an array that receives the note numbers
+ * @param [in] capacity The number of entries in the notes array
+ * @return The number of notes written
+ */
+size_t midi_state_channel_notes(const midi_state_t *state,
+                                midi_channel_t channel,
+                                uint8_t *notes,
+                                size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (state == NULL || notes == NULL
+        || (size_t)channel >= MIDI_STATE_CHANNELS) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (size_t word = 0; word < MIDI_STATE_SET_WORDS; word++) {
+        uint64_t bits =
+            state->held[channel][word] | state->sustained[channel][word];
+        while (bits != 0 && count < capacity) {
+            notes[count++] = (uint8_t)(word * 64 + first_set_bit(bits));
+            bits &= bits - 1;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief List the sounding notes of every channel
+ * @param [in] state Pointer to a midi_state_t struct
+ * @param [out] notes Pointer to an array that receives the notes
+ * @param [in] capacity The number of entries in the notes array
+ * @return The number of notes written
+ */
+size_t midi_state_all_notes(const midi_state_t *state,
+                            midi_state_note_t *notes,
+                            size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (state == NULL || notes == NULL) { return 0; }
+
+    size_t count = 0;
+    uint64_t channels = state->active_channels;
+
+    while (channels != 0) {
+        const size_t channel = first_set_bit(channels);
+        channels &= channels - 1;
+
+        for (size_t word = 0; word < MIDI_STATE_SET_WORDS; word++) {
+            uint64_t bits =
+                state->held[channel][word] | state->sustained[channel][word];
+            while (bits != 0) {
+                if (count == capacity) { return count; }
+
+                const uint8_t note =
+                    (uint8_t)(word * 64 + first_set_bit(bits));
+                notes[count].channel = (midi_channel_t)channel;
+                notes[count].note = note;
+                notes[count].velocity = state->velocities[channel][note];
+                count++;
+                bits &= bits - 1;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Stop every sounding note with the fewest messages
+ * @param [in,out] state Pointer to a midi_state_t struct
+ * @param [out] messages Pointer to an array that receives the messages
+ * @param [in] capacity The number of entries in the messages array
+ * @return The number of messages written
+ */
+size_t midi_state_notes_off(midi_state_t *state,
+                            midi_message_t *messages,
+                            size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (state == NULL || messages == NULL) { return 0; }
+
+    size_t count = 0;
+
+    /* Each message is applied, so the loop ends when no note sounds */
+    while (state->active_channels != 0 && count < capacity) {
+        const size_t channel = first_set_bit(state->active_channels);
+        const uint64_t *held = state->held[channel];
+        midi_message_t message;
+
+        message.channel = (midi_channel_t)channel;
+        if (is_sustain_down(state, channel)) {
+            message.message_type = MIDI_MESSAGE_CONTROL_CHANGE;
+            message.controller = MIDI_CC_SUSTAIN_PEDAL;
+            message.control_value = 0;
+        } else if ((held[0] | held[1]) != 0) {
+            const size_t word = (held[0] != 0) ? 0 : 1;
+            message.message_type = MIDI_MESSAGE_NOTE_OFF;
+            message.note = (uint8_t)(word * 64 + first_set_bit(held[word]));
+            message.velocity = MIDI_STATE_RELEASE_VELOCITY;
+        } else {
+            /* Sustained notes without the pedal, which should not be */
+            message.message_type = MIDI_MESSAGE_ALL_SOUND_OFF;
+            message.controller = MIDI_CC_ALL_SOUND_OFF;
+            message.control_value = 0;
+        }
+
+        midi_state_update(state, &message);
+        messages[count++] = message;
+    }
+    return count;
+}
+
+/**
+ * @brief Read the changes since the last snapshot as messages
+ * @param [in,out] state Pointer to a midi_state_t struct
+ * @param [out] messages Pointer to an array that receives the messages
+ * @param [in] capacity The number of entries in the messages array
+ * @return The number of messages written
+ */
+size_t midi_state_changes(midi_state_t *state,
+                          midi_message_t *messages,
+                          size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (state == NULL || messages == NULL) { return 0; }
+
+    size_t count = 0;
+
+    for (size_t channel = 0; channel < MIDI_STATE_CHANNELS; channel++) {
+        const uint16_t channel_bit = (uint16_t)(1u << channel);
+        uint64_t *snapshot = state->snapshot_notes[channel];
+        uint64_t *dirty = state->dirty_controllers[channel];
+        midi_message_t message;
+
+        memset(&message, 0, sizeof(message));
+        message.channel = (midi_channel_t)channel;
+
+        if (state->dirty_sound_off & channel_bit) {
+            if (count == capacity) { return count; }
+            message.message_type = MIDI_MESSAGE_ALL_SOUND_OFF;
+            message.controller = MIDI_CC_ALL_SOUND_OFF;
+            message.control_value = 0;
+            messages[count++] = message;
+            state->dirty_sound_off &= (uint16_t)~channel_bit;
+            snapshot[0] = 0;
+            snapshot[1] = 0;
+        }
+
+        /*
+         * The receiver only holds notes, so a Note Off sent while its
+         * pedal is down would leave the note sustained. Lift the pedal
+         * first, which releases nothing, and press it again below.
+         */
+        uint64_t released = 0;
+        for (size_t word = 0; word < MIDI_STATE_SET_WORDS; word++) {
+            released |= snapshot[word]
+                        & ~(state->held[channel][word]
+                            | state->sustained[channel][word]);
+        }
+
+        const size_t pedal_word = MIDI_CC_SUSTAIN_PEDAL >> 6;
+        const uint64_t pedal_bit = (uint64_t)1 << (MIDI_CC_SUSTAIN_PEDAL & 63);
+
+        if (released != 0 && (state->snapshot_sustain & channel_bit)) {
+            if (count == capacity) { return count; }
+            message.message_type = MIDI_MESSAGE_CONTROL_CHANGE;
+            message.controller = MIDI_CC_SUSTAIN_PEDAL;
+            message.control_value = 0;
+            messages[count++] = message;
+            state->snapshot_sustain &= (uint16_t)~channel_bit;
+            if (is_sustain_down(state, channel)) {
+                dirty[pedal_word] |= pedal_bit;
+            }
+        }
+
+        /* Notes that stopped sounding */
+        message.message_type = MIDI_MESSAGE_NOTE_OFF;
+        message.velocity = MIDI_STATE_RELEASE_VELOCITY;
+        for (size_t word = 0; word < MIDI_STATE_SET_WORDS; word++) {
+            uint64_t bits = snapshot[word]
+                            & ~(state->held[channel][word]
+                                | state->sustained[channel][word]);
+            while (bits != 0) {
+                if (count == capacity) { return count; }
+                const uint32_t bit = first_set_bit(bits);
+                message.note = (uint8_t)(word * 64 + bit);
+                messages[count++] = message;
+                snapshot[word] &= ~((uint64_t)1 << bit);
+                bits &= bits - 1;
+            }
+        }
+
+        /* Controllers, with Bank Select before Program Change */
+        message.message_type = MIDI_MESSAGE_CONTROL_CHANGE;
+        for (size_t word = 0; word < MIDI_STATE_SET_WORDS; word++) {
+            while (dirty[word] != 0) {
+                if (count == capacity) { return count; }
+                const size_t controller =
+                    word * 64 + first_set_bit(dirty[word]);
+                message.controller = (midi_controller_t)controller;
+                message.control_value = state->controllers[channel][controller];
+                messages[count++] = message;
+                dirty[word] &= dirty[word] - 1;
+
+                if (controller == MIDI_CC_SUSTAIN_PEDAL) {
+                    if (message.control_value >= STATE_SWITCH_ON) {
+                        state->snapshot_sustain |= channel_bit;
+                    } else {
+                        state->snapshot_sustain &= (uint16_t)~channel_bit;
+                    }
+                }
+            }
+        }
+
+        if (state->dirty_program & channel_bit) {
+            if (count == capacity) { return count; }
+            message.message_type = MIDI_MESSAGE_PROGRAM_CHANGE;
+            message.program = state->program[channel];
+            messages[count++] = message;
+            state->dirty_program &= (uint16_t)~channel_bit;
+        }
+
+        if (state->dirty_pitch_bend & channel_bit) {
+            if (count == capacity) { return count; }
+            message.message_type = MIDI_MESSAGE_PITCH_BEND;
+            message.pitch_bend = state->pitch_bend[channel];
+            messages[count++] = message;
+            state->dirty_pitch_bend &= (uint16_t)~channel_bit;
+        }
+
+        if (state->dirty_channel_pressure & channel_bit) {
+            if (count == capacity) { return count; }
+            message.message_type = MIDI_MESSAGE_CHANNEL_PRESSURE;
+            message.channel_pressure = state->channel_pressure[channel];
+            messages[count++] = message;
+            state->dirty_channel_pressure &= (uint16_t)~channel_bit;
+        }
+
+        /* Notes that started sounding */
+        message.message_type = MIDI_MESSAGE_NOTE_ON;
+        for (size_t word = 0; word < MIDI_STATE_SET_WORDS; word++) {
+            uint64_t bits = (state->held[channel][word]
+                             | state->sustained[channel][word])
+                            & ~snapshot[word];
+            while (bits != 0) {
+                if (count == capacity) { return count; }
+                const uint32_t bit = first_set_bit(bits);
+                message.note = (uint8_t)(word * 64 + bit);
+                message.velocity = state->velocities[channel][message.note];
+                messages[count++] = message;
+                snapshot[word] |= (uint64_t)1 << bit;
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief Take a snapshot
+ * @param [in,out] state Pointer to a midi_state_t struct
+ */
+void midi_state_snapshot(midi_state_t *state)
+{
+    /* Check for NULL pointers */
+    if (state == NULL) { return; }
+
+    state->snapshot_sustain = 0;
+    for (size_t channel = 0; channel < MIDI_STATE_CHANNELS; channel++) {
+        for (size_t word = 0; word < MIDI_STATE_SET_WORDS; word++) {
+            state->dirty_controllers[channel][word] = 0;
+            state->snapshot_notes[channel][word] =
+                state->held[channel][word] | state->sustained[channel][word];
+        }
+        if (is_sustain_down(state, channel)) {
+            state->snapshot_sustain |= (uint16_t)(1u << channel);
+        }
+    }
+    state->dirty_program = 0;
+    state->dirty_pitch_bend = 0;
+    state->dirty_channel_pressure = 0;
+    state->dirty_sound_off = 0;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Count the set bits of a word
+ */
+static inline uint32_t count_bits(uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (uint32_t)__builtin_popcountll(bits);
+#else
+    uint32_t count = 0;
+    for (; bits != 0; bits &= bits - 1) { count++; }
+    return count;
+#endif
+}
+
+/**
+ * @brief Find the lowest set bit of a word
+ * @param [in] bits The word to search. Must not be zero
+ * @return The bit position of the lowest set bit
+ */
+static inline uint32_t first_set_bit(uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (uint32_t)__builtin_ctzll(bits);
+#else
+    uint32_t position = 0;
+    while (!(bits & ((uint64_t)1 << position))) { position++; }
+    return position;
+#endif
+}
+
+/**
+ * @brief Check whether the sustain pedal of a channel is down
+ */
+static inline int is_sustain_down(const midi_state_t *state, size_t channel)
+{
+    return state->controllers[channel][MIDI_CC_SUSTAIN_PEDAL]
+           >= STATE_SWITCH_ON;
+}
+
+/**
+ * @brief Update the active channel mask after notes of a channel changed
+ */
+static inline void update_activity(midi_state_t *state, size_t channel)
+{
+    const uint16_t channel_bit = (uint16_t)(1u << channel);
+
+    if ((state->held[channel][0] | state->held[channel][1]
+         | state->sustained[channel][0] | state->sustained[channel][1])
+        != 0) {
+        state->active_channels |= channel_bit;
+    } else {
+        state->active_channels &= (uint16_t)~channel_bit;
+    }
+}
+
+/**
+ * @brief Power-on value of a controller
+ */
+static inline uint8_t default_controller(size_t controller)
+{
+    switch (controller) {
+    case MIDI_CC_CHANNEL_VOLUME:
+        return MIDI_STATE_DEFAULT_VOLUME;
+    case MIDI_CC_PAN:
+        return MIDI_STATE_DEFAULT_PAN;
+    case MIDI_CC_EXPRESSION_CONTROLLER:
+        return MIDI_STATE_DEFAULT_EXPRESSION;
+    case MIDI_CC_NRPN_LSB:
+    case MIDI_CC_NRPN_MSB:
+    case MIDI_CC_RPN_LSB:
+    case MIDI_CC_RPN_MSB:
+        return STATE_NULL_PARAMETER;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Set a controller, marking it dirty if it changed
+ * @details Lifting the sustain pedal ends the sustained notes
+ */
+static void set_controller(midi_state_t *state,
+                           size_t channel,
+                           size_t controller,
+                           uint8_t value)
+{
+    const uint8_t previous = state->controllers[channel][controller];
+
+    if (previous == value) { return; }
+
+    state->controllers[channel][controller] = value;
+    state->dirty_controllers[channel][controller >> 6] |=
+        (uint64_t)1 << (controller & 63);
+
+    if (controller == MIDI_CC_SUSTAIN_PEDAL && value < STATE_SWITCH_ON) {
+        state->sustained[channel][0] = 0;
+        state->sustained[channel][1] = 0;
+        update_activity(state, channel);
+    }
+}
+
+/**
+ * @brief Set the pitch bend of a channel, marking it dirty if it changed
+ */
+static inline void set_pitch_bend(midi_state_t *state,
+                                  size_t channel,
+                                  uint16_t value)
+{
+    if (state->pitch_bend[channel] != value) {
+        state->pitch_bend[channel] = value;
+        state->dirty_pitch_bend |= (uint16_t)(1u << channel);
+    }
+}
+
+/**
+ * @brief Set the Channel Pressure of a channel, marking it dirty if it
+ *        changed
+ */
+static inline void set_channel_pressure(midi_state_t *state,
+                                        size_t channel,
+                                        uint8_t value)
+{
+    if (state->channel_pressure[channel] != value) {
+        state->channel_pressure[channel] = value;
+        state->dirty_channel_pressure |= (uint16_t)(1u << channel);
+    }
+}
+
+/**
+ * @brief Release every held note of a channel, as All Notes Off
+ * @details Released notes keep sounding while the sustain pedal is down
+ */
+static inline void release_notes(midi_state_t *state, size_t channel)
+{
+    for (size_t word = 0; word < MIDI_STATE_SET_WORDS; word++) {
+        if (is_sustain_down(state, channel)) {
+            state->sustained[channel][word] |= state->held[channel][word];
+        }
+        state->held[channel][word] = 0;
+    }
+    update_activity(state, channel);
+}
+
+/**
+ * @brief Silence every note of a channel, as All Sound Off
+ */
+static inline void silence_notes(midi_state_t *state, size_t channel)
+{
+    for (size_t word = 0; word < MIDI_STATE_SET_WORDS; word++) {
+        state->held[channel][word] = 0;
+        state->sustained[channel][word] = 0;
+    }
+    state->active_channels &= (uint16_t)~(1u << channel);
+    state->dirty_sound_off |= (uint16_t)(1u << channel);
+}
+
+/**
+ * @brief Apply Reset All Controllers to a channel, as listed by RP-015
+ * @details Volume, pan, bank select, the effect depths and the program
+ *          are kept
+ */
+static void reset_controllers(midi_state_t *state, size_t channel)
+{
+    static const uint8_t reset[] = {
+        MIDI_CC_MOD_WHEEL,
+        MIDI_CC_EXPRESSION_CONTROLLER,
+        MIDI_CC_SUSTAIN_PEDAL,
+        MIDI_CC_PORTAMENTO_ON_OFF,
+        MIDI_CC_SOSTENUTO,
+        MIDI_CC_SOFT_PEDAL,
+        MIDI_CC_NRPN_LSB,
+        MIDI_CC_NRPN_MSB,
+        MIDI_CC_RPN_LSB,
+        MIDI_CC_RPN_MSB,
+    };
+
+    for (size_t i = 0; i < sizeof(reset); i++) {
+        set_controller(state, channel, reset[i], default_controller(reset[i]));
+    }
+    set_pitch_bend(state, channel, MIDI_STATE_PITCH_BEND_CENTER);
+    set_channel_pressure(state, channel, 0);
+    memset(state->key_pressure[channel], 0, MIDI_STATE_KEYS);
+}
+
+/**
+ * @brief Return a channel to its power-on state, marking what changed
+ */
+static void reset_channel(midi_state_t *state, size_t channel)
+{
+    const uint16_t channel_bit = (uint16_t)(1u << channel);
+
+    silence_notes(state, channel);
+    for (size_t controller = 0; controller < STATE_FIRST_MODE_CONTROLLER;
+         controller++) {
+        set_controller(state, channel, controller,
+                       default_controller(controller));
+    }
+    if (state->program[channel] != 0) {
+        state->program[channel] = 0;
+        state->dirty_program |= channel_bit;
+    }
+    set_pitch_bend(state, channel, MIDI_STATE_PITCH_BEND_CENTER);
+    set_channel_pressure(state, channel, 0);
+    memset(state->key_pressure[channel], 0, MIDI_STATE_KEYS);
+
+    state->omni |= channel_bit;
+    state->mono &= (uint16_t)~channel_bit;
+    state->local_control |= channel_bit;
+}
@@ -0,0 +1,342 @@
+/**********************************************************************
+ * @file midi_state.h
+ * @brief MIDI channel state module
+ *
+ * @details This module tracks the current state of all 16 channels of
+ *          a MIDI stream: controller values, sounding notes, program,
+ *          pitch bend and pressure. It is updated directly from parsed
+ *          messages and stored as structure-of-arrays tables, with the
+ *          notes of each channel in a 128-bit set, so queries over notes
+ *          are a few word operations.
+ *
+ *          Channel Mode messages, which the parser leaves to the
+ *          application, are applied here as bulk operations on the
+ *          tables.
+ *
+ *          Changes are tracked in dirty sets, so that the difference
+ *          since the last snapshot can be read back as messages, for
+ *          example to bring another device up to date.
+ *
+ * @see MIDI 1.0 Detailed Specification
+ *      https://midi.org/midi-1-0-detailed-specification
+ * @see RP-015 Response to Reset All Controllers
+ **********************************************************************/
+
+#ifndef MIDI_STATE_H
+#define MIDI_STATE_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Number of MIDI channels
+ */
+#define MIDI_STATE_CHANNELS (16)
+
+/**
+ * @brief Number of notes and of controllers per channel
+ */
+#define MIDI_STATE_KEYS (128)
+
+/**
+ * @brief Number of 64-bit words in a set of 128 notes or controllers
+ */
+#define MIDI_STATE_SET_WORDS (2)
+
+/**
+ * @brief Power-on Values
+ * @details The values that midi_state_init and System Reset set
+ */
+#define MIDI_STATE_DEFAULT_VOLUME (100)
+#define MIDI_STATE_DEFAULT_PAN (64)
+#define MIDI_STATE_DEFAULT_EXPRESSION (127)
+#define MIDI_STATE_PITCH_BEND_CENTER (0x2000)
+
+/**
+ * @brief Release velocity of the Note Off messages of a change list
+ */
+#define MIDI_STATE_RELEASE_VELOCITY (64)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Set of 128 notes or controllers
+ * @details Bit n of word n / 64 is set if note or controller n is in
+ *          the set
+ */
+typedef uint64_t midi_state_set_t[MIDI_STATE_SET_WORDS];
+
+/**
+ * @brief Sounding Note
+ */
+typedef struct midi_state_note_t {
+    /**
+     * @brief The channel of the note
+     */
+    midi_channel_t channel;
+
+    /**
+     * @brief The note number
+     */
+    uint8_t note;
+
+    /**
+     * @brief The velocity of the Note On message
+     */
+    uint8_t velocity;
+} midi_state_note_t;
+
+/**
+ * @brief MIDI Channel State
+ * @details The tables may be read directly. Use midi_state_update to
+ *          change them, so that the sets and masks stay consistent.
+ */
+typedef struct midi_state_t {
+    /**
+     * @brief Controller values by channel and controller number
+     * @details Controllers 120 to 127 are Channel Mode messages and are
+     *          not stored
+     */
+    uint8_t controllers[MIDI_STATE_CHANNELS][MIDI_STATE_KEYS];
+
+    /**
+     * @brief Note On velocity by channel and note, for sounding notes
+     */
+    uint8_t velocities[MIDI_STATE_CHANNELS][MIDI_STATE_KEYS];
+
+    /**
+     * @brief Polyphonic Key Pressure by channel and note
+     */
+    uint8_t key_pressure[MIDI_STATE_CHANNELS][MIDI_STATE_KEYS];
+
+    /**
+     * @brief Notes whose key is held down
+     */
+    midi_state_set_t held[MIDI_STATE_CHANNELS];
+
+    /**
+     * @brief Notes whose key was released while the sustain pedal was
+     *        down, and which sound until it is released
+     */
+    midi_state_set_t sustained[MIDI_STATE_CHANNELS];
+
+    /**
+     * @brief Pitch bend by channel, from 0 to 0x3FFF
+     */
+    uint16_t pitch_bend[MIDI_STATE_CHANNELS];
+
+    /**
+     * @brief Program by channel
+     */
+    uint8_t program[MIDI_STATE_CHANNELS];
+
+    /**
+     * @brief Channel Pressure by channel
+     */
+    uint8_t channel_pressure[MIDI_STATE_CHANNELS];
+
+    /**
+     * @brief Channels with at least one sounding note
+     */
+    uint16_t active_channels;
+
+    /**
+     * @brief Channels in Omni On mode
+     */
+    uint16_t omni;
+
+    /**
+     * @brief Channels in Mono mode, the others are in Poly mode
+     */
+    uint16_t mono;
+
+    /**
+     * @brief Channels with Local Control on
+     */
+    uint16_t local_control;
+
+    /**
+     * @brief Controllers changed since the last snapshot
+     */
+    midi_state_set_t dirty_controllers[MIDI_STATE_CHANNELS];
+
+    /**
+     * @brief Sounding notes at the last snapshot
+     */
+    midi_state_set_t snapshot_notes[MIDI_STATE_CHANNELS];
+
+    /**
+     * @brief Channels whose sustain pedal was down at the last snapshot
+     */
+    uint16_t snapshot_sustain;
+
+    /**
+     * @brief Channels whose program changed since the last snapshot
+     */
+    uint16_t dirty_program;
+
+    /**
+     * @brief Channels whose pitch bend changed since the last snapshot
+     */
+    uint16_t dirty_pitch_bend;
+
+    /**
+     * @brief Channels whose Channel Pressure changed since the last
+     *        snapshot
+     */
+    uint16_t dirty_channel_pressure;
+
+    /**
+     * @brief Channels that received All Sound Off since the last snapshot
+     */
+    uint16_t dirty_sound_off;
+} midi_state_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a MIDI channel state
+ * @details Sets every channel to its power-on state: no notes, all
+ *          controllers 0 except volume, pan, expression and the null
+ *          RPN and NRPN, pitch bend centered, program 0, Omni On, Poly
+ *          and Local Control on. The initial state is the first
+ *          snapshot.
+ * @param [out] state Pointer to a midi_state_t struct to initialize
+ */
+void midi_state_init(midi_state_t *state);
+
+/**
+ * @brief Update the state with a message
+ * @details Channel Mode messages are applied as bulk operations:
+ *          - All Sound Off silences every note of the channel.
+ *          - All Notes Off, Omni Off, Omni On, Mono On and Poly On
+ *            release every held note. Released notes keep sounding
+ *            while the sustain pedal is down.
+ *          - Reset All Controllers resets the controllers listed by
+ *            RP-015, the pitch bend and the pressure.
+ *          System Reset returns every channel to its power-on state.
+ *          Other system messages are ignored.
+ * @param [in,out] state Pointer to a midi_state_t struct
+ * @param [in] message Pointer to the message
+ */
+void midi_state_update(midi_state_t *state, const midi_message_t *message);
+
+/**
+ * @brief Update the state with a packed message
+ * @param [in,out] state Pointer to a midi_state_t struct
+ * @param [in] packed The packed message
+ */
+void midi_state_update_packed(midi_state_t *state, midi_packed_t packed);
+
+/**
+ * @brief Check whether a note is sounding
+ * @param [in] state Pointer to a midi_state_t struct
+ * @param [in] channel The channel of the note
+ * @param [in] note The note number
+ * @return Non-zero if the note is held or sustained
+ */
+int midi_state_is_note_on(const midi_state_t *state,
+                          midi_channel_t channel,
+                          uint8_t note);
+
+/**
+ * @brief Count the sounding notes of a channel
+ * @param [in] state Pointer to a midi_state_t struct
+ * @param [in] channel The channel
+ * @return The number of held or sustained notes
+ */
+size_t midi_state_count_notes(const midi_state_t *state,
+                              midi_channel_t channel);
+
+/**
+ * @brief List the sounding notes of a channel
+ * @param [in] state Pointer to a midi_state_t struct
+ * @param [in] channel The channel
+ * @param [out] notes Pointer to an array that receives the note numbers
+ *      in ascending order
+ * @param [in] capacity The number of entries in the notes array
+ * @return The number of notes written
+ */
+size_t midi_state_channel_notes(const midi_state_t *state,
+                                midi_channel_t channel,
+                                uint8_t *notes,
+                                size_t capacity);
+
+/**
+ * @brief List the sounding notes of every channel
+ * @details Only the channels with sounding notes are visited
+ * @param [in] state Pointer to a midi_state_t struct
+ * @param [out] notes Pointer to an array that receives the notes, by
+ *      channel and then by note number
+ * @param [in] capacity The number of entries in the notes array
+ * @return The number of notes written
+ */
+size_t midi_state_all_notes(const midi_state_t *state,
+                            midi_state_note_t *notes,
+                            size_t capacity);
+
+/**
+ * @brief Stop every sounding note with the fewest messages
+ * @details For each channel with sounding notes: Sustain Pedal off if
+ *          the pedal is down, which ends the sustained notes, then a
+ *          Note Off for each held note. Unlike All Notes Off on every
+ *          channel, only the notes that are sounding are sent, and the
+ *          messages work on receivers that ignore Channel Mode
+ *          messages. Used to silence a receiver whose sender was lost.
+ * @param [in,out] state Pointer to a midi_state_t struct. The messages
+ *      that are written are applied to it, and so are listed by
+ *      midi_state_changes.
+ * @param [out] messages Pointer to an array that receives the messages
+ * @param [in] capacity The number of entries in the messages array
+ * @return The number of messages written. If it equals the capacity,
+ *      call again for the remaining notes.
+ */
+size_t midi_state_notes_off(midi_state_t *state,
+                            midi_message_t *messages,
+                            size_t capacity);
+
+/**
+ * @brief Read the changes since the last snapshot as messages
+ * @details For each changed channel in order: All Sound Off if it was
+ *          received, Note Off for notes that stopped sounding, the
+ *          changed controllers, Program Change, Pitch Bend, Channel
+ *          Pressure and Note On for notes that started. If the sustain
+ *          pedal was down, it is lifted before the Note Off messages and
+ *          pressed again with the controllers. Sending the
+ *          messages to a receiver that had the snapshot state brings it
+ *          to the current state. Notes that started and stopped between
+ *          two snapshots are not listed, and Polyphonic Key Pressure is
+ *          not tracked.
+ * @param [in,out] state Pointer to a midi_state_t struct. The changes
+ *      that are written are removed from the dirty sets.
+ * @param [out] messages Pointer to an array that receives the messages
+ * @param [in] capacity The number of entries in the messages array
+ * @return The number of messages written. If it equals the capacity,
+ *      call again for the remaining changes.
+ */
+size_t midi_state_changes(midi_state_t *state,
+                          midi_message_t *messages,
+                          size_t capacity);
+
+/**
+ * @brief Take a snapshot
+ * @details Clears the dirty sets, so that the next changes are relative
+ *          to the current state
+ * @param [in,out] state Pointer to a midi_state_t struct
+ */
+void midi_state_snapshot(midi_state_t *state);
+
+#endif /* MIDI_STATE_H */
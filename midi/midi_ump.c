@@ -0,0 +1,1069 @@
+/***********************************************************************
+ * @file midi_ump.c
+ * @brief MIDI 1.0 to Universal MIDI Packet translation implementation
+ *
+ * @details 7-bit values are upscaled with a 128-entry table of their
+ *          32-bit values, whose upper half gives the 16-bit velocities,
+ *          and 14-bit values with the closed form of the Min-Center-Max
+ *          algorithm. MIDI 1.0 parameter changes are assembled by a
+ *          parameter decoder in immediate order, so that every message
+ *          translates into at most one packet.
+ *
+ * @see Universal MIDI Packet (UMP) Format and MIDI 2.0 Protocol (M2-104)
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_ump.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+#include "midi_encoder.h"
+#include "midi_param.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Mask of the status bit of a MIDI byte
+ */
+#define UMP_STATUS_BIT (0x80)
+
+/**
+ * @brief Mask of the high nibble of a status byte
+ */
+#define UMP_STATUS_CLASS_MASK (0xF0)
+
+/**
+ * @brief Status class of System messages
+ */
+#define UMP_STATUS_SYSTEM (0xF0)
+
+/**
+ * @brief Largest group number
+ */
+#define UMP_MAX_GROUP (0x0F)
+
+/**
+ * @brief Selection of a decoder channel with no parameter selected
+ */
+#define UMP_SELECTED_NONE (0xFFFF)
+
+/**
+ * @brief Flag of a selected Non-Registered Parameter Number
+ * @details Set above the 14-bit parameter number
+ */
+#define UMP_SELECTED_NRPN (0x4000)
+
+/**
+ * @brief Relative controller change of one 14-bit step
+ */
+#define UMP_RELATIVE_STEP (UINT32_C(1) << 18)
+
+/**
+ * @brief MIDI 2.0 velocity of a translated Note On with velocity 0
+ * @details The upscaled default release velocity of 64
+ */
+#define UMP_RELEASE_VELOCITY (0x8000)
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static inline uint32_t make_word(midi_ump_type_t type,
+                                 uint8_t group,
+                                 uint8_t status,
+                                 uint8_t data1,
+                                 uint8_t data2);
+
+static inline uint32_t make_midi2_word(uint8_t group,
+                                       midi_ump_status_t status,
+                                       uint8_t channel,
+                                       uint8_t index1,
+                                       uint8_t index2);
+
+static void write_sysex7(uint8_t group,
+                         midi_ump_sysex7_status_t status,
+                         const uint8_t *bytes,
+                         size_t length,
+                         uint32_t *words);
+
+static size_t translate_midi2(midi_ump_encoder_t *encoder,
+                              midi_packed_t packed,
+                              uint32_t *words);
+
+static size_t translate_param(const midi_ump_encoder_t *encoder,
+                              const midi_param_event_t *event,
+                              uint32_t *words);
+
+static size_t decode_packet(const uint32_t *packet,
+                            uint16_t *selected,
+                            midi_packed_t *messages);
+
+static size_t decode_midi2(const uint32_t *packet,
+                           uint16_t *selected,
+                           midi_packed_t *messages);
+
+static size_t select_parameter(uint8_t channel,
+                               uint16_t parameter,
+                               uint16_t *selected,
+                               midi_packed_t *messages);
+
+static size_t decode_sysex7(const uint32_t *packet,
+                            midi_encoder_t *encoder,
+                            uint8_t *bytes);
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+
+/**
+ * @brief The 32-bit value of each 7-bit value
+ * @details Min-Center-Max upscaling: values up to the center (64) are
+ *          shifted, and the 6 bits below the center bit of the values
+ *          above it are repeated into the new bits, so that 127 maps to
+ *          0xFFFFFFFF
+ */
+static const uint32_t scale_7_to_32[128] = {
+    0x00000000, 0x02000000, 0x04000000, 0x06000000,
+    0x08000000, 0x0A000000, 0x0C000000, 0x0E000000,
+    0x10000000, 0x12000000, 0x14000000, 0x16000000,
+    0x18000000, 0x1A000000, 0x1C000000, 0x1E000000,
+    0x20000000, 0x22000000, 0x24000000, 0x26000000,
+    0x28000000, 0x2A000000, 0x2C000000, 0x2E000000,
+    0x30000000, 0x32000000, 0x34000000, 0x36000000,
+    0x38000000, 0x3A000000, 0x3C000000, 0x3E000000,
+    0x40000000, 0x42000000, 0x44000000, 0x46000000,
+    0x48000000, 0x4A000000, 0x4C000000, 0x4E000000,
+    0x50000000, 0x52000000, 0x54000000, 0x56000000,
+    0x58000000, 0x5A000000, 0x5C000000, 0x5E000000,
+    0x60000000, 0x62000000, 0x64000000, 0x66000000,
+    0x68000000, 0x6A000000, 0x6C000000, 0x6E000000,
+    0x70000000, 0x72000000, 0x74000000, 0x76000000,
+    0x78000000, 0x7A000000, 0x7C000000, 0x7E000000,
+    0x80000000, 0x82082082, 0x84104104, 0x86186186,
+    0x88208208, 0x8A28A28A, 0x8C30C30C, 0x8E38E38E,
+    0x90410410, 0x92492492, 0x94514514, 0x96596596,
+    0x98618618, 0x9A69A69A, 0x9C71C71C, 0x9E79E79E,
+    0xA0820820, 0xA28A28A2, 0xA4924924, 0xA69A69A6,
+    0xA8A28A28, 0xAAAAAAAA, 0xACB2CB2C, 0xAEBAEBAE,
+    0xB0C30C30, 0xB2CB2CB2, 0xB4D34D34, 0xB6DB6DB6,
+    0xB8E38E38, 0xBAEBAEBA, 0xBCF3CF3C, 0xBEFBEFBE,
+    0xC1041041, 0xC30C30C3, 0xC5145145, 0xC71C71C7,
+    0xC9249249, 0xCB2CB2CB, 0xCD34D34D, 0xCF3CF3CF,
+    0xD1451451, 0xD34D34D3, 0xD5555555, 0xD75D75D7,
+    0xD9659659, 0xDB6DB6DB, 0xDD75D75D, 0xDF7DF7DF,
+    0xE1861861, 0xE38E38E3, 0xE5965965, 0xE79E79E7,
+    0xE9A69A69, 0xEBAEBAEB, 0xEDB6DB6D, 0xEFBEFBEF,
+    0xF1C71C71, 0xF3CF3CF3, 0xF5D75D75, 0xF7DF7DF7,
+    0xF9E79E79, 0xFBEFBEFB, 0xFDF7DF7D, 0xFFFFFFFF,
+};
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Upscale a 7-bit value to 16 bits
+ * @param [in] value The 7-bit value
+ * @return The 16-bit value
+ */
+uint16_t midi_ump_scale_7_to_16(uint8_t value)
+{
+    return (uint16_t)(scale_7_to_32[value & 0x7F] >> 16);
+}
+
+/**
+ * @brief Upscale a 7-bit value to 32 bits
+ * @param [in] value The 7-bit value
+ * @return The 32-bit value
+ */
+uint32_t midi_ump_scale_7_to_32(uint8_t value)
+{
+    return scale_7_to_32[value & 0x7F];
+}
+
+/**
+ * @brief Upscale a 14-bit value to 32 bits
+ * @details The 13 bits below the center bit fill the 18 new bits in two
+ *          copies, which is what the repeat loop of the algorithm does
+ * @param [in] value The 14-bit value
+ * @return The 32-bit value
+ */
+uint32_t midi_ump_scale_14_to_32(uint16_t value)
+{
+    value &= 0x3FFF;
+
+    const uint32_t shifted = (uint32_t)value << 18;
+    if (value <= 0x2000) { return shifted; }
+
+    const uint32_t repeat = (uint32_t)(value & 0x1FFF);
+    return shifted | (repeat << 5) | (repeat >> 8);
+}
+
+/**
+ * @brief Initialize a MIDI 1.0 to UMP translator
+ * @param [out] encoder Pointer to a midi_ump_encoder_t struct
+ * @param [in] group The group of the packets (0-15)
+ * @param [in] protocol The message type of Channel Voice messages
+ */
+void midi_ump_encoder_init(midi_ump_encoder_t *encoder,
+                           uint8_t group,
+                           midi_ump_protocol_t protocol)
+{
+    /* Check for NULL pointers */
+    if (encoder == NULL) { return; }
+
+    memset(encoder, 0, sizeof(*encoder));
+    midi_param_init(&encoder->param,
+                    MIDI_PARAM_FLAG_RPN | MIDI_PARAM_FLAG_NRPN,
+                    MIDI_PARAM_ORDER_IMMEDIATE,
+                    0);
+    encoder->group = group & UMP_MAX_GROUP;
+    encoder->protocol = protocol;
+}
+
+/**
+ * @brief Reset a MIDI 1.0 to UMP translator
+ * @param [in,out] encoder Pointer to a midi_ump_encoder_t struct
+ */
+void midi_ump_encoder_reset(midi_ump_encoder_t *encoder)
+{
+    /* Check for NULL pointers */
+    if (encoder == NULL) { return; }
+
+    midi_param_reset(&encoder->param);
+    memset(encoder->bank_msb, 0, sizeof(encoder->bank_msb));
+    memset(encoder->bank_lsb, 0, sizeof(encoder->bank_lsb));
+    encoder->bank_valid = 0;
+    encoder->sysex_sent = 0;
+    encoder->sysex_length = 0;
+}
+
+/**
+ * @brief Translate packed MIDI 1.0 messages into packets
+ * @param [in,out] encoder Pointer to a midi_ump_encoder_t struct
+ * @param [in] packed Pointer to the packed messages to translate
+ * @param [in] count The number of packed messages
+ * @param [out] words Pointer to the array that receives the packets
+ * @param [in] capacity The number of entries in the words array
+ * @param [out] consumed Optional pointer that receives the number of
+ *      messages that were translated or skipped
+ * @return The number of words written
+ */
+size_t midi_ump_from_packed(midi_ump_encoder_t *encoder,
+                            const midi_packed_t *packed,
+                            size_t count,
+                            uint32_t *words,
+                            size_t capacity,
+                            size_t *consumed)
+{
+    /* Check for NULL pointers */
+    if (encoder == NULL || packed == NULL || words == NULL) {
+        if (consumed != NULL) { *consumed = 0; }
+        return 0;
+    }
+
+    const int midi2 = encoder->protocol == MIDI_UMP_PROTOCOL_MIDI2;
+    size_t written = 0;
+    size_t index = 0;
+
+    for (; index < count; index++) {
+        const midi_packed_t message = packed[index];
+        const midi_message_type_t type = midi_packed_type(message);
+        const int is_system = type >= MIDI_MESSAGE_SYSTEM_EXCLUSIVE;
+
+        /* Room for the packet, checked before any state changes */
+        if (written + (is_system || !midi2 ? 1 : 2) > capacity) { break; }
+
+        if (type == MIDI_MESSAGE_NONE
+            || type == MIDI_MESSAGE_SYSTEM_EXCLUSIVE
+            || type == MIDI_MESSAGE_END_OF_EXCLUSIVE) {
+            continue;
+        }
+
+        if (is_system) {
+            if (type == MIDI_MESSAGE_SYSTEM_RESET) {
+                midi_param_reset(&encoder->param);
+            }
+            words[written++] = make_word(MIDI_UMP_TYPE_SYSTEM,
+                                         encoder->group,
+                                         (uint8_t)type,
+                                         midi_packed_data1(message),
+                                         midi_packed_data2(message));
+            continue;
+        }
+
+        const midi_channel_t channel = midi_packed_channel(message);
+        if (channel > MIDI_CHANNEL_16) { continue; }
+
+        if (!midi2) {
+            /* Channel Mode messages are Control Changes on the wire */
+            const uint8_t status =
+                (uint8_t)((type < UMP_STATUS_BIT
+                               ? MIDI_MESSAGE_CONTROL_CHANGE
+                               : type)
+                          | channel);
+            words[written++] = make_word(MIDI_UMP_TYPE_MIDI1_CHANNEL_VOICE,
+                                         encoder->group,
+                                         status,
+                                         midi_packed_data1(message),
+                                         midi_packed_data2(message));
+            continue;
+        }
+
+        /* Only controllers take part in parameter changes */
+        if (type != MIDI_MESSAGE_CONTROL_CHANGE
+            && type != MIDI_MESSAGE_RESET_ALL_CONTROLLERS) {
+            written += translate_midi2(encoder, message, &words[written]);
+            continue;
+        }
+
+        /* In immediate order a message gives at most one event */
+        midi_param_event_t events[MIDI_PARAM_MAX_EVENTS];
+        midi_message_t unpacked;
+        midi_message_unpack(message, &unpacked);
+        if (midi_param_process(&encoder->param, &unpacked, 0, events,
+                               MIDI_PARAM_MAX_EVENTS)
+            == 0) {
+            continue;
+        }
+
+        written += events[0].type == MIDI_PARAM_EVENT_MESSAGE
+                       ? translate_midi2(
+                           encoder, events[0].message, &words[written])
+                       : translate_param(
+                           encoder, &events[0], &words[written]);
+    }
+
+    if (consumed != NULL) { *consumed = index; }
+    return written;
+}
+
+/**
+ * @brief Translate a SysEx span into Message Type 3 packets
+ * @param [in,out] encoder Pointer to a midi_ump_encoder_t struct
+ * @param [in] span Pointer to the span
+ * @param [out] words Pointer to the array that receives the packets
+ * @param [in] capacity The number of entries in the words array
+ * @return The number of words written, or 0 if they do not fit
+ */
+size_t midi_ump_from_sysex_span(midi_ump_encoder_t *encoder,
+                                const midi_sysex_span_t *span,
+                                uint32_t *words,
+                                size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (encoder == NULL || span == NULL || words == NULL
+        || (span->data == NULL && span->length > 0)) {
+        return 0;
+    }
+
+    if (span->flags & MIDI_SYSEX_FLAG_START) {
+        encoder->sysex_sent = 0;
+        encoder->sysex_length = 0;
+    }
+
+    /* Hold back the last bytes until the end of the message is known */
+    const int ends = (span->flags & MIDI_SYSEX_FLAG_END) != 0;
+    const size_t pending = encoder->sysex_length + span->length;
+    size_t packets;
+    if (ends) {
+        packets = pending == 0 ? 1
+                               : (pending + MIDI_UMP_SYSEX7_BYTES - 1)
+                                     / MIDI_UMP_SYSEX7_BYTES;
+    } else {
+        packets = pending == 0 ? 0 : (pending - 1) / MIDI_UMP_SYSEX7_BYTES;
+    }
+    if (packets * 2 > capacity) { return 0; }
+
+    size_t held = 0;
+    size_t taken = 0;
+
+    for (size_t p = 0; p < packets; p++) {
+        uint8_t bytes[MIDI_UMP_SYSEX7_BYTES];
+        size_t length = 0;
+
+        while (length < MIDI_UMP_SYSEX7_BYTES
+               && held < encoder->sysex_length) {
+            bytes[length++] = encoder->sysex_bytes[held++];
+        }
+        while (length < MIDI_UMP_SYSEX7_BYTES && taken < span->length) {
+            bytes[length++] = span->data[taken++];
+        }
+
+        midi_ump_sysex7_status_t status;
+        if (ends && p == packets - 1) {
+            status = encoder->sysex_sent ? MIDI_UMP_SYSEX7_END
+                                         : MIDI_UMP_SYSEX7_COMPLETE;
+        } else {
+            status = encoder->sysex_sent ? MIDI_UMP_SYSEX7_CONTINUE
+                                         : MIDI_UMP_SYSEX7_START;
+        }
+        write_sysex7(encoder->group, status, bytes, length, &words[p * 2]);
+        encoder->sysex_sent = 1;
+    }
+
+    if (ends) {
+        encoder->sysex_sent = 0;
+        encoder->sysex_length = 0;
+    } else {
+        /* Keep what is left of the held bytes, then the rest of the span */
+        const size_t kept = encoder->sysex_length - held;
+        memmove(encoder->sysex_bytes, &encoder->sysex_bytes[held], kept);
+        memcpy(&encoder->sysex_bytes[kept], &span->data[taken],
+               span->length - taken);
+        encoder->sysex_length = (uint8_t)(kept + span->length - taken);
+    }
+
+    return packets * 2;
+}
+
+/**
+ * @brief Translate a complete System Exclusive message into Message
+ *        Type 3 packets
+ * @param [in] group The group of the packets (0-15)
+ * @param [in] payload Pointer to the payload bytes, or NULL if length is 0
+ * @param [in] length The number of payload bytes
+ * @param [out] words Pointer to the array that receives the packets
+ * @param [in] capacity The number of entries in the words array
+ * @return The number of words written, or 0 on failure
+ */
+size_t midi_ump_from_sysex(uint8_t group,
+                           const uint8_t *payload,
+                           size_t length,
+                           uint32_t *words,
+                           size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (words == NULL || (payload == NULL && length > 0)
+        || group > UMP_MAX_GROUP) {
+        return 0;
+    }
+
+    const size_t needed = MIDI_UMP_SYSEX7_WORDS(length);
+    if (needed > capacity) { return 0; }
+    for (size_t i = 0; i < length; i++) {
+        if (payload[i] & UMP_STATUS_BIT) { return 0; }
+    }
+
+    const size_t packets = needed / 2;
+    for (size_t p = 0; p < packets; p++) {
+        const size_t offset = p * MIDI_UMP_SYSEX7_BYTES;
+        const size_t remaining = length - offset;
+        midi_ump_sysex7_status_t status;
+
+        if (packets == 1) {
+            status = MIDI_UMP_SYSEX7_COMPLETE;
+        } else if (p == 0) {
+            status = MIDI_UMP_SYSEX7_START;
+        } else if (p == packets - 1) {
+            status = MIDI_UMP_SYSEX7_END;
+        } else {
+            status = MIDI_UMP_SYSEX7_CONTINUE;
+        }
+        write_sysex7(group,
+                     status,
+                     length > 0 ? &payload[offset] : NULL,
+                     remaining > MIDI_UMP_SYSEX7_BYTES
+                         ? MIDI_UMP_SYSEX7_BYTES
+                         : remaining,
+                     &words[p * 2]);
+    }
+
+    return needed;
+}
+
+/**
+ * @brief Initialize a UMP to MIDI 1.0 translator
+ * @param [out] decoder Pointer to a midi_ump_decoder_t struct
+ */
+void midi_ump_decoder_init(midi_ump_decoder_t *decoder)
+{
+    /* Check for NULL pointers */
+    if (decoder == NULL) { return; }
+
+    midi_encoder_init(&decoder->encoder);
+    midi_ump_decoder_reset(decoder);
+}
+
+/**
+ * @brief Reset a UMP to MIDI 1.0 translator
+ * @param [in,out] decoder Pointer to a midi_ump_decoder_t struct
+ */
+void midi_ump_decoder_reset(midi_ump_decoder_t *decoder)
+{
+    /* Check for NULL pointers */
+    if (decoder == NULL) { return; }
+
+    for (size_t i = 0; i < MIDI_UMP_GROUPS * 16; i++) {
+        decoder->selected[i] = UMP_SELECTED_NONE;
+    }
+    midi_encoder_reset(&decoder->encoder);
+}
+
+/**
+ * @brief Enable or disable running status in midi_ump_to_bytes
+ * @param [in,out] decoder Pointer to a midi_ump_decoder_t struct
+ * @param [in] enabled Non-zero to leave out repeated status bytes
+ */
+void midi_ump_decoder_set_running_status(midi_ump_decoder_t *decoder,
+                                         int enabled)
+{
+    /* Check for NULL pointers */
+    if (decoder == NULL) { return; }
+
+    midi_encoder_set_running_status(&decoder->encoder, enabled);
+}
+
+/**
+ * @brief Translate packets into packed MIDI 1.0 messages
+ * @param [in,out] decoder Pointer to a midi_ump_decoder_t struct
+ * @param [in] words Pointer to the packets to translate
+ * @param [in] count The number of words
+ * @param [out] groups Optional pointer to an array that receives the
+ *      group of each message
+ * @param [out] messages Pointer to an array that receives the messages
+ * @param [in] capacity The number of entries in the groups and messages
+ *      arrays
+ * @param [out] consumed Optional pointer that receives the number of
+ *      words that were translated or skipped
+ * @return The number of messages written
+ */
+size_t midi_ump_to_packed(midi_ump_decoder_t *decoder,
+                          const uint32_t *words,
+                          size_t count,
+                          uint8_t *groups,
+                          midi_packed_t *messages,
+                          size_t capacity,
+                          size_t *consumed)
+{
+    /* Check for NULL pointers */
+    if (decoder == NULL || words == NULL || messages == NULL) {
+        if (consumed != NULL) { *consumed = 0; }
+        return 0;
+    }
+
+    size_t written = 0;
+    size_t index = 0;
+
+    while (index < count) {
+        const uint32_t word = words[index];
+        const size_t size = midi_ump_packet_words(word);
+        if (size > count - index) { break; }
+
+        /* The selection only changes once the messages are written */
+        const uint8_t group = midi_ump_packet_group(word);
+        uint16_t *slot = &decoder->selected[group * 16 + ((word >> 16) & 0x0F)];
+        uint16_t selected = *slot;
+        midi_packed_t translated[MIDI_UMP_MAX_MESSAGES];
+
+        const size_t length =
+            decode_packet(&words[index], &selected, translated);
+        if (length > capacity - written) { break; }
+
+        for (size_t i = 0; i < length; i++, written++) {
+            messages[written] = translated[i];
+            if (groups != NULL) { groups[written] = group; }
+        }
+        *slot = selected;
+        index += size;
+    }
+
+    if (consumed != NULL) { *consumed = index; }
+    return written;
+}
+
+/**
+ * @brief Translate packets into a MIDI 1.0 byte stream
+ * @param [in,out] decoder Pointer to a midi_ump_decoder_t struct
+ * @param [in] words Pointer to the packets to translate
+ * @param [in] count The number of words
+ * @param [out] bytes Pointer to the buffer that receives the bytes
+ * @param [in] capacity The size of the buffer in bytes
+ * @param [out] consumed Optional pointer that receives the number of
+ *      words that were translated or skipped
+ * @return The number of bytes written
+ */
+size_t midi_ump_to_bytes(midi_ump_decoder_t *decoder,
+                         const uint32_t *words,
+                         size_t count,
+                         uint8_t *bytes,
+                         size_t capacity,
+                         size_t *consumed)
+{
+    /* Check for NULL pointers */
+    if (decoder == NULL || words == NULL || bytes == NULL) {
+        if (consumed != NULL) { *consumed = 0; }
+        return 0;
+    }
+
+    size_t written = 0;
+    size_t index = 0;
+
+    while (index < count) {
+        const uint32_t word = words[index];
+        const size_t size = midi_ump_packet_words(word);
+        if (size > count - index) { break; }
+
+        /* The state only changes once the bytes are written */
+        const uint8_t group = midi_ump_packet_group(word);
+        uint16_t *slot = &decoder->selected[group * 16 + ((word >> 16) & 0x0F)];
+        uint16_t selected = *slot;
+        midi_encoder_t encoder = decoder->encoder;
+        uint8_t buffer[MIDI_UMP_MAX_MESSAGES
+                       * MIDI_ENCODER_MAX_MESSAGE_SIZE];
+        size_t length;
+
+        if (midi_ump_packet_type(word) == MIDI_UMP_TYPE_DATA_64) {
+            length = decode_sysex7(&words[index], &encoder, buffer);
+        } else {
+            midi_packed_t translated[MIDI_UMP_MAX_MESSAGES];
+            const size_t messages =
+                decode_packet(&words[index], &selected, translated);
+            length = midi_encode_packed(&encoder, translated, messages,
+                                        buffer, sizeof(buffer), NULL);
+        }
+        if (length > capacity - written) { break; }
+
+        memcpy(&bytes[written], buffer, length);
+        written += length;
+        decoder->encoder = encoder;
+        *slot = selected;
+        index += size;
+    }
+
+    if (consumed != NULL) { *consumed = index; }
+    return written;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Build the first word of a Message Type 1, 2 or 4 packet
+ */
+static inline uint32_t make_word(midi_ump_type_t type,
+                                 uint8_t group,
+                                 uint8_t status,
+                                 uint8_t data1,
+                                 uint8_t data2)
+{
+    return ((uint32_t)type << 28) | ((uint32_t)group << 24)
+           | ((uint32_t)status << 16) | ((uint32_t)data1 << 8)
+           | (uint32_t)data2;
+}
+
+/**
+ * @brief Build the first word of a Message Type 4 packet
+ */
+static inline uint32_t make_midi2_word(uint8_t group,
+                                       midi_ump_status_t status,
+                                       uint8_t channel,
+                                       uint8_t index1,
+                                       uint8_t index2)
+{
+    return make_word(MIDI_UMP_TYPE_MIDI2_CHANNEL_VOICE,
+                     group,
+                     (uint8_t)((status << 4) | channel),
+                     index1,
+                     index2);
+}
+
+/**
+ * @brief Write a Message Type 3 packet
+ * @details Unused bytes are zero
+ */
+static void write_sysex7(uint8_t group,
+                         midi_ump_sysex7_status_t status,
+                         const uint8_t *bytes,
+                         size_t length,
+                         uint32_t *words)
+{
+    uint8_t data[MIDI_UMP_SYSEX7_BYTES] = {0};
+    if (length > 0) { memcpy(data, bytes, length); }
+
+    words[0] = make_word(MIDI_UMP_TYPE_DATA_64,
+                         group,
+                         (uint8_t)((status << 4) | length),
+                         data[0],
+                         data[1]);
+    words[1] = ((uint32_t)data[2] << 24) | ((uint32_t)data[3] << 16)
+               | ((uint32_t)data[4] << 8) | (uint32_t)data[5];
+}
+
+/**
+ * @brief Translate a message into a Message Type 4 packet
+ * @details Bank Select is held for the next Program Change
+ * @return The number of words written, 0 or 2
+ */
+static size_t translate_midi2(midi_ump_encoder_t *encoder,
+                              midi_packed_t packed,
+                              uint32_t *words)
+{
+    const midi_message_type_t type = midi_packed_type(packed);
+    const uint8_t channel = (uint8_t)midi_packed_channel(packed);
+    const uint8_t data1 = midi_packed_data1(packed) & 0x7F;
+    const uint8_t data2 = midi_packed_data2(packed) & 0x7F;
+    const uint8_t group = encoder->group;
+
+    switch (type) {
+    case MIDI_MESSAGE_NOTE_OFF:
+        words[0] = make_midi2_word(
+            group, MIDI_UMP_STATUS_NOTE_OFF, channel, data1, 0);
+        words[1] = scale_7_to_32[data2] & 0xFFFF0000u;
+        return 2;
+    case MIDI_MESSAGE_NOTE_ON:
+        if (data2 == 0) {
+            words[0] = make_midi2_word(
+                group, MIDI_UMP_STATUS_NOTE_OFF, channel, data1, 0);
+            words[1] = (uint32_t)UMP_RELEASE_VELOCITY << 16;
+        } else {
+            words[0] = make_midi2_word(
+                group, MIDI_UMP_STATUS_NOTE_ON, channel, data1, 0);
+            words[1] = scale_7_to_32[data2] & 0xFFFF0000u;
+        }
+        return 2;
+    case MIDI_MESSAGE_KEY_PRESSURE:
+        words[0] = make_midi2_word(
+            group, MIDI_UMP_STATUS_KEY_PRESSURE, channel, data1, 0);
+        words[1] = scale_7_to_32[data2];
+        return 2;
+    case MIDI_MESSAGE_PROGRAM_CHANGE: {
+        const int bank = (encoder->bank_valid >> channel) & 1;
+        words[0] = make_midi2_word(group,
+                                   MIDI_UMP_STATUS_PROGRAM_CHANGE,
+                                   channel,
+                                   0,
+                                   bank ? MIDI_UMP_PROGRAM_BANK_VALID : 0);
+        words[1] = ((uint32_t)data1 << 24)
+                   | (bank ? ((uint32_t)encoder->bank_msb[channel] << 8)
+                                 | encoder->bank_lsb[channel]
+                           : 0);
+        return 2;
+    }
+    case MIDI_MESSAGE_CHANNEL_PRESSURE:
+        words[0] = make_midi2_word(
+            group, MIDI_UMP_STATUS_CHANNEL_PRESSURE, channel, 0, 0);
+        words[1] = scale_7_to_32[data1];
+        return 2;
+    case MIDI_MESSAGE_PITCH_BEND:
+        words[0] = make_midi2_word(
+            group, MIDI_UMP_STATUS_PITCH_BEND, channel, 0, 0);
+        words[1] = midi_ump_scale_14_to_32((uint16_t)(data2 << 7 | data1));
+        return 2;
+    default:
+        break;
+    }
+
+    /* Control Change and the Channel Mode messages */
+    if (type != MIDI_MESSAGE_CONTROL_CHANGE
+        && (type == MIDI_MESSAGE_NONE || type >= UMP_STATUS_BIT)) {
+        return 0;
+    }
+    if (data1 == MIDI_CC_BANK_SELECT || data1 == MIDI_CC_BANK_SELECT_LSB) {
+        if (data1 == MIDI_CC_BANK_SELECT) {
+            encoder->bank_msb[channel] = data2;
+        } else {
+            encoder->bank_lsb[channel] = data2;
+        }
+        encoder->bank_valid |= (uint16_t)(1u << channel);
+        return 0;
+    }
+    words[0] = make_midi2_word(
+        group, MIDI_UMP_STATUS_CONTROL_CHANGE, channel, data1, 0);
+    words[1] = scale_7_to_32[data2];
+    return 2;
+}
+
+/**
+ * @brief Translate a parameter change into a Registered or Assignable
+ *        Controller
+ * @return The number of words written, 0 or 2
+ */
+static size_t translate_param(const midi_ump_encoder_t *encoder,
+                              const midi_param_event_t *event,
+                              uint32_t *words)
+{
+    const int registered = event->type == MIDI_PARAM_EVENT_RPN;
+    midi_ump_status_t status;
+    uint32_t data;
+
+    if (event->type != MIDI_PARAM_EVENT_RPN
+        && event->type != MIDI_PARAM_EVENT_NRPN) {
+        return 0;
+    }
+
+    switch (event->op) {
+    case MIDI_PARAM_OP_INCREMENT:
+        status = registered ? MIDI_UMP_STATUS_RELATIVE_REGISTERED
+                            : MIDI_UMP_STATUS_RELATIVE_ASSIGNABLE;
+        data = UMP_RELATIVE_STEP;
+        break;
+    case MIDI_PARAM_OP_DECREMENT:
+        status = registered ? MIDI_UMP_STATUS_RELATIVE_REGISTERED
+                            : MIDI_UMP_STATUS_RELATIVE_ASSIGNABLE;
+        data = 0u - UMP_RELATIVE_STEP;
+        break;
+    case MIDI_PARAM_OP_SET:
+    default:
+        status = registered ? MIDI_UMP_STATUS_REGISTERED_CONTROLLER
+                            : MIDI_UMP_STATUS_ASSIGNABLE_CONTROLLER;
+        data = midi_ump_scale_14_to_32(event->value);
+        break;
+    }
+
+    /* The bank is the MSB of the parameter number and the index its LSB */
+    words[0] = make_midi2_word(encoder->group,
+                               status,
+                               (uint8_t)event->channel,
+                               (uint8_t)(event->number >> 7),
+                               (uint8_t)(event->number & 0x7F));
+    words[1] = data;
+    return 2;
+}
+
+/**
+ * @brief Translate a Message Type 1, 2 or 4 packet into messages
+ * @param [in] packet Pointer to the words of the packet
+ * @param [in,out] selected The parameter selected on the channel of the
+ *      packet
+ * @param [out] messages Pointer to MIDI_UMP_MAX_MESSAGES messages
+ * @return The number of messages written
+ */
+static size_t decode_packet(const uint32_t *packet,
+                            uint16_t *selected,
+                            midi_packed_t *messages)
+{
+    const uint32_t word = packet[0];
+    const midi_ump_type_t type = midi_ump_packet_type(word);
+    const uint8_t status = (uint8_t)(word >> 16);
+    midi_message_t message;
+
+    switch (type) {
+    case MIDI_UMP_TYPE_SYSTEM:
+        if (status <= MIDI_MESSAGE_SYSTEM_EXCLUSIVE
+            || status == MIDI_MESSAGE_END_OF_EXCLUSIVE) {
+            return 0;
+        }
+        break;
+    case MIDI_UMP_TYPE_MIDI1_CHANNEL_VOICE:
+        if ((status & UMP_STATUS_CLASS_MASK) == UMP_STATUS_SYSTEM
+            || !(status & UMP_STATUS_BIT)) {
+            return 0;
+        }
+        break;
+    case MIDI_UMP_TYPE_MIDI2_CHANNEL_VOICE:
+        return decode_midi2(packet, selected, messages);
+    default:
+        return 0;
+    }
+
+    if (midi_decode_message(status, (uint8_t)(word >> 8), (uint8_t)word,
+                            &message)
+        == MIDI_MESSAGE_NONE) {
+        return 0;
+    }
+
+    /* A selection sent as it is replaces the one that was tracked */
+    if (message.message_type == MIDI_MESSAGE_CONTROL_CHANGE
+        && message.controller >= MIDI_CC_NRPN_LSB
+        && message.controller <= MIDI_CC_RPN_MSB) {
+        *selected = UMP_SELECTED_NONE;
+    }
+
+    messages[0] = midi_message_pack(&message);
+    return 1;
+}
+
+/**
+ * @brief Translate a Message Type 4 packet into messages
+ * @return The number of messages written
+ */
+static size_t decode_midi2(const uint32_t *packet,
+                           uint16_t *selected,
+                           midi_packed_t *messages)
+{
+    const uint32_t word = packet[0];
+    const uint32_t data = packet[1];
+    const uint8_t channel = (uint8_t)((word >> 16) & 0x0F);
+    const midi_channel_t ch = (midi_channel_t)channel;
+    const uint8_t index1 = (uint8_t)((word >> 8) & 0x7F);
+    const uint8_t index2 = (uint8_t)(word & 0x7F);
+    size_t count = 0;
+
+    switch ((midi_ump_status_t)((word >> 20) & 0x0F)) {
+    case MIDI_UMP_STATUS_NOTE_OFF:
+        messages[0] = midi_packed_make(
+            MIDI_MESSAGE_NOTE_OFF, ch, index1, (uint8_t)(data >> 25));
+        return 1;
+    case MIDI_UMP_STATUS_NOTE_ON: {
+        /* Velocity 0 would turn the note off */
+        const uint8_t velocity = (uint8_t)(data >> 25);
+        messages[0] = midi_packed_make(MIDI_MESSAGE_NOTE_ON, ch, index1,
+                                       velocity == 0 ? 1 : velocity);
+        return 1;
+    }
+    case MIDI_UMP_STATUS_KEY_PRESSURE:
+        messages[0] = midi_packed_make(
+            MIDI_MESSAGE_KEY_PRESSURE, ch, index1, (uint8_t)(data >> 25));
+        return 1;
+    case MIDI_UMP_STATUS_CONTROL_CHANGE: {
+        midi_message_t message;
+        midi_decode_message((uint8_t)(MIDI_MESSAGE_CONTROL_CHANGE | channel),
+                            index1,
+                            (uint8_t)(data >> 25),
+                            &message);
+        if (index1 >= MIDI_CC_NRPN_LSB && index1 <= MIDI_CC_RPN_MSB) {
+            *selected = UMP_SELECTED_NONE;
+        }
+        messages[0] = midi_message_pack(&message);
+        return 1;
+    }
+    case MIDI_UMP_STATUS_PROGRAM_CHANGE:
+        if (word & MIDI_UMP_PROGRAM_BANK_VALID) {
+            messages[count++] = midi_packed_make(
+                MIDI_MESSAGE_CONTROL_CHANGE, ch, MIDI_CC_BANK_SELECT,
+                (uint8_t)((data >> 8) & 0x7F));
+            messages[count++] = midi_packed_make(
+                MIDI_MESSAGE_CONTROL_CHANGE, ch, MIDI_CC_BANK_SELECT_LSB,
+                (uint8_t)(data & 0x7F));
+        }
+        messages[count++] = midi_packed_make(
+            MIDI_MESSAGE_PROGRAM_CHANGE, ch, (uint8_t)((data >> 24) & 0x7F),
+            0);
+        return count;
+    case MIDI_UMP_STATUS_CHANNEL_PRESSURE:
+        messages[0] = midi_packed_make(
+            MIDI_MESSAGE_CHANNEL_PRESSURE, ch, (uint8_t)(data >> 25), 0);
+        return 1;
+    case MIDI_UMP_STATUS_PITCH_BEND: {
+        const uint16_t value = (uint16_t)(data >> 18);
+        messages[0] = midi_packed_make(MIDI_MESSAGE_PITCH_BEND, ch,
+                                       (uint8_t)(value & 0x7F),
+                                       (uint8_t)(value >> 7));
+        return 1;
+    }
+    case MIDI_UMP_STATUS_REGISTERED_CONTROLLER:
+    case MIDI_UMP_STATUS_ASSIGNABLE_CONTROLLER: {
+        const uint16_t value = (uint16_t)(data >> 18);
+        const uint16_t nrpn =
+            ((word >> 20) & 0x0F) == MIDI_UMP_STATUS_ASSIGNABLE_CONTROLLER
+                ? UMP_SELECTED_NRPN
+                : 0;
+        count = select_parameter(
+            channel, (uint16_t)(nrpn | (index1 << 7) | index2), selected,
+            messages);
+        messages[count++] = midi_packed_make(
+            MIDI_MESSAGE_CONTROL_CHANGE, ch, MIDI_CC_DATA_ENTRY_MSB,
+            (uint8_t)(value >> 7));
+        messages[count++] = midi_packed_make(
+            MIDI_MESSAGE_CONTROL_CHANGE, ch, MIDI_CC_DATA_ENTRY_LSB,
+            (uint8_t)(value & 0x7F));
+        return count;
+    }
+    case MIDI_UMP_STATUS_RELATIVE_REGISTERED:
+    case MIDI_UMP_STATUS_RELATIVE_ASSIGNABLE: {
+        if (data == 0) { return 0; }
+
+        /* The data is a signed change */
+        const uint16_t nrpn =
+            ((word >> 20) & 0x0F) == MIDI_UMP_STATUS_RELATIVE_ASSIGNABLE
+                ? UMP_SELECTED_NRPN
+                : 0;
+        count = select_parameter(
+            channel, (uint16_t)(nrpn | (index1 << 7) | index2), selected,
+            messages);
+        messages[count++] = midi_packed_make(
+            MIDI_MESSAGE_CONTROL_CHANGE, ch,
+            (data & 0x80000000u) ? MIDI_CC_DATA_DECREMENT
+                                 : MIDI_CC_DATA_INCREMENT,
+            0);
+        return count;
+    }
+    case MIDI_UMP_STATUS_REGISTERED_PER_NOTE:
+    case MIDI_UMP_STATUS_ASSIGNABLE_PER_NOTE:
+    case MIDI_UMP_STATUS_PER_NOTE_PITCH_BEND:
+    case MIDI_UMP_STATUS_PER_NOTE_MANAGEMENT:
+    default:
+        /* No MIDI 1.0 equivalent */
+        return 0;
+    }
+}
+
+/**
+ * @brief Send the selection of a parameter, unless it is selected already
+ * @param [in] channel The channel
+ * @param [in] parameter The 14-bit parameter number, with
+ *      UMP_SELECTED_NRPN set for a Non-Registered Parameter Number
+ * @param [in,out] selected The parameter selected on the channel
+ * @param [out] messages Pointer to the array that receives the messages
+ * @return The number of messages written, 0 or 2
+ */
+static size_t select_parameter(uint8_t channel,
+                               uint16_t parameter,
+                               uint16_t *selected,
+                               midi_packed_t *messages)
+{
+    if (*selected == parameter) { return 0; }
+
+    const int nrpn = (parameter & UMP_SELECTED_NRPN) != 0;
+    const midi_channel_t ch = (midi_channel_t)channel;
+
+    messages[0] = midi_packed_make(MIDI_MESSAGE_CONTROL_CHANGE, ch,
+                                   nrpn ? MIDI_CC_NRPN_MSB : MIDI_CC_RPN_MSB,
+                                   (uint8_t)((parameter >> 7) & 0x7F));
+    messages[1] = midi_packed_make(MIDI_MESSAGE_CONTROL_CHANGE, ch,
+                                   nrpn ? MIDI_CC_NRPN_LSB : MIDI_CC_RPN_LSB,
+                                   (uint8_t)(parameter & 0x7F));
+    *selected = parameter;
+    return 2;
+}
+
+/**
+ * @brief Translate a Message Type 3 packet into System Exclusive bytes
+ * @details Start of Exclusive clears running status
+ * @return The number of bytes written, at most MIDI_UMP_SYSEX7_BYTES + 2
+ */
+static size_t decode_sysex7(const uint32_t *packet,
+                            midi_encoder_t *encoder,
+                            uint8_t *bytes)
+{
+    const midi_ump_sysex7_status_t status =
+        (midi_ump_sysex7_status_t)((packet[0] >> 20) & 0x0F);
+    size_t length = (packet[0] >> 16) & 0x0F;
+    const uint8_t data[MIDI_UMP_SYSEX7_BYTES] = {
+        (uint8_t)(packet[0] >> 8), (uint8_t)packet[0],
+        (uint8_t)(packet[1] >> 24), (uint8_t)(packet[1] >> 16),
+        (uint8_t)(packet[1] >> 8), (uint8_t)packet[1],
+    };
+    size_t count = 0;
+
+    if (status > MIDI_UMP_SYSEX7_END) { return 0; }
+    if (length > MIDI_UMP_SYSEX7_BYTES) { length = MIDI_UMP_SYSEX7_BYTES; }
+
+    if (status == MIDI_UMP_SYSEX7_COMPLETE
+        || status == MIDI_UMP_SYSEX7_START) {
+        bytes[count++] = MIDI_MESSAGE_SYSTEM_EXCLUSIVE;
+        midi_encoder_reset(encoder);
+    }
+    for (size_t i = 0; i < length; i++) {
+        bytes[count++] = data[i] & 0x7F;
+    }
+    if (status == MIDI_UMP_SYSEX7_COMPLETE
+        || status == MIDI_UMP_SYSEX7_END) {
+        bytes[count++] = MIDI_MESSAGE_END_OF_EXCLUSIVE;
+    }
+    return count;
+}
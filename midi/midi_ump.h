@@ -0,0 +1,451 @@
+/**********************************************************************
+ * @file midi_ump.h
+ * @brief MIDI 1.0 to Universal MIDI Packet translation module
+ *
+ * @details This module translates between the messages of the parser
+ *          and the Universal MIDI Packets (UMP) of MIDI 2.0, in batches
+ *          over arrays of 32-bit words:
+ *          - Channel Voice messages become Message Type 2 (MIDI 1.0
+ *            Channel Voice) packets, or Message Type 4 (MIDI 2.0 Channel
+ *            Voice) packets with their values upscaled
+ *          - System Common and System Real-Time messages become Message
+ *            Type 1 packets
+ *          - System Exclusive payloads become Message Type 3 (7-bit
+ *            Data) packets
+ *          - With Message Type 4, Registered and Non-Registered
+ *            Parameter Number changes become Registered and Assignable
+ *            Controllers, and Bank Select is sent with Program Change
+ *
+ *          The reverse translation downscales Message Type 4 packets and
+ *          sends Registered and Assignable Controllers as the Control
+ *          Change messages that select and change the parameter.
+ *
+ *          Values are upscaled with the Min-Center-Max algorithm of the
+ *          UMP specification, which maps 0, the center value and the
+ *          maximum value exactly and repeats the lower bits above the
+ *          center. Downscaling drops the lower bits, so a 7-bit or
+ *          14-bit value round trips unchanged.
+ *
+ * @see Universal MIDI Packet (UMP) Format and MIDI 2.0 Protocol (M2-104)
+ **********************************************************************/
+
+#ifndef MIDI_UMP_H
+#define MIDI_UMP_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+#include "midi_encoder.h"
+#include "midi_param.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Number of groups of a UMP stream
+ */
+#define MIDI_UMP_GROUPS (16)
+
+/**
+ * @brief Largest number of words written for one MIDI 1.0 message
+ */
+#define MIDI_UMP_MAX_WORDS (2)
+
+/**
+ * @brief Largest number of MIDI 1.0 messages written for one packet
+ * @details A Registered Controller needs the four Control Change
+ *          messages that select the parameter and set its value
+ */
+#define MIDI_UMP_MAX_MESSAGES (4)
+
+/**
+ * @brief Number of SysEx payload bytes of a Message Type 3 packet
+ */
+#define MIDI_UMP_SYSEX7_BYTES (6)
+
+/**
+ * @brief Number of words of the Message Type 3 packets of a complete
+ *        System Exclusive message
+ * @param length The number of payload bytes, excluding the Start and End
+ *      of Exclusive status bytes
+ */
+#define MIDI_UMP_SYSEX7_WORDS(length)                                     \
+    ((length) == 0 ? (size_t)2                                            \
+                   : ((size_t)(length) + MIDI_UMP_SYSEX7_BYTES - 1)       \
+                         / MIDI_UMP_SYSEX7_BYTES * 2)
+
+/**
+ * @brief Option flag of a MIDI 2.0 Program Change that carries a bank
+ */
+#define MIDI_UMP_PROGRAM_BANK_VALID (0x01)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief UMP Message Types
+ * @details The most significant nibble of the first word of a packet
+ */
+typedef enum midi_ump_type_t {
+    MIDI_UMP_TYPE_UTILITY = 0x0,
+    MIDI_UMP_TYPE_SYSTEM = 0x1,
+    MIDI_UMP_TYPE_MIDI1_CHANNEL_VOICE = 0x2,
+    MIDI_UMP_TYPE_DATA_64 = 0x3,
+    MIDI_UMP_TYPE_MIDI2_CHANNEL_VOICE = 0x4,
+    MIDI_UMP_TYPE_DATA_128 = 0x5,
+} midi_ump_type_t;
+
+/**
+ * @brief MIDI 2.0 Channel Voice Statuses
+ * @details The status nibble of a Message Type 4 packet. The statuses
+ *          shared with MIDI 1.0 have the same values as the high nibble
+ *          of their MIDI 1.0 status byte.
+ */
+typedef enum midi_ump_status_t {
+    MIDI_UMP_STATUS_REGISTERED_PER_NOTE = 0x0,
+    MIDI_UMP_STATUS_ASSIGNABLE_PER_NOTE = 0x1,
+    MIDI_UMP_STATUS_REGISTERED_CONTROLLER = 0x2,
+    MIDI_UMP_STATUS_ASSIGNABLE_CONTROLLER = 0x3,
+    MIDI_UMP_STATUS_RELATIVE_REGISTERED = 0x4,
+    MIDI_UMP_STATUS_RELATIVE_ASSIGNABLE = 0x5,
+    MIDI_UMP_STATUS_PER_NOTE_PITCH_BEND = 0x6,
+    MIDI_UMP_STATUS_NOTE_OFF = 0x8,
+    MIDI_UMP_STATUS_NOTE_ON = 0x9,
+    MIDI_UMP_STATUS_KEY_PRESSURE = 0xA,
+    MIDI_UMP_STATUS_CONTROL_CHANGE = 0xB,
+    MIDI_UMP_STATUS_PROGRAM_CHANGE = 0xC,
+    MIDI_UMP_STATUS_CHANNEL_PRESSURE = 0xD,
+    MIDI_UMP_STATUS_PITCH_BEND = 0xE,
+    MIDI_UMP_STATUS_PER_NOTE_MANAGEMENT = 0xF,
+} midi_ump_status_t;
+
+/**
+ * @brief Message Type 3 Statuses
+ * @details Where a packet lies in its System Exclusive message
+ */
+typedef enum midi_ump_sysex7_status_t {
+    MIDI_UMP_SYSEX7_COMPLETE = 0x0,
+    MIDI_UMP_SYSEX7_START = 0x1,
+    MIDI_UMP_SYSEX7_CONTINUE = 0x2,
+    MIDI_UMP_SYSEX7_END = 0x3,
+} midi_ump_sysex7_status_t;
+
+/**
+ * @brief Channel Voice Protocol
+ * @details The message type Channel Voice messages are translated to
+ */
+typedef enum midi_ump_protocol_t {
+    /**
+     * @brief Message Type 2, the MIDI 1.0 messages unchanged
+     */
+    MIDI_UMP_PROTOCOL_MIDI1 = 0,
+
+    /**
+     * @brief Message Type 4, with upscaled values
+     */
+    MIDI_UMP_PROTOCOL_MIDI2 = 1,
+} midi_ump_protocol_t;
+
+/**
+ * @brief MIDI 1.0 to UMP Translator
+ * @note The fields of this struct should not be accessed directly.
+ *       Use the `midi_ump_*` functions.
+ */
+typedef struct midi_ump_encoder_t {
+    /**
+     * @brief Assembles the parameter changes, for Message Type 4
+     */
+    midi_param_decoder_t param;
+
+    /**
+     * @brief The group of the packets
+     */
+    uint8_t group;
+
+    /**
+     * @brief The message type of Channel Voice messages
+     */
+    midi_ump_protocol_t protocol;
+
+    /**
+     * @brief The Bank Select MSB and LSB of each channel
+     */
+    uint8_t bank_msb[16];
+    uint8_t bank_lsb[16];
+
+    /**
+     * @brief Bit n set once a bank has been selected on channel n
+     */
+    uint16_t bank_valid;
+
+    /**
+     * @brief Non-zero once a packet of the current SysEx was written
+     */
+    uint8_t sysex_sent;
+
+    /**
+     * @brief The SysEx payload bytes held back for the next packet
+     * @details The last packet of a message can only be written once
+     *          its end is known
+     */
+    uint8_t sysex_length;
+    uint8_t sysex_bytes[MIDI_UMP_SYSEX7_BYTES];
+} midi_ump_encoder_t;
+
+/**
+ * @brief UMP to MIDI 1.0 Translator
+ * @note The fields of this struct should not be accessed directly.
+ *       Use the `midi_ump_*` functions.
+ */
+typedef struct midi_ump_decoder_t {
+    /**
+     * @brief The parameter last selected on each group and channel
+     * @details Lets consecutive changes of the same parameter skip the
+     *          selection messages
+     */
+    uint16_t selected[MIDI_UMP_GROUPS * 16];
+
+    /**
+     * @brief Encodes the messages of midi_ump_to_bytes
+     */
+    midi_encoder_t encoder;
+} midi_ump_decoder_t;
+
+/*=====================================================================*
+    Public Inline Functions
+ *=====================================================================*/
+
+/**
+ * @brief Get the message type of a packet
+ * @param [in] word The first word of the packet
+ * @return The message type
+ */
+static inline midi_ump_type_t midi_ump_packet_type(uint32_t word)
+{
+    return (midi_ump_type_t)(word >> 28);
+}
+
+/**
+ * @brief Get the group of a packet
+ * @param [in] word The first word of the packet
+ * @return The group (0-15)
+ */
+static inline uint8_t midi_ump_packet_group(uint32_t word)
+{
+    return (uint8_t)((word >> 24) & 0x0F);
+}
+
+/**
+ * @brief Get the number of words of a packet
+ * @details Looks the message type up in a table of two bits per type,
+ *          holding the size minus one, so that unknown message types
+ *          can be skipped
+ * @param [in] word The first word of the packet
+ * @return The number of words (1-4)
+ */
+static inline size_t midi_ump_packet_words(uint32_t word)
+{
+    return (size_t)((0xFE950D40u >> ((word >> 28) * 2)) & 0x03) + 1;
+}
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Upscale a 7-bit value to 16 bits
+ * @param [in] value The 7-bit value
+ * @return The 16-bit value
+ */
+uint16_t midi_ump_scale_7_to_16(uint8_t value);
+
+/**
+ * @brief Upscale a 7-bit value to 32 bits
+ * @param [in] value The 7-bit value
+ * @return The 32-bit value
+ */
+uint32_t midi_ump_scale_7_to_32(uint8_t value);
+
+/**
+ * @brief Upscale a 14-bit value to 32 bits
+ * @param [in] value The 14-bit value
+ * @return The 32-bit value
+ */
+uint32_t midi_ump_scale_14_to_32(uint16_t value);
+
+/**
+ * @brief Initialize a MIDI 1.0 to UMP translator
+ * @details No bank is selected, and no SysEx is in progress
+ * @param [out] encoder Pointer to a midi_ump_encoder_t struct
+ * @param [in] group The group of the packets (0-15)
+ * @param [in] protocol The message type of Channel Voice messages
+ */
+void midi_ump_encoder_init(midi_ump_encoder_t *encoder,
+                           uint8_t group,
+                           midi_ump_protocol_t protocol);
+
+/**
+ * @brief Reset a MIDI 1.0 to UMP translator
+ * @details Deselects every bank and parameter and drops any SysEx in
+ *          progress, keeping the group and protocol
+ * @param [in,out] encoder Pointer to a midi_ump_encoder_t struct
+ */
+void midi_ump_encoder_reset(midi_ump_encoder_t *encoder);
+
+/**
+ * @brief Translate packed MIDI 1.0 messages into packets
+ * @details Translates messages until every message is translated or the
+ *          word array is full. With MIDI_UMP_PROTOCOL_MIDI2:
+ *          - Note On with velocity 0 becomes Note Off with the default
+ *            release velocity of 64
+ *          - Bank Select is held and sent with the next Program Change
+ *          - The parameter selection and Data Entry, Increment and
+ *            Decrement controllers become Registered and Assignable
+ *            Controllers, absolute and relative, on every Data Entry
+ *            MSB and LSB
+ *          System Exclusive, End of Exclusive and MIDI_MESSAGE_NONE are
+ *          skipped. Use midi_ump_from_sysex_span for the payload.
+ * @param [in,out] encoder Pointer to a midi_ump_encoder_t struct
+ * @param [in] packed Pointer to the packed messages to translate
+ * @param [in] count The number of packed messages
+ * @param [out] words Pointer to the array that receives the packets
+ * @param [in] capacity The number of entries in the words array
+ * @param [out] consumed Optional pointer that receives the number of
+ *      messages that were translated or skipped. May be NULL.
+ * @return The number of words written
+ * @note The remaining messages (from packed + *consumed) should be passed
+ *       to the next call
+ */
+size_t midi_ump_from_packed(midi_ump_encoder_t *encoder,
+                            const midi_packed_t *packed,
+                            size_t count,
+                            uint32_t *words,
+                            size_t capacity,
+                            size_t *consumed);
+
+/**
+ * @brief Translate a SysEx span into Message Type 3 packets
+ * @details Meant to be called from the SysEx handler of the parser.
+ *          Full packets are written as soon as they are known not to be
+ *          the last of the message, and the remaining bytes are held
+ *          until the span that ends it. A message that was aborted ends
+ *          after its last payload byte.
+ * @param [in,out] encoder Pointer to a midi_ump_encoder_t struct
+ * @param [in] span Pointer to the span
+ * @param [out] words Pointer to the array that receives the packets
+ * @param [in] capacity The number of entries in the words array, at least
+ *      MIDI_UMP_SYSEX7_WORDS(span->length + MIDI_UMP_SYSEX7_BYTES)
+ * @return The number of words written, or 0 if they do not fit, in which
+ *      case the span is dropped
+ */
+size_t midi_ump_from_sysex_span(midi_ump_encoder_t *encoder,
+                                const midi_sysex_span_t *span,
+                                uint32_t *words,
+                                size_t capacity);
+
+/**
+ * @brief Translate a complete System Exclusive message into Message
+ *        Type 3 packets
+ * @param [in] group The group of the packets (0-15)
+ * @param [in] payload Pointer to the payload bytes, excluding the Start
+ *      and End of Exclusive status bytes. May be NULL if length is 0.
+ * @param [in] length The number of payload bytes
+ * @param [out] words Pointer to the array that receives the packets
+ * @param [in] capacity The number of entries in the words array
+ * @return The number of words written (MIDI_UMP_SYSEX7_WORDS(length)), or
+ *      0 if they do not fit, the group is invalid or the payload
+ *      contains a status byte
+ */
+size_t midi_ump_from_sysex(uint8_t group,
+                           const uint8_t *payload,
+                           size_t length,
+                           uint32_t *words,
+                           size_t capacity);
+
+/**
+ * @brief Initialize a UMP to MIDI 1.0 translator
+ * @details No parameter is selected and running status is enabled
+ * @param [out] decoder Pointer to a midi_ump_decoder_t struct
+ */
+void midi_ump_decoder_init(midi_ump_decoder_t *decoder);
+
+/**
+ * @brief Reset a UMP to MIDI 1.0 translator
+ * @details Forgets the selected parameters, so that the next change of
+ *          each sends its selection again, and clears running status
+ * @param [in,out] decoder Pointer to a midi_ump_decoder_t struct
+ */
+void midi_ump_decoder_reset(midi_ump_decoder_t *decoder);
+
+/**
+ * @brief Enable or disable running status in midi_ump_to_bytes
+ * @param [in,out] decoder Pointer to a midi_ump_decoder_t struct
+ * @param [in] enabled Non-zero to leave out repeated status bytes
+ */
+void midi_ump_decoder_set_running_status(midi_ump_decoder_t *decoder,
+                                         int enabled);
+
+/**
+ * @brief Translate packets into packed MIDI 1.0 messages
+ * @details Translates packets until every packet is translated or the
+ *          message array is full. Message Type 4 values are downscaled,
+ *          and a Note On whose velocity downscales to 0 is sent with
+ *          velocity 1. Program Change with a bank is preceded by Bank
+ *          Select, and Registered and Assignable Controllers by the
+ *          selection of their parameter when it changed. Packets with
+ *          no MIDI 1.0 equivalent (per-note controllers and management,
+ *          Utility, Data and unknown message types) are skipped, as are
+ *          Message Type 3 packets (use midi_ump_to_bytes).
+ * @param [in,out] decoder Pointer to a midi_ump_decoder_t struct
+ * @param [in] words Pointer to the packets to translate
+ * @param [in] count The number of words
+ * @param [out] groups Optional pointer to an array that receives the
+ *      group of each message. May be NULL.
+ * @param [out] messages Pointer to an array that receives the messages
+ * @param [in] capacity The number of entries in the groups and messages
+ *      arrays
+ * @param [out] consumed Optional pointer that receives the number of
+ *      words that were translated or skipped. May be NULL.
+ * @return The number of messages written
+ * @note The remaining words (from words + *consumed), including a packet
+ *       cut short by the end of the array, should be passed to the next
+ *       call
+ */
+size_t midi_ump_to_packed(midi_ump_decoder_t *decoder,
+                          const uint32_t *words,
+                          size_t count,
+                          uint8_t *groups,
+                          midi_packed_t *messages,
+                          size_t capacity,
+                          size_t *consumed);
+
+/**
+ * @brief Translate packets into a MIDI 1.0 byte stream
+ * @details Translates the packets as midi_ump_to_packed does and encodes
+ *          the messages, including System Exclusive from Message Type 3
+ *          packets, with the encoder of the translator. The packets of
+ *          every group are merged into one stream.
+ * @param [in,out] decoder Pointer to a midi_ump_decoder_t struct
+ * @param [in] words Pointer to the packets to translate
+ * @param [in] count The number of words
+ * @param [out] bytes Pointer to the buffer that receives the bytes
+ * @param [in] capacity The size of the buffer in bytes
+ * @param [out] consumed Optional pointer that receives the number of
+ *      words that were translated or skipped. May be NULL.
+ * @return The number of bytes written
+ * @note A packet is only translated when all of its bytes fit
+ */
+size_t midi_ump_to_bytes(midi_ump_decoder_t *decoder,
+                         const uint32_t *words,
+                         size_t count,
+                         uint8_t *bytes,
+                         size_t capacity,
+                         size_t *consumed);
+
+#endif /* MIDI_UMP_H */
@@ -0,0 +1,757 @@
+/***********************************************************************
+ * @file midi_usb.c
+ * @brief USB-MIDI 1.0 event packet implementation
+ *
+ * @details Looks up the Code Index Number of each packet in a 16-entry
+ *          table that gives the number of MIDI bytes and how to decode
+ *          them. Framed messages are checked against the parser filters
+ *          and decoded with midi_decode_message. SysEx payload bytes of
+ *          consecutive packets of a cable are collected into one span,
+ *          with the span flags kept in the state of the cable.
+ *
+ * @see Universal Serial Bus Device Class Definition for MIDI Devices,
+ *      Release 1.0
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_usb.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+#include "midi_encoder.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Mask of the status bit of a MIDI byte
+ */
+#define USB_STATUS_BIT (0x80)
+
+/**
+ * @brief Mask of the high nibble of a status byte
+ */
+#define USB_STATUS_CLASS_MASK (0xF0)
+
+/**
+ * @brief Status class of System messages
+ */
+#define USB_STATUS_SYSTEM (0xF0)
+
+/**
+ * @brief Largest cable number
+ */
+#define USB_MAX_CABLE (0x0F)
+
+/**
+ * @brief Mask that accepts every cable
+ */
+#define USB_ALL_CABLES_MASK (0xFFFF)
+
+/*=====================================================================*
+    Private Data Types
+ *=====================================================================*/
+
+/**
+ * @brief How the MIDI bytes of a packet are decoded
+ */
+typedef enum cin_kind_t {
+    /**
+     * @brief Reserved, the packet is skipped
+     */
+    CIN_KIND_RESERVED,
+
+    /**
+     * @brief A whole message whose status class is given by the CIN
+     */
+    CIN_KIND_MESSAGE,
+
+    /**
+     * @brief SysEx bytes
+     */
+    CIN_KIND_SYSEX,
+
+    /**
+     * @brief SysEx bytes, or a single-byte message
+     */
+    CIN_KIND_SYSEX_OR_MESSAGE,
+
+    /**
+     * @brief A single byte, passed to the parser
+     */
+    CIN_KIND_SINGLE_BYTE,
+} cin_kind_t;
+
+/**
+ * @brief Code Index Number Descriptor
+ */
+typedef struct cin_descriptor_t {
+    /**
+     * @brief The number of MIDI bytes in the packet
+     */
+    uint8_t length;
+
+    /**
+     * @brief One of the cin_kind_t values
+     */
+    uint8_t kind;
+
+    /**
+     * @brief The high nibble of the status byte of a message
+     */
+    uint8_t status_class;
+} cin_descriptor_t;
+
+/**
+ * @brief SysEx Span Collector
+ * @details Payload bytes of consecutive SysEx packets of one cable
+ */
+typedef struct usb_span_t {
+    uint8_t data[MIDI_USB_SPAN_SIZE];
+    size_t length;
+    uint8_t cable;
+} usb_span_t;
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static inline int is_sysex_byte(uint8_t byte);
+
+static inline size_t count_sysex_messages(const uint8_t *bytes,
+                                          size_t length);
+
+static inline void emit_message(uint8_t cable,
+                                midi_packed_t message,
+                                uint8_t *cables,
+                                midi_packed_t *messages,
+                                size_t *count);
+
+static void flush_span(midi_usb_decoder_t *decoder,
+                       usb_span_t *span,
+                       uint8_t end_flags);
+
+static void end_sysex(midi_usb_decoder_t *decoder,
+                      usb_span_t *span,
+                      uint8_t cable,
+                      uint8_t end_flags);
+
+static void decode_message_bytes(midi_usb_decoder_t *decoder,
+                                 usb_span_t *span,
+                                 uint8_t cable,
+                                 const uint8_t *bytes,
+                                 size_t offset,
+                                 uint8_t *cables,
+                                 midi_packed_t *messages,
+                                 size_t *count);
+
+static void decode_sysex_bytes(midi_usb_decoder_t *decoder,
+                               usb_span_t *span,
+                               uint8_t cable,
+                               const uint8_t *bytes,
+                               size_t length,
+                               uint8_t *cables,
+                               midi_packed_t *messages,
+                               size_t *count);
+
+static void decode_single_byte(midi_usb_decoder_t *decoder,
+                               usb_span_t *span,
+                               uint8_t cable,
+                               uint8_t byte,
+                               uint8_t *cables,
+                               midi_packed_t *messages,
+                               size_t *count);
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+
+/**
+ * @brief Code Index Number Table
+ * @details Indexed by the Code Index Number of a packet
+ */
+static const cin_descriptor_t cin_descriptors[16] = {
+    {0, CIN_KIND_RESERVED, 0},                         /* 0x0 Misc */
+    {0, CIN_KIND_RESERVED, 0},                         /* 0x1 Cable event */
+    {2, CIN_KIND_MESSAGE, USB_STATUS_SYSTEM},          /* 0x2 Common */
+    {3, CIN_KIND_MESSAGE, USB_STATUS_SYSTEM},          /* 0x3 Common */
+    {3, CIN_KIND_SYSEX, 0},                            /* 0x4 SysEx */
+    {1, CIN_KIND_SYSEX_OR_MESSAGE, USB_STATUS_SYSTEM}, /* 0x5 SysEx end */
+    {2, CIN_KIND_SYSEX, 0},                            /* 0x6 SysEx end */
+    {3, CIN_KIND_SYSEX, 0},                            /* 0x7 SysEx end */
+    {3, CIN_KIND_MESSAGE, MIDI_MESSAGE_NOTE_OFF},
+    {3, CIN_KIND_MESSAGE, MIDI_MESSAGE_NOTE_ON},
+    {3, CIN_KIND_MESSAGE, MIDI_MESSAGE_KEY_PRESSURE},
+    {3, CIN_KIND_MESSAGE, MIDI_MESSAGE_CONTROL_CHANGE},
+    {2, CIN_KIND_MESSAGE, MIDI_MESSAGE_PROGRAM_CHANGE},
+    {2, CIN_KIND_MESSAGE, MIDI_MESSAGE_CHANNEL_PRESSURE},
+    {3, CIN_KIND_MESSAGE, MIDI_MESSAGE_PITCH_BEND},
+    {1, CIN_KIND_SINGLE_BYTE, 0}, /* 0xF Single byte */
+};
+
+/**
+ * @brief Code Index Numbers of System status bytes
+ * @details Indexed by the low nibble of the status byte. Zero for the
+ *          status bytes that are not sent as a message of their own.
+ */
+static const uint8_t system_cins[16] = {
+    0,                            /* 0xF0 Start of Exclusive */
+    MIDI_USB_CIN_SYSTEM_COMMON_2, /* 0xF1 MTC Quarter Frame */
+    MIDI_USB_CIN_SYSTEM_COMMON_3, /* 0xF2 Song Position Pointer */
+    MIDI_USB_CIN_SYSTEM_COMMON_2, /* 0xF3 Song Select */
+    0,                            /* 0xF4 Undefined */
+    0,                            /* 0xF5 Undefined */
+    MIDI_USB_CIN_SYSEX_END_1,     /* 0xF6 Tune Request */
+    0,                            /* 0xF7 End of Exclusive */
+    MIDI_USB_CIN_SINGLE_BYTE,     /* 0xF8 - 0xFF System Real-Time */
+    MIDI_USB_CIN_SINGLE_BYTE,
+    MIDI_USB_CIN_SINGLE_BYTE,
+    MIDI_USB_CIN_SINGLE_BYTE,
+    MIDI_USB_CIN_SINGLE_BYTE,
+    MIDI_USB_CIN_SINGLE_BYTE,
+    MIDI_USB_CIN_SINGLE_BYTE,
+    MIDI_USB_CIN_SINGLE_BYTE,
+};
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a USB-MIDI decoder
+ * @param [out] decoder Pointer to a midi_usb_decoder_t struct
+ * @param [in] config Pointer to a parser to copy the configuration of,
+ *      or NULL
+ */
+void midi_usb_decoder_init(midi_usb_decoder_t *decoder,
+                           const midi_parser_t *config)
+{
+    /* Check for NULL pointers */
+    if (decoder == NULL) { return; }
+
+    if (config != NULL) {
+        decoder->parser = *config;
+    } else {
+        midi_parser_init(&decoder->parser);
+    }
+    decoder->cable_mask = USB_ALL_CABLES_MASK;
+    midi_usb_decoder_reset(decoder);
+}
+
+/**
+ * @brief Reset the state of every cable of a USB-MIDI decoder
+ * @param [in,out] decoder Pointer to a midi_usb_decoder_t struct
+ */
+void midi_usb_decoder_reset(midi_usb_decoder_t *decoder)
+{
+    /* Check for NULL pointers */
+    if (decoder == NULL) { return; }
+
+    midi_parser_reset(&decoder->parser);
+    for (size_t c = 0; c < MIDI_USB_CABLES; c++) {
+        midi_parser_save_state(&decoder->parser, &decoder->cables[c]);
+    }
+    decoder->current_cable = 0;
+}
+
+/**
+ * @brief Set the cables a USB-MIDI decoder accepts
+ * @param [in,out] decoder Pointer to a midi_usb_decoder_t struct
+ * @param [in] mask Bit n set to accept the packets of cable n
+ */
+void midi_usb_decoder_set_cable_mask(midi_usb_decoder_t *decoder,
+                                     uint16_t mask)
+{
+    /* Check for NULL pointers */
+    if (decoder == NULL) { return; }
+
+    decoder->cable_mask = mask;
+}
+
+/**
+ * @brief Decode USB-MIDI event packets
+ * @param [in,out] decoder Pointer to a midi_usb_decoder_t struct
+ * @param [in] packets Pointer to the packets to decode
+ * @param [in] count The number of packets
+ * @param [out] cables Optional pointer to the cable of each message
+ * @param [out] messages Pointer to an array that receives the messages
+ * @param [in] capacity The number of entries in the output arrays
+ * @param [out] consumed Optional pointer that receives the number of
+ *      packets that were decoded
+ * @return The number of messages written
+ */
+size_t midi_usb_decode(midi_usb_decoder_t *decoder,
+                       const midi_usb_packet_t *packets,
+                       size_t count,
+                       uint8_t *cables,
+                       midi_packed_t *messages,
+                       size_t capacity,
+                       size_t *consumed)
+{
+    /* Check for NULL pointers */
+    if (decoder == NULL || packets == NULL || messages == NULL) {
+        if (consumed != NULL) { *consumed = 0; }
+        return 0;
+    }
+
+    usb_span_t span;
+    size_t total = 0;
+    size_t index = 0;
+
+    span.length = 0;
+    span.cable = 0;
+
+    for (; index < count; index++) {
+        const midi_usb_packet_t packet = packets[index];
+        const uint8_t cable = midi_usb_packet_cable(packet);
+        const cin_descriptor_t descriptor =
+            cin_descriptors[midi_usb_packet_cin(packet)];
+        const uint8_t bytes[3] = {
+            (uint8_t)(packet >> 16), (uint8_t)(packet >> 8), (uint8_t)packet};
+
+        if (!((decoder->cable_mask >> cable) & 1)) { continue; }
+
+        /* CIN 0x5 is SysEx unless it holds a single-byte message */
+        uint8_t kind = descriptor.kind;
+        if (kind == CIN_KIND_SYSEX_OR_MESSAGE) {
+            kind = is_sysex_byte(bytes[0]) ? CIN_KIND_SYSEX
+                                           : CIN_KIND_MESSAGE;
+        }
+
+        /* Stop before a packet whose messages may not fit */
+        const size_t needed =
+            kind == CIN_KIND_SYSEX
+                ? count_sysex_messages(bytes, descriptor.length)
+                : (kind != CIN_KIND_RESERVED);
+        if (needed > capacity - total) { break; }
+
+        switch (kind) {
+        case CIN_KIND_MESSAGE:
+            /* The status byte must match the CIN and the length */
+            if ((bytes[0] & USB_STATUS_CLASS_MASK) == descriptor.status_class
+                && !is_sysex_byte(bytes[0])
+                && midi_status_data_length(bytes[0]) + 1
+                       == descriptor.length) {
+                decode_message_bytes(decoder, &span, cable, bytes, index,
+                                     cables, messages, &total);
+            }
+            break;
+        case CIN_KIND_SYSEX:
+            decode_sysex_bytes(decoder, &span, cable, bytes,
+                               descriptor.length, cables, messages, &total);
+            break;
+        case CIN_KIND_SINGLE_BYTE:
+            if (bytes[0] >= MIDI_MESSAGE_TIMING_CLOCK) {
+                decode_message_bytes(decoder, &span, cable, bytes, index,
+                                     cables, messages, &total);
+            } else {
+                decode_single_byte(decoder, &span, cable, bytes[0], cables,
+                                   messages, &total);
+            }
+            break;
+        default:
+            /* Reserved Code Index Numbers */
+            break;
+        }
+    }
+
+    flush_span(decoder, &span, 0);
+    if (consumed != NULL) { *consumed = index; }
+    return total;
+}
+
+/**
+ * @brief Encode packed MIDI messages into USB-MIDI event packets
+ * @param [in] cable The cable number (0-15)
+ * @param [in] packed Pointer to the packed messages to encode
+ * @param [in] count The number of packed messages
+ * @param [out] packets Pointer to the array that receives the packets
+ * @param [in] capacity The number of entries in the packets array
+ * @param [out] encoded Optional pointer that receives the number of
+ *      messages that were encoded or skipped
+ * @return The number of packets written
+ */
+size_t midi_usb_encode_packed(uint8_t cable,
+                              const midi_packed_t *packed,
+                              size_t count,
+                              midi_usb_packet_t *packets,
+                              size_t capacity,
+                              size_t *encoded)
+{
+    /* Check for NULL pointers */
+    if (packed == NULL || packets == NULL || cable > USB_MAX_CABLE) {
+        if (encoded != NULL) { *encoded = 0; }
+        return 0;
+    }
+
+    /* Each packet carries its own status byte */
+    midi_encoder_t encoder;
+    midi_encoder_init(&encoder);
+    midi_encoder_set_running_status(&encoder, 0);
+
+    size_t written = 0;
+    size_t index = 0;
+
+    for (; index < count && written < capacity; index++) {
+        uint8_t bytes[MIDI_ENCODER_MAX_MESSAGE_SIZE] = {0};
+        const size_t length = midi_encode_packed(
+            &encoder, &packed[index], 1, bytes, sizeof(bytes), NULL);
+        if (length == 0) { continue; }
+
+        const uint8_t cin = (bytes[0] & USB_STATUS_CLASS_MASK)
+                                    == USB_STATUS_SYSTEM
+                                ? system_cins[bytes[0] & 0x0F]
+                                : (uint8_t)(bytes[0] >> 4);
+        if (cin == 0) { continue; }
+
+        packets[written++] = midi_usb_packet_make(
+            cable, (midi_usb_cin_t)cin, bytes[0], bytes[1], bytes[2]);
+    }
+
+    if (encoded != NULL) { *encoded = index; }
+    return written;
+}
+
+/**
+ * @brief Encode a complete System Exclusive message into USB-MIDI event
+ *        packets
+ * @param [in] cable The cable number (0-15)
+ * @param [in] payload Pointer to the payload bytes, or NULL if length is 0
+ * @param [in] length The number of payload bytes
+ * @param [out] packets Pointer to the array that receives the packets
+ * @param [in] capacity The number of entries in the packets array
+ * @return The number of packets written, or 0 on failure
+ */
+size_t midi_usb_encode_sysex(uint8_t cable,
+                             const uint8_t *payload,
+                             size_t length,
+                             midi_usb_packet_t *packets,
+                             size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (packets == NULL || (payload == NULL && length > 0)
+        || cable > USB_MAX_CABLE) {
+        return 0;
+    }
+
+    const size_t needed = MIDI_USB_SYSEX_PACKETS(length);
+    if (needed > capacity) { return 0; }
+    for (size_t i = 0; i < length; i++) {
+        if (payload[i] & USB_STATUS_BIT) { return 0; }
+    }
+
+    /* Index 0 is Start of Exclusive and length + 1 End of Exclusive */
+    const size_t total = length + 2;
+    size_t position = 0;
+
+    for (size_t p = 0; p < needed; p++) {
+        uint8_t bytes[3] = {0};
+        const size_t remaining = total - position;
+        const size_t used = remaining > 3 ? 3 : remaining;
+
+        for (size_t b = 0; b < used; b++, position++) {
+            if (position == 0) {
+                bytes[b] = MIDI_MESSAGE_SYSTEM_EXCLUSIVE;
+            } else if (position == total - 1) {
+                bytes[b] = MIDI_MESSAGE_END_OF_EXCLUSIVE;
+            } else {
+                bytes[b] = payload[position - 1];
+            }
+        }
+
+        const midi_usb_cin_t cin =
+            remaining > 3 ? MIDI_USB_CIN_SYSEX_START
+                          : (midi_usb_cin_t)(MIDI_USB_CIN_SYSEX_START + used);
+        packets[p] =
+            midi_usb_packet_make(cable, cin, bytes[0], bytes[1], bytes[2]);
+    }
+
+    return needed;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Check whether a byte may appear in a SysEx packet: a data byte,
+ *        Start of Exclusive or End of Exclusive
+ */
+static inline int is_sysex_byte(uint8_t byte)
+{
+    return !(byte & USB_STATUS_BIT) || byte == MIDI_MESSAGE_SYSTEM_EXCLUSIVE
+           || byte == MIDI_MESSAGE_END_OF_EXCLUSIVE;
+}
+
+/**
+ * @brief Count the Start and End of Exclusive bytes of a SysEx packet,
+ *        which each return a message
+ */
+static inline size_t count_sysex_messages(const uint8_t *bytes,
+                                          size_t length)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        count += bytes[i] == MIDI_MESSAGE_SYSTEM_EXCLUSIVE
+                 || bytes[i] == MIDI_MESSAGE_END_OF_EXCLUSIVE;
+    }
+    return count;
+}
+
+/**
+ * @brief Write a message and its cable to the output arrays
+ */
+static inline void emit_message(uint8_t cable,
+                                midi_packed_t message,
+                                uint8_t *cables,
+                                midi_packed_t *messages,
+                                size_t *count)
+{
+    if (cables != NULL) { cables[*count] = cable; }
+    messages[(*count)++] = message;
+}
+
+/**
+ * @brief Deliver the collected SysEx payload bytes to the SysEx handler
+ * @details Flags the span as in deliver_sysex_span of the parser. Empty
+ *          spans are only delivered to mark the end of a payload.
+ * @param [in,out] decoder Pointer to a midi_usb_decoder_t struct
+ * @param [in,out] span Pointer to the collected bytes, emptied
+ * @param [in] end_flags MIDI_SYSEX_FLAG_END and MIDI_SYSEX_FLAG_ABORTED
+ *      to end the payload, or 0
+ */
+static void flush_span(midi_usb_decoder_t *decoder,
+                       usb_span_t *span,
+                       uint8_t end_flags)
+{
+    midi_parser_state_t *state = &decoder->cables[span->cable];
+    midi_sysex_span_t delivered;
+
+    if (decoder->parser.sysex_handler == NULL
+        || (span->length == 0 && end_flags == 0)) {
+        span->length = 0;
+        return;
+    }
+
+    delivered.data = span->data;
+    delivered.length = span->length;
+    delivered.flags = (uint8_t)(state->sysex_flags | end_flags);
+    if (!(delivered.flags & MIDI_SYSEX_FLAG_START)) {
+        delivered.flags |= MIDI_SYSEX_FLAG_CONTINUE;
+    }
+
+    decoder->current_cable = span->cable;
+    decoder->parser.sysex_handler(decoder->parser.sysex_context, &delivered);
+    state->sysex_flags = 0;
+    span->length = 0;
+}
+
+/**
+ * @brief End the SysEx payload of a cable
+ * @param [in,out] decoder Pointer to a midi_usb_decoder_t struct
+ * @param [in,out] span Pointer to the collected bytes
+ * @param [in] cable The cable whose payload ends
+ * @param [in] end_flags MIDI_SYSEX_FLAG_END, with MIDI_SYSEX_FLAG_ABORTED
+ *      if the payload was not ended by End of Exclusive
+ */
+static void end_sysex(midi_usb_decoder_t *decoder,
+                      usb_span_t *span,
+                      uint8_t cable,
+                      uint8_t end_flags)
+{
+    if (span->cable != cable) {
+        flush_span(decoder, span, 0);
+        span->cable = cable;
+    }
+    flush_span(decoder, span, end_flags);
+}
+
+/**
+ * @brief Decode a packet that frames a whole message
+ * @details System Real-Time messages keep the state of the cable. Other
+ *          messages abort a SysEx in progress and clear the running
+ *          status of single bytes.
+ * @param [in,out] decoder Pointer to a midi_usb_decoder_t struct
+ * @param [in,out] span Pointer to the collected SysEx bytes
+ * @param [in] cable The cable of the packet
+ * @param [in] bytes Pointer to the MIDI bytes of the packet
+ * @param [in] offset The index of the packet, for the realtime lane
+ * @param [out] cables Optional pointer to the cable of each message
+ * @param [out] messages Pointer to the output array
+ * @param [in,out] count The number of messages written
+ */
+static void decode_message_bytes(midi_usb_decoder_t *decoder,
+                                 usb_span_t *span,
+                                 uint8_t cable,
+                                 const uint8_t *bytes,
+                                 size_t offset,
+                                 uint8_t *cables,
+                                 midi_packed_t *messages,
+                                 size_t *count)
+{
+    const midi_parser_t *parser = &decoder->parser;
+    midi_parser_state_t *state = &decoder->cables[cable];
+    midi_message_t message;
+
+    /* Undefined status bytes are ignored */
+    if (midi_decode_message(bytes[0], bytes[1], bytes[2], &message)
+        == MIDI_MESSAGE_NONE) {
+        return;
+    }
+
+    if (bytes[0] < MIDI_MESSAGE_TIMING_CLOCK) {
+        if (state->message_type == MIDI_MESSAGE_SYSTEM_EXCLUSIVE) {
+            end_sysex(decoder, span, cable,
+                      MIDI_SYSEX_FLAG_END | MIDI_SYSEX_FLAG_ABORTED);
+        }
+        state->message_type = MIDI_MESSAGE_NONE;
+        state->channel = MIDI_CHANNEL_NONE;
+        state->byte_count = 0;
+    }
+
+    if (!midi_parser_accepts(parser, bytes[0], bytes[1], bytes[2])) {
+        return;
+    }
+
+    /* System Real-Time messages go straight to the realtime lane */
+    if (bytes[0] >= MIDI_MESSAGE_TIMING_CLOCK
+        && parser->realtime_handler != NULL) {
+        midi_realtime_event_t event;
+
+        flush_span(decoder, span, 0);
+        event.message_type = message.message_type;
+        event.timestamp = (parser->timestamp_source != NULL)
+                              ? parser->timestamp_source(
+                                    parser->realtime_context)
+                              : 0;
+        event.offset = offset;
+        decoder->current_cable = cable;
+        parser->realtime_handler(parser->realtime_context, &event);
+        return;
+    }
+
+    emit_message(cable, midi_message_pack(&message), cables, messages, count);
+}
+
+/**
+ * @brief Decode the bytes of a SysEx packet
+ * @details Start and End of Exclusive return their messages as in the
+ *          parser. Other status bytes are not valid in a SysEx packet
+ *          and are ignored.
+ * @param [in,out] decoder Pointer to a midi_usb_decoder_t struct
+ * @param [in,out] span Pointer to the collected SysEx bytes
+ * @param [in] cable The cable of the packet
+ * @param [in] bytes Pointer to the MIDI bytes of the packet
+ * @param [in] length The number of MIDI bytes
+ * @param [out] cables Optional pointer to the cable of each message
+ * @param [out] messages Pointer to the output array
+ * @param [in,out] count The number of messages written
+ */
+static void decode_sysex_bytes(midi_usb_decoder_t *decoder,
+                               usb_span_t *span,
+                               uint8_t cable,
+                               const uint8_t *bytes,
+                               size_t length,
+                               uint8_t *cables,
+                               midi_packed_t *messages,
+                               size_t *count)
+{
+    const midi_parser_t *parser = &decoder->parser;
+    midi_parser_state_t *state = &decoder->cables[cable];
+
+    for (size_t i = 0; i < length; i++) {
+        const uint8_t byte = bytes[i];
+
+        if (!(byte & USB_STATUS_BIT)) {
+            if (state->message_type != MIDI_MESSAGE_SYSTEM_EXCLUSIVE
+                || parser->sysex_handler == NULL) {
+                continue;
+            }
+            if (span->length > 0 && span->cable != cable) {
+                flush_span(decoder, span, 0);
+            }
+            if (span->length == MIDI_USB_SPAN_SIZE) {
+                flush_span(decoder, span, 0);
+            }
+            span->cable = cable;
+            span->data[span->length++] = byte;
+            continue;
+        }
+
+        if (byte != MIDI_MESSAGE_SYSTEM_EXCLUSIVE
+            && byte != MIDI_MESSAGE_END_OF_EXCLUSIVE) {
+            continue;
+        }
+
+        if (state->message_type == MIDI_MESSAGE_SYSTEM_EXCLUSIVE) {
+            end_sysex(decoder, span, cable,
+                      byte == MIDI_MESSAGE_END_OF_EXCLUSIVE
+                          ? MIDI_SYSEX_FLAG_END
+                          : MIDI_SYSEX_FLAG_END | MIDI_SYSEX_FLAG_ABORTED);
+        }
+
+        const int accepted = midi_parser_accepts(parser, byte, 0, 0);
+        state->message_type = MIDI_MESSAGE_NONE;
+        state->channel = MIDI_CHANNEL_NONE;
+        state->byte_count = 0;
+        if (byte == MIDI_MESSAGE_SYSTEM_EXCLUSIVE) {
+            state->sysex_flags = MIDI_SYSEX_FLAG_START;
+            if (accepted) {
+                state->message_type = MIDI_MESSAGE_SYSTEM_EXCLUSIVE;
+            }
+        }
+
+        if (accepted) {
+            emit_message(cable,
+                         midi_packed_make((midi_message_type_t)byte,
+                                          MIDI_CHANNEL_NONE, 0, 0),
+                         cables, messages, count);
+        }
+    }
+}
+
+/**
+ * @brief Parse the byte of a single byte packet with the state of its
+ *        cable
+ * @param [in,out] decoder Pointer to a midi_usb_decoder_t struct
+ * @param [in,out] span Pointer to the collected SysEx bytes
+ * @param [in] cable The cable of the packet
+ * @param [in] byte The byte
+ * @param [out] cables Optional pointer to the cable of each message
+ * @param [out] messages Pointer to the output array
+ * @param [in,out] count The number of messages written
+ */
+static void decode_single_byte(midi_usb_decoder_t *decoder,
+                               usb_span_t *span,
+                               uint8_t cable,
+                               uint8_t byte,
+                               uint8_t *cables,
+                               midi_packed_t *messages,
+                               size_t *count)
+{
+    /* The parser delivers its own SysEx spans */
+    flush_span(decoder, span, 0);
+
+    decoder->current_cable = cable;
+    midi_parser_restore_state(&decoder->parser, &decoder->cables[cable]);
+    const size_t parsed = midi_parse_buffer_packed(
+        &decoder->parser, &byte, 1, &messages[*count], 1, NULL);
+    midi_parser_save_state(&decoder->parser, &decoder->cables[cable]);
+
+    if (parsed > 0) {
+        if (cables != NULL) { cables[*count] = cable; }
+        (*count)++;
+    }
+}
@@ -0,0 +1,356 @@
+/**********************************************************************
+ * @file midi_usb.h
+ * @brief USB-MIDI 1.0 event packet module
+ *
+ * @details This module decodes and encodes the 32-bit event packets of
+ *          the USB Device Class Definition for MIDI Devices 1.0. Each
+ *          packet holds a Cable Number, a Code Index Number (CIN), which
+ *          gives the kind and length of the message, and up to three
+ *          MIDI bytes.
+ *
+ *          Since every packet frames a whole message, the decoder looks
+ *          up the CIN in a table and decodes the message directly,
+ *          without passing its bytes through the parser one at a time.
+ *          Only SysEx and single bytes (CIN 0xF) carry state from one
+ *          packet to the next, which is kept per cable.
+ *
+ *          A packet is held as a midi_usb_packet_t word with the header
+ *          byte in the most significant byte. Use midi_usb_packet_read
+ *          and midi_usb_packet_write to convert from and to the byte
+ *          order of the USB endpoint buffers.
+ *
+ * @see Universal Serial Bus Device Class Definition for MIDI Devices,
+ *      Release 1.0
+ **********************************************************************/
+
+#ifndef MIDI_USB_H
+#define MIDI_USB_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Number of virtual cables of a USB-MIDI endpoint
+ */
+#define MIDI_USB_CABLES (16)
+
+/**
+ * @brief Size of a USB-MIDI event packet, in bytes
+ */
+#define MIDI_USB_PACKET_SIZE (4)
+
+/**
+ * @brief Number of USB-MIDI event packets of a complete System Exclusive
+ *        message
+ * @param length The number of payload bytes, excluding the Start and End
+ *      of Exclusive status bytes
+ */
+#define MIDI_USB_SYSEX_PACKETS(length) (((size_t)(length) + 4) / 3)
+
+/**
+ * @brief Number of SysEx payload bytes the decoder collects into one span
+ * @details Consecutive SysEx packets of a cable are delivered to the
+ *          SysEx handler as a single span of up to this many bytes
+ */
+#define MIDI_USB_SPAN_SIZE (96)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief USB-MIDI Event Packet
+ * @details | Bits  | Field                      |
+ *          |-------|----------------------------|
+ *          | 31-28 | Cable Number               |
+ *          | 27-24 | Code Index Number          |
+ *          | 23-16 | MIDI byte 0                |
+ *          | 15-8  | MIDI byte 1                |
+ *          | 7-0   | MIDI byte 2                |
+ *
+ *          Unused MIDI bytes are zero.
+ */
+typedef uint32_t midi_usb_packet_t;
+
+/**
+ * @brief USB-MIDI Code Index Numbers
+ */
+typedef enum midi_usb_cin_t {
+    /**
+     * @brief Miscellaneous function codes, reserved
+     */
+    MIDI_USB_CIN_MISC = 0x0,
+
+    /**
+     * @brief Cable events, reserved
+     */
+    MIDI_USB_CIN_CABLE_EVENT = 0x1,
+
+    /**
+     * @brief Two-byte System Common message
+     */
+    MIDI_USB_CIN_SYSTEM_COMMON_2 = 0x2,
+
+    /**
+     * @brief Three-byte System Common message
+     */
+    MIDI_USB_CIN_SYSTEM_COMMON_3 = 0x3,
+
+    /**
+     * @brief SysEx starts or continues, with three bytes
+     */
+    MIDI_USB_CIN_SYSEX_START = 0x4,
+
+    /**
+     * @brief Single-byte System Common message, or SysEx ends with
+     *        one byte
+     */
+    MIDI_USB_CIN_SYSEX_END_1 = 0x5,
+
+    /**
+     * @brief SysEx ends with two bytes
+     */
+    MIDI_USB_CIN_SYSEX_END_2 = 0x6,
+
+    /**
+     * @brief SysEx ends with three bytes
+     */
+    MIDI_USB_CIN_SYSEX_END_3 = 0x7,
+
+    /**
+     * @brief Channel Voice messages, the high nibble of their status
+     */
+    MIDI_USB_CIN_NOTE_OFF = 0x8,
+    MIDI_USB_CIN_NOTE_ON = 0x9,
+    MIDI_USB_CIN_KEY_PRESSURE = 0xA,
+    MIDI_USB_CIN_CONTROL_CHANGE = 0xB,
+    MIDI_USB_CIN_PROGRAM_CHANGE = 0xC,
+    MIDI_USB_CIN_CHANNEL_PRESSURE = 0xD,
+    MIDI_USB_CIN_PITCH_BEND = 0xE,
+
+    /**
+     * @brief Single byte, sent without parsing
+     */
+    MIDI_USB_CIN_SINGLE_BYTE = 0xF,
+} midi_usb_cin_t;
+
+/**
+ * @brief USB-MIDI Decoder
+ * @note The fields of this struct should not be accessed directly,
+ *       except for current_cable from a handler
+ */
+typedef struct midi_usb_decoder_t {
+    /**
+     * @brief The parser whose filters and handlers are used
+     * @details Also parses the single bytes of CIN 0xF packets, with the
+     *          state of their cable
+     */
+    midi_parser_t parser;
+
+    /**
+     * @brief The state of each cable
+     * @details Holds the SysEx span flags, and the running status and
+     *          partial message of single bytes
+     */
+    midi_parser_state_t cables[MIDI_USB_CABLES];
+
+    /**
+     * @brief Bit n set to accept the packets of cable n
+     */
+    uint16_t cable_mask;
+
+    /**
+     * @brief The cable of the packet being decoded
+     * @details Lets the SysEx and realtime handlers tell the cables apart
+     */
+    uint8_t current_cable;
+} midi_usb_decoder_t;
+
+/*=====================================================================*
+    Public Inline Functions
+ *=====================================================================*/
+
+/**
+ * @brief Build a USB-MIDI event packet
+ * @param [in] cable The cable number (0-15)
+ * @param [in] cin The Code Index Number
+ * @param [in] byte0 The first MIDI byte
+ * @param [in] byte1 The second MIDI byte
+ * @param [in] byte2 The third MIDI byte
+ * @return The packet
+ */
+static inline midi_usb_packet_t midi_usb_packet_make(uint8_t cable,
+                                                     midi_usb_cin_t cin,
+                                                     uint8_t byte0,
+                                                     uint8_t byte1,
+                                                     uint8_t byte2)
+{
+    return ((uint32_t)(cable & 0x0F) << 28) | ((uint32_t)(cin & 0x0F) << 24)
+           | ((uint32_t)byte0 << 16) | ((uint32_t)byte1 << 8)
+           | (uint32_t)byte2;
+}
+
+/**
+ * @brief Get the cable number of a USB-MIDI event packet
+ * @param [in] packet The packet
+ * @return The cable number
+ */
+static inline uint8_t midi_usb_packet_cable(midi_usb_packet_t packet)
+{
+    return (uint8_t)(packet >> 28);
+}
+
+/**
+ * @brief Get the Code Index Number of a USB-MIDI event packet
+ * @param [in] packet The packet
+ * @return The Code Index Number
+ */
+static inline midi_usb_cin_t midi_usb_packet_cin(midi_usb_packet_t packet)
+{
+    return (midi_usb_cin_t)((packet >> 24) & 0x0F);
+}
+
+/**
+ * @brief Read a USB-MIDI event packet from an endpoint buffer
+ * @param [in] bytes Pointer to the MIDI_USB_PACKET_SIZE bytes of the
+ *      packet, header byte first
+ * @return The packet
+ */
+static inline midi_usb_packet_t midi_usb_packet_read(const uint8_t *bytes)
+{
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16)
+           | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+/**
+ * @brief Write a USB-MIDI event packet to an endpoint buffer
+ * @param [in] packet The packet
+ * @param [out] bytes Pointer to MIDI_USB_PACKET_SIZE bytes that receive
+ *      the packet, header byte first
+ */
+static inline void midi_usb_packet_write(midi_usb_packet_t packet,
+                                         uint8_t *bytes)
+{
+    bytes[0] = (uint8_t)(packet >> 24);
+    bytes[1] = (uint8_t)(packet >> 16);
+    bytes[2] = (uint8_t)(packet >> 8);
+    bytes[3] = (uint8_t)packet;
+}
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a USB-MIDI decoder
+ * @details Every cable is accepted and starts in the state of a freshly
+ *          reset parser
+ * @param [out] decoder Pointer to a midi_usb_decoder_t struct
+ * @param [in] config Pointer to a parser whose filters and handlers are
+ *      copied to the decoder, or NULL for the defaults of
+ *      midi_parser_init
+ */
+void midi_usb_decoder_init(midi_usb_decoder_t *decoder,
+                           const midi_parser_t *config);
+
+/**
+ * @brief Reset the state of every cable of a USB-MIDI decoder
+ * @details Drops any SysEx in progress, for example when the device is
+ *          reconnected. The filters, handlers and cable mask are kept.
+ * @param [in,out] decoder Pointer to a midi_usb_decoder_t struct
+ */
+void midi_usb_decoder_reset(midi_usb_decoder_t *decoder);
+
+/**
+ * @brief Set the cables a USB-MIDI decoder accepts
+ * @param [in,out] decoder Pointer to a midi_usb_decoder_t struct
+ * @param [in] mask Bit n set to accept the packets of cable n
+ */
+void midi_usb_decoder_set_cable_mask(midi_usb_decoder_t *decoder,
+                                     uint16_t mask);
+
+/**
+ * @brief Decode USB-MIDI event packets
+ * @details Decodes packets until every packet is decoded or the output
+ *          array is full. The messages are the ones a parser with the
+ *          same filters and handlers would return for the bytes of each
+ *          cable, including the System Exclusive and End of Exclusive
+ *          messages. Reserved CINs (0x0 and 0x1) and packets of cables
+ *          that are not accepted are skipped.
+ * @param [in,out] decoder Pointer to a midi_usb_decoder_t struct
+ * @param [in] packets Pointer to the packets to decode
+ * @param [in] count The number of packets
+ * @param [out] cables Optional pointer to an array that receives the
+ *      cable of each message. May be NULL.
+ * @param [out] messages Pointer to an array that receives the messages
+ * @param [in] capacity The number of entries in the cables and messages
+ *      arrays
+ * @param [out] consumed Optional pointer that receives the number of
+ *      packets that were decoded. May be NULL.
+ * @return The number of messages written
+ * @note The remaining packets (from packets + *consumed) should be
+ *       passed to the next call
+ */
+size_t midi_usb_decode(midi_usb_decoder_t *decoder,
+                       const midi_usb_packet_t *packets,
+                       size_t count,
+                       uint8_t *cables,
+                       midi_packed_t *messages,
+                       size_t capacity,
+                       size_t *consumed);
+
+/**
+ * @brief Encode packed MIDI messages into USB-MIDI event packets
+ * @details Writes one packet per message until every message is encoded
+ *          or the packet array is full. Messages that cannot be sent on
+ *          their own are skipped: System Exclusive and End of Exclusive
+ *          (use midi_usb_encode_sysex), MIDI_MESSAGE_NONE, and channel
+ *          messages without a valid channel.
+ * @param [in] cable The cable number (0-15)
+ * @param [in] packed Pointer to the packed messages to encode
+ * @param [in] count The number of packed messages
+ * @param [out] packets Pointer to the array that receives the packets
+ * @param [in] capacity The number of entries in the packets array
+ * @param [out] encoded Optional pointer that receives the number of
+ *      messages that were encoded or skipped. May be NULL.
+ * @return The number of packets written, or 0 if the cable is invalid
+ */
+size_t midi_usb_encode_packed(uint8_t cable,
+                              const midi_packed_t *packed,
+                              size_t count,
+                              midi_usb_packet_t *packets,
+                              size_t capacity,
+                              size_t *encoded);
+
+/**
+ * @brief Encode a complete System Exclusive message into USB-MIDI event
+ *        packets
+ * @details Frames Start of Exclusive, the payload and End of Exclusive
+ *          three bytes at a time with CIN 0x4, and the last one to three
+ *          bytes with CIN 0x5, 0x6 or 0x7
+ * @param [in] cable The cable number (0-15)
+ * @param [in] payload Pointer to the payload bytes, excluding the Start
+ *      and End of Exclusive status bytes. May be NULL if length is 0.
+ * @param [in] length The number of payload bytes
+ * @param [out] packets Pointer to the array that receives the packets
+ * @param [in] capacity The number of entries in the packets array
+ * @return The number of packets written (MIDI_USB_SYSEX_PACKETS(length)),
+ *      or 0 if they do not fit, the cable is invalid or the payload
+ *      contains a status byte
+ */
+size_t midi_usb_encode_sysex(uint8_t cable,
+                             const uint8_t *payload,
+                             size_t length,
+                             midi_usb_packet_t *packets,
+                             size_t capacity);
+
+#endif /* MIDI_USB_H */
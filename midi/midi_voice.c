@@ -0,0 +1,682 @@
+/***********************************************************************
+ * @file midi_voice.c
+ * @brief MIDI polyphonic voice allocation implementation
+ *
+ * @details Each voice is on exactly one of three doubly linked lists,
+ *          threaded through byte arrays: free, held by a pedal, or with
+ *          its key down. Lists are kept in age order by appending at the
+ *          tail, so the head of a list is its oldest voice. Killed
+ *          voices go to the head of the free list instead, since they
+ *          are silent at once and the best to reuse. The pedal and held
+ *          voices are threaded a second time on lists of their channel,
+ *          in the same order, so that a pedal or Channel Mode message
+ *          walks only the voices of its channel.
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_voice.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief Lists of the voices
+ */
+#define VOICE_FREE (0)
+#define VOICE_PEDAL (1)
+#define VOICE_HELD (2)
+
+/**
+ * @brief Index of a pedal or held list in the lists of a channel
+ */
+#define VOICE_CHANNEL_LIST(list) ((size_t)(list) - VOICE_PEDAL)
+
+/**
+ * @brief Controller values from which a pedal is down
+ */
+#define VOICE_SWITCH_ON (64)
+
+/**
+ * @brief Mask of the 7-bit data values
+ */
+#define VOICE_DATA_MASK (0x7F)
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static void list_remove(midi_voice_allocator_t *allocator, uint8_t voice);
+
+static void list_append(midi_voice_allocator_t *allocator,
+                        uint8_t list,
+                        uint8_t voice);
+
+static void list_prepend(midi_voice_allocator_t *allocator,
+                         uint8_t list,
+                         uint8_t voice);
+
+static void emit(midi_voice_allocator_t *allocator,
+                 midi_voice_action_t action,
+                 uint8_t voice,
+                 uint8_t velocity);
+
+static void unmap(midi_voice_allocator_t *allocator, uint8_t voice);
+
+static void assign(midi_voice_allocator_t *allocator,
+                   uint8_t voice,
+                   size_t channel,
+                   uint8_t note,
+                   uint8_t velocity);
+
+static void release_voice(midi_voice_allocator_t *allocator,
+                          uint8_t voice,
+                          uint8_t velocity);
+
+static void kill_voice(midi_voice_allocator_t *allocator, uint8_t voice);
+
+static void release_key(midi_voice_allocator_t *allocator,
+                        uint8_t voice,
+                        uint8_t velocity);
+
+static void note_on(midi_voice_allocator_t *allocator,
+                    size_t channel,
+                    uint8_t note,
+                    uint8_t velocity);
+
+static void note_off(midi_voice_allocator_t *allocator,
+                     size_t channel,
+                     uint8_t note,
+                     uint8_t velocity);
+
+static void set_sustain(midi_voice_allocator_t *allocator,
+                        size_t channel,
+                        int down);
+
+static void set_sostenuto(midi_voice_allocator_t *allocator,
+                          size_t channel,
+                          int down);
+
+static void release_keys(midi_voice_allocator_t *allocator, size_t channel);
+
+static void kill_channel(midi_voice_allocator_t *allocator, size_t channel);
+
+static void reset(midi_voice_allocator_t *allocator);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a voice allocator
+ * @param [out] allocator Pointer to a midi_voice_allocator_t struct
+ * @param [in] voices The number of voices
+ * @param [in] handler The handler of the events. May be NULL.
+ * @param [in] context Pointer passed to the handler. May be NULL.
+ */
+void midi_voice_init(midi_voice_allocator_t *allocator,
+                     size_t voices,
+                     midi_voice_handler_t handler,
+                     void *context)
+{
+    /* Check for NULL pointers */
+    if (allocator == NULL) { return; }
+
+    if (voices == 0) { voices = 1; }
+    if (voices > MIDI_VOICE_MAX_VOICES) { voices = MIDI_VOICE_MAX_VOICES; }
+
+    memset(allocator->voices, MIDI_VOICE_NONE, sizeof(allocator->voices));
+    memset(allocator->heads, MIDI_VOICE_NONE, sizeof(allocator->heads));
+    memset(allocator->tails, MIDI_VOICE_NONE, sizeof(allocator->tails));
+    memset(allocator->channel_heads, MIDI_VOICE_NONE,
+           sizeof(allocator->channel_heads));
+    memset(allocator->channel_tails, MIDI_VOICE_NONE,
+           sizeof(allocator->channel_tails));
+    allocator->count = voices;
+    allocator->handler = handler;
+    allocator->context = context;
+
+    for (size_t voice = 0; voice < voices; voice++) {
+        allocator->channel[voice] = 0;
+        allocator->note[voice] = 0;
+        allocator->velocity[voice] = 0;
+        allocator->latched[voice] = 0;
+        list_append(allocator, VOICE_FREE, (uint8_t)voice);
+    }
+    reset(allocator);
+}
+
+/**
+ * @brief Update the voices with a message
+ * @param [in,out] allocator Pointer to a midi_voice_allocator_t struct
+ * @param [in] message Pointer to the message
+ */
+void midi_voice_update(midi_voice_allocator_t *allocator,
+                       const midi_message_t *message)
+{
+    /* Check for NULL pointers */
+    if (allocator == NULL || message == NULL) { return; }
+
+    if (message->message_type == MIDI_MESSAGE_SYSTEM_RESET) {
+        kill_channel(allocator, MIDI_VOICE_CHANNELS);
+        reset(allocator);
+        return;
+    }
+
+    /* Everything else is a channel message */
+    const size_t channel = (size_t)message->channel;
+    if (channel >= MIDI_VOICE_CHANNELS) { return; }
+
+    const uint16_t channel_bit = (uint16_t)(1u << channel);
+
+    switch (message->message_type) {
+    case MIDI_MESSAGE_NOTE_ON:
+        if (message->velocity == 0) {
+            /* Note On with a velocity of 0 from a non-parser source */
+            note_off(allocator, channel, message->note & VOICE_DATA_MASK, 0);
+            break;
+        }
+        note_on(allocator, channel, message->note & VOICE_DATA_MASK,
+                message->velocity & VOICE_DATA_MASK);
+        break;
+    case MIDI_MESSAGE_NOTE_OFF:
+        note_off(allocator, channel, message->note & VOICE_DATA_MASK,
+                 message->velocity & VOICE_DATA_MASK);
+        break;
+    case MIDI_MESSAGE_CONTROL_CHANGE:
+        if (message->controller == MIDI_CC_SUSTAIN_PEDAL) {
+            set_sustain(allocator, channel,
+                        message->control_value >= VOICE_SWITCH_ON);
+        } else if (message->controller == MIDI_CC_SOSTENUTO) {
+            set_sostenuto(allocator, channel,
+                          message->control_value >= VOICE_SWITCH_ON);
+        }
+        break;
+    case MIDI_MESSAGE_ALL_SOUND_OFF:
+        kill_channel(allocator, channel);
+        break;
+    case MIDI_MESSAGE_RESET_ALL_CONTROLLERS:
+        set_sustain(allocator, channel, 0);
+        set_sostenuto(allocator, channel, 0);
+        break;
+    case MIDI_MESSAGE_ALL_NOTES_OFF:
+    case MIDI_MESSAGE_OMNI_OFF:
+    case MIDI_MESSAGE_OMNI_ON:
+        release_keys(allocator, channel);
+        break;
+    case MIDI_MESSAGE_MONO_ON:
+        allocator->mono |= channel_bit;
+        release_keys(allocator, channel);
+        break;
+    case MIDI_MESSAGE_POLY_ON:
+        allocator->mono &= (uint16_t)~channel_bit;
+        allocator->mono_voice[channel] = MIDI_VOICE_NONE;
+        release_keys(allocator, channel);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Update the voices with a packed message
+ * @param [in,out] allocator Pointer to a midi_voice_allocator_t struct
+ * @param [in] packed The packed message
+ */
+void midi_voice_update_packed(midi_voice_allocator_t *allocator,
+                              midi_packed_t packed)
+{
+    midi_message_t message;
+
+    midi_message_unpack(packed, &message);
+    midi_voice_update(allocator, &message);
+}
+
+/**
+ * @brief Message handler that updates the voices
+ * @param [in] context Pointer to a midi_voice_allocator_t struct
+ * @param [in] message Pointer to the message
+ */
+void midi_voice_handle_message(void *context, const midi_message_t *message)
+{
+    midi_voice_update((midi_voice_allocator_t *)context, message);
+}
+
+/**
+ * @brief Find the voice of a note
+ * @param [in] allocator Pointer to a midi_voice_allocator_t struct
+ * @param [in] channel The channel of the note
+ * @param [in] note The note number
+ * @return The voice that plays the note, or MIDI_VOICE_NONE
+ */
+uint8_t midi_voice_find(const midi_voice_allocator_t *allocator,
+                        midi_channel_t channel,
+                        uint8_t note)
+{
+    /* Check for NULL pointers */
+    if (allocator == NULL || (size_t)channel >= MIDI_VOICE_CHANNELS
+        || note >= MIDI_VOICE_KEYS) {
+        return MIDI_VOICE_NONE;
+    }
+
+    return allocator->voices[channel][note];
+}
+
+/**
+ * @brief Count the sounding voices
+ * @param [in] allocator Pointer to a midi_voice_allocator_t struct
+ * @return The number of sounding voices
+ */
+size_t midi_voice_count(const midi_voice_allocator_t *allocator)
+{
+    /* Check for NULL pointers */
+    if (allocator == NULL) { return 0; }
+
+    return allocator->sounding;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Take a voice off its list, and off the list of its channel
+ */
+static void list_remove(midi_voice_allocator_t *allocator, uint8_t voice)
+{
+    const uint8_t list = allocator->list[voice];
+    const uint8_t next = allocator->next[voice];
+    const uint8_t prev = allocator->prev[voice];
+
+    if (prev != MIDI_VOICE_NONE) {
+        allocator->next[prev] = next;
+    } else {
+        allocator->heads[list] = next;
+    }
+    if (next != MIDI_VOICE_NONE) {
+        allocator->prev[next] = prev;
+    } else {
+        allocator->tails[list] = prev;
+    }
+    if (list == VOICE_FREE) { return; }
+
+    const size_t channel = allocator->channel[voice];
+    const size_t channel_list = VOICE_CHANNEL_LIST(list);
+    const uint8_t channel_next = allocator->channel_next[voice];
+    const uint8_t channel_prev = allocator->channel_prev[voice];
+
+    if (channel_prev != MIDI_VOICE_NONE) {
+        allocator->channel_next[channel_prev] = channel_next;
+    } else {
+        allocator->channel_heads[channel][channel_list] = channel_next;
+    }
+    if (channel_next != MIDI_VOICE_NONE) {
+        allocator->channel_prev[channel_next] = channel_prev;
+    } else {
+        allocator->channel_tails[channel][channel_list] = channel_prev;
+    }
+}
+
+/**
+ * @brief Put a voice at the tail of a list, as its newest voice, and at
+ *        the tail of the list of its channel
+ */
+static void list_append(midi_voice_allocator_t *allocator,
+                        uint8_t list,
+                        uint8_t voice)
+{
+    const uint8_t tail = allocator->tails[list];
+
+    allocator->list[voice] = list;
+    allocator->prev[voice] = tail;
+    allocator->next[voice] = MIDI_VOICE_NONE;
+    if (tail != MIDI_VOICE_NONE) {
+        allocator->next[tail] = voice;
+    } else {
+        allocator->heads[list] = voice;
+    }
+    allocator->tails[list] = voice;
+    if (list == VOICE_FREE) { return; }
+
+    const size_t channel = allocator->channel[voice];
+    const size_t channel_list = VOICE_CHANNEL_LIST(list);
+    const uint8_t channel_tail =
+        allocator->channel_tails[channel][channel_list];
+
+    allocator->channel_prev[voice] = channel_tail;
+    allocator->channel_next[voice] = MIDI_VOICE_NONE;
+    if (channel_tail != MIDI_VOICE_NONE) {
+        allocator->channel_next[channel_tail] = voice;
+    } else {
+        allocator->channel_heads[channel][channel_list] = voice;
+    }
+    allocator->channel_tails[channel][channel_list] = voice;
+}
+
+/**
+ * @brief Put a voice at the head of the free list, as its oldest voice
+ */
+static void list_prepend(midi_voice_allocator_t *allocator,
+                         uint8_t list,
+                         uint8_t voice)
+{
+    const uint8_t head = allocator->heads[list];
+
+    allocator->list[voice] = list;
+    allocator->prev[voice] = MIDI_VOICE_NONE;
+    allocator->next[voice] = head;
+    if (head != MIDI_VOICE_NONE) {
+        allocator->prev[head] = voice;
+    } else {
+        allocator->tails[list] = voice;
+    }
+    allocator->heads[list] = voice;
+}
+
+/**
+ * @brief Pass an event for the current note of a voice to the handler
+ */
+static void emit(midi_voice_allocator_t *allocator,
+                 midi_voice_action_t action,
+                 uint8_t voice,
+                 uint8_t velocity)
+{
+    if (allocator->handler == NULL) { return; }
+
+    const midi_voice_event_t event = {
+        .action = action,
+        .voice = voice,
+        .channel = (midi_channel_t)allocator->channel[voice],
+        .note = allocator->note[voice],
+        .velocity = velocity,
+    };
+    allocator->handler(allocator->context, &event);
+}
+
+/**
+ * @brief Forget the note of a sounding voice
+ */
+static void unmap(midi_voice_allocator_t *allocator, uint8_t voice)
+{
+    const size_t channel = allocator->channel[voice];
+
+    allocator->voices[channel][allocator->note[voice]] = MIDI_VOICE_NONE;
+    if (allocator->mono_voice[channel] == voice) {
+        allocator->mono_voice[channel] = MIDI_VOICE_NONE;
+    }
+}
+
+/**
+ * @brief Give a note to a voice and make it the newest held voice
+ */
+static void assign(midi_voice_allocator_t *allocator,
+                   uint8_t voice,
+                   size_t channel,
+                   uint8_t note,
+                   uint8_t velocity)
+{
+    /* Off the lists of its old channel before the channel changes */
+    list_remove(allocator, voice);
+    allocator->channel[voice] = (uint8_t)channel;
+    allocator->note[voice] = note;
+    allocator->velocity[voice] = velocity;
+    allocator->latched[voice] = 0;
+    allocator->voices[channel][note] = voice;
+    if (allocator->mono & (1u << channel)) {
+        allocator->mono_voice[channel] = voice;
+    }
+    list_append(allocator, VOICE_HELD, voice);
+}
+
+/**
+ * @brief Release a sounding voice and make it the newest free voice
+ */
+static void release_voice(midi_voice_allocator_t *allocator,
+                          uint8_t voice,
+                          uint8_t velocity)
+{
+    emit(allocator, MIDI_VOICE_RELEASE, voice, velocity);
+    unmap(allocator, voice);
+    allocator->latched[voice] = 0;
+    list_remove(allocator, voice);
+    list_append(allocator, VOICE_FREE, voice);
+    allocator->sounding--;
+}
+
+/**
+ * @brief Silence a sounding voice and make it the first to reuse
+ */
+static void kill_voice(midi_voice_allocator_t *allocator, uint8_t voice)
+{
+    emit(allocator, MIDI_VOICE_KILL, voice, 0);
+    unmap(allocator, voice);
+    allocator->latched[voice] = 0;
+    list_remove(allocator, voice);
+    list_prepend(allocator, VOICE_FREE, voice);
+    allocator->sounding--;
+}
+
+/**
+ * @brief Release the key of a held voice, which a pedal may hold on to
+ */
+static void release_key(midi_voice_allocator_t *allocator,
+                        uint8_t voice,
+                        uint8_t velocity)
+{
+    const uint16_t channel_bit = (uint16_t)(1u << allocator->channel[voice]);
+    const int latched =
+        allocator->latched[voice] && (allocator->sostenuto & channel_bit);
+
+    if ((allocator->sustain & channel_bit) || latched) {
+        list_remove(allocator, voice);
+        list_append(allocator, VOICE_PEDAL, voice);
+    } else {
+        release_voice(allocator, voice, velocity);
+    }
+}
+
+/**
+ * @brief Start a note
+ */
+static void note_on(midi_voice_allocator_t *allocator,
+                    size_t channel,
+                    uint8_t note,
+                    uint8_t velocity)
+{
+    uint8_t voice = allocator->voices[channel][note];
+
+    /* A Mono channel moves its voice to the new note */
+    const uint8_t mono = allocator->mono_voice[channel];
+    if (mono != MIDI_VOICE_NONE) {
+        if (voice != MIDI_VOICE_NONE && voice != mono) {
+            release_voice(allocator, voice, 0);
+        }
+        const midi_voice_action_t action =
+            (allocator->list[mono] == VOICE_HELD
+             && allocator->note[mono] != note)
+                ? MIDI_VOICE_LEGATO
+                : MIDI_VOICE_RETRIGGER;
+        allocator->voices[channel][allocator->note[mono]] = MIDI_VOICE_NONE;
+        assign(allocator, mono, channel, note, velocity);
+        emit(allocator, action, mono, velocity);
+        return;
+    }
+
+    /* A note that is still sounding plays again on its voice */
+    if (voice != MIDI_VOICE_NONE) {
+        assign(allocator, voice, channel, note, velocity);
+        emit(allocator, MIDI_VOICE_RETRIGGER, voice, velocity);
+        return;
+    }
+
+    midi_voice_action_t action = MIDI_VOICE_START;
+    voice = allocator->heads[VOICE_FREE];
+    if (voice != MIDI_VOICE_NONE) {
+        allocator->sounding++;
+    } else {
+        action = MIDI_VOICE_STEAL;
+        voice = allocator->heads[VOICE_PEDAL];
+        if (voice == MIDI_VOICE_NONE) { voice = allocator->heads[VOICE_HELD]; }
+        unmap(allocator, voice);
+    }
+    assign(allocator, voice, channel, note, velocity);
+    emit(allocator, action, voice, velocity);
+}
+
+/**
+ * @brief Release the key of a note
+ * @details Ignored unless the key of the note is down
+ */
+static void note_off(midi_voice_allocator_t *allocator,
+                     size_t channel,
+                     uint8_t note,
+                     uint8_t velocity)
+{
+    const uint8_t voice = allocator->voices[channel][note];
+
+    if (voice == MIDI_VOICE_NONE || allocator->list[voice] != VOICE_HELD) {
+        return;
+    }
+    release_key(allocator, voice, velocity);
+}
+
+/**
+ * @brief Press or lift the Sustain Pedal
+ * @details Lifting it releases the notes it held, unless the Sostenuto
+ *          pedal holds them too
+ */
+static void set_sustain(midi_voice_allocator_t *allocator,
+                        size_t channel,
+                        int down)
+{
+    const uint16_t channel_bit = (uint16_t)(1u << channel);
+
+    if (down) {
+        allocator->sustain |= channel_bit;
+        return;
+    }
+    if (!(allocator->sustain & channel_bit)) { return; }
+
+    allocator->sustain &= (uint16_t)~channel_bit;
+    const int sostenuto = (allocator->sostenuto & channel_bit) != 0;
+    uint8_t voice =
+        allocator->channel_heads[channel][VOICE_CHANNEL_LIST(VOICE_PEDAL)];
+    while (voice != MIDI_VOICE_NONE) {
+        const uint8_t next = allocator->channel_next[voice];
+        if (!(sostenuto && allocator->latched[voice])) {
+            release_voice(allocator, voice, 0);
+        }
+        voice = next;
+    }
+}
+
+/**
+ * @brief Press or lift the Sostenuto pedal
+ * @details Pressing it catches the notes whose key is down. Lifting it
+ *          lets them go, and releases those whose key is up, unless the
+ *          Sustain Pedal holds them.
+ */
+static void set_sostenuto(midi_voice_allocator_t *allocator,
+                          size_t channel,
+                          int down)
+{
+    const uint16_t channel_bit = (uint16_t)(1u << channel);
+    const int was_down = (allocator->sostenuto & channel_bit) != 0;
+
+    if (down == was_down) { return; }
+
+    for (uint8_t voice =
+             allocator->channel_heads[channel][VOICE_CHANNEL_LIST(VOICE_HELD)];
+         voice != MIDI_VOICE_NONE;
+         voice = allocator->channel_next[voice]) {
+        allocator->latched[voice] = (uint8_t)(down != 0);
+    }
+    if (down) {
+        allocator->sostenuto |= channel_bit;
+        return;
+    }
+
+    allocator->sostenuto &= (uint16_t)~channel_bit;
+    const int sustain = (allocator->sustain & channel_bit) != 0;
+    uint8_t voice =
+        allocator->channel_heads[channel][VOICE_CHANNEL_LIST(VOICE_PEDAL)];
+    while (voice != MIDI_VOICE_NONE) {
+        const uint8_t next = allocator->channel_next[voice];
+        if (allocator->latched[voice]) {
+            allocator->latched[voice] = 0;
+            if (!sustain) { release_voice(allocator, voice, 0); }
+        }
+        voice = next;
+    }
+}
+
+/**
+ * @brief Release every key of a channel
+ */
+static void release_keys(midi_voice_allocator_t *allocator, size_t channel)
+{
+    uint8_t voice =
+        allocator->channel_heads[channel][VOICE_CHANNEL_LIST(VOICE_HELD)];
+
+    while (voice != MIDI_VOICE_NONE) {
+        const uint8_t next = allocator->channel_next[voice];
+        release_key(allocator, voice, 0);
+        voice = next;
+    }
+}
+
+/**
+ * @brief Silence every voice of a channel, or of every channel if the
+ *        channel is MIDI_VOICE_CHANNELS
+ */
+static void kill_channel(midi_voice_allocator_t *allocator, size_t channel)
+{
+    static const uint8_t lists[] = {VOICE_HELD, VOICE_PEDAL};
+
+    for (size_t i = 0; i < sizeof(lists); i++) {
+        if (channel == MIDI_VOICE_CHANNELS) {
+            uint8_t voice = allocator->heads[lists[i]];
+            while (voice != MIDI_VOICE_NONE) {
+                const uint8_t next = allocator->next[voice];
+                kill_voice(allocator, voice);
+                voice = next;
+            }
+            continue;
+        }
+        uint8_t voice =
+            allocator->channel_heads[channel][VOICE_CHANNEL_LIST(lists[i])];
+        while (voice != MIDI_VOICE_NONE) {
+            const uint8_t next = allocator->channel_next[voice];
+            kill_voice(allocator, voice);
+            voice = next;
+        }
+    }
+}
+
+/**
+ * @brief Return every channel to Poly mode with its pedals up
+ * @details The voices must all be free
+ */
+static void reset(midi_voice_allocator_t *allocator)
+{
+    memset(allocator->mono_voice, MIDI_VOICE_NONE,
+           sizeof(allocator->mono_voice));
+    allocator->sustain = 0;
+    allocator->sostenuto = 0;
+    allocator->mono = 0;
+    allocator->sounding = 0;
+}
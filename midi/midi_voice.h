@@ -0,0 +1,319 @@
+/**********************************************************************
+ * @file midi_voice.h
+ * @brief MIDI polyphonic voice allocation module
+ *
+ * @details This module assigns the notes of a MIDI stream to the voices
+ *          of a synthesizer. It is fed the parsed messages, directly or
+ *          as the handler of a dispatcher, and reports what each voice
+ *          should do through a handler: start a note, glide to another
+ *          note, release or stop.
+ *
+ *          A table maps the channel and note of each sounding note to
+ *          its voice. The voices are threaded on three intrusive lists
+ *          in age order: the free voices, by the time they were
+ *          released, the voices whose key was released but that a pedal
+ *          holds, and the voices whose key is down. A note takes the
+ *          voice released longest ago, so that its release has most
+ *          likely ended, and when every voice is sounding it steals the
+ *          oldest voice that only a pedal holds, then the oldest voice
+ *          whose key is down. The pedal and held voices of each
+ *          channel are also on lists of their own. Note On and Note Off
+ *          are a table lookup and a few list operations whatever the
+ *          number of voices, and pedals and Channel Mode messages only
+ *          visit the voices of their channel that they change.
+ *
+ *          The Sustain Pedal holds every note released while it is
+ *          down, and the Sostenuto pedal the notes whose key was down
+ *          when it was pressed. Channels in Mono mode play one voice,
+ *          which glides from note to note while keys overlap. Omni and
+ *          the voice count of Mono On are left to the application. An
+ *          allocator is not thread-safe.
+ *
+ * @see MIDI 1.0 Detailed Specification, Channel Modes
+ *      https://midi.org/midi-1-0-detailed-specification
+ **********************************************************************/
+
+#ifndef MIDI_VOICE_H
+#define MIDI_VOICE_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Maximum number of voices
+ */
+#define MIDI_VOICE_MAX_VOICES (128)
+
+/**
+ * @brief Voice of a note that is not sounding
+ */
+#define MIDI_VOICE_NONE (0xFF)
+
+/**
+ * @brief Number of MIDI channels
+ */
+#define MIDI_VOICE_CHANNELS (16)
+
+/**
+ * @brief Number of notes per channel
+ */
+#define MIDI_VOICE_KEYS (128)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Voice Action
+ */
+typedef enum midi_voice_action_t {
+    /**
+     * @brief Start the note on a free voice
+     */
+    MIDI_VOICE_START,
+
+    /**
+     * @brief Cut the note the voice was playing, quickly, and start the
+     *        note. There were no free voices.
+     */
+    MIDI_VOICE_STEAL,
+
+    /**
+     * @brief Start the note again on the voice that was playing it, or
+     *        that a pedal held on a Mono channel
+     */
+    MIDI_VOICE_RETRIGGER,
+
+    /**
+     * @brief Change the note of the voice without starting it again. On
+     *        a Mono channel, when a key is pressed while another is down.
+     */
+    MIDI_VOICE_LEGATO,
+
+    /**
+     * @brief Release the note. The voice is free and can be given a new
+     *        note while its release sounds.
+     */
+    MIDI_VOICE_RELEASE,
+
+    /**
+     * @brief Silence the voice now, for All Sound Off and System Reset
+     */
+    MIDI_VOICE_KILL,
+} midi_voice_action_t;
+
+/**
+ * @brief Voice Event
+ */
+typedef struct midi_voice_event_t {
+    /**
+     * @brief What the voice should do
+     */
+    midi_voice_action_t action;
+
+    /**
+     * @brief The voice
+     */
+    uint8_t voice;
+
+    /**
+     * @brief The channel of the note
+     */
+    midi_channel_t channel;
+
+    /**
+     * @brief The note number
+     */
+    uint8_t note;
+
+    /**
+     * @brief The velocity of the Note On, or of the Note Off for
+     *        MIDI_VOICE_RELEASE when the key was released, 0 otherwise
+     */
+    uint8_t velocity;
+} midi_voice_event_t;
+
+/**
+ * @brief Voice Event Handler
+ * @param [in] context The context pointer given to midi_voice_init
+ * @param [in] event Pointer to the event. Only valid during the call
+ */
+typedef void (*midi_voice_handler_t)(void *context,
+                                     const midi_voice_event_t *event);
+
+/**
+ * @brief MIDI Voice Allocator
+ * @note The fields of this struct should not be accessed directly.
+ *       Use the `midi_voice_*` functions.
+ */
+typedef struct midi_voice_allocator_t {
+    /**
+     * @brief The voice of each sounding note, by channel and note, or
+     *        MIDI_VOICE_NONE
+     */
+    uint8_t voices[MIDI_VOICE_CHANNELS][MIDI_VOICE_KEYS];
+
+    /**
+     * @brief The channel, note and velocity of each voice
+     */
+    uint8_t channel[MIDI_VOICE_MAX_VOICES];
+    uint8_t note[MIDI_VOICE_MAX_VOICES];
+    uint8_t velocity[MIDI_VOICE_MAX_VOICES];
+
+    /**
+     * @brief The list each voice is on
+     */
+    uint8_t list[MIDI_VOICE_MAX_VOICES];
+
+    /**
+     * @brief Non-zero if the Sostenuto pedal caught the voice
+     */
+    uint8_t latched[MIDI_VOICE_MAX_VOICES];
+
+    /**
+     * @brief The links of the lists, MIDI_VOICE_NONE at the ends
+     */
+    uint8_t next[MIDI_VOICE_MAX_VOICES];
+    uint8_t prev[MIDI_VOICE_MAX_VOICES];
+
+    /**
+     * @brief The oldest and newest voice of each list
+     */
+    uint8_t heads[3];
+    uint8_t tails[3];
+
+    /**
+     * @brief The links of the pedal and held lists of each channel,
+     *        MIDI_VOICE_NONE at the ends
+     */
+    uint8_t channel_next[MIDI_VOICE_MAX_VOICES];
+    uint8_t channel_prev[MIDI_VOICE_MAX_VOICES];
+
+    /**
+     * @brief The oldest and newest pedal and held voice of each channel
+     */
+    uint8_t channel_heads[MIDI_VOICE_CHANNELS][2];
+    uint8_t channel_tails[MIDI_VOICE_CHANNELS][2];
+
+    /**
+     * @brief The voice of each Mono channel, or MIDI_VOICE_NONE
+     */
+    uint8_t mono_voice[MIDI_VOICE_CHANNELS];
+
+    /**
+     * @brief Channels whose Sustain Pedal is down
+     */
+    uint16_t sustain;
+
+    /**
+     * @brief Channels whose Sostenuto pedal is down
+     */
+    uint16_t sostenuto;
+
+    /**
+     * @brief Channels in Mono mode
+     */
+    uint16_t mono;
+
+    /**
+     * @brief The number of voices
+     */
+    size_t count;
+
+    /**
+     * @brief The number of sounding voices
+     */
+    size_t sounding;
+
+    /**
+     * @brief The handler of the events and its context
+     */
+    midi_voice_handler_t handler;
+    void *context;
+} midi_voice_allocator_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a voice allocator
+ * @details Every voice starts free, every channel in Poly mode with its
+ *          pedals up
+ * @param [out] allocator Pointer to a midi_voice_allocator_t struct
+ * @param [in] voices The number of voices, from 1 to
+ *      MIDI_VOICE_MAX_VOICES
+ * @param [in] handler The handler of the events. May be NULL.
+ * @param [in] context Pointer passed to the handler. May be NULL.
+ */
+void midi_voice_init(midi_voice_allocator_t *allocator,
+                     size_t voices,
+                     midi_voice_handler_t handler,
+                     void *context);
+
+/**
+ * @brief Update the voices with a message
+ * @details Handles Note On, Note Off, the Sustain Pedal and Sostenuto
+ *          controllers and the Channel Mode messages, as follows, and
+ *          ignores the other messages:
+ *          - All Sound Off kills every voice of the channel.
+ *          - All Notes Off, Omni Off and Omni On release every key of
+ *            the channel. The pedals keep holding their notes.
+ *          - Mono On and Poly On change the mode, and release every key
+ *            too.
+ *          - Reset All Controllers lifts both pedals.
+ *          - System Reset kills every voice and returns every channel to
+ *            its initial state.
+ * @param [in,out] allocator Pointer to a midi_voice_allocator_t struct
+ * @param [in] message Pointer to the message
+ */
+void midi_voice_update(midi_voice_allocator_t *allocator,
+                       const midi_message_t *message);
+
+/**
+ * @brief Update the voices with a packed message
+ * @param [in,out] allocator Pointer to a midi_voice_allocator_t struct
+ * @param [in] packed The packed message
+ */
+void midi_voice_update_packed(midi_voice_allocator_t *allocator,
+                              midi_packed_t packed);
+
+/**
+ * @brief Message handler that updates the voices
+ * @details For midi_dispatcher_set_handler, with the allocator as the
+ *          context of the dispatcher, so that the voices are updated as
+ *          the bytes are parsed
+ * @param [in] context Pointer to a midi_voice_allocator_t struct
+ * @param [in] message Pointer to the message
+ */
+void midi_voice_handle_message(void *context, const midi_message_t *message);
+
+/**
+ * @brief Find the voice of a note
+ * @param [in] allocator Pointer to a midi_voice_allocator_t struct
+ * @param [in] channel The channel of the note
+ * @param [in] note The note number
+ * @return The voice that plays the note, or MIDI_VOICE_NONE if the note
+ *      is not sounding
+ */
+uint8_t midi_voice_find(const midi_voice_allocator_t *allocator,
+                        midi_channel_t channel,
+                        uint8_t note);
+
+/**
+ * @brief Count the sounding voices
+ * @param [in] allocator Pointer to a midi_voice_allocator_t struct
+ * @return The number of voices whose key is down or that a pedal holds
+ */
+size_t midi_voice_count(const midi_voice_allocator_t *allocator);
+
+#endif /* MIDI_VOICE_H */
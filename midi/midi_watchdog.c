@@ -0,0 +1,351 @@
+/***********************************************************************
+ * @file midi_watchdog.c
+ * @brief MIDI Active Sensing watchdog implementation
+ *
+ * @details An armed port sits in the slot of its deadline: level 0 if
+ *          the deadline is less than 64 ticks away, level 1 if less than
+ *          64^2 and so on. Advancing the wheel to a multiple of 64^n
+ *          moves the ports of the next level n slot down to the levels
+ *          below. Each level 0 slot that comes due is emptied: ports
+ *          that were active since they were scheduled go back in the
+ *          wheel at their new deadline, the others expire.
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_watchdog.h"
+
+/*====================================================================*
+ *    Interface Header Files
+ *====================================================================*/
+#include "midi.h"
+
+/*====================================================================*
+ *    System-wide Header Files
+ *====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+
+/**
+ * @brief End of a slot list
+ */
+#define WATCHDOG_NONE (UINT32_MAX)
+
+/**
+ * @brief Slot of a port that is not armed
+ */
+#define WATCHDOG_UNARMED (UINT16_MAX)
+
+/**
+ * @brief Number of bits of a slot index
+ */
+#define WATCHDOG_SLOT_BITS (6)
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static inline uint32_t first_set_bit(uint64_t bits);
+
+static void schedule(midi_watchdog_t *watchdog,
+                     uint32_t port,
+                     uint32_t deadline);
+
+static void unschedule(midi_watchdog_t *watchdog, uint32_t port);
+
+static void cascade(midi_watchdog_t *watchdog, size_t level);
+
+static size_t expire_slot(midi_watchdog_t *watchdog,
+                          uint32_t *ports,
+                          size_t capacity);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a watchdog
+ * @param [out] watchdog Pointer to a midi_watchdog_t struct
+ * @param [in] storage Pointer to MIDI_WATCHDOG_STORAGE_SIZE(ports) bytes
+ * @param [in] ports The number of ports
+ * @param [in] timeout The timeout, in ticks
+ * @param [in] now The current time
+ * @return 1 if the watchdog was initialized, 0 otherwise
+ */
+int midi_watchdog_init(midi_watchdog_t *watchdog,
+                       uint8_t *storage,
+                       uint32_t ports,
+                       uint32_t timeout,
+                       uint32_t now)
+{
+    /* Check for NULL pointers */
+    if (watchdog == NULL || storage == NULL) { return 0; }
+
+    /* The arrays are read as words */
+    if (((uintptr_t)storage & (sizeof(uint32_t) - 1)) != 0) { return 0; }
+
+    const size_t stride = MIDI_WATCHDOG_STORAGE_SIZE(ports)
+                          / MIDI_WATCHDOG_PORT_SIZE;
+    watchdog->last = (uint32_t *)(void *)storage;
+    watchdog->deadline = (uint32_t *)(void *)(storage + 4 * stride);
+    watchdog->next = (uint32_t *)(void *)(storage + 8 * stride);
+    watchdog->prev = (uint32_t *)(void *)(storage + 12 * stride);
+    watchdog->slot = (uint16_t *)(void *)(storage + 16 * stride);
+    watchdog->ports = ports;
+    watchdog->armed = 0;
+    watchdog->now = now;
+
+    if (timeout == 0) { timeout = 1; }
+    if (timeout >= MIDI_WATCHDOG_MAX_TIMEOUT) {
+        timeout = MIDI_WATCHDOG_MAX_TIMEOUT - 1;
+    }
+    watchdog->timeout = timeout;
+
+    for (size_t i = 0; i < MIDI_WATCHDOG_LEVELS * MIDI_WATCHDOG_SLOTS; i++) {
+        watchdog->heads[i] = WATCHDOG_NONE;
+    }
+    for (size_t level = 0; level < MIDI_WATCHDOG_LEVELS; level++) {
+        watchdog->occupied[level] = 0;
+    }
+    for (uint32_t port = 0; port < ports; port++) {
+        watchdog->last[port] = now;
+        watchdog->slot[port] = WATCHDOG_UNARMED;
+    }
+    return 1;
+}
+
+/**
+ * @brief Record the activity of a port
+ * @param [in,out] watchdog Pointer to a midi_watchdog_t struct
+ * @param [in] port The port the message was received on
+ * @param [in] message_type The type of the message
+ * @param [in] now The time the message was received
+ */
+void midi_watchdog_feed(midi_watchdog_t *watchdog,
+                        uint32_t port,
+                        midi_message_type_t message_type,
+                        uint32_t now)
+{
+    /* Check for NULL pointers */
+    if (watchdog == NULL || port >= watchdog->ports) { return; }
+
+    watchdog->last[port] = now;
+
+    if (message_type == MIDI_MESSAGE_ACTIVE_SENSE
+        && watchdog->slot[port] == WATCHDOG_UNARMED) {
+        schedule(watchdog, port, now + watchdog->timeout);
+        watchdog->armed++;
+    }
+}
+
+/**
+ * @brief Stop watching a port
+ * @param [in,out] watchdog Pointer to a midi_watchdog_t struct
+ * @param [in] port The port
+ */
+void midi_watchdog_disarm(midi_watchdog_t *watchdog, uint32_t port)
+{
+    /* Check for NULL pointers */
+    if (watchdog == NULL || port >= watchdog->ports) { return; }
+
+    if (watchdog->slot[port] != WATCHDOG_UNARMED) {
+        unschedule(watchdog, port);
+        watchdog->armed--;
+    }
+}
+
+/**
+ * @brief Check whether a port is armed
+ * @param [in] watchdog Pointer to a midi_watchdog_t struct
+ * @param [in] port The port
+ * @return Non-zero if the port is armed
+ */
+int midi_watchdog_is_armed(const midi_watchdog_t *watchdog, uint32_t port)
+{
+    /* Check for NULL pointers */
+    if (watchdog == NULL || port >= watchdog->ports) { return 0; }
+
+    return watchdog->slot[port] != WATCHDOG_UNARMED;
+}
+
+/**
+ * @brief Advance the watchdog and list the ports that expired
+ * @param [in,out] watchdog Pointer to a midi_watchdog_t struct
+ * @param [in] now The current time
+ * @param [out] ports Pointer to an array that receives the expired ports
+ * @param [in] capacity The number of entries in the ports array
+ * @return The number of ports written
+ */
+size_t midi_watchdog_poll(midi_watchdog_t *watchdog,
+                          uint32_t now,
+                          uint32_t *ports,
+                          size_t capacity)
+{
+    /* Check for NULL pointers */
+    if (watchdog == NULL || ports == NULL) { return 0; }
+
+    /* Ports left in the current slot by a call that ran out of room */
+    size_t count = expire_slot(watchdog, ports, capacity);
+
+    while (count < capacity && (int32_t)(now - watchdog->now) > 0) {
+        if (watchdog->armed == 0) {
+            watchdog->now = now;
+            break;
+        }
+
+        /* Skip the empty level 0 slots, up to the next cascade */
+        uint32_t tick = watchdog->now + 1;
+        const uint32_t index = tick & (MIDI_WATCHDOG_SLOTS - 1);
+        if (index != 0) {
+            const uint64_t pending = watchdog->occupied[0] >> index;
+            uint32_t skip = (pending != 0) ? first_set_bit(pending)
+                                           : MIDI_WATCHDOG_SLOTS - index;
+            if (skip > now - tick) { skip = now - tick; }
+            tick += skip;
+        }
+
+        watchdog->now = tick;
+        if ((tick & (MIDI_WATCHDOG_SLOTS - 1)) == 0) { cascade(watchdog, 1); }
+        count += expire_slot(watchdog, &ports[count], capacity - count);
+    }
+    return count;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Get the position of the lowest set bit
+ */
+static inline uint32_t first_set_bit(uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (uint32_t)__builtin_ctzll(bits);
+#else
+    uint32_t position = 0;
+    while (!(bits & ((uint64_t)1 << position))) { position++; }
+    return position;
+#endif
+}
+
+/**
+ * @brief Put a port in the slot of its deadline
+ * @details A deadline that has passed goes in the current slot
+ */
+static void schedule(midi_watchdog_t *watchdog,
+                     uint32_t port,
+                     uint32_t deadline)
+{
+    int32_t delta = (int32_t)(deadline - watchdog->now);
+
+    if (delta < 0) {
+        delta = 0;
+        deadline = watchdog->now;
+    }
+    if ((uint32_t)delta >= MIDI_WATCHDOG_MAX_TIMEOUT) {
+        delta = (int32_t)(MIDI_WATCHDOG_MAX_TIMEOUT - 1);
+        deadline = watchdog->now + (uint32_t)delta;
+    }
+
+    size_t level = 0;
+    while ((uint32_t)delta >> (WATCHDOG_SLOT_BITS * (level + 1)) != 0) {
+        level++;
+    }
+
+    const size_t index = (deadline >> (WATCHDOG_SLOT_BITS * level))
+                         & (MIDI_WATCHDOG_SLOTS - 1);
+    const size_t slot = level * MIDI_WATCHDOG_SLOTS + index;
+    const uint32_t head = watchdog->heads[slot];
+
+    watchdog->deadline[port] = deadline;
+    watchdog->slot[port] = (uint16_t)slot;
+    watchdog->prev[port] = WATCHDOG_NONE;
+    watchdog->next[port] = head;
+    if (head != WATCHDOG_NONE) { watchdog->prev[head] = port; }
+    watchdog->heads[slot] = port;
+    watchdog->occupied[level] |= (uint64_t)1 << index;
+}
+
+/**
+ * @brief Take a port out of its slot
+ */
+static void unschedule(midi_watchdog_t *watchdog, uint32_t port)
+{
+    const size_t slot = watchdog->slot[port];
+    const uint32_t next = watchdog->next[port];
+    const uint32_t prev = watchdog->prev[port];
+
+    if (prev != WATCHDOG_NONE) {
+        watchdog->next[prev] = next;
+    } else {
+        watchdog->heads[slot] = next;
+    }
+    if (next != WATCHDOG_NONE) { watchdog->prev[next] = prev; }
+
+    if (watchdog->heads[slot] == WATCHDOG_NONE) {
+        watchdog->occupied[slot / MIDI_WATCHDOG_SLOTS] &=
+            ~((uint64_t)1 << (slot % MIDI_WATCHDOG_SLOTS));
+    }
+    watchdog->slot[port] = WATCHDOG_UNARMED;
+}
+
+/**
+ * @brief Move the ports of the level slot that starts now to the levels
+ *        below
+ * @details The levels above are cascaded first when their slot starts
+ *          too
+ */
+static void cascade(midi_watchdog_t *watchdog, size_t level)
+{
+    const size_t index = (watchdog->now >> (WATCHDOG_SLOT_BITS * level))
+                         & (MIDI_WATCHDOG_SLOTS - 1);
+
+    if (index == 0 && level + 1 < MIDI_WATCHDOG_LEVELS) {
+        cascade(watchdog, level + 1);
+    }
+
+    const size_t slot = level * MIDI_WATCHDOG_SLOTS + index;
+    uint32_t port = watchdog->heads[slot];
+
+    watchdog->heads[slot] = WATCHDOG_NONE;
+    watchdog->occupied[level] &= ~((uint64_t)1 << index);
+    while (port != WATCHDOG_NONE) {
+        const uint32_t next = watchdog->next[port];
+        schedule(watchdog, port, watchdog->deadline[port]);
+        port = next;
+    }
+}
+
+/**
+ * @brief Empty the level 0 slot of the current tick
+ * @details Ports that were active go back in the wheel, the others are
+ *          written out and disarmed
+ * @return The number of ports written
+ */
+static size_t expire_slot(midi_watchdog_t *watchdog,
+                          uint32_t *ports,
+                          size_t capacity)
+{
+    const size_t slot = watchdog->now & (MIDI_WATCHDOG_SLOTS - 1);
+    size_t count = 0;
+
+    while (watchdog->heads[slot] != WATCHDOG_NONE && count < capacity) {
+        const uint32_t port = watchdog->heads[slot];
+        const uint32_t deadline = watchdog->last[port] + watchdog->timeout;
+
+        unschedule(watchdog, port);
+        if ((int32_t)(deadline - watchdog->now) > 0) {
+            schedule(watchdog, port, deadline);
+        } else {
+            ports[count++] = port;
+            watchdog->armed--;
+        }
+    }
+    return count;
+}
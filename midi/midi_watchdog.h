@@ -0,0 +1,227 @@
+/**********************************************************************
+ * @file midi_watchdog.h
+ * @brief MIDI Active Sensing watchdog module
+ *
+ * @details This module detects the ports whose sender has gone away.
+ *          A port that sends Active Sensing promises to send some
+ *          message at least every 300 ms; once it has, the watchdog
+ *          expects activity from it, and reports it when the timeout
+ *          passes without any. The application then stops the notes
+ *          the port left sounding, for example with midi_state_notes_off
+ *          on the channel state of the port, and the port returns to
+ *          the normal mode where silence is not an error.
+ *
+ *          The ports are kept in a hierarchical timer wheel: four levels
+ *          of 64 slots, of 1, 64, 4096 and 262144 ticks. Feeding a port
+ *          only records the time of its activity. The port is looked at
+ *          again when its slot comes due, and rescheduled then if it was
+ *          active, so the cost is at most one rescheduling per port and
+ *          timeout however many messages it receives, and polling visits
+ *          only the slots that are due rather than every port.
+ *
+ *          The per-port arrays live in storage provided by the caller,
+ *          in structure-of-arrays layout, so that thousands of ports
+ *          cost 18 bytes each. A watchdog is not thread-safe.
+ *
+ * @see MIDI 1.0 Detailed Specification, Active Sensing
+ *      https://midi.org/midi-1-0-detailed-specification
+ **********************************************************************/
+
+#ifndef MIDI_WATCHDOG_H
+#define MIDI_WATCHDOG_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "midi.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief Active Sensing timeout of the specification, in milliseconds
+ */
+#define MIDI_WATCHDOG_SENSE_TIMEOUT (300)
+
+/**
+ * @brief Number of levels of the timer wheel
+ */
+#define MIDI_WATCHDOG_LEVELS (4)
+
+/**
+ * @brief Number of slots of each level of the timer wheel
+ */
+#define MIDI_WATCHDOG_SLOTS (64)
+
+/**
+ * @brief Longest timeout, in ticks
+ */
+#define MIDI_WATCHDOG_MAX_TIMEOUT ((uint32_t)1 << 24)
+
+/**
+ * @brief Bytes of state per port
+ */
+#define MIDI_WATCHDOG_PORT_SIZE (18)
+
+/**
+ * @brief Alignment of each per-port array in the storage, in bytes
+ */
+#define MIDI_WATCHDOG_ALIGN (64)
+
+/**
+ * @brief Size of the storage of a watchdog
+ * @details Each per-port array is padded to a whole number of cache
+ *          lines, so if the storage is cache-line aligned, every array
+ *          starts on a cache line
+ * @param ports The number of ports
+ */
+#define MIDI_WATCHDOG_STORAGE_SIZE(ports)                                  \
+    (MIDI_WATCHDOG_PORT_SIZE                                               \
+     * (((size_t)(ports) + MIDI_WATCHDOG_ALIGN - 1)                        \
+        & ~(size_t)(MIDI_WATCHDOG_ALIGN - 1)))
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief MIDI Active Sensing Watchdog
+ * @note The fields of this struct should not be accessed directly.
+ *       Use the `midi_watchdog_*` functions.
+ */
+typedef struct midi_watchdog_t {
+    /**
+     * @brief The time of the last activity of each port
+     */
+    uint32_t *last;
+
+    /**
+     * @brief The time of the slot each armed port is scheduled in
+     */
+    uint32_t *deadline;
+
+    /**
+     * @brief The links of the slot lists, UINT32_MAX at the ends
+     */
+    uint32_t *next;
+    uint32_t *prev;
+
+    /**
+     * @brief The slot of each port, level * MIDI_WATCHDOG_SLOTS + index,
+     *        or UINT16_MAX if the port is not armed
+     */
+    uint16_t *slot;
+
+    /**
+     * @brief The first port of each slot list, UINT32_MAX if empty
+     */
+    uint32_t heads[MIDI_WATCHDOG_LEVELS * MIDI_WATCHDOG_SLOTS];
+
+    /**
+     * @brief Bit n of a level is set if its slot n is not empty
+     */
+    uint64_t occupied[MIDI_WATCHDOG_LEVELS];
+
+    /**
+     * @brief The number of ports
+     */
+    uint32_t ports;
+
+    /**
+     * @brief The number of armed ports
+     */
+    uint32_t armed;
+
+    /**
+     * @brief The timeout, in ticks
+     */
+    uint32_t timeout;
+
+    /**
+     * @brief The tick the wheel has been advanced to
+     */
+    uint32_t now;
+} midi_watchdog_t;
+
+/*=====================================================================*
+    Public Functions
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a watchdog
+ * @details Every port starts unarmed
+ * @param [out] watchdog Pointer to a midi_watchdog_t struct
+ * @param [in] storage Pointer to MIDI_WATCHDOG_STORAGE_SIZE(ports) bytes
+ *      that hold the per-port state. Must be aligned to 4 bytes, for
+ *      example an array of uint32_t, and stay valid for as long as the
+ *      watchdog is used.
+ * @param [in] ports The number of ports
+ * @param [in] timeout The time without activity after which an armed
+ *      port expires, in the units of the times given to the watchdog,
+ *      for example MIDI_WATCHDOG_SENSE_TIMEOUT with a millisecond clock.
+ *      Limited to 1 to MIDI_WATCHDOG_MAX_TIMEOUT - 1.
+ * @param [in] now The current time
+ * @return 1 if the watchdog was initialized, 0 if a pointer is NULL or
+ *      the storage is not aligned to 4 bytes
+ */
+int midi_watchdog_init(midi_watchdog_t *watchdog,
+                       uint8_t *storage,
+                       uint32_t ports,
+                       uint32_t timeout,
+                       uint32_t now);
+
+/**
+ * @brief Record the activity of a port
+ * @details Call for every message received on the port, including the
+ *          realtime messages. Active Sensing arms the port if it is not
+ *          armed yet. Unknown ports are ignored.
+ * @param [in,out] watchdog Pointer to a midi_watchdog_t struct
+ * @param [in] port The port the message was received on
+ * @param [in] message_type The type of the message
+ * @param [in] now The time the message was received
+ */
+void midi_watchdog_feed(midi_watchdog_t *watchdog,
+                        uint32_t port,
+                        midi_message_type_t message_type,
+                        uint32_t now);
+
+/**
+ * @brief Stop watching a port
+ * @details For example when the port is closed. The port is armed again
+ *          by its next Active Sensing message.
+ * @param [in,out] watchdog Pointer to a midi_watchdog_t struct
+ * @param [in] port The port
+ */
+void midi_watchdog_disarm(midi_watchdog_t *watchdog, uint32_t port);
+
+/**
+ * @brief Check whether a port is armed
+ * @param [in] watchdog Pointer to a midi_watchdog_t struct
+ * @param [in] port The port
+ * @return Non-zero if the port has sent Active Sensing and has not
+ *      expired since
+ */
+int midi_watchdog_is_armed(const midi_watchdog_t *watchdog, uint32_t port);
+
+/**
+ * @brief Advance the watchdog and list the ports that expired
+ * @details Expired ports are disarmed. Call at least every 2^31 ticks,
+ *          and preferably every few ticks: a port is reported by the
+ *          first call at or after its last activity plus the timeout.
+ * @param [in,out] watchdog Pointer to a midi_watchdog_t struct
+ * @param [in] now The current time
+ * @param [out] ports Pointer to an array that receives the expired ports
+ * @param [in] capacity The number of entries in the ports array
+ * @return The number of ports written. If it equals the capacity, call
+ *      again with the same time for the remaining ports.
+ */
+size_t midi_watchdog_poll(midi_watchdog_t *watchdog,
+                          uint32_t now,
+                          uint32_t *ports,
+                          size_t capacity);
+
+#endif /* MIDI_WATCHDOG_H */
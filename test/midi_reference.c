@@ -0,0 +1,180 @@
+/***********************************************************************
+ * @file midi_reference.c
+ * @brief Reference MIDI decoder implementation
+ *
+ * @details Every decision is spelled out with comparisons on the byte
+ *          values, so that the decoder can be read against the
+ *          specification. Speed is not a goal.
+ ***********************************************************************/
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "midi_reference.h"
+
+/*=====================================================================*
+    Private Function Prototypes
+ *=====================================================================*/
+
+static int data_length(uint8_t status);
+
+static int starts_message(uint8_t status);
+
+static midi_packed_t complete_message(uint8_t status,
+                                      uint8_t data1,
+                                      uint8_t data2);
+
+/*=====================================================================*
+    Public Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a reference decoder
+ * @param [out] reference Pointer to a midi_reference_t struct
+ */
+void midi_reference_init(midi_reference_t *reference)
+{
+    reference->status = 0;
+    reference->channel = MIDI_CHANNEL_NONE;
+    reference->data[0] = 0;
+    reference->data[1] = 0;
+    reference->count = 0;
+    reference->sysex = MIDI_REFERENCE_SYSEX_NONE;
+}
+
+/**
+ * @brief Decode a MIDI byte
+ * @param [in,out] reference Pointer to a midi_reference_t struct
+ * @param [in] byte The byte to decode
+ * @return The packed message completed by the byte, or 0
+ */
+midi_packed_t midi_reference_parse_byte(midi_reference_t *reference,
+                                        uint8_t byte)
+{
+    reference->sysex = MIDI_REFERENCE_SYSEX_NONE;
+
+    /* System Real-Time: complete at once, anywhere, with no effect */
+    if (byte >= 0xF8) {
+        if (byte == 0xF9 || byte == 0xFD) { return 0; }
+        return midi_packed_make(
+            (midi_message_type_t)byte, MIDI_CHANNEL_NONE, 0, 0);
+    }
+
+    /* Undefined System Common status bytes are ignored */
+    if (byte == 0xF4 || byte == 0xF5) { return 0; }
+
+    /* Any other status byte ends the message being received */
+    if (byte >= 0x80) {
+        if (reference->status == 0xF0) {
+            reference->sysex = (byte == 0xF7) ? MIDI_REFERENCE_SYSEX_END
+                                              : MIDI_REFERENCE_SYSEX_ABORTED;
+        }
+        reference->status = starts_message(byte) ? byte : 0;
+        reference->channel =
+            (byte < 0xF0) ? (uint8_t)(byte & 0x0F) : MIDI_CHANNEL_NONE;
+        reference->count = 0;
+
+        if (byte == 0xF6
+            || (MIDI_CONFIG_SYSEX && (byte == 0xF0 || byte == 0xF7))) {
+            return midi_packed_make(
+                (midi_message_type_t)byte, MIDI_CHANNEL_NONE, 0, 0);
+        }
+        return 0;
+    }
+
+    /* Data bytes */
+    if (reference->status == 0) { return 0; }
+    if (reference->status == 0xF0) {
+        reference->sysex = MIDI_REFERENCE_SYSEX_PAYLOAD;
+        return 0;
+    }
+
+    reference->data[reference->count++] = byte;
+    if (reference->count < data_length(reference->status)) { return 0; }
+    reference->count = 0;
+
+    const uint8_t status = reference->status;
+    const uint8_t data2 = (data_length(status) == 2) ? reference->data[1] : 0;
+
+    /* Only channel messages have running status */
+    if (status >= 0xF0) { reference->status = 0; }
+    return complete_message(status, reference->data[0], data2);
+}
+
+/**
+ * @brief Get the state of a reference decoder as a parser state
+ * @param [in] reference Pointer to a midi_reference_t struct
+ * @param [out] state Pointer to a midi_parser_state_t struct
+ */
+void midi_reference_get_state(const midi_reference_t *reference,
+                              midi_parser_state_t *state)
+{
+    const uint8_t status = reference->status;
+
+    state->message_type =
+        (midi_message_type_t)((status < 0xF0) ? (status & 0xF0) : status);
+    state->channel = (midi_channel_t)reference->channel;
+    state->buffer[0] = (reference->count > 0) ? reference->data[0] : 0;
+    state->buffer[1] = (reference->count > 1) ? reference->data[1] : 0;
+    state->byte_count = reference->count;
+    state->sysex_flags = 0;
+}
+
+/*=====================================================================*
+    Private Function Implementations
+ *=====================================================================*/
+
+/**
+ * @brief Get the number of data bytes of a message
+ */
+static int data_length(uint8_t status)
+{
+    if (status < 0xF0) {
+        const uint8_t type = status & 0xF0;
+        return (type == 0xC0 || type == 0xD0) ? 1 : 2;
+    }
+    if (status == 0xF1 || status == 0xF3) { return 1; }
+    if (status == 0xF2) { return 2; }
+    return 0;
+}
+
+/**
+ * @brief Check whether a status byte starts a message with data bytes
+ * @details Message families compiled out of the parser start no message
+ */
+static int starts_message(uint8_t status)
+{
+    if (status < 0xF0) { return 1; }
+    if (status == 0xF0) { return MIDI_CONFIG_SYSEX; }
+    if (status == 0xF1) { return MIDI_CONFIG_MTC; }
+    if (status == 0xF2 || status == 0xF3) { return MIDI_CONFIG_SONG; }
+    return 0;
+}
+
+/**
+ * @brief Pack a completed message
+ */
+static midi_packed_t complete_message(uint8_t status,
+                                      uint8_t data1,
+                                      uint8_t data2)
+{
+    if (status >= 0xF0) {
+        return midi_packed_make(
+            (midi_message_type_t)status, MIDI_CHANNEL_NONE, data1, data2);
+    }
+
+    uint8_t type = status & 0xF0;
+
+    /* Note On with a velocity of zero is a Note Off */
+    if (type == 0x90 && data2 == 0) { type = 0x80; }
+
+    /* Controllers 120-127 are Channel Mode messages */
+    if (MIDI_CONFIG_CHANNEL_MODE && type == 0xB0 && data1 >= 120) {
+        type = data1;
+    }
+
+    return midi_packed_make((midi_message_type_t)type,
+                            (midi_channel_t)(status & 0x0F),
+                            data1,
+                            data2);
+}
@@ -0,0 +1,122 @@
+/**********************************************************************
+ * @file midi_reference.h
+ * @brief Reference MIDI decoder for differential testing
+ *
+ * @details A deliberately simple byte at a time decoder, written
+ *          straight from the MIDI 1.0 specification without the tables,
+ *          filters, scanners or fast paths of midi.c. It follows the
+ *          same build configuration (MIDI_CONFIG_SYSEX, MIDI_CONFIG_MTC,
+ *          MIDI_CONFIG_SONG and MIDI_CONFIG_CHANNEL_MODE) and returns
+ *          the same packed messages as midi_parse_byte of an unfiltered
+ *          parser, so that every parser entry point can be checked
+ *          against it. It is test code and is not part of the library.
+ **********************************************************************/
+
+#ifndef MIDI_REFERENCE_H
+#define MIDI_REFERENCE_H
+
+/*=====================================================================*
+    Required Header Files
+ *=====================================================================*/
+#include <stdint.h>
+
+#include "../midi/midi.h"
+
+/*=====================================================================*
+    Public Defines
+ *=====================================================================*/
+
+/**
+ * @brief SysEx Event: None
+ * @details The byte was not part of a System Exclusive message
+ */
+#define MIDI_REFERENCE_SYSEX_NONE (0)
+
+/**
+ * @brief SysEx Event: Payload
+ * @details The byte is a payload byte of a System Exclusive message
+ */
+#define MIDI_REFERENCE_SYSEX_PAYLOAD (1)
+
+/**
+ * @brief SysEx Event: End
+ * @details The byte is the End of Exclusive of a System Exclusive message
+ */
+#define MIDI_REFERENCE_SYSEX_END (2)
+
+/**
+ * @brief SysEx Event: Aborted
+ * @details The byte is a status byte that cut a System Exclusive message
+ *          short
+ */
+#define MIDI_REFERENCE_SYSEX_ABORTED (3)
+
+/*=====================================================================*
+    Public Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Reference MIDI Decoder
+ */
+typedef struct midi_reference_t {
+    /**
+     * @brief The status byte of the message being received, or 0 if
+     *        data bytes are ignored
+     */
+    uint8_t status;
+
+    /**
+     * @brief The channel of the last status byte, or MIDI_CHANNEL_NONE
+     *        for a system status byte
+     */
+    uint8_t channel;
+
+    /**
+     * @brief The data bytes received so far
+     */
+    uint8_t data[2];
+
+    /**
+     * @brief The number of data bytes received so far
+     */
+    uint8_t count;
+
+    /**
+     * @brief The MIDI_REFERENCE_SYSEX_* event of the last byte
+     */
+    uint8_t sysex;
+} midi_reference_t;
+
+/*=====================================================================*
+    Public Function Prototypes
+ *=====================================================================*/
+
+/**
+ * @brief Initialize a reference decoder
+ * @param [out] reference Pointer to a midi_reference_t struct
+ */
+void midi_reference_init(midi_reference_t *reference);
+
+/**
+ * @brief Decode a MIDI byte
+ * @param [in,out] reference Pointer to a midi_reference_t struct
+ * @param [in] byte The byte to decode
+ * @return The packed message completed by the byte, or 0
+ *      (MIDI_MESSAGE_NONE) if the byte completes no message
+ */
+midi_packed_t midi_reference_parse_byte(midi_reference_t *reference,
+                                        uint8_t byte);
+
+/**
+ * @brief Get the state of a reference decoder as a parser state
+ * @details The message type, channel, byte count and received data bytes
+ *      match those saved by midi_parser_save_state from an unfiltered
+ *      parser that was given the same bytes. Data bytes past the byte
+ *      count and the SysEx span flags are set to zero.
+ * @param [in] reference Pointer to a midi_reference_t struct
+ * @param [out] state Pointer to a midi_parser_state_t struct
+ */
+void midi_reference_get_state(const midi_reference_t *reference,
+                              midi_parser_state_t *state);
+
+#endif /* MIDI_REFERENCE_H */
@@ -248,6 +248,7 @@ void test_control_change_message(void)
     }
 }
 
+#if MIDI_CONFIG_CHANNEL_MODE
 /**
  * @brief Test the channel mode messages
  * @details Tests every possible channel mode message
@@ -290,6 +291,7 @@ void test_channel_mode_messages(void)
         }
     }
 }
+#endif
 
 /**
  * @brief Test the program change message
@@ -395,6 +397,7 @@ void test_pitch_bend_message(void)
     System Messages
  *=====================================================================*/
 
+#if MIDI_CONFIG_MTC
 /**
  * @brief Test the MTC quarter frame message
  * @details Tests every possible MTC quarter frame message
@@ -422,7 +425,9 @@ void test_mtc_quarter_frame_message(void)
         TEST_ASSERT_EQUAL(data & 0x0F, message.mtc_values);
     }
 }
+#endif
 
+#if MIDI_CONFIG_SONG
 /**
  * @brief Test the song position pointer message
  * @details Tests every possible song position pointer message
@@ -488,6 +493,7 @@ void test_song_select_message(void)
         TEST_ASSERT_EQUAL(song, message.song_select);
     }
 }
+#endif
 
 /**
  * @brief Test the tune request message
@@ -612,6 +618,7 @@ void test_system_reset_message(void)
     Sysex Messages
  *=====================================================================*/
 
+#if MIDI_CONFIG_SYSEX
 /**
  * @brief Test the sysex message
  */
@@ -648,6 +655,7 @@ void test_sysex_message(void)
     TEST_ASSERT_EQUAL(MIDI_MESSAGE_END_OF_EXCLUSIVE, message.message_type);
     TEST_ASSERT_EQUAL(MIDI_CHANNEL_NONE, message.channel);
 }
+#endif
 
 /*=====================================================================*
     Interruptions
@@ -754,6 +762,7 @@ void test_interrupt_channel_message_with_undefined_status_bytes(void)
     }
 }
 
+#if MIDI_CONFIG_SYSEX
 /**
  * @brief Interrupt a SysEx message with system realtime messages
  */
@@ -871,6 +880,7 @@ void test_interrupt_sysex_with_undefined_status_bytes(void)
         TEST_ASSERT_EQUAL(MIDI_CHANNEL_NONE, message.channel);
     }
 }
+#endif
 
 /*=====================================================================*
    Partial Messages
@@ -901,6 +911,7 @@ void test_partial_channel_message(void)
     TEST_ASSERT_EQUAL(42, message.program);
 }
 
+#if MIDI_CONFIG_SYSEX
 /**
  * @brief Test SysEx message without proper EOX termination
  */
@@ -952,6 +963,1710 @@ void test_partial_sysex_message(void)
     TEST_ASSERT_EQUAL(60, message.note);
     TEST_ASSERT_EQUAL(100, message.velocity);
 }
+#endif
+
+/*=====================================================================*
+    Buffer Parsing
+
+    midi_parse_buffer must produce exactly the same message sequence
+    and parser state as feeding the same bytes to midi_parse_byte,
+    regardless of how the stream is split into chunks.
+ *=====================================================================*/
+
+/**
+ * @brief A mixed stream covering running status, interruptions,
+ *        system messages and partial messages
+ */
+static const uint8_t mixed_stream[] = {
+    0x90, 60,   100,  62,   0,    0xF8, 64,   90,   0xB0, 7,    127,
+    0x78, 0,    74,   0xFE, 33,   0xC5, 10,   11,   0xE2, 0x00, 0x40,
+    0x7F, 0xF4, 0x7F, 0xF0, 1,    2,    0xFA, 3,    0xF7, 0xF1, 0x35,
+    0xF2, 0x10, 0x20, 0xF3, 5,    0xF6, 0x80, 60,   0xA3, 61,   70,
+    0xD9, 99,   98,   0x91, 20,   0xF9, 0x90, 20,   30,   0xFF, 40,
+    1,    2,    3,    0xB1, 123,  0,    1,    2,    0xFD, 3,    4,
+};
+
+/**
+ * @brief Check that two parsers are in the same parsing state
+ */
+static void assert_same_parser_state(const midi_parser_t *expected,
+                                     const midi_parser_t *actual)
+{
+    TEST_ASSERT_EQUAL(expected->message_type, actual->message_type);
+    TEST_ASSERT_EQUAL(expected->channel, actual->channel);
+    TEST_ASSERT_EQUAL(expected->byte_count, actual->byte_count);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected->buffer, actual->buffer, 2);
+    TEST_ASSERT_EQUAL_HEX8(expected->sysex_flags, actual->sysex_flags);
+}
+
+/**
+ * @brief Parse a stream one byte at a time
+ * @return The number of messages written to messages
+ */
+static size_t parse_bytewise(midi_parser_t *p,
+                             const uint8_t *bytes,
+                             size_t length,
+                             midi_message_t *messages)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (midi_parse_byte(p, bytes[i], &messages[count])
+            != MIDI_MESSAGE_NONE) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Parse a stream with midi_parse_buffer in fixed size chunks
+ * @return The number of messages written to messages
+ */
+static size_t parse_chunked(midi_parser_t *p,
+                            const uint8_t *bytes,
+                            size_t length,
+                            size_t chunk,
+                            midi_message_t *messages)
+{
+    size_t count = 0;
+    for (size_t offset = 0; offset < length; offset += chunk) {
+        size_t size = (length - offset < chunk) ? length - offset : chunk;
+        size_t consumed = 0;
+        count += midi_parse_buffer(
+            p, &bytes[offset], size, &messages[count], size, &consumed);
+        TEST_ASSERT_EQUAL(size, consumed);
+    }
+    return count;
+}
+
+/**
+ * @brief Buffer parsing produces the same messages as byte parsing
+ */
+void test_parse_buffer_matches_parse_byte(void)
+{
+    midi_parser_t expected_parser;
+    midi_message_t expected[sizeof(mixed_stream)];
+    midi_message_t actual[sizeof(mixed_stream)];
+    size_t expected_count;
+    size_t actual_count;
+    size_t consumed;
+
+    memset(expected, 0, sizeof(expected));
+    memset(actual, 0, sizeof(actual));
+    midi_parser_init(&expected_parser);
+
+    expected_count = parse_bytewise(
+        &expected_parser, mixed_stream, sizeof(mixed_stream), expected);
+    actual_count = midi_parse_buffer(&parser,
+                                     mixed_stream,
+                                     sizeof(mixed_stream),
+                                     actual,
+                                     sizeof(mixed_stream),
+                                     &consumed);
+
+    TEST_ASSERT_EQUAL(sizeof(mixed_stream), consumed);
+    TEST_ASSERT_EQUAL(expected_count, actual_count);
+    TEST_ASSERT_EQUAL_MEMORY(
+        expected, actual, expected_count * sizeof(midi_message_t));
+    assert_same_parser_state(&expected_parser, &parser);
+}
+
+/**
+ * @brief Buffer parsing resumes correctly across chunk boundaries
+ */
+void test_parse_buffer_chunked(void)
+{
+    midi_parser_t expected_parser;
+    midi_message_t expected[sizeof(mixed_stream)];
+    midi_message_t actual[sizeof(mixed_stream)];
+    size_t expected_count;
+
+    memset(expected, 0, sizeof(expected));
+    midi_parser_init(&expected_parser);
+    expected_count = parse_bytewise(
+        &expected_parser, mixed_stream, sizeof(mixed_stream), expected);
+
+    for (size_t chunk = 1; chunk <= sizeof(mixed_stream); chunk++) {
+        midi_parser_init(&parser);
+        memset(actual, 0, sizeof(actual));
+
+        size_t actual_count = parse_chunked(
+            &parser, mixed_stream, sizeof(mixed_stream), chunk, actual);
+
+        TEST_ASSERT_EQUAL(expected_count, actual_count);
+        TEST_ASSERT_EQUAL_MEMORY(
+            expected, actual, expected_count * sizeof(midi_message_t));
+        assert_same_parser_state(&expected_parser, &parser);
+    }
+}
+
+/**
+ * @brief Buffer parsing stops as soon as the messages array is full
+ */
+void test_parse_buffer_capacity(void)
+{
+    const uint8_t bytes[] = {0x90, 60, 100, 61, 101, 62, 102, 0xF8};
+    midi_message_t messages[2];
+    size_t consumed;
+    size_t count;
+
+    count = midi_parse_buffer(
+        &parser, bytes, sizeof(bytes), messages, 2, &consumed);
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(5, consumed);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_ON, messages[0].message_type);
+    TEST_ASSERT_EQUAL(60, messages[0].note);
+    TEST_ASSERT_EQUAL(61, messages[1].note);
+    TEST_ASSERT_EQUAL(101, messages[1].velocity);
+
+    /* Resume from where the previous call stopped */
+    count = midi_parse_buffer(&parser,
+                              &bytes[consumed],
+                              sizeof(bytes) - consumed,
+                              messages,
+                              2,
+                              &consumed);
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(3, consumed);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_ON, messages[0].message_type);
+    TEST_ASSERT_EQUAL(62, messages[0].note);
+    TEST_ASSERT_EQUAL(102, messages[0].velocity);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_TIMING_CLOCK, messages[1].message_type);
+
+    /* A zero capacity array consumes nothing */
+    count = midi_parse_buffer(
+        &parser, bytes, sizeof(bytes), messages, 0, &consumed);
+    TEST_ASSERT_EQUAL(0, count);
+    TEST_ASSERT_EQUAL(0, consumed);
+}
+
+/**
+ * @brief Buffer parsing null pointer handling
+ */
+void test_parse_buffer_null_pointer_handling(void)
+{
+    const uint8_t bytes[] = {0xF8};
+    midi_message_t messages[1];
+    size_t consumed = 1;
+
+    TEST_ASSERT_EQUAL(
+        0, midi_parse_buffer(NULL, bytes, 1, messages, 1, &consumed));
+    TEST_ASSERT_EQUAL(0, consumed);
+
+    consumed = 1;
+    TEST_ASSERT_EQUAL(
+        0, midi_parse_buffer(&parser, NULL, 1, messages, 1, &consumed));
+    TEST_ASSERT_EQUAL(0, consumed);
+
+    consumed = 1;
+    TEST_ASSERT_EQUAL(
+        0, midi_parse_buffer(&parser, bytes, 1, NULL, 1, &consumed));
+    TEST_ASSERT_EQUAL(0, consumed);
+
+    /* The consumed pointer is optional */
+    TEST_ASSERT_EQUAL(
+        1, midi_parse_buffer(&parser, bytes, 1, messages, 1, NULL));
+}
+
+/*=====================================================================*
+    Packed Messages
+ *=====================================================================*/
+
+/**
+ * @brief Check that two messages carry the same decoded data
+ */
+static void assert_same_message(const midi_message_t *expected,
+                                const midi_message_t *actual)
+{
+    TEST_ASSERT_EQUAL(expected->message_type, actual->message_type);
+    TEST_ASSERT_EQUAL(expected->channel, actual->channel);
+    TEST_ASSERT_EQUAL_HEX32(midi_message_pack(expected),
+                            midi_message_pack(actual));
+}
+
+/**
+ * @brief The packed representation fits in 32 bits
+ */
+void test_packed_size(void)
+{
+    TEST_ASSERT_EQUAL(4, sizeof(midi_packed_t));
+}
+
+/**
+ * @brief Packed messages expose their fields
+ */
+void test_packed_fields(void)
+{
+    midi_packed_t packed;
+
+    packed = midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_10, 60, 100);
+    TEST_ASSERT_EQUAL_HEX32(0x90093C64, packed);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_ON, midi_packed_type(packed));
+    TEST_ASSERT_EQUAL(MIDI_CHANNEL_10, midi_packed_channel(packed));
+    TEST_ASSERT_EQUAL(60, midi_packed_data1(packed));
+    TEST_ASSERT_EQUAL(100, midi_packed_data2(packed));
+
+    packed =
+        midi_packed_make(MIDI_MESSAGE_TIMING_CLOCK, MIDI_CHANNEL_NONE, 0, 0);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_TIMING_CLOCK, midi_packed_type(packed));
+    TEST_ASSERT_EQUAL(MIDI_CHANNEL_NONE, midi_packed_channel(packed));
+}
+
+/**
+ * @brief Packing and unpacking every parsed message is lossless
+ */
+void test_packed_round_trip(void)
+{
+    midi_message_t messages[sizeof(mixed_stream)];
+    midi_message_t unpacked;
+    size_t count;
+
+    memset(messages, 0, sizeof(messages));
+    count = parse_bytewise(
+        &parser, mixed_stream, sizeof(mixed_stream), messages);
+    TEST_ASSERT_TRUE(count > 0);
+
+    for (size_t i = 0; i < count; i++) {
+        memset(&unpacked, 0, sizeof(unpacked));
+        midi_message_unpack(midi_message_pack(&messages[i]), &unpacked);
+        assert_same_message(&messages[i], &unpacked);
+        TEST_ASSERT_EQUAL_MEMORY(&messages[i], &unpacked, sizeof(unpacked));
+    }
+
+    /* 14-bit values are split into LSB and MSB data bytes */
+    message.message_type = MIDI_MESSAGE_PITCH_BEND;
+    message.channel = MIDI_CHANNEL_3;
+    message.pitch_bend = 0x3FFF;
+    TEST_ASSERT_EQUAL_HEX32(0xE0027F7F, midi_message_pack(&message));
+    message.pitch_bend = 0x2000;
+    TEST_ASSERT_EQUAL_HEX32(0xE0020040, midi_message_pack(&message));
+}
+
+/**
+ * @brief Packed buffer parsing matches buffer parsing
+ */
+void test_parse_buffer_packed(void)
+{
+    midi_parser_t expected_parser;
+    midi_message_t expected[sizeof(mixed_stream)];
+    midi_packed_t packed[sizeof(mixed_stream)];
+    size_t expected_count;
+
+    memset(expected, 0, sizeof(expected));
+    midi_parser_init(&expected_parser);
+    expected_count = parse_bytewise(
+        &expected_parser, mixed_stream, sizeof(mixed_stream), expected);
+
+    for (size_t chunk = 1; chunk <= sizeof(mixed_stream); chunk++) {
+        size_t count = 0;
+
+        midi_parser_init(&parser);
+        for (size_t offset = 0; offset < sizeof(mixed_stream);
+             offset += chunk) {
+            size_t size = sizeof(mixed_stream) - offset;
+            size_t consumed;
+            if (size > chunk) { size = chunk; }
+            count += midi_parse_buffer_packed(&parser,
+                                              &mixed_stream[offset],
+                                              size,
+                                              &packed[count],
+                                              size,
+                                              &consumed);
+            TEST_ASSERT_EQUAL(size, consumed);
+        }
+
+        TEST_ASSERT_EQUAL(expected_count, count);
+        for (size_t i = 0; i < count; i++) {
+            TEST_ASSERT_EQUAL_HEX32(midi_message_pack(&expected[i]),
+                                    packed[i]);
+        }
+        assert_same_parser_state(&expected_parser, &parser);
+    }
+
+    /* Null pointer handling */
+    TEST_ASSERT_EQUAL(
+        0, midi_parse_buffer_packed(&parser, mixed_stream, 1, NULL, 1, NULL));
+}
+
+/*=====================================================================*
+    Differential Tests
+
+    The running status fast path of the buffer parsers skips the state
+    machine, so it is checked against midi_parse_byte on the same
+    vectors as the per-message tests above, split into chunks of sizes
+    that land on and around the scanner block boundaries.
+ *=====================================================================*/
+
+/**
+ * @brief Maximum number of bytes in a differential test vector
+ */
+#define VECTOR_SIZE (1 + 2 * 128 * 128)
+
+static uint8_t vector[VECTOR_SIZE];
+static midi_message_t expected_messages[VECTOR_SIZE];
+static midi_message_t actual_messages[VECTOR_SIZE];
+static midi_packed_t actual_packed[VECTOR_SIZE];
+static midi_packed_t dispatched[VECTOR_SIZE];
+static size_t dispatched_count;
+
+/**
+ * @brief Test message handler that records each message in packed form
+ */
+static void record_message(void *context, const midi_message_t *m)
+{
+    (void)context;
+    dispatched[dispatched_count++] = midi_message_pack(m);
+}
+
+/**
+ * @brief Initialize a dispatcher with record_message for every type
+ */
+static void dispatch_all_to_recorder(midi_dispatcher_t *dispatcher)
+{
+    midi_dispatcher_init(dispatcher, NULL);
+    for (int type = 0; type < 256; type++) {
+        midi_dispatcher_set_handler(
+            dispatcher, (midi_message_type_t)type, record_message);
+    }
+    dispatched_count = 0;
+}
+
+/**
+ * @brief Check that the buffer parsers match the byte parser on a vector
+ * @details Covers midi_parse_buffer, midi_parse_buffer_packed and
+ *          midi_parse_buffer_dispatch
+ */
+static void assert_buffer_parsers_match(const uint8_t *bytes, size_t length)
+{
+    static const size_t chunks[] = {1, 2, 3, 7, 15, 16, 17, 31, 32, 33, 4096};
+    midi_parser_t expected_parser;
+    size_t expected_count;
+
+    memset(expected_messages, 0, length * sizeof(midi_message_t));
+    midi_parser_init(&expected_parser);
+    expected_count =
+        parse_bytewise(&expected_parser, bytes, length, expected_messages);
+
+    for (size_t c = 0; c <= sizeof(chunks) / sizeof(chunks[0]); c++) {
+        size_t chunk =
+            (c < sizeof(chunks) / sizeof(chunks[0])) ? chunks[c] : length;
+        size_t count = 0;
+        size_t packed = 0;
+        size_t dispatch_count = 0;
+        midi_parser_t packed_parser;
+        midi_parser_t dispatch_parser;
+        midi_dispatcher_t dispatcher;
+
+        memset(actual_messages, 0, length * sizeof(midi_message_t));
+        midi_parser_init(&parser);
+        midi_parser_init(&packed_parser);
+        midi_parser_init(&dispatch_parser);
+        dispatch_all_to_recorder(&dispatcher);
+
+        for (size_t offset = 0; offset < length; offset += chunk) {
+            size_t size = (length - offset < chunk) ? length - offset : chunk;
+            count += midi_parse_buffer(&parser,
+                                       &bytes[offset],
+                                       size,
+                                       &actual_messages[count],
+                                       size,
+                                       NULL);
+            packed += midi_parse_buffer_packed(&packed_parser,
+                                               &bytes[offset],
+                                               size,
+                                               &actual_packed[packed],
+                                               size,
+                                               NULL);
+            dispatch_count += midi_parse_buffer_dispatch(
+                &dispatch_parser, &dispatcher, &bytes[offset], size);
+        }
+
+        TEST_ASSERT_EQUAL(expected_count, count);
+        TEST_ASSERT_EQUAL(expected_count, packed);
+        TEST_ASSERT_EQUAL(expected_count, dispatch_count);
+        TEST_ASSERT_EQUAL(expected_count, dispatched_count);
+        TEST_ASSERT_EQUAL_MEMORY(expected_messages,
+                                 actual_messages,
+                                 expected_count * sizeof(midi_message_t));
+        for (size_t i = 0; i < expected_count; i++) {
+            TEST_ASSERT_EQUAL_HEX32(midi_message_pack(&expected_messages[i]),
+                                    actual_packed[i]);
+            TEST_ASSERT_EQUAL_HEX32(actual_packed[i], dispatched[i]);
+        }
+        assert_same_parser_state(&expected_parser, &parser);
+        assert_same_parser_state(&expected_parser, &packed_parser);
+        assert_same_parser_state(&expected_parser, &dispatch_parser);
+    }
+}
+
+/**
+ * @brief Differential test of every two data byte channel message
+ */
+void test_differential_two_byte_channel_messages(void)
+{
+    static const uint8_t types[] = {MIDI_MESSAGE_NOTE_OFF,
+                                    MIDI_MESSAGE_NOTE_ON,
+                                    MIDI_MESSAGE_KEY_PRESSURE,
+                                    MIDI_MESSAGE_CONTROL_CHANGE,
+                                    MIDI_MESSAGE_PITCH_BEND};
+
+    for (size_t t = 0; t < sizeof(types); t++) {
+        for (uint8_t channel = 0; channel < 16; channel += 5) {
+            size_t length = 0;
+            vector[length++] = types[t] | channel;
+            for (uint8_t data0 = 0; data0 < 128; data0++) {
+                for (uint8_t data1 = 0; data1 < 128; data1++) {
+                    vector[length++] = data0;
+                    vector[length++] = data1;
+                }
+            }
+            assert_buffer_parsers_match(vector, length);
+        }
+    }
+}
+
+/**
+ * @brief Differential test of every one data byte channel message
+ */
+void test_differential_one_byte_channel_messages(void)
+{
+    static const uint8_t types[] = {MIDI_MESSAGE_PROGRAM_CHANGE,
+                                    MIDI_MESSAGE_CHANNEL_PRESSURE};
+
+    for (size_t t = 0; t < sizeof(types); t++) {
+        for (uint8_t channel = 0; channel < 16; channel++) {
+            size_t length = 0;
+            vector[length++] = types[t] | channel;
+            for (uint8_t data = 0; data < 128; data++) {
+                vector[length++] = data;
+            }
+            assert_buffer_parsers_match(vector, length);
+        }
+    }
+}
+
+/**
+ * @brief Differential test of runs interrupted by other bytes
+ * @details Runs of every length from 0 to 40 data bytes, ended by
+ *          real-time, undefined, system common and channel status bytes
+ */
+void test_differential_interrupted_runs(void)
+{
+    static const uint8_t statuses[] = {0x90, 0xC3, 0xB1, 0xE5, 0xD2};
+    static const uint8_t interrupts[] = {
+        0xF8, 0xFE, 0xF4, 0xFD, 0xF1, 0x10, 0xF6, 0xF0, 0xF7, 0x80, 0xA2};
+    size_t length = 0;
+
+    for (size_t s = 0; s < sizeof(statuses); s++) {
+        for (size_t run = 0; run <= 40; run++) {
+            vector[length++] = statuses[s];
+            for (size_t i = 0; i < run; i++) {
+                vector[length++] = (uint8_t)((run * 7 + i * 13) & 0x7F);
+            }
+            vector[length++] = interrupts[run % sizeof(interrupts)];
+            for (size_t i = 0; i < run % 5; i++) {
+                vector[length++] = (uint8_t)(i + 1);
+            }
+        }
+    }
+    assert_buffer_parsers_match(vector, length);
+    assert_buffer_parsers_match(mixed_stream, sizeof(mixed_stream));
+}
+
+/*=====================================================================*
+    SysEx Spans
+ *=====================================================================*/
+
+/**
+ * @brief Maximum number of spans recorded by the test SysEx handler
+ */
+#define MAX_SPANS (128)
+
+/**
+ * @brief Spans and payload bytes recorded by the test SysEx handler
+ */
+typedef struct sysex_recorder_t {
+    midi_sysex_span_t spans[MAX_SPANS];
+    size_t span_count;
+    uint8_t payload[256];
+    size_t payload_length;
+} sysex_recorder_t;
+
+static sysex_recorder_t recorder;
+
+/**
+ * @brief Test SysEx handler that records each span and its payload
+ */
+static void record_sysex_span(void *context, const midi_sysex_span_t *span)
+{
+    sysex_recorder_t *r = (sysex_recorder_t *)context;
+
+    TEST_ASSERT_LESS_THAN(MAX_SPANS, r->span_count);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(r->payload),
+                              r->payload_length + span->length);
+    r->spans[r->span_count++] = *span;
+    memcpy(&r->payload[r->payload_length], span->data, span->length);
+    r->payload_length += span->length;
+}
+
+#if MIDI_CONFIG_SYSEX
+/**
+ * @brief Parse a stream in one call with the test SysEx handler set
+ */
+static size_t parse_with_recorder(const uint8_t *bytes,
+                                  size_t length,
+                                  midi_message_t *messages,
+                                  size_t capacity)
+{
+    memset(&recorder, 0, sizeof(recorder));
+    midi_parser_set_sysex_handler(&parser, record_sysex_span, &recorder);
+    return midi_parse_buffer(
+        &parser, bytes, length, messages, capacity, NULL);
+}
+
+/**
+ * @brief A whole SysEx message is delivered as a single span
+ */
+void test_sysex_span_single(void)
+{
+    const uint8_t stream[] = {0xF0, 0x7E, 0x01, 0x02, 0x03, 0xF7};
+    midi_message_t messages[4];
+
+    size_t count = parse_with_recorder(stream, sizeof(stream), messages, 4);
+
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_SYSTEM_EXCLUSIVE, messages[0].message_type);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_END_OF_EXCLUSIVE, messages[1].message_type);
+
+    TEST_ASSERT_EQUAL(1, recorder.span_count);
+    TEST_ASSERT_EQUAL_PTR(&stream[1], recorder.spans[0].data);
+    TEST_ASSERT_EQUAL(4, recorder.spans[0].length);
+    TEST_ASSERT_EQUAL_HEX8(MIDI_SYSEX_FLAG_START | MIDI_SYSEX_FLAG_END,
+                           recorder.spans[0].flags);
+}
+
+/**
+ * @brief An empty SysEx message is delivered as an empty span
+ */
+void test_sysex_span_empty(void)
+{
+    const uint8_t stream[] = {0xF0, 0xF7};
+    midi_message_t messages[4];
+
+    size_t count = parse_with_recorder(stream, sizeof(stream), messages, 4);
+
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(1, recorder.span_count);
+    TEST_ASSERT_EQUAL(0, recorder.spans[0].length);
+    TEST_ASSERT_EQUAL_HEX8(MIDI_SYSEX_FLAG_START | MIDI_SYSEX_FLAG_END,
+                           recorder.spans[0].flags);
+}
+
+/**
+ * @brief System Real-Time bytes split the payload into spans
+ */
+void test_sysex_span_interrupted_by_realtime(void)
+{
+    const uint8_t stream[] = {
+        0xF0, 0x01, 0x02, 0xF8, 0x03, 0xF9, 0xFE, 0x04, 0x05, 0xF7};
+    const uint8_t payload[] = {0x01, 0x02, 0x03, 0x04, 0x05};
+    midi_message_t messages[8];
+
+    size_t count = parse_with_recorder(stream, sizeof(stream), messages, 8);
+
+    TEST_ASSERT_EQUAL(4, count);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_SYSTEM_EXCLUSIVE, messages[0].message_type);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_TIMING_CLOCK, messages[1].message_type);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_ACTIVE_SENSE, messages[2].message_type);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_END_OF_EXCLUSIVE, messages[3].message_type);
+
+    TEST_ASSERT_EQUAL(3, recorder.span_count);
+    TEST_ASSERT_EQUAL_PTR(&stream[1], recorder.spans[0].data);
+    TEST_ASSERT_EQUAL(2, recorder.spans[0].length);
+    TEST_ASSERT_EQUAL_HEX8(MIDI_SYSEX_FLAG_START, recorder.spans[0].flags);
+    TEST_ASSERT_EQUAL_PTR(&stream[4], recorder.spans[1].data);
+    TEST_ASSERT_EQUAL(1, recorder.spans[1].length);
+    TEST_ASSERT_EQUAL_HEX8(MIDI_SYSEX_FLAG_CONTINUE, recorder.spans[1].flags);
+    TEST_ASSERT_EQUAL_PTR(&stream[7], recorder.spans[2].data);
+    TEST_ASSERT_EQUAL(2, recorder.spans[2].length);
+    TEST_ASSERT_EQUAL_HEX8(MIDI_SYSEX_FLAG_CONTINUE | MIDI_SYSEX_FLAG_END,
+                           recorder.spans[2].flags);
+    TEST_ASSERT_EQUAL(sizeof(payload), recorder.payload_length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(payload, recorder.payload, sizeof(payload));
+}
+
+/**
+ * @brief A status byte other than End of Exclusive aborts the payload
+ */
+void test_sysex_span_aborted(void)
+{
+    const uint8_t stream[] = {0xF0, 0x01, 0x02, 0x90, 0x3C, 0x64};
+    midi_message_t messages[4];
+
+    size_t count = parse_with_recorder(stream, sizeof(stream), messages, 4);
+
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_SYSTEM_EXCLUSIVE, messages[0].message_type);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_ON, messages[1].message_type);
+    TEST_ASSERT_EQUAL(1, recorder.span_count);
+    TEST_ASSERT_EQUAL(2, recorder.spans[0].length);
+    TEST_ASSERT_EQUAL_HEX8(MIDI_SYSEX_FLAG_START | MIDI_SYSEX_FLAG_END
+                               | MIDI_SYSEX_FLAG_ABORTED,
+                           recorder.spans[0].flags);
+}
+
+/**
+ * @brief The payload is delivered in order for every chunk size
+ * @details Each message must be delivered as exactly one start span,
+ *          followed by continue spans, the last of which is the end span
+ */
+void test_sysex_span_chunked(void)
+{
+    uint8_t stream[2 + 100 + 2];
+    midi_message_t messages[8];
+    size_t length = 0;
+
+    stream[length++] = 0xF0;
+    for (uint8_t i = 0; i < 100; i++) {
+        stream[length++] = i;
+        if (i == 50) { stream[length++] = 0xF8; }
+    }
+    stream[length++] = 0xF7;
+
+    for (size_t chunk = 1; chunk <= length; chunk++) {
+        midi_parser_init(&parser);
+        memset(&recorder, 0, sizeof(recorder));
+        midi_parser_set_sysex_handler(&parser, record_sysex_span, &recorder);
+
+        size_t count = 0;
+        for (size_t offset = 0; offset < length; offset += chunk) {
+            size_t size = (length - offset < chunk) ? length - offset : chunk;
+            count += midi_parse_buffer(
+                &parser, &stream[offset], size, messages, 8, NULL);
+        }
+
+        TEST_ASSERT_EQUAL(100, recorder.payload_length);
+        for (uint8_t i = 0; i < 100; i++) {
+            TEST_ASSERT_EQUAL_HEX8(i, recorder.payload[i]);
+        }
+        TEST_ASSERT_EQUAL_HEX8(MIDI_SYSEX_FLAG_START,
+                               recorder.spans[0].flags
+                                   & ~MIDI_SYSEX_FLAG_END);
+        for (size_t i = 1; i < recorder.span_count; i++) {
+            TEST_ASSERT_EQUAL_HEX8(MIDI_SYSEX_FLAG_CONTINUE,
+                                   recorder.spans[i].flags
+                                       & ~MIDI_SYSEX_FLAG_END);
+        }
+        for (size_t i = 0; i + 1 < recorder.span_count; i++) {
+            TEST_ASSERT_FALSE(recorder.spans[i].flags & MIDI_SYSEX_FLAG_END);
+        }
+        TEST_ASSERT_EQUAL_HEX8(
+            MIDI_SYSEX_FLAG_END,
+            recorder.spans[recorder.span_count - 1].flags
+                & MIDI_SYSEX_FLAG_END);
+    }
+}
+
+/**
+ * @brief Messages are unchanged by the SysEx handler
+ */
+void test_sysex_span_messages_unchanged(void)
+{
+    midi_message_t expected[sizeof(mixed_stream)];
+    midi_message_t actual[sizeof(mixed_stream)];
+    midi_parser_t reference;
+
+    memset(expected, 0, sizeof(expected));
+    memset(actual, 0, sizeof(actual));
+    midi_parser_init(&reference);
+    size_t expected_count = midi_parse_buffer(&reference,
+                                              mixed_stream,
+                                              sizeof(mixed_stream),
+                                              expected,
+                                              sizeof(mixed_stream),
+                                              NULL);
+    size_t count = parse_with_recorder(
+        mixed_stream, sizeof(mixed_stream), actual, sizeof(mixed_stream));
+
+    TEST_ASSERT_EQUAL(expected_count, count);
+    TEST_ASSERT_EQUAL_MEMORY(
+        expected, actual, expected_count * sizeof(midi_message_t));
+    TEST_ASSERT_GREATER_THAN(0, recorder.span_count);
+}
+#endif
+
+/**
+ * @brief Resetting the parser keeps the SysEx handler
+ */
+void test_sysex_handler_kept_on_reset(void)
+{
+    midi_parser_set_sysex_handler(&parser, record_sysex_span, &recorder);
+    midi_parser_reset(&parser);
+
+    TEST_ASSERT_EQUAL_PTR(record_sysex_span, parser.sysex_handler);
+    TEST_ASSERT_EQUAL_PTR(&recorder, parser.sysex_context);
+
+    /* NULL pointer handling */
+    midi_parser_set_sysex_handler(NULL, record_sysex_span, &recorder);
+    midi_parser_set_sysex_handler(&parser, NULL, NULL);
+    TEST_ASSERT_NULL(parser.sysex_handler);
+}
+
+/*=====================================================================*
+    Dispatch
+ *=====================================================================*/
+
+/**
+ * @brief Number of calls of each test handler
+ */
+static size_t note_on_calls;
+static size_t control_change_calls;
+static size_t sustain_calls;
+
+static void on_note_on(void *context, const midi_message_t *m)
+{
+    TEST_ASSERT_EQUAL_PTR(&note_on_calls, context);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_ON, m->message_type);
+    note_on_calls++;
+}
+
+static void on_control_change(void *context, const midi_message_t *m)
+{
+    (void)context;
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_CONTROL_CHANGE, m->message_type);
+    control_change_calls++;
+}
+
+static void on_sustain(void *context, const midi_message_t *m)
+{
+    (void)context;
+    TEST_ASSERT_EQUAL(MIDI_CC_SUSTAIN_PEDAL, m->controller);
+    sustain_calls++;
+}
+
+/**
+ * @brief Messages are passed to the handler of their type
+ */
+void test_dispatch_by_type(void)
+{
+    const uint8_t stream[] = {
+        0x90, 60, 100, 62, 0, 0xF8, 64, 90, 0xB0, 7, 127, 0x78, 0};
+    midi_dispatcher_t dispatcher;
+
+    note_on_calls = 0;
+    midi_dispatcher_init(&dispatcher, &note_on_calls);
+    midi_dispatcher_set_handler(
+        &dispatcher, MIDI_MESSAGE_NOTE_ON, on_note_on);
+
+    size_t count = midi_parse_buffer_dispatch(
+        &parser, &dispatcher, stream, sizeof(stream));
+
+    /* Note Off (velocity 0), clock, CC and Channel Mode have no handler */
+    TEST_ASSERT_EQUAL(6, count);
+    TEST_ASSERT_EQUAL(2, note_on_calls);
+}
+
+/**
+ * @brief Controller handlers take precedence over the CC handler
+ */
+void test_dispatch_by_controller(void)
+{
+    const uint8_t stream[] = {
+        0xB0, 7, 127, 64, 127, 64, 0, 1, 10, 0x7B, 0};
+    midi_dispatcher_t dispatcher;
+
+    control_change_calls = 0;
+    sustain_calls = 0;
+    midi_dispatcher_init(&dispatcher, NULL);
+    midi_dispatcher_set_handler(
+        &dispatcher, MIDI_MESSAGE_CONTROL_CHANGE, on_control_change);
+    midi_dispatcher_set_controller_handler(
+        &dispatcher, MIDI_CC_SUSTAIN_PEDAL, on_sustain);
+
+    /* All Notes Off is a Channel Mode message, not a Control Change,
+     * unless Channel Mode messages are compiled out */
+    const size_t all_notes_off = MIDI_CONFIG_CHANNEL_MODE ? 0 : 1;
+
+    size_t count = midi_parse_buffer_dispatch(
+        &parser, &dispatcher, stream, sizeof(stream));
+
+    TEST_ASSERT_EQUAL(5, count);
+    TEST_ASSERT_EQUAL(2 + all_notes_off, control_change_calls);
+    TEST_ASSERT_EQUAL(2, sustain_calls);
+
+    /* Clearing the controller handler falls back to the CC handler */
+    midi_dispatcher_set_controller_handler(
+        &dispatcher, MIDI_CC_SUSTAIN_PEDAL, NULL);
+    midi_parse_buffer_dispatch(&parser, &dispatcher, stream, sizeof(stream));
+    TEST_ASSERT_EQUAL(6 + 2 * all_notes_off, control_change_calls);
+    TEST_ASSERT_EQUAL(2, sustain_calls);
+}
+
+/**
+ * @brief Dispatch NULL pointer handling
+ */
+void test_dispatch_null_pointer_handling(void)
+{
+    const uint8_t stream[] = {0x90, 60, 100};
+    midi_dispatcher_t dispatcher;
+
+    midi_dispatcher_init(&dispatcher, NULL);
+    midi_dispatcher_init(NULL, NULL);
+    midi_dispatcher_set_handler(NULL, MIDI_MESSAGE_NOTE_ON, on_note_on);
+    midi_dispatcher_set_controller_handler(
+        NULL, MIDI_CC_SUSTAIN_PEDAL, on_sustain);
+
+    TEST_ASSERT_EQUAL(
+        0, midi_parse_buffer_dispatch(NULL, &dispatcher, stream, 3));
+    TEST_ASSERT_EQUAL(0, midi_parse_buffer_dispatch(&parser, NULL, stream, 3));
+    TEST_ASSERT_EQUAL(
+        0, midi_parse_buffer_dispatch(&parser, &dispatcher, NULL, 3));
+    TEST_ASSERT_EQUAL(
+        1, midi_parse_buffer_dispatch(&parser, &dispatcher, stream, 3));
+}
+
+/*=====================================================================*
+    Filters
+ *=====================================================================*/
+
+/**
+ * @brief Number of bytes in the pseudo random filter test stream
+ */
+#define FILTER_STREAM_SIZE (20000)
+
+/**
+ * @brief Predicate that returns non-zero for messages a filter accepts
+ */
+typedef int (*message_predicate_t)(const midi_message_t *m);
+
+/**
+ * @brief Generate a pseudo random stream of status and data bytes
+ * @details One in eight bytes is a status byte, and data bytes are
+ *          biased towards zero so that Note On messages with a velocity
+ *          of zero and Channel Mode messages are common
+ */
+static size_t generate_random_stream(uint8_t *bytes, size_t length)
+{
+    uint32_t state = 0x2545F491;
+
+    for (size_t i = 0; i < length; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        if ((state & 0x07) == 0) {
+            bytes[i] = (uint8_t)(0x80 | (state >> 8));
+        } else if ((state & 0x18) == 0) {
+            bytes[i] = (uint8_t)(0x78 | ((state >> 8) & 0x07));
+        } else if ((state & 0x18) == 0x08) {
+            bytes[i] = 0;
+        } else {
+            bytes[i] = (state >> 8) & 0x7F;
+        }
+    }
+    return length;
+}
+
+/**
+ * @brief Check a configured parser against the unfiltered byte parser
+ * @details The filtered parsers must return exactly the messages of an
+ *          unfiltered parser for which keep returns non-zero
+ * @param [in] bytes The stream to parse
+ * @param [in] length The number of bytes in the stream
+ * @param [in] configured A parser with the filters under test set
+ * @param [in] keep The predicate matching the filters under test
+ */
+static void assert_filter_matches(const uint8_t *bytes,
+                                  size_t length,
+                                  const midi_parser_t *configured,
+                                  message_predicate_t keep)
+{
+    static const size_t chunks[] = {1, 3, 16, 33, FILTER_STREAM_SIZE};
+    midi_parser_t reference;
+    midi_parser_t filtered;
+    size_t all_count;
+    size_t expected_count = 0;
+
+    /* Unfiltered messages, with the rejected ones removed */
+    memset(actual_messages, 0, length * sizeof(midi_message_t));
+    midi_parser_init(&reference);
+    all_count = parse_bytewise(&reference, bytes, length, actual_messages);
+    memset(expected_messages, 0, length * sizeof(midi_message_t));
+    for (size_t i = 0; i < all_count; i++) {
+        if (keep(&actual_messages[i])) {
+            expected_messages[expected_count++] = actual_messages[i];
+        }
+    }
+    TEST_ASSERT_GREATER_THAN(expected_count, all_count);
+    TEST_ASSERT_GREATER_THAN(0, expected_count);
+
+    /* midi_parse_byte, which does not use the realtime lane */
+    if (configured->realtime_handler == NULL) {
+        filtered = *configured;
+        memset(actual_messages, 0, length * sizeof(midi_message_t));
+        TEST_ASSERT_EQUAL(
+            expected_count,
+            parse_bytewise(&filtered, bytes, length, actual_messages));
+        TEST_ASSERT_EQUAL_MEMORY(expected_messages,
+                                 actual_messages,
+                                 expected_count * sizeof(midi_message_t));
+    }
+
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        size_t count = 0;
+        size_t packed = 0;
+        midi_parser_t packed_parser = *configured;
+        midi_parser_t dispatch_parser = *configured;
+        midi_dispatcher_t dispatcher;
+
+        filtered = *configured;
+        memset(actual_messages, 0, length * sizeof(midi_message_t));
+        dispatch_all_to_recorder(&dispatcher);
+
+        for (size_t offset = 0; offset < length; offset += chunks[c]) {
+            size_t size = (length - offset < chunks[c]) ? length - offset
+                                                        : chunks[c];
+            count += midi_parse_buffer(&filtered,
+                                       &bytes[offset],
+                                       size,
+                                       &actual_messages[count],
+                                       size,
+                                       NULL);
+            packed += midi_parse_buffer_packed(&packed_parser,
+                                               &bytes[offset],
+                                               size,
+                                               &actual_packed[packed],
+                                               size,
+                                               NULL);
+            midi_parse_buffer_dispatch(
+                &dispatch_parser, &dispatcher, &bytes[offset], size);
+        }
+
+        TEST_ASSERT_EQUAL(expected_count, count);
+        TEST_ASSERT_EQUAL(expected_count, packed);
+        TEST_ASSERT_EQUAL(expected_count, dispatched_count);
+        TEST_ASSERT_EQUAL_MEMORY(expected_messages,
+                                 actual_messages,
+                                 expected_count * sizeof(midi_message_t));
+        for (size_t i = 0; i < expected_count; i++) {
+            TEST_ASSERT_EQUAL_HEX32(midi_message_pack(&expected_messages[i]),
+                                    actual_packed[i]);
+            TEST_ASSERT_EQUAL_HEX32(actual_packed[i], dispatched[i]);
+        }
+    }
+}
+
+static int keep_channels_1_and_3(const midi_message_t *m)
+{
+    return m->channel == MIDI_CHANNEL_NONE || m->channel == MIDI_CHANNEL_1
+           || m->channel == MIDI_CHANNEL_3;
+}
+
+static int keep_channel_2(const midi_message_t *m)
+{
+    return m->channel == MIDI_CHANNEL_NONE || m->channel == MIDI_CHANNEL_2;
+}
+
+static int keep_all_but_note_on(const midi_message_t *m)
+{
+    return m->message_type != MIDI_MESSAGE_NOTE_ON;
+}
+
+static int keep_all_but_note_off(const midi_message_t *m)
+{
+    return m->message_type != MIDI_MESSAGE_NOTE_OFF;
+}
+
+static int keep_controllers(const midi_message_t *m)
+{
+    if (m->message_type == MIDI_MESSAGE_CONTROL_CHANGE) {
+        return m->controller != MIDI_CC_CHANNEL_VOLUME
+               && m->controller != MIDI_CC_MOD_WHEEL;
+    }
+    return m->message_type != MIDI_MESSAGE_ALL_NOTES_OFF;
+}
+
+static int keep_channel_modes_only(const midi_message_t *m)
+{
+    if (m->channel == MIDI_CHANNEL_NONE) { return 1; }
+    return m->message_type >= MIDI_MESSAGE_ALL_SOUND_OFF
+           && m->message_type <= MIDI_MESSAGE_POLY_ON;
+}
+
+static int keep_non_system(const midi_message_t *m)
+{
+    return m->channel != MIDI_CHANNEL_NONE
+           || m->message_type == MIDI_MESSAGE_SONG_SELECT;
+}
+
+/**
+ * @brief Filtered parsers return exactly the accepted messages
+ */
+void test_filter_differential(void)
+{
+    midi_parser_t configured;
+    size_t length = generate_random_stream(vector, FILTER_STREAM_SIZE);
+
+    midi_parser_init(&configured);
+    midi_parser_set_channel_mask(&configured, 0x0005);
+    assert_filter_matches(vector, length, &configured, keep_channels_1_and_3);
+
+    midi_parser_init(&configured);
+    midi_parser_set_active_channel(&configured, MIDI_CHANNEL_2);
+    assert_filter_matches(vector, length, &configured, keep_channel_2);
+
+    midi_parser_init(&configured);
+    midi_parser_set_message_enabled(&configured, MIDI_MESSAGE_NOTE_ON, 0);
+    assert_filter_matches(vector, length, &configured, keep_all_but_note_on);
+
+    midi_parser_init(&configured);
+    midi_parser_set_message_enabled(&configured, MIDI_MESSAGE_NOTE_OFF, 0);
+    assert_filter_matches(vector, length, &configured, keep_all_but_note_off);
+
+    midi_parser_init(&configured);
+    midi_parser_set_controller_enabled(
+        &configured, MIDI_CC_CHANNEL_VOLUME, 0);
+    midi_parser_set_controller_enabled(&configured, MIDI_CC_MOD_WHEEL, 0);
+    midi_parser_set_message_enabled(
+        &configured, MIDI_MESSAGE_ALL_NOTES_OFF, 0);
+    assert_filter_matches(vector, length, &configured, keep_controllers);
+
+    midi_parser_init(&configured);
+    for (int type = MIDI_MESSAGE_NOTE_OFF; type <= MIDI_MESSAGE_PITCH_BEND;
+         type += 0x10) {
+        midi_parser_set_message_enabled(
+            &configured, (midi_message_type_t)type, 0);
+    }
+    assert_filter_matches(
+        vector, length, &configured, keep_channel_modes_only);
+
+    midi_parser_init(&configured);
+    for (int type = MIDI_MESSAGE_SYSTEM_EXCLUSIVE; type <= 0xFF; type++) {
+        midi_parser_set_message_enabled(
+            &configured, (midi_message_type_t)type, 0);
+    }
+    midi_parser_set_message_enabled(
+        &configured, MIDI_MESSAGE_SONG_SELECT, 1);
+    assert_filter_matches(vector, length, &configured, keep_non_system);
+}
+
+/**
+ * @brief Data bytes of rejected status bytes are skipped
+ * @details Including across System Real-Time bytes and buffer boundaries
+ */
+void test_filter_rejects_at_status_byte(void)
+{
+    const uint8_t stream[] = {
+        0x90, 60, 100, 0xF8, 61, 0x91, 62, 100, 0x92, 1, 0xF8, 2, 3, 4};
+    midi_message_t messages[8];
+
+    midi_parser_set_channel_mask(&parser, 0x0002);
+    TEST_ASSERT_EQUAL(MIDI_CHANNEL_2,
+                      midi_parser_get_active_channel(&parser));
+
+    size_t count =
+        midi_parse_buffer(&parser, stream, 5, messages, 8, NULL);
+    count += midi_parse_buffer(
+        &parser, &stream[5], sizeof(stream) - 5, &messages[count], 8, NULL);
+
+    TEST_ASSERT_EQUAL(3, count);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_TIMING_CLOCK, messages[0].message_type);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_ON, messages[1].message_type);
+    TEST_ASSERT_EQUAL(MIDI_CHANNEL_2, messages[1].channel);
+    TEST_ASSERT_EQUAL(62, messages[1].note);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_TIMING_CLOCK, messages[2].message_type);
+}
+
+/**
+ * @brief Channel mask and active channel are kept in step
+ */
+void test_filter_active_channel(void)
+{
+    TEST_ASSERT_EQUAL(MIDI_CHANNEL_NONE,
+                      midi_parser_get_active_channel(&parser));
+    TEST_ASSERT_EQUAL_HEX16(0xFFFF, midi_parser_get_channel_mask(&parser));
+
+    midi_parser_set_active_channel(&parser, MIDI_CHANNEL_10);
+    TEST_ASSERT_EQUAL(MIDI_CHANNEL_10,
+                      midi_parser_get_active_channel(&parser));
+    TEST_ASSERT_EQUAL_HEX16(0x0200, midi_parser_get_channel_mask(&parser));
+
+    /* Filters are kept on reset */
+    midi_parser_reset(&parser);
+    TEST_ASSERT_EQUAL(MIDI_CHANNEL_10,
+                      midi_parser_get_active_channel(&parser));
+
+    midi_parser_set_channel_mask(&parser, 0x0300);
+    TEST_ASSERT_EQUAL(MIDI_CHANNEL_NONE,
+                      midi_parser_get_active_channel(&parser));
+
+    midi_parser_set_active_channel(&parser, MIDI_CHANNEL_NONE);
+    TEST_ASSERT_EQUAL_HEX16(0xFFFF, midi_parser_get_channel_mask(&parser));
+
+    /* NULL pointer handling */
+    midi_parser_set_active_channel(NULL, MIDI_CHANNEL_1);
+    midi_parser_set_channel_mask(NULL, 0x0001);
+    midi_parser_set_message_enabled(NULL, MIDI_MESSAGE_NOTE_ON, 0);
+    midi_parser_set_controller_enabled(NULL, MIDI_CC_MOD_WHEEL, 0);
+    TEST_ASSERT_EQUAL(MIDI_CHANNEL_NONE, midi_parser_get_active_channel(NULL));
+    TEST_ASSERT_EQUAL_HEX16(0xFFFF, midi_parser_get_channel_mask(NULL));
+}
+
+/*=====================================================================*
+    Realtime Lane
+ *=====================================================================*/
+
+/**
+ * @brief Maximum number of entries in the event log
+ */
+#define MAX_LOG (32)
+
+/**
+ * @brief Log of realtime events and dispatched messages, in call order
+ */
+static midi_realtime_event_t realtime_log[MAX_LOG];
+static uint8_t event_log[MAX_LOG];
+static size_t realtime_count;
+static size_t event_count;
+static uint32_t fake_time;
+
+static void record_realtime(void *context, const midi_realtime_event_t *e)
+{
+    (void)context;
+    TEST_ASSERT_LESS_THAN(MAX_LOG, realtime_count);
+    realtime_log[realtime_count++] = *e;
+    event_log[event_count++] = (uint8_t)e->message_type;
+}
+
+static void log_message(void *context, const midi_message_t *m)
+{
+    (void)context;
+    TEST_ASSERT_LESS_THAN(MAX_LOG, event_count);
+    event_log[event_count++] = (uint8_t)m->message_type;
+}
+
+static uint32_t next_timestamp(void *context)
+{
+    TEST_ASSERT_EQUAL_PTR(&fake_time, context);
+    return ++fake_time;
+}
+
+static void count_realtime(void *context, const midi_realtime_event_t *e)
+{
+    (void)context;
+    (void)e;
+    realtime_count++;
+}
+
+static int keep_non_realtime(const midi_message_t *m)
+{
+    return m->message_type < MIDI_MESSAGE_TIMING_CLOCK;
+}
+
+/**
+ * @brief System Real-Time bytes are delivered to the realtime handler
+ *        instead of the output array
+ */
+void test_realtime_lane(void)
+{
+    const uint8_t stream[] = {
+        0x90, 60, 0xF8, 100, 0xFA, 0xF9, 62, 0xFE, 0, 0xFC};
+    midi_message_t messages[8];
+
+    realtime_count = 0;
+    event_count = 0;
+    fake_time = 0;
+    midi_parser_set_realtime_handler(
+        &parser, record_realtime, next_timestamp, &fake_time);
+
+    size_t count =
+        midi_parse_buffer(&parser, stream, sizeof(stream), messages, 8, NULL);
+
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_ON, messages[0].message_type);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_OFF, messages[1].message_type);
+
+    /* The undefined 0xF9 byte is not delivered */
+    TEST_ASSERT_EQUAL(4, realtime_count);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_TIMING_CLOCK, realtime_log[0].message_type);
+    TEST_ASSERT_EQUAL(2, realtime_log[0].offset);
+    TEST_ASSERT_EQUAL(1, realtime_log[0].timestamp);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_START, realtime_log[1].message_type);
+    TEST_ASSERT_EQUAL(4, realtime_log[1].offset);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_ACTIVE_SENSE, realtime_log[2].message_type);
+    TEST_ASSERT_EQUAL(7, realtime_log[2].offset);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_STOP, realtime_log[3].message_type);
+    TEST_ASSERT_EQUAL(9, realtime_log[3].offset);
+    TEST_ASSERT_EQUAL(4, realtime_log[3].timestamp);
+}
+
+/**
+ * @brief Realtime events are delivered in stream order with dispatch
+ */
+void test_realtime_lane_order(void)
+{
+    const uint8_t stream[] = {0x90, 60, 100, 62, 0xF8, 100, 64, 100, 0xFF};
+    const uint8_t expected[] = {MIDI_MESSAGE_NOTE_ON,
+                                MIDI_MESSAGE_TIMING_CLOCK,
+                                MIDI_MESSAGE_NOTE_ON,
+                                MIDI_MESSAGE_NOTE_ON,
+                                MIDI_MESSAGE_SYSTEM_RESET};
+    midi_dispatcher_t dispatcher;
+
+    realtime_count = 0;
+    event_count = 0;
+    midi_dispatcher_init(&dispatcher, NULL);
+    for (int type = 0; type < 256; type++) {
+        midi_dispatcher_set_handler(
+            &dispatcher, (midi_message_type_t)type, log_message);
+    }
+    midi_parser_set_realtime_handler(&parser, record_realtime, NULL, NULL);
+
+    TEST_ASSERT_EQUAL(3,
+                      midi_parse_buffer_dispatch(
+                          &parser, &dispatcher, stream, sizeof(stream)));
+    TEST_ASSERT_EQUAL(sizeof(expected), event_count);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, event_log, sizeof(expected));
+    TEST_ASSERT_EQUAL(0, realtime_log[0].timestamp);
+}
+
+/**
+ * @brief The realtime lane leaves the other messages unchanged
+ */
+void test_realtime_lane_differential(void)
+{
+    midi_parser_t configured;
+    size_t length = generate_random_stream(vector, FILTER_STREAM_SIZE);
+
+    midi_parser_init(&configured);
+    midi_parser_set_realtime_handler(
+        &configured, count_realtime, NULL, NULL);
+    assert_filter_matches(vector, length, &configured, keep_non_realtime);
+}
+
+/**
+ * @brief The realtime lane honours filters and survives a reset
+ */
+void test_realtime_lane_filter_and_reset(void)
+{
+    const uint8_t stream[] = {0xFE, 0xF8, 0xFE};
+    midi_message_t messages[4];
+
+    realtime_count = 0;
+    event_count = 0;
+    midi_parser_set_realtime_handler(&parser, record_realtime, NULL, NULL);
+    midi_parser_set_message_enabled(&parser, MIDI_MESSAGE_ACTIVE_SENSE, 0);
+    midi_parser_reset(&parser);
+
+    TEST_ASSERT_EQUAL(0,
+                      midi_parse_buffer(
+                          &parser, stream, sizeof(stream), messages, 4, NULL));
+    TEST_ASSERT_EQUAL(1, realtime_count);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_TIMING_CLOCK, realtime_log[0].message_type);
+
+    /* midi_parse_byte is not affected */
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_TIMING_CLOCK,
+                      midi_parse_byte(&parser, 0xF8, &message));
+    TEST_ASSERT_EQUAL(1, realtime_count);
+
+    /* NULL pointer handling */
+    midi_parser_set_realtime_handler(NULL, record_realtime, NULL, NULL);
+    midi_parser_set_realtime_handler(&parser, NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(1,
+                      midi_parse_buffer(
+                          &parser, stream, sizeof(stream), messages, 4, NULL));
+}
+
+/*=====================================================================*
+    Timed Parsing Tests
+ *=====================================================================*/
+
+static uint32_t expected_times[FILTER_STREAM_SIZE];
+static uint32_t actual_times[FILTER_STREAM_SIZE];
+static uint32_t packed_times[FILTER_STREAM_SIZE];
+
+/**
+ * @brief Parse a stream one byte at a time, timing each message by the
+ *        byte that completes it
+ * @return The number of messages written to messages
+ */
+static size_t parse_bytewise_timed(midi_parser_t *p,
+                                   const uint8_t *bytes,
+                                   size_t length,
+                                   uint32_t base,
+                                   uint32_t period,
+                                   midi_message_t *messages,
+                                   uint32_t *timestamps)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (midi_parse_byte(p, bytes[i], &messages[count])
+            != MIDI_MESSAGE_NONE) {
+            timestamps[count++] = base + period * (uint32_t)i;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Timed parsing stamps each message with the time of the byte
+ *        that completes it, through running status runs and messages
+ *        parsed by the state machine
+ */
+void test_parse_buffer_timed(void)
+{
+    const uint8_t stream[] = {
+        0x90, 60, 100, 62, 90, 64, 80, 0xC1, 5, 6, 7, 0xF8, 0xB0, 7, 127};
+    const uint32_t times[] = {2, 4, 6, 8, 9, 10, 11, 14};
+    midi_message_t messages[8];
+    uint32_t timestamps[8];
+    size_t consumed = 0;
+
+    TEST_ASSERT_EQUAL(8,
+                      midi_parse_buffer_timed(&parser,
+                                              stream,
+                                              sizeof(stream),
+                                              0,
+                                              1,
+                                              messages,
+                                              timestamps,
+                                              8,
+                                              &consumed));
+    TEST_ASSERT_EQUAL(sizeof(stream), consumed);
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(times, timestamps, 8);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_PROGRAM_CHANGE, messages[5].message_type);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_TIMING_CLOCK, messages[6].message_type);
+
+    /* The clock wraps around */
+    midi_parser_reset(&parser);
+    TEST_ASSERT_EQUAL(1,
+                      midi_parse_buffer_timed(&parser,
+                                              stream,
+                                              3,
+                                              0xFFFFFF00u,
+                                              320,
+                                              messages,
+                                              timestamps,
+                                              8,
+                                              NULL));
+    TEST_ASSERT_EQUAL_UINT32(0x180, timestamps[0]);
+
+    /* Null pointer handling */
+    TEST_ASSERT_EQUAL(0,
+                      midi_parse_buffer_timed(
+                          NULL, stream, 3, 0, 1, messages, timestamps, 8,
+                          NULL));
+    TEST_ASSERT_EQUAL(0,
+                      midi_parse_buffer_timed(
+                          &parser, stream, 3, 0, 1, messages, NULL, 8, NULL));
+    TEST_ASSERT_EQUAL(0,
+                      midi_parse_buffer_packed_timed(
+                          &parser, stream, 3, 0, 1, NULL, timestamps, 8,
+                          NULL));
+    TEST_ASSERT_EQUAL(0,
+                      midi_parse_buffer_packed_timed(
+                          &parser, stream, 3, 0, 1, actual_packed, NULL, 8,
+                          NULL));
+}
+
+/**
+ * @brief Realtime events delivered to the handler are timed by their
+ *        byte instead of the timestamp source
+ */
+void test_parse_buffer_timed_realtime(void)
+{
+    const uint8_t stream[] = {0x90, 60, 0xF8, 100, 62, 0xFA, 100};
+    midi_packed_t packed[4];
+    uint32_t timestamps[4];
+
+    realtime_count = 0;
+    event_count = 0;
+    fake_time = 0;
+    midi_parser_set_realtime_handler(
+        &parser, record_realtime, next_timestamp, &fake_time);
+
+    TEST_ASSERT_EQUAL(2,
+                      midi_parse_buffer_packed_timed(&parser,
+                                                     stream,
+                                                     sizeof(stream),
+                                                     1000,
+                                                     320,
+                                                     packed,
+                                                     timestamps,
+                                                     4,
+                                                     NULL));
+    TEST_ASSERT_EQUAL_UINT32(1000 + 3 * 320, timestamps[0]);
+    TEST_ASSERT_EQUAL_UINT32(1000 + 6 * 320, timestamps[1]);
+    TEST_ASSERT_EQUAL(2, realtime_count);
+    TEST_ASSERT_EQUAL_UINT32(1000 + 2 * 320, realtime_log[0].timestamp);
+    TEST_ASSERT_EQUAL_UINT32(1000 + 5 * 320, realtime_log[1].timestamp);
+    TEST_ASSERT_EQUAL(0, fake_time);
+}
+
+/**
+ * @brief Timed parsing in chunks matches bytewise timing on a random
+ *        stream when the base advances by the consumed bytes
+ */
+void test_parse_buffer_timed_differential(void)
+{
+    const size_t chunks[] = {1, 7, 64, 1000, FILTER_STREAM_SIZE};
+    const uint32_t period = 320;
+    midi_parser_t expected_parser;
+    size_t length = generate_random_stream(vector, FILTER_STREAM_SIZE);
+
+    midi_parser_init(&expected_parser);
+    const size_t expected_count =
+        parse_bytewise_timed(&expected_parser, vector, length, 77, period,
+                             expected_messages, expected_times);
+
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        size_t count = 0;
+        size_t packed_count = 0;
+        midi_parser_t packed_parser;
+
+        midi_parser_init(&parser);
+        midi_parser_init(&packed_parser);
+        for (size_t offset = 0; offset < length; offset += chunks[c]) {
+            const uint32_t base = 77 + period * (uint32_t)offset;
+            size_t size = length - offset;
+            size_t consumed;
+            if (size > chunks[c]) { size = chunks[c]; }
+
+            count += midi_parse_buffer_timed(&parser,
+                                             &vector[offset],
+                                             size,
+                                             base,
+                                             period,
+                                             &actual_messages[count],
+                                             &actual_times[count],
+                                             size,
+                                             &consumed);
+            TEST_ASSERT_EQUAL(size, consumed);
+            packed_count +=
+                midi_parse_buffer_packed_timed(&packed_parser,
+                                               &vector[offset],
+                                               size,
+                                               base,
+                                               period,
+                                               &actual_packed[packed_count],
+                                               &packed_times[packed_count],
+                                               size,
+                                               &consumed);
+            TEST_ASSERT_EQUAL(size, consumed);
+        }
+
+        TEST_ASSERT_EQUAL(expected_count, count);
+        TEST_ASSERT_EQUAL(expected_count, packed_count);
+        TEST_ASSERT_EQUAL_UINT32_ARRAY(expected_times, actual_times, count);
+        TEST_ASSERT_EQUAL_UINT32_ARRAY(expected_times, packed_times, count);
+        for (size_t i = 0; i < count; i++) {
+            TEST_ASSERT_EQUAL(expected_messages[i].message_type,
+                              actual_messages[i].message_type);
+            TEST_ASSERT_EQUAL_HEX32(midi_message_pack(&expected_messages[i]),
+                                    actual_packed[i]);
+        }
+    }
+}
+
+/*=====================================================================*
+    Message Decoding Tests
+ *=====================================================================*/
+
+/**
+ * @brief midi_decode_message decodes complete messages the same way as
+ *        midi_parse_byte, for every status byte
+ */
+void test_decode_message_matches_parse_byte(void)
+{
+    static const uint8_t data[][2] = {
+        {0, 0}, {60, 100}, {60, 0}, {0x7F, 0x7F}, {120, 0}, {0x15, 0x40}};
+
+    for (unsigned status = 0x80; status <= 0xFF; status++) {
+        const size_t data_length = midi_status_data_length((uint8_t)status);
+
+        for (size_t d = 0; d < sizeof(data) / sizeof(data[0]); d++) {
+            midi_message_t expected = {0};
+            midi_message_t actual = {0};
+            midi_message_type_t expected_type;
+
+            /* Feed the message to a fresh parser */
+            midi_parser_init(&parser);
+            expected_type =
+                midi_parse_byte(&parser, (uint8_t)status, &expected);
+            for (size_t i = 0; i < data_length; i++) {
+                expected_type =
+                    midi_parse_byte(&parser, data[d][i], &expected);
+            }
+            if (expected_type == MIDI_MESSAGE_NONE) {
+                expected.message_type = MIDI_MESSAGE_NONE;
+            }
+
+            TEST_ASSERT_EQUAL_HEX8(
+                expected_type,
+                midi_decode_message(
+                    (uint8_t)status, data[d][0], data[d][1], &actual));
+            if (expected_type != MIDI_MESSAGE_NONE) {
+                TEST_ASSERT_EQUAL_HEX32(midi_message_pack(&expected),
+                                        midi_message_pack(&actual));
+            }
+        }
+    }
+}
+
+/**
+ * @brief Status byte data lengths and invalid arguments
+ */
+void test_decode_message_data_length(void)
+{
+    TEST_ASSERT_EQUAL(2, midi_status_data_length(0x93));
+    TEST_ASSERT_EQUAL(1, midi_status_data_length(0xC0));
+    TEST_ASSERT_EQUAL(1, midi_status_data_length(0xF1));
+    TEST_ASSERT_EQUAL(2, midi_status_data_length(0xF2));
+    TEST_ASSERT_EQUAL(0, midi_status_data_length(0xF0));
+    TEST_ASSERT_EQUAL(0, midi_status_data_length(0xF8));
+    TEST_ASSERT_EQUAL(0, midi_status_data_length(0x40));
+
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NONE,
+                      midi_decode_message(0x90, 60, 100, NULL));
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NONE,
+                      midi_decode_message(0x40, 60, 100, &message));
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NONE,
+                      midi_decode_message(0xF4, 0, 0, &message));
+}
+
+/**
+ * @brief Test that midi_parser_accepts agrees with the parser filters
+ */
+void test_parser_accepts_matches_parse_byte(void)
+{
+    static const uint8_t data[][2] = {
+        {60, 100}, {60, 0}, {1, 0x40}, {7, 0x40}, {123, 0}, {0x15, 0x40}};
+    midi_parser_t config;
+
+    midi_parser_init(&config);
+    midi_parser_set_channel_mask(&config, 0x0005);
+    midi_parser_set_message_enabled(&config, MIDI_MESSAGE_NOTE_OFF, 0);
+    midi_parser_set_message_enabled(&config, MIDI_MESSAGE_ALL_NOTES_OFF, 0);
+    midi_parser_set_message_enabled(&config, MIDI_MESSAGE_TIMING_CLOCK, 0);
+    midi_parser_set_controller_enabled(&config, MIDI_CC_MOD_WHEEL, 0);
+
+    for (unsigned status = 0x80; status <= 0xFF; status++) {
+        const size_t data_length = midi_status_data_length((uint8_t)status);
+
+        for (size_t d = 0; d < sizeof(data) / sizeof(data[0]); d++) {
+            midi_message_type_t parsed;
+
+            if (midi_decode_message(
+                    (uint8_t)status, data[d][0], data[d][1], &message)
+                == MIDI_MESSAGE_NONE) {
+                continue;
+            }
+
+            parser = config;
+            parsed = midi_parse_byte(&parser, (uint8_t)status, &message);
+            for (size_t i = 0; i < data_length; i++) {
+                parsed = midi_parse_byte(&parser, data[d][i], &message);
+            }
+
+            TEST_ASSERT_EQUAL(parsed != MIDI_MESSAGE_NONE,
+                              midi_parser_accepts(&config, (uint8_t)status,
+                                                  data[d][0], data[d][1]));
+        }
+    }
+
+    TEST_ASSERT_FALSE(midi_parser_accepts(NULL, 0x90, 60, 100));
+    TEST_ASSERT_FALSE(midi_parser_accepts(&config, 0x40, 60, 100));
+}
+
+/*=====================================================================*
+    Parser State Tests
+ *=====================================================================*/
+
+/**
+ * @brief Parsing resumes exactly from a saved state, at every offset of
+ *        a random stream
+ */
+void test_parser_state_resume(void)
+{
+    static uint8_t stream[512];
+    static midi_packed_t expected[512];
+    midi_parser_t resumed;
+    midi_parser_state_t state;
+    size_t expected_count = 0;
+
+    generate_random_stream(stream, sizeof(stream));
+    midi_parser_init(&parser);
+    for (size_t i = 0; i < sizeof(stream); i++) {
+        if (midi_parse_byte(&parser, stream[i], &message)
+            != MIDI_MESSAGE_NONE) {
+            expected[expected_count++] = midi_message_pack(&message);
+        }
+    }
+
+    for (size_t split = 0; split <= sizeof(stream); split++) {
+        size_t count = 0;
+
+        midi_parser_init(&parser);
+        for (size_t i = 0; i < split; i++) {
+            if (midi_parse_byte(&parser, stream[i], &message)
+                != MIDI_MESSAGE_NONE) {
+                count++;
+            }
+        }
+
+        midi_parser_save_state(&parser, &state);
+        midi_parser_init(&resumed);
+        midi_parser_restore_state(&resumed, &state);
+        assert_same_parser_state(&parser, &resumed);
+
+        for (size_t i = split; i < sizeof(stream); i++) {
+            if (midi_parse_byte(&resumed, stream[i], &message)
+                != MIDI_MESSAGE_NONE) {
+                TEST_ASSERT_EQUAL_HEX32(expected[count++],
+                                        midi_message_pack(&message));
+            }
+        }
+        TEST_ASSERT_EQUAL(expected_count, count);
+    }
+}
+
+/**
+ * @brief Restoring into a filtered parser drops running status that its
+ *        filters reject
+ */
+void test_parser_state_restore_filtered(void)
+{
+    midi_parser_t filtered;
+    midi_parser_state_t state;
+
+    midi_parser_init(&parser);
+    midi_parse_byte(&parser, 0x92, &message);
+    midi_parse_byte(&parser, 60, &message);
+    midi_parser_save_state(&parser, &state);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_ON, state.message_type);
+    TEST_ASSERT_EQUAL(MIDI_CHANNEL_3, state.channel);
+    TEST_ASSERT_EQUAL(1, state.byte_count);
+
+    midi_parser_init(&filtered);
+    midi_parser_set_channel_mask(&filtered, 1u << MIDI_CHANNEL_3);
+    midi_parser_restore_state(&filtered, &state);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_ON,
+                      midi_parse_byte(&filtered, 100, &message));
+    TEST_ASSERT_EQUAL(60, message.note);
+
+    midi_parser_init(&filtered);
+    midi_parser_set_channel_mask(&filtered, 1u << MIDI_CHANNEL_1);
+    midi_parser_restore_state(&filtered, &state);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NONE,
+                      midi_parse_byte(&filtered, 100, &message));
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NONE,
+                      midi_parse_byte(&filtered, 60, &message));
+
+    /* NULL pointers are ignored */
+    midi_parser_save_state(NULL, &state);
+    midi_parser_save_state(&parser, NULL);
+    midi_parser_restore_state(NULL, &state);
+    midi_parser_restore_state(&parser, NULL);
+}
 
 /*=====================================================================*
     Main Test Runner
@@ -968,15 +2683,21 @@ int main(void)
     RUN_TEST(test_note_off_message);
     RUN_TEST(test_poly_key_pressure);
     RUN_TEST(test_control_change_message);
+#if MIDI_CONFIG_CHANNEL_MODE
     RUN_TEST(test_channel_mode_messages);
+#endif
     RUN_TEST(test_program_change_message);
     RUN_TEST(test_pitch_bend_message);
     RUN_TEST(test_channel_pressure_message);
 
     // System messages
+#if MIDI_CONFIG_MTC
     RUN_TEST(test_mtc_quarter_frame_message);
+#endif
+#if MIDI_CONFIG_SONG
     RUN_TEST(test_song_position_pointer_message);
     RUN_TEST(test_song_select_message);
+#endif
     RUN_TEST(test_tune_request_message);
     RUN_TEST(test_timing_clock_message);
     RUN_TEST(test_start_message);
@@ -984,17 +2705,81 @@ int main(void)
     RUN_TEST(test_stop_message);
     RUN_TEST(test_active_sense_message);
     RUN_TEST(test_system_reset_message);
+#if MIDI_CONFIG_SYSEX
     RUN_TEST(test_sysex_message);
+#endif
 
     // Interruptions
     RUN_TEST(test_interrupt_channel_message_with_system_realtime_messages);
     RUN_TEST(test_interrupt_channel_message_with_undefined_status_bytes);
+#if MIDI_CONFIG_SYSEX
     RUN_TEST(test_interrupt_sysex_with_system_realtime_messages);
     RUN_TEST(test_interrupt_sysex_with_undefined_status_bytes);
+#endif
 
     // Partial messages
     RUN_TEST(test_partial_channel_message);
+#if MIDI_CONFIG_SYSEX
     RUN_TEST(test_partial_sysex_message);
+#endif
+
+    // Buffer parsing
+    RUN_TEST(test_parse_buffer_matches_parse_byte);
+    RUN_TEST(test_parse_buffer_chunked);
+    RUN_TEST(test_parse_buffer_capacity);
+    RUN_TEST(test_parse_buffer_null_pointer_handling);
+
+    // Packed messages
+    RUN_TEST(test_packed_size);
+    RUN_TEST(test_packed_fields);
+    RUN_TEST(test_packed_round_trip);
+    RUN_TEST(test_parse_buffer_packed);
+
+    // Differential tests
+    RUN_TEST(test_differential_two_byte_channel_messages);
+    RUN_TEST(test_differential_one_byte_channel_messages);
+    RUN_TEST(test_differential_interrupted_runs);
+
+    // SysEx spans
+#if MIDI_CONFIG_SYSEX
+    RUN_TEST(test_sysex_span_single);
+    RUN_TEST(test_sysex_span_empty);
+    RUN_TEST(test_sysex_span_interrupted_by_realtime);
+    RUN_TEST(test_sysex_span_aborted);
+    RUN_TEST(test_sysex_span_chunked);
+    RUN_TEST(test_sysex_span_messages_unchanged);
+#endif
+    RUN_TEST(test_sysex_handler_kept_on_reset);
+
+    // Dispatch
+    RUN_TEST(test_dispatch_by_type);
+    RUN_TEST(test_dispatch_by_controller);
+    RUN_TEST(test_dispatch_null_pointer_handling);
+
+    // Filters
+    RUN_TEST(test_filter_differential);
+    RUN_TEST(test_filter_rejects_at_status_byte);
+    RUN_TEST(test_filter_active_channel);
+
+    // Realtime lane
+    RUN_TEST(test_realtime_lane);
+    RUN_TEST(test_realtime_lane_order);
+    RUN_TEST(test_realtime_lane_differential);
+    RUN_TEST(test_realtime_lane_filter_and_reset);
+
+    // Timed parsing
+    RUN_TEST(test_parse_buffer_timed);
+    RUN_TEST(test_parse_buffer_timed_realtime);
+    RUN_TEST(test_parse_buffer_timed_differential);
+
+    // Message decoding
+    RUN_TEST(test_decode_message_matches_parse_byte);
+    RUN_TEST(test_decode_message_data_length);
+    RUN_TEST(test_parser_accepts_matches_parse_byte);
+
+    // Parser state
+    RUN_TEST(test_parser_state_resume);
+    RUN_TEST(test_parser_state_restore_filtered);
 
     return UNITY_END();
 }
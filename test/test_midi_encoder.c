@@ -0,0 +1,510 @@
+/***********************************************************************
+ * @file test_midi_encoder.c
+ * @brief Unit tests for the MIDI encoder module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_encoder.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define FUZZ_MESSAGES (4096)
+#define FUZZ_ROUNDS (64)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static midi_encoder_t encoder;
+static uint8_t output[3 * FUZZ_MESSAGES];
+static midi_message_t fuzz_messages[FUZZ_MESSAGES];
+static uint32_t random_state;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void) { midi_encoder_init(&encoder); }
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Build a channel message
+ */
+static midi_message_t channel_message(midi_message_type_t message_type,
+                                      midi_channel_t channel,
+                                      uint8_t data1,
+                                      uint8_t data2)
+{
+    midi_message_t result;
+    midi_message_unpack(midi_packed_make(message_type, channel, data1, data2),
+                        &result);
+    return result;
+}
+
+/**
+ * @brief Build a message without a channel
+ */
+static midi_message_t system_message(midi_message_type_t message_type,
+                                     uint8_t data1,
+                                     uint8_t data2)
+{
+    return channel_message(message_type, MIDI_CHANNEL_NONE, data1, data2);
+}
+
+/**
+ * @brief Encode an array of messages that is known to fit
+ * @return The number of bytes written to output
+ */
+static size_t encode_all(const midi_message_t *messages, size_t count)
+{
+    size_t encoded;
+    size_t written = midi_encode_messages(
+        &encoder, messages, count, output, sizeof(output), &encoded);
+    TEST_ASSERT_EQUAL(count, encoded);
+    return written;
+}
+
+/**
+ * @brief Deterministic pseudo random number generator (xorshift32)
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief Generate a random message of any type that can be encoded
+ *        and that the parser of this build decodes
+ */
+static midi_message_t random_message(void)
+{
+    static const midi_message_type_t channel_types[] = {
+        MIDI_MESSAGE_NOTE_OFF,
+        MIDI_MESSAGE_NOTE_ON,
+        MIDI_MESSAGE_KEY_PRESSURE,
+        MIDI_MESSAGE_CONTROL_CHANGE,
+        MIDI_MESSAGE_PROGRAM_CHANGE,
+        MIDI_MESSAGE_CHANNEL_PRESSURE,
+        MIDI_MESSAGE_PITCH_BEND,
+#if MIDI_CONFIG_CHANNEL_MODE
+        MIDI_MESSAGE_ALL_NOTES_OFF,
+#endif
+    };
+    static const midi_message_type_t system_types[] = {
+#if MIDI_CONFIG_SYSEX
+        MIDI_MESSAGE_SYSTEM_EXCLUSIVE,
+#endif
+#if MIDI_CONFIG_MTC
+        MIDI_MESSAGE_MTC_QUARTER_FRAME,
+#endif
+#if MIDI_CONFIG_SONG
+        MIDI_MESSAGE_SONG_POSITION_POINTER,
+        MIDI_MESSAGE_SONG_SELECT,
+#endif
+        MIDI_MESSAGE_TUNE_REQUEST,
+#if MIDI_CONFIG_SYSEX
+        MIDI_MESSAGE_END_OF_EXCLUSIVE,
+#endif
+        MIDI_MESSAGE_TIMING_CLOCK,
+        MIDI_MESSAGE_START,
+        MIDI_MESSAGE_CONTINUE,
+        MIDI_MESSAGE_STOP,
+        MIDI_MESSAGE_ACTIVE_SENSE,
+        MIDI_MESSAGE_SYSTEM_RESET,
+    };
+    const size_t channel_type_count =
+        sizeof(channel_types) / sizeof(channel_types[0]);
+    const size_t system_type_count =
+        sizeof(system_types) / sizeof(system_types[0]);
+    const uint32_t r = next_random();
+    const uint8_t data1 = (r >> 8) & 0x7F;
+    const uint8_t data2 = (r >> 16) & 0x7F;
+
+    /* Mostly channel messages on a few channels, so running status
+     * has something to compress */
+    if ((r & 0x07) != 0) {
+        const midi_message_type_t message_type =
+            channel_types[(r >> 3) % channel_type_count];
+        const midi_channel_t channel = (midi_channel_t)((r >> 24) & 0x03);
+        if (message_type == MIDI_MESSAGE_CONTROL_CHANGE) {
+            /* Controllers 120-127 decode as Channel Mode messages */
+            return channel_message(message_type, channel, data1 % 120, data2);
+        }
+        if (message_type == MIDI_MESSAGE_ALL_NOTES_OFF) {
+            return channel_message(
+                message_type, channel, MIDI_CC_ALL_NOTES_OFF, 0);
+        }
+        return channel_message(message_type, channel, data1, data2);
+    }
+    return system_message(
+        system_types[(r >> 3) % system_type_count], data1, data2);
+}
+
+/**
+ * @brief The message the parser is expected to decode from an
+ *        encoded message
+ */
+static midi_packed_t expected_packed(const midi_message_t *sent,
+                                     int note_off_as_note_on)
+{
+    midi_message_t expected = *sent;
+
+    if (expected.message_type == MIDI_MESSAGE_NOTE_OFF
+        && note_off_as_note_on) {
+        expected.velocity = 0;
+    }
+    if (expected.message_type == MIDI_MESSAGE_NOTE_ON
+        && expected.velocity == 0) {
+        expected.message_type = MIDI_MESSAGE_NOTE_OFF;
+    }
+    return midi_message_pack(&expected);
+}
+
+/*=====================================================================*
+    Basic Tests
+ *=====================================================================*/
+
+/**
+ * @brief MIDI encoder initialization
+ */
+void test_encoder_init(void)
+{
+    midi_encoder_t test_encoder;
+
+    memset(&test_encoder, 0xFF, sizeof(test_encoder));
+    midi_encoder_init(&test_encoder);
+
+    TEST_ASSERT_EQUAL(0, test_encoder.running_status);
+    TEST_ASSERT_TRUE(test_encoder.running_status_enabled);
+    TEST_ASSERT_FALSE(test_encoder.note_off_as_note_on);
+}
+
+/**
+ * @brief MIDI encoder null pointer handling
+ */
+void test_encoder_null_pointer_handling(void)
+{
+    const midi_message_t note = channel_message(
+        MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100);
+    const midi_packed_t packed = midi_message_pack(&note);
+    size_t encoded = 99;
+
+    midi_encoder_init(NULL);
+    midi_encoder_reset(NULL);
+    midi_encoder_set_running_status(NULL, 0);
+    midi_encoder_set_note_off_as_note_on(NULL, 1);
+
+    TEST_ASSERT_EQUAL(0, midi_encode_message(NULL, &note, output, 3));
+    TEST_ASSERT_EQUAL(0, midi_encode_message(&encoder, NULL, output, 3));
+    TEST_ASSERT_EQUAL(0, midi_encode_message(&encoder, &note, NULL, 3));
+    TEST_ASSERT_EQUAL(
+        0, midi_encode_messages(NULL, &note, 1, output, 3, &encoded));
+    TEST_ASSERT_EQUAL(0, encoded);
+    TEST_ASSERT_EQUAL(
+        0, midi_encode_packed(&encoder, &packed, 1, NULL, 3, NULL));
+    TEST_ASSERT_EQUAL(0, midi_encode_sysex(NULL, NULL, 0, output, 3));
+    TEST_ASSERT_EQUAL(0, midi_encode_sysex(&encoder, NULL, 1, output, 3));
+    TEST_ASSERT_EQUAL(0, encoder.running_status);
+}
+
+/*=====================================================================*
+    Running Status Tests
+ *=====================================================================*/
+
+/**
+ * @brief Repeated channel status bytes are left out
+ */
+void test_encoder_running_status(void)
+{
+    const midi_message_t messages[] = {
+        channel_message(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100),
+        channel_message(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 64, 100),
+        channel_message(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_2, 67, 100),
+        channel_message(MIDI_MESSAGE_PROGRAM_CHANGE, MIDI_CHANNEL_2, 5, 0),
+        channel_message(MIDI_MESSAGE_PROGRAM_CHANGE, MIDI_CHANNEL_2, 6, 0),
+    };
+    const uint8_t expected[] = {
+        0x90, 60, 100, 64, 100, 0x91, 67, 100, 0xC1, 5, 6};
+
+    TEST_ASSERT_EQUAL(sizeof(expected), encode_all(messages, 5));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, output, sizeof(expected));
+}
+
+/**
+ * @brief Every message has a status byte with running status disabled,
+ *        or after a reset
+ */
+void test_encoder_running_status_disabled(void)
+{
+    const midi_message_t note = channel_message(
+        MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100);
+
+    TEST_ASSERT_EQUAL(3, midi_encode_message(&encoder, &note, output, 3));
+    TEST_ASSERT_EQUAL(2, midi_encode_message(&encoder, &note, output, 3));
+    midi_encoder_reset(&encoder);
+    TEST_ASSERT_EQUAL(3, midi_encode_message(&encoder, &note, output, 3));
+
+    midi_encoder_set_running_status(&encoder, 0);
+    TEST_ASSERT_EQUAL(3, midi_encode_message(&encoder, &note, output, 3));
+    TEST_ASSERT_EQUAL(3, midi_encode_message(&encoder, &note, output, 3));
+    TEST_ASSERT_EQUAL_HEX8(0x90, output[0]);
+}
+
+/**
+ * @brief Note Off can be sent as Note On with velocity 0 to keep
+ *        running status
+ */
+void test_encoder_note_off_as_note_on(void)
+{
+    const midi_message_t messages[] = {
+        channel_message(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100),
+        channel_message(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 60, 64),
+    };
+    const uint8_t plain[] = {0x90, 60, 100, 0x80, 60, 64};
+    const uint8_t converted[] = {0x90, 60, 100, 60, 0};
+
+    TEST_ASSERT_EQUAL(sizeof(plain), encode_all(messages, 2));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(plain, output, sizeof(plain));
+
+    midi_encoder_reset(&encoder);
+    midi_encoder_set_note_off_as_note_on(&encoder, 1);
+    TEST_ASSERT_EQUAL(sizeof(converted), encode_all(messages, 2));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(converted, output, sizeof(converted));
+}
+
+/**
+ * @brief System Common messages clear running status, and System
+ *        Real-Time messages do not
+ */
+void test_encoder_system_messages_and_running_status(void)
+{
+    const midi_message_t messages[] = {
+        channel_message(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_3, 7, 90),
+        system_message(MIDI_MESSAGE_TIMING_CLOCK, 0, 0),
+        channel_message(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_3, 7, 91),
+        system_message(MIDI_MESSAGE_SONG_SELECT, 3, 0),
+        channel_message(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_3, 7, 92),
+        system_message(MIDI_MESSAGE_TUNE_REQUEST, 0, 0),
+        channel_message(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_3, 7, 93),
+        system_message(MIDI_MESSAGE_SONG_POSITION_POINTER, 0x10, 0x20),
+        channel_message(MIDI_MESSAGE_ALL_NOTES_OFF, MIDI_CHANNEL_3, 123, 0),
+    };
+    const uint8_t expected[] = {
+        0xB2, 7, 90, 0xF8, 7, 91, 0xF3, 3, 0xB2, 7, 92, 0xF6,
+        0xB2, 7, 93, 0xF2, 0x10, 0x20, 0xB2, 123, 0};
+
+    TEST_ASSERT_EQUAL(sizeof(expected), encode_all(messages, 9));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, output, sizeof(expected));
+}
+
+/*=====================================================================*
+    Bulk Encoding Tests
+ *=====================================================================*/
+
+/**
+ * @brief Bulk encoding stops before the first message that does not fit,
+ *        and skips messages that cannot be encoded
+ */
+void test_encoder_bulk_capacity_and_invalid(void)
+{
+    const midi_message_t messages[] = {
+        channel_message(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100),
+        system_message(MIDI_MESSAGE_NONE, 0, 0),
+        channel_message(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_NONE, 1, 2),
+        channel_message(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 62, 100),
+        channel_message(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_2, 64, 100),
+    };
+    const uint8_t expected[] = {0x90, 60, 100, 62, 100, 0x91, 64, 100};
+    size_t encoded;
+
+    TEST_ASSERT_EQUAL(
+        0, midi_encode_message(&encoder, &messages[1], output, 3));
+    TEST_ASSERT_EQUAL(
+        0, midi_encode_message(&encoder, &messages[2], output, 3));
+
+    /* Room for the first two notes only */
+    TEST_ASSERT_EQUAL(
+        5, midi_encode_messages(&encoder, messages, 5, output, 7, &encoded));
+    TEST_ASSERT_EQUAL(4, encoded);
+    TEST_ASSERT_EQUAL(3,
+                      midi_encode_messages(
+                          &encoder, &messages[4], 1, &output[5], 3, &encoded));
+    TEST_ASSERT_EQUAL(1, encoded);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, output, sizeof(expected));
+}
+
+/**
+ * @brief Packed messages encode the same as midi_message_t
+ */
+void test_encoder_packed_matches_messages(void)
+{
+    midi_packed_t packed[256];
+    uint8_t from_messages[3 * 256];
+    size_t expected_length;
+
+    random_state = 0xC0FFEE;
+    for (size_t i = 0; i < 256; i++) {
+        fuzz_messages[i] = random_message();
+        packed[i] = midi_message_pack(&fuzz_messages[i]);
+    }
+
+    expected_length = encode_all(fuzz_messages, 256);
+    memcpy(from_messages, output, expected_length);
+
+    midi_encoder_init(&encoder);
+    TEST_ASSERT_EQUAL(expected_length,
+                      midi_encode_packed(
+                          &encoder, packed, 256, output, sizeof(output), NULL));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(from_messages, output, expected_length);
+}
+
+/**
+ * @brief Complete SysEx messages
+ */
+void test_encoder_sysex(void)
+{
+    const midi_message_t note = channel_message(
+        MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100);
+    const uint8_t payload[] = {0x7E, 0x7F, 0x06, 0x01};
+    const uint8_t expected[] = {0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7};
+    const uint8_t invalid[] = {0x01, 0x90};
+
+    midi_encode_message(&encoder, &note, output, 3);
+    TEST_ASSERT_EQUAL(0, midi_encode_sysex(&encoder, payload, 4, output, 5));
+    TEST_ASSERT_EQUAL(0, midi_encode_sysex(&encoder, invalid, 2, output, 8));
+    TEST_ASSERT_EQUAL(0x90, encoder.running_status);
+
+    TEST_ASSERT_EQUAL(6, midi_encode_sysex(&encoder, payload, 4, output, 6));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, output, sizeof(expected));
+    TEST_ASSERT_EQUAL(0, encoder.running_status);
+    TEST_ASSERT_EQUAL(2, midi_encode_sysex(&encoder, NULL, 0, output, 2));
+}
+
+/*=====================================================================*
+    Round Trip Tests
+ *=====================================================================*/
+
+/**
+ * @brief Random message streams survive encoding and parsing with
+ *        midi_parse_byte, for every combination of options and with
+ *        random output buffer sizes
+ */
+void test_encoder_round_trip_fuzz(void)
+{
+    random_state = 0x12345678;
+
+    for (int round = 0; round < FUZZ_ROUNDS; round++) {
+        const int running_status = round & 1;
+        const int note_off_as_note_on = (round >> 1) & 1;
+        midi_parser_t parser;
+        size_t length = 0;
+        size_t sent = 0;
+        size_t received = 0;
+
+        for (size_t i = 0; i < FUZZ_MESSAGES; i++) {
+            fuzz_messages[i] = random_message();
+        }
+
+        midi_encoder_init(&encoder);
+        midi_encoder_set_running_status(&encoder, running_status);
+        midi_encoder_set_note_off_as_note_on(&encoder, note_off_as_note_on);
+
+        /* Encode into output buffers of random sizes */
+        while (sent < FUZZ_MESSAGES) {
+            size_t encoded;
+            const size_t capacity = next_random() % 16;
+            length += midi_encode_messages(&encoder,
+                                           &fuzz_messages[sent],
+                                           FUZZ_MESSAGES - sent,
+                                           &output[length],
+                                           capacity,
+                                           &encoded);
+            sent += encoded;
+        }
+
+        /* Every byte parses back into the next message */
+        midi_parser_init(&parser);
+        for (size_t i = 0; i < length; i++) {
+            midi_message_t message;
+            if (midi_parse_byte(&parser, output[i], &message)
+                == MIDI_MESSAGE_NONE) {
+                continue;
+            }
+            TEST_ASSERT_LESS_THAN(FUZZ_MESSAGES, received);
+            TEST_ASSERT_EQUAL_HEX32(
+                expected_packed(&fuzz_messages[received], note_off_as_note_on),
+                midi_message_pack(&message));
+            received++;
+        }
+        TEST_ASSERT_EQUAL(FUZZ_MESSAGES, received);
+    }
+}
+
+/**
+ * @brief Running status makes dense channel traffic smaller
+ */
+void test_encoder_running_status_saves_bytes(void)
+{
+    midi_message_t notes[64];
+    size_t with_running_status;
+
+    for (size_t i = 0; i < 64; i++) {
+        notes[i] = channel_message((i & 1) ? MIDI_MESSAGE_NOTE_OFF
+                                           : MIDI_MESSAGE_NOTE_ON,
+                                   MIDI_CHANNEL_1,
+                                   (uint8_t)(40 + i / 2),
+                                   100);
+    }
+
+    midi_encoder_set_note_off_as_note_on(&encoder, 1);
+    with_running_status = encode_all(notes, 64);
+    TEST_ASSERT_EQUAL(1 + 2 * 64, with_running_status);
+
+    midi_encoder_init(&encoder);
+    midi_encoder_set_running_status(&encoder, 0);
+    TEST_ASSERT_EQUAL(3 * 64, encode_all(notes, 64));
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_encoder_init);
+    RUN_TEST(test_encoder_null_pointer_handling);
+
+    // Running status
+    RUN_TEST(test_encoder_running_status);
+    RUN_TEST(test_encoder_running_status_disabled);
+    RUN_TEST(test_encoder_note_off_as_note_on);
+    RUN_TEST(test_encoder_system_messages_and_running_status);
+
+    // Bulk encoding
+    RUN_TEST(test_encoder_bulk_capacity_and_invalid);
+    RUN_TEST(test_encoder_packed_matches_messages);
+    RUN_TEST(test_encoder_sysex);
+
+    // Round trip
+    RUN_TEST(test_encoder_round_trip_fuzz);
+    RUN_TEST(test_encoder_running_status_saves_bytes);
+
+    return UNITY_END();
+}
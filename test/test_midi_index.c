@@ -0,0 +1,448 @@
+/***********************************************************************
+ * @file test_midi_index.c
+ * @brief Unit tests for the MIDI stream index module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_index.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define STREAM_SIZE (2048)
+#define MAX_CHECKPOINTS (256)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static uint8_t stream[STREAM_SIZE];
+static midi_packed_t reference[STREAM_SIZE];
+static size_t reference_offsets[STREAM_SIZE];
+static size_t reference_count;
+static size_t clock_offsets[STREAM_SIZE];
+static size_t clock_count;
+
+static midi_index_t index_;
+static midi_index_checkpoint_t checkpoints[MAX_CHECKPOINTS];
+static midi_index_checkpoint_t loaded[MAX_CHECKPOINTS];
+static uint8_t serialized[MIDI_INDEX_SERIALIZED_SIZE(MAX_CHECKPOINTS)];
+static midi_parser_t parser;
+static int realtime_calls;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    memset(&index_, 0, sizeof(index_));
+    midi_parser_init(&parser);
+    realtime_calls = 0;
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Realtime handler that counts its calls
+ */
+static void count_realtime(void *context, const midi_realtime_event_t *event)
+{
+    (void)context;
+    (void)event;
+    realtime_calls++;
+}
+
+/**
+ * @brief Generate a pseudo random stream with clocks, running status,
+ *        SysEx and realtime bytes inside messages, and parse it once as
+ *        the reference
+ */
+static void generate_stream(void)
+{
+    uint32_t state = 0x2545F491;
+    midi_parser_t reference_parser;
+    midi_message_t message;
+
+    for (size_t i = 0; i < STREAM_SIZE; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        if ((state & 0x07) == 0) {
+            stream[i] = MIDI_MESSAGE_TIMING_CLOCK;
+        } else if ((state & 0x18) == 0) {
+            stream[i] = (uint8_t)(0x80 | (state >> 8));
+        } else {
+            stream[i] = (state >> 8) & 0x7F;
+        }
+    }
+
+    reference_count = 0;
+    clock_count = 0;
+    midi_parser_init(&reference_parser);
+    for (size_t i = 0; i < STREAM_SIZE; i++) {
+        if (midi_parse_byte(&reference_parser, stream[i], &message)
+            != MIDI_MESSAGE_NONE) {
+            reference_offsets[reference_count] = i;
+            reference[reference_count++] = midi_message_pack(&message);
+        }
+        if (stream[i] == MIDI_MESSAGE_TIMING_CLOCK) {
+            clock_offsets[clock_count++] = i;
+        }
+    }
+}
+
+/**
+ * @brief Parse the rest of the stream and compare it with the reference
+ */
+static void assert_resumes_at(size_t offset, midi_parser_t *p)
+{
+    midi_message_t message;
+    size_t next = 0;
+
+    while (next < reference_count && reference_offsets[next] < offset) {
+        next++;
+    }
+    for (size_t i = offset; i < STREAM_SIZE; i++) {
+        if (midi_parse_byte(p, stream[i], &message) != MIDI_MESSAGE_NONE) {
+            TEST_ASSERT_LESS_THAN(reference_count, next);
+            TEST_ASSERT_EQUAL(reference_offsets[next], i);
+            TEST_ASSERT_EQUAL_HEX32(reference[next++],
+                                    midi_message_pack(&message));
+        }
+    }
+    TEST_ASSERT_EQUAL(reference_count, next);
+}
+
+/**
+ * @brief Check that every checkpoint matches parsing up to its offset
+ */
+static void assert_checkpoints_exact(const midi_index_t *index)
+{
+    TEST_ASSERT_GREATER_THAN(0, index->count);
+    for (size_t c = 0; c < index->count; c++) {
+        const midi_index_checkpoint_t *checkpoint = &index->checkpoints[c];
+        midi_parser_t prefix;
+        midi_parser_state_t state;
+        midi_message_t message;
+        uint32_t messages = 0;
+        uint32_t ticks = 0;
+
+        midi_parser_init(&prefix);
+        for (size_t i = 0; i < checkpoint->offset; i++) {
+            if (midi_parse_byte(&prefix, stream[i], &message)
+                != MIDI_MESSAGE_NONE) {
+                messages++;
+            }
+            if (stream[i] == MIDI_MESSAGE_TIMING_CLOCK) { ticks++; }
+        }
+        midi_parser_save_state(&prefix, &state);
+
+        TEST_ASSERT_EQUAL(messages, checkpoint->message);
+        TEST_ASSERT_EQUAL(ticks, checkpoint->tick);
+        TEST_ASSERT_EQUAL(state.message_type, checkpoint->state.message_type);
+        TEST_ASSERT_EQUAL(state.channel, checkpoint->state.channel);
+        TEST_ASSERT_EQUAL(state.byte_count, checkpoint->state.byte_count);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(
+            state.buffer, checkpoint->state.buffer, 2);
+        TEST_ASSERT_EQUAL_HEX8(state.sysex_flags,
+                               checkpoint->state.sysex_flags);
+    }
+}
+
+/*=====================================================================*
+    Build Tests
+ *=====================================================================*/
+
+/**
+ * @brief Checkpoints start at the beginning of the stream, follow the
+ *        intervals and hold the exact parser state
+ */
+void test_index_build(void)
+{
+    generate_stream();
+
+    const size_t count = midi_index_build(
+        &index_, stream, STREAM_SIZE, checkpoints, MAX_CHECKPOINTS, 32, 16);
+    TEST_ASSERT_EQUAL(index_.count, count);
+    TEST_ASSERT_GREATER_THAN(STREAM_SIZE / 8 / 16, count);
+    TEST_ASSERT_LESS_THAN(MAX_CHECKPOINTS, count);
+    TEST_ASSERT_EQUAL(0, checkpoints[0].offset);
+
+    for (size_t c = 1; c < count; c++) {
+        TEST_ASSERT_TRUE(
+            checkpoints[c].message - checkpoints[c - 1].message == 32
+            || checkpoints[c].tick - checkpoints[c - 1].tick == 16);
+    }
+    assert_checkpoints_exact(&index_);
+
+    /* Only the start without any interval */
+    TEST_ASSERT_EQUAL(1,
+                      midi_index_build(&index_, stream, STREAM_SIZE,
+                                       checkpoints, MAX_CHECKPOINTS, 0, 0));
+}
+
+/**
+ * @brief A full array is thinned out and the intervals doubled
+ */
+void test_index_build_decimates(void)
+{
+    generate_stream();
+
+    const size_t count =
+        midi_index_build(&index_, stream, STREAM_SIZE, checkpoints, 8, 4, 0);
+    TEST_ASSERT_LESS_OR_EQUAL(8, count);
+    TEST_ASSERT_GREATER_THAN(3, count);
+    TEST_ASSERT_GREATER_THAN(4, index_.message_interval);
+    TEST_ASSERT_EQUAL(0, index_.tick_interval);
+
+    /* The checkpoints still cover the end of the stream */
+    TEST_ASSERT_GREATER_THAN(
+        reference_count - 2 * index_.message_interval,
+        checkpoints[count - 1].message);
+    assert_checkpoints_exact(&index_);
+}
+
+/**
+ * @brief Invalid arguments are rejected
+ */
+void test_index_build_errors(void)
+{
+    TEST_ASSERT_EQUAL(0,
+                      midi_index_build(NULL, stream, STREAM_SIZE,
+                                       checkpoints, MAX_CHECKPOINTS, 1, 1));
+    TEST_ASSERT_EQUAL(0,
+                      midi_index_build(&index_, NULL, STREAM_SIZE,
+                                       checkpoints, MAX_CHECKPOINTS, 1, 1));
+    TEST_ASSERT_EQUAL(
+        0, midi_index_build(&index_, stream, STREAM_SIZE, NULL, 8, 1, 1));
+    TEST_ASSERT_EQUAL(0,
+                      midi_index_build(&index_, stream, STREAM_SIZE,
+                                       checkpoints, 1, 1, 1));
+    TEST_ASSERT_EQUAL(
+        1, midi_index_build(&index_, NULL, 0, checkpoints, 2, 1, 1));
+
+    TEST_ASSERT_EQUAL(0, midi_index_seek_offset(NULL, 10, &parser));
+    TEST_ASSERT_EQUAL(0, midi_index_seek_offset(&index_, 10, NULL));
+    TEST_ASSERT_EQUAL(0, midi_index_seek_tick(NULL, 10, &parser));
+    TEST_ASSERT_EQUAL(0, midi_index_seek_tick(&index_, 10, NULL));
+}
+
+/*=====================================================================*
+    Seek Tests
+ *=====================================================================*/
+
+/**
+ * @brief Seeking to any offset resumes parsing exactly
+ */
+void test_index_seek_offset(void)
+{
+    generate_stream();
+    midi_index_build(
+        &index_, stream, STREAM_SIZE, checkpoints, MAX_CHECKPOINTS, 16, 0);
+
+    for (size_t offset = 0; offset <= STREAM_SIZE; offset++) {
+        midi_parser_init(&parser);
+        TEST_ASSERT_EQUAL(offset,
+                          midi_index_seek_offset(&index_, offset, &parser));
+        assert_resumes_at(offset, &parser);
+    }
+
+    TEST_ASSERT_EQUAL(
+        STREAM_SIZE, midi_index_seek_offset(&index_, STREAM_SIZE + 5, &parser));
+}
+
+/**
+ * @brief Seeking to a tick resumes after its Timing Clock, without
+ *        calling the parser's handlers
+ */
+void test_index_seek_tick(void)
+{
+    generate_stream();
+    midi_index_build(
+        &index_, stream, STREAM_SIZE, checkpoints, MAX_CHECKPOINTS, 0, 8);
+    TEST_ASSERT_GREATER_THAN(8, clock_count);
+
+    for (uint32_t tick = 0; tick <= clock_count + 1; tick++) {
+        const size_t expected = (tick == 0) ? 0
+                                : (tick > clock_count)
+                                    ? STREAM_SIZE
+                                    : clock_offsets[tick - 1] + 1;
+
+        midi_parser_init(&parser);
+        midi_parser_set_realtime_handler(&parser, count_realtime, NULL, NULL);
+        const size_t offset = midi_index_seek_tick(&index_, tick, &parser);
+        TEST_ASSERT_EQUAL(expected, offset);
+        TEST_ASSERT_EQUAL(0, realtime_calls);
+
+        midi_parser_set_realtime_handler(&parser, NULL, NULL, NULL);
+        assert_resumes_at(offset, &parser);
+    }
+}
+
+/*=====================================================================*
+    Serialization Tests
+ *=====================================================================*/
+
+/**
+ * @brief A serialized index loads back unchanged
+ */
+void test_index_serialize_round_trip(void)
+{
+    midi_index_t restored;
+
+    generate_stream();
+    const size_t count = midi_index_build(
+        &index_, stream, STREAM_SIZE, checkpoints, MAX_CHECKPOINTS, 16, 16);
+    const size_t size =
+        midi_index_serialize(&index_, serialized, sizeof(serialized));
+    TEST_ASSERT_EQUAL(MIDI_INDEX_SERIALIZED_SIZE(count), size);
+    TEST_ASSERT_EQUAL_MEMORY("MIDX", serialized, 4);
+
+    TEST_ASSERT_EQUAL(count,
+                      midi_index_deserialize(&restored, stream, STREAM_SIZE,
+                                             serialized, size, loaded,
+                                             MAX_CHECKPOINTS));
+    TEST_ASSERT_EQUAL_PTR(stream, restored.stream);
+    TEST_ASSERT_EQUAL(16, restored.message_interval);
+    TEST_ASSERT_EQUAL(16, restored.tick_interval);
+    for (size_t c = 0; c < count; c++) {
+        TEST_ASSERT_EQUAL(checkpoints[c].offset, loaded[c].offset);
+        TEST_ASSERT_EQUAL(checkpoints[c].tick, loaded[c].tick);
+        TEST_ASSERT_EQUAL(checkpoints[c].message, loaded[c].message);
+        TEST_ASSERT_EQUAL(checkpoints[c].state.message_type,
+                          loaded[c].state.message_type);
+        TEST_ASSERT_EQUAL(checkpoints[c].state.channel,
+                          loaded[c].state.channel);
+        TEST_ASSERT_EQUAL(checkpoints[c].state.byte_count,
+                          loaded[c].state.byte_count);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(
+            checkpoints[c].state.buffer, loaded[c].state.buffer, 2);
+        TEST_ASSERT_EQUAL(checkpoints[c].state.sysex_flags,
+                          loaded[c].state.sysex_flags);
+    }
+
+    const size_t offset = midi_index_seek_offset(&restored, 1000, &parser);
+    assert_resumes_at(offset, &parser);
+
+    TEST_ASSERT_EQUAL(
+        0, midi_index_serialize(&index_, serialized, size - 1));
+    TEST_ASSERT_EQUAL(0, midi_index_serialize(NULL, serialized, size));
+}
+
+/**
+ * @brief Corrupt, stale or truncated data is rejected
+ */
+void test_index_deserialize_rejects(void)
+{
+    static uint8_t corrupt[sizeof(serialized)];
+    midi_index_t restored;
+
+    generate_stream();
+    const size_t count = midi_index_build(
+        &index_, stream, STREAM_SIZE, checkpoints, MAX_CHECKPOINTS, 16, 16);
+    const size_t size =
+        midi_index_serialize(&index_, serialized, sizeof(serialized));
+
+    /* Stale: built for another stream length */
+    TEST_ASSERT_EQUAL(0,
+                      midi_index_deserialize(&restored, stream,
+                                             STREAM_SIZE - 1, serialized,
+                                             size, loaded, MAX_CHECKPOINTS));
+    /* Truncated, or too many checkpoints */
+    TEST_ASSERT_EQUAL(0,
+                      midi_index_deserialize(&restored, stream, STREAM_SIZE,
+                                             serialized, size - 1, loaded,
+                                             MAX_CHECKPOINTS));
+    TEST_ASSERT_EQUAL(0,
+                      midi_index_deserialize(&restored, stream, STREAM_SIZE,
+                                             serialized, size, loaded,
+                                             count - 1));
+
+    enum {
+        first = MIDI_INDEX_HEADER_SIZE,
+        second = first + MIDI_INDEX_CHECKPOINT_SIZE,
+    };
+    static const struct {
+        size_t offset;
+        uint8_t value;
+    } corruptions[] = {
+        {0, 'X'},              /* Magic */
+        {4, 2},                /* Version */
+        {6, 17},               /* Checkpoint size */
+        {20, 0},               /* Count */
+        {first, 1},            /* First checkpoint not at the start */
+        {second + 3, 0xFF},    /* Offset past the stream */
+        {second + 13, 16},     /* Channel */
+        {second + 14, 0x80},   /* Data byte */
+        {second + 12, 0x42},   /* Message type: a data byte */
+        {second + 12, 0x91},   /* Message type: a status with a channel */
+        {second + 12, 0xF8},   /* Message type: System Real-Time */
+        {second + 16, 2},      /* Byte count */
+        {second + 17, 0x10},   /* SysEx flags */
+    };
+
+    for (size_t i = 0; i < sizeof(corruptions) / sizeof(corruptions[0]);
+         i++) {
+        memcpy(corrupt, serialized, size);
+        corrupt[corruptions[i].offset] = corruptions[i].value;
+        TEST_ASSERT_EQUAL(0,
+                          midi_index_deserialize(&restored, stream,
+                                                 STREAM_SIZE, corrupt, size,
+                                                 loaded, MAX_CHECKPOINTS));
+    }
+
+    /* Checkpoints out of order */
+    memcpy(corrupt, serialized, size);
+    memcpy(&corrupt[second], &serialized[second + MIDI_INDEX_CHECKPOINT_SIZE],
+           MIDI_INDEX_CHECKPOINT_SIZE);
+    memcpy(&corrupt[second + MIDI_INDEX_CHECKPOINT_SIZE], &serialized[second],
+           MIDI_INDEX_CHECKPOINT_SIZE);
+    TEST_ASSERT_EQUAL(0,
+                      midi_index_deserialize(&restored, stream, STREAM_SIZE,
+                                             corrupt, size, loaded,
+                                             MAX_CHECKPOINTS));
+
+    TEST_ASSERT_EQUAL(0,
+                      midi_index_deserialize(NULL, stream, STREAM_SIZE,
+                                             serialized, size, loaded,
+                                             MAX_CHECKPOINTS));
+    TEST_ASSERT_EQUAL(0,
+                      midi_index_deserialize(&restored, stream, STREAM_SIZE,
+                                             NULL, size, loaded,
+                                             MAX_CHECKPOINTS));
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Build
+    RUN_TEST(test_index_build);
+    RUN_TEST(test_index_build_decimates);
+    RUN_TEST(test_index_build_errors);
+
+    // Seek
+    RUN_TEST(test_index_seek_offset);
+    RUN_TEST(test_index_seek_tick);
+
+    // Serialization
+    RUN_TEST(test_index_serialize_round_trip);
+    RUN_TEST(test_index_deserialize_rejects);
+
+    return UNITY_END();
+}
@@ -0,0 +1,457 @@
+/***********************************************************************
+ * @file test_midi_io.c
+ * @brief Unit tests for the MIDI asynchronous input module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_io.h"
+#include "../midi/midi_ring.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define PORTS (64)
+#define BUFFER_SIZE (32)
+#define RING_CAPACITY (1024)
+#define STREAM_SIZE (600)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static midi_io_t io;
+static midi_io_port_t ports[PORTS];
+static uint8_t buffers[PORTS * BUFFER_SIZE];
+static midi_ring_t rings[PORTS];
+static midi_packed_t ring_storage[PORTS][RING_CAPACITY];
+static int pipes[PORTS][2];
+static uint8_t streams[PORTS][STREAM_SIZE];
+static midi_packed_t expected[STREAM_SIZE];
+static midi_packed_t popped[RING_CAPACITY];
+static size_t popped_counts[PORTS];
+static uint32_t random_state;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    for (size_t p = 0; p < PORTS; p++) {
+        TEST_ASSERT_TRUE(midi_ring_init(&rings[p], ring_storage[p],
+                                        RING_CAPACITY));
+        pipes[p][0] = -1;
+        pipes[p][1] = -1;
+        popped_counts[p] = 0;
+    }
+    random_state = 0x1F2E3D4C;
+}
+
+void tearDown(void)
+{
+    midi_io_deinit(&io);
+    for (size_t p = 0; p < PORTS; p++) {
+        if (pipes[p][0] >= 0) { close(pipes[p][0]); }
+        if (pipes[p][1] >= 0) { close(pipes[p][1]); }
+    }
+}
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Next pseudo random number
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief Initialize the input, or skip the test if the backend is not
+ *        available
+ */
+static void init_io(midi_io_backend_t backend, size_t workers)
+{
+    if (!midi_io_init(&io, backend, workers, ports, PORTS, buffers,
+                      BUFFER_SIZE)) {
+        TEST_ASSERT_EQUAL(MIDI_IO_BACKEND_IO_URING, backend);
+        TEST_IGNORE_MESSAGE("io_uring is not available");
+    }
+    TEST_ASSERT_EQUAL(backend == MIDI_IO_BACKEND_EPOLL
+                          ? MIDI_IO_BACKEND_EPOLL
+                          : MIDI_IO_BACKEND_IO_URING,
+                      midi_io_get_backend(&io));
+}
+
+/**
+ * @brief Open the pipe of a port
+ */
+static void open_pipe(size_t port, int nonblocking)
+{
+    TEST_ASSERT_EQUAL(0, pipe(pipes[port]));
+    if (nonblocking) {
+        TEST_ASSERT_EQUAL(0, fcntl(pipes[port][0], F_SETFL, O_NONBLOCK));
+    }
+}
+
+/**
+ * @brief Open the pipes of ports and add their read ends
+ */
+static void add_ports(size_t count, int nonblocking)
+{
+    for (size_t p = 0; p < count; p++) {
+        open_pipe(p, nonblocking);
+        TEST_ASSERT_EQUAL(p, midi_io_add_port(&io, pipes[p][0], NULL,
+                                              &rings[p]));
+        TEST_ASSERT_TRUE(midi_io_port_is_open(&io, p));
+    }
+}
+
+/**
+ * @brief Fill the stream of each port with random channel messages and
+ *        real-time bytes, using running status
+ */
+static void make_streams(size_t count)
+{
+    for (size_t p = 0; p < count; p++) {
+        size_t i = 0;
+        while (i + 3 <= STREAM_SIZE) {
+            const uint32_t r = next_random();
+            if ((r & 7) == 0) {
+                streams[p][i++] = 0xF8;
+            } else if ((r & 7) == 1 || i == 0) {
+                streams[p][i++] = (uint8_t)(0x90 | ((r >> 4) & 0x0F));
+            } else {
+                streams[p][i++] = (uint8_t)((r >> 8) & 0x7F);
+                streams[p][i++] = (uint8_t)((r >> 16) & 0x7F);
+            }
+        }
+        while (i < STREAM_SIZE) { streams[p][i++] = 0xFE; }
+    }
+}
+
+/**
+ * @brief Write part of the stream of a port to its pipe
+ */
+static void write_stream(size_t port, size_t begin, size_t end)
+{
+    TEST_ASSERT_EQUAL((ssize_t)(end - begin),
+                      write(pipes[port][1], &streams[port][begin],
+                            end - begin));
+}
+
+/**
+ * @brief Pop the messages of every port, until each has received the
+ *        messages of its stream up to a byte offset, polling the workers
+ *        on the calling thread if asked
+ */
+static void receive_streams(size_t count, size_t end, int poll)
+{
+    midi_parser_t parser;
+    size_t targets[PORTS];
+    size_t missing = 0;
+
+    for (size_t p = 0; p < count; p++) {
+        midi_parser_init(&parser);
+        targets[p] = midi_parse_buffer_packed(&parser, streams[p], end,
+                                              expected, STREAM_SIZE, NULL);
+        missing += targets[p] - popped_counts[p];
+    }
+
+    for (size_t spins = 0; missing > 0; spins++) {
+        TEST_ASSERT_LESS_THAN(10000000, spins);
+        if (poll) {
+            for (size_t w = 0; w < io.worker_count; w++) {
+                midi_io_poll(&io, w, 0);
+            }
+        }
+        for (size_t p = 0; p < count; p++) {
+            const size_t n = midi_ring_pop(&rings[p], popped, RING_CAPACITY);
+            if (n == 0) { continue; }
+
+            midi_parser_init(&parser);
+            midi_parse_buffer_packed(&parser, streams[p], end, expected,
+                                     STREAM_SIZE, NULL);
+            TEST_ASSERT_LESS_OR_EQUAL(targets[p], popped_counts[p] + n);
+            TEST_ASSERT_EQUAL_HEX32_ARRAY(&expected[popped_counts[p]],
+                                          popped, n);
+            popped_counts[p] += n;
+            missing -= n;
+        }
+    }
+}
+
+/*=====================================================================*
+    Backend Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test that messages split across reads are parsed in order
+ */
+static void check_single_port(midi_io_backend_t backend)
+{
+    init_io(backend, 1);
+    add_ports(1, 0);
+    make_streams(1);
+
+    write_stream(0, 0, 100);
+    receive_streams(1, 100, 1);
+    write_stream(0, 100, 101);
+    write_stream(0, 101, STREAM_SIZE);
+    receive_streams(1, STREAM_SIZE, 1);
+    TEST_ASSERT_EQUAL(STREAM_SIZE, ports[0].bytes);
+    TEST_ASSERT_GREATER_OR_EQUAL(STREAM_SIZE / BUFFER_SIZE, ports[0].reads);
+
+    /* The end of the file closes the port */
+    close(pipes[0][1]);
+    pipes[0][1] = -1;
+    for (size_t i = 0; i < 1000 && midi_io_port_is_open(&io, 0); i++) {
+        midi_io_poll(&io, 0, 1);
+    }
+    TEST_ASSERT_FALSE(midi_io_port_is_open(&io, 0));
+    TEST_ASSERT_EQUAL(0, ports[0].error);
+}
+
+/**
+ * @brief Test many ports on two workers, some of them non-blocking
+ */
+static void check_many_ports(midi_io_backend_t backend)
+{
+    init_io(backend, 2);
+    add_ports(PORTS / 2, 0);
+    for (size_t p = PORTS / 2; p < PORTS; p++) {
+        open_pipe(p, 1);
+        TEST_ASSERT_EQUAL(p, midi_io_add_port(&io, pipes[p][0], NULL,
+                                              &rings[p]));
+    }
+    TEST_ASSERT_EQUAL(MIDI_IO_INVALID_PORT,
+                      midi_io_add_port(&io, pipes[0][0], NULL, &rings[0]));
+    make_streams(PORTS);
+
+    for (size_t end = 0; end < STREAM_SIZE;) {
+        const size_t next = end + 1 + next_random() % 150;
+        const size_t stop = next < STREAM_SIZE ? next : STREAM_SIZE;
+        for (size_t p = 0; p < PORTS; p++) { write_stream(p, end, stop); }
+        receive_streams(PORTS, stop, 1);
+        end = stop;
+    }
+}
+
+/**
+ * @brief Test the worker threads, stopped and started again
+ */
+static void check_threads(midi_io_backend_t backend)
+{
+    init_io(backend, 4);
+    add_ports(PORTS, 0);
+    make_streams(PORTS);
+
+    TEST_ASSERT_TRUE(midi_io_start(&io));
+    for (size_t p = 0; p < PORTS; p++) { write_stream(p, 0, 200); }
+    receive_streams(PORTS, 200, 0);
+    midi_io_stop(&io);
+
+    /* Bytes sent while stopped are read once started again */
+    for (size_t p = 0; p < PORTS; p++) {
+        write_stream(p, 200, STREAM_SIZE);
+    }
+    TEST_ASSERT_TRUE(midi_io_start(&io));
+    receive_streams(PORTS, STREAM_SIZE, 0);
+    midi_io_stop(&io);
+}
+
+/*=====================================================================*
+    io_uring Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test a single port with io_uring
+ */
+void test_io_uring_single_port(void)
+{
+    check_single_port(MIDI_IO_BACKEND_IO_URING);
+}
+
+/**
+ * @brief Test many ports with io_uring
+ */
+void test_io_uring_many_ports(void)
+{
+    check_many_ports(MIDI_IO_BACKEND_IO_URING);
+}
+
+/**
+ * @brief Test threads with io_uring
+ */
+void test_io_uring_threads(void) { check_threads(MIDI_IO_BACKEND_IO_URING); }
+
+/**
+ * @brief Test that io_uring reaps the reads of every ready port with a
+ *        single system call
+ */
+void test_io_uring_batching(void)
+{
+    init_io(MIDI_IO_BACKEND_IO_URING, 1);
+    add_ports(PORTS, 0);
+    make_streams(PORTS);
+
+    /* Submit the first reads */
+    midi_io_poll(&io, 0, 0);
+    const size_t before = midi_io_get_syscall_count(&io, 0);
+    for (size_t p = 0; p < PORTS; p++) {
+        write_stream(p, 0, BUFFER_SIZE);
+    }
+    size_t reads = 0;
+    while (reads < PORTS) {
+        midi_io_poll(&io, 0, 1);
+        reads = 0;
+        for (size_t p = 0; p < PORTS; p++) { reads += ports[p].reads; }
+    }
+    TEST_ASSERT_LESS_THAN(PORTS / 8,
+                          midi_io_get_syscall_count(&io, 0) - before);
+    receive_streams(PORTS, BUFFER_SIZE, 0);
+}
+
+/*=====================================================================*
+    epoll Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test a single port with epoll
+ */
+void test_io_epoll_single_port(void)
+{
+    check_single_port(MIDI_IO_BACKEND_EPOLL);
+}
+
+/**
+ * @brief Test many ports with epoll
+ */
+void test_io_epoll_many_ports(void)
+{
+    check_many_ports(MIDI_IO_BACKEND_EPOLL);
+}
+
+/**
+ * @brief Test threads with epoll
+ */
+void test_io_epoll_threads(void) { check_threads(MIDI_IO_BACKEND_EPOLL); }
+
+/*=====================================================================*
+    Argument Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test invalid arguments and failing reads
+ */
+void test_io_arguments(void)
+{
+    TEST_ASSERT_FALSE(midi_io_init(NULL, MIDI_IO_BACKEND_AUTO, 1, ports,
+                                   PORTS, buffers, BUFFER_SIZE));
+    TEST_ASSERT_FALSE(midi_io_init(&io, MIDI_IO_BACKEND_AUTO, 0, ports,
+                                   PORTS, buffers, BUFFER_SIZE));
+    TEST_ASSERT_FALSE(midi_io_init(&io, MIDI_IO_BACKEND_AUTO,
+                                   MIDI_IO_MAX_WORKERS + 1, ports, PORTS,
+                                   buffers, BUFFER_SIZE));
+    TEST_ASSERT_FALSE(midi_io_init(&io, MIDI_IO_BACKEND_AUTO, 1, NULL,
+                                   PORTS, buffers, BUFFER_SIZE));
+    TEST_ASSERT_FALSE(midi_io_init(&io, MIDI_IO_BACKEND_AUTO, 1, ports,
+                                   PORTS, buffers, 0));
+    midi_io_deinit(&io);
+    midi_io_deinit(NULL);
+
+    TEST_ASSERT_TRUE(midi_io_init(&io, MIDI_IO_BACKEND_AUTO, 1, ports,
+                                  PORTS, buffers, BUFFER_SIZE));
+    TEST_ASSERT_EQUAL(MIDI_IO_INVALID_PORT,
+                      midi_io_add_port(&io, -1, NULL, &rings[0]));
+    open_pipe(0, 0);
+    TEST_ASSERT_EQUAL(MIDI_IO_INVALID_PORT,
+                      midi_io_add_port(&io, pipes[0][0], NULL, NULL));
+    TEST_ASSERT_EQUAL(0, midi_io_poll(&io, 1, 0));
+    TEST_ASSERT_EQUAL(0, midi_io_poll(NULL, 0, 0));
+    TEST_ASSERT_FALSE(midi_io_port_is_open(&io, 0));
+    TEST_ASSERT_FALSE(midi_io_start(NULL));
+    midi_io_stop(NULL);
+
+    /* A port whose reads fail is closed with the error */
+    if (midi_io_get_backend(&io) == MIDI_IO_BACKEND_IO_URING) {
+        TEST_ASSERT_EQUAL(0, midi_io_add_port(&io, pipes[0][1], NULL,
+                                              &rings[0]));
+        for (size_t i = 0; i < 1000 && midi_io_port_is_open(&io, 0); i++) {
+            midi_io_poll(&io, 0, 1);
+        }
+        TEST_ASSERT_FALSE(midi_io_port_is_open(&io, 0));
+        TEST_ASSERT_EQUAL(EBADF, ports[0].error);
+    }
+}
+
+/**
+ * @brief Test that each port copies the filters of its parser
+ */
+void test_io_parser_config(void)
+{
+    static const uint8_t bytes[] = {0x90, 60, 100, 0x91, 60, 100, 0xF8};
+    midi_parser_t config;
+
+    midi_parser_init(&config);
+    midi_parser_set_channel_mask(&config, 0x0002);
+    TEST_ASSERT_TRUE(midi_io_init(&io, MIDI_IO_BACKEND_AUTO, 1, ports,
+                                  PORTS, buffers, BUFFER_SIZE));
+    open_pipe(0, 0);
+    TEST_ASSERT_EQUAL(0, midi_io_add_port(&io, pipes[0][0], &config,
+                                          &rings[0]));
+    TEST_ASSERT_EQUAL((ssize_t)sizeof(bytes),
+                      write(pipes[0][1], bytes, sizeof(bytes)));
+
+    size_t count = 0;
+    while (count < 2) {
+        midi_io_poll(&io, 0, 1);
+        count += midi_ring_pop(&rings[0], &popped[count], 2 - count);
+    }
+    TEST_ASSERT_EQUAL_HEX32(
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_2, 60, 100),
+        popped[0]);
+    TEST_ASSERT_EQUAL_HEX32(midi_packed_make(MIDI_MESSAGE_TIMING_CLOCK,
+                                             MIDI_CHANNEL_NONE, 0, 0),
+                            popped[1]);
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // io_uring
+    RUN_TEST(test_io_uring_single_port);
+    RUN_TEST(test_io_uring_many_ports);
+    RUN_TEST(test_io_uring_threads);
+    RUN_TEST(test_io_uring_batching);
+
+    // epoll
+    RUN_TEST(test_io_epoll_single_port);
+    RUN_TEST(test_io_epoll_many_ports);
+    RUN_TEST(test_io_epoll_threads);
+
+    // Arguments
+    RUN_TEST(test_io_arguments);
+    RUN_TEST(test_io_parser_config);
+
+    return UNITY_END();
+}
@@ -0,0 +1,254 @@
+/***********************************************************************
+ * @file test_midi_lean.c
+ * @brief Unit tests for the lean parser and the lean build configuration
+ *
+ * @details This test is built with midi.c compiled in directly, with
+ *          every optional message family compiled out and small enums,
+ *          and checks the header-only lean parser against it.
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_lean.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define STREAM_SIZE (20000)
+
+/**
+ * @brief Largest midi_parser_t of this build: 12 bytes of running state,
+ *        64 bytes of filter masks, padding, and the handler and context
+ *        pointers, with stats off
+ */
+#define LEAN_PARSER_SIZE (80 + 5 * sizeof(void *))
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static midi_parser_t parser;
+static midi_lean_parser_t lean;
+static uint8_t stream[STREAM_SIZE];
+static midi_packed_t expected[STREAM_SIZE];
+static midi_packed_t packed[STREAM_SIZE];
+static uint32_t random_state;
+static size_t span_count;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    midi_parser_init(&parser);
+    midi_lean_parser_init(&lean);
+    random_state = 0x2545F491;
+    span_count = 0;
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Next pseudo random number
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief Fill a buffer with random bytes, about one in four a status byte
+ */
+static void generate_stream(uint8_t *bytes, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        const uint32_t r = next_random();
+        bytes[i] = (r & 0x300) ? (uint8_t)(r & 0x7F) : (uint8_t)(r | 0x80);
+    }
+}
+
+/**
+ * @brief Parse a byte with the lean parser and the full parser
+ * @return The packed message of the lean parser, after checking that
+ *      the full parser returned the same message
+ */
+static midi_packed_t parse_both(uint8_t byte)
+{
+    midi_message_t message;
+    midi_packed_t full = 0;
+
+    memset(&message, 0, sizeof(message));
+    if (midi_parse_byte(&parser, byte, &message) != MIDI_MESSAGE_NONE) {
+        full = midi_message_pack(&message);
+    }
+
+    const midi_packed_t result = midi_lean_parse_byte(&lean, byte);
+    TEST_ASSERT_EQUAL_HEX32(full, result);
+    return result;
+}
+
+static void count_span(void *context, const midi_sysex_span_t *span)
+{
+    (void)context;
+    (void)span;
+    span_count++;
+}
+
+/*=====================================================================*
+    Lean Parser Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test the size of the lean state, of the parser of the lean
+ *        build and of the small enums
+ */
+void test_lean_sizes(void)
+{
+    TEST_ASSERT_EQUAL(3, sizeof(midi_lean_parser_t));
+#if defined(__GNUC__) || defined(__clang__)
+    TEST_ASSERT_EQUAL(1, sizeof(midi_message_type_t));
+    TEST_ASSERT_EQUAL(1, sizeof(midi_channel_t));
+    TEST_ASSERT_EQUAL(1, sizeof(midi_controller_t));
+    TEST_ASSERT_EQUAL(4, sizeof(midi_message_t));
+    TEST_ASSERT_LESS_OR_EQUAL(LEAN_PARSER_SIZE, sizeof(midi_parser_t));
+#endif
+}
+
+/**
+ * @brief Test running status, realtime bytes and system common bytes
+ */
+void test_lean_parse_byte(void)
+{
+    /* Note On, then Note On with velocity 0 under running status */
+    TEST_ASSERT_EQUAL_HEX32(0, parse_both(0x92));
+    TEST_ASSERT_EQUAL_HEX32(0, parse_both(60));
+    TEST_ASSERT_EQUAL_HEX32(0x90023C64, parse_both(100));
+    TEST_ASSERT_EQUAL_HEX32(0, parse_both(60));
+    TEST_ASSERT_EQUAL_HEX32(0x80023C00, parse_both(0));
+
+    /* A clock between the data bytes leaves the message intact */
+    TEST_ASSERT_EQUAL_HEX32(0, parse_both(62));
+    TEST_ASSERT_EQUAL_HEX32(0xF8FF0000, parse_both(0xF8));
+    TEST_ASSERT_EQUAL_HEX32(0x90023E40, parse_both(64));
+
+    /* One data byte messages */
+    TEST_ASSERT_EQUAL_HEX32(0, parse_both(0xC5));
+    TEST_ASSERT_EQUAL_HEX32(0xC0050A00, parse_both(10));
+    TEST_ASSERT_EQUAL_HEX32(0xC0050B00, parse_both(11));
+
+    /* Undefined status bytes are ignored */
+    TEST_ASSERT_EQUAL_HEX32(0, parse_both(0xF5));
+    TEST_ASSERT_EQUAL_HEX32(0, parse_both(0xFD));
+    TEST_ASSERT_EQUAL_HEX32(0xC0050C00, parse_both(12));
+
+    /* Tune Request clears running status */
+    TEST_ASSERT_EQUAL_HEX32(0xF6FF0000, parse_both(0xF6));
+    TEST_ASSERT_EQUAL_HEX32(0, parse_both(12));
+
+    /* Controllers 120-127 are Control Change in this build */
+    TEST_ASSERT_EQUAL_HEX32(0, parse_both(0xB0));
+    TEST_ASSERT_EQUAL_HEX32(0, parse_both(123));
+    TEST_ASSERT_EQUAL_HEX32(0xB0007B00, parse_both(0));
+}
+
+/**
+ * @brief Test the lean parser against the full parser on a random stream
+ */
+void test_lean_differential(void)
+{
+    size_t count = 0;
+    size_t consumed = 0;
+    midi_parser_t buffer_parser;
+
+    generate_stream(stream, STREAM_SIZE);
+    for (size_t i = 0; i < STREAM_SIZE; i++) {
+        const midi_packed_t result = parse_both(stream[i]);
+        if (result != 0) { expected[count++] = result; }
+    }
+    TEST_ASSERT_GREATER_THAN(STREAM_SIZE / 4, count);
+
+    /* The buffer parser agrees as well */
+    midi_parser_init(&buffer_parser);
+    TEST_ASSERT_EQUAL(count,
+                      midi_parse_buffer_packed(&buffer_parser,
+                                               stream,
+                                               STREAM_SIZE,
+                                               packed,
+                                               STREAM_SIZE,
+                                               &consumed));
+    TEST_ASSERT_EQUAL(STREAM_SIZE, consumed);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(expected, packed, count);
+}
+
+/*=====================================================================*
+    Lean Build Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test that the compiled out message families are skipped
+ */
+void test_lean_build_families(void)
+{
+    const uint8_t input[] = {0x90, 60,   100, 0xF0, 1,  2,    0xF7, 65,
+                             0xF1, 0x35, 66,  0xF2, 1,  2,    67,   0xF3,
+                             4,    68,   0x91, 70,  80, 0xF7, 71,   72};
+    midi_message_t message;
+    size_t consumed = 0;
+
+    midi_parser_set_sysex_handler(&parser, count_span, NULL);
+    TEST_ASSERT_EQUAL(2,
+                      midi_parse_buffer_packed(&parser,
+                                               input,
+                                               sizeof(input),
+                                               packed,
+                                               STREAM_SIZE,
+                                               &consumed));
+    TEST_ASSERT_EQUAL_HEX32(0x90003C64, packed[0]);
+    TEST_ASSERT_EQUAL_HEX32(0x90014650, packed[1]);
+    TEST_ASSERT_EQUAL(0, span_count);
+
+    /* Framing of whole messages is unchanged */
+    TEST_ASSERT_EQUAL(0, midi_status_data_length(0xF0));
+    TEST_ASSERT_EQUAL(1, midi_status_data_length(0xF1));
+    TEST_ASSERT_EQUAL(2, midi_status_data_length(0xF2));
+    TEST_ASSERT_EQUAL(1, midi_status_data_length(0xF3));
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NONE,
+                      midi_decode_message(0xF2, 1, 2, &message));
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NONE,
+                      midi_decode_message(0xF0, 0, 0, &message));
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_CONTROL_CHANGE,
+                      midi_decode_message(0xB3, 120, 0, &message));
+    TEST_ASSERT_EQUAL(120, message.controller);
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Lean parser
+    RUN_TEST(test_lean_sizes);
+    RUN_TEST(test_lean_parse_byte);
+    RUN_TEST(test_lean_differential);
+
+    // Lean build
+    RUN_TEST(test_lean_build_families);
+
+    return UNITY_END();
+}
@@ -0,0 +1,440 @@
+/***********************************************************************
+ * @file test_midi_log.c
+ * @brief Unit tests for the MIDI message log module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_log.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define LOG_MESSAGES (1000)
+#define STREAM_SIZE (2048)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static uint8_t storage[MIDI_LOG_STORAGE_SIZE(LOG_MESSAGES)];
+static midi_log_t log_;
+static midi_packed_t messages[LOG_MESSAGES];
+static uint32_t times[LOG_MESSAGES];
+static midi_packed_t selected[LOG_MESSAGES];
+static uint32_t selected_times[LOG_MESSAGES];
+static uint8_t stream[STREAM_SIZE];
+static uint32_t random_state;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    TEST_ASSERT_EQUAL(1, midi_log_init(&log_, storage, sizeof(storage)));
+    random_state = 0x2545F491;
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Next pseudo random number
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief Generate messages with a few types, channels and clustered
+ *        timestamps, so that some chunks can be skipped and some cannot
+ */
+static void generate_messages(size_t count)
+{
+    static const midi_message_type_t types[] = {
+        MIDI_MESSAGE_NOTE_ON,
+        MIDI_MESSAGE_NOTE_OFF,
+        MIDI_MESSAGE_CONTROL_CHANGE,
+        MIDI_MESSAGE_PROGRAM_CHANGE,
+    };
+
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t r = next_random();
+        const size_t chunk = i / MIDI_LOG_CHUNK_SIZE;
+        const midi_message_type_t type =
+            (chunk == 1) ? MIDI_MESSAGE_CONTROL_CHANGE : types[r & 3];
+
+        if ((r >> 2) % 16 == 0) {
+            messages[i] = midi_packed_make(
+                MIDI_MESSAGE_TIMING_CLOCK, MIDI_CHANNEL_NONE, 0, 0);
+        } else {
+            messages[i] = midi_packed_make(type,
+                                           (midi_channel_t)((r >> 6) & 3),
+                                           (uint8_t)((r >> 8) & 0x7F),
+                                           (uint8_t)((r >> 16) & 0x7F));
+        }
+        times[i] = 0xFFFFF000u + (uint32_t)i * 8;
+    }
+}
+
+/**
+ * @brief Check a message against a query, field by field
+ */
+static int query_matches(const midi_log_query_t *query,
+                         midi_packed_t packed,
+                         uint32_t time)
+{
+    const uint8_t data1 = midi_packed_data1(packed);
+    const uint8_t data2 = midi_packed_data2(packed);
+
+    if (query->message_type != MIDI_MESSAGE_NONE
+        && midi_packed_type(packed) != query->message_type) {
+        return 0;
+    }
+    if (query->channel != MIDI_CHANNEL_NONE
+        && midi_packed_channel(packed) != query->channel) {
+        return 0;
+    }
+    if (data1 < query->data1_min || data1 > query->data1_max) { return 0; }
+    if (data2 < query->data2_min || data2 > query->data2_max) { return 0; }
+    if (query->time_from <= query->time_to) {
+        return time >= query->time_from && time <= query->time_to;
+    }
+    return time >= query->time_from || time <= query->time_to;
+}
+
+/**
+ * @brief Compare count, histogram and select with a scan of the messages
+ */
+static void assert_query(const midi_log_query_t *query, size_t count)
+{
+    uint32_t expected_histogram[128] = {0};
+    uint32_t histogram[128] = {0};
+    size_t expected = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (query_matches(query, messages[i], times[i])) {
+            expected_histogram[midi_packed_data2(messages[i])]++;
+            selected[expected] = messages[i];
+            selected_times[expected++] = times[i];
+        }
+    }
+
+    TEST_ASSERT_EQUAL(expected, midi_log_count(&log_, query));
+    TEST_ASSERT_EQUAL(expected,
+                      midi_log_histogram(
+                          &log_, query, MIDI_LOG_COLUMN_DATA2, histogram));
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(expected_histogram, histogram, 128);
+
+    /* Select a few messages at a time */
+    size_t start = 0;
+    size_t found = 0;
+    for (;;) {
+        midi_packed_t packed[7];
+        uint32_t packed_times[7];
+        size_t next = 0;
+        const size_t written = midi_log_select(
+            &log_, query, start, packed, packed_times, 7, &next);
+
+        for (size_t i = 0; i < written; i++) {
+            TEST_ASSERT_LESS_THAN(expected, found);
+            TEST_ASSERT_EQUAL_HEX32(selected[found], packed[i]);
+            TEST_ASSERT_EQUAL_HEX32(selected_times[found++], packed_times[i]);
+        }
+        if (written < 7) {
+            TEST_ASSERT_EQUAL(count, next);
+            break;
+        }
+        start = next;
+    }
+    TEST_ASSERT_EQUAL(expected, found);
+}
+
+/*=====================================================================*
+    Append Tests
+ *=====================================================================*/
+
+/**
+ * @brief The storage is aligned and too small storage is rejected
+ */
+void test_log_init(void)
+{
+    midi_log_t small;
+
+    TEST_ASSERT_EQUAL(0,
+                      (uintptr_t)log_.chunks & (uintptr_t)(MIDI_LOG_ALIGN - 1));
+    TEST_ASSERT_EQUAL(0, midi_log_size(&log_));
+    TEST_ASSERT_GREATER_OR_EQUAL(LOG_MESSAGES, midi_log_capacity(&log_));
+
+    TEST_ASSERT_EQUAL(1,
+                      midi_log_init(&small, &storage[1],
+                                    MIDI_LOG_STORAGE_SIZE(1)));
+    TEST_ASSERT_EQUAL(MIDI_LOG_CHUNK_SIZE, midi_log_capacity(&small));
+    TEST_ASSERT_EQUAL(0,
+                      midi_log_init(&small, storage,
+                                    sizeof(midi_log_chunk_t) - 1));
+    TEST_ASSERT_EQUAL(0, midi_log_init(NULL, storage, sizeof(storage)));
+    TEST_ASSERT_EQUAL(0, midi_log_init(&small, NULL, sizeof(storage)));
+}
+
+/**
+ * @brief Messages come back in order across chunks, until the log is full
+ */
+void test_log_append_get(void)
+{
+    const size_t capacity = midi_log_capacity(&log_);
+    midi_packed_t packed;
+    uint32_t time;
+
+    generate_messages(LOG_MESSAGES);
+    TEST_ASSERT_EQUAL(300, midi_log_append(&log_, messages, times, 300));
+    TEST_ASSERT_EQUAL(LOG_MESSAGES - 300,
+                      midi_log_append(&log_, &messages[300], &times[300],
+                                      LOG_MESSAGES - 300));
+    TEST_ASSERT_EQUAL(LOG_MESSAGES, midi_log_size(&log_));
+
+    for (size_t i = 0; i < LOG_MESSAGES; i++) {
+        TEST_ASSERT_EQUAL(1, midi_log_get(&log_, i, &packed, &time));
+        TEST_ASSERT_EQUAL_HEX32(messages[i], packed);
+        TEST_ASSERT_EQUAL_HEX32(times[i], time);
+    }
+    TEST_ASSERT_EQUAL(0, midi_log_get(&log_, LOG_MESSAGES, &packed, NULL));
+
+    /* Without timestamps, then past the end of the storage */
+    TEST_ASSERT_EQUAL(1, midi_log_append(&log_, messages, NULL, 1));
+    TEST_ASSERT_EQUAL(1, midi_log_get(&log_, LOG_MESSAGES, &packed, &time));
+    TEST_ASSERT_EQUAL(0, time);
+    while (midi_log_size(&log_) < capacity) {
+        midi_log_append(&log_, messages, times, LOG_MESSAGES);
+    }
+    TEST_ASSERT_EQUAL(capacity, midi_log_size(&log_));
+    TEST_ASSERT_EQUAL(0, midi_log_append(&log_, messages, times, 1));
+
+    midi_log_clear(&log_);
+    TEST_ASSERT_EQUAL(0, midi_log_size(&log_));
+    TEST_ASSERT_EQUAL(0, midi_log_get(&log_, 0, &packed, NULL));
+    TEST_ASSERT_EQUAL(0, midi_log_append(NULL, messages, times, 1));
+    TEST_ASSERT_EQUAL(0, midi_log_append(&log_, NULL, times, 1));
+}
+
+/**
+ * @brief Parsing into the log gives the messages and arrival times of
+ *        midi_parse_buffer_packed_timed, and stops when the log is full
+ */
+void test_log_parse_buffer(void)
+{
+    midi_parser_t parser;
+    midi_parser_t reference_parser;
+    midi_log_t small;
+    midi_packed_t packed;
+    uint32_t time;
+    size_t consumed = 0;
+
+    for (size_t i = 0; i < STREAM_SIZE; i++) {
+        const uint32_t r = next_random();
+        stream[i] = (r % 5 == 0) ? (uint8_t)(0x80 | (r >> 8))
+                                 : (uint8_t)((r >> 8) & 0x7F);
+    }
+    midi_parser_init(&reference_parser);
+    const size_t expected = midi_parse_buffer_packed_timed(
+        &reference_parser, stream, STREAM_SIZE, 1000, 3,
+        messages, times, LOG_MESSAGES, NULL);
+    TEST_ASSERT_GREATER_THAN(MIDI_LOG_CHUNK_SIZE, expected);
+
+    midi_parser_init(&parser);
+    TEST_ASSERT_EQUAL(expected,
+                      midi_log_parse_buffer(&log_, &parser, stream,
+                                            STREAM_SIZE, 1000, 3, &consumed));
+    TEST_ASSERT_EQUAL(STREAM_SIZE, consumed);
+    for (size_t i = 0; i < expected; i++) {
+        TEST_ASSERT_EQUAL(1, midi_log_get(&log_, i, &packed, &time));
+        TEST_ASSERT_EQUAL_HEX32(messages[i], packed);
+        TEST_ASSERT_EQUAL(times[i], time);
+    }
+
+    /* A single chunk fills up, and the parse resumes where it stopped */
+    TEST_ASSERT_EQUAL(1, midi_log_init(&small, storage,
+                                       MIDI_LOG_STORAGE_SIZE(1)));
+    midi_parser_init(&parser);
+    TEST_ASSERT_EQUAL(MIDI_LOG_CHUNK_SIZE,
+                      midi_log_parse_buffer(&small, &parser, stream,
+                                            STREAM_SIZE, 1000, 3, &consumed));
+    TEST_ASSERT_LESS_THAN(STREAM_SIZE, consumed);
+    TEST_ASSERT_EQUAL(0,
+                      midi_log_parse_buffer(&small, &parser, stream,
+                                            STREAM_SIZE, 1000, 3, NULL));
+
+    midi_log_clear(&small);
+    const size_t first = consumed;
+    TEST_ASSERT_EQUAL(MIDI_LOG_CHUNK_SIZE,
+                      midi_log_parse_buffer(&small, &parser, &stream[first],
+                                            STREAM_SIZE - first,
+                                            1000 + 3 * (uint32_t)first, 3,
+                                            &consumed));
+    TEST_ASSERT_EQUAL(1, midi_log_get(&small, 0, &packed, &time));
+    TEST_ASSERT_EQUAL_HEX32(messages[MIDI_LOG_CHUNK_SIZE], packed);
+    TEST_ASSERT_EQUAL(times[MIDI_LOG_CHUNK_SIZE], time);
+
+    TEST_ASSERT_EQUAL(0,
+                      midi_log_parse_buffer(NULL, &parser, stream,
+                                            STREAM_SIZE, 0, 1, &consumed));
+    TEST_ASSERT_EQUAL(0, consumed);
+}
+
+/*=====================================================================*
+    Query Tests
+ *=====================================================================*/
+
+/**
+ * @brief Queries on each field match a scan of the messages
+ */
+void test_log_query_fields(void)
+{
+    midi_log_query_t query;
+
+    generate_messages(LOG_MESSAGES);
+    midi_log_append(&log_, messages, times, LOG_MESSAGES);
+
+    midi_log_query_init(&query);
+    TEST_ASSERT_EQUAL(LOG_MESSAGES, midi_log_count(&log_, &query));
+    assert_query(&query, LOG_MESSAGES);
+
+    query.message_type = MIDI_MESSAGE_NOTE_ON;
+    assert_query(&query, LOG_MESSAGES);
+    query.channel = MIDI_CHANNEL_2;
+    assert_query(&query, LOG_MESSAGES);
+    query.data1_min = 60;
+    query.data1_max = 72;
+    assert_query(&query, LOG_MESSAGES);
+    query.data2_min = 100;
+    assert_query(&query, LOG_MESSAGES);
+
+    midi_log_query_init(&query);
+    query.message_type = MIDI_MESSAGE_TIMING_CLOCK;
+    assert_query(&query, LOG_MESSAGES);
+
+    midi_log_query_init(&query);
+    query.channel = MIDI_CHANNEL_4;
+    query.data2_max = 10;
+    assert_query(&query, LOG_MESSAGES);
+
+    /* An empty range matches nothing */
+    midi_log_query_init(&query);
+    query.data1_min = 10;
+    query.data1_max = 9;
+    TEST_ASSERT_EQUAL(0, midi_log_count(&log_, &query));
+    assert_query(&query, LOG_MESSAGES);
+}
+
+/**
+ * @brief Time ranges, including one that wraps around, and queries that
+ *        skip whole chunks
+ */
+void test_log_query_time(void)
+{
+    midi_log_query_t query;
+
+    generate_messages(LOG_MESSAGES);
+    midi_log_append(&log_, messages, times, LOG_MESSAGES);
+
+    midi_log_query_init(&query);
+    query.time_from = times[100];
+    query.time_to = times[700];
+    assert_query(&query, LOG_MESSAGES);
+
+    /* The timestamps wrap around after message 512 */
+    query.time_from = times[400];
+    query.time_to = times[600];
+    TEST_ASSERT_EQUAL(201, midi_log_count(&log_, &query));
+    assert_query(&query, LOG_MESSAGES);
+
+    query.time_from = times[LOG_MESSAGES - 1] + 1;
+    query.time_to = times[0] - 1;
+    TEST_ASSERT_EQUAL(0, midi_log_count(&log_, &query));
+    assert_query(&query, LOG_MESSAGES);
+
+    /* Only the second chunk holds Control Change on every message */
+    midi_log_query_init(&query);
+    query.message_type = MIDI_MESSAGE_PROGRAM_CHANGE;
+    query.time_from = times[MIDI_LOG_CHUNK_SIZE];
+    query.time_to = times[2 * MIDI_LOG_CHUNK_SIZE - 1];
+    TEST_ASSERT_EQUAL(0, midi_log_count(&log_, &query));
+    assert_query(&query, LOG_MESSAGES);
+
+    /* A partial last chunk */
+    midi_log_clear(&log_);
+    midi_log_append(&log_, messages, times, MIDI_LOG_CHUNK_SIZE + 3);
+    midi_log_query_init(&query);
+    assert_query(&query, MIDI_LOG_CHUNK_SIZE + 3);
+}
+
+/**
+ * @brief Histograms add up over calls and count the first data byte
+ */
+void test_log_histogram(void)
+{
+    uint32_t histogram[128] = {0};
+    midi_log_query_t query;
+
+    generate_messages(LOG_MESSAGES);
+    midi_log_append(&log_, messages, times, LOG_MESSAGES);
+    midi_log_query_init(&query);
+    query.message_type = MIDI_MESSAGE_CONTROL_CHANGE;
+
+    const size_t count = midi_log_count(&log_, &query);
+    TEST_ASSERT_EQUAL(count,
+                      midi_log_histogram(&log_, &query, MIDI_LOG_COLUMN_DATA1,
+                                         histogram));
+    TEST_ASSERT_EQUAL(count,
+                      midi_log_histogram(&log_, &query, MIDI_LOG_COLUMN_DATA1,
+                                         histogram));
+
+    uint32_t total = 0;
+    for (size_t i = 0; i < LOG_MESSAGES; i++) {
+        if (midi_packed_type(messages[i]) == MIDI_MESSAGE_CONTROL_CHANGE
+            && midi_packed_data1(messages[i]) == 7) {
+            total += 2;
+        }
+    }
+    TEST_ASSERT_EQUAL(total, histogram[7]);
+
+    TEST_ASSERT_EQUAL(0,
+                      midi_log_histogram(&log_, &query, MIDI_LOG_COLUMN_DATA1,
+                                         NULL));
+    TEST_ASSERT_EQUAL(0, midi_log_count(NULL, &query));
+    TEST_ASSERT_EQUAL(0, midi_log_count(&log_, NULL));
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Append
+    RUN_TEST(test_log_init);
+    RUN_TEST(test_log_append_get);
+    RUN_TEST(test_log_parse_buffer);
+
+    // Query
+    RUN_TEST(test_log_query_fields);
+    RUN_TEST(test_log_query_time);
+    RUN_TEST(test_log_histogram);
+
+    return UNITY_END();
+}
@@ -0,0 +1,679 @@
+/***********************************************************************
+ * @file test_midi_net.c
+ * @brief Unit tests for the MIDI network transport module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_net.h"
+#include "../midi/midi_pool.h"
+#include "../midi/midi_state.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define MESSAGES (20000)
+#define BATCH (16)
+#define ITEMS (MIDI_NET_MAX_PACKET_SIZE + 1)
+#define SSRC (0x11223344u)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static midi_net_sender_t sender;
+static midi_net_receiver_t receiver;
+static midi_net_batch_t batch;
+static uint8_t storage[MIDI_NET_BATCH_STORAGE_SIZE(BATCH,
+                                                   MIDI_NET_MAX_PACKET_SIZE)];
+static midi_parser_pool_t pool;
+static uint8_t pool_storage[MIDI_PARSER_POOL_STORAGE_SIZE(1)];
+static midi_parser_pool_work_t items[ITEMS];
+static uint32_t item_times[ITEMS];
+static uint32_t out_ports[ITEMS];
+static midi_packed_t out_messages[ITEMS];
+static midi_packed_t messages[MESSAGES];
+static uint32_t times[MESSAGES];
+static midi_state_t expected_state;
+static midi_state_t received_state;
+static uint32_t random_state;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    midi_net_sender_init(&sender, SSRC, 0xFFF0, MIDI_NET_MAX_PACKET_SIZE);
+    midi_net_receiver_init(&receiver);
+    TEST_ASSERT_TRUE(midi_net_batch_init(&batch, storage, BATCH,
+                                         MIDI_NET_MAX_PACKET_SIZE));
+    midi_parser_pool_init(&pool, pool_storage, 1, NULL);
+    midi_state_init(&expected_state);
+    midi_state_init(&received_state);
+    random_state = 0x5EED1234;
+}
+
+void tearDown(void) {}
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Next pseudo random number
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief Make a random channel message on a few channels, notes and
+ *        controllers
+ */
+static midi_packed_t random_message(uint32_t channels,
+                                    uint32_t notes,
+                                    uint32_t controllers)
+{
+    const uint32_t r = next_random();
+    const midi_channel_t channel = (midi_channel_t)((r >> 4) % channels);
+    const uint8_t note = (uint8_t)((36 + (r >> 8) % notes) & 0x7F);
+    const uint8_t value = (uint8_t)((r >> 16) & 0x7F);
+    const uint32_t kind = r & 15;
+
+    if (kind < 5) {
+        return midi_packed_make(MIDI_MESSAGE_NOTE_ON, channel, note,
+                                (uint8_t)(value | 1));
+    }
+    if (kind < 10) {
+        return midi_packed_make(MIDI_MESSAGE_NOTE_OFF, channel, note, value);
+    }
+    if (kind == 10) {
+        return midi_packed_make(MIDI_MESSAGE_CONTROL_CHANGE, channel,
+                                MIDI_CC_SUSTAIN_PEDAL,
+                                (r >> 24) & 1 ? 127 : 0);
+    }
+    if (kind == 11) {
+        return midi_packed_make(MIDI_MESSAGE_CONTROL_CHANGE, channel,
+                                (uint8_t)(1 + (r >> 24) % controllers),
+                                value);
+    }
+    if (kind == 12) {
+        return midi_packed_make(MIDI_MESSAGE_PROGRAM_CHANGE, channel,
+                                value & 7, 0);
+    }
+    if (kind == 13) {
+        return midi_packed_make(MIDI_MESSAGE_PITCH_BEND, channel, value,
+                                (uint8_t)((r >> 24) & 0x7F));
+    }
+    if (kind == 14) {
+        return midi_packed_make(MIDI_MESSAGE_CHANNEL_PRESSURE, channel, value,
+                                0);
+    }
+    if ((r >> 24) < 4) {
+        /* Parsed as a Control Change when Channel Mode messages are
+         * compiled out */
+        return midi_packed_make(MIDI_CONFIG_CHANNEL_MODE
+                                    ? MIDI_MESSAGE_ALL_SOUND_OFF
+                                    : MIDI_MESSAGE_CONTROL_CHANGE,
+                                channel, MIDI_CC_ALL_SOUND_OFF, 0);
+    }
+    return midi_packed_make(MIDI_MESSAGE_TIMING_CLOCK, MIDI_CHANNEL_NONE, 0,
+                            0);
+}
+
+/**
+ * @brief Fill the messages with random messages at increasing times,
+ *        with a few long pauses
+ */
+static void make_messages(uint32_t channels,
+                          uint32_t notes,
+                          uint32_t controllers)
+{
+    uint32_t time = 0xFFFFF000u;
+
+    for (size_t i = 0; i < MESSAGES; i++) {
+        const uint32_t r = next_random();
+        messages[i] = random_message(channels, notes, controllers);
+        time += (r & 0xFF) == 0 ? 0x300000u : (r >> 8) % 300;
+        times[i] = time;
+    }
+}
+
+/**
+ * @brief Decode a packet and parse its items with the pool
+ * @return The number of messages parsed
+ */
+static size_t receive_packet(uint8_t *packet, size_t length)
+{
+    const size_t count = midi_net_receiver_decode(
+        &receiver, packet, length, 0, items, item_times, ITEMS);
+    const size_t parsed = midi_parser_pool_process(
+        &pool, items, count, out_ports, out_messages, ITEMS);
+    for (size_t i = 0; i < parsed; i++) {
+        midi_state_update_packed(&received_state, out_messages[i]);
+    }
+    return parsed;
+}
+
+/**
+ * @brief Check that the received state has the sounding notes and
+ *        channel values of the sent state
+ */
+static void check_states(void)
+{
+    for (uint8_t channel = 0; channel < MIDI_STATE_CHANNELS; channel++) {
+        for (uint8_t key = 0; key < MIDI_STATE_KEYS; key++) {
+            TEST_ASSERT_EQUAL(
+                midi_state_is_note_on(&expected_state, channel, key),
+                midi_state_is_note_on(&received_state, channel, key));
+        }
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_state.controllers[channel],
+                                      received_state.controllers[channel],
+                                      MIDI_STATE_KEYS);
+        TEST_ASSERT_EQUAL(expected_state.program[channel],
+                          received_state.program[channel]);
+        TEST_ASSERT_EQUAL(expected_state.pitch_bend[channel],
+                          received_state.pitch_bend[channel]);
+        TEST_ASSERT_EQUAL(expected_state.channel_pressure[channel],
+                          received_state.channel_pressure[channel]);
+    }
+}
+
+/**
+ * @brief Send the messages through a lossy link, checking the received
+ *        state after every packet that arrives
+ */
+static void check_lossy_link(size_t packet_size, int feedback)
+{
+    uint8_t acknowledgement[MIDI_NET_FEEDBACK_SIZE];
+    size_t sent = 0;
+    size_t dropped = 0;
+
+    midi_net_sender_init(&sender, SSRC, 0xFFF0, packet_size);
+    while (sent < MESSAGES) {
+        size_t count = 1 + next_random() % 40;
+        if (count > MESSAGES - sent) {
+            count = MESSAGES - sent;
+        }
+        const size_t packed = midi_net_sender_pack(
+            &sender, &messages[sent], &times[sent], count, &batch);
+        for (size_t i = 0; i < packed; i++) {
+            midi_state_update_packed(&expected_state, messages[sent + i]);
+        }
+        sent += packed;
+
+        /*
+         * The state matches once the last packet of the batch arrives.
+         * The first packet arrives, or the receiver would join the stream
+         * at the next one.
+         */
+        int arrived = 0;
+        for (size_t p = 0; p < batch.count; p++) {
+            size_t length = 0;
+            uint8_t *packet = midi_net_batch_packet(&batch, p, &length);
+            arrived = sent == MESSAGES || receiver.packets == 0
+                      || next_random() % 5 != 0;
+            if (!arrived) {
+                dropped++;
+                continue;
+            }
+            receive_packet(packet, length);
+            if (feedback) {
+                TEST_ASSERT_EQUAL(MIDI_NET_FEEDBACK_SIZE,
+                                  midi_net_receiver_feedback(
+                                      &receiver, acknowledgement,
+                                      sizeof(acknowledgement)));
+                midi_net_sender_feedback(&sender, acknowledgement,
+                                         sizeof(acknowledgement));
+            }
+        }
+        midi_net_batch_clear(&batch);
+        if (arrived) { check_states(); }
+    }
+
+    TEST_ASSERT_TRUE(dropped > 0);
+    TEST_ASSERT_EQUAL(dropped, receiver.lost);
+    TEST_ASSERT_EQUAL(dropped, receiver.recovered);
+    TEST_ASSERT_EQUAL(0, receiver.ignored);
+}
+
+/*=====================================================================*
+    Test Cases - Packets
+ *=====================================================================*/
+
+/**
+ * @brief Test the bytes of a packet and of its journal
+ */
+void test_net_packet_bytes(void)
+{
+    static const uint8_t first[] = {
+        0x80, 0x61, 0xFF, 0xF0, 0x00, 0x00, 0x03, 0xE8, 0x11, 0x22,
+        0x33, 0x44, 0x4B, 0x90, 0x3C, 0x64, 0x00, 0x40, 0x5A, 0x81,
+        0x48, 0x80, 0x3C, 0x40, 0xFF, 0xEF, 0x00, 0x00,
+    };
+    static const uint8_t second[] = {
+        0x80, 0x61, 0xFF, 0xF1, 0x00, 0x00, 0x05, 0x14, 0x11, 0x22,
+        0x33, 0x44, 0x43, 0xB0, 0x07, 0x32, 0xFF, 0xEF, 0x00, 0x06,
+        0x80, 0x3C, 0x40, 0x90, 0x40, 0x5A,
+    };
+    const midi_packed_t notes[] = {
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100),
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 64, 90),
+        midi_packed_make(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 60, 64),
+    };
+    const uint32_t note_times[] = {1000, 1000, 1200};
+    const midi_packed_t volume =
+        midi_packed_make(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1, 7, 50);
+    const uint32_t volume_time = 1300;
+    size_t length = 0;
+
+    TEST_ASSERT_EQUAL(3, midi_net_sender_pack(&sender, notes, note_times, 3,
+                                              &batch));
+    TEST_ASSERT_EQUAL(1, midi_net_sender_pack(&sender, &volume,
+                                              &volume_time, 1, &batch));
+    TEST_ASSERT_EQUAL(2, batch.count);
+
+    const uint8_t *packet = midi_net_batch_packet(&batch, 0, &length);
+    TEST_ASSERT_EQUAL(sizeof(first), length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(first, packet, sizeof(first));
+
+    /* The journal holds the notes of the first packet */
+    packet = midi_net_batch_packet(&batch, 1, &length);
+    TEST_ASSERT_EQUAL(sizeof(second), length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(second, packet, sizeof(second));
+    TEST_ASSERT_NULL(midi_net_batch_packet(&batch, 2, &length));
+}
+
+/**
+ * @brief Test that lists longer than 15 bytes use the long header
+ */
+void test_net_long_header(void)
+{
+    midi_packed_t notes[8];
+
+    for (size_t i = 0; i < 8; i++) {
+        notes[i] = midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_2,
+                                    (uint8_t)(60 + i), 100);
+    }
+    TEST_ASSERT_EQUAL(8, midi_net_sender_pack(&sender, notes, NULL, 8,
+                                              &batch));
+
+    /* A status byte, 8 notes and 7 delta times of 0 */
+    size_t length = 0;
+    const uint8_t *packet = midi_net_batch_packet(&batch, 0, &length);
+    TEST_ASSERT_EQUAL_HEX8(0xC0, packet[12]);
+    TEST_ASSERT_EQUAL_HEX8(1 + 8 * 2 + 7, packet[13]);
+    TEST_ASSERT_EQUAL_HEX8(0x91, packet[14]);
+    TEST_ASSERT_EQUAL(12 + 2 + 24 + 4, length);
+}
+
+/**
+ * @brief Test that packets split where the next message does not fit
+ */
+void test_net_packet_size(void)
+{
+    make_messages(16, 128, 100);
+    midi_net_sender_init(&sender, SSRC, 0, MIDI_NET_MIN_PACKET_SIZE);
+
+    const size_t packed = midi_net_sender_pack(&sender, messages, times,
+                                               MESSAGES, &batch);
+    TEST_ASSERT_EQUAL(BATCH, batch.count);
+    TEST_ASSERT_TRUE(packed > BATCH);
+    TEST_ASSERT_TRUE(packed < MESSAGES);
+    for (size_t p = 0; p < batch.count; p++) {
+        size_t length = 0;
+        midi_net_batch_packet(&batch, p, &length);
+        TEST_ASSERT_TRUE(length <= MIDI_NET_MIN_PACKET_SIZE);
+        TEST_ASSERT_TRUE(length > MIDI_NET_MIN_PACKET_SIZE / 2);
+    }
+}
+
+/*=====================================================================*
+    Test Cases - Receiver
+ *=====================================================================*/
+
+/**
+ * @brief Test that every message arrives in order, at its time, with
+ *        packets of several sizes
+ */
+void test_net_round_trip(void)
+{
+    static const size_t sizes[] = {MIDI_NET_MIN_PACKET_SIZE, 200,
+                                   MIDI_NET_MAX_PACKET_SIZE};
+
+    make_messages(16, 128, 100);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t sent = 0;
+        size_t received = 0;
+
+        midi_net_sender_init(&sender, SSRC + s, 0, sizes[s]);
+        midi_net_receiver_init(&receiver);
+        midi_parser_pool_reset_port(&pool, 0);
+        while (sent < MESSAGES) {
+            sent += midi_net_sender_pack(&sender, &messages[sent],
+                                         &times[sent], MESSAGES - sent,
+                                         &batch);
+            for (size_t p = 0; p < batch.count; p++) {
+                size_t length = 0;
+                uint8_t *packet = midi_net_batch_packet(&batch, p, &length);
+                const size_t count = receive_packet(packet, length);
+                TEST_ASSERT_EQUAL_HEX32_ARRAY(&messages[received],
+                                              out_messages, count);
+                TEST_ASSERT_EQUAL_UINT32_ARRAY(&times[received], item_times,
+                                               count);
+                received += count;
+            }
+            midi_net_batch_clear(&batch);
+        }
+        TEST_ASSERT_EQUAL(MESSAGES, received);
+        TEST_ASSERT_EQUAL(0, receiver.lost);
+        TEST_ASSERT_EQUAL(0, receiver.ignored);
+    }
+}
+
+/**
+ * @brief Test that the state of the receiver catches up after lost
+ *        packets, with feedback moving the checkpoint
+ */
+void test_net_recovery(void)
+{
+    make_messages(16, 128, 100);
+    check_lossy_link(MIDI_NET_MAX_PACKET_SIZE, 1);
+}
+
+/**
+ * @brief Test recovery from the initial state, without feedback
+ */
+void test_net_recovery_without_feedback(void)
+{
+    make_messages(2, 16, 4);
+    check_lossy_link(MIDI_NET_MAX_PACKET_SIZE, 0);
+}
+
+/**
+ * @brief Test that a receiver joining a stream gets its state from the
+ *        journal
+ */
+void test_net_late_join(void)
+{
+    for (size_t i = 0; i < 100; i++) {
+        messages[i] = random_message(2, 16, 4);
+        midi_state_update_packed(&expected_state, messages[i]);
+    }
+    TEST_ASSERT_EQUAL(50, midi_net_sender_pack(&sender, messages, NULL, 50,
+                                               &batch));
+    midi_net_batch_clear(&batch);
+    TEST_ASSERT_EQUAL(50, midi_net_sender_pack(&sender, &messages[50], NULL,
+                                               50, &batch));
+
+    size_t length = 0;
+    uint8_t *packet = midi_net_batch_packet(&batch, 0, &length);
+    receive_packet(packet, length);
+    check_states();
+    TEST_ASSERT_EQUAL(0, receiver.lost);
+}
+
+/**
+ * @brief Test commands that the sender does not write: a delta time
+ *        before the first command, System Real-Time, running status and
+ *        SysEx
+ */
+void test_net_foreign_commands(void)
+{
+    uint8_t packet[] = {
+        0x80, 0x61, 0x00, 0x07, 0x00, 0x00, 0x00, 0x64, 0x01, 0x02,
+        0x03, 0x04, 0x2E, 0x05, 0x90, 0x3C, 0x40, 0x00, 0xF8, 0x01,
+        0x3E, 0x40, 0x00, 0xF0, 0x01, 0x02, 0xF7,
+    };
+    const midi_packed_t expected[] = {
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 64),
+        midi_packed_make(MIDI_MESSAGE_TIMING_CLOCK, MIDI_CHANNEL_NONE, 0, 0),
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 62, 64),
+        midi_packed_make(MIDI_MESSAGE_SYSTEM_EXCLUSIVE, MIDI_CHANNEL_NONE, 0,
+                         0),
+        midi_packed_make(MIDI_MESSAGE_END_OF_EXCLUSIVE, MIDI_CHANNEL_NONE, 0,
+                         0),
+    };
+    const uint32_t expected_times[] = {105, 105, 106, 106};
+    const size_t expected_lengths[] = {3, 1, 2, 4};
+    /* The parser drops the SysEx when SysEx support is compiled out */
+    const size_t expected_count = MIDI_CONFIG_SYSEX ? 5 : 3;
+
+    const size_t count = midi_net_receiver_decode(
+        &receiver, packet, sizeof(packet), 3, items, item_times, ITEMS);
+    TEST_ASSERT_EQUAL(4, count);
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT_EQUAL(3, items[i].port);
+        TEST_ASSERT_EQUAL(expected_lengths[i], items[i].length);
+        TEST_ASSERT_EQUAL(expected_times[i], item_times[i]);
+    }
+    TEST_ASSERT_EQUAL_PTR(&packet[27 - 4], items[3].data);
+
+    midi_parser_pool_init(&pool, pool_storage, 1, NULL);
+    for (size_t i = 0; i < count; i++) { items[i].port = 0; }
+    TEST_ASSERT_EQUAL(expected_count,
+                      midi_parser_pool_process(&pool, items, count,
+                                               out_ports, out_messages,
+                                               ITEMS));
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(expected, out_messages, expected_count);
+    TEST_ASSERT_TRUE(midi_state_is_note_on(&receiver.state, 0, 62));
+}
+
+/**
+ * @brief Test that late, repeated, foreign and malformed packets are
+ *        ignored
+ */
+void test_net_ignored_packets(void)
+{
+    const midi_packed_t notes[] = {
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100),
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 62, 100),
+    };
+    uint8_t copy[MIDI_NET_MAX_PACKET_SIZE];
+    size_t first_length = 0;
+    size_t second_length = 0;
+
+    midi_net_sender_pack(&sender, &notes[0], NULL, 1, &batch);
+    midi_net_sender_pack(&sender, &notes[1], NULL, 1, &batch);
+    uint8_t *first = midi_net_batch_packet(&batch, 0, &first_length);
+    uint8_t *second = midi_net_batch_packet(&batch, 1, &second_length);
+
+    TEST_ASSERT_EQUAL(1, receive_packet(first, first_length));
+    TEST_ASSERT_EQUAL(1, receive_packet(second, second_length));
+    TEST_ASSERT_EQUAL(0, receive_packet(second, second_length));
+    TEST_ASSERT_EQUAL(0, receive_packet(first, first_length));
+    TEST_ASSERT_EQUAL(2, receiver.ignored);
+
+    /* Another stream */
+    memcpy(copy, second, second_length);
+    copy[11] ^= 1;
+    copy[3]++;
+    TEST_ASSERT_EQUAL(0, receive_packet(copy, second_length));
+
+    /* Wrong version, payload type, and truncated packets */
+    memcpy(copy, second, second_length);
+    copy[3]++;
+    copy[0] = 0x40;
+    TEST_ASSERT_EQUAL(0, receive_packet(copy, second_length));
+    copy[0] = 0x80;
+    copy[1] = 0x60;
+    TEST_ASSERT_EQUAL(0, receive_packet(copy, second_length));
+    copy[1] = 0x61;
+    TEST_ASSERT_EQUAL(0, receive_packet(copy, 12));
+    TEST_ASSERT_EQUAL(0, receive_packet(copy, 15));
+    TEST_ASSERT_EQUAL(7, receiver.ignored);
+    TEST_ASSERT_EQUAL(2, receiver.packets);
+
+    /* The valid copy is accepted */
+    TEST_ASSERT_EQUAL(1, receive_packet(copy, second_length));
+    TEST_ASSERT_EQUAL(3, receiver.packets);
+    TEST_ASSERT_EQUAL(0, receiver.lost);
+
+    /* Invalid arguments */
+    TEST_ASSERT_EQUAL(0, midi_net_receiver_decode(NULL, copy, second_length,
+                                                  0, items, NULL, ITEMS));
+    TEST_ASSERT_EQUAL(0, midi_net_receiver_decode(&receiver, NULL, 0, 0,
+                                                  items, NULL, ITEMS));
+    TEST_ASSERT_EQUAL(0, midi_net_sender_pack(NULL, notes, NULL, 1, &batch));
+    TEST_ASSERT_EQUAL(0, midi_net_sender_pack(&sender, notes, NULL, 1,
+                                              NULL));
+    TEST_ASSERT_FALSE(midi_net_batch_init(&batch, storage, 0,
+                                          MIDI_NET_MAX_PACKET_SIZE));
+    TEST_ASSERT_FALSE(midi_net_batch_init(&batch, storage,
+                                          MIDI_NET_MAX_BATCH + 1,
+                                          MIDI_NET_MAX_PACKET_SIZE));
+    TEST_ASSERT_FALSE(midi_net_batch_init(&batch, NULL, 1,
+                                          MIDI_NET_MAX_PACKET_SIZE));
+
+    /* Packets smaller than the sender's are refused */
+    TEST_ASSERT_TRUE(midi_net_batch_init(&batch, storage, 1, 100));
+    TEST_ASSERT_EQUAL(0, midi_net_sender_pack(&sender, notes, NULL, 1,
+                                              &batch));
+}
+
+/*=====================================================================*
+    Test Cases - Feedback
+ *=====================================================================*/
+
+/**
+ * @brief Test that feedback moves the checkpoint and empties the journal
+ */
+void test_net_feedback(void)
+{
+    static const uint8_t expected[] = {
+        0xFF, 0xFF, 'R', 'S', 0x11, 0x22, 0x33, 0x44, 0xFF, 0xF0, 0, 0,
+    };
+    const midi_packed_t note =
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100);
+    const midi_packed_t bend =
+        midi_packed_make(MIDI_MESSAGE_PITCH_BEND, MIDI_CHANNEL_1, 0, 0x50);
+    uint8_t feedback[MIDI_NET_FEEDBACK_SIZE];
+    size_t length = 0;
+
+    TEST_ASSERT_EQUAL(0, midi_net_receiver_feedback(&receiver, feedback,
+                                                    sizeof(feedback)));
+    midi_net_sender_pack(&sender, &note, NULL, 1, &batch);
+    uint8_t *packet = midi_net_batch_packet(&batch, 0, &length);
+    receive_packet(packet, length);
+    TEST_ASSERT_EQUAL(0, midi_net_receiver_feedback(&receiver, feedback,
+                                                    sizeof(feedback) - 1));
+    TEST_ASSERT_EQUAL(sizeof(feedback),
+                      midi_net_receiver_feedback(&receiver, feedback,
+                                                 sizeof(feedback)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, feedback, sizeof(feedback));
+
+    /* Short, foreign and repeated feedback is ignored */
+    TEST_ASSERT_FALSE(midi_net_sender_feedback(&sender, feedback, 11));
+    feedback[7] ^= 1;
+    TEST_ASSERT_FALSE(midi_net_sender_feedback(&sender, feedback, 12));
+    feedback[7] ^= 1;
+    TEST_ASSERT_TRUE(midi_net_sender_feedback(&sender, feedback, 12));
+    TEST_ASSERT_FALSE(midi_net_sender_feedback(&sender, feedback, 12));
+
+    /* The next journal is empty, from the acknowledged packet */
+    midi_net_sender_pack(&sender, &bend, NULL, 1, &batch);
+    packet = midi_net_batch_packet(&batch, 1, &length);
+    TEST_ASSERT_EQUAL(12 + 1 + 3 + 4, length);
+    TEST_ASSERT_EQUAL_HEX8(0xFF, packet[16]);
+    TEST_ASSERT_EQUAL_HEX8(0xF0, packet[17]);
+    TEST_ASSERT_EQUAL_HEX8(0x00, packet[19]);
+
+    /* Feedback for a packet not sent yet is ignored */
+    feedback[9] = 0xF5;
+    TEST_ASSERT_FALSE(midi_net_sender_feedback(&sender, feedback, 12));
+
+    /* The journal of the next packet holds the bend */
+    midi_net_sender_pack(&sender, &note, NULL, 1, &batch);
+    packet = midi_net_batch_packet(&batch, 2, &length);
+    TEST_ASSERT_EQUAL_HEX8(0xF0, packet[17]);
+    TEST_ASSERT_EQUAL_HEX8(0x03, packet[19]);
+    TEST_ASSERT_EQUAL_HEX8(0xE0, packet[20]);
+}
+
+/*=====================================================================*
+    Test Cases - Sockets
+ *=====================================================================*/
+
+/**
+ * @brief Test sending and receiving a batch with one call each
+ */
+void test_net_socket_batch(void)
+{
+    static uint8_t received_storage[sizeof(storage)];
+    midi_net_batch_t received;
+    int fds[2];
+
+    make_messages(16, 128, 100);
+    TEST_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_DGRAM, 0, fds));
+    TEST_ASSERT_TRUE(midi_net_batch_init(&received, received_storage, BATCH,
+                                         MIDI_NET_MAX_PACKET_SIZE));
+    TEST_ASSERT_EQUAL(0, midi_net_receive(fds[1], &received, MSG_DONTWAIT));
+
+    midi_net_sender_pack(&sender, messages, times, 3000, &batch);
+    const size_t count = batch.count;
+    TEST_ASSERT_TRUE(count > 1);
+    uint8_t copy[BATCH][MIDI_NET_MAX_PACKET_SIZE];
+    size_t lengths[BATCH];
+    for (size_t p = 0; p < count; p++) {
+        const uint8_t *packet = midi_net_batch_packet(&batch, p, &lengths[p]);
+        memcpy(copy[p], packet, lengths[p]);
+    }
+
+    TEST_ASSERT_EQUAL(count, midi_net_send(fds[0], &batch, NULL, 0));
+    TEST_ASSERT_EQUAL(0, batch.count);
+    TEST_ASSERT_EQUAL(count, midi_net_receive(fds[1], &received,
+                                              MSG_DONTWAIT));
+    for (size_t p = 0; p < count; p++) {
+        size_t length = 0;
+        const uint8_t *packet = midi_net_batch_packet(&received, p, &length);
+        TEST_ASSERT_EQUAL(lengths[p], length);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(copy[p], packet, length);
+    }
+    TEST_ASSERT_EQUAL(0, midi_net_send(fds[0], &batch, NULL, 0));
+    TEST_ASSERT_EQUAL(0, midi_net_receive(-1, &received, MSG_DONTWAIT));
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Packets
+    RUN_TEST(test_net_packet_bytes);
+    RUN_TEST(test_net_long_header);
+    RUN_TEST(test_net_packet_size);
+
+    // Receiver
+    RUN_TEST(test_net_round_trip);
+    RUN_TEST(test_net_recovery);
+    RUN_TEST(test_net_recovery_without_feedback);
+    RUN_TEST(test_net_late_join);
+    RUN_TEST(test_net_foreign_commands);
+    RUN_TEST(test_net_ignored_packets);
+
+    // Feedback
+    RUN_TEST(test_net_feedback);
+
+    // Sockets
+    RUN_TEST(test_net_socket_batch);
+
+    return UNITY_END();
+}
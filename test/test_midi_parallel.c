@@ -0,0 +1,293 @@
+/***********************************************************************
+ * @file test_midi_parallel.c
+ * @brief Unit tests for the MIDI parallel decoder module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_parallel.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define STREAM_SIZE (1 << 18)
+#define MAX_CHUNKS (16384)
+#define SMALL_CHUNK (64)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static uint8_t stream[STREAM_SIZE];
+static midi_packed_t reference[STREAM_SIZE];
+static size_t reference_count;
+static midi_parser_state_t reference_state;
+static midi_packed_t output[STREAM_SIZE];
+static midi_parallel_chunk_t chunks[MAX_CHUNKS];
+static midi_parser_t config;
+static uint32_t random_state;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    midi_parser_init(&config);
+    random_state = 0x2545F491;
+    memset(output, 0, sizeof(output));
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Next pseudo random number
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief Generate a stream whose status bytes grow sparse and dense in
+ *        turns, so that some chunks have no sync point, with SysEx,
+ *        realtime and undefined bytes
+ */
+static void generate_stream(void)
+{
+    for (size_t i = 0; i < STREAM_SIZE; i++) {
+        const uint32_t r = next_random();
+        const uint32_t density = (i >> 14) & 1 ? 0x3F : 0x0FFF;
+
+        if ((r & density) == 0) {
+            stream[i] = (uint8_t)(0x80 | (r >> 16));
+        } else {
+            stream[i] = (uint8_t)((r >> 16) & 0x7F);
+        }
+    }
+}
+
+/**
+ * @brief Parse the whole stream on one parser as the reference
+ */
+static void parse_reference(const midi_parser_state_t *start)
+{
+    midi_parser_t parser = config;
+
+    if (start != NULL) { midi_parser_restore_state(&parser, start); }
+    reference_count = midi_parse_buffer_packed(
+        &parser, stream, STREAM_SIZE, reference, STREAM_SIZE, NULL);
+    midi_parser_save_state(&parser, &reference_state);
+}
+
+/**
+ * @brief Check the output and end state against the reference
+ */
+static void assert_matches_reference(size_t count,
+                                     const midi_parser_state_t *state)
+{
+    TEST_ASSERT_EQUAL(reference_count, count);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(reference, output, count);
+    TEST_ASSERT_EQUAL(reference_state.message_type, state->message_type);
+    TEST_ASSERT_EQUAL(reference_state.channel, state->channel);
+    TEST_ASSERT_EQUAL(reference_state.byte_count, state->byte_count);
+    TEST_ASSERT_EQUAL(reference_state.sysex_flags, state->sysex_flags);
+    if (state->byte_count > 0) {
+        TEST_ASSERT_EQUAL(reference_state.buffer[0], state->buffer[0]);
+    }
+}
+
+/**
+ * @brief Decode the stream with the chunk functions, in chunks of
+ *        pseudo random sizes, on the calling thread
+ */
+static size_t decode_in_chunks(size_t max_chunk, midi_parser_state_t *state)
+{
+    midi_parser_t parser = config;
+    midi_parser_state_t start;
+    size_t count = 0;
+    size_t begin = 0;
+
+    midi_parser_reset(&parser);
+    midi_parser_save_state(&parser, &start);
+
+    while (begin < STREAM_SIZE) {
+        size_t length = 1 + next_random() % max_chunk;
+        if (length > STREAM_SIZE - begin) { length = STREAM_SIZE - begin; }
+        TEST_ASSERT_LESS_THAN(MAX_CHUNKS, count);
+        midi_parallel_chunk_init(&chunks[count++], &stream[begin], length);
+        begin += length;
+    }
+
+    /* Scan the chunks out of order, as threads would */
+    for (size_t c = count; c-- > 0;) {
+        midi_parallel_scan(&chunks[c], &config, c == 0 ? &start : NULL);
+    }
+    const size_t total = midi_parallel_link(chunks, count, &config, &start);
+    for (size_t c = count; c-- > 0;) {
+        TEST_ASSERT_EQUAL(chunks[c].count,
+                          midi_parallel_emit(&chunks[c], &config, output));
+    }
+
+    *state = chunks[count - 1].end;
+    return total;
+}
+
+/*=====================================================================*
+    Chunk Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test chunks of a few bytes, which cut every kind of message
+ */
+void test_parallel_small_chunks(void)
+{
+    midi_parser_state_t state;
+
+    generate_stream();
+    parse_reference(NULL);
+
+    const size_t count = decode_in_chunks(SMALL_CHUNK, &state);
+    assert_matches_reference(count, &state);
+}
+
+/**
+ * @brief Test chunks with the filters of the configuration
+ */
+void test_parallel_filters(void)
+{
+    midi_parser_state_t state;
+
+    midi_parser_set_channel_mask(&config, 0x00F0);
+    midi_parser_set_message_enabled(&config, MIDI_MESSAGE_TIMING_CLOCK, 0);
+    midi_parser_set_controller_enabled(&config, MIDI_CC_MOD_WHEEL, 0);
+    generate_stream();
+    parse_reference(NULL);
+
+    const size_t count = decode_in_chunks(SMALL_CHUNK, &state);
+    assert_matches_reference(count, &state);
+}
+
+/**
+ * @brief Test that a stream of one status byte and only data bytes
+ *        after it links through every chunk
+ */
+void test_parallel_running_status(void)
+{
+    midi_parser_state_t state;
+
+    for (size_t i = 0; i < STREAM_SIZE; i++) {
+        stream[i] = (uint8_t)(next_random() & 0x7F);
+    }
+    stream[5] = 0x93;
+    parse_reference(NULL);
+    TEST_ASSERT_GREATER_THAN(STREAM_SIZE / 3, reference_count);
+
+    const size_t count = decode_in_chunks(STREAM_SIZE / 64, &state);
+    assert_matches_reference(count, &state);
+}
+
+/*=====================================================================*
+    Thread Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test the threaded decoder with several thread counts
+ */
+void test_parallel_decode_threads(void)
+{
+    static const size_t thread_counts[] = {1, 2, 3, 7, 16, 64};
+
+    generate_stream();
+    parse_reference(NULL);
+
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(size_t); t++) {
+        midi_parser_t parser = config;
+        midi_parser_state_t state;
+
+        midi_parser_reset(&parser);
+        midi_parser_save_state(&parser, &state);
+        memset(output, 0, sizeof(output));
+
+        const size_t count = midi_parallel_decode(&config, stream,
+                                                  STREAM_SIZE, output,
+                                                  STREAM_SIZE,
+                                                  thread_counts[t], &state);
+        assert_matches_reference(count, &state);
+    }
+}
+
+/**
+ * @brief Test continuing from a state and the argument checks
+ */
+void test_parallel_decode_state(void)
+{
+    static const uint8_t head[] = {0xF0, 0x01, 0xB2, 0x07};
+    static const uint8_t note[] = {0x90, 0x3C, 0x40};
+    midi_parser_t parser = config;
+    midi_parser_state_t state;
+    midi_packed_t packed[4];
+
+    generate_stream();
+    /* Start with data bytes that complete the head's Control Change */
+    stream[0] = 0x40;
+    stream[1] = 0x0A;
+
+    midi_parse_buffer_packed(&parser, head, sizeof(head), packed, 4, NULL);
+    midi_parser_save_state(&parser, &state);
+    parse_reference(&state);
+
+    const size_t count = midi_parallel_decode(NULL, stream, STREAM_SIZE,
+                                              output, STREAM_SIZE, 8, &state);
+    assert_matches_reference(count, &state);
+    TEST_ASSERT_EQUAL_HEX32(
+        midi_packed_make(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_3, 0x07,
+                         0x40),
+        output[0]);
+
+    /* Short streams, a NULL state, and invalid arguments */
+    TEST_ASSERT_EQUAL(1, midi_parallel_decode(NULL, note, sizeof(note), output,
+                                              4, 64, NULL));
+    TEST_ASSERT_EQUAL(0, midi_parallel_decode(NULL, stream, STREAM_SIZE,
+                                              output, 1, 8, NULL));
+    TEST_ASSERT_EQUAL(0, midi_parallel_decode(NULL, stream, STREAM_SIZE,
+                                              output, STREAM_SIZE, 0, NULL));
+    TEST_ASSERT_EQUAL(0, midi_parallel_decode(NULL, stream, STREAM_SIZE,
+                                              output, STREAM_SIZE,
+                                              MIDI_PARALLEL_MAX_THREADS + 1,
+                                              NULL));
+    TEST_ASSERT_EQUAL(0, midi_parallel_decode(NULL, NULL, STREAM_SIZE,
+                                              output, STREAM_SIZE, 8, NULL));
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Chunks
+    RUN_TEST(test_parallel_small_chunks);
+    RUN_TEST(test_parallel_filters);
+    RUN_TEST(test_parallel_running_status);
+
+    // Threads
+    RUN_TEST(test_parallel_decode_threads);
+    RUN_TEST(test_parallel_decode_state);
+
+    return UNITY_END();
+}
@@ -0,0 +1,351 @@
+/***********************************************************************
+ * @file test_midi_param.c
+ * @brief Unit tests for the MIDI parameter decoder module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_param.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define MAX_EVENTS (16)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static midi_param_decoder_t decoder;
+static midi_param_event_t events[MAX_EVENTS];
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    midi_param_init(&decoder, MIDI_PARAM_FLAG_ALL,
+                    MIDI_PARAM_ORDER_IMMEDIATE, 0);
+    memset(events, 0, sizeof(events));
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Decode a Control Change message
+ */
+static size_t control(midi_channel_t channel,
+                      midi_controller_t controller,
+                      uint8_t value,
+                      uint32_t timestamp)
+{
+    midi_message_t message;
+
+    memset(&message, 0, sizeof(message));
+    message.message_type = MIDI_MESSAGE_CONTROL_CHANGE;
+    message.channel = channel;
+    message.controller = controller;
+    message.control_value = value;
+    return midi_param_process(&decoder, &message, timestamp, events,
+                              MAX_EVENTS);
+}
+
+/**
+ * @brief Decode a Note On message
+ */
+static size_t note_on(midi_channel_t channel, uint8_t note, uint32_t time)
+{
+    midi_message_t message;
+
+    memset(&message, 0, sizeof(message));
+    message.message_type = MIDI_MESSAGE_NOTE_ON;
+    message.channel = channel;
+    message.note = note;
+    message.velocity = 100;
+    return midi_param_process(&decoder, &message, time, events, MAX_EVENTS);
+}
+
+/**
+ * @brief Check the fields of a value event
+ */
+static void assert_event(const midi_param_event_t *event,
+                         midi_param_event_type_t type,
+                         midi_channel_t channel,
+                         uint16_t number,
+                         uint16_t value)
+{
+    TEST_ASSERT_EQUAL(type, event->type);
+    TEST_ASSERT_EQUAL(MIDI_PARAM_OP_SET, event->op);
+    TEST_ASSERT_EQUAL(channel, event->channel);
+    TEST_ASSERT_EQUAL_HEX16(number, event->number);
+    TEST_ASSERT_EQUAL_HEX16(value, event->value);
+}
+
+/*=====================================================================*
+    Controller Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test 14-bit controllers emitted on the MSB and the LSB
+ */
+void test_param_controller_immediate(void)
+{
+    TEST_ASSERT_EQUAL(1, control(3, MIDI_CC_MOD_WHEEL, 0x40, 10));
+    assert_event(&events[0], MIDI_PARAM_EVENT_CONTROLLER, 3,
+                 MIDI_CC_MOD_WHEEL, 0x2000);
+    TEST_ASSERT_EQUAL(10, events[0].timestamp);
+
+    TEST_ASSERT_EQUAL(1, control(3, MIDI_CC_MOD_WHEEL_LSB, 0x05, 11));
+    assert_event(&events[0], MIDI_PARAM_EVENT_CONTROLLER, 3,
+                 MIDI_CC_MOD_WHEEL, 0x2005);
+
+    /* An LSB alone combines with the latched MSB */
+    TEST_ASSERT_EQUAL(1, control(3, MIDI_CC_MOD_WHEEL_LSB, 0x7F, 12));
+    TEST_ASSERT_EQUAL_HEX16(0x207F, events[0].value);
+
+    /* Controllers without an LSB partner pass through */
+    TEST_ASSERT_EQUAL(1, control(3, MIDI_CC_SUSTAIN_PEDAL, 127, 13));
+    TEST_ASSERT_EQUAL(MIDI_PARAM_EVENT_MESSAGE, events[0].type);
+    TEST_ASSERT_EQUAL_HEX32(
+        midi_packed_make(MIDI_MESSAGE_CONTROL_CHANGE, 3,
+                         MIDI_CC_SUSTAIN_PEDAL, 127),
+        events[0].message);
+}
+
+/**
+ * @brief Test 14-bit controllers that wait for their LSB
+ */
+void test_param_controller_paired(void)
+{
+    midi_param_init(&decoder, MIDI_PARAM_FLAG_CONTROLLERS,
+                    MIDI_PARAM_ORDER_PAIRED, 0);
+
+    TEST_ASSERT_EQUAL(0, control(0, MIDI_CC_CHANNEL_VOLUME, 0x64, 1));
+    TEST_ASSERT_EQUAL(1, control(0, MIDI_CC_CHANNEL_VOLUME_LSB, 0x01, 2));
+    assert_event(&events[0], MIDI_PARAM_EVENT_CONTROLLER, 0,
+                 MIDI_CC_CHANNEL_VOLUME, 0x3201);
+    TEST_ASSERT_EQUAL(2, events[0].timestamp);
+
+    /* Another message of the channel emits the MSB alone before it */
+    TEST_ASSERT_EQUAL(0, control(0, MIDI_CC_PAN, 0x10, 3));
+    TEST_ASSERT_EQUAL(2, note_on(0, 60, 4));
+    assert_event(&events[0], MIDI_PARAM_EVENT_CONTROLLER, 0, MIDI_CC_PAN,
+                 0x0800);
+    TEST_ASSERT_EQUAL(3, events[0].timestamp);
+    TEST_ASSERT_EQUAL(MIDI_PARAM_EVENT_MESSAGE, events[1].type);
+
+    /* Messages of other channels do not */
+    TEST_ASSERT_EQUAL(0, control(0, MIDI_CC_PAN, 0x11, 5));
+    TEST_ASSERT_EQUAL(1, note_on(1, 60, 6));
+    TEST_ASSERT_EQUAL(MIDI_PARAM_EVENT_MESSAGE, events[0].type);
+    TEST_ASSERT_EQUAL(1, midi_param_flush(&decoder, events, MAX_EVENTS));
+    TEST_ASSERT_EQUAL_HEX16(0x0880, events[0].value);
+    TEST_ASSERT_EQUAL(0, midi_param_flush(&decoder, events, MAX_EVENTS));
+}
+
+/**
+ * @brief Test that a pending MSB is emitted when its timeout expires
+ */
+void test_param_controller_timeout(void)
+{
+    midi_param_init(&decoder, MIDI_PARAM_FLAG_ALL,
+                    MIDI_PARAM_ORDER_PAIRED, 100);
+
+    /* The timestamps wrap around */
+    TEST_ASSERT_EQUAL(0, control(2, MIDI_CC_BREATH_CONTROLLER, 1,
+                                 UINT32_MAX - 10));
+    TEST_ASSERT_EQUAL(0, control(5, MIDI_CC_BREATH_CONTROLLER, 2, 50));
+    TEST_ASSERT_EQUAL(0, midi_param_poll(&decoder, 80, events, MAX_EVENTS));
+    TEST_ASSERT_EQUAL(1, midi_param_poll(&decoder, 89, events, MAX_EVENTS));
+    assert_event(&events[0], MIDI_PARAM_EVENT_CONTROLLER, 2,
+                 MIDI_CC_BREATH_CONTROLLER, 0x0080);
+    TEST_ASSERT_EQUAL(1, midi_param_poll(&decoder, 150, events, MAX_EVENTS));
+    TEST_ASSERT_EQUAL(5, events[0].channel);
+
+    /* A late LSB is emitted on its own, after the MSB */
+    TEST_ASSERT_EQUAL(0, control(2, MIDI_CC_BREATH_CONTROLLER, 3, 200));
+    TEST_ASSERT_EQUAL(2, control(2, MIDI_CC_BREATH_CONTROLLER_LSB, 4, 300));
+    TEST_ASSERT_EQUAL_HEX16(0x0180, events[0].value);
+    TEST_ASSERT_EQUAL_HEX16(0x0184, events[1].value);
+}
+
+/*=====================================================================*
+    Parameter Number Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test a pitch bend sensitivity change through RPN 0
+ */
+void test_param_rpn(void)
+{
+    TEST_ASSERT_EQUAL(0, control(1, MIDI_CC_RPN_MSB, 0, 1));
+    TEST_ASSERT_EQUAL(0, control(1, MIDI_CC_RPN_LSB, 0, 2));
+    TEST_ASSERT_EQUAL(1, control(1, MIDI_CC_DATA_ENTRY_MSB, 12, 3));
+    assert_event(&events[0], MIDI_PARAM_EVENT_RPN, 1, 0x0000, 12 << 7);
+    TEST_ASSERT_EQUAL(1, control(1, MIDI_CC_DATA_ENTRY_LSB, 50, 4));
+    assert_event(&events[0], MIDI_PARAM_EVENT_RPN, 1, 0x0000,
+                 (12 << 7) | 50);
+
+    TEST_ASSERT_EQUAL(1, control(1, MIDI_CC_DATA_INCREMENT, 0, 5));
+    TEST_ASSERT_EQUAL(MIDI_PARAM_EVENT_RPN, events[0].type);
+    TEST_ASSERT_EQUAL(MIDI_PARAM_OP_INCREMENT, events[0].op);
+    TEST_ASSERT_EQUAL(1, control(1, MIDI_CC_DATA_DECREMENT, 0, 6));
+    TEST_ASSERT_EQUAL(MIDI_PARAM_OP_DECREMENT, events[0].op);
+
+    /* Selecting the null RPN makes Data Entry a plain controller */
+    TEST_ASSERT_EQUAL(0, control(1, MIDI_CC_RPN_MSB, 127, 7));
+    TEST_ASSERT_EQUAL(0, control(1, MIDI_CC_RPN_LSB, 127, 8));
+    TEST_ASSERT_EQUAL(1, control(1, MIDI_CC_DATA_ENTRY_MSB, 3, 9));
+    assert_event(&events[0], MIDI_PARAM_EVENT_CONTROLLER, 1,
+                 MIDI_CC_DATA_ENTRY_MSB, 3 << 7);
+    TEST_ASSERT_EQUAL(1, control(1, MIDI_CC_DATA_INCREMENT, 0, 10));
+    TEST_ASSERT_EQUAL(MIDI_PARAM_EVENT_MESSAGE, events[0].type);
+}
+
+/**
+ * @brief Test NRPN selection, and that it is kept apart from the RPN
+ */
+void test_param_nrpn(void)
+{
+    midi_param_init(&decoder, MIDI_PARAM_FLAG_ALL, MIDI_PARAM_ORDER_PAIRED,
+                    0);
+
+    TEST_ASSERT_EQUAL(0, control(9, MIDI_CC_RPN_MSB, 0, 1));
+    TEST_ASSERT_EQUAL(0, control(9, MIDI_CC_RPN_LSB, 2, 2));
+    TEST_ASSERT_EQUAL(0, control(9, MIDI_CC_NRPN_MSB, 0x12, 3));
+    TEST_ASSERT_EQUAL(0, control(9, MIDI_CC_NRPN_LSB, 0x34, 4));
+    TEST_ASSERT_EQUAL(0, control(9, MIDI_CC_DATA_ENTRY_MSB, 0x7F, 5));
+    TEST_ASSERT_EQUAL(1, control(9, MIDI_CC_DATA_ENTRY_LSB, 0x7F, 6));
+    assert_event(&events[0], MIDI_PARAM_EVENT_NRPN, 9, (0x12 << 7) | 0x34,
+                 0x3FFF);
+
+    /* Changing a single byte of the selection keeps the other one */
+    TEST_ASSERT_EQUAL(0, control(9, MIDI_CC_RPN_LSB, 1, 7));
+    TEST_ASSERT_EQUAL(0, control(9, MIDI_CC_DATA_ENTRY_MSB, 0x40, 8));
+    TEST_ASSERT_EQUAL(1, control(9, MIDI_CC_DATA_ENTRY_LSB, 0, 9));
+    assert_event(&events[0], MIDI_PARAM_EVENT_RPN, 9, 0x0001, 0x2000);
+
+    /* A pending Data Entry MSB is emitted before a new selection */
+    TEST_ASSERT_EQUAL(0, control(9, MIDI_CC_DATA_ENTRY_MSB, 0x01, 10));
+    TEST_ASSERT_EQUAL(1, control(9, MIDI_CC_NRPN_LSB, 0x35, 11));
+    assert_event(&events[0], MIDI_PARAM_EVENT_RPN, 9, 0x0001, 0x0080);
+
+    /* And an LSB alone after it does not reuse the old MSB */
+    TEST_ASSERT_EQUAL(1, control(9, MIDI_CC_DATA_ENTRY_LSB, 0x05, 12));
+    assert_event(&events[0], MIDI_PARAM_EVENT_NRPN, 9, (0x12 << 7) | 0x35,
+                 0x0005);
+}
+
+/**
+ * @brief Test the flags, Reset All Controllers and System Reset
+ */
+void test_param_flags_and_resets(void)
+{
+    midi_message_t message;
+
+    /* Without the RPN flag, RPN controllers pass through */
+    midi_param_init(&decoder, MIDI_PARAM_FLAG_NRPN,
+                    MIDI_PARAM_ORDER_IMMEDIATE, 0);
+    TEST_ASSERT_EQUAL(1, control(0, MIDI_CC_RPN_MSB, 0, 1));
+    TEST_ASSERT_EQUAL(MIDI_PARAM_EVENT_MESSAGE, events[0].type);
+    TEST_ASSERT_EQUAL(1, control(0, MIDI_CC_DATA_ENTRY_MSB, 2, 2));
+    TEST_ASSERT_EQUAL(MIDI_PARAM_EVENT_MESSAGE, events[0].type);
+    TEST_ASSERT_EQUAL(1, control(0, MIDI_CC_MOD_WHEEL, 2, 3));
+    TEST_ASSERT_EQUAL(MIDI_PARAM_EVENT_MESSAGE, events[0].type);
+
+    /* Reset All Controllers selects the null parameters */
+    TEST_ASSERT_EQUAL(0, control(0, MIDI_CC_NRPN_MSB, 1, 4));
+    TEST_ASSERT_EQUAL(0, control(0, MIDI_CC_NRPN_LSB, 1, 5));
+    memset(&message, 0, sizeof(message));
+    message.message_type = MIDI_MESSAGE_RESET_ALL_CONTROLLERS;
+    message.channel = 0;
+    message.controller = MIDI_CC_RESET_ALL_CONTROLLERS;
+    TEST_ASSERT_EQUAL(1, midi_param_process(&decoder, &message, 6, events,
+                                            MAX_EVENTS));
+    TEST_ASSERT_EQUAL(MIDI_PARAM_EVENT_MESSAGE, events[0].type);
+    TEST_ASSERT_EQUAL(1, control(0, MIDI_CC_DATA_ENTRY_MSB, 2, 7));
+    TEST_ASSERT_EQUAL(MIDI_PARAM_EVENT_MESSAGE, events[0].type);
+
+    /* System Reset drops the pending MSBs and passes through */
+    midi_param_init(&decoder, MIDI_PARAM_FLAG_ALL, MIDI_PARAM_ORDER_PAIRED,
+                    0);
+    TEST_ASSERT_EQUAL(0, control(4, MIDI_CC_MOD_WHEEL, 2, 8));
+    memset(&message, 0, sizeof(message));
+    message.message_type = MIDI_MESSAGE_SYSTEM_RESET;
+    message.channel = MIDI_CHANNEL_NONE;
+    TEST_ASSERT_EQUAL(1, midi_param_process(&decoder, &message, 9, events,
+                                            MAX_EVENTS));
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_SYSTEM_RESET,
+                      midi_packed_type(events[0].message));
+    TEST_ASSERT_EQUAL(0, midi_param_flush(&decoder, events, MAX_EVENTS));
+
+    /* Invalid arguments */
+    TEST_ASSERT_EQUAL(0, midi_param_process(&decoder, &message, 9, events,
+                                            MIDI_PARAM_MAX_EVENTS - 1));
+    TEST_ASSERT_EQUAL(0, midi_param_process(NULL, &message, 9, events,
+                                            MAX_EVENTS));
+    TEST_ASSERT_EQUAL(0, midi_param_poll(NULL, 0, events, MAX_EVENTS));
+}
+
+/**
+ * @brief Test decoding a parsed byte stream
+ */
+void test_param_parsed_stream(void)
+{
+    static const uint8_t stream[] = {
+        0xB0, 0x65, 0x00, 0x64, 0x00, /* RPN 0, running status */
+        0x06, 0x02, 0x26, 0x00,       /* 2 semitones */
+        0x90, 0x3C, 0x40,             /* Note On */
+    };
+    midi_parser_t parser;
+    midi_message_t messages[8];
+    size_t total = 0;
+
+    midi_parser_init(&parser);
+    const size_t count = midi_parse_buffer(&parser, stream, sizeof(stream),
+                                           messages, 8, NULL);
+    TEST_ASSERT_EQUAL(5, count);
+
+    for (size_t i = 0; i < count; i++) {
+        total += midi_param_process(&decoder, &messages[i], (uint32_t)i,
+                                    &events[total], MAX_EVENTS - total);
+    }
+    TEST_ASSERT_EQUAL(3, total);
+    assert_event(&events[0], MIDI_PARAM_EVENT_RPN, 0, 0x0000, 0x0100);
+    assert_event(&events[1], MIDI_PARAM_EVENT_RPN, 0, 0x0000, 0x0100);
+    TEST_ASSERT_EQUAL(MIDI_PARAM_EVENT_MESSAGE, events[2].type);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_ON,
+                      midi_packed_type(events[2].message));
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Controllers
+    RUN_TEST(test_param_controller_immediate);
+    RUN_TEST(test_param_controller_paired);
+    RUN_TEST(test_param_controller_timeout);
+
+    // Parameter Numbers
+    RUN_TEST(test_param_rpn);
+    RUN_TEST(test_param_nrpn);
+    RUN_TEST(test_param_flags_and_resets);
+    RUN_TEST(test_param_parsed_stream);
+
+    return UNITY_END();
+}
@@ -0,0 +1,351 @@
+/***********************************************************************
+ * @file test_midi_pool.c
+ * @brief Unit tests for the MIDI parser pool module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_pool.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define PORTS (100)
+#define STREAM_SIZE (512)
+#define MAX_ITEMS (PORTS * 8)
+#define MAX_MESSAGES (STREAM_SIZE)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static uint8_t storage[MIDI_PARSER_POOL_STORAGE_SIZE(PORTS)];
+static midi_parser_pool_t pool;
+static uint8_t streams[PORTS][STREAM_SIZE];
+static midi_packed_t expected[PORTS][MAX_MESSAGES];
+static size_t expected_count[PORTS];
+static size_t received_count[PORTS];
+static midi_parser_pool_work_t items[MAX_ITEMS];
+static uint32_t out_ports[MAX_MESSAGES];
+static midi_packed_t out_messages[MAX_MESSAGES];
+static uint32_t random_state;
+static uint32_t realtime_ports[8];
+static size_t realtime_calls;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    memset(storage, 0xA5, sizeof(storage));
+    midi_parser_pool_init(&pool, storage, PORTS, NULL);
+    memset(received_count, 0, sizeof(received_count));
+    random_state = 0x2545F491;
+    realtime_calls = 0;
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Next pseudo random number
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief Realtime handler that records the port being parsed
+ */
+static void record_realtime(void *context, const midi_realtime_event_t *event)
+{
+    const midi_parser_pool_t *p = (const midi_parser_pool_t *)context;
+
+    (void)event;
+    if (realtime_calls < 8) {
+        realtime_ports[realtime_calls] = p->current_port;
+    }
+    realtime_calls++;
+}
+
+/**
+ * @brief Generate a stream per port, with running status and SysEx,
+ *        and parse each one on its own parser as the reference
+ */
+static void generate_streams(void)
+{
+    for (size_t port = 0; port < PORTS; port++) {
+        midi_parser_t parser;
+
+        for (size_t i = 0; i < STREAM_SIZE; i++) {
+            const uint32_t r = next_random();
+            streams[port][i] = (r & 0x30) == 0 ? (uint8_t)(0x80 | (r >> 8))
+                                               : (uint8_t)((r >> 8) & 0x7F);
+        }
+        midi_parser_init(&parser);
+        expected_count[port] = midi_parse_buffer_packed(
+            &parser, streams[port], STREAM_SIZE, expected[port],
+            MAX_MESSAGES, NULL);
+    }
+}
+
+/**
+ * @brief Split every stream into random chunks, interleaved across ports
+ * @return The number of work items
+ */
+static size_t make_items(size_t chunks)
+{
+    size_t count = 0;
+
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        for (size_t port = 0; port < PORTS; port++) {
+            const size_t start = STREAM_SIZE * chunk / chunks;
+            const size_t end = STREAM_SIZE * (chunk + 1) / chunks;
+
+            items[count].port = (uint32_t)((port * 37) % PORTS);
+            items[count].data = &streams[items[count].port][start];
+            items[count].length = end - start;
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Check the output of a batch against the references
+ */
+static void check_output(size_t count)
+{
+    for (size_t m = 0; m < count; m++) {
+        const uint32_t port = out_ports[m];
+
+        TEST_ASSERT_LESS_THAN(PORTS, port);
+        TEST_ASSERT_LESS_THAN(expected_count[port], received_count[port]);
+        TEST_ASSERT_EQUAL_HEX32(expected[port][received_count[port]],
+                                out_messages[m]);
+        received_count[port]++;
+    }
+}
+
+/*=====================================================================*
+    Layout Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test the storage size and the initial state of the ports
+ */
+void test_pool_init(void)
+{
+    midi_parser_t parser;
+    midi_parser_state_t fresh;
+    midi_parser_state_t state;
+
+    TEST_ASSERT_EQUAL(6 * 128, MIDI_PARSER_POOL_STORAGE_SIZE(PORTS));
+    TEST_ASSERT_EQUAL(6 * 64, MIDI_PARSER_POOL_STORAGE_SIZE(64));
+    TEST_ASSERT_EQUAL(0, MIDI_PARSER_POOL_STORAGE_SIZE(0));
+    TEST_ASSERT_EQUAL_PTR(storage + 128, pool.channel);
+
+    midi_parser_init(&parser);
+    midi_parser_save_state(&parser, &fresh);
+    for (uint32_t port = 0; port < PORTS; port++) {
+        memset(&state, 0xFF, sizeof(state));
+        midi_parser_pool_get_state(&pool, port, &state);
+        TEST_ASSERT_EQUAL(fresh.message_type, state.message_type);
+        TEST_ASSERT_EQUAL(fresh.channel, state.channel);
+        TEST_ASSERT_EQUAL(fresh.byte_count, state.byte_count);
+        TEST_ASSERT_EQUAL(fresh.sysex_flags, state.sysex_flags);
+    }
+}
+
+/*=====================================================================*
+    Batch Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test that interleaved chunks parse as if each port had its own
+ *        parser
+ */
+void test_pool_matches_parsers(void)
+{
+    generate_streams();
+    const size_t count = make_items(7);
+
+    const size_t parsed = midi_parser_pool_process(
+        &pool, items, count, out_ports, out_messages, MAX_MESSAGES);
+    check_output(parsed);
+
+    /* The output may have filled up, continue with the same items */
+    size_t more;
+    do {
+        more = midi_parser_pool_process(&pool, items, count, out_ports,
+                                        out_messages, MAX_MESSAGES);
+        check_output(more);
+    } while (more > 0);
+
+    for (size_t port = 0; port < PORTS; port++) {
+        TEST_ASSERT_EQUAL(expected_count[port], received_count[port]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT_EQUAL(0, items[i].length);
+    }
+}
+
+/**
+ * @brief Test that a small output array stops mid-item and resumes
+ */
+void test_pool_resumes(void)
+{
+    size_t calls = 0;
+    size_t parsed;
+
+    generate_streams();
+    const size_t count = make_items(3);
+
+    do {
+        parsed = midi_parser_pool_process(&pool, items, count, out_ports,
+                                          out_messages, 5);
+        TEST_ASSERT_LESS_OR_EQUAL(5, parsed);
+        check_output(parsed);
+        calls++;
+    } while (parsed > 0);
+
+    TEST_ASSERT_GREATER_THAN(10, calls);
+    for (size_t port = 0; port < PORTS; port++) {
+        TEST_ASSERT_EQUAL(expected_count[port], received_count[port]);
+    }
+}
+
+/**
+ * @brief Test the configuration, handlers and invalid items
+ */
+void test_pool_config_and_handlers(void)
+{
+    static const uint8_t chunk_a[] = {0x92, 0x3C, 0x40, 0x91, 0x3C,
+                                      MIDI_MESSAGE_TIMING_CLOCK, 0x40};
+    static const uint8_t chunk_b[] = {0x3E, 0x40, MIDI_MESSAGE_TIMING_CLOCK};
+    midi_parser_t config;
+
+    midi_parser_init(&config);
+    midi_parser_set_active_channel(&config, MIDI_CHANNEL_2);
+    midi_parser_set_realtime_handler(&config, record_realtime, NULL, &pool);
+    midi_parser_pool_init(&pool, storage, PORTS, &config);
+
+    items[0].port = 7;
+    items[0].data = chunk_a;
+    items[0].length = sizeof(chunk_a);
+    items[1].port = PORTS;
+    items[1].data = chunk_b;
+    items[1].length = sizeof(chunk_b);
+    items[2].port = 3;
+    items[2].data = chunk_b;
+    items[2].length = sizeof(chunk_b);
+    items[3].port = 7;
+    items[3].data = chunk_b;
+    items[3].length = sizeof(chunk_b);
+
+    const size_t parsed = midi_parser_pool_process(
+        &pool, items, 4, out_ports, out_messages, MAX_MESSAGES);
+
+    /* Only channel 2 passes, and port 3 has no running status */
+    TEST_ASSERT_EQUAL(2, parsed);
+    TEST_ASSERT_EQUAL(7, out_ports[0]);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_ON, midi_packed_type(out_messages[0]));
+    TEST_ASSERT_EQUAL(0x3C, midi_packed_data1(out_messages[0]));
+    TEST_ASSERT_EQUAL(7, out_ports[1]);
+    TEST_ASSERT_EQUAL(0x3E, midi_packed_data1(out_messages[1]));
+    TEST_ASSERT_EQUAL(0, items[1].length);
+
+    TEST_ASSERT_EQUAL(3, realtime_calls);
+    TEST_ASSERT_EQUAL(7, realtime_ports[0]);
+    TEST_ASSERT_EQUAL(3, realtime_ports[1]);
+    TEST_ASSERT_EQUAL(7, realtime_ports[2]);
+
+    /* Resetting a port drops its running status */
+    midi_parser_pool_reset_port(&pool, 7);
+    items[0].port = 7;
+    items[0].data = chunk_b;
+    items[0].length = sizeof(chunk_b);
+    TEST_ASSERT_EQUAL(0, midi_parser_pool_process(&pool, items, 1, out_ports,
+                                                  out_messages,
+                                                  MAX_MESSAGES));
+
+    TEST_ASSERT_EQUAL(0, midi_parser_pool_process(NULL, items, 1, out_ports,
+                                                  out_messages,
+                                                  MAX_MESSAGES));
+}
+
+/**
+ * @brief Test moving a port between the pool and a standalone parser
+ */
+void test_pool_state_transfer(void)
+{
+    static const uint8_t first[] = {0xB5, 0x07};
+    static const uint8_t second[] = {0x64, 0x0A, 0x20};
+    midi_parser_t parser;
+    midi_parser_state_t state;
+    midi_packed_t packed[4];
+
+    items[0].port = 42;
+    items[0].data = first;
+    items[0].length = sizeof(first);
+    TEST_ASSERT_EQUAL(0, midi_parser_pool_process(&pool, items, 1, out_ports,
+                                                  out_messages,
+                                                  MAX_MESSAGES));
+
+    midi_parser_pool_get_state(&pool, 42, &state);
+    midi_parser_init(&parser);
+    midi_parser_restore_state(&parser, &state);
+    TEST_ASSERT_EQUAL(1, midi_parse_buffer_packed(&parser, second, 2,
+                                                  packed, 4, NULL));
+    TEST_ASSERT_EQUAL_HEX32(
+        midi_packed_make(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_6, 0x07,
+                         0x64),
+        packed[0]);
+
+    /* And back, into another port */
+    midi_parser_save_state(&parser, &state);
+    midi_parser_pool_set_state(&pool, 9, &state);
+    items[0].port = 9;
+    items[0].data = &second[2];
+    items[0].length = 1;
+    TEST_ASSERT_EQUAL(1, midi_parser_pool_process(&pool, items, 1, out_ports,
+                                                  out_messages,
+                                                  MAX_MESSAGES));
+    TEST_ASSERT_EQUAL_HEX32(
+        midi_packed_make(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_6, 0x0A,
+                         0x20),
+        out_messages[0]);
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Layout
+    RUN_TEST(test_pool_init);
+
+    // Batches
+    RUN_TEST(test_pool_matches_parsers);
+    RUN_TEST(test_pool_resumes);
+    RUN_TEST(test_pool_config_and_handlers);
+    RUN_TEST(test_pool_state_transfer);
+
+    return UNITY_END();
+}
@@ -0,0 +1,302 @@
+/***********************************************************************
+ * @file test_midi_ring.c
+ * @brief Unit tests for the MIDI message ring module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_ring.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define RING_CAPACITY (8)
+#define STRESS_CAPACITY (64)
+#define STRESS_MESSAGES (1u << 18)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static midi_ring_t ring;
+static midi_packed_t storage[RING_CAPACITY];
+static midi_parser_t parser;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    TEST_ASSERT_TRUE(midi_ring_init(&ring, storage, RING_CAPACITY));
+    midi_parser_init(&parser);
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Basic Tests
+ *=====================================================================*/
+
+/**
+ * @brief Ring initialization
+ */
+void test_ring_init(void)
+{
+    midi_ring_t test_ring;
+    midi_packed_t test_storage[16];
+
+    TEST_ASSERT_TRUE(midi_ring_init(&test_ring, test_storage, 16));
+    TEST_ASSERT_EQUAL(16, midi_ring_capacity(&test_ring));
+    TEST_ASSERT_EQUAL(0, midi_ring_size(&test_ring));
+    TEST_ASSERT_EQUAL(0, midi_ring_get_overflow_count(&test_ring));
+
+    /* The capacity must be a power of two */
+    TEST_ASSERT_FALSE(midi_ring_init(&test_ring, test_storage, 0));
+    TEST_ASSERT_FALSE(midi_ring_init(&test_ring, test_storage, 12));
+    TEST_ASSERT_TRUE(midi_ring_init(&test_ring, test_storage, 1));
+}
+
+/**
+ * @brief Ring null pointer handling
+ */
+void test_ring_null_pointer_handling(void)
+{
+    midi_packed_t packed[4] = {0};
+    const uint8_t bytes[] = {0x90, 60, 100};
+
+    TEST_ASSERT_FALSE(midi_ring_init(NULL, storage, RING_CAPACITY));
+    TEST_ASSERT_FALSE(midi_ring_init(&ring, NULL, RING_CAPACITY));
+    TEST_ASSERT_EQUAL(0, midi_ring_capacity(NULL));
+    TEST_ASSERT_EQUAL(0, midi_ring_size(NULL));
+    TEST_ASSERT_EQUAL(0, midi_ring_get_overflow_count(NULL));
+    TEST_ASSERT_EQUAL(0, midi_ring_push(NULL, packed, 4));
+    TEST_ASSERT_EQUAL(0, midi_ring_push(&ring, NULL, 4));
+    TEST_ASSERT_EQUAL(0, midi_ring_pop(NULL, packed, 4));
+    TEST_ASSERT_EQUAL(0, midi_ring_pop(&ring, NULL, 4));
+    TEST_ASSERT_EQUAL(0, midi_ring_parse(NULL, &parser, bytes, 3));
+    TEST_ASSERT_EQUAL(0, midi_ring_parse(&ring, NULL, bytes, 3));
+    TEST_ASSERT_EQUAL(0, midi_ring_parse(&ring, &parser, NULL, 3));
+    TEST_ASSERT_EQUAL(0, midi_ring_size(&ring));
+}
+
+/*=====================================================================*
+    Push and Pop Tests
+ *=====================================================================*/
+
+/**
+ * @brief Messages are popped in the order they were pushed, across
+ *        the end of the storage
+ */
+void test_ring_push_pop_wraps_around(void)
+{
+    midi_packed_t in[5];
+    midi_packed_t out[RING_CAPACITY];
+    uint32_t next_in = 0;
+    uint32_t next_out = 0;
+
+    for (int round = 0; round < 10; round++) {
+        for (size_t i = 0; i < 5; i++) { in[i] = next_in++; }
+        TEST_ASSERT_EQUAL(5, midi_ring_push(&ring, in, 5));
+        TEST_ASSERT_EQUAL(5, midi_ring_size(&ring));
+
+        /* Pop in two batches */
+        TEST_ASSERT_EQUAL(2, midi_ring_pop(&ring, out, 2));
+        TEST_ASSERT_EQUAL(3, midi_ring_pop(&ring, &out[2], RING_CAPACITY));
+        for (size_t i = 0; i < 5; i++) {
+            TEST_ASSERT_EQUAL_HEX32(next_out++, out[i]);
+        }
+        TEST_ASSERT_EQUAL(0, midi_ring_size(&ring));
+    }
+
+    TEST_ASSERT_EQUAL(0, midi_ring_pop(&ring, out, RING_CAPACITY));
+    TEST_ASSERT_EQUAL(0, midi_ring_get_overflow_count(&ring));
+}
+
+/**
+ * @brief Messages that do not fit are dropped and counted
+ */
+void test_ring_push_overflow(void)
+{
+    midi_packed_t in[RING_CAPACITY + 3];
+    midi_packed_t out[RING_CAPACITY];
+
+    for (size_t i = 0; i < RING_CAPACITY + 3; i++) { in[i] = i; }
+
+    TEST_ASSERT_EQUAL(RING_CAPACITY,
+                      midi_ring_push(&ring, in, RING_CAPACITY + 3));
+    TEST_ASSERT_EQUAL(3, midi_ring_get_overflow_count(&ring));
+    TEST_ASSERT_EQUAL(0, midi_ring_push(&ring, in, 1));
+    TEST_ASSERT_EQUAL(4, midi_ring_get_overflow_count(&ring));
+
+    /* The oldest messages are kept */
+    TEST_ASSERT_EQUAL(RING_CAPACITY,
+                      midi_ring_pop(&ring, out, RING_CAPACITY));
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(in, out, RING_CAPACITY);
+}
+
+/*=====================================================================*
+    Parser Tests
+ *=====================================================================*/
+
+/**
+ * @brief Parsing into the ring gives the same messages as
+ *        midi_parse_buffer_packed, whatever the chunk size
+ */
+void test_ring_parse_matches_buffer_parser(void)
+{
+    const uint8_t bytes[] = {
+        0x90, 60,   100, 62,   100, 0xF8, 64,   100, /* Running status */
+        0xB1, 0x07, 90,  0xF0, 1,   2,    3,    0xF7, /* CC and SysEx */
+        0xE2, 0x00, 0x40, 0xC3, 5,    0xFA, 0x80, 60, /* Pitch bend ... */
+        0,    0xF2, 0x10, 0x20, 0x90, 67,   0,    0xFC,
+    };
+    midi_parser_t reference;
+    midi_packed_t expected[32];
+    midi_packed_t actual[32];
+    midi_packed_t big_storage[32];
+    midi_ring_t big_ring;
+    size_t expected_count;
+
+    midi_parser_init(&reference);
+    expected_count = midi_parse_buffer_packed(
+        &reference, bytes, sizeof(bytes), expected, 32, NULL);
+
+    for (size_t chunk = 1; chunk <= sizeof(bytes); chunk++) {
+        size_t count = 0;
+        midi_parser_init(&parser);
+        TEST_ASSERT_TRUE(midi_ring_init(&big_ring, big_storage, 32));
+
+        for (size_t offset = 0; offset < sizeof(bytes); offset += chunk) {
+            size_t length = sizeof(bytes) - offset;
+            if (length > chunk) { length = chunk; }
+            midi_ring_parse(&big_ring, &parser, &bytes[offset], length);
+            /* Pop a few on the way so the ring wraps */
+            count += midi_ring_pop(&big_ring, &actual[count], 3);
+        }
+        count += midi_ring_pop(&big_ring, &actual[count], 32);
+
+        TEST_ASSERT_EQUAL(expected_count, count);
+        TEST_ASSERT_EQUAL_HEX32_ARRAY(expected, actual, expected_count);
+        TEST_ASSERT_EQUAL(0, midi_ring_get_overflow_count(&big_ring));
+    }
+}
+
+/**
+ * @brief When the ring is full the parser keeps up with the stream,
+ *        and the dropped messages are counted
+ */
+void test_ring_parse_overflow_keeps_parser_in_step(void)
+{
+    uint8_t bytes[1 + 2 * 20];
+    midi_packed_t out[RING_CAPACITY];
+    const uint8_t next[] = {80, 0};
+
+    /* Twenty Note On messages under running status */
+    bytes[0] = 0x90;
+    for (size_t i = 0; i < 20; i++) {
+        bytes[1 + 2 * i] = (uint8_t)(40 + i);
+        bytes[2 + 2 * i] = 100;
+    }
+
+    TEST_ASSERT_EQUAL(RING_CAPACITY,
+                      midi_ring_parse(&ring, &parser, bytes, sizeof(bytes)));
+    TEST_ASSERT_EQUAL(20 - RING_CAPACITY, midi_ring_get_overflow_count(&ring));
+
+    TEST_ASSERT_EQUAL(RING_CAPACITY, midi_ring_pop(&ring, out, RING_CAPACITY));
+    for (size_t i = 0; i < RING_CAPACITY; i++) {
+        TEST_ASSERT_EQUAL(40 + i, midi_packed_data1(out[i]));
+    }
+
+    /* Running status survived the dropped messages */
+    TEST_ASSERT_EQUAL(1, midi_ring_parse(&ring, &parser, next, 2));
+    TEST_ASSERT_EQUAL(1, midi_ring_pop(&ring, out, RING_CAPACITY));
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_OFF, midi_packed_type(out[0]));
+    TEST_ASSERT_EQUAL(80, midi_packed_data1(out[0]));
+}
+
+/*=====================================================================*
+    Concurrency Tests
+ *=====================================================================*/
+
+static midi_ring_t stress_ring;
+static midi_packed_t stress_storage[STRESS_CAPACITY];
+
+/**
+ * @brief Producer thread pushing a sequence of numbers one at a time,
+ *        waiting while the ring is full
+ */
+static void *stress_producer(void *argument)
+{
+    (void)argument;
+    for (uint32_t i = 0; i < STRESS_MESSAGES; i++) {
+        while (midi_ring_size(&stress_ring) == STRESS_CAPACITY) {
+            /* Wait for the consumer */
+            sched_yield();
+        }
+        midi_ring_push(&stress_ring, &i, 1);
+    }
+    return NULL;
+}
+
+/**
+ * @brief A producer and a consumer thread pass every message through
+ *        the ring, in order
+ */
+void test_ring_concurrent_producer_consumer(void)
+{
+    pthread_t producer;
+    midi_packed_t out[7];
+    uint32_t expected = 0;
+    int in_order = 1;
+
+    TEST_ASSERT_TRUE(
+        midi_ring_init(&stress_ring, stress_storage, STRESS_CAPACITY));
+    TEST_ASSERT_EQUAL(0,
+                      pthread_create(&producer, NULL, stress_producer, NULL));
+
+    while (expected < STRESS_MESSAGES) {
+        size_t count = midi_ring_pop(&stress_ring, out, 7);
+        if (count == 0) { sched_yield(); }
+        for (size_t i = 0; i < count; i++) {
+            in_order &= (out[i] == expected++);
+        }
+    }
+    pthread_join(producer, NULL);
+
+    TEST_ASSERT_TRUE(in_order);
+    TEST_ASSERT_EQUAL(0, midi_ring_size(&stress_ring));
+    TEST_ASSERT_EQUAL(0, midi_ring_get_overflow_count(&stress_ring));
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_ring_init);
+    RUN_TEST(test_ring_null_pointer_handling);
+
+    // Push and pop
+    RUN_TEST(test_ring_push_pop_wraps_around);
+    RUN_TEST(test_ring_push_overflow);
+
+    // Parser
+    RUN_TEST(test_ring_parse_matches_buffer_parser);
+    RUN_TEST(test_ring_parse_overflow_keeps_parser_in_step);
+
+    // Concurrency
+    RUN_TEST(test_ring_concurrent_producer_consumer);
+
+    return UNITY_END();
+}
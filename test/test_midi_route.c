@@ -0,0 +1,861 @@
+/***********************************************************************
+ * @file test_midi_route.c
+ * @brief Unit tests for the MIDI routing module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_route.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define BATCH (64)
+#define MAX_COPIES (8)
+#define MODEL_SIZE (BATCH * MAX_COPIES)
+#define MODEL_REFS (2 * MIDI_ROUTE_MAX_NODES + 1)
+#define RANDOM_GRAPHS (300)
+
+/*=====================================================================*
+    Private Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Node of the reference model, kept from the arguments of the
+ *        `midi_route_add_*` calls
+ */
+typedef struct model_node_t {
+    midi_route_kind_t kind;
+    midi_route_ref_t inputs[2];
+    midi_route_match_t match;
+    uint8_t table[128];
+    uint16_t channels;
+    uint8_t controller;
+    uint8_t output;
+} model_node_t;
+
+/**
+ * @brief Messages of a reference of the model
+ */
+typedef struct model_list_t {
+    midi_packed_t events[MODEL_SIZE];
+    uint16_t sources[MODEL_SIZE];
+    size_t count;
+} model_list_t;
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static uint32_t storage[MODEL_REFS * MODEL_SIZE * 2];
+static midi_route_graph_t graph;
+static midi_route_plan_t plan;
+static midi_route_match_t match;
+static midi_packed_t events[BATCH];
+static model_node_t model[MIDI_ROUTE_MAX_NODES];
+static size_t model_count;
+static model_list_t lists[MODEL_REFS];
+static uint32_t random_state;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    midi_route_graph_init(&graph);
+    midi_route_match_init(&match);
+    memset(&plan, 0, sizeof(plan));
+    model_count = 0;
+    random_state = 0x2545F491;
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Next pseudo random number
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief A random packed message of any kind the parser produces
+ */
+static midi_packed_t random_event(void)
+{
+    static const midi_message_type_t types[] = {
+        MIDI_MESSAGE_NOTE_OFF,       MIDI_MESSAGE_NOTE_ON,
+        MIDI_MESSAGE_NOTE_ON,        MIDI_MESSAGE_KEY_PRESSURE,
+        MIDI_MESSAGE_CONTROL_CHANGE, MIDI_MESSAGE_CONTROL_CHANGE,
+        MIDI_MESSAGE_PROGRAM_CHANGE, MIDI_MESSAGE_PITCH_BEND,
+        MIDI_MESSAGE_TIMING_CLOCK,   MIDI_MESSAGE_SONG_POSITION_POINTER,
+    };
+    const uint32_t r = next_random();
+    const midi_message_type_t type = types[(r >> 24) % 10];
+    const int system = (type == MIDI_MESSAGE_TIMING_CLOCK
+                        || type == MIDI_MESSAGE_SONG_POSITION_POINTER);
+    const midi_channel_t channel = system ? MIDI_CHANNEL_NONE
+                                          : (midi_channel_t)((r >> 20) & 0x0F);
+    const uint8_t data1 = (type == MIDI_MESSAGE_CONTROL_CHANGE)
+                              ? (uint8_t)((r >> 8) % 8)
+                              : (uint8_t)((r >> 8) & 0x7F);
+    uint8_t data2 = (uint8_t)(r & 0x7F);
+
+    if (type == MIDI_MESSAGE_NOTE_ON && data2 == 0) { data2 = 1; }
+    return midi_packed_make(type, channel, data1, data2);
+}
+
+/**
+ * @brief Index of a reference in the lists of the model
+ */
+static size_t model_index(midi_route_ref_t ref)
+{
+    return (ref == MIDI_ROUTE_SOURCE) ? MODEL_REFS - 1 : ref;
+}
+
+/**
+ * @brief Check a message against a match, the plain way
+ */
+static int model_match(const midi_route_match_t *m, midi_packed_t event)
+{
+    const uint8_t type = (uint8_t)midi_packed_type(event);
+    const uint8_t channel = (uint8_t)midi_packed_channel(event);
+    const uint8_t note = midi_packed_data1(event);
+    const size_t bit = (channel < 16) ? channel : 16;
+
+    if (!((m->types[type / 32] >> (type % 32)) & 1)) { return 0; }
+    if (!((m->channels >> bit) & 1)) { return 0; }
+    if (type >= 0x80 && type <= 0xA0 && type % 16 == 0) {
+        return note >= m->note_min && note <= m->note_max;
+    }
+    return 1;
+}
+
+/**
+ * @brief Transform one message by a node of the model
+ * @return 1 to keep the message, 0 to drop it
+ */
+static int model_apply(const model_node_t *node, midi_packed_t *event)
+{
+    const uint8_t type = (uint8_t)midi_packed_type(*event);
+    const uint8_t channel = (uint8_t)midi_packed_channel(*event);
+    const uint8_t data1 = midi_packed_data1(*event);
+    const uint8_t data2 = midi_packed_data2(*event);
+    const int on_channel = channel < 16 && ((node->channels >> channel) & 1);
+
+    switch (node->kind) {
+    case MIDI_ROUTE_FILTER:
+        return model_match(&node->match, *event);
+    case MIDI_ROUTE_CHANNEL_MAP:
+        if (channel >= 16) { return 1; }
+        if (node->table[channel] >= 16) { return 0; }
+        *event = midi_packed_make((midi_message_type_t)type,
+                                  (midi_channel_t)node->table[channel],
+                                  data1, data2);
+        return 1;
+    case MIDI_ROUTE_NOTE_MAP:
+        if (!on_channel || (type != 0x80 && type != 0x90 && type != 0xA0)) {
+            return 1;
+        }
+        if (node->table[data1] > 127) { return 0; }
+        *event = midi_packed_make((midi_message_type_t)type,
+                                  (midi_channel_t)channel,
+                                  node->table[data1], data2);
+        return 1;
+    case MIDI_ROUTE_CURVE:
+        if (!on_channel) { return 1; }
+        if (node->controller == MIDI_ROUTE_VELOCITY) {
+            if (type != MIDI_MESSAGE_NOTE_ON || data2 == 0) { return 1; }
+            uint8_t value = node->table[data2] & 0x7F;
+            if (value == 0) { value = 1; }
+            *event = (*event & 0xFFFFFF00u) | value;
+        } else if (type == MIDI_MESSAGE_CONTROL_CHANGE
+                   && data1 == node->controller) {
+            *event = (*event & 0xFFFFFF00u) | (node->table[data2] & 0x7F);
+        }
+        return 1;
+    default:
+        return 1;
+    }
+}
+
+/**
+ * @brief Run the events through the model, node by node
+ */
+static void model_run(size_t count)
+{
+    model_list_t *source = &lists[MODEL_REFS - 1];
+
+    for (size_t i = 0; i < count; i++) {
+        source->events[i] = events[i];
+        source->sources[i] = (uint16_t)i;
+    }
+    source->count = count;
+
+    for (size_t n = 0; n < model_count; n++) {
+        const model_node_t *node = &model[n];
+        const model_list_t *in = &lists[model_index(node->inputs[0])];
+        model_list_t *out = &lists[2 * n];
+        model_list_t *other = &lists[2 * n + 1];
+
+        out->count = 0;
+        other->count = 0;
+        if (node->kind == MIDI_ROUTE_MERGE) {
+            const model_list_t *second = &lists[model_index(node->inputs[1])];
+            size_t a = 0;
+            size_t b = 0;
+            while (a < in->count || b < second->count) {
+                const int take_first =
+                    b == second->count
+                    || (a < in->count && in->sources[a] <= second->sources[b]);
+                const model_list_t *from = take_first ? in : second;
+                const size_t i = take_first ? a++ : b++;
+                out->events[out->count] = from->events[i];
+                out->sources[out->count++] = from->sources[i];
+            }
+            continue;
+        }
+        if (node->kind == MIDI_ROUTE_OUTPUT) { continue; }
+
+        for (size_t i = 0; i < in->count; i++) {
+            midi_packed_t event = in->events[i];
+            model_list_t *to = out;
+            if (node->kind == MIDI_ROUTE_SPLIT) {
+                to = model_match(&node->match, event) ? out : other;
+            } else if (!model_apply(node, &event)) {
+                continue;
+            }
+            to->events[to->count] = event;
+            to->sources[to->count++] = in->sources[i];
+        }
+    }
+}
+
+/**
+ * @brief Record a node in the model once the graph accepted it
+ */
+static midi_route_ref_t model_add(midi_route_ref_t ref,
+                                  const model_node_t *node)
+{
+    if (ref != MIDI_ROUTE_INVALID) { model[model_count++] = *node; }
+    return ref;
+}
+
+/**
+ * @brief Compile the graph into storage of the exact size
+ */
+static void compile(size_t batch)
+{
+    const size_t size = midi_route_compile(&plan, &graph, batch, NULL, 0);
+    TEST_ASSERT_NOT_EQUAL(0, size);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(storage), size);
+    TEST_ASSERT_EQUAL(size,
+                      midi_route_compile(&plan, &graph, batch,
+                                         (uint8_t *)storage, size));
+}
+
+/**
+ * @brief Compare every output of the plan with the model
+ */
+static void assert_outputs(void)
+{
+    for (size_t output = 0; output < MIDI_ROUTE_MAX_OUTPUTS; output++) {
+        const midi_packed_t *out_events;
+        const uint16_t *out_sources;
+        const size_t count =
+            midi_route_output(&plan, output, &out_events, &out_sources);
+        const model_list_t *expected = NULL;
+
+        for (size_t n = 0; n < model_count; n++) {
+            if (model[n].kind == MIDI_ROUTE_OUTPUT
+                && model[n].output == output) {
+                expected = &lists[model_index(model[n].inputs[0])];
+            }
+        }
+        if (expected == NULL) {
+            TEST_ASSERT_EQUAL(0, count);
+            continue;
+        }
+        TEST_ASSERT_EQUAL(expected->count, count);
+        if (count != 0) {
+            TEST_ASSERT_EQUAL_HEX32_ARRAY(expected->events, out_events, count);
+            TEST_ASSERT_EQUAL_UINT16_ARRAY(expected->sources, out_sources,
+                                           count);
+        }
+    }
+}
+
+/**
+ * @brief Run random events through the plan and the model
+ */
+static void assert_random_batches(size_t batches)
+{
+    for (size_t b = 0; b < batches; b++) {
+        const size_t count = next_random() % (BATCH + 1);
+        for (size_t i = 0; i < count; i++) { events[i] = random_event(); }
+        TEST_ASSERT_EQUAL(count, midi_route_run(&plan, events, count));
+        model_run(count);
+        assert_outputs();
+    }
+}
+
+/**
+ * @brief Add a node of a random kind to the graph and the model
+ * @param [in,out] copies The most copies of a message each reference
+ *      can hold
+ */
+static void add_random_node(size_t *copies)
+{
+    const uint32_t r = next_random();
+    model_node_t node;
+    midi_route_ref_t ref;
+
+    /* Chain most nodes to the last one so that some stages fuse */
+    midi_route_ref_t input = MIDI_ROUTE_SOURCE;
+    if (model_count != 0 && (r & 3) != 0) {
+        input = (midi_route_ref_t)(2 * (model_count - 1));
+    } else if (model_count != 0) {
+        input = (midi_route_ref_t)(2 * (next_random() % model_count));
+    }
+    if (input != MIDI_ROUTE_SOURCE
+        && model[input / 2].kind == MIDI_ROUTE_SPLIT && (r & 4)) {
+        input = MIDI_ROUTE_ELSE(input);
+    }
+
+    memset(&node, 0, sizeof(node));
+    node.inputs[0] = input;
+    node.inputs[1] = MIDI_ROUTE_INVALID;
+    node.channels = (uint16_t)next_random();
+    node.controller = (r & 8) ? MIDI_ROUTE_VELOCITY : (uint8_t)(r >> 29);
+    midi_route_match_init(&node.match);
+    node.match.types[4] = next_random() | next_random();
+    node.match.types[5] = next_random() | next_random();
+    node.match.types[7] = next_random() | next_random();
+    node.match.channels = next_random() | next_random();
+    node.match.note_min = (uint8_t)(next_random() % 80);
+    node.match.note_max = (uint8_t)(next_random() % 128);
+    for (size_t i = 0; i < 128; i++) {
+        node.table[i] = (uint8_t)next_random();
+        if (node.table[i] > 127 && (i & 7) != 0) { node.table[i] &= 0x7F; }
+    }
+
+    const size_t from = model_index(input);
+    const size_t kind = (r >> 4) % 7;
+    switch (kind) {
+    case 0:
+        node.kind = MIDI_ROUTE_FILTER;
+        ref = midi_route_add_filter(&graph, input, &node.match);
+        break;
+    case 1:
+        node.kind = MIDI_ROUTE_CHANNEL_MAP;
+        for (size_t i = 0; i < 16; i++) {
+            node.table[i] = (i == 3) ? MIDI_ROUTE_DROP : node.table[i] % 16;
+        }
+        ref = midi_route_add_remap(&graph, input, node.table);
+        break;
+    case 2:
+        node.kind = MIDI_ROUTE_NOTE_MAP;
+        ref = midi_route_add_key_map(&graph, input, node.channels, node.table);
+        break;
+    case 3:
+        node.kind = MIDI_ROUTE_CURVE;
+        ref = midi_route_add_curve(&graph, input, node.channels,
+                                   node.controller, node.table);
+        break;
+    case 4:
+        node.kind = MIDI_ROUTE_SPLIT;
+        ref = midi_route_add_split(&graph, input, &node.match);
+        copies[2 * model_count + 1] = copies[from];
+        break;
+    default:
+        node.kind = MIDI_ROUTE_MERGE;
+        node.inputs[1] = (midi_route_ref_t)(
+            (model_count != 0) ? 2 * (next_random() % model_count)
+                               : MIDI_ROUTE_SOURCE);
+        if (copies[from] + copies[model_index(node.inputs[1])]
+            > MAX_COPIES) {
+            node.inputs[1] = input;
+            node.kind = (copies[from] * 2 <= MAX_COPIES) ? MIDI_ROUTE_MERGE
+                                                         : MIDI_ROUTE_FILTER;
+        }
+        if (node.kind == MIDI_ROUTE_FILTER) {
+            ref = midi_route_add_filter(&graph, input, &node.match);
+            break;
+        }
+        ref = midi_route_add_merge(&graph, input, node.inputs[1]);
+        copies[2 * model_count] =
+            copies[from] + copies[model_index(node.inputs[1])];
+        TEST_ASSERT_NOT_EQUAL(MIDI_ROUTE_INVALID,
+                              model_add(ref, &node));
+        return;
+    }
+    copies[2 * model_count] = copies[from];
+    TEST_ASSERT_NOT_EQUAL(MIDI_ROUTE_INVALID, model_add(ref, &node));
+}
+
+/**
+ * @brief Build a single node graph into output 0 and compile it
+ */
+static void single_node_outputs(midi_route_ref_t ref, const model_node_t *node)
+{
+    model_node_t output;
+
+    TEST_ASSERT_NOT_EQUAL(MIDI_ROUTE_INVALID, model_add(ref, node));
+    memset(&output, 0, sizeof(output));
+    output.kind = MIDI_ROUTE_OUTPUT;
+    output.inputs[0] = ref;
+    TEST_ASSERT_TRUE(midi_route_add_output(&graph, ref, 0));
+    model_add(0, &output);
+    compile(BATCH);
+}
+
+/*=====================================================================*
+    Node Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test a filter on type, channel and note range
+ */
+void test_route_filter(void)
+{
+    model_node_t node = {.kind = MIDI_ROUTE_FILTER};
+    const midi_packed_t *out;
+
+    midi_route_match_set_type(&match, MIDI_MESSAGE_NONE, 0);
+    midi_route_match_set_type(&match, MIDI_MESSAGE_NOTE_ON, 1);
+    midi_route_match_set_type(&match, MIDI_MESSAGE_CONTROL_CHANGE, 1);
+    midi_route_match_set_type(&match, MIDI_MESSAGE_TIMING_CLOCK, 1);
+    match.channels = (1u << 2) | MIDI_ROUTE_SYSTEM_CHANNEL;
+    match.note_min = 60;
+    match.note_max = 72;
+    node.inputs[0] = MIDI_ROUTE_SOURCE;
+    node.match = match;
+    single_node_outputs(midi_route_add_filter(&graph, MIDI_ROUTE_SOURCE,
+                                              &match),
+                        &node);
+
+    events[0] = midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_3, 60, 1);
+    events[1] = midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_3, 73, 1);
+    events[2] = midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_4, 64, 1);
+    events[3] = midi_packed_make(MIDI_MESSAGE_CONTROL_CHANGE,
+                                 MIDI_CHANNEL_3, 7, 100);
+    events[4] = midi_packed_make(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_3, 60, 0);
+    events[5] = midi_packed_make(MIDI_MESSAGE_TIMING_CLOCK,
+                                 MIDI_CHANNEL_NONE, 0, 0);
+    TEST_ASSERT_EQUAL(6, midi_route_run(&plan, events, 6));
+    TEST_ASSERT_EQUAL(3, midi_route_output(&plan, 0, &out, NULL));
+    TEST_ASSERT_EQUAL_HEX32(events[0], out[0]);
+    TEST_ASSERT_EQUAL_HEX32(events[3], out[1]);
+    TEST_ASSERT_EQUAL_HEX32(events[5], out[2]);
+
+    model_run(6);
+    assert_outputs();
+}
+
+/**
+ * @brief Test that an empty note range drops the note messages only
+ */
+void test_route_filter_empty_range(void)
+{
+    model_node_t node = {.kind = MIDI_ROUTE_FILTER};
+    const midi_packed_t *out;
+
+    match.note_min = 80;
+    match.note_max = 20;
+    node.inputs[0] = MIDI_ROUTE_SOURCE;
+    node.match = match;
+    single_node_outputs(midi_route_add_filter(&graph, MIDI_ROUTE_SOURCE,
+                                              &match),
+                        &node);
+
+    events[0] = midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 50, 1);
+    events[1] = midi_packed_make(MIDI_MESSAGE_PITCH_BEND, MIDI_CHANNEL_1,
+                                 50, 1);
+    events[2] = midi_packed_make(MIDI_MESSAGE_KEY_PRESSURE, MIDI_CHANNEL_1,
+                                 50, 1);
+    midi_route_run(&plan, events, 3);
+    TEST_ASSERT_EQUAL(1, midi_route_output(&plan, 0, &out, NULL));
+    TEST_ASSERT_EQUAL_HEX32(events[1], out[0]);
+}
+
+/**
+ * @brief Test a channel remap, which drops channels and passes system
+ *        messages
+ */
+void test_route_remap(void)
+{
+    model_node_t node = {.kind = MIDI_ROUTE_CHANNEL_MAP};
+
+    for (size_t channel = 0; channel < 16; channel++) {
+        node.table[channel] = (uint8_t)(15 - channel);
+    }
+    node.table[5] = MIDI_ROUTE_DROP;
+    node.inputs[0] = MIDI_ROUTE_SOURCE;
+    single_node_outputs(midi_route_add_remap(&graph, MIDI_ROUTE_SOURCE,
+                                             node.table),
+                        &node);
+    assert_random_batches(50);
+}
+
+/**
+ * @brief Test a key map and a transpose that shifts notes out of range
+ */
+void test_route_key_map(void)
+{
+    model_node_t node = {.kind = MIDI_ROUTE_NOTE_MAP};
+    const midi_packed_t *out;
+
+    for (int note = 0; note < 128; note++) {
+        node.table[note] = (note + 100 < 128) ? (uint8_t)(note + 100)
+                                              : MIDI_ROUTE_DROP;
+    }
+    node.inputs[0] = MIDI_ROUTE_SOURCE;
+    node.channels = 0x00FF;
+    single_node_outputs(midi_route_add_transpose(&graph, MIDI_ROUTE_SOURCE,
+                                                 0x00FF, 100),
+                        &node);
+    assert_random_batches(50);
+
+    events[0] = midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 27, 9);
+    events[1] = midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 28, 9);
+    events[2] = midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_9, 28, 9);
+    midi_route_run(&plan, events, 3);
+    TEST_ASSERT_EQUAL(2, midi_route_output(&plan, 0, &out, NULL));
+    TEST_ASSERT_EQUAL_HEX32(
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 127, 9),
+        out[0]);
+    TEST_ASSERT_EQUAL_HEX32(events[2], out[1]);
+}
+
+/**
+ * @brief Test velocity and controller curves
+ */
+void test_route_curve(void)
+{
+    uint8_t table[128];
+    const midi_packed_t *out;
+
+    memset(table, 0, sizeof(table));
+    table[127] = 64;
+    midi_route_ref_t ref = midi_route_add_curve(
+        &graph, MIDI_ROUTE_SOURCE, 0xFFFF, MIDI_ROUTE_VELOCITY, table);
+    ref = midi_route_add_curve(&graph, ref, 0xFFFF, 7, table);
+    TEST_ASSERT_TRUE(midi_route_add_output(&graph, ref, 0));
+    compile(BATCH);
+
+    /* Velocities stay above 0, Note Off and other controllers pass */
+    events[0] = midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 5);
+    events[1] = midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60,
+                                 127);
+    events[2] = midi_packed_make(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 60,
+                                 127);
+    events[3] = midi_packed_make(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1,
+                                 7, 100);
+    events[4] = midi_packed_make(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1,
+                                 8, 100);
+    midi_route_run(&plan, events, 5);
+    TEST_ASSERT_EQUAL(5, midi_route_output(&plan, 0, &out, NULL));
+    TEST_ASSERT_EQUAL(1, midi_packed_data2(out[0]));
+    TEST_ASSERT_EQUAL(64, midi_packed_data2(out[1]));
+    TEST_ASSERT_EQUAL_HEX32(events[2], out[2]);
+    TEST_ASSERT_EQUAL(0, midi_packed_data2(out[3]));
+    TEST_ASSERT_EQUAL_HEX32(events[4], out[4]);
+
+    /* Channel Mode controllers cannot be curved */
+    TEST_ASSERT_EQUAL(MIDI_ROUTE_INVALID,
+                      midi_route_add_curve(&graph, MIDI_ROUTE_SOURCE, 0xFFFF,
+                                           MIDI_CC_ALL_SOUND_OFF, table));
+}
+
+/**
+ * @brief Test that a split and a merge give back the batch in order,
+ *        with the index of every message
+ */
+void test_route_split_merge(void)
+{
+    const midi_packed_t *out;
+    const uint16_t *sources;
+
+    midi_route_match_set_type(&match, MIDI_MESSAGE_NONE, 0);
+    midi_route_match_set_type(&match, MIDI_MESSAGE_NOTE_ON, 1);
+    const midi_route_ref_t split =
+        midi_route_add_split(&graph, MIDI_ROUTE_SOURCE, &match);
+    const midi_route_ref_t notes =
+        midi_route_add_transpose(&graph, split, 0xFFFF, 12);
+    const midi_route_ref_t merged =
+        midi_route_add_merge(&graph, notes, MIDI_ROUTE_ELSE(split));
+    TEST_ASSERT_TRUE(midi_route_add_output(&graph, merged, 0));
+    TEST_ASSERT_TRUE(midi_route_add_output(&graph, MIDI_ROUTE_ELSE(split), 1));
+    TEST_ASSERT_TRUE(midi_route_add_output(&graph, MIDI_ROUTE_SOURCE, 2));
+    compile(BATCH);
+
+    for (size_t i = 0; i < BATCH; i++) {
+        events[i] = midi_packed_make((i % 3) ? MIDI_MESSAGE_NOTE_ON
+                                             : MIDI_MESSAGE_PITCH_BEND,
+                                     MIDI_CHANNEL_1, (uint8_t)i, 1);
+    }
+    TEST_ASSERT_EQUAL(BATCH, midi_route_run(&plan, events, BATCH));
+    TEST_ASSERT_EQUAL(BATCH, midi_route_output(&plan, 0, &out, &sources));
+    for (size_t i = 0; i < BATCH; i++) {
+        TEST_ASSERT_EQUAL(i, sources[i]);
+        TEST_ASSERT_EQUAL((i % 3) ? i + 12 : i, midi_packed_data1(out[i]));
+    }
+    TEST_ASSERT_EQUAL(BATCH / 3 + 1,
+                      midi_route_output(&plan, 1, &out, &sources));
+    TEST_ASSERT_EQUAL(3, sources[1]);
+    TEST_ASSERT_EQUAL(BATCH, midi_route_output(&plan, 2, &out, NULL));
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(events, out, BATCH);
+    TEST_ASSERT_EQUAL(0, midi_route_output(&plan, 3, &out, &sources));
+    TEST_ASSERT_NULL(out);
+    TEST_ASSERT_NULL(sources);
+}
+
+/**
+ * @brief Test that a message merged with itself is there twice
+ */
+void test_route_merge_twice(void)
+{
+    const midi_packed_t *out;
+    const uint16_t *sources;
+
+    const midi_route_ref_t ref =
+        midi_route_add_merge(&graph, MIDI_ROUTE_SOURCE, MIDI_ROUTE_SOURCE);
+    TEST_ASSERT_TRUE(midi_route_add_output(&graph, ref, 0));
+    compile(BATCH);
+
+    for (size_t i = 0; i < BATCH; i++) { events[i] = random_event(); }
+    midi_route_run(&plan, events, BATCH);
+    TEST_ASSERT_EQUAL(2 * BATCH, midi_route_output(&plan, 0, &out, &sources));
+    for (size_t i = 0; i < 2 * BATCH; i++) {
+        TEST_ASSERT_EQUAL(i / 2, sources[i]);
+        TEST_ASSERT_EQUAL_HEX32(events[i / 2], out[i]);
+    }
+}
+
+/*=====================================================================*
+    Plan Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test that consecutive stages of the same kind are fused without
+ *        changing the result
+ */
+void test_route_fusion(void)
+{
+    uint8_t table[128];
+    model_node_t node;
+    midi_route_ref_t ref = MIDI_ROUTE_SOURCE;
+
+    memset(&node, 0, sizeof(node));
+    node.kind = MIDI_ROUTE_CURVE;
+    node.channels = 0x0F0F;
+    node.controller = MIDI_ROUTE_VELOCITY;
+    for (size_t k = 0; k < 3; k++) {
+        for (size_t i = 0; i < 128; i++) {
+            table[i] = (uint8_t)((i * (2 * k + 3) + k * 40) & 0x7F);
+        }
+        memcpy(node.table, table, sizeof(table));
+        node.inputs[0] = ref;
+        ref = model_add(midi_route_add_curve(&graph, ref, 0x0F0F,
+                                             MIDI_ROUTE_VELOCITY, table),
+                        &node);
+    }
+
+    memset(&node, 0, sizeof(node));
+    node.kind = MIDI_ROUTE_NOTE_MAP;
+    node.channels = 0xFFFF;
+    for (int semitones = -5; semitones <= 5; semitones += 5) {
+        for (int i = 0; i < 128; i++) {
+            node.table[i] = (i + semitones >= 0 && i + semitones < 128)
+                                ? (uint8_t)(i + semitones)
+                                : MIDI_ROUTE_DROP;
+        }
+        node.inputs[0] = ref;
+        ref = model_add(midi_route_add_transpose(&graph, ref, 0xFFFF,
+                                                 semitones),
+                        &node);
+    }
+
+    memset(&node, 0, sizeof(node));
+    node.kind = MIDI_ROUTE_FILTER;
+    midi_route_match_init(&node.match);
+    for (size_t i = 0; i < 2; i++) {
+        node.match.channels = i ? 0x1FF0F : 0x100FF;
+        node.match.note_min = (uint8_t)(i ? 50 : 20);
+        node.match.note_max = (uint8_t)(i ? 90 : 70);
+        node.inputs[0] = ref;
+        ref = model_add(midi_route_add_filter(&graph, ref, &node.match),
+                        &node);
+    }
+
+    memset(&node, 0, sizeof(node));
+    node.kind = MIDI_ROUTE_OUTPUT;
+    node.inputs[0] = ref;
+    TEST_ASSERT_TRUE(midi_route_add_output(&graph, ref, 0));
+    model_add(0, &node);
+
+    compile(BATCH);
+    TEST_ASSERT_EQUAL(3, plan.stage_count);
+    TEST_ASSERT_EQUAL(1, plan.buffer_count);
+    assert_random_batches(100);
+}
+
+/**
+ * @brief Test that a stage whose output feeds two nodes is not fused
+ */
+void test_route_no_fusion_when_shared(void)
+{
+    const midi_route_ref_t first =
+        midi_route_add_transpose(&graph, MIDI_ROUTE_SOURCE, 0xFFFF, 1);
+    const midi_route_ref_t second =
+        midi_route_add_transpose(&graph, first, 0xFFFF, 1);
+    TEST_ASSERT_TRUE(midi_route_add_output(&graph, first, 0));
+    TEST_ASSERT_TRUE(midi_route_add_output(&graph, second, 1));
+    compile(BATCH);
+    TEST_ASSERT_EQUAL(2, plan.stage_count);
+
+    const midi_packed_t *out;
+    events[0] = midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 1);
+    midi_route_run(&plan, events, 1);
+    TEST_ASSERT_EQUAL(1, midi_route_output(&plan, 0, &out, NULL));
+    TEST_ASSERT_EQUAL(61, midi_packed_data1(out[0]));
+    TEST_ASSERT_EQUAL(1, midi_route_output(&plan, 1, &out, NULL));
+    TEST_ASSERT_EQUAL(62, midi_packed_data1(out[0]));
+}
+
+/**
+ * @brief Test random graphs against the model
+ */
+void test_route_random_graphs(void)
+{
+    size_t copies[MODEL_REFS];
+
+    for (size_t g = 0; g < RANDOM_GRAPHS; g++) {
+        const size_t nodes = 1 + next_random() % 24;
+        model_node_t output;
+
+        midi_route_graph_init(&graph);
+        model_count = 0;
+        copies[MODEL_REFS - 1] = 1;
+        for (size_t n = 0; n < nodes; n++) { add_random_node(copies); }
+
+        for (uint8_t o = 0; o < MIDI_ROUTE_MAX_OUTPUTS; o++) {
+            if (next_random() % 4 == 0) { continue; }
+            const size_t n = next_random() % nodes;
+            memset(&output, 0, sizeof(output));
+            output.kind = MIDI_ROUTE_OUTPUT;
+            output.output = o;
+            output.inputs[0] = (midi_route_ref_t)(
+                (model[n].kind == MIDI_ROUTE_SPLIT) ? 2 * n + (o & 1)
+                                                    : 2 * n);
+            TEST_ASSERT_TRUE(midi_route_add_output(&graph, output.inputs[0],
+                                                   o));
+            model_add(0, &output);
+        }
+
+        compile(BATCH);
+        assert_random_batches(4);
+    }
+}
+
+/**
+ * @brief Test the storage size, batch limits and invalid references
+ */
+void test_route_limits(void)
+{
+    uint8_t map[128] = {0};
+
+    /* Unknown references and a chain built on an invalid one */
+    TEST_ASSERT_EQUAL(MIDI_ROUTE_INVALID,
+                      midi_route_add_filter(&graph, 0, &match));
+    midi_route_ref_t ref =
+        midi_route_add_filter(&graph, MIDI_ROUTE_INVALID, &match);
+    ref = midi_route_add_remap(&graph, ref, map);
+    TEST_ASSERT_EQUAL(MIDI_ROUTE_INVALID, ref);
+    TEST_ASSERT_FALSE(midi_route_add_output(&graph, ref, 0));
+    ref = midi_route_add_filter(&graph, MIDI_ROUTE_SOURCE, &match);
+    TEST_ASSERT_EQUAL(MIDI_ROUTE_INVALID,
+                      midi_route_add_filter(&graph, MIDI_ROUTE_ELSE(ref),
+                                            &match));
+    TEST_ASSERT_EQUAL(MIDI_ROUTE_INVALID,
+                      midi_route_add_merge(&graph, ref, 2));
+    TEST_ASSERT_EQUAL(MIDI_ROUTE_INVALID,
+                      midi_route_add_filter(&graph, ref, NULL));
+    TEST_ASSERT_EQUAL(MIDI_ROUTE_INVALID,
+                      midi_route_add_filter(NULL, ref, &match));
+
+    /* Outputs are numbered and used once */
+    TEST_ASSERT_TRUE(midi_route_add_output(&graph, ref, 0));
+    TEST_ASSERT_FALSE(midi_route_add_output(&graph, ref, 0));
+    TEST_ASSERT_FALSE(midi_route_add_output(&graph, ref,
+                                            MIDI_ROUTE_MAX_OUTPUTS));
+    TEST_ASSERT_EQUAL(MIDI_ROUTE_INVALID,
+                      midi_route_add_filter(&graph, 2, &match));
+
+    /* An in-place stage needs the input buffer only */
+    TEST_ASSERT_EQUAL(10 * 6,
+                      midi_route_compile(&plan, &graph, 10, NULL, 0));
+    TEST_ASSERT_EQUAL(0, midi_route_compile(&plan, &graph, 0, NULL, 0));
+    TEST_ASSERT_EQUAL(0,
+                      midi_route_compile(&plan, &graph,
+                                         MIDI_ROUTE_MAX_BATCH + 1, NULL, 0));
+    TEST_ASSERT_EQUAL(0, midi_route_compile(NULL, &graph, 10, NULL, 0));
+
+    /* Not compiled until the storage is large enough */
+    TEST_ASSERT_EQUAL(60, midi_route_compile(&plan, &graph, 10,
+                                             (uint8_t *)storage, 59));
+    TEST_ASSERT_EQUAL(0, midi_route_run(&plan, events, 1));
+    TEST_ASSERT_EQUAL(60, midi_route_compile(&plan, &graph, 10,
+                                             (uint8_t *)storage, 60));
+    TEST_ASSERT_EQUAL(10, midi_route_run(&plan, events, BATCH));
+    TEST_ASSERT_EQUAL(0, midi_route_run(&plan, NULL, 1));
+    TEST_ASSERT_EQUAL(0, midi_route_output(&plan, 0, NULL, NULL));
+
+    /* The graph is full at MIDI_ROUTE_MAX_NODES nodes */
+    while (graph.count < MIDI_ROUTE_MAX_NODES) {
+        TEST_ASSERT_NOT_EQUAL(MIDI_ROUTE_INVALID,
+                              midi_route_add_filter(&graph, ref, &match));
+    }
+    TEST_ASSERT_EQUAL(MIDI_ROUTE_INVALID,
+                      midi_route_add_filter(&graph, ref, &match));
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Nodes
+    RUN_TEST(test_route_filter);
+    RUN_TEST(test_route_filter_empty_range);
+    RUN_TEST(test_route_remap);
+    RUN_TEST(test_route_key_map);
+    RUN_TEST(test_route_curve);
+    RUN_TEST(test_route_split_merge);
+    RUN_TEST(test_route_merge_twice);
+
+    // Plan
+    RUN_TEST(test_route_fusion);
+    RUN_TEST(test_route_no_fusion_when_shared);
+    RUN_TEST(test_route_random_graphs);
+    RUN_TEST(test_route_limits);
+
+    return UNITY_END();
+}
@@ -0,0 +1,273 @@
+/***********************************************************************
+ * @file test_midi_schedule.c
+ * @brief Unit tests for the MIDI output scheduler module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_encoder.h"
+#include "../midi/midi_schedule.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define MAX_EVENTS (256)
+#define MAX_BYTES (1024)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static midi_scheduler_t scheduler;
+static midi_scheduled_t storage[MAX_EVENTS];
+static midi_packed_t packed[MAX_EVENTS];
+static uint32_t deadlines[MAX_EVENTS];
+static uint8_t bytes[MAX_BYTES];
+static uint32_t random_state;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    midi_scheduler_init(&scheduler, storage, MAX_EVENTS, NULL);
+    memset(bytes, 0, sizeof(bytes));
+    random_state = 0x2545F491;
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Next pseudo random number
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief Push one message
+ */
+static size_t push_one(midi_packed_t message, uint32_t deadline)
+{
+    return midi_scheduler_push(&scheduler, &message, &deadline, 1, 0);
+}
+
+/*=====================================================================*
+    Queue Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test initialization and NULL handling
+ */
+void test_scheduler_init(void)
+{
+    midi_scheduler_t other;
+    uint32_t deadline = 0;
+
+    TEST_ASSERT_EQUAL(0, midi_scheduler_init(NULL, storage, MAX_EVENTS, NULL));
+    TEST_ASSERT_EQUAL(0, midi_scheduler_init(&other, NULL, MAX_EVENTS, NULL));
+    TEST_ASSERT_EQUAL(0, midi_scheduler_init(&other, storage, 0, NULL));
+    TEST_ASSERT_EQUAL(1, midi_scheduler_init(&other, storage, 1, NULL));
+
+    TEST_ASSERT_EQUAL(0, midi_scheduler_size(&scheduler));
+    TEST_ASSERT_EQUAL(0, midi_scheduler_size(NULL));
+    TEST_ASSERT_EQUAL(0, midi_scheduler_next_deadline(&scheduler, &deadline));
+    TEST_ASSERT_EQUAL(0, midi_scheduler_next_deadline(NULL, &deadline));
+    TEST_ASSERT_EQUAL(0, midi_scheduler_push(NULL, packed, deadlines, 1, 0));
+    TEST_ASSERT_EQUAL(0, midi_scheduler_push(&scheduler, NULL, deadlines, 1,
+                                             0));
+    TEST_ASSERT_EQUAL(0, midi_scheduler_push(&scheduler, packed, NULL, 1, 0));
+    TEST_ASSERT_EQUAL(0, midi_scheduler_poll(NULL, 0, bytes, MAX_BYTES));
+    TEST_ASSERT_EQUAL(0, midi_scheduler_poll(&scheduler, 0, NULL, MAX_BYTES));
+    midi_scheduler_clear(NULL);
+}
+
+/**
+ * @brief Test that messages come out by deadline, in push order on ties
+ */
+void test_scheduler_order(void)
+{
+    const midi_packed_t late =
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 0x40, 0x7F);
+    const midi_packed_t first =
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 0x3C, 0x64);
+    const midi_packed_t second =
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_2, 0x3E, 0x64);
+    const midi_packed_t clock =
+        midi_packed_make(MIDI_MESSAGE_TIMING_CLOCK, MIDI_CHANNEL_NONE, 0, 0);
+    uint32_t deadline = 0;
+
+    TEST_ASSERT_EQUAL(1, push_one(late, 300));
+    TEST_ASSERT_EQUAL(1, push_one(first, 100));
+    TEST_ASSERT_EQUAL(1, push_one(second, 100));
+    TEST_ASSERT_EQUAL(1, push_one(clock, 200));
+    TEST_ASSERT_EQUAL(4, midi_scheduler_size(&scheduler));
+    TEST_ASSERT_EQUAL(1, midi_scheduler_next_deadline(&scheduler, &deadline));
+    TEST_ASSERT_EQUAL_UINT32(100, deadline);
+
+    /* Nothing is due yet */
+    TEST_ASSERT_EQUAL(0, midi_scheduler_poll(&scheduler, 99, bytes,
+                                             MAX_BYTES));
+
+    /* Both messages due at 100, in push order */
+    const uint8_t burst[] = {0x90, 0x3C, 0x64, 0x91, 0x3E, 0x64};
+    TEST_ASSERT_EQUAL(6, midi_scheduler_poll(&scheduler, 100, bytes,
+                                             MAX_BYTES));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(burst, bytes, sizeof(burst));
+    TEST_ASSERT_EQUAL(1, midi_scheduler_next_deadline(&scheduler, &deadline));
+    TEST_ASSERT_EQUAL_UINT32(200, deadline);
+
+    /* A late poll sends everything that is due, keeping running status */
+    const uint8_t rest[] = {0xF8, 0x90, 0x40, 0x7F};
+    TEST_ASSERT_EQUAL(4, midi_scheduler_poll(&scheduler, 1000, bytes,
+                                             MAX_BYTES));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(rest, bytes, sizeof(rest));
+    TEST_ASSERT_EQUAL(0, midi_scheduler_size(&scheduler));
+}
+
+/**
+ * @brief Test random deadlines against a stable reference order
+ */
+void test_scheduler_random(void)
+{
+    midi_encoder_t config;
+    midi_encoder_init(&config);
+    midi_encoder_set_running_status(&config, 0);
+    midi_scheduler_init(&scheduler, storage, MAX_EVENTS, &config);
+
+    /* Deadlines straddle the wrap of the clock */
+    const uint32_t start = 0xFFFFF000u;
+    for (size_t i = 0; i < MAX_EVENTS; i++) {
+        deadlines[i] = next_random() % 64;
+        packed[i] = midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1,
+                                     (uint8_t)(i & 0x7F),
+                                     (uint8_t)(1 + (i >> 7)));
+    }
+    TEST_ASSERT_EQUAL(MAX_EVENTS,
+                      midi_scheduler_push(&scheduler, packed, deadlines,
+                                          MAX_EVENTS, start + 0xFE0));
+
+    /* Poll one tick at a time, each burst holds that tick's messages */
+    size_t sent = 0;
+    for (uint32_t tick = 0; tick < 64; tick++) {
+        const size_t length = midi_scheduler_poll(
+            &scheduler, start + 0xFE0 + tick, bytes, MAX_BYTES);
+        TEST_ASSERT_EQUAL(0, length % 3);
+
+        size_t j = 0;
+        for (size_t i = 0; i < MAX_EVENTS; i++) {
+            if (deadlines[i] != tick) { continue; }
+            TEST_ASSERT_EQUAL_HEX8(0x90, bytes[j]);
+            TEST_ASSERT_EQUAL_HEX8(i & 0x7F, bytes[j + 1]);
+            TEST_ASSERT_EQUAL_HEX8(1 + (i >> 7), bytes[j + 2]);
+            j += 3;
+        }
+        TEST_ASSERT_EQUAL(j, length);
+        sent += length / 3;
+    }
+    TEST_ASSERT_EQUAL(MAX_EVENTS, sent);
+    TEST_ASSERT_EQUAL(0, midi_scheduler_size(&scheduler));
+}
+
+/**
+ * @brief Test overflow, partial bursts and clearing
+ */
+void test_scheduler_limits(void)
+{
+    midi_scheduled_t small[2];
+    midi_scheduler_init(&scheduler, small, 2, NULL);
+
+    for (size_t i = 0; i < 3; i++) {
+        packed[i] = midi_packed_make(MIDI_MESSAGE_PROGRAM_CHANGE,
+                                     MIDI_CHANNEL_1, (uint8_t)i, 0);
+        deadlines[i] = 10;
+    }
+    TEST_ASSERT_EQUAL(2, midi_scheduler_push(&scheduler, packed, deadlines,
+                                             3, 0));
+    TEST_ASSERT_EQUAL(1, midi_scheduler_get_overflow_count(&scheduler));
+
+    /* A message that does not fit waits for the next burst */
+    TEST_ASSERT_EQUAL(2, midi_scheduler_poll(&scheduler, 10, bytes, 2));
+    TEST_ASSERT_EQUAL_HEX8(0xC0, bytes[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x00, bytes[1]);
+    TEST_ASSERT_EQUAL(1, midi_scheduler_size(&scheduler));
+    TEST_ASSERT_EQUAL(1, midi_scheduler_poll(&scheduler, 10, bytes, 3));
+    TEST_ASSERT_EQUAL_HEX8(0x01, bytes[0]);
+
+    /* Messages that cannot be encoded are dropped */
+    TEST_ASSERT_EQUAL(1, push_one(0, 20));
+    TEST_ASSERT_EQUAL(0, midi_scheduler_poll(&scheduler, 20, bytes, 3));
+    TEST_ASSERT_EQUAL(0, midi_scheduler_size(&scheduler));
+
+    /* Clearing drops the queue and running status */
+    TEST_ASSERT_EQUAL(1, push_one(packed[0], 30));
+    midi_scheduler_clear(&scheduler);
+    TEST_ASSERT_EQUAL(0, midi_scheduler_size(&scheduler));
+    TEST_ASSERT_EQUAL(1, push_one(packed[1], 40));
+    TEST_ASSERT_EQUAL(2, midi_scheduler_poll(&scheduler, 40, bytes, 3));
+    TEST_ASSERT_EQUAL_HEX8(0xC0, bytes[0]);
+}
+
+/**
+ * @brief Test replaying timed parser output with a latency
+ */
+void test_scheduler_replay(void)
+{
+    const uint8_t stream[] = {0x90, 0x3C, 0x64, 0x3E, 0x64, 0xC1, 0x05};
+    midi_parser_t parser;
+    uint32_t timestamps[8];
+    size_t consumed = 0;
+
+    midi_parser_init(&parser);
+    const size_t count = midi_parse_buffer_packed_timed(
+        &parser, stream, sizeof(stream), 1000, 320, packed, timestamps, 8,
+        &consumed);
+    TEST_ASSERT_EQUAL(3, count);
+
+    TEST_ASSERT_EQUAL(3, midi_scheduler_push(&scheduler, packed, timestamps,
+                                             count, 5000));
+
+    /* The first note completes with the third byte */
+    TEST_ASSERT_EQUAL(0, midi_scheduler_poll(&scheduler, 6639, bytes,
+                                             MAX_BYTES));
+    TEST_ASSERT_EQUAL(3, midi_scheduler_poll(&scheduler, 6640, bytes,
+                                             MAX_BYTES));
+    TEST_ASSERT_EQUAL(2, midi_scheduler_poll(&scheduler, 7280, bytes,
+                                             MAX_BYTES));
+    TEST_ASSERT_EQUAL_HEX8(0x3E, bytes[0]);
+    TEST_ASSERT_EQUAL(2, midi_scheduler_poll(&scheduler, 7920, bytes,
+                                             MAX_BYTES));
+    TEST_ASSERT_EQUAL_HEX8(0xC1, bytes[0]);
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Queue
+    RUN_TEST(test_scheduler_init);
+    RUN_TEST(test_scheduler_order);
+    RUN_TEST(test_scheduler_random);
+    RUN_TEST(test_scheduler_limits);
+    RUN_TEST(test_scheduler_replay);
+
+    return UNITY_END();
+}
@@ -0,0 +1,378 @@
+/***********************************************************************
+ * @file test_midi_smf.c
+ * @brief Unit tests for the Standard MIDI File module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_smf.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define MAX_TRACKS (4)
+#define MAX_IMAGE_SIZE (256)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static midi_smf_t smf;
+static midi_smf_track_t tracks[MAX_TRACKS];
+static midi_smf_iterator_t iterator;
+static midi_smf_event_t event;
+static uint8_t image[MAX_IMAGE_SIZE];
+
+/**
+ * @brief A format 1 file with a tempo track, an unknown chunk and a
+ *        track of notes
+ */
+static const uint8_t format1_file[] = {
+    /* Header: format 1, 2 tracks, 480 ticks per quarter note */
+    'M', 'T', 'h', 'd', 0x00, 0x00, 0x00, 0x06, 0x00, 0x01, 0x00, 0x02,
+    0x01, 0xE0,
+    /* Tempo track */
+    'M', 'T', 'r', 'k', 0x00, 0x00, 0x00, 0x13,
+    0x00, 0xFF, 0x03, 0x04, 'P', 'i', 'a', 'n', /* Track name */
+    0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20,   /* 120 BPM */
+    0x00, 0xFF, 0x2F, 0x00,                     /* End of track */
+    /* Unknown chunk */
+    'X', 'U', 'N', 'K', 0x00, 0x00, 0x00, 0x02, 0xAA, 0xBB,
+    /* Note track */
+    'M', 'T', 'r', 'k', 0x00, 0x00, 0x00, 0x1F,
+    0x00, 0x90, 0x3C, 0x64,             /* Note On */
+    0x83, 0x60, 0x3E, 0x64,             /* Running status, delta 480 */
+    0x00, 0xF0, 0x03, 0x7E, 0x7F, 0xF7, /* SysEx */
+    0x00, 0xC1, 0x05,                   /* Program Change */
+    0x81, 0x00, 0x80, 0x3C, 0x40,       /* Note Off, delta 128 */
+    0x00, 0xF7, 0x02, 0xF8, 0xFA,       /* Escape */
+    0x00, 0xFF, 0x2F, 0x00,             /* End of track */
+};
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    memset(&smf, 0, sizeof(smf));
+    memset(&event, 0, sizeof(event));
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Open a format 0 file with a single track holding the given bytes
+ */
+static void open_single_track(const uint8_t *track, uint32_t length)
+{
+    static const uint8_t header[] = {'M',  'T',  'h',  'd',  0x00,
+                                     0x00, 0x00, 0x06, 0x00, 0x00,
+                                     0x00, 0x01, 0x00, 0x60};
+    size_t size = 0;
+
+    TEST_ASSERT_LESS_OR_EQUAL(MAX_IMAGE_SIZE - 22, length);
+    memcpy(image, header, sizeof(header));
+    size += sizeof(header);
+    memcpy(&image[size], "MTrk", 4);
+    image[size + 4] = (uint8_t)(length >> 24);
+    image[size + 5] = (uint8_t)(length >> 16);
+    image[size + 6] = (uint8_t)(length >> 8);
+    image[size + 7] = (uint8_t)length;
+    size += 8;
+    memcpy(&image[size], track, length);
+    size += length;
+
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK,
+                      midi_smf_open(&smf, image, size, tracks, MAX_TRACKS));
+    TEST_ASSERT_EQUAL(1, smf.track_count);
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_track_begin(&smf, 0, &iterator));
+}
+
+/**
+ * @brief Read the next event, which must be a MIDI event
+ */
+static void expect_midi_event(uint32_t tick, midi_packed_t expected)
+{
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_next_event(&iterator, &event));
+    TEST_ASSERT_EQUAL(MIDI_SMF_EVENT_MIDI, event.kind);
+    TEST_ASSERT_EQUAL(tick, event.tick);
+    TEST_ASSERT_NULL(event.data);
+    TEST_ASSERT_EQUAL_HEX32(expected, midi_message_pack(&event.message));
+}
+
+/**
+ * @brief Read the next event, which must be a meta or SysEx event
+ */
+static void expect_span_event(midi_smf_event_kind_t kind,
+                              uint8_t meta_type,
+                              const uint8_t *data,
+                              uint32_t length)
+{
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_next_event(&iterator, &event));
+    TEST_ASSERT_EQUAL(kind, event.kind);
+    TEST_ASSERT_EQUAL_HEX8(meta_type, event.meta_type);
+    TEST_ASSERT_EQUAL(length, event.length);
+    if (length > 0) { TEST_ASSERT_EQUAL_HEX8_ARRAY(data, event.data, length); }
+}
+
+/*=====================================================================*
+    Open Tests
+ *=====================================================================*/
+
+/**
+ * @brief The header is read and the track chunks indexed in place
+ */
+void test_smf_open(void)
+{
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_OK,
+        midi_smf_open(
+            &smf, format1_file, sizeof(format1_file), tracks, MAX_TRACKS));
+
+    TEST_ASSERT_EQUAL(1, smf.format);
+    TEST_ASSERT_EQUAL(480, smf.division);
+    TEST_ASSERT_EQUAL(2, smf.track_count);
+    TEST_ASSERT_EQUAL_PTR(&format1_file[22], tracks[0].data);
+    TEST_ASSERT_EQUAL(0x13, tracks[0].length);
+    TEST_ASSERT_EQUAL_PTR(&format1_file[59], tracks[1].data);
+    TEST_ASSERT_EQUAL(0x1F, tracks[1].length);
+}
+
+/**
+ * @brief Invalid headers and arguments are rejected
+ */
+void test_smf_open_errors(void)
+{
+    uint8_t bad[sizeof(format1_file)];
+
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_ERROR_ARGUMENT,
+        midi_smf_open(NULL, format1_file, sizeof(format1_file), tracks, 4));
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_ERROR_ARGUMENT,
+        midi_smf_open(&smf, NULL, sizeof(format1_file), tracks, 4));
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_ERROR_ARGUMENT,
+        midi_smf_open(&smf, format1_file, sizeof(format1_file), NULL, 4));
+
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_HEADER,
+                      midi_smf_open(&smf, format1_file, 13, tracks, 4));
+
+    memcpy(bad, format1_file, sizeof(bad));
+    bad[3] = 'x';
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_HEADER,
+                      midi_smf_open(&smf, bad, sizeof(bad), tracks, 4));
+
+    memcpy(bad, format1_file, sizeof(bad));
+    bad[7] = 0x05;
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_HEADER,
+                      midi_smf_open(&smf, bad, sizeof(bad), tracks, 4));
+    bad[4] = 0x7F;
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_HEADER,
+                      midi_smf_open(&smf, bad, sizeof(bad), tracks, 4));
+}
+
+/**
+ * @brief A file with more tracks than fit is reported, with the tracks
+ *        that fit indexed, and a last chunk that runs past the end of the
+ *        image is cut short
+ */
+void test_smf_open_capacity_and_short_chunk(void)
+{
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_ERROR_CAPACITY,
+        midi_smf_open(&smf, format1_file, sizeof(format1_file), tracks, 1));
+    TEST_ASSERT_EQUAL(1, smf.track_count);
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_track_begin(&smf, 0, &iterator));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_ARGUMENT,
+                      midi_smf_track_begin(&smf, 1, &iterator));
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_ERROR_CAPACITY,
+        midi_smf_open(&smf, format1_file, sizeof(format1_file), NULL, 0));
+    TEST_ASSERT_EQUAL(0, smf.track_count);
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_OK,
+        midi_smf_open(&smf, format1_file, sizeof(format1_file), tracks, 2));
+    TEST_ASSERT_EQUAL(2, smf.track_count);
+
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_OK,
+        midi_smf_open(
+            &smf, format1_file, sizeof(format1_file) - 4, tracks, MAX_TRACKS));
+    TEST_ASSERT_EQUAL(2, smf.track_count);
+    TEST_ASSERT_EQUAL(0x1F - 4, tracks[1].length);
+
+    /* The track ends at the end of the chunk without End of Track */
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_track_begin(&smf, 1, &iterator));
+    for (int i = 0; i < 6; i++) {
+        TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_next_event(&iterator, &event));
+    }
+    TEST_ASSERT_EQUAL(MIDI_SMF_END_OF_TRACK,
+                      midi_smf_next_event(&iterator, &event));
+}
+
+/*=====================================================================*
+    Iterator Tests
+ *=====================================================================*/
+
+/**
+ * @brief Meta events are returned as spans into the file image
+ */
+void test_smf_meta_events(void)
+{
+    static const uint8_t tempo[] = {0x07, 0xA1, 0x20};
+
+    midi_smf_open(
+        &smf, format1_file, sizeof(format1_file), tracks, MAX_TRACKS);
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_track_begin(&smf, 0, &iterator));
+
+    expect_span_event(MIDI_SMF_EVENT_META,
+                      MIDI_SMF_META_TRACK_NAME,
+                      (const uint8_t *)"Pian",
+                      4);
+    TEST_ASSERT_EQUAL_PTR(&format1_file[26], event.data);
+    expect_span_event(MIDI_SMF_EVENT_META, MIDI_SMF_META_SET_TEMPO, tempo, 3);
+    expect_span_event(
+        MIDI_SMF_EVENT_META, MIDI_SMF_META_END_OF_TRACK, NULL, 0);
+
+    TEST_ASSERT_EQUAL(MIDI_SMF_END_OF_TRACK,
+                      midi_smf_next_event(&iterator, &event));
+    TEST_ASSERT_EQUAL(MIDI_SMF_END_OF_TRACK,
+                      midi_smf_next_event(&iterator, &event));
+}
+
+/**
+ * @brief Channel messages are decoded with running status, and SysEx
+ *        events are returned as spans
+ */
+void test_smf_midi_and_sysex_events(void)
+{
+    static const uint8_t sysex[] = {0x7E, 0x7F, 0xF7};
+    static const uint8_t escape[] = {0xF8, 0xFA};
+
+    midi_smf_open(
+        &smf, format1_file, sizeof(format1_file), tracks, MAX_TRACKS);
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_track_begin(&smf, 1, &iterator));
+
+    expect_midi_event(
+        0, midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100));
+    expect_midi_event(
+        480, midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 62, 100));
+    TEST_ASSERT_EQUAL(480, event.delta_time);
+    expect_span_event(MIDI_SMF_EVENT_SYSEX, 0, sysex, 3);
+    expect_midi_event(
+        480,
+        midi_packed_make(MIDI_MESSAGE_PROGRAM_CHANGE, MIDI_CHANNEL_2, 5, 0));
+    expect_midi_event(
+        608, midi_packed_make(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 60, 64));
+    expect_span_event(MIDI_SMF_EVENT_ESCAPE, 0, escape, 2);
+    expect_span_event(
+        MIDI_SMF_EVENT_META, MIDI_SMF_META_END_OF_TRACK, NULL, 0);
+    TEST_ASSERT_EQUAL(608, event.tick);
+
+    TEST_ASSERT_EQUAL(MIDI_SMF_END_OF_TRACK,
+                      midi_smf_next_event(&iterator, &event));
+}
+
+/**
+ * @brief Meta and SysEx events cancel running status
+ */
+void test_smf_running_status_cancelled(void)
+{
+    static const uint8_t track[] = {
+        0x00, 0x90, 0x3C, 0x64, /* Note On */
+        0x00, 0xFF, 0x01, 0x00, /* Empty text */
+        0x00, 0x3E, 0x64,       /* Data bytes without running status */
+    };
+
+    open_single_track(track, sizeof(track));
+
+    expect_midi_event(
+        0, midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100));
+    expect_span_event(MIDI_SMF_EVENT_META, MIDI_SMF_META_TEXT, NULL, 0);
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_EVENT,
+                      midi_smf_next_event(&iterator, &event));
+
+    /* The iterator stays at the malformed event */
+    TEST_ASSERT_EQUAL(8, iterator.offset);
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_EVENT,
+                      midi_smf_next_event(&iterator, &event));
+}
+
+/**
+ * @brief Malformed events are reported
+ */
+void test_smf_malformed_events(void)
+{
+    static const uint8_t truncated_vlq[] = {0x81};
+    static const uint8_t long_vlq[] = {0xFF, 0xFF, 0xFF, 0xFF, 0x7F, 0x90};
+    static const uint8_t truncated_meta[] = {0x00, 0xFF, 0x01, 0x05, 'a'};
+    static const uint8_t truncated_message[] = {0x00, 0x90, 0x3C};
+    static const uint8_t system_common[] = {0x00, 0xF2, 0x00, 0x00};
+    static const uint8_t bad_data_byte[] = {0x00, 0x90, 0x3C, 0x90};
+
+    open_single_track(truncated_vlq, sizeof(truncated_vlq));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_TRUNCATED,
+                      midi_smf_next_event(&iterator, &event));
+
+    open_single_track(long_vlq, sizeof(long_vlq));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_EVENT,
+                      midi_smf_next_event(&iterator, &event));
+
+    open_single_track(truncated_meta, sizeof(truncated_meta));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_TRUNCATED,
+                      midi_smf_next_event(&iterator, &event));
+
+    open_single_track(truncated_message, sizeof(truncated_message));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_TRUNCATED,
+                      midi_smf_next_event(&iterator, &event));
+
+    open_single_track(system_common, sizeof(system_common));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_EVENT,
+                      midi_smf_next_event(&iterator, &event));
+
+    open_single_track(bad_data_byte, sizeof(bad_data_byte));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_EVENT,
+                      midi_smf_next_event(&iterator, &event));
+
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_ARGUMENT,
+                      midi_smf_next_event(NULL, &event));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_ARGUMENT,
+                      midi_smf_next_event(&iterator, NULL));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_ARGUMENT,
+                      midi_smf_track_begin(NULL, 0, &iterator));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_ARGUMENT,
+                      midi_smf_track_begin(&smf, 0, NULL));
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Open
+    RUN_TEST(test_smf_open);
+    RUN_TEST(test_smf_open_errors);
+    RUN_TEST(test_smf_open_capacity_and_short_chunk);
+
+    // Iterator
+    RUN_TEST(test_smf_meta_events);
+    RUN_TEST(test_smf_midi_and_sysex_events);
+    RUN_TEST(test_smf_running_status_cancelled);
+    RUN_TEST(test_smf_malformed_events);
+
+    return UNITY_END();
+}
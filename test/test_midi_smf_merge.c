@@ -0,0 +1,619 @@
+/***********************************************************************
+ * @file test_midi_smf_merge.c
+ * @brief Unit tests for the Standard MIDI File merge module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_smf.h"
+#include "../midi/midi_smf_merge.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define MAX_TRACKS (16)
+#define MAX_IMAGE_SIZE (8192)
+#define MAX_EVENTS (1024)
+#define MAX_TEMPOS (8)
+#define MAX_CHECKPOINTS (256)
+
+/*=====================================================================*
+    Private Data Types
+ *=====================================================================*/
+
+/**
+ * @brief The parts of a merged event that the tests compare
+ */
+typedef struct event_record_t {
+    uint32_t tick;
+    size_t track;
+    midi_smf_event_kind_t kind;
+    uint32_t value;
+} event_record_t;
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static uint8_t image[MAX_IMAGE_SIZE];
+static size_t image_size;
+static size_t track_start;
+static uint8_t track_running_status;
+
+static midi_smf_t smf;
+static midi_smf_track_t tracks[MAX_TRACKS];
+static midi_smf_cursor_t cursors[MAX_TRACKS];
+static midi_smf_checkpoint_t checkpoints[MAX_CHECKPOINTS];
+static midi_smf_tempo_t tempos[MAX_TEMPOS];
+static midi_smf_tempo_map_t tempo_map;
+static midi_smf_merge_t merge;
+static midi_smf_merge_event_t merged;
+
+static event_record_t expected[MAX_EVENTS];
+static event_record_t actual[MAX_EVENTS];
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    image_size = 0;
+    memset(&smf, 0, sizeof(smf));
+    memset(&merge, 0, sizeof(merge));
+    memset(cursors, 0x55, sizeof(cursors));
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Append bytes to the file image
+ */
+static void emit(const uint8_t *bytes, size_t length)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(MAX_IMAGE_SIZE, image_size + length);
+    memcpy(&image[image_size], bytes, length);
+    image_size += length;
+}
+
+/**
+ * @brief Append a variable-length quantity to the file image
+ */
+static void emit_vlq(uint32_t value)
+{
+    uint8_t bytes[4];
+    size_t count = 0;
+
+    do {
+        bytes[count++] = (uint8_t)(value & 0x7F);
+        value >>= 7;
+    } while (value > 0);
+
+    while (count > 0) {
+        const uint8_t byte = bytes[--count];
+        emit((const uint8_t[]){(count > 0) ? (byte | 0x80) : byte}, 1);
+    }
+}
+
+/**
+ * @brief Start a file image with an MThd chunk
+ */
+static void begin_file(uint16_t format, uint16_t count, uint16_t division)
+{
+    const uint8_t header[] = {'M',  'T',  'h',  'd',
+                              0x00, 0x00, 0x00, 0x06,
+                              0x00, (uint8_t)format,
+                              (uint8_t)(count >> 8), (uint8_t)count,
+                              (uint8_t)(division >> 8), (uint8_t)division};
+    image_size = 0;
+    emit(header, sizeof(header));
+}
+
+/**
+ * @brief Start an MTrk chunk
+ */
+static void begin_track(void)
+{
+    emit((const uint8_t *)"MTrk\0\0\0\0", 8);
+    track_start = image_size;
+    track_running_status = 0;
+}
+
+/**
+ * @brief Append a channel message, using running status
+ */
+static void emit_message(uint32_t delta, uint8_t status, uint8_t d0, uint8_t d1)
+{
+    emit_vlq(delta);
+    if (status != track_running_status) { emit(&status, 1); }
+    track_running_status = status;
+    emit((const uint8_t[]){d0, d1}, 2);
+}
+
+/**
+ * @brief Append a meta event
+ */
+static void emit_meta(uint32_t delta,
+                      uint8_t type,
+                      const uint8_t *data,
+                      uint8_t length)
+{
+    emit_vlq(delta);
+    emit((const uint8_t[]){0xFF, type, length}, 3);
+    if (length > 0) { emit(data, length); }
+    track_running_status = 0;
+}
+
+/**
+ * @brief Append a Set Tempo meta event
+ */
+static void emit_tempo(uint32_t delta, uint32_t tempo)
+{
+    const uint8_t data[] = {(uint8_t)(tempo >> 16), (uint8_t)(tempo >> 8),
+                            (uint8_t)tempo};
+    emit_meta(delta, MIDI_SMF_META_SET_TEMPO, data, 3);
+}
+
+/**
+ * @brief End an MTrk chunk with End of Track and patch its length
+ */
+static void end_track(void)
+{
+    emit_meta(0, MIDI_SMF_META_END_OF_TRACK, NULL, 0);
+
+    const size_t length = image_size - track_start;
+    image[track_start - 4] = (uint8_t)(length >> 24);
+    image[track_start - 3] = (uint8_t)(length >> 16);
+    image[track_start - 2] = (uint8_t)(length >> 8);
+    image[track_start - 1] = (uint8_t)length;
+}
+
+/**
+ * @brief Open the file image
+ */
+static void open_image(void)
+{
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_OK,
+        midi_smf_open(&smf, image, image_size, tracks, MAX_TRACKS));
+}
+
+/**
+ * @brief Build a format 1 file whose tracks have many equal ticks, with
+ *        running status broken up by meta events
+ */
+static void build_busy_file(size_t track_count)
+{
+    uint32_t seed = 12345;
+
+    begin_file(1, (uint16_t)track_count, 480);
+    for (size_t track = 0; track < track_count; track++) {
+        begin_track();
+        for (size_t i = 0; i < 40; i++) {
+            seed = seed * 1103515245 + 12345;
+            const uint32_t delta = (seed >> 16) % 4 * 60;
+            const uint8_t note = (uint8_t)((seed >> 8) & 0x7F);
+
+            if (i % 7 == 6) {
+                emit_meta(delta, MIDI_SMF_META_MARKER, &note, 1);
+            } else {
+                emit_message(delta,
+                             (uint8_t)(MIDI_MESSAGE_NOTE_ON | (track & 0x0F)),
+                             note, (uint8_t)(i + 1));
+            }
+        }
+        end_track();
+    }
+    open_image();
+}
+
+/**
+ * @brief Record the parts of an event that the tests compare
+ */
+static event_record_t record_event(const midi_smf_event_t *event,
+                                   size_t track)
+{
+    event_record_t record;
+
+    record.tick = event->tick;
+    record.track = track;
+    record.kind = event->kind;
+    record.value = (event->kind == MIDI_SMF_EVENT_MIDI)
+                       ? midi_message_pack(&event->message)
+                       : event->meta_type;
+    return record;
+}
+
+/**
+ * @brief Merge the tracks with a linear scan over the track iterators
+ * @return The number of events at or after the tick
+ */
+static size_t linear_merge(uint32_t from_tick, event_record_t *records)
+{
+    midi_smf_iterator_t iterators[MAX_TRACKS];
+    midi_smf_event_t events[MAX_TRACKS];
+    int pending[MAX_TRACKS];
+    size_t count = 0;
+
+    for (size_t track = 0; track < smf.track_count; track++) {
+        midi_smf_track_begin(&smf, track, &iterators[track]);
+        pending[track] = midi_smf_next_event(&iterators[track],
+                                             &events[track]) == MIDI_SMF_OK;
+    }
+
+    for (;;) {
+        size_t next = MAX_TRACKS;
+        for (size_t track = 0; track < smf.track_count; track++) {
+            if (pending[track]
+                && (next == MAX_TRACKS
+                    || events[track].tick < events[next].tick)) {
+                next = track;
+            }
+        }
+        if (next == MAX_TRACKS) { break; }
+
+        if (events[next].tick >= from_tick) {
+            TEST_ASSERT_LESS_THAN(MAX_EVENTS, count);
+            records[count++] = record_event(&events[next], next);
+        }
+        pending[next] = midi_smf_next_event(&iterators[next], &events[next])
+                        == MIDI_SMF_OK;
+    }
+    return count;
+}
+
+/**
+ * @brief Read the rest of the merged stream
+ * @return The number of events
+ */
+static size_t drain_merge(event_record_t *records)
+{
+    size_t count = 0;
+    midi_smf_status_t status;
+
+    while ((status = midi_smf_merge_next(&merge, &merged)) == MIDI_SMF_OK) {
+        TEST_ASSERT_LESS_THAN(MAX_EVENTS, count);
+        records[count++] = record_event(&merged.event, merged.track);
+    }
+    TEST_ASSERT_EQUAL(MIDI_SMF_END_OF_TRACK, status);
+    return count;
+}
+
+/**
+ * @brief Compare two merged streams
+ */
+static void assert_records_equal(const event_record_t *expected_records,
+                                 size_t expected_count,
+                                 const event_record_t *actual_records,
+                                 size_t actual_count)
+{
+    TEST_ASSERT_EQUAL(expected_count, actual_count);
+    for (size_t i = 0; i < expected_count; i++) {
+        TEST_ASSERT_EQUAL(expected_records[i].tick, actual_records[i].tick);
+        TEST_ASSERT_EQUAL(expected_records[i].track, actual_records[i].track);
+        TEST_ASSERT_EQUAL(expected_records[i].kind, actual_records[i].kind);
+        TEST_ASSERT_EQUAL_HEX32(expected_records[i].value,
+                                actual_records[i].value);
+    }
+}
+
+/*=====================================================================*
+    Merge Tests
+ *=====================================================================*/
+
+/**
+ * @brief Events are merged in tick order, and in track order within a
+ *        tick
+ */
+void test_merge_orders_by_tick_and_track(void)
+{
+    begin_file(1, 3, 96);
+    begin_track();
+    emit_message(10, 0x90, 1, 1);
+    emit_message(0, 0x90, 2, 1);
+    end_track();
+    begin_track();
+    emit_message(0, 0x91, 3, 1);
+    emit_message(20, 0x91, 4, 1);
+    end_track();
+    begin_track();
+    emit_message(10, 0x92, 5, 1);
+    end_track();
+    open_image();
+
+    static const struct {
+        uint32_t tick;
+        size_t track;
+        uint8_t note;
+    } order[] = {
+        {0, 1, 3}, {10, 0, 1}, {10, 0, 2}, {10, 0, 0}, {10, 2, 5},
+        {10, 2, 0}, {20, 1, 4}, {20, 1, 0},
+    };
+
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK,
+                      midi_smf_merge_init(&merge, &smf, NULL, cursors, 3));
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_merge_next(&merge, &merged));
+        TEST_ASSERT_EQUAL(order[i].tick, merged.event.tick);
+        TEST_ASSERT_EQUAL(order[i].track, merged.track);
+        TEST_ASSERT_EQUAL(0, merged.microseconds);
+        if (order[i].note == 0) {
+            TEST_ASSERT_EQUAL(MIDI_SMF_EVENT_META, merged.event.kind);
+            TEST_ASSERT_EQUAL(MIDI_SMF_META_END_OF_TRACK,
+                              merged.event.meta_type);
+        } else {
+            TEST_ASSERT_EQUAL(MIDI_SMF_EVENT_MIDI, merged.event.kind);
+            TEST_ASSERT_EQUAL(order[i].note, merged.event.message.note);
+        }
+    }
+    TEST_ASSERT_EQUAL(MIDI_SMF_END_OF_TRACK,
+                      midi_smf_merge_next(&merge, &merged));
+    TEST_ASSERT_EQUAL(MIDI_SMF_END_OF_TRACK,
+                      midi_smf_merge_next(&merge, &merged));
+}
+
+/**
+ * @brief The heap merge matches a linear scan over many tracks
+ */
+void test_merge_matches_linear_scan(void)
+{
+    build_busy_file(MAX_TRACKS);
+
+    const size_t expected_count = linear_merge(0, expected);
+    TEST_ASSERT_EQUAL(MAX_TRACKS * 41, expected_count);
+
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_OK,
+        midi_smf_merge_init(&merge, &smf, NULL, cursors, MAX_TRACKS));
+    assert_records_equal(expected, expected_count, actual, drain_merge(actual));
+}
+
+/**
+ * @brief A malformed track is reported once and left out of the merge
+ */
+void test_merge_malformed_track(void)
+{
+    begin_file(1, 2, 96);
+    begin_track();
+    emit_message(0, 0x90, 1, 1);
+    emit_meta(0, MIDI_SMF_META_TEXT, NULL, 0);
+    emit((const uint8_t[]){0x00, 0x3C, 0x40}, 3); /* No running status */
+    end_track();
+    begin_track();
+    emit_message(0, 0x91, 2, 1);
+    emit_message(10, 0x91, 3, 1);
+    end_track();
+    open_image();
+
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK,
+                      midi_smf_merge_init(&merge, &smf, NULL, cursors, 2));
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_merge_next(&merge, &merged));
+    TEST_ASSERT_EQUAL(0, merged.track);
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_merge_next(&merge, &merged));
+    TEST_ASSERT_EQUAL(MIDI_SMF_META_TEXT, merged.event.meta_type);
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_EVENT,
+                      midi_smf_merge_next(&merge, &merged));
+    TEST_ASSERT_EQUAL(0, merged.track);
+
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_merge_next(&merge, &merged));
+    TEST_ASSERT_EQUAL(1, merged.track);
+    TEST_ASSERT_EQUAL(0, merged.event.tick);
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_merge_next(&merge, &merged));
+    TEST_ASSERT_EQUAL(10, merged.event.tick);
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_merge_next(&merge, &merged));
+    TEST_ASSERT_EQUAL(MIDI_SMF_EVENT_META, merged.event.kind);
+    TEST_ASSERT_EQUAL(MIDI_SMF_END_OF_TRACK,
+                      midi_smf_merge_next(&merge, &merged));
+}
+
+/**
+ * @brief Invalid arguments are rejected
+ */
+void test_merge_errors(void)
+{
+    build_busy_file(4);
+
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_ARGUMENT,
+                      midi_smf_merge_init(NULL, &smf, NULL, cursors, 4));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_ARGUMENT,
+                      midi_smf_merge_init(&merge, NULL, NULL, cursors, 4));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_ARGUMENT,
+                      midi_smf_merge_init(&merge, &smf, NULL, NULL, 4));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_CAPACITY,
+                      midi_smf_merge_init(&merge, &smf, NULL, cursors, 3));
+
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK,
+                      midi_smf_merge_init(&merge, &smf, NULL, cursors, 4));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_ARGUMENT,
+                      midi_smf_merge_index(&merge, checkpoints, 4, 0));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_ARGUMENT,
+                      midi_smf_merge_index(&merge, NULL, 4, 1));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_ARGUMENT, midi_smf_merge_seek(NULL, 0));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_ARGUMENT,
+                      midi_smf_merge_next(NULL, &merged));
+    TEST_ASSERT_EQUAL(MIDI_SMF_ERROR_ARGUMENT,
+                      midi_smf_merge_next(&merge, NULL));
+}
+
+/*=====================================================================*
+    Tempo Map Tests
+ *=====================================================================*/
+
+/**
+ * @brief Tempo changes from every track are converted to microseconds,
+ *        and merged events carry their time
+ */
+void test_tempo_map(void)
+{
+    begin_file(1, 2, 480);
+    begin_track();
+    emit_tempo(0, 250000);   /* Replaces the default tempo */
+    emit_tempo(960, 1000000); /* At 0.5 s */
+    end_track();
+    begin_track();
+    emit_tempo(480, 500000); /* At 0.25 s, inserted before 960 */
+    emit_message(960, 0x90, 60, 100);
+    end_track();
+    open_image();
+
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_OK,
+        midi_smf_tempo_map_build(&tempo_map, &smf, tempos, MAX_TEMPOS));
+    TEST_ASSERT_EQUAL(3, tempo_map.count);
+    TEST_ASSERT_EQUAL(0, tempos[0].tick);
+    TEST_ASSERT_EQUAL(250000, tempos[0].tempo);
+    TEST_ASSERT_EQUAL(480, tempos[1].tick);
+    TEST_ASSERT_EQUAL(250000, tempos[1].microseconds);
+    TEST_ASSERT_EQUAL(960, tempos[2].tick);
+    TEST_ASSERT_EQUAL(750000, tempos[2].microseconds);
+
+    TEST_ASSERT_EQUAL(0, midi_smf_tempo_map_microseconds(&tempo_map, 0));
+    TEST_ASSERT_EQUAL(125000, midi_smf_tempo_map_microseconds(&tempo_map, 240));
+    TEST_ASSERT_EQUAL(500000, midi_smf_tempo_map_microseconds(&tempo_map, 720));
+    TEST_ASSERT_EQUAL(1750000,
+                      midi_smf_tempo_map_microseconds(&tempo_map, 1440));
+    TEST_ASSERT_EQUAL(0, midi_smf_tempo_map_microseconds(NULL, 1440));
+
+    /* The note at tick 1440 is the second to last event */
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_OK,
+        midi_smf_merge_init(&merge, &smf, &tempo_map, cursors, MAX_TRACKS));
+    size_t count = 0;
+    while (midi_smf_merge_next(&merge, &merged) == MIDI_SMF_OK) {
+        TEST_ASSERT_EQUAL(
+            midi_smf_tempo_map_microseconds(&tempo_map, merged.event.tick),
+            merged.microseconds);
+        count++;
+    }
+    TEST_ASSERT_EQUAL(6, count);
+
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_merge_seek(&merge, 1000));
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_merge_next(&merge, &merged));
+    TEST_ASSERT_EQUAL(1440, merged.event.tick);
+    TEST_ASSERT_EQUAL(1750000, merged.microseconds);
+
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_ERROR_CAPACITY,
+        midi_smf_tempo_map_build(&tempo_map, &smf, tempos, 2));
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_ERROR_ARGUMENT,
+        midi_smf_tempo_map_build(&tempo_map, &smf, tempos, 0));
+}
+
+/**
+ * @brief SMPTE time divisions have a fixed tick length
+ */
+void test_tempo_map_smpte(void)
+{
+    /* 25 frames per second, 40 ticks per frame: 1 ms ticks */
+    begin_file(0, 1, 0xE728);
+    begin_track();
+    emit_tempo(0, 1000000);
+    end_track();
+    open_image();
+
+    TEST_ASSERT_EQUAL(
+        MIDI_SMF_OK,
+        midi_smf_tempo_map_build(&tempo_map, &smf, tempos, MAX_TEMPOS));
+    TEST_ASSERT_EQUAL(500000, midi_smf_tempo_map_microseconds(&tempo_map, 500));
+
+    /* 29.97 frames per second, 100 ticks per frame */
+    tempo_map.division = 0xE364;
+    TEST_ASSERT_EQUAL(1000000,
+                      midi_smf_tempo_map_microseconds(&tempo_map, 2997));
+}
+
+/*=====================================================================*
+    Seek Tests
+ *=====================================================================*/
+
+/**
+ * @brief Seeking returns the events at or after the tick, with and
+ *        without checkpoints
+ */
+void test_merge_seek(void)
+{
+    static const uint32_t targets[] = {0, 1, 60, 61, 900, 2000, 4000, 100000};
+
+    build_busy_file(MAX_TRACKS);
+
+    for (int indexed = 0; indexed < 2; indexed++) {
+        TEST_ASSERT_EQUAL(
+            MIDI_SMF_OK,
+            midi_smf_merge_init(&merge, &smf, NULL, cursors, MAX_TRACKS));
+        if (indexed) {
+            TEST_ASSERT_EQUAL(
+                MIDI_SMF_OK,
+                midi_smf_merge_index(&merge, checkpoints, MAX_CHECKPOINTS, 3));
+            TEST_ASSERT_EQUAL(13, cursors[0].checkpoint_count);
+            TEST_ASSERT_EQUAL_PTR(&checkpoints[13], cursors[1].checkpoints);
+        }
+
+        for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+            const size_t expected_count = linear_merge(targets[i], expected);
+
+            TEST_ASSERT_EQUAL(MIDI_SMF_OK,
+                              midi_smf_merge_seek(&merge, targets[i]));
+            assert_records_equal(
+                expected, expected_count, actual, drain_merge(actual));
+        }
+    }
+}
+
+/**
+ * @brief Tracks that do not fit in the checkpoint array still seek
+ */
+void test_merge_seek_partial_index(void)
+{
+    build_busy_file(4);
+
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK,
+                      midi_smf_merge_init(&merge, &smf, NULL, cursors, 4));
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK,
+                      midi_smf_merge_index(&merge, checkpoints, 10, 4));
+    TEST_ASSERT_EQUAL(10, cursors[0].checkpoint_count);
+    TEST_ASSERT_EQUAL(0, cursors[1].checkpoint_count);
+    TEST_ASSERT_NULL(cursors[1].checkpoints);
+
+    /* The merge is rewound after indexing */
+    const size_t all = linear_merge(0, expected);
+    assert_records_equal(expected, all, actual, drain_merge(actual));
+
+    const size_t expected_count = linear_merge(1500, expected);
+    TEST_ASSERT_EQUAL(MIDI_SMF_OK, midi_smf_merge_seek(&merge, 1500));
+    assert_records_equal(expected, expected_count, actual, drain_merge(actual));
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Merge
+    RUN_TEST(test_merge_orders_by_tick_and_track);
+    RUN_TEST(test_merge_matches_linear_scan);
+    RUN_TEST(test_merge_malformed_track);
+    RUN_TEST(test_merge_errors);
+
+    // Tempo map
+    RUN_TEST(test_tempo_map);
+    RUN_TEST(test_tempo_map_smpte);
+
+    // Seek
+    RUN_TEST(test_merge_seek);
+    RUN_TEST(test_merge_seek_partial_index);
+
+    return UNITY_END();
+}
@@ -0,0 +1,560 @@
+/***********************************************************************
+ * @file test_midi_state.c
+ * @brief Unit tests for the MIDI channel state module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_state.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define MAX_CHANGES (4096)
+#define FUZZ_MESSAGES (20000)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static midi_state_t state;
+static midi_state_t receiver;
+static midi_message_t changes[MAX_CHANGES];
+static uint32_t random_state;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    midi_state_init(&state);
+    midi_state_init(&receiver);
+    random_state = 0x2545F491;
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Send a channel message to the state
+ */
+static void send(midi_state_t *s,
+                 midi_message_type_t type,
+                 midi_channel_t channel,
+                 uint8_t data1,
+                 uint8_t data2)
+{
+    midi_message_t message;
+
+    memset(&message, 0, sizeof(message));
+    message.message_type = type;
+    message.channel = channel;
+    switch (type) {
+    case MIDI_MESSAGE_PROGRAM_CHANGE:
+        message.program = data1;
+        break;
+    case MIDI_MESSAGE_CHANNEL_PRESSURE:
+        message.channel_pressure = data1;
+        break;
+    case MIDI_MESSAGE_PITCH_BEND:
+        message.pitch_bend = (uint16_t)(data1 | (data2 << 7));
+        break;
+    case MIDI_MESSAGE_CONTROL_CHANGE:
+    case MIDI_MESSAGE_ALL_SOUND_OFF:
+    case MIDI_MESSAGE_RESET_ALL_CONTROLLERS:
+    case MIDI_MESSAGE_LOCAL_CONTROL:
+    case MIDI_MESSAGE_ALL_NOTES_OFF:
+    case MIDI_MESSAGE_OMNI_OFF:
+    case MIDI_MESSAGE_OMNI_ON:
+    case MIDI_MESSAGE_MONO_ON:
+    case MIDI_MESSAGE_POLY_ON:
+        message.controller = (midi_controller_t)data1;
+        message.control_value = data2;
+        break;
+    default:
+        message.note = data1;
+        message.velocity = data2;
+        break;
+    }
+    midi_state_update(s, &message);
+}
+
+/**
+ * @brief Next pseudo random number
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief Send a pseudo random message, mostly on few notes and
+ *        controllers so that they collide
+ */
+static void send_random(midi_state_t *s)
+{
+    static const midi_message_type_t modes[] = {
+        MIDI_MESSAGE_ALL_SOUND_OFF, MIDI_MESSAGE_RESET_ALL_CONTROLLERS,
+        MIDI_MESSAGE_ALL_NOTES_OFF, MIDI_MESSAGE_OMNI_OFF,
+        MIDI_MESSAGE_OMNI_ON,       MIDI_MESSAGE_MONO_ON,
+        MIDI_MESSAGE_POLY_ON,
+    };
+    const uint32_t r = next_random();
+    const midi_channel_t channel = (midi_channel_t)(r & 0x03);
+    const uint8_t data1 = (uint8_t)((r >> 8) & 0x7F);
+    const uint8_t data2 = (uint8_t)((r >> 16) & 0x7F);
+    const uint8_t note = (uint8_t)(60 + ((r >> 24) & 0x0F));
+
+    switch ((r >> 4) & 0x0F) {
+    case 0:
+    case 1:
+    case 2:
+        send(s, MIDI_MESSAGE_NOTE_ON, channel, note, data2);
+        break;
+    case 3:
+    case 4:
+        send(s, MIDI_MESSAGE_NOTE_OFF, channel, note, data2);
+        break;
+    case 5:
+    case 6:
+        send(s, MIDI_MESSAGE_CONTROL_CHANGE, channel,
+             MIDI_CC_SUSTAIN_PEDAL, data2);
+        break;
+    case 7:
+        send(s, MIDI_MESSAGE_CONTROL_CHANGE, channel, data1 % 120, data2);
+        break;
+    case 8:
+        send(s, MIDI_MESSAGE_PROGRAM_CHANGE, channel, data1, 0);
+        break;
+    case 9:
+        send(s, MIDI_MESSAGE_PITCH_BEND, channel, data1, data2);
+        break;
+    case 10:
+        send(s, MIDI_MESSAGE_CHANNEL_PRESSURE, channel, data1, 0);
+        break;
+    case 11:
+        send(s, MIDI_MESSAGE_KEY_PRESSURE, channel, note, data2);
+        break;
+    case 12:
+        send(s, modes[data1 % (sizeof(modes) / sizeof(modes[0]))],
+             channel, 0, 0);
+        break;
+    case 13:
+        if (data1 == 0) {
+            midi_message_t reset;
+            memset(&reset, 0, sizeof(reset));
+            reset.message_type = MIDI_MESSAGE_SYSTEM_RESET;
+            reset.channel = MIDI_CHANNEL_NONE;
+            midi_state_update(s, &reset);
+        }
+        break;
+    default:
+        send(s, MIDI_MESSAGE_NOTE_ON, channel, note, 0);
+        break;
+    }
+}
+
+/**
+ * @brief Check that the receiver has the same channel state as the state
+ */
+static void assert_same_channels(const midi_state_t *expected,
+                                 const midi_state_t *actual)
+{
+    for (size_t channel = 0; channel < MIDI_STATE_CHANNELS; channel++) {
+        for (size_t word = 0; word < MIDI_STATE_SET_WORDS; word++) {
+            TEST_ASSERT_EQUAL_HEX64(expected->held[channel][word]
+                                        | expected->sustained[channel][word],
+                                    actual->held[channel][word]
+                                        | actual->sustained[channel][word]);
+        }
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected->controllers[channel],
+                                     actual->controllers[channel], 120);
+        TEST_ASSERT_EQUAL(expected->program[channel],
+                          actual->program[channel]);
+        TEST_ASSERT_EQUAL_HEX16(expected->pitch_bend[channel],
+                                actual->pitch_bend[channel]);
+        TEST_ASSERT_EQUAL(expected->channel_pressure[channel],
+                          actual->channel_pressure[channel]);
+    }
+    TEST_ASSERT_EQUAL_HEX16(expected->active_channels,
+                            actual->active_channels);
+}
+
+/*=====================================================================*
+    Notes Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test note tracking and the note queries
+ */
+void test_state_notes(void)
+{
+    uint8_t notes[8];
+    midi_state_note_t all[8];
+
+    TEST_ASSERT_EQUAL_HEX16(0, state.active_channels);
+
+    send(&state, MIDI_MESSAGE_NOTE_ON, 2, 100, 90);
+    send(&state, MIDI_MESSAGE_NOTE_ON, 2, 30, 80);
+    send(&state, MIDI_MESSAGE_NOTE_ON, 9, 36, 127);
+    TEST_ASSERT_TRUE(midi_state_is_note_on(&state, 2, 100));
+    TEST_ASSERT_TRUE(midi_state_is_note_on(&state, 2, 30));
+    TEST_ASSERT_FALSE(midi_state_is_note_on(&state, 3, 30));
+    TEST_ASSERT_EQUAL(2, midi_state_count_notes(&state, 2));
+    TEST_ASSERT_EQUAL_HEX16(0x0204, state.active_channels);
+
+    TEST_ASSERT_EQUAL(2, midi_state_channel_notes(&state, 2, notes, 8));
+    TEST_ASSERT_EQUAL(30, notes[0]);
+    TEST_ASSERT_EQUAL(100, notes[1]);
+    TEST_ASSERT_EQUAL(1, midi_state_channel_notes(&state, 2, notes, 1));
+
+    TEST_ASSERT_EQUAL(3, midi_state_all_notes(&state, all, 8));
+    TEST_ASSERT_EQUAL(2, all[0].channel);
+    TEST_ASSERT_EQUAL(30, all[0].note);
+    TEST_ASSERT_EQUAL(80, all[0].velocity);
+    TEST_ASSERT_EQUAL(100, all[1].note);
+    TEST_ASSERT_EQUAL(9, all[2].channel);
+    TEST_ASSERT_EQUAL(36, all[2].note);
+    TEST_ASSERT_EQUAL(2, midi_state_all_notes(&state, all, 2));
+
+    /* Note On with a velocity of 0 and Note Off both end a note */
+    send(&state, MIDI_MESSAGE_NOTE_ON, 2, 100, 0);
+    send(&state, MIDI_MESSAGE_NOTE_OFF, 2, 30, 64);
+    send(&state, MIDI_MESSAGE_NOTE_OFF, 9, 37, 64);
+    TEST_ASSERT_EQUAL(0, midi_state_count_notes(&state, 2));
+    TEST_ASSERT_EQUAL(1, midi_state_count_notes(&state, 9));
+    TEST_ASSERT_EQUAL_HEX16(0x0200, state.active_channels);
+
+    /* Invalid arguments */
+    TEST_ASSERT_FALSE(midi_state_is_note_on(&state, 16, 36));
+    TEST_ASSERT_FALSE(midi_state_is_note_on(NULL, 9, 36));
+    TEST_ASSERT_EQUAL(0, midi_state_count_notes(&state, MIDI_CHANNEL_NONE));
+    TEST_ASSERT_EQUAL(0, midi_state_all_notes(NULL, all, 8));
+    send(&state, MIDI_MESSAGE_NOTE_ON, 16, 36, 127);
+    TEST_ASSERT_EQUAL_HEX16(0x0200, state.active_channels);
+}
+
+/**
+ * @brief Test that the sustain pedal holds released notes
+ */
+void test_state_sustain(void)
+{
+    send(&state, MIDI_MESSAGE_NOTE_ON, 0, 60, 100);
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 0, MIDI_CC_SUSTAIN_PEDAL, 127);
+    send(&state, MIDI_MESSAGE_NOTE_OFF, 0, 60, 64);
+    TEST_ASSERT_TRUE(midi_state_is_note_on(&state, 0, 60));
+
+    /* Striking a sustained note holds it again */
+    send(&state, MIDI_MESSAGE_NOTE_ON, 0, 62, 100);
+    send(&state, MIDI_MESSAGE_NOTE_OFF, 0, 62, 64);
+    send(&state, MIDI_MESSAGE_NOTE_ON, 0, 62, 100);
+    TEST_ASSERT_EQUAL(2, midi_state_count_notes(&state, 0));
+
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 0, MIDI_CC_SUSTAIN_PEDAL, 0);
+    TEST_ASSERT_FALSE(midi_state_is_note_on(&state, 0, 60));
+    TEST_ASSERT_TRUE(midi_state_is_note_on(&state, 0, 62));
+    TEST_ASSERT_EQUAL(1, midi_state_count_notes(&state, 0));
+}
+
+/*=====================================================================*
+    Channel Mode Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test the note and mode effects of the Channel Mode messages
+ */
+void test_state_mode_messages(void)
+{
+    send(&state, MIDI_MESSAGE_NOTE_ON, 1, 60, 100);
+    send(&state, MIDI_MESSAGE_NOTE_ON, 1, 64, 100);
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 1, MIDI_CC_SUSTAIN_PEDAL, 127);
+    send(&state, MIDI_MESSAGE_ALL_NOTES_OFF, 1, MIDI_CC_ALL_NOTES_OFF, 0);
+    TEST_ASSERT_EQUAL(2, midi_state_count_notes(&state, 1));
+    TEST_ASSERT_EQUAL_HEX64(0, state.held[1][0]);
+
+    send(&state, MIDI_MESSAGE_ALL_SOUND_OFF, 1, MIDI_CC_ALL_SOUND_OFF, 0);
+    TEST_ASSERT_EQUAL(0, midi_state_count_notes(&state, 1));
+    TEST_ASSERT_EQUAL_HEX16(0, state.active_channels);
+
+    send(&state, MIDI_MESSAGE_NOTE_ON, 3, 60, 100);
+    send(&state, MIDI_MESSAGE_MONO_ON, 3, MIDI_CC_MONO_ON, 1);
+    TEST_ASSERT_EQUAL(0, midi_state_count_notes(&state, 3));
+    TEST_ASSERT_EQUAL_HEX16(0x0008, state.mono);
+    send(&state, MIDI_MESSAGE_POLY_ON, 3, MIDI_CC_POLY_ON, 0);
+    TEST_ASSERT_EQUAL_HEX16(0, state.mono);
+
+    send(&state, MIDI_MESSAGE_OMNI_OFF, 3, MIDI_CC_OMNI_OFF, 0);
+    TEST_ASSERT_EQUAL_HEX16(0xFFF7, state.omni);
+    send(&state, MIDI_MESSAGE_OMNI_ON, 3, MIDI_CC_OMNI_ON, 0);
+    TEST_ASSERT_EQUAL_HEX16(0xFFFF, state.omni);
+
+    send(&state, MIDI_MESSAGE_LOCAL_CONTROL, 4, MIDI_CC_LOCAL_CONTROL, 0);
+    TEST_ASSERT_EQUAL_HEX16(0xFFEF, state.local_control);
+    send(&state, MIDI_MESSAGE_LOCAL_CONTROL, 4, MIDI_CC_LOCAL_CONTROL, 127);
+    TEST_ASSERT_EQUAL_HEX16(0xFFFF, state.local_control);
+
+    /* Mode controllers are not stored as controller values */
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 4, 121, 5);
+    TEST_ASSERT_EQUAL(0, state.controllers[4][121]);
+}
+
+/**
+ * @brief Test that Reset All Controllers follows RP-015
+ */
+void test_state_reset_all_controllers(void)
+{
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 5, MIDI_CC_MOD_WHEEL, 90);
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 5, MIDI_CC_CHANNEL_VOLUME, 20);
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 5, MIDI_CC_PAN, 10);
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 5,
+         MIDI_CC_EXPRESSION_CONTROLLER, 40);
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 5, MIDI_CC_RPN_LSB, 0);
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 5, MIDI_CC_SOFT_PEDAL, 127);
+    send(&state, MIDI_MESSAGE_PROGRAM_CHANGE, 5, 33, 0);
+    send(&state, MIDI_MESSAGE_PITCH_BEND, 5, 0, 0);
+    send(&state, MIDI_MESSAGE_CHANNEL_PRESSURE, 5, 70, 0);
+    send(&state, MIDI_MESSAGE_KEY_PRESSURE, 5, 60, 50);
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 5, MIDI_CC_SUSTAIN_PEDAL, 127);
+    send(&state, MIDI_MESSAGE_NOTE_ON, 5, 60, 100);
+    send(&state, MIDI_MESSAGE_NOTE_OFF, 5, 60, 0);
+
+    send(&state, MIDI_MESSAGE_RESET_ALL_CONTROLLERS, 5,
+         MIDI_CC_RESET_ALL_CONTROLLERS, 0);
+
+    TEST_ASSERT_EQUAL(0, state.controllers[5][MIDI_CC_MOD_WHEEL]);
+    TEST_ASSERT_EQUAL(127, state.controllers[5][MIDI_CC_EXPRESSION_CONTROLLER]);
+    TEST_ASSERT_EQUAL(127, state.controllers[5][MIDI_CC_RPN_LSB]);
+    TEST_ASSERT_EQUAL(0, state.controllers[5][MIDI_CC_SOFT_PEDAL]);
+    TEST_ASSERT_EQUAL_HEX16(MIDI_STATE_PITCH_BEND_CENTER, state.pitch_bend[5]);
+    TEST_ASSERT_EQUAL(0, state.channel_pressure[5]);
+    TEST_ASSERT_EQUAL(0, state.key_pressure[5][60]);
+
+    /* Volume, pan and program are kept, and the pedal release ends notes */
+    TEST_ASSERT_EQUAL(20, state.controllers[5][MIDI_CC_CHANNEL_VOLUME]);
+    TEST_ASSERT_EQUAL(10, state.controllers[5][MIDI_CC_PAN]);
+    TEST_ASSERT_EQUAL(33, state.program[5]);
+    TEST_ASSERT_EQUAL(0, midi_state_count_notes(&state, 5));
+}
+
+/*=====================================================================*
+    Change Tracking Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test the order and content of a change list
+ */
+void test_state_changes(void)
+{
+    TEST_ASSERT_EQUAL(0, midi_state_changes(&state, changes, MAX_CHANGES));
+
+    send(&state, MIDI_MESSAGE_NOTE_ON, 0, 60, 100);
+    send(&state, MIDI_MESSAGE_NOTE_ON, 0, 64, 90);
+    midi_state_snapshot(&state);
+
+    send(&state, MIDI_MESSAGE_PITCH_BEND, 0, 0, 0x50);
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 0, MIDI_CC_PAN, 0);
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 0, MIDI_CC_MOD_WHEEL, 3);
+    send(&state, MIDI_MESSAGE_NOTE_OFF, 0, 60, 0);
+    send(&state, MIDI_MESSAGE_NOTE_ON, 0, 67, 80);
+
+    TEST_ASSERT_EQUAL(5, midi_state_changes(&state, changes, MAX_CHANGES));
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_OFF, changes[0].message_type);
+    TEST_ASSERT_EQUAL(60, changes[0].note);
+    TEST_ASSERT_EQUAL(MIDI_STATE_RELEASE_VELOCITY, changes[0].velocity);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_CONTROL_CHANGE, changes[1].message_type);
+    TEST_ASSERT_EQUAL(MIDI_CC_MOD_WHEEL, changes[1].controller);
+    TEST_ASSERT_EQUAL(3, changes[1].control_value);
+    TEST_ASSERT_EQUAL(MIDI_CC_PAN, changes[2].controller);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_PITCH_BEND, changes[3].message_type);
+    TEST_ASSERT_EQUAL_HEX16(0x2800, changes[3].pitch_bend);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_ON, changes[4].message_type);
+    TEST_ASSERT_EQUAL(67, changes[4].note);
+    TEST_ASSERT_EQUAL(80, changes[4].velocity);
+
+    /* Reading the changes consumes them */
+    TEST_ASSERT_EQUAL(0, midi_state_changes(&state, changes, MAX_CHANGES));
+
+    /* All Sound Off comes first and resends what still sounds */
+    send(&state, MIDI_MESSAGE_ALL_SOUND_OFF, 0, MIDI_CC_ALL_SOUND_OFF, 0);
+    send(&state, MIDI_MESSAGE_NOTE_ON, 0, 64, 90);
+    TEST_ASSERT_EQUAL(2, midi_state_changes(&state, changes, MAX_CHANGES));
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_ALL_SOUND_OFF, changes[0].message_type);
+    TEST_ASSERT_EQUAL(MIDI_CC_ALL_SOUND_OFF, changes[0].controller);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_ON, changes[1].message_type);
+    TEST_ASSERT_EQUAL(64, changes[1].note);
+
+    TEST_ASSERT_EQUAL(0, midi_state_changes(NULL, changes, MAX_CHANGES));
+}
+
+/**
+ * @brief Test that the sustain pedal is lifted before Note Off messages
+ */
+void test_state_changes_sustain(void)
+{
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 0, MIDI_CC_SUSTAIN_PEDAL, 127);
+    send(&state, MIDI_MESSAGE_NOTE_ON, 0, 60, 100);
+    midi_state_snapshot(&state);
+    send(&receiver, MIDI_MESSAGE_CONTROL_CHANGE, 0,
+         MIDI_CC_SUSTAIN_PEDAL, 127);
+    send(&receiver, MIDI_MESSAGE_NOTE_ON, 0, 60, 100);
+
+    /* The note ends while the pedal goes up and down again */
+    send(&state, MIDI_MESSAGE_NOTE_OFF, 0, 60, 0);
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 0, MIDI_CC_SUSTAIN_PEDAL, 0);
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 0, MIDI_CC_SUSTAIN_PEDAL, 127);
+
+    const size_t count = midi_state_changes(&state, changes, MAX_CHANGES);
+    TEST_ASSERT_EQUAL(3, count);
+    TEST_ASSERT_EQUAL(MIDI_CC_SUSTAIN_PEDAL, changes[0].controller);
+    TEST_ASSERT_EQUAL(0, changes[0].control_value);
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_OFF, changes[1].message_type);
+    TEST_ASSERT_EQUAL(MIDI_CC_SUSTAIN_PEDAL, changes[2].controller);
+    TEST_ASSERT_EQUAL(127, changes[2].control_value);
+
+    for (size_t i = 0; i < count; i++) {
+        midi_state_update(&receiver, &changes[i]);
+    }
+    assert_same_channels(&state, &receiver);
+}
+
+/**
+ * @brief Test that a random stream is mirrored by its change lists, read
+ *        a few messages at a time
+ */
+void test_state_changes_fuzz(void)
+{
+    midi_message_t chunk[3];
+
+    for (size_t i = 0; i < FUZZ_MESSAGES; i++) {
+        send_random(&state);
+
+        if ((next_random() & 0x1F) != 0) { continue; }
+
+        size_t count;
+        do {
+            count = midi_state_changes(&state, chunk, 3);
+            for (size_t c = 0; c < count; c++) {
+                midi_state_update(&receiver, &chunk[c]);
+            }
+        } while (count == 3);
+        midi_state_snapshot(&state);
+        assert_same_channels(&state, &receiver);
+    }
+}
+
+/*=====================================================================*
+    Notes Off Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test that the pedal is lifted before the held notes are released
+ *        and that only sounding notes are listed
+ */
+void test_state_notes_off(void)
+{
+    send(&state, MIDI_MESSAGE_NOTE_ON, 2, 60, 100);
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 2, MIDI_CC_SUSTAIN_PEDAL, 127);
+    send(&state, MIDI_MESSAGE_NOTE_OFF, 2, 60, 64);
+    send(&state, MIDI_MESSAGE_NOTE_ON, 2, 64, 100);
+    send(&state, MIDI_MESSAGE_NOTE_ON, 9, 36, 100);
+    send(&state, MIDI_MESSAGE_NOTE_ON, 9, 100, 100);
+
+    /* One message at a time resumes where the last call stopped */
+    TEST_ASSERT_EQUAL(1, midi_state_notes_off(&state, changes, 1));
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_CONTROL_CHANGE, changes[0].message_type);
+    TEST_ASSERT_EQUAL(2, changes[0].channel);
+    TEST_ASSERT_EQUAL(MIDI_CC_SUSTAIN_PEDAL, changes[0].controller);
+    TEST_ASSERT_EQUAL(0, changes[0].control_value);
+    TEST_ASSERT_FALSE(midi_state_is_note_on(&state, 2, 60));
+
+    TEST_ASSERT_EQUAL(3, midi_state_notes_off(&state, changes, MAX_CHANGES));
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_OFF, changes[0].message_type);
+    TEST_ASSERT_EQUAL(2, changes[0].channel);
+    TEST_ASSERT_EQUAL(64, changes[0].note);
+    TEST_ASSERT_EQUAL(MIDI_STATE_RELEASE_VELOCITY, changes[0].velocity);
+    TEST_ASSERT_EQUAL(9, changes[1].channel);
+    TEST_ASSERT_EQUAL(36, changes[1].note);
+    TEST_ASSERT_EQUAL(9, changes[2].channel);
+    TEST_ASSERT_EQUAL(100, changes[2].note);
+    TEST_ASSERT_EQUAL_HEX16(0, state.active_channels);
+
+    /* Nothing left to stop, and a pedal without notes stays down */
+    send(&state, MIDI_MESSAGE_CONTROL_CHANGE, 5, MIDI_CC_SUSTAIN_PEDAL, 127);
+    TEST_ASSERT_EQUAL(0, midi_state_notes_off(&state, changes, MAX_CHANGES));
+    TEST_ASSERT_EQUAL(0, midi_state_notes_off(NULL, changes, MAX_CHANGES));
+    TEST_ASSERT_EQUAL(0, midi_state_notes_off(&state, NULL, MAX_CHANGES));
+}
+
+/**
+ * @brief Test that the messages silence a receiver of a random stream,
+ *        with at most one message per note and one per channel
+ */
+void test_state_notes_off_fuzz(void)
+{
+    midi_message_t chunk[2];
+
+    for (size_t round = 0; round < 200; round++) {
+        for (size_t i = 0; i < 100; i++) { send_random(&state); }
+
+        /* The receiver got the same stream */
+        receiver = state;
+
+        size_t count;
+        size_t sounding = 0;
+        for (size_t channel = 0; channel < MIDI_STATE_CHANNELS; channel++) {
+            sounding += midi_state_count_notes(&state, channel);
+        }
+
+        size_t total = 0;
+        while ((count = midi_state_notes_off(&state, chunk, 2)) > 0) {
+            for (size_t c = 0; c < count; c++) {
+                midi_state_update(&receiver, &chunk[c]);
+            }
+            total += count;
+        }
+        TEST_ASSERT_LESS_OR_EQUAL(sounding + MIDI_STATE_CHANNELS, total);
+        TEST_ASSERT_EQUAL_HEX16(0, state.active_channels);
+        TEST_ASSERT_EQUAL_HEX16(0, receiver.active_channels);
+        assert_same_channels(&state, &receiver);
+    }
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Notes
+    RUN_TEST(test_state_notes);
+    RUN_TEST(test_state_sustain);
+
+    // Channel Mode
+    RUN_TEST(test_state_mode_messages);
+    RUN_TEST(test_state_reset_all_controllers);
+
+    // Change Tracking
+    RUN_TEST(test_state_changes);
+    RUN_TEST(test_state_changes_sustain);
+    RUN_TEST(test_state_changes_fuzz);
+
+    // Notes Off
+    RUN_TEST(test_state_notes_off);
+    RUN_TEST(test_state_notes_off_fuzz);
+
+    return UNITY_END();
+}
@@ -0,0 +1,299 @@
+/***********************************************************************
+ * @file test_midi_stats.c
+ * @brief Unit tests for the parser statistics
+ *
+ * @details This test is built with midi.c compiled in directly with
+ *          MIDI_CONFIG_STATS set, so that the counters are tested
+ *          whatever the configuration of the library.
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define STREAM_SIZE (20000)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static midi_parser_t parser;
+static midi_parser_stats_t stats;
+static uint8_t stream[STREAM_SIZE];
+static midi_message_t messages[STREAM_SIZE];
+static midi_packed_t packed[STREAM_SIZE];
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    midi_parser_init(&parser);
+    memset(&stats, 0, sizeof(stats));
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Generate a pseudo random stream of status and data bytes
+ * @details One in eight bytes is a status byte
+ */
+static void generate_stream(uint8_t *bytes, size_t length)
+{
+    uint32_t state = 0x2545F491;
+
+    for (size_t i = 0; i < length; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        bytes[i] = ((state & 0x07) == 0) ? (uint8_t)(0x80 | (state >> 8))
+                                         : (uint8_t)((state >> 8) & 0x7F);
+    }
+}
+
+/**
+ * @brief Parse a stream one byte at a time
+ */
+static void parse_bytewise(midi_parser_t *p, const uint8_t *bytes, size_t n)
+{
+    midi_message_t message;
+
+    for (size_t i = 0; i < n; i++) { midi_parse_byte(p, bytes[i], &message); }
+}
+
+/**
+ * @brief Get the message counter of a message type
+ */
+static uint32_t messages_of(midi_message_type_t message_type)
+{
+    return stats.messages[midi_stats_type_index(message_type)];
+}
+
+static void ignore_realtime(void *context, const midi_realtime_event_t *e)
+{
+    (void)context;
+    (void)e;
+}
+
+static void ignore_message(void *context, const midi_message_t *m)
+{
+    (void)context;
+    (void)m;
+}
+
+/*=====================================================================*
+    Counter Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test that every message type has its own counter
+ */
+void test_stats_type_index(void)
+{
+    uint32_t used = 0;
+    const midi_message_type_t types[] = {MIDI_MESSAGE_NOTE_OFF,
+                                         MIDI_MESSAGE_NOTE_ON,
+                                         MIDI_MESSAGE_KEY_PRESSURE,
+                                         MIDI_MESSAGE_CONTROL_CHANGE,
+                                         MIDI_MESSAGE_PROGRAM_CHANGE,
+                                         MIDI_MESSAGE_CHANNEL_PRESSURE,
+                                         MIDI_MESSAGE_PITCH_BEND};
+
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        const size_t index = midi_stats_type_index(types[i]);
+        TEST_ASSERT_LESS_THAN(MIDI_STATS_MESSAGE_TYPES, index);
+        TEST_ASSERT_FALSE(used & (1u << index));
+        used |= 1u << index;
+    }
+    for (int type = MIDI_MESSAGE_ALL_SOUND_OFF; type <= 0xFF; type++) {
+        if (type == 0x80) { type = MIDI_MESSAGE_SYSTEM_EXCLUSIVE; }
+        const size_t index =
+            midi_stats_type_index((midi_message_type_t)type);
+        TEST_ASSERT_LESS_THAN(MIDI_STATS_MESSAGE_TYPES, index);
+        TEST_ASSERT_FALSE(used & (1u << index));
+        used |= 1u << index;
+    }
+    TEST_ASSERT_EQUAL_HEX32(0x7FFFFFFF, used);
+}
+
+/**
+ * @brief Test each counter on a hand written stream
+ */
+void test_stats_counters(void)
+{
+    const uint8_t input[] = {
+        0x40, 0x41,             /* Orphaned data bytes */
+        0x90, 60,   100,  62,   0, /* Note On, Note Off */
+        0xB0, 7,    0x90,       /* Control Change cut short */
+        64,   0xF4, 0xFD, 70,   /* Undefined bytes inside a Note On */
+        0xF0, 1,    2,    3,    0xF7, /* SysEx of three bytes */
+        0xF0, 4,    0xC1, 5,    /* SysEx cut by Program Change */
+        0xF8, 0xF2, 1,    2,    9, /* Clock, Song Position, orphan */
+    };
+
+    parse_bytewise(&parser, input, sizeof(input));
+    midi_parser_get_stats(&parser, &stats);
+
+    TEST_ASSERT_EQUAL_UINT32(sizeof(input), stats.bytes);
+    TEST_ASSERT_EQUAL_UINT32(2, messages_of(MIDI_MESSAGE_NOTE_ON));
+    TEST_ASSERT_EQUAL_UINT32(1, messages_of(MIDI_MESSAGE_NOTE_OFF));
+    TEST_ASSERT_EQUAL_UINT32(0, messages_of(MIDI_MESSAGE_CONTROL_CHANGE));
+    TEST_ASSERT_EQUAL_UINT32(1, messages_of(MIDI_MESSAGE_PROGRAM_CHANGE));
+    TEST_ASSERT_EQUAL_UINT32(2, messages_of(MIDI_MESSAGE_SYSTEM_EXCLUSIVE));
+    TEST_ASSERT_EQUAL_UINT32(1, messages_of(MIDI_MESSAGE_END_OF_EXCLUSIVE));
+    TEST_ASSERT_EQUAL_UINT32(1, messages_of(MIDI_MESSAGE_TIMING_CLOCK));
+    TEST_ASSERT_EQUAL_UINT32(1,
+                             messages_of(MIDI_MESSAGE_SONG_POSITION_POINTER));
+    TEST_ASSERT_EQUAL_UINT32(3, stats.orphaned_data_bytes);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.interrupted_messages);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.undefined_status_bytes);
+    TEST_ASSERT_EQUAL_UINT32(4, stats.sysex_bytes);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.buffer_overflows);
+}
+
+/**
+ * @brief Test that the buffer parsers count exactly like midi_parse_byte
+ */
+void test_stats_buffer_matches_parse_byte(void)
+{
+    static const size_t chunks[] = {1, 7, 200, STREAM_SIZE};
+    midi_parser_stats_t expected;
+    midi_parser_stats_t actual;
+    midi_dispatcher_t dispatcher;
+
+    generate_stream(stream, STREAM_SIZE);
+    parse_bytewise(&parser, stream, STREAM_SIZE);
+    midi_parser_get_stats(&parser, &expected);
+    TEST_ASSERT_EQUAL_UINT32(STREAM_SIZE, expected.bytes);
+    TEST_ASSERT_GREATER_THAN(0, expected.orphaned_data_bytes);
+    TEST_ASSERT_GREATER_THAN(0, expected.interrupted_messages);
+    TEST_ASSERT_GREATER_THAN(0, expected.sysex_bytes);
+
+    midi_dispatcher_init(&dispatcher, NULL);
+    for (int type = 0; type < 256; type++) {
+        midi_dispatcher_set_handler(
+            &dispatcher, (midi_message_type_t)type, ignore_message);
+    }
+
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        for (int format = 0; format < 4; format++) {
+            midi_parser_init(&parser);
+            if (format == 3) {
+                midi_parser_set_realtime_handler(
+                    &parser, ignore_realtime, NULL, NULL);
+            }
+            for (size_t offset = 0; offset < STREAM_SIZE;
+                 offset += chunks[c]) {
+                size_t size = STREAM_SIZE - offset;
+                if (size > chunks[c]) { size = chunks[c]; }
+                if (format == 0 || format == 3) {
+                    midi_parse_buffer(&parser, &stream[offset], size,
+                                      messages, size, NULL);
+                } else if (format == 1) {
+                    midi_parse_buffer_packed(&parser, &stream[offset], size,
+                                             packed, size, NULL);
+                } else {
+                    midi_parse_buffer_dispatch(
+                        &parser, &dispatcher, &stream[offset], size);
+                }
+            }
+            midi_parser_get_stats(&parser, &actual);
+            TEST_ASSERT_EQUAL_MEMORY(&expected, &actual, sizeof(expected));
+        }
+    }
+}
+
+/**
+ * @brief Test that filtered messages are not counted
+ */
+void test_stats_filtered(void)
+{
+    const uint8_t input[] = {0x90, 60, 100, 62, 0, 0xC0, 1, 2, 3, 4};
+
+    midi_parser_set_message_enabled(&parser, MIDI_MESSAGE_NOTE_OFF, 0);
+    midi_parser_set_message_enabled(&parser, MIDI_MESSAGE_PROGRAM_CHANGE, 0);
+    TEST_ASSERT_EQUAL(1, midi_parse_buffer_packed(&parser, input,
+                                                  sizeof(input), packed,
+                                                  sizeof(input), NULL));
+    midi_parser_get_stats(&parser, &stats);
+    TEST_ASSERT_EQUAL_UINT32(1, messages_of(MIDI_MESSAGE_NOTE_ON));
+    TEST_ASSERT_EQUAL_UINT32(0, messages_of(MIDI_MESSAGE_NOTE_OFF));
+    TEST_ASSERT_EQUAL_UINT32(4, stats.orphaned_data_bytes);
+}
+
+/*=====================================================================*
+    Snapshot Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test merging, resetting and NULL handling
+ */
+void test_stats_merge_and_reset(void)
+{
+    const uint8_t input[] = {0x90, 60, 100, 0xF4, 7};
+    midi_parser_t other;
+    midi_parser_stats_t total;
+
+    midi_parser_init(&other);
+    parse_bytewise(&parser, input, sizeof(input));
+    parse_bytewise(&other, input, 3);
+
+    memset(&total, 0, sizeof(total));
+    midi_parser_get_stats(&parser, &stats);
+    midi_parser_stats_merge(&total, &stats);
+    midi_parser_get_stats(&other, &stats);
+    midi_parser_stats_merge(&total, &stats);
+    TEST_ASSERT_EQUAL_UINT32(8, total.bytes);
+    TEST_ASSERT_EQUAL_UINT32(
+        2, total.messages[midi_stats_type_index(MIDI_MESSAGE_NOTE_ON)]);
+    TEST_ASSERT_EQUAL_UINT32(1, total.undefined_status_bytes);
+
+    /* Resetting the parser keeps the counters */
+    midi_parser_reset(&parser);
+    midi_parser_get_stats(&parser, &stats);
+    TEST_ASSERT_EQUAL_UINT32(5, stats.bytes);
+    midi_parser_reset_stats(&parser);
+    midi_parser_get_stats(&parser, &stats);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.bytes);
+    TEST_ASSERT_EQUAL_UINT32(0, messages_of(MIDI_MESSAGE_NOTE_ON));
+
+    /* NULL pointer handling */
+    midi_parser_get_stats(NULL, &stats);
+    midi_parser_get_stats(&parser, NULL);
+    midi_parser_reset_stats(NULL);
+    midi_parser_stats_merge(NULL, &stats);
+    midi_parser_stats_merge(&total, NULL);
+    TEST_ASSERT_EQUAL_UINT32(8, total.bytes);
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Counters
+    RUN_TEST(test_stats_type_index);
+    RUN_TEST(test_stats_counters);
+    RUN_TEST(test_stats_buffer_matches_parse_byte);
+    RUN_TEST(test_stats_filtered);
+
+    // Snapshots
+    RUN_TEST(test_stats_merge_and_reset);
+
+    return UNITY_END();
+}
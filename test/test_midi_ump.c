@@ -0,0 +1,556 @@
+/***********************************************************************
+ * @file test_midi_ump.c
+ * @brief Unit tests for the MIDI 1.0 to UMP translation module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_ump.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define MAX_MESSAGES (1024)
+#define MAX_WORDS (2 * MAX_MESSAGES)
+#define MAX_BYTES (256)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static midi_ump_encoder_t encoder;
+static midi_ump_decoder_t decoder;
+static uint32_t words[MAX_WORDS];
+static midi_packed_t expected[MAX_MESSAGES];
+static midi_packed_t messages[MAX_MESSAGES];
+static uint8_t groups[MAX_MESSAGES];
+#if MIDI_CONFIG_SYSEX
+static uint32_t span_words[MAX_WORDS];
+static size_t span_word_count;
+#endif
+static uint32_t random_state;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    midi_ump_encoder_init(&encoder, 0, MIDI_UMP_PROTOCOL_MIDI1);
+    midi_ump_decoder_init(&decoder);
+#if MIDI_CONFIG_SYSEX
+    span_word_count = 0;
+#endif
+    random_state = 0x2545F491;
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Next pseudo random number
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief Fill the expected messages with random defined messages
+ * @param [in] channel_only Non-zero for Channel Voice and Channel Mode
+ *      messages that round trip through Message Type 4 unchanged
+ * @return The number of messages
+ */
+static size_t random_messages(int channel_only)
+{
+    size_t count = 0;
+
+    while (count < MAX_MESSAGES) {
+        const uint32_t r = next_random();
+        midi_message_t message;
+        const uint8_t status = (uint8_t)(0x80 | (r >> 24));
+        const uint8_t data1 = (uint8_t)(r >> 8) & 0x7F;
+
+        if (status == MIDI_MESSAGE_SYSTEM_EXCLUSIVE
+            || status == MIDI_MESSAGE_END_OF_EXCLUSIVE
+            || midi_decode_message(status, data1, (uint8_t)r, &message)
+                   == MIDI_MESSAGE_NONE) {
+            continue;
+        }
+        if (channel_only) {
+            const uint8_t kind = status & 0xF0;
+            if (kind == 0xF0
+                || (kind == MIDI_MESSAGE_NOTE_ON && message.velocity == 0)
+                || (kind == MIDI_MESSAGE_CONTROL_CHANGE
+                    && (data1 == MIDI_CC_BANK_SELECT
+                        || data1 == MIDI_CC_BANK_SELECT_LSB
+                        || data1 == MIDI_CC_DATA_ENTRY_MSB
+                        || data1 == MIDI_CC_DATA_ENTRY_LSB
+                        || (data1 >= MIDI_CC_DATA_INCREMENT
+                            && data1 <= MIDI_CC_RPN_MSB)))) {
+                continue;
+            }
+        }
+        expected[count++] = midi_message_pack(&message);
+    }
+    return count;
+}
+
+#if MIDI_CONFIG_SYSEX
+/**
+ * @brief SysEx handler that translates the spans of the parser
+ */
+static void translate_span(void *context, const midi_sysex_span_t *span)
+{
+    (void)context;
+    const size_t written =
+        midi_ump_from_sysex_span(&encoder, span, &span_words[span_word_count],
+                                 MAX_WORDS - span_word_count);
+
+    TEST_ASSERT_TRUE(written > 0 || !(span->flags & MIDI_SYSEX_FLAG_END));
+    span_word_count += written;
+}
+#endif
+
+/*=====================================================================*
+    Scaling Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test the Min-Center-Max values and that downscaling inverts
+ *        upscaling
+ */
+void test_ump_scaling(void)
+{
+    TEST_ASSERT_EQUAL_HEX32(0x00000000, midi_ump_scale_7_to_32(0x00));
+    TEST_ASSERT_EQUAL_HEX32(0x80000000, midi_ump_scale_7_to_32(0x40));
+    TEST_ASSERT_EQUAL_HEX32(0x82082082, midi_ump_scale_7_to_32(0x41));
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFF, midi_ump_scale_7_to_32(0x7F));
+    TEST_ASSERT_EQUAL_HEX16(0x8000, midi_ump_scale_7_to_16(0x40));
+    TEST_ASSERT_EQUAL_HEX16(0xFFFF, midi_ump_scale_7_to_16(0x7F));
+    TEST_ASSERT_EQUAL_HEX32(0x00040000, midi_ump_scale_14_to_32(0x0001));
+    TEST_ASSERT_EQUAL_HEX32(0x80000000, midi_ump_scale_14_to_32(0x2000));
+    TEST_ASSERT_EQUAL_HEX32(0x80040020, midi_ump_scale_14_to_32(0x2001));
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFF, midi_ump_scale_14_to_32(0x3FFF));
+
+    for (uint8_t value = 0; value < 0x80; value++) {
+        TEST_ASSERT_EQUAL(value, midi_ump_scale_7_to_32(value) >> 25);
+        TEST_ASSERT_EQUAL(value, midi_ump_scale_7_to_16(value) >> 9);
+    }
+    for (uint16_t value = 0; value < 0x4000; value++) {
+        TEST_ASSERT_EQUAL(value, midi_ump_scale_14_to_32(value) >> 18);
+    }
+}
+
+/**
+ * @brief Test the packet size of each message type
+ */
+void test_ump_packet_words(void)
+{
+    const size_t reference[16] = {1, 1, 1, 2, 2, 4, 1, 1,
+                                  2, 2, 2, 3, 3, 4, 4, 4};
+
+    for (uint32_t type = 0; type < 16; type++) {
+        TEST_ASSERT_EQUAL(reference[type],
+                          midi_ump_packet_words(type << 28 | 0x0ABCDEF));
+    }
+    TEST_ASSERT_EQUAL(MIDI_UMP_TYPE_DATA_64,
+                      midi_ump_packet_type(0x37123456));
+    TEST_ASSERT_EQUAL(7, midi_ump_packet_group(0x37123456));
+}
+
+/*=====================================================================*
+    Translation Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test that Message Type 1 and 2 packets round trip every message
+ */
+void test_ump_midi1_round_trip(void)
+{
+    const size_t count = random_messages(0);
+    const midi_packed_t unsent[] = {
+        midi_packed_make(MIDI_MESSAGE_SYSTEM_EXCLUSIVE, MIDI_CHANNEL_NONE, 0,
+                         0),
+        midi_packed_make(MIDI_MESSAGE_NONE, MIDI_CHANNEL_NONE, 0, 0),
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_NONE, 0x3C, 0x40),
+    };
+    size_t consumed = 0;
+
+    TEST_ASSERT_EQUAL(0, midi_ump_from_packed(&encoder, unsent, 3, words,
+                                              MAX_WORDS, &consumed));
+    TEST_ASSERT_EQUAL(3, consumed);
+
+    midi_ump_encoder_init(&encoder, 3, MIDI_UMP_PROTOCOL_MIDI1);
+    TEST_ASSERT_EQUAL(count, midi_ump_from_packed(&encoder, expected, count,
+                                                  words, MAX_WORDS,
+                                                  &consumed));
+    TEST_ASSERT_EQUAL(count, consumed);
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t type =
+            midi_packed_type(expected[i]) >= MIDI_MESSAGE_SYSTEM_EXCLUSIVE
+                ? MIDI_UMP_TYPE_SYSTEM
+                : MIDI_UMP_TYPE_MIDI1_CHANNEL_VOICE;
+        TEST_ASSERT_EQUAL(type, midi_ump_packet_type(words[i]));
+        TEST_ASSERT_EQUAL(3, midi_ump_packet_group(words[i]));
+    }
+
+    TEST_ASSERT_EQUAL(count, midi_ump_to_packed(&decoder, words, count,
+                                                groups, messages,
+                                                MAX_MESSAGES, &consumed));
+    TEST_ASSERT_EQUAL(count, consumed);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(expected, messages, count);
+    TEST_ASSERT_EQUAL(3, groups[count - 1]);
+
+    /* Channel Mode messages are Control Changes on the wire */
+    const midi_packed_t mode[] = {
+        midi_packed_make(MIDI_MESSAGE_ALL_NOTES_OFF, MIDI_CHANNEL_6, 0x7B, 0),
+        midi_packed_make(MIDI_MESSAGE_TIMING_CLOCK, MIDI_CHANNEL_NONE, 0, 0),
+    };
+    TEST_ASSERT_EQUAL(2, midi_ump_from_packed(&encoder, mode, 2, words,
+                                              MAX_WORDS, NULL));
+    TEST_ASSERT_EQUAL_HEX32(0x23B57B00, words[0]);
+    TEST_ASSERT_EQUAL_HEX32(0x13F80000, words[1]);
+}
+
+/**
+ * @brief Test the packets of MIDI 2.0 Channel Voice messages and their
+ *        translation back
+ */
+void test_ump_midi2_channel_voice(void)
+{
+    const midi_packed_t input[] = {
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_2, 0x3C, 0x40),
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_2, 0x3C, 0x00),
+        midi_packed_make(MIDI_MESSAGE_KEY_PRESSURE, MIDI_CHANNEL_2, 0x3C,
+                         0x7F),
+        midi_packed_make(
+            MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1, 0x07, 0x64),
+        midi_packed_make(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1,
+                         MIDI_CC_BANK_SELECT, 0x01),
+        midi_packed_make(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1,
+                         MIDI_CC_BANK_SELECT_LSB, 0x02),
+        midi_packed_make(MIDI_MESSAGE_PROGRAM_CHANGE, MIDI_CHANNEL_1, 0x05, 0),
+        midi_packed_make(MIDI_MESSAGE_PROGRAM_CHANGE, MIDI_CHANNEL_3, 0x06, 0),
+        midi_packed_make(
+            MIDI_MESSAGE_CHANNEL_PRESSURE, MIDI_CHANNEL_3, 0x40, 0),
+        midi_packed_make(MIDI_MESSAGE_PITCH_BEND, MIDI_CHANNEL_3, 0x00, 0x40),
+        midi_packed_make(MIDI_MESSAGE_TIMING_CLOCK, MIDI_CHANNEL_NONE, 0, 0),
+    };
+    const uint32_t reference[] = {
+        0x45913C00, 0x80000000, /* Note On */
+        0x45813C00, 0x80000000, /* Note On with velocity 0 */
+        0x45A13C00, 0xFFFFFFFF, /* Key Pressure */
+        0x45B00700, 0xC9249249, /* Control Change */
+        0x45C00001, 0x05000102, /* Program Change with the bank */
+        0x45C20000, 0x06000000, /* Program Change */
+        0x45D20000, 0x80000000, /* Channel Pressure */
+        0x45E20000, 0x80000000, /* Pitch Bend */
+        0x15F80000,             /* Timing Clock */
+    };
+    const size_t input_count = sizeof(input) / sizeof(input[0]);
+    const size_t reference_count = sizeof(reference) / sizeof(reference[0]);
+    size_t consumed = 0;
+
+    midi_ump_encoder_init(&encoder, 5, MIDI_UMP_PROTOCOL_MIDI2);
+
+    /* A packet is only started when all of its words fit */
+    TEST_ASSERT_EQUAL(0, midi_ump_from_packed(&encoder, input, input_count,
+                                              words, 1, &consumed));
+    TEST_ASSERT_EQUAL(0, consumed);
+
+    TEST_ASSERT_EQUAL(reference_count,
+                      midi_ump_from_packed(&encoder, input, input_count,
+                                           words, MAX_WORDS, &consumed));
+    TEST_ASSERT_EQUAL(input_count, consumed);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(reference, words, reference_count);
+
+    /* Bank Select comes back ahead of its Program Change */
+    memcpy(expected, input, sizeof(input));
+    expected[1] =
+        midi_packed_make(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_2, 0x3C, 0x40);
+    TEST_ASSERT_EQUAL(input_count,
+                      midi_ump_to_packed(&decoder, words, reference_count,
+                                         groups, messages, MAX_MESSAGES,
+                                         &consumed));
+    TEST_ASSERT_EQUAL(reference_count, consumed);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(expected, messages, input_count);
+    TEST_ASSERT_EQUAL(5, groups[0]);
+
+    /* A Note On velocity that downscales to 0 keeps the note on */
+    const uint32_t soft[] = {0x40903C00, 0x01000000};
+    TEST_ASSERT_EQUAL(1, midi_ump_to_packed(&decoder, soft, 2, NULL,
+                                            messages, MAX_MESSAGES, NULL));
+    TEST_ASSERT_EQUAL_HEX32(
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 0x3C, 0x01),
+        messages[0]);
+}
+
+/**
+ * @brief Test that Message Type 4 packets round trip channel messages
+ */
+void test_ump_midi2_round_trip(void)
+{
+    const size_t count = random_messages(1);
+    size_t consumed = 0;
+
+    midi_ump_encoder_init(&encoder, 0, MIDI_UMP_PROTOCOL_MIDI2);
+    TEST_ASSERT_EQUAL(2 * count,
+                      midi_ump_from_packed(&encoder, expected, count, words,
+                                           MAX_WORDS, &consumed));
+    TEST_ASSERT_EQUAL(count, consumed);
+
+    TEST_ASSERT_EQUAL(count, midi_ump_to_packed(&decoder, words, 2 * count,
+                                                NULL, messages,
+                                                MAX_MESSAGES, &consumed));
+    TEST_ASSERT_EQUAL(2 * count, consumed);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(expected, messages, count);
+}
+
+/**
+ * @brief Test RPN and NRPN changes as Registered and Assignable
+ *        Controllers
+ */
+void test_ump_registered_controllers(void)
+{
+    const midi_channel_t ch = MIDI_CHANNEL_1;
+    const midi_message_type_t cc = MIDI_MESSAGE_CONTROL_CHANGE;
+    const midi_packed_t input[] = {
+        midi_packed_make(cc, ch, MIDI_CC_RPN_MSB, 0x00),
+        midi_packed_make(cc, ch, MIDI_CC_RPN_LSB, 0x02),
+        midi_packed_make(cc, ch, MIDI_CC_DATA_ENTRY_MSB, 0x40),
+        midi_packed_make(cc, ch, MIDI_CC_DATA_ENTRY_LSB, 0x10),
+        midi_packed_make(cc, ch, MIDI_CC_DATA_INCREMENT, 0x00),
+        midi_packed_make(cc, ch, MIDI_CC_NRPN_MSB, 0x01),
+        midi_packed_make(cc, ch, MIDI_CC_NRPN_LSB, 0x03),
+        midi_packed_make(cc, ch, MIDI_CC_DATA_ENTRY_MSB, 0x7F),
+        midi_packed_make(cc, ch, MIDI_CC_DATA_DECREMENT, 0x00),
+    };
+    const uint32_t reference[] = {
+        0x40200002, 0x80000000, /* RPN 0x0002 = 0x2000 */
+        0x40200002, 0x80400200, /* RPN 0x0002 = 0x2010 */
+        0x40400002, 0x00040000, /* RPN 0x0002 + 1 */
+        0x40300103, 0xFE03F01F, /* NRPN 0x0083 = 0x3F80 */
+        0x40500103, 0xFFFC0000, /* NRPN 0x0083 - 1 */
+    };
+    const midi_packed_t translated[] = {
+        midi_packed_make(cc, ch, MIDI_CC_RPN_MSB, 0x00),
+        midi_packed_make(cc, ch, MIDI_CC_RPN_LSB, 0x02),
+        midi_packed_make(cc, ch, MIDI_CC_DATA_ENTRY_MSB, 0x40),
+        midi_packed_make(cc, ch, MIDI_CC_DATA_ENTRY_LSB, 0x00),
+        midi_packed_make(cc, ch, MIDI_CC_DATA_ENTRY_MSB, 0x40),
+        midi_packed_make(cc, ch, MIDI_CC_DATA_ENTRY_LSB, 0x10),
+        midi_packed_make(cc, ch, MIDI_CC_DATA_INCREMENT, 0x00),
+        midi_packed_make(cc, ch, MIDI_CC_NRPN_MSB, 0x01),
+        midi_packed_make(cc, ch, MIDI_CC_NRPN_LSB, 0x03),
+        midi_packed_make(cc, ch, MIDI_CC_DATA_ENTRY_MSB, 0x7F),
+        midi_packed_make(cc, ch, MIDI_CC_DATA_ENTRY_LSB, 0x00),
+        midi_packed_make(cc, ch, MIDI_CC_DATA_DECREMENT, 0x00),
+    };
+    const size_t reference_count = sizeof(reference) / sizeof(reference[0]);
+    const size_t translated_count =
+        sizeof(translated) / sizeof(translated[0]);
+
+    midi_ump_encoder_init(&encoder, 0, MIDI_UMP_PROTOCOL_MIDI2);
+    TEST_ASSERT_EQUAL(reference_count,
+                      midi_ump_from_packed(&encoder, input,
+                                           sizeof(input) / sizeof(input[0]),
+                                           words, MAX_WORDS, NULL));
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(reference, words, reference_count);
+
+    /* The selection is only sent when the parameter changes */
+    TEST_ASSERT_EQUAL(translated_count,
+                      midi_ump_to_packed(&decoder, words, reference_count,
+                                         NULL, messages, MAX_MESSAGES,
+                                         NULL));
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(translated, messages, translated_count);
+
+    /* The four messages of a change fit or the packet waits */
+    size_t consumed = 0;
+    midi_ump_decoder_reset(&decoder);
+    TEST_ASSERT_EQUAL(0, midi_ump_to_packed(&decoder, words, 2, NULL,
+                                            messages, 3, &consumed));
+    TEST_ASSERT_EQUAL(0, consumed);
+
+    /* A selection sent as a Control Change replaces the tracked one */
+    const uint32_t reselect[] = {0x20B06500, 0x40200002, 0x80000000};
+    TEST_ASSERT_EQUAL(5, midi_ump_to_packed(&decoder, reselect, 3, NULL,
+                                            messages, MAX_MESSAGES,
+                                            &consumed));
+    TEST_ASSERT_EQUAL(3, consumed);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(translated, &messages[1], 4);
+}
+
+/**
+ * @brief Test System Exclusive messages as Message Type 3 packets
+ */
+void test_ump_sysex(void)
+{
+    uint8_t payload[20];
+    const uint8_t bad[] = {0x01, 0x90};
+
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)(i + 1);
+    }
+
+    /* Start, continue and end packets, and a complete one */
+    TEST_ASSERT_EQUAL(6, midi_ump_from_sysex(2, payload, 14, words, 6));
+    TEST_ASSERT_EQUAL_HEX32(0x32160102, words[0]);
+    TEST_ASSERT_EQUAL_HEX32(0x03040506, words[1]);
+    TEST_ASSERT_EQUAL_HEX32(0x32260708, words[2]);
+    TEST_ASSERT_EQUAL_HEX32(0x32320D0E, words[4]);
+    TEST_ASSERT_EQUAL_HEX32(0x00000000, words[5]);
+    TEST_ASSERT_EQUAL(2, midi_ump_from_sysex(2, NULL, 0, words, 2));
+    TEST_ASSERT_EQUAL_HEX32(0x32000000, words[0]);
+    TEST_ASSERT_EQUAL(0, midi_ump_from_sysex(2, payload, 14, words, 5));
+    TEST_ASSERT_EQUAL(0, midi_ump_from_sysex(16, payload, 14, words, 6));
+    TEST_ASSERT_EQUAL(0, midi_ump_from_sysex(2, bad, 2, words, 2));
+}
+
+#if MIDI_CONFIG_SYSEX
+/**
+ * @brief Test that the SysEx spans of a parsed stream give the same
+ *        Message Type 3 packets
+ */
+void test_ump_sysex_spans(void)
+{
+    uint8_t payload[20];
+    uint8_t stream[64];
+    uint8_t bytes[MAX_BYTES];
+    uint32_t reference[MIDI_UMP_SYSEX7_WORDS(20)];
+    size_t length = 0;
+
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)(i + 1);
+    }
+
+    /* A complete message interrupted by a clock */
+    stream[length++] = MIDI_MESSAGE_SYSTEM_EXCLUSIVE;
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        if (i == 9) { stream[length++] = MIDI_MESSAGE_TIMING_CLOCK; }
+        stream[length++] = payload[i];
+    }
+    stream[length++] = MIDI_MESSAGE_END_OF_EXCLUSIVE;
+
+    /* Then a message aborted by a Note On */
+    stream[length++] = MIDI_MESSAGE_SYSTEM_EXCLUSIVE;
+    memcpy(&stream[length], payload, 8);
+    length += 8;
+    stream[length++] = 0x90;
+    stream[length++] = 0x3C;
+    stream[length++] = 0x40;
+
+    midi_parser_t parser;
+    midi_parser_init(&parser);
+    midi_parser_set_sysex_handler(&parser, translate_span, NULL);
+    midi_ump_encoder_init(&encoder, 2, MIDI_UMP_PROTOCOL_MIDI1);
+    for (size_t offset = 0; offset < length; offset += 5) {
+        const size_t chunk = length - offset < 5 ? length - offset : 5;
+        midi_parse_buffer_packed(&parser, &stream[offset], chunk, messages,
+                                 MAX_MESSAGES, NULL);
+    }
+
+    TEST_ASSERT_EQUAL(MIDI_UMP_SYSEX7_WORDS(20) + MIDI_UMP_SYSEX7_WORDS(8),
+                      span_word_count);
+    TEST_ASSERT_EQUAL(sizeof(reference) / sizeof(reference[0]),
+                      midi_ump_from_sysex(2, payload, 20, reference,
+                                          MIDI_UMP_SYSEX7_WORDS(20)));
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(reference, span_words,
+                                  MIDI_UMP_SYSEX7_WORDS(20));
+    TEST_ASSERT_EQUAL_HEX32(0x32160102, span_words[8]);
+    TEST_ASSERT_EQUAL_HEX32(0x32320708, span_words[10]);
+
+    /* And translate back to the bytes of the complete message */
+    span_word_count = MIDI_UMP_SYSEX7_WORDS(20);
+    size_t consumed = 0;
+    TEST_ASSERT_EQUAL(22, midi_ump_to_bytes(&decoder, span_words,
+                                            span_word_count, bytes,
+                                            MAX_BYTES, &consumed));
+    TEST_ASSERT_EQUAL(span_word_count, consumed);
+    TEST_ASSERT_EQUAL_HEX8(MIDI_MESSAGE_SYSTEM_EXCLUSIVE, bytes[0]);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(payload, &bytes[1], sizeof(payload));
+    TEST_ASSERT_EQUAL_HEX8(MIDI_MESSAGE_END_OF_EXCLUSIVE, bytes[21]);
+}
+#endif
+
+/**
+ * @brief Test the translation into a byte stream
+ */
+void test_ump_to_bytes(void)
+{
+    const uint32_t input[] = {
+        0x20903C40,             /* Note On */
+        0x20903E40,             /* Note On, under running status */
+        0x10F80000,             /* Timing Clock */
+        0x40803C00, 0x80000000, /* MIDI 2.0 Note Off */
+        0x00000000,             /* Utility NOOP, skipped */
+        0x30020102, 0x00000000, /* Complete SysEx */
+        0x40F03C00, 0x00000000, /* Per-Note Management, skipped */
+        0x20903C00,             /* Note On with velocity 0 */
+    };
+    const uint8_t reference[] = {
+        0x90, 0x3C, 0x40, 0x3E, 0x40, 0xF8, 0x80, 0x3C, 0x40,
+        0xF0, 0x01, 0x02, 0xF7, 0x80, 0x3C, 0x00,
+    };
+    const size_t count = sizeof(input) / sizeof(input[0]);
+    uint8_t bytes[MAX_BYTES];
+    size_t consumed = 0;
+
+    /* A packet is only translated when all of its bytes fit */
+    TEST_ASSERT_EQUAL(3, midi_ump_to_bytes(&decoder, input, count, bytes, 4,
+                                           &consumed));
+    TEST_ASSERT_EQUAL(1, consumed);
+
+    size_t length = 3;
+    length += midi_ump_to_bytes(&decoder, &input[1], count - 1,
+                                &bytes[length], MAX_BYTES - length,
+                                &consumed);
+    TEST_ASSERT_EQUAL(count - 1, consumed);
+    TEST_ASSERT_EQUAL(sizeof(reference), length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(reference, bytes, length);
+
+    /* A packet cut short by the end of the words waits for the rest */
+    midi_ump_decoder_reset(&decoder);
+    midi_ump_decoder_set_running_status(&decoder, 0);
+    TEST_ASSERT_EQUAL(7, midi_ump_to_bytes(&decoder, input, 4, bytes,
+                                           MAX_BYTES, &consumed));
+    TEST_ASSERT_EQUAL(3, consumed);
+    TEST_ASSERT_EQUAL_HEX8(0x90, bytes[3]);
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Scaling
+    RUN_TEST(test_ump_scaling);
+    RUN_TEST(test_ump_packet_words);
+
+    // Translation
+    RUN_TEST(test_ump_midi1_round_trip);
+    RUN_TEST(test_ump_midi2_channel_voice);
+    RUN_TEST(test_ump_midi2_round_trip);
+    RUN_TEST(test_ump_registered_controllers);
+    RUN_TEST(test_ump_sysex);
+#if MIDI_CONFIG_SYSEX
+    RUN_TEST(test_ump_sysex_spans);
+#endif
+    RUN_TEST(test_ump_to_bytes);
+
+    return UNITY_END();
+}
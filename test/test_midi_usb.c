@@ -0,0 +1,495 @@
+/***********************************************************************
+ * @file test_midi_usb.c
+ * @brief Unit tests for the USB-MIDI event packet module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_encoder.h"
+#include "../midi/midi_usb.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define MAX_MESSAGES (1024)
+#define MAX_PAYLOAD (256)
+#define MAX_SPANS (64)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static midi_usb_decoder_t decoder;
+static midi_usb_packet_t packets[MAX_MESSAGES];
+static midi_packed_t expected[MAX_MESSAGES];
+static midi_packed_t messages[MAX_MESSAGES];
+static uint8_t cables[MAX_MESSAGES];
+static uint8_t payloads[MIDI_USB_CABLES][MAX_PAYLOAD];
+static size_t payload_length[MIDI_USB_CABLES];
+static uint8_t span_flags[MAX_SPANS];
+static uint8_t span_cables[MAX_SPANS];
+static size_t span_count;
+static uint8_t realtime_cables[8];
+static size_t realtime_count;
+static uint32_t random_state;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    midi_usb_decoder_init(&decoder, NULL);
+    memset(payload_length, 0, sizeof(payload_length));
+    memset(cables, 0xFF, sizeof(cables));
+    span_count = 0;
+    realtime_count = 0;
+    random_state = 0x2545F491;
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Next pseudo random number
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief SysEx handler that collects the payload of each cable
+ */
+static void record_span(void *context, const midi_sysex_span_t *span)
+{
+    const midi_usb_decoder_t *d = (const midi_usb_decoder_t *)context;
+    const uint8_t cable = d->current_cable;
+
+    TEST_ASSERT_LESS_OR_EQUAL(MAX_PAYLOAD,
+                              payload_length[cable] + span->length);
+    memcpy(&payloads[cable][payload_length[cable]], span->data, span->length);
+    payload_length[cable] += span->length;
+    if (span_count < MAX_SPANS) {
+        span_flags[span_count] = span->flags;
+        span_cables[span_count] = cable;
+        span_count++;
+    }
+}
+
+/**
+ * @brief Realtime handler that records the cable of each event
+ */
+static void record_realtime(void *context, const midi_realtime_event_t *event)
+{
+    const midi_usb_decoder_t *d = (const midi_usb_decoder_t *)context;
+
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_TIMING_CLOCK, event->message_type);
+    if (realtime_count < 8) {
+        realtime_cables[realtime_count] = d->current_cable;
+    }
+    realtime_count++;
+}
+
+/**
+ * @brief Initialize the decoder with the SysEx handler
+ */
+static void init_with_sysex_handler(void)
+{
+    midi_parser_t config;
+
+    midi_parser_init(&config);
+    midi_parser_set_sysex_handler(&config, record_span, &decoder);
+    midi_usb_decoder_init(&decoder, &config);
+}
+
+/*=====================================================================*
+    Decoder Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test channel messages on several cables
+ */
+void test_usb_channel_messages(void)
+{
+    const midi_usb_packet_t input[] = {
+        midi_usb_packet_make(0, MIDI_USB_CIN_NOTE_ON, 0x90, 0x3C, 0x40),
+        midi_usb_packet_make(5, MIDI_USB_CIN_NOTE_ON, 0x91, 0x3C, 0x00),
+        midi_usb_packet_make(5, MIDI_USB_CIN_CONTROL_CHANGE, 0xB2, 0x07, 0x64),
+        midi_usb_packet_make(0, MIDI_USB_CIN_MISC, 0x90, 0x3C, 0x40),
+        midi_usb_packet_make(0, MIDI_USB_CIN_NOTE_ON, 0x80, 0x3C, 0x40),
+        midi_usb_packet_make(15, MIDI_USB_CIN_PITCH_BEND, 0xE3, 0x01, 0x40),
+        midi_usb_packet_make(1, MIDI_USB_CIN_PROGRAM_CHANGE, 0xC4, 0x05, 0),
+        midi_usb_packet_make(1, MIDI_USB_CIN_CONTROL_CHANGE, 0xB5, 0x7B, 0),
+        midi_usb_packet_make(2, MIDI_USB_CIN_SYSTEM_COMMON_3, 0xF2, 0x10, 0x20),
+        midi_usb_packet_make(2, MIDI_USB_CIN_SYSTEM_COMMON_2, 0xF2, 0x10, 0),
+        midi_usb_packet_make(2, MIDI_USB_CIN_SYSEX_END_1, 0xF6, 0, 0),
+    };
+    const midi_packed_t reference[] = {
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 0x3C, 0x40),
+        midi_packed_make(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_2, 0x3C, 0x00),
+        midi_packed_make(
+            MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_3, 0x07, 0x64),
+        midi_packed_make(MIDI_MESSAGE_PITCH_BEND, MIDI_CHANNEL_4, 0x01, 0x40),
+        midi_packed_make(MIDI_MESSAGE_PROGRAM_CHANGE, MIDI_CHANNEL_5, 0x05, 0),
+#if MIDI_CONFIG_CHANNEL_MODE
+        midi_packed_make(MIDI_MESSAGE_ALL_NOTES_OFF, MIDI_CHANNEL_6, 0x7B, 0),
+#else
+        midi_packed_make(
+            MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_6, 0x7B, 0),
+#endif
+#if MIDI_CONFIG_SONG
+        midi_packed_make(
+            MIDI_MESSAGE_SONG_POSITION_POINTER, MIDI_CHANNEL_NONE, 0x10, 0x20),
+#endif
+        midi_packed_make(MIDI_MESSAGE_TUNE_REQUEST, MIDI_CHANNEL_NONE, 0, 0),
+    };
+#if MIDI_CONFIG_SONG
+    const uint8_t reference_cables[] = {0, 5, 5, 15, 1, 1, 2, 2};
+#else
+    const uint8_t reference_cables[] = {0, 5, 5, 15, 1, 1, 2};
+#endif
+    size_t consumed = 0;
+
+    const size_t count =
+        midi_usb_decode(&decoder, input, sizeof(input) / sizeof(input[0]),
+                        cables, messages, MAX_MESSAGES, &consumed);
+
+    TEST_ASSERT_EQUAL(sizeof(input) / sizeof(input[0]), consumed);
+    TEST_ASSERT_EQUAL(sizeof(reference) / sizeof(reference[0]), count);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(reference, messages, count);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(reference_cables, cables, count);
+}
+
+/**
+ * @brief Test that encoded messages decode to themselves
+ */
+void test_usb_round_trip(void)
+{
+    const midi_packed_t unsent[] = {
+        midi_packed_make(MIDI_MESSAGE_SYSTEM_EXCLUSIVE, MIDI_CHANNEL_NONE, 0,
+                         0),
+        midi_packed_make(MIDI_MESSAGE_NONE, MIDI_CHANNEL_NONE, 0, 0),
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_NONE, 0x3C, 0x40),
+    };
+    size_t count = 0;
+
+    /* Every defined status byte other than SysEx, with random data */
+    while (count < MAX_MESSAGES) {
+        const uint32_t r = next_random();
+        midi_message_t message;
+        const uint8_t status = (uint8_t)(0x80 | (r >> 24));
+
+        if (status == MIDI_MESSAGE_SYSTEM_EXCLUSIVE
+            || status == MIDI_MESSAGE_END_OF_EXCLUSIVE
+            || midi_decode_message(status, (uint8_t)(r >> 8), (uint8_t)r,
+                                   &message)
+                   == MIDI_MESSAGE_NONE) {
+            continue;
+        }
+        expected[count++] = midi_message_pack(&message);
+    }
+
+    size_t encoded = 0;
+    TEST_ASSERT_EQUAL(0, midi_usb_encode_packed(3, unsent, 3, packets,
+                                                MAX_MESSAGES, &encoded));
+    TEST_ASSERT_EQUAL(3, encoded);
+    TEST_ASSERT_EQUAL(0, midi_usb_encode_packed(16, expected, count, packets,
+                                                MAX_MESSAGES, &encoded));
+
+    TEST_ASSERT_EQUAL(count, midi_usb_encode_packed(3, expected, count,
+                                                    packets, MAX_MESSAGES,
+                                                    &encoded));
+    TEST_ASSERT_EQUAL(count, encoded);
+    TEST_ASSERT_EQUAL(3, midi_usb_packet_cable(packets[0]));
+
+    /* Through the byte order of an endpoint buffer and back */
+    for (size_t i = 0; i < count; i++) {
+        uint8_t bytes[MIDI_USB_PACKET_SIZE];
+        midi_usb_packet_write(packets[i], bytes);
+        TEST_ASSERT_EQUAL_HEX8(packets[i] >> 24, bytes[0]);
+        packets[i] = midi_usb_packet_read(bytes);
+    }
+
+    TEST_ASSERT_EQUAL(count, midi_usb_decode(&decoder, packets, count,
+                                             NULL, messages, MAX_MESSAGES,
+                                             NULL));
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(expected, messages, count);
+}
+
+/**
+ * @brief Test SysEx messages interleaved on two cables
+ */
+void test_usb_sysex_cables(void)
+{
+    uint8_t short_payload[10];
+    uint8_t long_payload[200];
+    midi_usb_packet_t long_packets[MIDI_USB_SYSEX_PACKETS(200)];
+    midi_usb_packet_t short_packets[MIDI_USB_SYSEX_PACKETS(10)];
+    size_t count = 0;
+
+    init_with_sysex_handler();
+    for (size_t i = 0; i < sizeof(short_payload); i++) {
+        short_payload[i] = (uint8_t)(0x10 + i);
+    }
+    for (size_t i = 0; i < sizeof(long_payload); i++) {
+        long_payload[i] = (uint8_t)(i & 0x7F);
+    }
+
+    const size_t long_count =
+        midi_usb_encode_sysex(2, long_payload, sizeof(long_payload),
+                              long_packets, MIDI_USB_SYSEX_PACKETS(200));
+    const size_t short_count =
+        midi_usb_encode_sysex(1, short_payload, sizeof(short_payload),
+                              short_packets, MIDI_USB_SYSEX_PACKETS(10));
+    TEST_ASSERT_EQUAL(MIDI_USB_SYSEX_PACKETS(200), long_count);
+    TEST_ASSERT_EQUAL(MIDI_USB_SYSEX_PACKETS(10), short_count);
+
+    /* Two long packets for each short one */
+    for (size_t l = 0, s = 0; l < long_count || s < short_count;) {
+        if (l < long_count) { packets[count++] = long_packets[l++]; }
+        if (l < long_count) { packets[count++] = long_packets[l++]; }
+        if (s < short_count) { packets[count++] = short_packets[s++]; }
+    }
+
+    const size_t decoded = midi_usb_decode(
+        &decoder, packets, count, cables, messages, MAX_MESSAGES, NULL);
+
+    TEST_ASSERT_EQUAL(4, decoded);
+    TEST_ASSERT_EQUAL(sizeof(short_payload), payload_length[1]);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(
+        short_payload, payloads[1], sizeof(short_payload));
+    TEST_ASSERT_EQUAL(sizeof(long_payload), payload_length[2]);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(long_payload, payloads[2],
+                                 sizeof(long_payload));
+
+    /* Each payload starts once and ends once, on its own cable */
+    size_t starts[MIDI_USB_CABLES] = {0};
+    size_t ends[MIDI_USB_CABLES] = {0};
+    for (size_t i = 0; i < span_count; i++) {
+        starts[span_cables[i]] += (span_flags[i] & MIDI_SYSEX_FLAG_START) != 0;
+        ends[span_cables[i]] += (span_flags[i] & MIDI_SYSEX_FLAG_END) != 0;
+        TEST_ASSERT_FALSE(span_flags[i] & MIDI_SYSEX_FLAG_ABORTED);
+    }
+    TEST_ASSERT_EQUAL(1, starts[1]);
+    TEST_ASSERT_EQUAL(1, ends[1]);
+    TEST_ASSERT_EQUAL(1, starts[2]);
+    TEST_ASSERT_EQUAL(1, ends[2]);
+
+    /* Start and End of Exclusive are returned as by the parser */
+    for (size_t i = 0; i < decoded; i++) {
+        const midi_message_type_t type = midi_packed_type(messages[i]);
+        TEST_ASSERT_TRUE(type == MIDI_MESSAGE_SYSTEM_EXCLUSIVE
+                         || type == MIDI_MESSAGE_END_OF_EXCLUSIVE);
+    }
+    TEST_ASSERT_EQUAL(2, cables[0]);
+    TEST_ASSERT_EQUAL(1, cables[1]);
+}
+
+/**
+ * @brief Test that a message aborts a SysEx on its own cable only
+ */
+void test_usb_sysex_aborted(void)
+{
+    const midi_usb_packet_t input[] = {
+        midi_usb_packet_make(0, MIDI_USB_CIN_SYSEX_START, 0xF0, 0x01, 0x02),
+        midi_usb_packet_make(1, MIDI_USB_CIN_SYSEX_START, 0xF0, 0x11, 0x12),
+        midi_usb_packet_make(1, MIDI_USB_CIN_NOTE_ON, 0x90, 0x3C, 0x40),
+        midi_usb_packet_make(0, MIDI_USB_CIN_SINGLE_BYTE, 0xF8, 0, 0),
+        midi_usb_packet_make(0, MIDI_USB_CIN_SYSEX_END_2, 0x03, 0xF7, 0),
+    };
+
+    init_with_sysex_handler();
+    const size_t count = midi_usb_decode(&decoder, input, 5, cables,
+                                         messages, MAX_MESSAGES, NULL);
+
+    TEST_ASSERT_EQUAL(5, count);
+    TEST_ASSERT_EQUAL(3, payload_length[0]);
+    TEST_ASSERT_EQUAL(2, payload_length[1]);
+    TEST_ASSERT_EQUAL_HEX8(0x03, payloads[0][2]);
+
+    /* Cable 0 is flushed when cable 1 starts collecting */
+    TEST_ASSERT_EQUAL(0, span_cables[0]);
+    TEST_ASSERT_EQUAL_HEX8(MIDI_SYSEX_FLAG_START, span_flags[0]);
+
+    /* The Note On ends the payload of cable 1, which is aborted */
+    TEST_ASSERT_EQUAL(1, span_cables[1]);
+    TEST_ASSERT_EQUAL_HEX8(MIDI_SYSEX_FLAG_START | MIDI_SYSEX_FLAG_END
+                               | MIDI_SYSEX_FLAG_ABORTED,
+                           span_flags[1]);
+
+    /* The realtime message does not end the payload of cable 0 */
+    TEST_ASSERT_EQUAL(0, span_cables[2]);
+    TEST_ASSERT_EQUAL_HEX8(MIDI_SYSEX_FLAG_CONTINUE | MIDI_SYSEX_FLAG_END,
+                           span_flags[2]);
+    TEST_ASSERT_EQUAL(3, span_count);
+
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_NOTE_ON, midi_packed_type(messages[2]));
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_TIMING_CLOCK,
+                      midi_packed_type(messages[3]));
+    TEST_ASSERT_EQUAL(MIDI_MESSAGE_END_OF_EXCLUSIVE,
+                      midi_packed_type(messages[4]));
+}
+
+/**
+ * @brief Test single byte packets, parsed with the state of each cable
+ */
+void test_usb_single_bytes(void)
+{
+    const midi_usb_packet_t input[] = {
+        midi_usb_packet_make(3, MIDI_USB_CIN_SINGLE_BYTE, 0x93, 0, 0),
+        midi_usb_packet_make(4, MIDI_USB_CIN_SINGLE_BYTE, 0xC4, 0, 0),
+        midi_usb_packet_make(3, MIDI_USB_CIN_SINGLE_BYTE, 0x3C, 0, 0),
+        midi_usb_packet_make(4, MIDI_USB_CIN_SINGLE_BYTE, 0x07, 0, 0),
+        midi_usb_packet_make(3, MIDI_USB_CIN_SINGLE_BYTE, 0x40, 0, 0),
+        midi_usb_packet_make(3, MIDI_USB_CIN_SINGLE_BYTE, 0x3E, 0, 0),
+        midi_usb_packet_make(3, MIDI_USB_CIN_SINGLE_BYTE, 0x41, 0, 0),
+        midi_usb_packet_make(4, MIDI_USB_CIN_SINGLE_BYTE, 0x08, 0, 0),
+    };
+    const midi_packed_t reference[] = {
+        midi_packed_make(MIDI_MESSAGE_PROGRAM_CHANGE, MIDI_CHANNEL_5, 0x07, 0),
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_4, 0x3C, 0x40),
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_4, 0x3E, 0x41),
+        midi_packed_make(MIDI_MESSAGE_PROGRAM_CHANGE, MIDI_CHANNEL_5, 0x08, 0),
+    };
+    const uint8_t reference_cables[] = {4, 3, 3, 4};
+    size_t consumed = 0;
+    size_t count = 0;
+
+    /* One message at a time, resuming after the last packet decoded */
+    for (size_t index = 0; index < 8; index += consumed) {
+        const size_t decoded =
+            midi_usb_decode(&decoder, &input[index], 8 - index,
+                            &cables[count], &messages[count], 1, &consumed);
+        TEST_ASSERT_LESS_OR_EQUAL(1, decoded);
+        TEST_ASSERT_GREATER_THAN(0, consumed);
+        count += decoded;
+    }
+
+    TEST_ASSERT_EQUAL(4, count);
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(reference, messages, count);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(reference_cables, cables, count);
+
+    /* A framed message clears the running status of its cable */
+    const midi_usb_packet_t framed[] = {
+        midi_usb_packet_make(3, MIDI_USB_CIN_NOTE_OFF, 0x83, 0x3C, 0x00),
+        midi_usb_packet_make(3, MIDI_USB_CIN_SINGLE_BYTE, 0x3C, 0, 0),
+        midi_usb_packet_make(3, MIDI_USB_CIN_SINGLE_BYTE, 0x40, 0, 0),
+    };
+    TEST_ASSERT_EQUAL(1, midi_usb_decode(&decoder, framed, 3, NULL,
+                                         messages, MAX_MESSAGES, NULL));
+}
+
+/**
+ * @brief Test the parser filters, the cable mask and the realtime lane
+ */
+void test_usb_filters(void)
+{
+    const midi_usb_packet_t input[] = {
+        midi_usb_packet_make(0, MIDI_USB_CIN_NOTE_ON, 0x90, 0x3C, 0x40),
+        midi_usb_packet_make(0, MIDI_USB_CIN_NOTE_ON, 0x91, 0x3C, 0x40),
+        midi_usb_packet_make(0, MIDI_USB_CIN_CONTROL_CHANGE, 0xB1, 0x01, 0x40),
+        midi_usb_packet_make(0, MIDI_USB_CIN_CONTROL_CHANGE, 0xB1, 0x07, 0x40),
+        midi_usb_packet_make(7, MIDI_USB_CIN_SINGLE_BYTE, 0xF8, 0, 0),
+        midi_usb_packet_make(9, MIDI_USB_CIN_NOTE_ON, 0x91, 0x3C, 0x40),
+        midi_usb_packet_make(7, MIDI_USB_CIN_SINGLE_BYTE, 0xFE, 0, 0),
+    };
+    midi_parser_t config;
+
+    midi_parser_init(&config);
+    midi_parser_set_active_channel(&config, MIDI_CHANNEL_2);
+    midi_parser_set_controller_enabled(&config, MIDI_CC_MOD_WHEEL, 0);
+    midi_parser_set_message_enabled(&config, MIDI_MESSAGE_ACTIVE_SENSE, 0);
+    midi_parser_set_realtime_handler(&config, record_realtime, NULL,
+                                     &decoder);
+    midi_usb_decoder_init(&decoder, &config);
+    midi_usb_decoder_set_cable_mask(&decoder, 0x00FF);
+
+    const size_t count = midi_usb_decode(&decoder, input, 7, cables,
+                                         messages, MAX_MESSAGES, NULL);
+
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL_HEX32(
+        midi_packed_make(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_2, 0x3C, 0x40),
+        messages[0]);
+    TEST_ASSERT_EQUAL_HEX32(
+        midi_packed_make(
+            MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_2, 0x07, 0x40),
+        messages[1]);
+    TEST_ASSERT_EQUAL(1, realtime_count);
+    TEST_ASSERT_EQUAL(7, realtime_cables[0]);
+}
+
+/*=====================================================================*
+    Encoder Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test the Code Index Numbers of SysEx packets
+ */
+void test_usb_encode_sysex(void)
+{
+    static const uint8_t payload[] = {0x01, 0x02, 0x03, 0x04};
+    static const uint8_t bad[] = {0x01, 0xF8};
+
+    /* F0 F7 */
+    TEST_ASSERT_EQUAL(1, midi_usb_encode_sysex(0, NULL, 0, packets, 1));
+    TEST_ASSERT_EQUAL_HEX32(0x06F0F700, packets[0]);
+
+    /* F0 01 F7 */
+    TEST_ASSERT_EQUAL(1, midi_usb_encode_sysex(1, payload, 1, packets, 1));
+    TEST_ASSERT_EQUAL_HEX32(0x17F001F7, packets[0]);
+
+    /* F0 01 02 | F7 */
+    TEST_ASSERT_EQUAL(2, midi_usb_encode_sysex(2, payload, 2, packets, 2));
+    TEST_ASSERT_EQUAL_HEX32(0x24F00102, packets[0]);
+    TEST_ASSERT_EQUAL_HEX32(0x25F70000, packets[1]);
+
+    /* F0 01 02 | 03 F7 */
+    TEST_ASSERT_EQUAL(2, midi_usb_encode_sysex(3, payload, 3, packets, 2));
+    TEST_ASSERT_EQUAL_HEX32(0x34F00102, packets[0]);
+    TEST_ASSERT_EQUAL_HEX32(0x3603F700, packets[1]);
+
+    /* F0 01 02 | 03 04 F7 */
+    TEST_ASSERT_EQUAL(2, midi_usb_encode_sysex(4, payload, 4, packets, 2));
+    TEST_ASSERT_EQUAL_HEX32(0x470304F7, packets[1]);
+
+    /* Capacity, cable and payload checks */
+    TEST_ASSERT_EQUAL(0, midi_usb_encode_sysex(0, payload, 4, packets, 1));
+    TEST_ASSERT_EQUAL(0, midi_usb_encode_sysex(16, payload, 4, packets, 2));
+    TEST_ASSERT_EQUAL(0, midi_usb_encode_sysex(0, bad, 2, packets, 2));
+    TEST_ASSERT_EQUAL(0, midi_usb_encode_sysex(0, NULL, 2, packets, 2));
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Decoder
+    RUN_TEST(test_usb_channel_messages);
+    RUN_TEST(test_usb_round_trip);
+    RUN_TEST(test_usb_sysex_cables);
+    RUN_TEST(test_usb_sysex_aborted);
+    RUN_TEST(test_usb_single_bytes);
+    RUN_TEST(test_usb_filters);
+
+    // Encoder
+    RUN_TEST(test_usb_encode_sysex);
+
+    return UNITY_END();
+}
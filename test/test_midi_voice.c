@@ -0,0 +1,836 @@
+/***********************************************************************
+ * @file test_midi_voice.c
+ * @brief Unit tests for the MIDI voice allocation module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_voice.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define VOICES (4)
+#define MAX_EVENTS (2 * MIDI_VOICE_MAX_VOICES)
+#define MODEL_MESSAGES (20000)
+
+/*=====================================================================*
+    Private Data Types
+ *=====================================================================*/
+
+/**
+ * @brief Voice of the reference model
+ * @details The lists are kept as an age stamp per voice, and searched
+ */
+typedef struct model_voice_t {
+    int list;
+    long stamp;
+    uint8_t channel;
+    uint8_t note;
+    uint8_t latched;
+} model_voice_t;
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static midi_voice_allocator_t allocator;
+static midi_voice_event_t events[MAX_EVENTS];
+static size_t event_count;
+static midi_voice_event_t expected[MAX_EVENTS];
+static size_t expected_count;
+static model_voice_t model[MIDI_VOICE_MAX_VOICES];
+static size_t model_voices;
+static uint16_t model_sustain;
+static uint16_t model_sostenuto;
+static uint16_t model_mono;
+static uint8_t model_mono_voice[MIDI_VOICE_CHANNELS];
+static long model_clock;
+static long model_kill_clock;
+static uint32_t random_state;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+
+/**
+ * @brief Handler that records the events
+ */
+static void record_event(void *context, const midi_voice_event_t *event)
+{
+    TEST_ASSERT_EQUAL_PTR(&allocator, context);
+    TEST_ASSERT_LESS_THAN(MAX_EVENTS, event_count);
+    events[event_count++] = *event;
+}
+
+void setUp(void)
+{
+    midi_voice_init(&allocator, VOICES, record_event, &allocator);
+    event_count = 0;
+    random_state = 0x2545F491;
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Next pseudo random number
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief Send a message with two data bytes to the allocator
+ */
+static void send(midi_message_type_t type,
+                 midi_channel_t channel,
+                 uint8_t data1,
+                 uint8_t data2)
+{
+    midi_voice_update_packed(&allocator,
+                             midi_packed_make(type, channel, data1, data2));
+}
+
+/**
+ * @brief Check an event recorded by the handler
+ */
+static void assert_event(size_t index,
+                         midi_voice_action_t action,
+                         uint8_t voice,
+                         uint8_t note)
+{
+    TEST_ASSERT_LESS_THAN(event_count, index);
+    TEST_ASSERT_EQUAL(action, events[index].action);
+    TEST_ASSERT_EQUAL(voice, events[index].voice);
+    TEST_ASSERT_EQUAL(note, events[index].note);
+}
+
+/**
+ * @brief Initialize the model and the allocator with the same voices
+ */
+static void model_init(size_t voices)
+{
+    midi_voice_init(&allocator, voices, record_event, &allocator);
+    model_voices = voices;
+    for (size_t v = 0; v < voices; v++) {
+        model[v].list = 0;
+        model[v].stamp = (long)v - 1000;
+        model[v].latched = 0;
+    }
+    model_sustain = 0;
+    model_sostenuto = 0;
+    model_mono = 0;
+    memset(model_mono_voice, MIDI_VOICE_NONE, sizeof(model_mono_voice));
+    model_clock = 0;
+    model_kill_clock = -2000;
+    expected_count = 0;
+    event_count = 0;
+}
+
+/**
+ * @brief Record an expected event
+ */
+static void model_emit(midi_voice_action_t action,
+                       size_t voice,
+                       uint8_t velocity)
+{
+    TEST_ASSERT_LESS_THAN(MAX_EVENTS, expected_count);
+    expected[expected_count].action = action;
+    expected[expected_count].voice = (uint8_t)voice;
+    expected[expected_count].channel = (midi_channel_t)model[voice].channel;
+    expected[expected_count].note = model[voice].note;
+    expected[expected_count].velocity = velocity;
+    expected_count++;
+}
+
+/**
+ * @brief Find the sounding voice of a note by searching every voice
+ */
+static size_t model_find(size_t channel, uint8_t note)
+{
+    for (size_t v = 0; v < model_voices; v++) {
+        if (model[v].list != 0 && model[v].channel == channel
+            && model[v].note == note) {
+            return v;
+        }
+    }
+    return MIDI_VOICE_NONE;
+}
+
+/**
+ * @brief List the voices of a list and channel, oldest first
+ * @param channel The channel, or MIDI_VOICE_CHANNELS for every channel
+ */
+static size_t model_list(int list, size_t channel, size_t *voices)
+{
+    size_t count = 0;
+
+    for (size_t v = 0; v < model_voices; v++) {
+        const int match =
+            channel == MIDI_VOICE_CHANNELS || model[v].channel == channel;
+        if (model[v].list == list && match) {
+            size_t i = count++;
+            while (i > 0 && model[voices[i - 1]].stamp > model[v].stamp) {
+                voices[i] = voices[i - 1];
+                i--;
+            }
+            voices[i] = v;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Move a voice to the newest end of a list
+ */
+static void model_move(size_t voice, int list)
+{
+    model[voice].list = list;
+    model[voice].stamp = model_clock++;
+}
+
+/**
+ * @brief Release a sounding voice
+ */
+static void model_release(size_t voice, uint8_t velocity)
+{
+    model_emit(MIDI_VOICE_RELEASE, voice, velocity);
+    if (model_mono_voice[model[voice].channel] == voice) {
+        model_mono_voice[model[voice].channel] = MIDI_VOICE_NONE;
+    }
+    model[voice].latched = 0;
+    model_move(voice, 0);
+}
+
+/**
+ * @brief Kill a sounding voice
+ */
+static void model_kill(size_t voice)
+{
+    model_emit(MIDI_VOICE_KILL, voice, 0);
+    if (model_mono_voice[model[voice].channel] == voice) {
+        model_mono_voice[model[voice].channel] = MIDI_VOICE_NONE;
+    }
+    model[voice].latched = 0;
+    model[voice].list = 0;
+    model[voice].stamp = model_kill_clock--;
+}
+
+/**
+ * @brief Release the key of a held voice
+ */
+static void model_release_key(size_t voice, uint8_t velocity)
+{
+    const unsigned bit = 1u << model[voice].channel;
+
+    const int latched = model[voice].latched && (model_sostenuto & bit);
+
+    if ((model_sustain & bit) || latched) {
+        model_move(voice, 1);
+    } else {
+        model_release(voice, velocity);
+    }
+}
+
+/**
+ * @brief Give a note to a voice
+ */
+static void model_assign(size_t voice,
+                         size_t channel,
+                         uint8_t note,
+                         midi_voice_action_t action,
+                         uint8_t velocity)
+{
+    if (model_mono_voice[model[voice].channel] == voice) {
+        model_mono_voice[model[voice].channel] = MIDI_VOICE_NONE;
+    }
+    model[voice].channel = (uint8_t)channel;
+    model[voice].note = note;
+    model[voice].latched = 0;
+    if (model_mono & (1u << channel)) {
+        model_mono_voice[channel] = (uint8_t)voice;
+    }
+    model_move(voice, 2);
+    model_emit(action, voice, velocity);
+}
+
+/**
+ * @brief Apply a message to the model
+ */
+static void model_update(midi_message_type_t type,
+                         size_t channel,
+                         uint8_t data1,
+                         uint8_t data2)
+{
+    size_t voices[MIDI_VOICE_MAX_VOICES];
+    const unsigned bit = 1u << channel;
+    size_t count;
+
+    if (type == MIDI_MESSAGE_NOTE_ON && data2 == 0) {
+        type = MIDI_MESSAGE_NOTE_OFF;
+    }
+
+    switch (type) {
+    case MIDI_MESSAGE_NOTE_ON: {
+        size_t voice = model_find(channel, data1);
+        const size_t mono = model_mono_voice[channel];
+        if (mono != MIDI_VOICE_NONE) {
+            if (voice != MIDI_VOICE_NONE && voice != mono) {
+                model_release(voice, 0);
+            }
+            model_assign(mono, channel, data1,
+                         (model[mono].list == 2 && model[mono].note != data1)
+                             ? MIDI_VOICE_LEGATO
+                             : MIDI_VOICE_RETRIGGER,
+                         data2);
+            break;
+        }
+        if (voice != MIDI_VOICE_NONE) {
+            model_assign(voice, channel, data1, MIDI_VOICE_RETRIGGER, data2);
+            break;
+        }
+        for (int list = 0; list < 3; list++) {
+            if (model_list(list, MIDI_VOICE_CHANNELS, voices) != 0) {
+                model_assign(voices[0], channel, data1,
+                             list ? MIDI_VOICE_STEAL : MIDI_VOICE_START,
+                             data2);
+                break;
+            }
+        }
+        break;
+    }
+    case MIDI_MESSAGE_NOTE_OFF: {
+        const size_t voice = model_find(channel, data1);
+        if (voice != MIDI_VOICE_NONE && model[voice].list == 2) {
+            model_release_key(voice, data2);
+        }
+        break;
+    }
+    case MIDI_MESSAGE_CONTROL_CHANGE:
+        if (data1 == MIDI_CC_SUSTAIN_PEDAL) {
+            if (data2 >= 64) {
+                model_sustain |= bit;
+            } else if (model_sustain & bit) {
+                model_sustain &= ~bit;
+                count = model_list(1, channel, voices);
+                for (size_t i = 0; i < count; i++) {
+                    const size_t voice = voices[i];
+                    if (!(model[voice].latched && (model_sostenuto & bit))) {
+                        model_release(voice, 0);
+                    }
+                }
+            }
+        } else if (data1 == MIDI_CC_SOSTENUTO) {
+            const int down = data2 >= 64;
+            if (down == ((model_sostenuto & bit) != 0)) { break; }
+            count = model_list(2, channel, voices);
+            for (size_t i = 0; i < count; i++) {
+                model[voices[i]].latched = (uint8_t)down;
+            }
+            if (down) {
+                model_sostenuto |= bit;
+                break;
+            }
+            model_sostenuto &= ~bit;
+            count = model_list(1, channel, voices);
+            for (size_t i = 0; i < count; i++) {
+                if (!model[voices[i]].latched) { continue; }
+                model[voices[i]].latched = 0;
+                if (!(model_sustain & bit)) { model_release(voices[i], 0); }
+            }
+        }
+        break;
+    case MIDI_MESSAGE_ALL_SOUND_OFF:
+        for (int list = 2; list >= 1; list--) {
+            count = model_list(list, channel, voices);
+            for (size_t i = 0; i < count; i++) { model_kill(voices[i]); }
+        }
+        break;
+    case MIDI_MESSAGE_RESET_ALL_CONTROLLERS:
+        model_update(MIDI_MESSAGE_CONTROL_CHANGE, channel,
+                     MIDI_CC_SUSTAIN_PEDAL, 0);
+        model_update(MIDI_MESSAGE_CONTROL_CHANGE, channel,
+                     MIDI_CC_SOSTENUTO, 0);
+        break;
+    case MIDI_MESSAGE_MONO_ON:
+    case MIDI_MESSAGE_POLY_ON:
+    case MIDI_MESSAGE_ALL_NOTES_OFF:
+        if (type == MIDI_MESSAGE_MONO_ON) { model_mono |= bit; }
+        if (type == MIDI_MESSAGE_POLY_ON) {
+            model_mono &= ~bit;
+            model_mono_voice[channel] = MIDI_VOICE_NONE;
+        }
+        count = model_list(2, channel, voices);
+        for (size_t i = 0; i < count; i++) {
+            model_release_key(voices[i], 0);
+        }
+        break;
+    case MIDI_MESSAGE_SYSTEM_RESET:
+        for (int list = 2; list >= 1; list--) {
+            count = model_list(list, MIDI_VOICE_CHANNELS, voices);
+            for (size_t i = 0; i < count; i++) { model_kill(voices[i]); }
+        }
+        model_sustain = 0;
+        model_sostenuto = 0;
+        model_mono = 0;
+        memset(model_mono_voice, MIDI_VOICE_NONE, sizeof(model_mono_voice));
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Send random messages to the allocator and the model, playing a
+ *        small range of notes on three channels with pedals and mode
+ *        changes, and compare the events
+ */
+static void run_model(size_t voices)
+{
+    model_init(voices);
+    for (size_t m = 0; m < MODEL_MESSAGES; m++) {
+        const uint32_t r = next_random();
+        const size_t channel = (r >> 4) % 3;
+        const uint8_t note = (uint8_t)(48 + (r >> 8) % 12);
+        const uint8_t value = (uint8_t)((r >> 16) & 0x7F);
+        midi_message_type_t type;
+        uint8_t data1 = note;
+        uint8_t data2 = value;
+
+        const uint32_t kind = r & 0x3F;
+        if (kind < 2) {
+            type = MIDI_MESSAGE_CONTROL_CHANGE;
+            data1 = MIDI_CC_SUSTAIN_PEDAL;
+        } else if (kind < 4) {
+            type = MIDI_MESSAGE_CONTROL_CHANGE;
+            data1 = MIDI_CC_SOSTENUTO;
+        } else if (kind == 4) {
+            const int mono = (r & 0x100) != 0;
+            type = mono ? MIDI_MESSAGE_MONO_ON : MIDI_MESSAGE_POLY_ON;
+            data1 = mono ? MIDI_CC_MONO_ON : MIDI_CC_POLY_ON;
+            data2 = 0;
+        } else if (kind == 5) {
+            const int notes = (r & 0x100) != 0;
+            type = notes ? MIDI_MESSAGE_ALL_NOTES_OFF
+                         : MIDI_MESSAGE_RESET_ALL_CONTROLLERS;
+            data1 = notes ? MIDI_CC_ALL_NOTES_OFF
+                          : MIDI_CC_RESET_ALL_CONTROLLERS;
+            data2 = 0;
+        } else if (kind == 6) {
+            type = ((r >> 8) % 16 == 0) ? MIDI_MESSAGE_SYSTEM_RESET
+                                        : MIDI_MESSAGE_ALL_SOUND_OFF;
+            data1 = MIDI_CC_ALL_SOUND_OFF;
+            data2 = 0;
+        } else if (kind < 32) {
+            type = MIDI_MESSAGE_NOTE_ON;
+            if (data2 == 0 && (r & 0x100)) { data2 = 1; }
+        } else {
+            type = MIDI_MESSAGE_NOTE_OFF;
+        }
+
+        expected_count = 0;
+        event_count = 0;
+        model_update(type, channel, data1, data2);
+        midi_voice_update_packed(
+            &allocator,
+            midi_packed_make(type,
+                             (type == MIDI_MESSAGE_SYSTEM_RESET)
+                                 ? MIDI_CHANNEL_NONE
+                                 : (midi_channel_t)channel,
+                             data1, data2));
+
+        TEST_ASSERT_EQUAL_MESSAGE(expected_count, event_count, "events");
+        for (size_t i = 0; i < event_count; i++) {
+            TEST_ASSERT_EQUAL(expected[i].action, events[i].action);
+            TEST_ASSERT_EQUAL(expected[i].voice, events[i].voice);
+            TEST_ASSERT_EQUAL(expected[i].channel, events[i].channel);
+            TEST_ASSERT_EQUAL(expected[i].note, events[i].note);
+            TEST_ASSERT_EQUAL(expected[i].velocity, events[i].velocity);
+        }
+
+        size_t sounding = 0;
+        for (size_t v = 0; v < voices; v++) {
+            if (model[v].list != 0) {
+                sounding++;
+                TEST_ASSERT_EQUAL(v, midi_voice_find(
+                                         &allocator,
+                                         (midi_channel_t)model[v].channel,
+                                         model[v].note));
+            }
+        }
+        TEST_ASSERT_EQUAL(sounding, midi_voice_count(&allocator));
+    }
+}
+
+/*=====================================================================*
+    Allocation Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test that notes take free voices, released longest ago first
+ */
+void test_voice_start_release(void)
+{
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_2, 60, 90);
+    assert_event(0, MIDI_VOICE_START, 0, 60);
+    assert_event(1, MIDI_VOICE_START, 1, 60);
+    TEST_ASSERT_EQUAL(100, events[0].velocity);
+    TEST_ASSERT_EQUAL(MIDI_CHANNEL_2, events[1].channel);
+    TEST_ASSERT_EQUAL(1, midi_voice_find(&allocator, MIDI_CHANNEL_2, 60));
+    TEST_ASSERT_EQUAL(2, midi_voice_count(&allocator));
+
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 60, 30);
+    assert_event(2, MIDI_VOICE_RELEASE, 0, 60);
+    TEST_ASSERT_EQUAL(30, events[2].velocity);
+    TEST_ASSERT_EQUAL(MIDI_VOICE_NONE,
+                      midi_voice_find(&allocator, MIDI_CHANNEL_1, 60));
+
+    /* Voice 0 was released last, so voices 2 and 3 come first */
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 61, 100);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 62, 100);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 63, 100);
+    assert_event(3, MIDI_VOICE_START, 2, 61);
+    assert_event(4, MIDI_VOICE_START, 3, 62);
+    assert_event(5, MIDI_VOICE_START, 0, 63);
+
+    /* A Note Off for a note that is not sounding does nothing */
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 60, 0);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 61, 0);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 61, 0);
+    TEST_ASSERT_EQUAL(7, event_count);
+
+    /* A Note On for a sounding note plays it again on its voice */
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 62, 50);
+    assert_event(7, MIDI_VOICE_RETRIGGER, 3, 62);
+    TEST_ASSERT_EQUAL(3, midi_voice_count(&allocator));
+}
+
+/**
+ * @brief Test that stealing takes the oldest pedal voice, then the oldest
+ *        held voice
+ */
+void test_voice_steal(void)
+{
+    for (uint8_t note = 60; note < 64; note++) {
+        send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, note, 100);
+    }
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 64, 100);
+    assert_event(4, MIDI_VOICE_STEAL, 0, 64);
+    TEST_ASSERT_EQUAL(MIDI_VOICE_NONE,
+                      midi_voice_find(&allocator, MIDI_CHANNEL_1, 60));
+
+    send(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1, MIDI_CC_SUSTAIN_PEDAL,
+         127);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 63, 0);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 62, 0);
+    TEST_ASSERT_EQUAL(5, event_count);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 65, 100);
+    assert_event(5, MIDI_VOICE_STEAL, 3, 65);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 66, 100);
+    assert_event(6, MIDI_VOICE_STEAL, 2, 66);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 67, 100);
+    assert_event(7, MIDI_VOICE_STEAL, 1, 67);
+    TEST_ASSERT_EQUAL(VOICES, midi_voice_count(&allocator));
+}
+
+/*=====================================================================*
+    Pedal Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test that the Sustain Pedal holds the released notes only
+ */
+void test_voice_sustain(void)
+{
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_2, 60, 100);
+    send(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1, MIDI_CC_SUSTAIN_PEDAL,
+         64);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 60, 0);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_2, 60, 0);
+    assert_event(2, MIDI_VOICE_RELEASE, 1, 60);
+    TEST_ASSERT_EQUAL(0, midi_voice_find(&allocator, MIDI_CHANNEL_1, 60));
+
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 62, 100);
+    send(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1, MIDI_CC_SUSTAIN_PEDAL,
+         0);
+    TEST_ASSERT_EQUAL(5, event_count);
+    assert_event(4, MIDI_VOICE_RELEASE, 0, 60);
+    TEST_ASSERT_EQUAL(1, midi_voice_count(&allocator));
+}
+
+/**
+ * @brief Test that the Sostenuto pedal holds the notes whose key was down
+ *        when it was pressed
+ */
+void test_voice_sostenuto(void)
+{
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 48, 100);
+    send(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1, MIDI_CC_SOSTENUTO, 127);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 48, 0);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 60, 0);
+    TEST_ASSERT_EQUAL(3, event_count);
+    assert_event(2, MIDI_VOICE_RELEASE, 1, 60);
+    TEST_ASSERT_EQUAL(0, midi_voice_find(&allocator, MIDI_CHANNEL_1, 48));
+
+    /* A note played again while held takes the pedal off it */
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 48, 100);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 48, 0);
+    assert_event(3, MIDI_VOICE_RETRIGGER, 0, 48);
+    assert_event(4, MIDI_VOICE_RELEASE, 0, 48);
+
+    /* Lifting the pedal releases the notes it held unless sustained */
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 50, 100);
+    send(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1, MIDI_CC_SOSTENUTO, 0);
+    send(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1, MIDI_CC_SOSTENUTO, 127);
+    send(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1, MIDI_CC_SUSTAIN_PEDAL,
+         127);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 50, 0);
+    send(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1, MIDI_CC_SOSTENUTO, 0);
+    TEST_ASSERT_EQUAL(6, event_count);
+    send(MIDI_MESSAGE_RESET_ALL_CONTROLLERS, MIDI_CHANNEL_1,
+         MIDI_CC_RESET_ALL_CONTROLLERS, 0);
+    assert_event(6, MIDI_VOICE_RELEASE, 2, 50);
+    TEST_ASSERT_EQUAL(0, midi_voice_count(&allocator));
+}
+
+/**
+ * @brief Test that lifting a pedal only walks the voices of its channel,
+ *        while another channel has many voices held
+ */
+void test_voice_pedal_other_channel(void)
+{
+    midi_voice_init(&allocator, 16, record_event, &allocator);
+
+    /* Channel 2 is busy: eight notes under its pedal, four keys down */
+    send(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_2, MIDI_CC_SUSTAIN_PEDAL,
+         127);
+    for (uint8_t note = 60; note < 72; note++) {
+        send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_2, note, 100);
+    }
+    for (uint8_t note = 60; note < 68; note++) {
+        send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_2, note, 0);
+    }
+
+    /* Channel 1 holds two notes with its pedal */
+    send(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1, MIDI_CC_SUSTAIN_PEDAL,
+         127);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 48, 100);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 50, 100);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 48, 0);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 50, 0);
+    TEST_ASSERT_EQUAL(14, event_count);
+
+    /* The pedal list of channel 1 has its two voices only */
+    uint8_t voice = allocator.channel_heads[MIDI_CHANNEL_1][0];
+    TEST_ASSERT_EQUAL(12, voice);
+    TEST_ASSERT_EQUAL(13, allocator.channel_next[voice]);
+    TEST_ASSERT_EQUAL(MIDI_VOICE_NONE, allocator.channel_next[13]);
+
+    send(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1, MIDI_CC_SUSTAIN_PEDAL,
+         0);
+    TEST_ASSERT_EQUAL(16, event_count);
+    assert_event(14, MIDI_VOICE_RELEASE, 12, 48);
+    assert_event(15, MIDI_VOICE_RELEASE, 13, 50);
+    TEST_ASSERT_EQUAL(MIDI_VOICE_NONE,
+                      allocator.channel_heads[MIDI_CHANNEL_1][0]);
+
+    /* Channel 2 is untouched, and still in age order */
+    TEST_ASSERT_EQUAL(12, midi_voice_count(&allocator));
+    for (uint8_t note = 60; note < 72; note++) {
+        TEST_ASSERT_EQUAL(note - 60,
+                          midi_voice_find(&allocator, MIDI_CHANNEL_2, note));
+    }
+    voice = allocator.channel_heads[MIDI_CHANNEL_2][0];
+    for (uint8_t expected_voice = 0; expected_voice < 8; expected_voice++) {
+        TEST_ASSERT_EQUAL(expected_voice, voice);
+        voice = allocator.channel_next[voice];
+    }
+    TEST_ASSERT_EQUAL(MIDI_VOICE_NONE, voice);
+
+    /* All Sound Off on channel 1 leaves channel 2 alone too */
+    send(MIDI_MESSAGE_ALL_SOUND_OFF, MIDI_CHANNEL_1, MIDI_CC_ALL_SOUND_OFF, 0);
+    send(MIDI_MESSAGE_ALL_NOTES_OFF, MIDI_CHANNEL_1, MIDI_CC_ALL_NOTES_OFF, 0);
+    TEST_ASSERT_EQUAL(16, event_count);
+
+    send(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_2, MIDI_CC_SUSTAIN_PEDAL,
+         0);
+    TEST_ASSERT_EQUAL(24, event_count);
+    assert_event(16, MIDI_VOICE_RELEASE, 0, 60);
+    assert_event(23, MIDI_VOICE_RELEASE, 7, 67);
+    TEST_ASSERT_EQUAL(4, midi_voice_count(&allocator));
+}
+
+/*=====================================================================*
+    Channel Mode Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test that a Mono channel glides its voice between held keys
+ */
+void test_voice_mono(void)
+{
+    send(MIDI_MESSAGE_MONO_ON, MIDI_CHANNEL_1, MIDI_CC_MONO_ON, 1);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 64, 90);
+    assert_event(0, MIDI_VOICE_START, 0, 60);
+    assert_event(1, MIDI_VOICE_LEGATO, 0, 64);
+    TEST_ASSERT_EQUAL(1, midi_voice_count(&allocator));
+
+    /* The key of the old note no longer plays */
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 60, 0);
+    TEST_ASSERT_EQUAL(2, event_count);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 64, 0);
+    assert_event(2, MIDI_VOICE_RELEASE, 0, 64);
+
+    /* Under the pedal, a new note starts the held voice again */
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100);
+    send(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_1, MIDI_CC_SUSTAIN_PEDAL,
+         127);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_1, 60, 0);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 62, 100);
+    assert_event(3, MIDI_VOICE_START, 1, 60);
+    assert_event(4, MIDI_VOICE_RETRIGGER, 1, 62);
+
+    /* Poly On releases the keys, which the pedal holds */
+    send(MIDI_MESSAGE_POLY_ON, MIDI_CHANNEL_1, MIDI_CC_POLY_ON, 0);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 64, 100);
+    assert_event(5, MIDI_VOICE_START, 2, 64);
+    TEST_ASSERT_EQUAL(2, midi_voice_count(&allocator));
+}
+
+/**
+ * @brief Test All Sound Off, All Notes Off and System Reset
+ */
+void test_voice_channel_mode(void)
+{
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_2, 60, 100);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 61, 100);
+    send(MIDI_MESSAGE_ALL_SOUND_OFF, MIDI_CHANNEL_1, MIDI_CC_ALL_SOUND_OFF, 0);
+    assert_event(3, MIDI_VOICE_KILL, 0, 60);
+    assert_event(4, MIDI_VOICE_KILL, 2, 61);
+    TEST_ASSERT_EQUAL(1, midi_voice_count(&allocator));
+
+    /* Killed voices are reused first, most recently killed first */
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 62, 100);
+    assert_event(5, MIDI_VOICE_START, 2, 62);
+
+    send(MIDI_MESSAGE_CONTROL_CHANGE, MIDI_CHANNEL_2, MIDI_CC_SUSTAIN_PEDAL,
+         127);
+    send(MIDI_MESSAGE_ALL_NOTES_OFF, MIDI_CHANNEL_2, MIDI_CC_ALL_NOTES_OFF, 0);
+    send(MIDI_MESSAGE_ALL_NOTES_OFF, MIDI_CHANNEL_1, MIDI_CC_ALL_NOTES_OFF, 0);
+    assert_event(6, MIDI_VOICE_RELEASE, 2, 62);
+    TEST_ASSERT_EQUAL(1, midi_voice_find(&allocator, MIDI_CHANNEL_2, 60));
+
+    midi_voice_update_packed(
+        &allocator,
+        midi_packed_make(MIDI_MESSAGE_SYSTEM_RESET, MIDI_CHANNEL_NONE, 0, 0));
+    assert_event(7, MIDI_VOICE_KILL, 1, 60);
+    TEST_ASSERT_EQUAL(0, midi_voice_count(&allocator));
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_2, 60, 100);
+    send(MIDI_MESSAGE_NOTE_OFF, MIDI_CHANNEL_2, 60, 0);
+    assert_event(9, MIDI_VOICE_RELEASE, 1, 60);
+}
+
+/**
+ * @brief Test the allocator as the handler of a dispatcher, and invalid
+ *        arguments
+ */
+void test_voice_dispatch(void)
+{
+    static const uint8_t stream[] = {0x90, 60, 100, 62, 100, 60, 0,
+                                     0xB0, 0x40, 127, 0x80, 62, 0};
+    midi_parser_t parser;
+    midi_dispatcher_t dispatcher;
+
+    midi_parser_init(&parser);
+    midi_dispatcher_init(&dispatcher, &allocator);
+    midi_dispatcher_set_handler(&dispatcher, MIDI_MESSAGE_NOTE_ON,
+                                midi_voice_handle_message);
+    midi_dispatcher_set_handler(&dispatcher, MIDI_MESSAGE_NOTE_OFF,
+                                midi_voice_handle_message);
+    midi_dispatcher_set_controller_handler(&dispatcher, MIDI_CC_SUSTAIN_PEDAL,
+                                           midi_voice_handle_message);
+    midi_parse_buffer_dispatch(&parser, &dispatcher, stream, sizeof(stream));
+    TEST_ASSERT_EQUAL(3, event_count);
+    assert_event(2, MIDI_VOICE_RELEASE, 0, 60);
+    TEST_ASSERT_EQUAL(1, midi_voice_find(&allocator, MIDI_CHANNEL_1, 62));
+
+    midi_voice_update(NULL, NULL);
+    midi_voice_update(&allocator, NULL);
+    TEST_ASSERT_EQUAL(0, midi_voice_count(NULL));
+    TEST_ASSERT_EQUAL(MIDI_VOICE_NONE,
+                      midi_voice_find(NULL, MIDI_CHANNEL_1, 62));
+    TEST_ASSERT_EQUAL(MIDI_VOICE_NONE,
+                      midi_voice_find(&allocator, MIDI_CHANNEL_NONE, 62));
+    TEST_ASSERT_EQUAL(MIDI_VOICE_NONE,
+                      midi_voice_find(&allocator, MIDI_CHANNEL_1, 200));
+
+    /* Without a handler the voices are still tracked */
+    midi_voice_init(&allocator, 0, NULL, NULL);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 60, 100);
+    send(MIDI_MESSAGE_NOTE_ON, MIDI_CHANNEL_1, 61, 100);
+    TEST_ASSERT_EQUAL(0, midi_voice_find(&allocator, MIDI_CHANNEL_1, 61));
+    TEST_ASSERT_EQUAL(1, midi_voice_count(&allocator));
+    TEST_ASSERT_EQUAL(3, event_count);
+}
+
+/*=====================================================================*
+    Model Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test against a model with few voices, so that notes are stolen
+ */
+void test_voice_model_few(void) { run_model(VOICES); }
+
+/**
+ * @brief Test against a model with more voices than notes
+ */
+void test_voice_model_many(void) { run_model(MIDI_VOICE_MAX_VOICES); }
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Allocation
+    RUN_TEST(test_voice_start_release);
+    RUN_TEST(test_voice_steal);
+
+    // Pedals
+    RUN_TEST(test_voice_sustain);
+    RUN_TEST(test_voice_sostenuto);
+    RUN_TEST(test_voice_pedal_other_channel);
+
+    // Channel Modes
+    RUN_TEST(test_voice_mono);
+    RUN_TEST(test_voice_channel_mode);
+    RUN_TEST(test_voice_dispatch);
+
+    // Model
+    RUN_TEST(test_voice_model_few);
+    RUN_TEST(test_voice_model_many);
+
+    return UNITY_END();
+}
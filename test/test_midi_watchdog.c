@@ -0,0 +1,295 @@
+/***********************************************************************
+ * @file test_midi_watchdog.c
+ * @brief Unit tests for the MIDI Active Sensing watchdog module
+ ***********************************************************************/
+
+/*=====================================================================*
+    System-wide Header Files
+ *=====================================================================*/
+#include "unity.h"
+#include <string.h>
+
+/*=====================================================================*
+    Local Header Files
+ *=====================================================================*/
+#include "../midi/midi.h"
+#include "../midi/midi_watchdog.h"
+
+/*=====================================================================*
+    Private Defines
+ *=====================================================================*/
+#define PORTS (300)
+#define MODEL_POLLS (20000)
+
+/*=====================================================================*
+    Private Data
+ *=====================================================================*/
+static uint32_t storage[MIDI_WATCHDOG_STORAGE_SIZE(PORTS) / 4];
+static midi_watchdog_t watchdog;
+static uint32_t expired[PORTS];
+static uint8_t model_armed[PORTS];
+static uint32_t model_last[PORTS];
+static uint8_t reported[PORTS];
+static uint32_t random_state;
+
+/*=====================================================================*
+    Test Setup and Teardown
+ *=====================================================================*/
+void setUp(void)
+{
+    midi_watchdog_init(&watchdog, (uint8_t *)storage, PORTS,
+                       MIDI_WATCHDOG_SENSE_TIMEOUT, 0);
+    memset(model_armed, 0, sizeof(model_armed));
+    random_state = 0x2545F491;
+}
+
+void tearDown(void) { /* Nothing to tear down */ }
+
+/*=====================================================================*
+    Helper Functions
+ *=====================================================================*/
+
+/**
+ * @brief Next pseudo random number
+ */
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/**
+ * @brief Poll a few ports at a time and compare the expired ports with
+ *        the armed ports of the model whose timeout has passed
+ */
+static void assert_poll(uint32_t now, uint32_t timeout, size_t chunk)
+{
+    size_t total = 0;
+    size_t count;
+
+    memset(reported, 0, sizeof(reported));
+    do {
+        count = midi_watchdog_poll(&watchdog, now, &expired[total], chunk);
+        for (size_t i = 0; i < count; i++) {
+            TEST_ASSERT_LESS_THAN(PORTS, expired[total + i]);
+            TEST_ASSERT_EQUAL(0, reported[expired[total + i]]);
+            reported[expired[total + i]] = 1;
+        }
+        total += count;
+    } while (count == chunk);
+
+    for (uint32_t port = 0; port < PORTS; port++) {
+        const int due = model_armed[port]
+                        && (int32_t)(model_last[port] + timeout - now) <= 0;
+        TEST_ASSERT_EQUAL_MESSAGE(due, reported[port], "expired port");
+        if (due) { model_armed[port] = 0; }
+        TEST_ASSERT_EQUAL(model_armed[port],
+                          midi_watchdog_is_armed(&watchdog, port) != 0);
+    }
+}
+
+/**
+ * @brief Drive the watchdog with random activity, disarms and polls at
+ *        random intervals, some of them long, against a model
+ */
+static void run_model(uint32_t timeout, uint32_t start)
+{
+    uint32_t now = start;
+
+    midi_watchdog_init(&watchdog, (uint8_t *)storage, PORTS, timeout, now);
+    for (size_t poll = 0; poll < MODEL_POLLS; poll++) {
+        const uint32_t r = next_random();
+        const uint32_t step = ((r & 0xFF) == 0) ? (r >> 8) % (4 * timeout)
+                              : ((r & 0x0F) == 0) ? (r >> 8) % timeout
+                                                  : 1 + (r >> 8) % 16;
+        const size_t feeds = next_random() % 8;
+
+        /* Activity at increasing times up to the poll */
+        for (size_t i = 0; i < feeds; i++) {
+            const uint32_t f = next_random();
+            const uint32_t port = f % PORTS;
+            const midi_message_type_t type = ((f >> 16) & 3) == 0
+                                                 ? MIDI_MESSAGE_ACTIVE_SENSE
+                                                 : MIDI_MESSAGE_NOTE_ON;
+            const uint32_t time = now + (uint32_t)(i + 1) * step / 8;
+
+            midi_watchdog_feed(&watchdog, port, type, time);
+            model_last[port] = time;
+            if (type == MIDI_MESSAGE_ACTIVE_SENSE) { model_armed[port] = 1; }
+        }
+        if ((r >> 24) == 0) {
+            const uint32_t port = next_random() % PORTS;
+            midi_watchdog_disarm(&watchdog, port);
+            model_armed[port] = 0;
+        }
+
+        now += step;
+        assert_poll(now, timeout, 1 + (r >> 28));
+    }
+}
+
+/*=====================================================================*
+    Timeout Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test that Active Sensing arms a port, activity postpones the
+ *        timeout and the port expires once
+ */
+void test_watchdog_timeout(void)
+{
+    midi_watchdog_feed(&watchdog, 7, MIDI_MESSAGE_NOTE_ON, 10);
+    TEST_ASSERT_FALSE(midi_watchdog_is_armed(&watchdog, 7));
+    TEST_ASSERT_EQUAL(0, midi_watchdog_poll(&watchdog, 1000, expired, PORTS));
+
+    midi_watchdog_feed(&watchdog, 7, MIDI_MESSAGE_ACTIVE_SENSE, 1000);
+    TEST_ASSERT_TRUE(midi_watchdog_is_armed(&watchdog, 7));
+    TEST_ASSERT_EQUAL(0, midi_watchdog_poll(&watchdog, 1299, expired, PORTS));
+
+    /* Any message postpones the timeout */
+    midi_watchdog_feed(&watchdog, 7, MIDI_MESSAGE_TIMING_CLOCK, 1200);
+    TEST_ASSERT_EQUAL(0, midi_watchdog_poll(&watchdog, 1300, expired, PORTS));
+    TEST_ASSERT_EQUAL(0, midi_watchdog_poll(&watchdog, 1499, expired, PORTS));
+    TEST_ASSERT_EQUAL(1, midi_watchdog_poll(&watchdog, 1500, expired, PORTS));
+    TEST_ASSERT_EQUAL(7, expired[0]);
+    TEST_ASSERT_FALSE(midi_watchdog_is_armed(&watchdog, 7));
+
+    /* Back in the normal mode, silence is not an error */
+    midi_watchdog_feed(&watchdog, 7, MIDI_MESSAGE_NOTE_OFF, 1600);
+    TEST_ASSERT_EQUAL(0,
+                      midi_watchdog_poll(&watchdog, 100000, expired, PORTS));
+}
+
+/**
+ * @brief Test disarming, unknown ports and invalid arguments
+ */
+void test_watchdog_disarm(void)
+{
+    midi_watchdog_feed(&watchdog, 0, MIDI_MESSAGE_ACTIVE_SENSE, 0);
+    midi_watchdog_feed(&watchdog, 1, MIDI_MESSAGE_ACTIVE_SENSE, 0);
+    midi_watchdog_disarm(&watchdog, 0);
+    midi_watchdog_disarm(&watchdog, 0);
+    TEST_ASSERT_FALSE(midi_watchdog_is_armed(&watchdog, 0));
+    TEST_ASSERT_EQUAL(1, midi_watchdog_poll(&watchdog, 300, expired, PORTS));
+    TEST_ASSERT_EQUAL(1, expired[0]);
+
+    midi_watchdog_feed(&watchdog, PORTS, MIDI_MESSAGE_ACTIVE_SENSE, 300);
+    TEST_ASSERT_FALSE(midi_watchdog_is_armed(&watchdog, PORTS));
+    midi_watchdog_feed(NULL, 0, MIDI_MESSAGE_ACTIVE_SENSE, 300);
+    midi_watchdog_disarm(NULL, 0);
+    TEST_ASSERT_FALSE(midi_watchdog_is_armed(NULL, 0));
+    TEST_ASSERT_EQUAL(0, midi_watchdog_poll(NULL, 1000, expired, PORTS));
+    TEST_ASSERT_EQUAL(0, midi_watchdog_poll(&watchdog, 1000, NULL, PORTS));
+}
+
+/**
+ * @brief Test that ports expiring together are read out a few at a time
+ */
+void test_watchdog_capacity(void)
+{
+    for (uint32_t port = 0; port < 100; port++) {
+        midi_watchdog_feed(&watchdog, port, MIDI_MESSAGE_ACTIVE_SENSE, 5);
+        model_armed[port] = 1;
+        model_last[port] = 5;
+    }
+    midi_watchdog_feed(&watchdog, 200, MIDI_MESSAGE_ACTIVE_SENSE, 6);
+    model_armed[200] = 1;
+    model_last[200] = 6;
+
+    assert_poll(305, MIDI_WATCHDOG_SENSE_TIMEOUT, 7);
+    TEST_ASSERT_TRUE(midi_watchdog_is_armed(&watchdog, 200));
+    assert_poll(306, MIDI_WATCHDOG_SENSE_TIMEOUT, 7);
+}
+
+/*=====================================================================*
+    Timer Wheel Tests
+ *=====================================================================*/
+
+/**
+ * @brief Test against a model with a timeout on the first level and
+ *        times that wrap around
+ */
+void test_watchdog_model_short(void)
+{
+    memset(model_last, 0, sizeof(model_last));
+    run_model(40, 0xFFFF0000u);
+}
+
+/**
+ * @brief Test against a model with the Active Sensing timeout
+ */
+void test_watchdog_model_sense(void)
+{
+    memset(model_last, 0, sizeof(model_last));
+    run_model(MIDI_WATCHDOG_SENSE_TIMEOUT, 12345);
+}
+
+/**
+ * @brief Test against a model with a timeout on the third level
+ */
+void test_watchdog_model_long(void)
+{
+    memset(model_last, 0, sizeof(model_last));
+    run_model(70000, 0xFFF00000u);
+}
+
+/**
+ * @brief Test the limits of the timeout
+ */
+void test_watchdog_timeout_limits(void)
+{
+    midi_watchdog_init(&watchdog, (uint8_t *)storage, PORTS, 0, 100);
+    midi_watchdog_feed(&watchdog, 3, MIDI_MESSAGE_ACTIVE_SENSE, 100);
+    TEST_ASSERT_EQUAL(1, midi_watchdog_poll(&watchdog, 101, expired, PORTS));
+
+    midi_watchdog_init(&watchdog, (uint8_t *)storage, PORTS, UINT32_MAX, 0);
+    midi_watchdog_feed(&watchdog, 3, MIDI_MESSAGE_ACTIVE_SENSE, 0);
+    TEST_ASSERT_EQUAL(0,
+                      midi_watchdog_poll(&watchdog,
+                                         MIDI_WATCHDOG_MAX_TIMEOUT - 2,
+                                         expired, PORTS));
+    TEST_ASSERT_EQUAL(1,
+                      midi_watchdog_poll(&watchdog,
+                                         MIDI_WATCHDOG_MAX_TIMEOUT - 1,
+                                         expired, PORTS));
+}
+
+/**
+ * @brief Test that storage that is not aligned to 4 bytes is refused
+ */
+void test_watchdog_init_storage(void)
+{
+    uint8_t *bytes = (uint8_t *)storage;
+
+    TEST_ASSERT_EQUAL(1, midi_watchdog_init(&watchdog, bytes, PORTS, 300, 0));
+    for (size_t offset = 1; offset < 4; offset++) {
+        TEST_ASSERT_EQUAL(0, midi_watchdog_init(&watchdog, bytes + offset,
+                                                PORTS, 300, 0));
+    }
+    TEST_ASSERT_EQUAL(0, midi_watchdog_init(NULL, bytes, PORTS, 300, 0));
+    TEST_ASSERT_EQUAL(0, midi_watchdog_init(&watchdog, NULL, PORTS, 300, 0));
+}
+
+/*=====================================================================*
+    Main Test Runner
+ *=====================================================================*/
+int main(void)
+{
+    UNITY_BEGIN();
+
+    // Timeout
+    RUN_TEST(test_watchdog_timeout);
+    RUN_TEST(test_watchdog_disarm);
+    RUN_TEST(test_watchdog_capacity);
+
+    // Timer Wheel
+    RUN_TEST(test_watchdog_model_short);
+    RUN_TEST(test_watchdog_model_sense);
+    RUN_TEST(test_watchdog_model_long);
+    RUN_TEST(test_watchdog_timeout_limits);
+    RUN_TEST(test_watchdog_init_storage);
+
+    return UNITY_END();
+}